@@ -82,6 +82,7 @@
 #define BLACKBOX_I_INTERVAL 32
 #define BLACKBOX_SHUTDOWN_TIMEOUT_MILLIS 200
 #define SLOW_FRAME_INTERVAL 4096
+#define BLACKBOX_HEADER_CHUNKS_PER_RUN 8
 
 #define ARRAY_LENGTH(x) (sizeof((x))/sizeof((x)[0]))
 
@@ -101,6 +102,16 @@ static const char blackboxHeader[] =
     "H Data version:2\n"
     "H I interval:" STR(BLACKBOX_I_INTERVAL) "\n";
 
+/*
+ * BLACKBOX_ENCODING_PACKED logs only differ in the P-frame predictors and encodings of the fields that version 2
+ * predicts from the average of the last two frames. The new version number makes viewers that don't know them turn
+ * the log down instead of misreading it.
+ */
+static const char blackboxPackedHeader[] =
+    "H Product:Blackbox flight data recorder by Nicholas Sherlock\n"
+    "H Data version:3\n"
+    "H I interval:" STR(BLACKBOX_I_INTERVAL) "\n";
+
 static const char* const blackboxFieldHeaderNames[] = {
     "name",
     "signed",
@@ -311,6 +322,38 @@ typedef struct blackboxSlowState_s {
     bool rxFlightChannelsValid;
 } __attribute__((__packed__)) blackboxSlowState_t; // We pack this struct so that padding doesn't interfere with memcmp()
 
+/*
+ * The flight loop only copies its state into this queue, the blackbox task encodes the frames and writes them out. Every
+ * producer and the encoder run from the main loop, never from an interrupt, so the two indexes are all the locking the
+ * queue needs. One slot is kept free to tell a full queue from an empty one.
+ */
+#ifndef BLACKBOX_QUEUE_SIZE
+#ifdef STM32F10X
+#define BLACKBOX_QUEUE_SIZE 4
+#else
+#define BLACKBOX_QUEUE_SIZE 16
+#endif
+#endif
+
+typedef enum {
+    BLACKBOX_QUEUE_INTRAFRAME,
+    BLACKBOX_QUEUE_INTERFRAME,
+    BLACKBOX_QUEUE_EVENT
+} blackboxQueueEntryType_e;
+
+typedef struct blackboxQueueEntry_s {
+    uint8_t type;
+    bool resume;                    // frames were skipped before this I-frame, log a resume event ahead of it
+    uint32_t iteration;
+    union {
+        struct {
+            blackboxMainState_t main;
+            blackboxSlowState_t slow;
+        } frame;
+        flightLogEvent_t event;
+    } u;
+} blackboxQueueEntry_t;
+
 //From mixer.c:
 extern uint8_t motorCount;
 
@@ -343,7 +386,16 @@ STATIC_ASSERT((sizeof(blackboxConditionCache) * 8) >= FLIGHT_LOG_FIELD_CONDITION
 
 static uint32_t blackboxIteration;
 static uint16_t blackboxPFrameIndex, blackboxIFrameIndex;
-static uint16_t blackboxSlowFrameIterationTimer;
+
+static uint32_t blackboxSlowFrameIteration;     // iteration of the last slow frame
+static bool blackboxSlowFrameDue;
+static uint16_t blackboxGpsHomeIFrameIndex;
+
+static blackboxQueueEntry_t blackboxQueue[BLACKBOX_QUEUE_SIZE];
+static volatile uint8_t blackboxQueueHead;      // only moved by the producers
+static volatile uint8_t blackboxQueueTail;      // only moved by the encoder
+static blackboxQueueStats_t blackboxQueueStats;
+static bool blackboxResumeNeeded;               // frames were dropped, wait for the next I-frame
 
 /*
  * We store voltages in I-frames relative to this, which was the voltage when the blackbox was activated.
@@ -361,6 +413,17 @@ static blackboxMainState_t blackboxHistoryRing[3];
 // These point into blackboxHistoryRing, use them to know where to store history of a given age (0, 1 or 2 generations old)
 static blackboxMainState_t* blackboxHistory[3];
 
+// The encoding of the current log, masterConfig.blackbox_encoding when it started
+static bool blackboxPackedEncoding;
+
+// Adaptive predictor and Rice parameter of gyroADC, accSmooth, attitude and motor in that order, reset by every I-frame
+#define BLACKBOX_ADAPTIVE_GYRO      0
+#define BLACKBOX_ADAPTIVE_ACC       (BLACKBOX_ADAPTIVE_GYRO + XYZ_AXIS_COUNT)
+#define BLACKBOX_ADAPTIVE_ATTITUDE  (BLACKBOX_ADAPTIVE_ACC + XYZ_AXIS_COUNT)
+#define BLACKBOX_ADAPTIVE_MOTOR     (BLACKBOX_ADAPTIVE_ATTITUDE + XYZ_AXIS_COUNT)
+
+static blackboxAdaptiveField_t blackboxAdaptiveFields[BLACKBOX_ADAPTIVE_MOTOR + MAX_SUPPORTED_MOTORS];
+
 static bool blackboxModeActivationConditionPresent = false;
 
 static bool blackboxIsOnlyLoggingIntraframes() {
@@ -473,7 +536,7 @@ static void blackboxSetState(BlackboxState newState)
             xmitState.headerIndex = 0;
         break;
         case BLACKBOX_STATE_RUNNING:
-            blackboxSlowFrameIterationTimer = SLOW_FRAME_INTERVAL; //Force a slow frame to be written on the first iteration
+            blackboxSlowFrameDue = true; //Force a slow frame to be written on the first iteration
         break;
         case BLACKBOX_STATE_SHUTTING_DOWN:
             xmitState.u.startTime = millis();
@@ -485,14 +548,14 @@ static void blackboxSetState(BlackboxState newState)
     blackboxState = newState;
 }
 
-static void writeIntraframe(void)
+static void writeIntraframe(uint32_t iteration)
 {
     blackboxMainState_t *blackboxCurrent = blackboxHistory[0];
     int x;
 
     blackboxWrite('I');
 
-    blackboxWriteUnsignedVB(blackboxIteration);
+    blackboxWriteUnsignedVB(iteration);
     blackboxWriteUnsignedVB(blackboxCurrent->time);
 
     blackboxWriteSignedVBArray(blackboxCurrent->axisPID_P, XYZ_AXIS_COUNT);
@@ -576,6 +639,13 @@ static void writeIntraframe(void)
     blackboxHistory[2] = blackboxHistory[0];
     //And advance the current state over to a blank space ready to be filled
     blackboxHistory[0] = ((blackboxHistory[0] - blackboxHistoryRing + 1) % 3) + blackboxHistoryRing;
+
+    //The packed fields of the next P-frames learn afresh, so that decoding can start at any I-frame
+    if (blackboxPackedEncoding) {
+        for (x = 0; x < BLACKBOX_ADAPTIVE_MOTOR + motorCount; x++) {
+            blackboxAdaptiveReset(&blackboxAdaptiveFields[x]);
+        }
+    }
 }
 
 static void blackboxWriteMainStateArrayUsingAveragePredictor(int arrOffsetInHistory, int count)
@@ -592,6 +662,15 @@ static void blackboxWriteMainStateArrayUsingAveragePredictor(int arrOffsetInHist
     }
 }
 
+static void blackboxWriteMainStateArrayUsingAdaptivePredictor(int arrOffsetInHistory, int count, blackboxAdaptiveField_t *fields)
+{
+    int16_t *curr  = (int16_t*) ((char*) (blackboxHistory[0]) + arrOffsetInHistory);
+    int16_t *prev1 = (int16_t*) ((char*) (blackboxHistory[1]) + arrOffsetInHistory);
+    int16_t *prev2 = (int16_t*) ((char*) (blackboxHistory[2]) + arrOffsetInHistory);
+
+    blackboxWriteAdaptiveS16Array(curr, prev1, prev2, fields, count);
+}
+
 static void writeInterframe(void)
 {
     int x;
@@ -677,11 +756,23 @@ static void writeInterframe(void)
 
     blackboxWriteTag8_8SVB(deltas, optionalFieldCount);
 
-    //Since gyros, accs and motors are noisy, base their predictions on the average of the history:
-    blackboxWriteMainStateArrayUsingAveragePredictor(offsetof(blackboxMainState_t, gyroADC),   XYZ_AXIS_COUNT);
-    blackboxWriteMainStateArrayUsingAveragePredictor(offsetof(blackboxMainState_t, accSmooth), XYZ_AXIS_COUNT);
-    blackboxWriteMainStateArrayUsingAveragePredictor(offsetof(blackboxMainState_t, attitude), XYZ_AXIS_COUNT);
-    blackboxWriteMainStateArrayUsingAveragePredictor(offsetof(blackboxMainState_t, motor),     motorCount);
+    if (blackboxPackedEncoding) {
+        /*
+         * Pick the predictor for each field that has been doing best lately and pack the residuals into as few bits as
+         * their recent size suggests, all four arrays in one bitstream.
+         */
+        blackboxWriteMainStateArrayUsingAdaptivePredictor(offsetof(blackboxMainState_t, gyroADC),   XYZ_AXIS_COUNT, &blackboxAdaptiveFields[BLACKBOX_ADAPTIVE_GYRO]);
+        blackboxWriteMainStateArrayUsingAdaptivePredictor(offsetof(blackboxMainState_t, accSmooth), XYZ_AXIS_COUNT, &blackboxAdaptiveFields[BLACKBOX_ADAPTIVE_ACC]);
+        blackboxWriteMainStateArrayUsingAdaptivePredictor(offsetof(blackboxMainState_t, attitude),  XYZ_AXIS_COUNT, &blackboxAdaptiveFields[BLACKBOX_ADAPTIVE_ATTITUDE]);
+        blackboxWriteMainStateArrayUsingAdaptivePredictor(offsetof(blackboxMainState_t, motor),     motorCount,     &blackboxAdaptiveFields[BLACKBOX_ADAPTIVE_MOTOR]);
+        blackboxFlushBits();
+    } else {
+        //Since gyros, accs and motors are noisy, base their predictions on the average of the history:
+        blackboxWriteMainStateArrayUsingAveragePredictor(offsetof(blackboxMainState_t, gyroADC),   XYZ_AXIS_COUNT);
+        blackboxWriteMainStateArrayUsingAveragePredictor(offsetof(blackboxMainState_t, accSmooth), XYZ_AXIS_COUNT);
+        blackboxWriteMainStateArrayUsingAveragePredictor(offsetof(blackboxMainState_t, attitude), XYZ_AXIS_COUNT);
+        blackboxWriteMainStateArrayUsingAveragePredictor(offsetof(blackboxMainState_t, motor),     motorCount);
+    }
 
     if (testBlackboxCondition(FLIGHT_LOG_FIELD_CONDITION_TRICOPTER)) {
         blackboxWriteSignedVB(blackboxCurrent->servo[5] - blackboxLast->servo[5]);
@@ -695,7 +786,7 @@ static void writeInterframe(void)
 
 /* Write the contents of the global "slowHistory" to the log as an "S" frame. Because this data is logged so
  * infrequently, delta updates are not reasonable, so we log independent frames. */
-static void writeSlowFrame(void)
+static void writeSlowFrame(uint32_t iteration)
 {
     int32_t values[3];
 
@@ -712,7 +803,8 @@ static void writeSlowFrame(void)
     values[2] = slowHistory.rxFlightChannelsValid ? 1 : 0;
     blackboxWriteTag2_3S32(values);
 
-    blackboxSlowFrameIterationTimer = 0;
+    blackboxSlowFrameIteration = iteration;
+    blackboxSlowFrameDue = false;
 }
 
 /**
@@ -728,33 +820,22 @@ static void loadSlowState(blackboxSlowState_t *slow)
 }
 
 /**
- * If the data in the slow frame has changed, log a slow frame.
+ * If the slow state captured with the frame of the given iteration has changed, log a slow frame.
  *
  * If allowPeriodicWrite is true, the frame is also logged if it has been more than SLOW_FRAME_INTERVAL logging iterations
  * since the field was last logged.
  */
-static void writeSlowFrameIfNeeded(bool allowPeriodicWrite)
+static void writeSlowFrameIfNeeded(const blackboxSlowState_t *newSlowState, uint32_t iteration, bool allowPeriodicWrite)
 {
     // Write the slow frame peridocially so it can be recovered if we ever lose sync
-    bool shouldWrite = allowPeriodicWrite && blackboxSlowFrameIterationTimer >= SLOW_FRAME_INTERVAL;
-
-    if (shouldWrite) {
-        loadSlowState(&slowHistory);
-    } else {
-        blackboxSlowState_t newSlowState;
-
-        loadSlowState(&newSlowState);
-
-        // Only write a slow frame if it was different from the previous state
-        if (memcmp(&newSlowState, &slowHistory, sizeof(slowHistory)) != 0) {
-            // Use the new state as our new history
-            memcpy(&slowHistory, &newSlowState, sizeof(slowHistory));
-            shouldWrite = true;
-        }
-    }
-
-    if (shouldWrite) {
-        writeSlowFrame();
+    bool shouldWrite = allowPeriodicWrite
+        && (blackboxSlowFrameDue || iteration - blackboxSlowFrameIteration >= SLOW_FRAME_INTERVAL);
+
+    // Only write a slow frame otherwise if it was different from the previous state
+    if (shouldWrite || memcmp(newSlowState, &slowHistory, sizeof(slowHistory)) != 0) {
+        // Use the new state as our new history
+        memcpy(&slowHistory, newSlowState, sizeof(slowHistory));
+        writeSlowFrame(iteration);
     }
 }
 
@@ -788,6 +869,10 @@ static void validateBlackboxConfig()
     if (masterConfig.blackbox_device >= BLACKBOX_DEVICE_END) {
         masterConfig.blackbox_device = BLACKBOX_DEVICE_SERIAL;
     }
+
+    if (masterConfig.blackbox_encoding > BLACKBOX_ENCODING_PACKED) {
+        masterConfig.blackbox_encoding = BLACKBOX_ENCODING_VB;
+    }
 }
 
 /**
@@ -811,6 +896,8 @@ void startBlackbox(void)
 
         vbatReference = vbatLatestADC;
 
+        blackboxPackedEncoding = masterConfig.blackbox_encoding == BLACKBOX_ENCODING_PACKED;
+
         //No need to clear the content of blackboxHistoryRing since our first frame will be an intra which overwrites it
 
         /*
@@ -825,6 +912,13 @@ void startBlackbox(void)
         blackboxIteration = 0;
         blackboxPFrameIndex = 0;
         blackboxIFrameIndex = 0;
+        blackboxGpsHomeIFrameIndex = UINT16_MAX;
+
+        // Whatever the last log left in the queue when the device filled up belongs to it
+        blackboxQueueHead = 0;
+        blackboxQueueTail = 0;
+        blackboxResumeNeeded = false;
+        memset(&blackboxQueueStats, 0, sizeof(blackboxQueueStats));
 
         /*
          * Record the beeper's current idea of the last arming beep time, so that we can detect it changing when
@@ -836,13 +930,18 @@ void startBlackbox(void)
     }
 }
 
+static bool blackboxEncodeQueue(void);
+static void writeEvent(FlightLogEvent event, const flightLogEventData_t *data);
+
 /**
  * Begin Blackbox shutdown.
  */
 void finishBlackbox(void)
 {
     if (blackboxState == BLACKBOX_STATE_RUNNING || blackboxState == BLACKBOX_STATE_PAUSED) {
-        blackboxLogEvent(FLIGHT_LOG_EVENT_LOG_END, NULL);
+        // The frames still queued go out ahead of the end of the log
+        blackboxEncodeQueue();
+        writeEvent(FLIGHT_LOG_EVENT_LOG_END, NULL);
 
         blackboxSetState(BLACKBOX_STATE_SHUTTING_DOWN);
     } else if (blackboxState != BLACKBOX_STATE_DISABLED && blackboxState != BLACKBOX_STATE_STOPPED
@@ -898,11 +997,10 @@ static void writeGPSFrame()
 #endif
 
 /**
- * Fill the current state of the blackbox using values read from the flight controller
+ * Fill the given state of the blackbox using values read from the flight controller
  */
-static void loadMainState(void)
+static void loadMainState(blackboxMainState_t *blackboxCurrent)
 {
-    blackboxMainState_t *blackboxCurrent = blackboxHistory[0];
     int i;
 
     blackboxCurrent->time = currentTime;
@@ -929,6 +1027,7 @@ static void loadMainState(void)
         blackboxCurrent->accSmooth[i] = accSmooth[i];
     }
 
+    imuUpdateEulerAngles();
     blackboxCurrent->attitude[0] = attitude.values.roll;
     blackboxCurrent->attitude[1] = attitude.values.pitch;
     blackboxCurrent->attitude[2] = attitude.values.yaw;
@@ -1061,6 +1160,11 @@ static bool sendFieldDefinition(char mainFrameChar, char deltaFrameChar, const v
                 if (def->fieldNameIndex != -1) {
                     blackboxPrintf("[%d]", def->fieldNameIndex);
                 }
+            } else if (blackboxPackedEncoding && deltaFrameChar && xmitState.headerIndex >= BLACKBOX_SIMPLE_FIELD_HEADER_COUNT
+                    && def->arr[BLACKBOX_SIMPLE_FIELD_HEADER_COUNT - 1] == FLIGHT_LOG_FIELD_PREDICTOR_AVERAGE_2) {
+                //The packed encoding replaces the P-frame predictor and encoding of the fields averaged in version 2
+                blackboxPrintf("%d", xmitState.headerIndex == BLACKBOX_SIMPLE_FIELD_HEADER_COUNT
+                    ? FLIGHT_LOG_FIELD_PREDICTOR_ADAPTIVE : FLIGHT_LOG_FIELD_ENCODING_RICE);
             } else {
                 //The other headers are integers
                 blackboxPrintf("%d", def->arr[xmitState.headerIndex - 1]);
@@ -1146,16 +1250,39 @@ static bool blackboxWriteSysinfo()
     return false;
 }
 
+// Returns the free slot at the head of the queue, or NULL if the encoder has fallen behind
+static blackboxQueueEntry_t *blackboxQueueReserve(void)
+{
+    if ((blackboxQueueHead + 1) % BLACKBOX_QUEUE_SIZE == blackboxQueueTail) {
+        return NULL;
+    }
+
+    return &blackboxQueue[blackboxQueueHead];
+}
+
+// Hands the slot from blackboxQueueReserve() over to the encoder
+static void blackboxQueueCommit(void)
+{
+    uint8_t queued;
+
+    blackboxQueueHead = (blackboxQueueHead + 1) % BLACKBOX_QUEUE_SIZE;
+
+    queued = (blackboxQueueHead + BLACKBOX_QUEUE_SIZE - blackboxQueueTail) % BLACKBOX_QUEUE_SIZE;
+    if (queued > blackboxQueueStats.maxQueued) {
+        blackboxQueueStats.maxQueued = queued;
+    }
+}
+
+const blackboxQueueStats_t *blackboxGetQueueStats(void)
+{
+    return &blackboxQueueStats;
+}
+
 /**
  * Write the given event to the log immediately
  */
-void blackboxLogEvent(FlightLogEvent event, flightLogEventData_t *data)
+static void writeEvent(FlightLogEvent event, const flightLogEventData_t *data)
 {
-    // Only allow events to be logged after headers have been written
-    if (!(blackboxState == BLACKBOX_STATE_RUNNING || blackboxState == BLACKBOX_STATE_PAUSED)) {
-        return;
-    }
-
     //Shared header for event frames
     blackboxWrite('E');
     blackboxWrite(event);
@@ -1189,6 +1316,32 @@ void blackboxLogEvent(FlightLogEvent event, flightLogEventData_t *data)
     }
 }
 
+/**
+ * Queue the given event, it is written to the log behind the frames queued before it
+ */
+void blackboxLogEvent(FlightLogEvent event, flightLogEventData_t *data)
+{
+    blackboxQueueEntry_t *entry;
+
+    // Only allow events to be logged after headers have been written
+    if (!(blackboxState == BLACKBOX_STATE_RUNNING || blackboxState == BLACKBOX_STATE_PAUSED)) {
+        return;
+    }
+
+    entry = blackboxQueueReserve();
+    if (!entry) {
+        blackboxQueueStats.droppedEvents++;
+        return;
+    }
+
+    entry->type = BLACKBOX_QUEUE_EVENT;
+    entry->u.event.event = event;
+    if (data) {
+        entry->u.event.data = *data;
+    }
+    blackboxQueueCommit();
+}
+
 /* If an arming beep has played since it was last logged, write the time of the arming beep to the log as a synchronization point */
 static void blackboxCheckAndLogArmingBeep()
 {
@@ -1200,7 +1353,7 @@ static void blackboxCheckAndLogArmingBeep()
 
         eventData.time = blackboxLastArmingBeep;
 
-        blackboxLogEvent(FLIGHT_LOG_EVENT_SYNC_BEEP, (flightLogEventData_t *) &eventData);
+        writeEvent(FLIGHT_LOG_EVENT_SYNC_BEEP, (flightLogEventData_t *) &eventData);
     }
 }
 
@@ -1223,7 +1376,6 @@ static bool blackboxShouldLogIFrame() {
 // Called once every FC loop in order to keep track of how many FC loop iterations have passed
 static void blackboxAdvanceIterationTimers()
 {
-    blackboxSlowFrameIterationTimer++;
     blackboxIteration++;
     blackboxPFrameIndex++;
 
@@ -1233,69 +1385,158 @@ static void blackboxAdvanceIterationTimers()
     }
 }
 
-// Called once every FC loop in order to log the current state
+// Called once every FC loop in order to queue the current state for the encoder
 static void blackboxLogIteration()
 {
+    blackboxQueueEntry_t *entry = NULL;
+    bool intraframe = blackboxShouldLogIFrame();
+
     // Write a keyframe every BLACKBOX_I_INTERVAL frames so we can resynchronise upon missing frames
-    if (blackboxShouldLogIFrame()) {
+    if (!intraframe && !blackboxShouldLogPFrame(blackboxPFrameIndex)) {
+        return;
+    }
+
+    // P-frames are predicted from the frames before them, once one is dropped the log can only go on from an I-frame
+    if (intraframe || !blackboxResumeNeeded) {
+        entry = blackboxQueueReserve();
+    }
+    if (!entry) {
+        blackboxQueueStats.droppedFrames++;
+        blackboxResumeNeeded = true;
+        return;
+    }
+
+    entry->type = intraframe ? BLACKBOX_QUEUE_INTRAFRAME : BLACKBOX_QUEUE_INTERFRAME;
+    entry->resume = blackboxResumeNeeded;
+    entry->iteration = blackboxIteration;
+    loadMainState(&entry->u.frame.main);
+    loadSlowState(&entry->u.frame.slow);
+    blackboxQueueCommit();
+
+    blackboxResumeNeeded = false;
+}
+
+static void blackboxEncodeFrame(const blackboxQueueEntry_t *entry)
+{
+    if (entry->resume) {
+        // Write a log entry so the decoder is aware that our large time/iteration skip is intended
+        flightLogEvent_loggingResume_t resume;
+
+        resume.logIteration = entry->iteration;
+        resume.currentTime = entry->u.frame.main.time;
+
+        writeEvent(FLIGHT_LOG_EVENT_LOGGING_RESUME, (flightLogEventData_t *) &resume);
+    }
+
+    memcpy(blackboxHistory[0], &entry->u.frame.main, sizeof(blackboxMainState_t));
+
+    if (entry->type == BLACKBOX_QUEUE_INTRAFRAME) {
         /*
          * Don't log a slow frame if the slow data didn't change ("I" frames are already large enough without adding
          * an additional item to write at the same time). Unless we're *only* logging "I" frames, then we have no choice.
          */
-        writeSlowFrameIfNeeded(blackboxIsOnlyLoggingIntraframes());
+        writeSlowFrameIfNeeded(&entry->u.frame.slow, entry->iteration, blackboxIsOnlyLoggingIntraframes());
 
-        loadMainState();
-        writeIntraframe();
+        writeIntraframe(entry->iteration);
     } else {
-        blackboxCheckAndLogArmingBeep();
-        
-        if (blackboxShouldLogPFrame(blackboxPFrameIndex)) {
-            /*
-             * We assume that slow frames are only interesting in that they aid the interpretation of the main data stream.
-             * So only log slow frames during loop iterations where we log a main frame.
-             */
-            writeSlowFrameIfNeeded(true);
+        /*
+         * We assume that slow frames are only interesting in that they aid the interpretation of the main data stream.
+         * So only log slow frames during loop iterations where we log a main frame.
+         */
+        writeSlowFrameIfNeeded(&entry->u.frame.slow, entry->iteration, true);
 
-            loadMainState();
-            writeInterframe();
-        }
-#ifdef GPS
-        if (feature(FEATURE_GPS)) {
-            /*
-             * If the GPS home point has been updated, or every 128 intraframes (~10 seconds), write the
-             * GPS home position.
-             *
-             * We write it periodically so that if one Home Frame goes missing, the GPS coordinates can
-             * still be interpreted correctly.
-             */
-            if (GPS_home[0] != gpsHistory.GPS_home[0] || GPS_home[1] != gpsHistory.GPS_home[1]
-                || (blackboxPFrameIndex == BLACKBOX_I_INTERVAL / 2 && blackboxIFrameIndex % 128 == 0)) {
-
-                writeGPSHomeFrame();
-                writeGPSFrame();
-            } else if (GPS_numSat != gpsHistory.GPS_numSat || GPS_coord[0] != gpsHistory.GPS_coord[0]
-                    || GPS_coord[1] != gpsHistory.GPS_coord[1]) {
-                //We could check for velocity changes as well but I doubt it changes independent of position
-                writeGPSFrame();
-            }
+        writeInterframe();
+    }
+}
+
+// Encodes everything queued so far, returns true if there was a main frame among it
+static bool blackboxEncodeQueue(void)
+{
+    bool encodedFrame = false;
+
+    while (blackboxQueueTail != blackboxQueueHead) {
+        const blackboxQueueEntry_t *entry = &blackboxQueue[blackboxQueueTail];
+
+        if (entry->type == BLACKBOX_QUEUE_EVENT) {
+            writeEvent(entry->u.event.event, &entry->u.event.data);
+        } else {
+            blackboxEncodeFrame(entry);
+            encodedFrame = true;
         }
-#endif
+        blackboxFlushFrame();
+
+        // The slot only goes back to the producers once it has been read
+        blackboxQueueTail = (blackboxQueueTail + 1) % BLACKBOX_QUEUE_SIZE;
     }
 
-    //Flush every iteration so that our runtime variance is minimized
-    blackboxDeviceFlush();
+    return encodedFrame;
+}
+
+#ifdef GPS
+static void writeGPSFramesIfNeeded(void)
+{
+    /*
+     * If the GPS home point has been updated, or every 128 intraframes (~10 seconds), write the
+     * GPS home position.
+     *
+     * We write it periodically so that if one Home Frame goes missing, the GPS coordinates can
+     * still be interpreted correctly.
+     */
+    if (GPS_home[0] != gpsHistory.GPS_home[0] || GPS_home[1] != gpsHistory.GPS_home[1]
+        || (blackboxIFrameIndex % 128 == 0 && blackboxIFrameIndex != blackboxGpsHomeIFrameIndex)) {
+
+        blackboxGpsHomeIFrameIndex = blackboxIFrameIndex;
+        writeGPSHomeFrame();
+        writeGPSFrame();
+    } else if (GPS_numSat != gpsHistory.GPS_numSat || GPS_coord[0] != gpsHistory.GPS_coord[0]
+            || GPS_coord[1] != gpsHistory.GPS_coord[1]) {
+        //We could check for velocity changes as well but I doubt it changes independent of position
+        writeGPSFrame();
+    }
 }
+#endif
 
 /**
- * Call each flight loop iteration to perform blackbox logging.
+ * Call each flight loop iteration to queue the flight state for logging. This only copies the state, updateBlackbox()
+ * encodes it and writes it to the device.
  */
 void handleBlackbox(void)
 {
-    int i;
+    switch (blackboxState) {
+        case BLACKBOX_STATE_PAUSED:
+            // Only allow resume to occur during an I-frame iteration, so that we have an "I" base to work from
+            if (IS_RC_MODE_ACTIVE(BOXBLACKBOX) && blackboxShouldLogIFrame()) {
+                // The encoder writes a resume event ahead of the I-frame
+                blackboxResumeNeeded = true;
+                blackboxSetState(BLACKBOX_STATE_RUNNING);
+
+                blackboxLogIteration();
+            }
+
+            // Keep the logging timers ticking so our log iteration continues to advance
+            blackboxAdvanceIterationTimers();
+        break;
+        case BLACKBOX_STATE_RUNNING:
+            // On entry to this state, blackboxIteration, blackboxPFrameIndex and blackboxIFrameIndex are reset to 0
+            if (blackboxModeActivationConditionPresent && !IS_RC_MODE_ACTIVE(BOXBLACKBOX)) {
+                blackboxSetState(BLACKBOX_STATE_PAUSED);
+            } else {
+                blackboxLogIteration();
+            }
 
-    if (blackboxState >= BLACKBOX_FIRST_HEADER_SENDING_STATE && blackboxState <= BLACKBOX_LAST_HEADER_SENDING_STATE) {
-        blackboxReplenishHeaderBudget();
+            blackboxAdvanceIterationTimers();
+        break;
+        default:
+        break;
     }
+}
+
+// Sends the next chunk of the headers
+static void blackboxSendHeader(void)
+{
+    int i;
+
+    blackboxReplenishHeaderBudget();
 
     switch (blackboxState) {
         case BLACKBOX_STATE_SEND_HEADER:
@@ -1306,13 +1547,15 @@ void handleBlackbox(void)
              * buffer, overflow the OpenLog's buffer, or keep the main loop busy for too long.
              */
             if (millis() > xmitState.u.startTime + 100) {
+                const char *header = blackboxPackedEncoding ? blackboxPackedHeader : blackboxHeader;
+
                 if (blackboxDeviceReserveBufferSpace(BLACKBOX_TARGET_HEADER_BUDGET_PER_ITERATION) == BLACKBOX_RESERVE_SUCCESS) {
-                    for (i = 0; i < BLACKBOX_TARGET_HEADER_BUDGET_PER_ITERATION && blackboxHeader[xmitState.headerIndex] != '\0'; i++, xmitState.headerIndex++) {
-                        blackboxWrite(blackboxHeader[xmitState.headerIndex]);
+                    for (i = 0; i < BLACKBOX_TARGET_HEADER_BUDGET_PER_ITERATION && header[xmitState.headerIndex] != '\0'; i++, xmitState.headerIndex++) {
+                        blackboxWrite(header[xmitState.headerIndex]);
                         blackboxHeaderBudget--;
                     }
 
-                    if (blackboxHeader[xmitState.headerIndex] == '\0') {
+                    if (header[xmitState.headerIndex] == '\0') {
                         blackboxSetState(BLACKBOX_STATE_SEND_MAIN_FIELD_HEADER);
                     }
                 }
@@ -1369,33 +1612,40 @@ void handleBlackbox(void)
                 }
             }
         break;
-        case BLACKBOX_STATE_PAUSED:
-            // Only allow resume to occur during an I-frame iteration, so that we have an "I" base to work from
-            if (IS_RC_MODE_ACTIVE(BOXBLACKBOX) && blackboxShouldLogIFrame()) {
-                // Write a log entry so the decoder is aware that our large time/iteration skip is intended
-                flightLogEvent_loggingResume_t resume;
+        default:
+        break;
+    }
 
-                resume.logIteration = blackboxIteration;
-                resume.currentTime = currentTime;
+    blackboxFlushFrame();
+}
 
-                blackboxLogEvent(FLIGHT_LOG_EVENT_LOGGING_RESUME, (flightLogEventData_t *) &resume);
-                blackboxSetState(BLACKBOX_STATE_RUNNING);
-                
-                blackboxLogIteration();
-            }
+/**
+ * Call from the blackbox task to send the headers, encode the frames queued by handleBlackbox() and flush the device.
+ */
+void updateBlackbox(void)
+{
+    int step;
 
-            // Keep the logging timers ticking so our log iteration continues to advance
-            blackboxAdvanceIterationTimers();
-        break;
+    // The flight loop used to send a chunk of the headers each iteration, keep up with it so the log starts as early
+    for (step = 0; step < BLACKBOX_HEADER_CHUNKS_PER_RUN
+            && blackboxState >= BLACKBOX_FIRST_HEADER_SENDING_STATE && blackboxState <= BLACKBOX_LAST_HEADER_SENDING_STATE; step++) {
+        blackboxSendHeader();
+    }
+
+    switch (blackboxState) {
+        case BLACKBOX_STATE_PAUSED:
         case BLACKBOX_STATE_RUNNING:
-            // On entry to this state, blackboxIteration, blackboxPFrameIndex and blackboxIFrameIndex are reset to 0
-            if (blackboxModeActivationConditionPresent && !IS_RC_MODE_ACTIVE(BOXBLACKBOX)) {
-                blackboxSetState(BLACKBOX_STATE_PAUSED);
-            } else {
-                blackboxLogIteration();
+            if (blackboxEncodeQueue()) {
+                blackboxCheckAndLogArmingBeep();
+#ifdef GPS
+                if (feature(FEATURE_GPS)) {
+                    writeGPSFramesIfNeeded();
+                }
+#endif
             }
 
-            blackboxAdvanceIterationTimers();
+            //Flush every run so that our runtime variance is minimized
+            blackboxDeviceFlushBackground();
         break;
         case BLACKBOX_STATE_SHUTTING_DOWN:
             //On entry of this state, startTime is set and a flush is performed
@@ -19,9 +19,23 @@
 
 #include "blackbox/blackbox_fielddefs.h"
 
+typedef enum {
+    BLACKBOX_ENCODING_VB = 0,       // data version 2, read by every log viewer
+    BLACKBOX_ENCODING_PACKED        // data version 3, gyro, acc, attitude and motors bit-packed with adaptive predictors
+} blackboxEncoding_e;
+
+typedef struct blackboxQueueStats_s {
+    uint32_t droppedFrames;     // the encoder fell behind, the log resumes at the next I-frame
+    uint32_t droppedEvents;
+    uint8_t maxQueued;          // most entries waiting for the encoder at once
+} blackboxQueueStats_t;
+
 void blackboxLogEvent(FlightLogEvent event, flightLogEventData_t *data);
 
 void initBlackbox(void);
 void handleBlackbox(void);
+void updateBlackbox(void);
 void startBlackbox(void);
 void finishBlackbox(void);
+
+const blackboxQueueStats_t *blackboxGetQueueStats(void);
@@ -0,0 +1,116 @@
+/*
+ * This file is part of Cleanflight.
+ *
+ * Cleanflight is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cleanflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cleanflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+/*
+ * Per field state of the packed P-frame encoding (data version 3), FLIGHT_LOG_FIELD_PREDICTOR_ADAPTIVE with
+ * FLIGHT_LOG_FIELD_ENCODING_RICE. Both the predictor and the Rice parameter are worked out from the values already
+ * logged, so the writer and the decoder arrive at the same ones without anything extra in the log. The state starts
+ * over at every I-frame.
+ */
+
+#include <stdint.h>
+
+typedef enum {
+    BLACKBOX_ADAPTIVE_AVERAGE_2 = 0,    // what data version 2 uses for these fields, the first choice on a tie
+    BLACKBOX_ADAPTIVE_PREVIOUS,
+    BLACKBOX_ADAPTIVE_STRAIGHT_LINE,    // linear extrapolation from the last two values
+    BLACKBOX_ADAPTIVE_PREDICTOR_COUNT
+} blackboxAdaptivePredictor_e;
+
+// The errors of the predictors and the size of the residuals are averaged over about 2^shift frames
+#define BLACKBOX_ADAPTIVE_ERROR_SHIFT 3
+#define BLACKBOX_ADAPTIVE_RESIDUAL_SHIFT 4
+
+#define BLACKBOX_RICE_MAX_PARAMETER 20
+// A quotient this long is an escape, the zigzagged residual follows in 32 bits
+#define BLACKBOX_RICE_ESCAPE_LENGTH 16
+
+typedef struct blackboxAdaptiveField_s {
+    uint32_t predictorError[BLACKBOX_ADAPTIVE_PREDICTOR_COUNT];
+    uint32_t residualSum;
+    uint8_t predictor;                  // blackboxAdaptivePredictor_e with the smallest error so far
+} blackboxAdaptiveField_t;
+
+static inline void blackboxAdaptiveReset(blackboxAdaptiveField_t *field)
+{
+    field->predictorError[BLACKBOX_ADAPTIVE_AVERAGE_2] = 0;
+    field->predictorError[BLACKBOX_ADAPTIVE_PREVIOUS] = 0;
+    field->predictorError[BLACKBOX_ADAPTIVE_STRAIGHT_LINE] = 0;
+    field->residualSum = 0;
+    field->predictor = BLACKBOX_ADAPTIVE_AVERAGE_2;
+}
+
+// The predictions of all the predictors, indexed by blackboxAdaptivePredictor_e
+static inline void blackboxAdaptivePredictions(int32_t *predictions, int32_t previous, int32_t previous2)
+{
+    predictions[BLACKBOX_ADAPTIVE_AVERAGE_2] = (int32_t)((uint32_t)previous + (uint32_t)previous2) / 2;
+    predictions[BLACKBOX_ADAPTIVE_PREVIOUS] = previous;
+    predictions[BLACKBOX_ADAPTIVE_STRAIGHT_LINE] = (int32_t)(2 * (uint32_t)previous - (uint32_t)previous2);
+}
+
+// Errors of 16 bit fields stay well clear of overflow, anything else just wraps
+static inline uint32_t blackboxAdaptiveErrorUpdate(uint32_t error, int32_t value, int32_t prediction)
+{
+    int32_t difference = (int32_t)((uint32_t)value - (uint32_t)prediction);
+    uint32_t magnitude = difference < 0 ? -(uint32_t)difference : (uint32_t)difference;
+
+    return error + magnitude - (error >> BLACKBOX_ADAPTIVE_ERROR_SHIFT);
+}
+
+// Scores every predictor against the value that was logged and picks the one to use for the next frame
+static inline void blackboxAdaptiveLearnValue(blackboxAdaptiveField_t *field, int32_t value, const int32_t *predictions)
+{
+    uint32_t *error = field->predictorError;
+    uint8_t best = BLACKBOX_ADAPTIVE_AVERAGE_2;
+
+    for (int i = 0; i < BLACKBOX_ADAPTIVE_PREDICTOR_COUNT; i++) {
+        error[i] = blackboxAdaptiveErrorUpdate(error[i], value, predictions[i]);
+    }
+
+    if (error[BLACKBOX_ADAPTIVE_PREVIOUS] < error[best]) {
+        best = BLACKBOX_ADAPTIVE_PREVIOUS;
+    }
+    if (error[BLACKBOX_ADAPTIVE_STRAIGHT_LINE] < error[best]) {
+        best = BLACKBOX_ADAPTIVE_STRAIGHT_LINE;
+    }
+    field->predictor = best;
+}
+
+// The Rice parameter k for the next residual, the smallest with 2^k at least the mean of the recent zigzagged residuals
+static inline int blackboxAdaptiveRiceParameter(const blackboxAdaptiveField_t *field)
+{
+    uint32_t mean = (field->residualSum + (1 << BLACKBOX_ADAPTIVE_RESIDUAL_SHIFT) - 1) >> BLACKBOX_ADAPTIVE_RESIDUAL_SHIFT;
+    int k;
+
+    if (mean <= 1) {
+        return 0;
+    }
+
+    k = 32 - __builtin_clz(mean - 1);
+
+    return k < BLACKBOX_RICE_MAX_PARAMETER ? k : BLACKBOX_RICE_MAX_PARAMETER;
+}
+
+static inline void blackboxAdaptiveLearnResidual(blackboxAdaptiveField_t *field, uint32_t zigzagResidual)
+{
+    if (zigzagResidual > UINT16_MAX) {
+        zigzagResidual = UINT16_MAX;
+    }
+    field->residualSum += zigzagResidual - (field->residualSum >> BLACKBOX_ADAPTIVE_RESIDUAL_SHIFT);
+}
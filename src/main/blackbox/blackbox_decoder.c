@@ -0,0 +1,1068 @@
+/*
+ * This file is part of Cleanflight.
+ *
+ * Cleanflight is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cleanflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cleanflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common/encoding.h"
+
+#include "blackbox/blackbox_fielddefs.h"
+#include "blackbox/blackbox_adaptive.h"
+#include "blackbox/blackbox_decoder.h"
+
+static const char logStartMarker[] = "H Product:Blackbox flight data recorder by Nicholas Sherlock\n";
+static const char logEndMessage[] = "End of log";
+
+// An I-frame that jumps further than this from the last main frame is taken to be corrupt
+#define MAXIMUM_ITERATION_JUMP_BETWEEN_FRAMES (500 * 32)
+#define MAXIMUM_TIME_JUMP_BETWEEN_FRAMES (10 * 1000000)
+
+static const char frameTypeChars[BLACKBOX_FRAME_TYPE_COUNT] = { 'I', 'P', 'G', 'H', 'S' };
+
+/* Reading the input */
+
+// Makes sure a whole frame or header line is in the buffer, unless the input ends first
+static void fillBuffer(blackboxDecoder_t *decoder)
+{
+    int remaining = decoder->end - decoder->pos;
+
+    if (remaining >= BLACKBOX_DECODER_MAX_FRAME_SIZE || decoder->inputEnded) {
+        return;
+    }
+
+    memmove(decoder->buffer, decoder->pos, remaining);
+    decoder->bufferOffset += decoder->pos - decoder->buffer;
+    decoder->pos = decoder->buffer;
+
+    uint8_t *end = decoder->buffer + remaining;
+    while (end < decoder->buffer + BLACKBOX_DECODER_BUFFER_SIZE) {
+        int length = decoder->read(decoder->readContext, end, decoder->buffer + BLACKBOX_DECODER_BUFFER_SIZE - end);
+
+        if (length <= 0) {
+            decoder->inputEnded = true;
+            break;
+        }
+        end += length;
+    }
+    decoder->end = end;
+
+    // Reads past the end of the input find zeros, which end any field, see readByte()
+    memset(end, 0, BLACKBOX_DECODER_MAX_FRAME_SIZE);
+}
+
+static uint64_t inputOffset(const blackboxDecoder_t *decoder, const uint8_t *pos)
+{
+    return decoder->bufferOffset + (pos - decoder->buffer);
+}
+
+/*
+ * Frames are read without checking for the end of the buffer, there are always BLACKBOX_DECODER_MAX_FRAME_SIZE bytes
+ * behind it and zeros once the input has ended. frameEndsCleanly() finds frames that ran past the end.
+ */
+static uint8_t readByte(blackboxDecoder_t *decoder)
+{
+    return *decoder->pos++;
+}
+
+static uint32_t readUnsignedVB(blackboxDecoder_t *decoder)
+{
+    uint32_t result = 0;
+
+    // 5 bytes at most for 32 bits
+    for (int shift = 0; shift < 35; shift += 7) {
+        uint8_t c = readByte(decoder);
+
+        result |= (uint32_t)(c & 0x7F) << shift;
+        if (c < 128) {
+            return result;
+        }
+    }
+
+    decoder->corrupt = true;
+    return 0;
+}
+
+static int32_t readSignedVB(blackboxDecoder_t *decoder)
+{
+    return zigzagDecode(readUnsignedVB(decoder));
+}
+
+static int32_t signExtend(uint32_t value, int bits)
+{
+    return (int32_t)(value << (32 - bits)) >> (32 - bits);
+}
+
+static void readTag2_3S32(blackboxDecoder_t *decoder, int32_t *values)
+{
+    uint8_t leadByte = readByte(decoder);
+    uint8_t byte1, byte2;
+
+    switch (leadByte >> 6) {
+        case 0:
+            values[0] = signExtend((leadByte >> 4) & 0x03, 2);
+            values[1] = signExtend((leadByte >> 2) & 0x03, 2);
+            values[2] = signExtend(leadByte & 0x03, 2);
+        break;
+        case 1:
+            byte1 = readByte(decoder);
+            values[0] = signExtend(leadByte & 0x0F, 4);
+            values[1] = signExtend(byte1 >> 4, 4);
+            values[2] = signExtend(byte1 & 0x0F, 4);
+        break;
+        case 2:
+            byte1 = readByte(decoder);
+            byte2 = readByte(decoder);
+            values[0] = signExtend(leadByte & 0x3F, 6);
+            values[1] = signExtend(byte1 & 0x3F, 6);
+            values[2] = signExtend(byte2 & 0x3F, 6);
+        break;
+        case 3:
+            // Each field has a byte count in the low bits of the lead byte, the first field in the lowest
+            for (int i = 0; i < 3; i++, leadByte >>= 2) {
+                int byteCount = (leadByte & 0x03) + 1;
+                uint32_t value = 0;
+
+                for (int b = 0; b < byteCount; b++) {
+                    value |= (uint32_t)readByte(decoder) << (8 * b);
+                }
+                values[i] = signExtend(value, 8 * byteCount);
+            }
+        break;
+    }
+}
+
+static void readTag8_4S16(blackboxDecoder_t *decoder, int32_t *values)
+{
+    uint8_t selector = readByte(decoder);
+    uint8_t buffer = 0;
+    bool nibblePending = false;     // the low nibble of buffer has not been used yet
+
+    for (int i = 0; i < 4; i++, selector >>= 2) {
+        uint32_t value;
+
+        switch (selector & 0x03) {
+            case 0:
+                values[i] = 0;
+            break;
+            case 1:
+                if (nibblePending) {
+                    value = buffer & 0x0F;
+                    nibblePending = false;
+                } else {
+                    buffer = readByte(decoder);
+                    value = buffer >> 4;
+                    nibblePending = true;
+                }
+                values[i] = signExtend(value, 4);
+            break;
+            case 2:
+                if (nibblePending) {
+                    value = (buffer & 0x0F) << 4;
+                    buffer = readByte(decoder);
+                    value |= buffer >> 4;
+                } else {
+                    value = readByte(decoder);
+                }
+                values[i] = signExtend(value, 8);
+            break;
+            case 3:
+                if (nibblePending) {
+                    value = (buffer & 0x0F) << 12;
+                    value |= readByte(decoder) << 4;
+                    buffer = readByte(decoder);
+                    value |= buffer >> 4;
+                } else {
+                    value = readByte(decoder) << 8;
+                    value |= readByte(decoder);
+                }
+                values[i] = signExtend(value, 16);
+            break;
+        }
+    }
+}
+
+static void readTag8_8SVB(blackboxDecoder_t *decoder, int32_t *values, int valueCount)
+{
+    // The writer leaves the header out when there is only one field
+    if (valueCount == 1) {
+        values[0] = readSignedVB(decoder);
+        return;
+    }
+
+    uint8_t header = readByte(decoder);
+
+    for (int i = 0; i < valueCount; i++, header >>= 1) {
+        values[i] = (header & 0x01) ? readSignedVB(decoder) : 0;
+    }
+}
+
+typedef struct bitReader_s {
+    uint32_t buffer;
+    int count;
+} bitReader_t;
+
+// Reads count bits, at most 24, the oldest ones come first
+static uint32_t readBits(blackboxDecoder_t *decoder, bitReader_t *reader, int count)
+{
+    while (reader->count < count) {
+        reader->buffer = (reader->buffer << 8) | readByte(decoder);
+        reader->count += 8;
+    }
+    reader->count -= count;
+
+    return (reader->buffer >> reader->count) & (((uint32_t)1 << count) - 1);
+}
+
+// Reads the bitstream of neighbouring Rice coded fields, the counterpart of blackboxWriteAdaptiveS16Array()
+static void readRiceFields(blackboxDecoder_t *decoder, blackboxAdaptiveField_t *fields, int32_t *values, int valueCount)
+{
+    bitReader_t reader = { 0, 0 };
+
+    for (int i = 0; i < valueCount; i++) {
+        int k = blackboxAdaptiveRiceParameter(&fields[i]);
+        uint32_t quotient = 0;
+        uint32_t residual;
+
+        while (quotient < BLACKBOX_RICE_ESCAPE_LENGTH && readBits(decoder, &reader, 1)) {
+            quotient++;
+        }
+
+        if (quotient == BLACKBOX_RICE_ESCAPE_LENGTH) {
+            residual = readBits(decoder, &reader, 16) << 16;
+            residual |= readBits(decoder, &reader, 16);
+        } else {
+            residual = (quotient << k) | readBits(decoder, &reader, k);
+        }
+
+        blackboxAdaptiveLearnResidual(&fields[i], residual);
+        values[i] = zigzagDecode(residual);
+    }
+}
+
+// Reads the encoded fields of a frame, before the predictors are added back
+static void readFrameFields(blackboxDecoder_t *decoder, const blackboxFrameDefinition_t *def, int32_t *values)
+{
+    for (int i = 0; i < def->fieldCount; i++) {
+        int groupCount;
+
+        switch (def->encoding[i]) {
+            case FLIGHT_LOG_FIELD_ENCODING_SIGNED_VB:
+                values[i] = readSignedVB(decoder);
+            break;
+            case FLIGHT_LOG_FIELD_ENCODING_UNSIGNED_VB:
+                values[i] = readUnsignedVB(decoder);
+            break;
+            case FLIGHT_LOG_FIELD_ENCODING_NEG_14BIT:
+                values[i] = -signExtend(readUnsignedVB(decoder), 14);
+            break;
+            case FLIGHT_LOG_FIELD_ENCODING_TAG8_8SVB:
+                // Up to 8 neighbouring fields with this encoding share the header
+                for (groupCount = 1; groupCount < 8 && i + groupCount < def->fieldCount; groupCount++) {
+                    if (def->encoding[i + groupCount] != FLIGHT_LOG_FIELD_ENCODING_TAG8_8SVB) {
+                        break;
+                    }
+                }
+                readTag8_8SVB(decoder, values + i, groupCount);
+                i += groupCount - 1;
+            break;
+            case FLIGHT_LOG_FIELD_ENCODING_TAG2_3S32:
+                readTag2_3S32(decoder, values + i);
+                i += 2;
+            break;
+            case FLIGHT_LOG_FIELD_ENCODING_TAG8_4S16:
+                readTag8_4S16(decoder, values + i);
+                i += 3;
+            break;
+            case FLIGHT_LOG_FIELD_ENCODING_RICE:
+                // All the neighbouring fields with this encoding share one bitstream, checkHeaders() keeps it to P-frames
+                for (groupCount = 1; i + groupCount < def->fieldCount; groupCount++) {
+                    if (def->encoding[i + groupCount] != FLIGHT_LOG_FIELD_ENCODING_RICE) {
+                        break;
+                    }
+                }
+                readRiceFields(decoder, decoder->adaptiveFields + i, values + i, groupCount);
+                i += groupCount - 1;
+            break;
+            case FLIGHT_LOG_FIELD_ENCODING_NULL:
+            default:
+                values[i] = 0;
+            break;
+        }
+    }
+}
+
+/* Predictors */
+
+// Loop iterations that are left out of the log on purpose by the P interval, the counterpart of blackboxShouldLogPFrame()
+static bool shouldHaveFrame(const blackboxDecoder_t *decoder, uint32_t iteration)
+{
+    return (iteration % decoder->frameIntervalI + decoder->frameIntervalPNum - 1) % decoder->frameIntervalPDenom
+        < (uint32_t)decoder->frameIntervalPNum;
+}
+
+static uint32_t nextLoggedIteration(const blackboxDecoder_t *decoder, uint32_t iteration)
+{
+    if (decoder->frameIntervalPNum == decoder->frameIntervalPDenom) {
+        return iteration + 1;
+    }
+
+    do {
+        iteration++;
+    } while (!shouldHaveFrame(decoder, iteration));
+
+    return iteration;
+}
+
+/*
+ * Adds the predictors of def back to the fields. The previous values come from the main history for main frames,
+ * returns false if a predictor needs something the log has not had yet.
+ */
+static bool applyPredictors(blackboxDecoder_t *decoder, const blackboxFrameDefinition_t *def, const uint8_t *isSigned,
+        int32_t *values)
+{
+    const int32_t *previous = decoder->mainHistory[1];
+    const int32_t *previous2 = decoder->mainHistory[2];
+    int homeCoord = 0;
+
+    for (int i = 0; i < def->fieldCount; i++) {
+        int32_t adaptivePredictions[BLACKBOX_ADAPTIVE_PREDICTOR_COUNT];
+        uint32_t predictor;
+
+        switch (def->predictor[i]) {
+            case FLIGHT_LOG_FIELD_PREDICTOR_PREVIOUS:
+                predictor = previous[i];
+            break;
+            case FLIGHT_LOG_FIELD_PREDICTOR_STRAIGHT_LINE:
+                predictor = 2 * (uint32_t)previous[i] - (uint32_t)previous2[i];
+            break;
+            case FLIGHT_LOG_FIELD_PREDICTOR_AVERAGE_2:
+                if (isSigned[i]) {
+                    predictor = (int32_t)(((int64_t)previous[i] + previous2[i]) / 2);
+                } else {
+                    predictor = (uint32_t)(((uint64_t)(uint32_t)previous[i] + (uint32_t)previous2[i]) / 2);
+                }
+            break;
+            case FLIGHT_LOG_FIELD_PREDICTOR_MINTHROTTLE:
+                predictor = decoder->minthrottle;
+            break;
+            case FLIGHT_LOG_FIELD_PREDICTOR_MOTOR_0:
+                predictor = values[decoder->motor0Field];
+            break;
+            case FLIGHT_LOG_FIELD_PREDICTOR_INC:
+                predictor = nextLoggedIteration(decoder, previous[i]);
+            break;
+            case FLIGHT_LOG_FIELD_PREDICTOR_HOME_COORD:
+                if (!decoder->gpsHomeValid || homeCoord >= 2) {
+                    return false;
+                }
+                predictor = decoder->gpsHome[homeCoord++];
+            break;
+            case FLIGHT_LOG_FIELD_PREDICTOR_1500:
+                predictor = 1500;
+            break;
+            case FLIGHT_LOG_FIELD_PREDICTOR_VBATREF:
+                predictor = decoder->vbatref;
+            break;
+            case FLIGHT_LOG_FIELD_PREDICTOR_LAST_MAIN_FRAME_TIME:
+                if (!decoder->lastMainValid) {
+                    return false;
+                }
+                predictor = decoder->lastMainTime;
+            break;
+            case FLIGHT_LOG_FIELD_PREDICTOR_ADAPTIVE:
+                blackboxAdaptivePredictions(adaptivePredictions, previous[i], previous2[i]);
+                predictor = adaptivePredictions[decoder->adaptiveFields[i].predictor];
+            break;
+            case FLIGHT_LOG_FIELD_PREDICTOR_0:
+            default:
+                predictor = 0;
+            break;
+        }
+
+        values[i] = (int32_t)((uint32_t)values[i] + predictor);
+
+        if (def->predictor[i] == FLIGHT_LOG_FIELD_PREDICTOR_ADAPTIVE) {
+            blackboxAdaptiveLearnValue(&decoder->adaptiveFields[i], values[i], adaptivePredictions);
+        }
+    }
+
+    return true;
+}
+
+/* Headers */
+
+static blackboxFrameDefinition_t *findFrameDefinition(blackboxDecoder_t *decoder, char frameChar)
+{
+    for (int i = 0; i < BLACKBOX_FRAME_TYPE_COUNT; i++) {
+        if (frameTypeChars[i] == frameChar) {
+            return &decoder->frameDefs[i];
+        }
+    }
+
+    return NULL;
+}
+
+static int parseFieldNames(blackboxFrameDefinition_t *def, const char *value, const char *valueEnd)
+{
+    int count = 0;
+
+    while (value < valueEnd && count < BLACKBOX_DECODER_MAX_FIELDS) {
+        const char *comma = memchr(value, ',', valueEnd - value);
+        int length = (comma ? comma : valueEnd) - value;
+
+        if (length >= BLACKBOX_DECODER_MAX_FIELD_NAME) {
+            length = BLACKBOX_DECODER_MAX_FIELD_NAME - 1;
+        }
+        memcpy(def->names[count], value, length);
+        def->names[count][length] = '\0';
+        count++;
+
+        value = comma ? comma + 1 : valueEnd;
+    }
+
+    return count;
+}
+
+static int parseFieldIntegers(uint8_t *dest, const char *value, const char *valueEnd)
+{
+    int count = 0;
+
+    while (value < valueEnd && count < BLACKBOX_DECODER_MAX_FIELDS) {
+        dest[count++] = atoi(value);
+
+        const char *comma = memchr(value, ',', valueEnd - value);
+        value = comma ? comma + 1 : valueEnd;
+    }
+
+    return count;
+}
+
+static bool headerKeyIs(const char *key, int keyLength, const char *expected)
+{
+    return keyLength == (int)strlen(expected) && memcmp(key, expected, keyLength) == 0;
+}
+
+// line runs from after the "H " to before the newline
+static void parseHeaderLine(blackboxDecoder_t *decoder, const char *line, const char *lineEnd)
+{
+    const char *colon = memchr(line, ':', lineEnd - line);
+
+    if (!colon) {
+        return;
+    }
+
+    int keyLength = colon - line;
+    const char *value = colon + 1;
+    char number[16];
+    int numberLength = lineEnd - value < (int)sizeof(number) - 1 ? lineEnd - value : (int)sizeof(number) - 1;
+
+    memcpy(number, value, numberLength);
+    number[numberLength] = '\0';
+
+    if (keyLength > 8 && memcmp(line, "Field ", 6) == 0 && line[7] == ' ') {
+        char frameChar = line[6];
+        const char *property = line + 8;
+        int propertyLength = colon - property;
+        blackboxFrameDefinition_t *def = findFrameDefinition(decoder, frameChar);
+
+        if (!def) {
+            return;
+        }
+
+        // P-frames use the names and signedness of the I-frame
+        if (headerKeyIs(property, propertyLength, "name")) {
+            def->fieldCount = parseFieldNames(def, value, lineEnd);
+        } else if (headerKeyIs(property, propertyLength, "signed")) {
+            parseFieldIntegers(def->isSigned, value, lineEnd);
+        } else if (headerKeyIs(property, propertyLength, "predictor")) {
+            int count = parseFieldIntegers(def->predictor, value, lineEnd);
+
+            if (frameChar == 'P') {
+                def->fieldCount = count;
+            }
+        } else if (headerKeyIs(property, propertyLength, "encoding")) {
+            parseFieldIntegers(def->encoding, value, lineEnd);
+        }
+    } else if (headerKeyIs(line, keyLength, "Data version")) {
+        decoder->dataVersion = atoi(number);
+    } else if (headerKeyIs(line, keyLength, "I interval")) {
+        decoder->frameIntervalI = atoi(number);
+    } else if (headerKeyIs(line, keyLength, "P interval")) {
+        const char *slash = strchr(number, '/');
+
+        decoder->frameIntervalPNum = atoi(number);
+        decoder->frameIntervalPDenom = slash ? atoi(slash + 1) : 1;
+    } else if (headerKeyIs(line, keyLength, "minthrottle")) {
+        decoder->minthrottle = atoi(number);
+    } else if (headerKeyIs(line, keyLength, "vbatref")) {
+        decoder->vbatref = atoi(number);
+    } else if (headerKeyIs(line, keyLength, "gyro.scale")) {
+        // the bits of the float, in hex
+        uint32_t bits = strtoul(number, NULL, 16);
+
+        memcpy(&decoder->gyroScale, &bits, sizeof(decoder->gyroScale));
+    } else if (headerKeyIs(line, keyLength, "Firmware revision")) {
+        int length = lineEnd - value < BLACKBOX_DECODER_MAX_FIELD_NAME - 1 ? lineEnd - value : BLACKBOX_DECODER_MAX_FIELD_NAME - 1;
+
+        memcpy(decoder->firmwareRevision, value, length);
+        decoder->firmwareRevision[length] = '\0';
+    }
+}
+
+static bool isSupportedEncoding(uint8_t encoding)
+{
+    switch (encoding) {
+        case FLIGHT_LOG_FIELD_ENCODING_SIGNED_VB:
+        case FLIGHT_LOG_FIELD_ENCODING_UNSIGNED_VB:
+        case FLIGHT_LOG_FIELD_ENCODING_NEG_14BIT:
+        case FLIGHT_LOG_FIELD_ENCODING_TAG8_8SVB:
+        case FLIGHT_LOG_FIELD_ENCODING_TAG2_3S32:
+        case FLIGHT_LOG_FIELD_ENCODING_TAG8_4S16:
+        case FLIGHT_LOG_FIELD_ENCODING_NULL:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Data version 3 adds the packed P-frame fields, always the adaptive predictor with the Rice code
+static bool isPackedField(const blackboxFrameDefinition_t *def, int i)
+{
+    return def->predictor[i] == FLIGHT_LOG_FIELD_PREDICTOR_ADAPTIVE || def->encoding[i] == FLIGHT_LOG_FIELD_ENCODING_RICE;
+}
+
+// Returns NULL if the log can be decoded, otherwise why not
+static const char *checkHeaders(blackboxDecoder_t *decoder)
+{
+    blackboxFrameDefinition_t *intraDef = &decoder->frameDefs[BLACKBOX_FRAME_INTRA];
+    blackboxFrameDefinition_t *interDef = &decoder->frameDefs[BLACKBOX_FRAME_INTER];
+
+    if (decoder->dataVersion != 2 && decoder->dataVersion != 3) {
+        return "unsupported data version";
+    }
+    if (intraDef->fieldCount == 0 || interDef->fieldCount != intraDef->fieldCount) {
+        return "missing main frame field definitions";
+    }
+    if (decoder->frameIntervalI <= 0 || decoder->frameIntervalPNum <= 0 || decoder->frameIntervalPDenom <= 0) {
+        return "bad frame intervals";
+    }
+
+    memcpy(interDef->names, intraDef->names, sizeof(intraDef->names));
+    memcpy(interDef->isSigned, intraDef->isSigned, sizeof(intraDef->isSigned));
+
+    decoder->iterationField = blackboxDecoderFindField(decoder, BLACKBOX_FRAME_INTRA, "loopIteration");
+    decoder->timeField = blackboxDecoderFindField(decoder, BLACKBOX_FRAME_INTRA, "time");
+    decoder->motor0Field = blackboxDecoderFindField(decoder, BLACKBOX_FRAME_INTRA, "motor[0]");
+    decoder->gpsTimeField = blackboxDecoderFindField(decoder, BLACKBOX_FRAME_GPS, "time");
+
+    if (decoder->iterationField < 0 || decoder->timeField < 0) {
+        return "missing loopIteration or time field";
+    }
+
+    for (int type = 0; type < BLACKBOX_FRAME_TYPE_COUNT; type++) {
+        const blackboxFrameDefinition_t *def = &decoder->frameDefs[type];
+
+        for (int i = 0; i < def->fieldCount; i++) {
+            if (isPackedField(def, i)) {
+                if (decoder->dataVersion < 3 || type != BLACKBOX_FRAME_INTER
+                    || def->predictor[i] != FLIGHT_LOG_FIELD_PREDICTOR_ADAPTIVE || def->encoding[i] != FLIGHT_LOG_FIELD_ENCODING_RICE) {
+                    return "bad packed field";
+                }
+                continue;
+            }
+            if (!isSupportedEncoding(def->encoding[i])) {
+                return "unsupported field encoding";
+            }
+            if (def->predictor[i] > FLIGHT_LOG_FIELD_PREDICTOR_LAST_MAIN_FRAME_TIME) {
+                return "unsupported field predictor";
+            }
+            if (def->predictor[i] == FLIGHT_LOG_FIELD_PREDICTOR_MOTOR_0 && (decoder->motor0Field < 0 || decoder->motor0Field >= i)) {
+                return "motor[0] predictor without motor[0]";
+            }
+        }
+    }
+
+    return NULL;
+}
+
+static void startLog(blackboxDecoder_t *decoder)
+{
+    memset(decoder->frameDefs, 0, sizeof(decoder->frameDefs));
+    memset(&decoder->stats, 0, sizeof(decoder->stats));
+    decoder->dataVersion = 0;
+    decoder->frameIntervalI = 32;
+    decoder->frameIntervalPNum = 1;
+    decoder->frameIntervalPDenom = 1;
+    decoder->minthrottle = 0;
+    decoder->vbatref = 0;
+    decoder->gyroScale = 0.0f;
+    decoder->firmwareRevision[0] = '\0';
+
+    decoder->mainHistoryValid = false;
+    decoder->lastMainValid = false;
+    decoder->gpsHomeValid = false;
+    decoder->logEnded = false;
+    decoder->error = NULL;
+    decoder->resyncing = false;
+}
+
+/* Frames */
+
+static bool isFrameMarker(const blackboxDecoder_t *decoder, uint8_t c)
+{
+    if (c == 'E') {
+        return true;
+    }
+    for (int i = 0; i < BLACKBOX_FRAME_TYPE_COUNT; i++) {
+        if (frameTypeChars[i] == c) {
+            return decoder->frameDefs[i].fieldCount > 0;
+        }
+    }
+
+    return false;
+}
+
+static bool isLogStart(const blackboxDecoder_t *decoder, const uint8_t *pos)
+{
+    return decoder->end - pos >= (int)strlen(logStartMarker) && memcmp(pos, logStartMarker, strlen(logStartMarker)) == 0;
+}
+
+// A frame only counts as decoded if the next one starts right behind it
+static bool frameEndsCleanly(const blackboxDecoder_t *decoder)
+{
+    if (decoder->corrupt || decoder->pos > decoder->end) {
+        return false;
+    }
+    if (decoder->pos == decoder->end) {
+        return decoder->inputEnded;
+    }
+
+    return isFrameMarker(decoder, *decoder->pos) || isLogStart(decoder, decoder->pos);
+}
+
+static void rotateMainHistory(blackboxDecoder_t *decoder, bool intraframe)
+{
+    int32_t *current = decoder->mainHistory[0];
+
+    decoder->mainHistory[2] = intraframe ? current : decoder->mainHistory[1];
+    decoder->mainHistory[1] = current;
+    decoder->mainHistory[0] = decoder->mainHistoryRing[((current - decoder->mainHistoryRing[0]) / BLACKBOX_DECODER_MAX_FIELDS + 1) % 3];
+}
+
+// Returns false if the frame is corrupt
+static bool decodeIntraframe(blackboxDecoder_t *decoder, blackboxDecoded_e *decoded)
+{
+    const blackboxFrameDefinition_t *def = &decoder->frameDefs[BLACKBOX_FRAME_INTRA];
+    int32_t *values = decoder->mainHistory[0];
+
+    readFrameFields(decoder, def, values);
+    if (!frameEndsCleanly(decoder)) {
+        return false;
+    }
+
+    applyPredictors(decoder, def, def->isSigned, values);
+
+    uint32_t iteration = values[decoder->iterationField];
+    uint32_t time = values[decoder->timeField];
+
+    if (decoder->lastMainValid) {
+        if (iteration < decoder->lastMainIteration
+            || iteration > decoder->lastMainIteration + MAXIMUM_ITERATION_JUMP_BETWEEN_FRAMES
+            || (int32_t)(time - decoder->lastMainTime) < 0
+            || time - decoder->lastMainTime > MAXIMUM_TIME_JUMP_BETWEEN_FRAMES) {
+            return false;
+        }
+
+        // A resume event already moved the last iteration up to this frame
+        if (iteration > decoder->lastMainIteration) {
+            for (uint32_t i = nextLoggedIteration(decoder, decoder->lastMainIteration); i < iteration; i = nextLoggedIteration(decoder, i)) {
+                decoder->stats.missingIterations++;
+            }
+        }
+    }
+
+    rotateMainHistory(decoder, true);
+    decoder->mainHistoryValid = true;
+    for (int i = 0; i < def->fieldCount; i++) {
+        blackboxAdaptiveReset(&decoder->adaptiveFields[i]);
+    }
+    decoder->lastMainIteration = iteration;
+    decoder->lastMainTime = time;
+    decoder->lastMainValid = true;
+
+    decoder->frame.type = BLACKBOX_FRAME_INTRA;
+    decoder->frame.values = decoder->mainHistory[1];
+    decoder->frame.fieldCount = def->fieldCount;
+    decoder->frame.time = time;
+    *decoded = BLACKBOX_DECODED_MAIN;
+    return true;
+}
+
+static bool decodeInterframe(blackboxDecoder_t *decoder, blackboxDecoded_e *decoded)
+{
+    const blackboxFrameDefinition_t *def = &decoder->frameDefs[BLACKBOX_FRAME_INTER];
+    int32_t *values = decoder->mainHistory[0];
+
+    readFrameFields(decoder, def, values);
+    if (!frameEndsCleanly(decoder)) {
+        return false;
+    }
+
+    // Only predicted from a frame that was lost, skip it but keep the stream in step
+    if (!decoder->mainHistoryValid) {
+        decoder->stats.unusableFrames++;
+        return true;
+    }
+
+    applyPredictors(decoder, def, def->isSigned, values);
+    rotateMainHistory(decoder, false);
+    decoder->lastMainIteration = decoder->mainHistory[1][decoder->iterationField];
+    decoder->lastMainTime = decoder->mainHistory[1][decoder->timeField];
+
+    decoder->frame.type = BLACKBOX_FRAME_INTER;
+    decoder->frame.values = decoder->mainHistory[1];
+    decoder->frame.fieldCount = def->fieldCount;
+    decoder->frame.time = decoder->lastMainTime;
+    *decoded = BLACKBOX_DECODED_MAIN;
+    return true;
+}
+
+static bool decodeSimpleFrame(blackboxDecoder_t *decoder, blackboxFrameType_e type, blackboxDecoded_e *decoded)
+{
+    const blackboxFrameDefinition_t *def = &decoder->frameDefs[type];
+    int32_t *values = decoder->frameValues;
+
+    readFrameFields(decoder, def, values);
+    if (!frameEndsCleanly(decoder)) {
+        return false;
+    }
+
+    if (!applyPredictors(decoder, def, def->isSigned, values)) {
+        decoder->stats.unusableFrames++;
+        return true;
+    }
+
+    decoder->frame.type = type;
+    decoder->frame.values = values;
+    decoder->frame.fieldCount = def->fieldCount;
+    decoder->frame.time = decoder->lastMainTime;
+
+    switch (type) {
+        case BLACKBOX_FRAME_GPS:
+            if (decoder->gpsTimeField >= 0) {
+                decoder->frame.time = values[decoder->gpsTimeField];
+            }
+            *decoded = BLACKBOX_DECODED_GPS;
+        break;
+        case BLACKBOX_FRAME_GPS_HOME:
+            for (int i = 0; i < 2 && i < def->fieldCount; i++) {
+                decoder->gpsHome[i] = values[i];
+            }
+            decoder->gpsHomeValid = def->fieldCount >= 2;
+            *decoded = BLACKBOX_DECODED_GPS_HOME;
+        break;
+        default:
+            *decoded = BLACKBOX_DECODED_SLOW;
+        break;
+    }
+
+    return true;
+}
+
+static bool decodeEvent(blackboxDecoder_t *decoder, blackboxDecoded_e *decoded)
+{
+    flightLogEvent_t *event = &decoder->event;
+
+    memset(event, 0, sizeof(*event));
+    event->event = readByte(decoder);
+
+    switch (event->event) {
+        case FLIGHT_LOG_EVENT_SYNC_BEEP:
+            event->data.syncBeep.time = readUnsignedVB(decoder);
+        break;
+        case FLIGHT_LOG_EVENT_INFLIGHT_ADJUSTMENT:
+        {
+            uint8_t adjustmentFunction = readByte(decoder);
+            flightLogEvent_inflightAdjustment_t *adjustment = &event->data.inflightAdjustment;
+
+            if (adjustmentFunction & FLIGHT_LOG_EVENT_INFLIGHT_ADJUSTMENT_FUNCTION_FLOAT_VALUE_FLAG) {
+                union { uint32_t u; float f; } value;
+
+                value.u = readByte(decoder);
+                value.u |= readByte(decoder) << 8;
+                value.u |= readByte(decoder) << 16;
+                value.u |= (uint32_t)readByte(decoder) << 24;
+
+                adjustment->adjustmentFunction = adjustmentFunction & ~FLIGHT_LOG_EVENT_INFLIGHT_ADJUSTMENT_FUNCTION_FLOAT_VALUE_FLAG;
+                adjustment->floatFlag = true;
+                adjustment->newFloatValue = value.f;
+            } else {
+                adjustment->adjustmentFunction = adjustmentFunction;
+                adjustment->newValue = readSignedVB(decoder);
+            }
+
+            // writeEvent() carries on into the G-Tune fields for this event, skip what it wrote
+            readByte(decoder);
+            readSignedVB(decoder);
+            readByte(decoder);
+            readByte(decoder);
+        }
+        break;
+        case FLIGHT_LOG_EVENT_GTUNE_RESULT:
+            event->data.gtuneCycleResult.gtuneAxis = readByte(decoder);
+            event->data.gtuneCycleResult.gtuneGyroAVG = readSignedVB(decoder);
+            event->data.gtuneCycleResult.gtuneNewP = readByte(decoder);
+            event->data.gtuneCycleResult.gtuneNewP |= readByte(decoder) << 8;
+        break;
+        case FLIGHT_LOG_EVENT_LOGGING_RESUME:
+            event->data.loggingResume.logIteration = readUnsignedVB(decoder);
+            event->data.loggingResume.currentTime = readUnsignedVB(decoder);
+        break;
+        case FLIGHT_LOG_EVENT_LOG_END:
+            if (decoder->end - decoder->pos < (int)sizeof(logEndMessage)
+                || memcmp(decoder->pos, logEndMessage, sizeof(logEndMessage)) != 0) {
+                return false;
+            }
+            decoder->pos += sizeof(logEndMessage);
+            decoder->logEnded = true;
+            *decoded = BLACKBOX_DECODED_LOG_END;
+            return true;
+        default:
+            // The length of unknown events isn't known, so the stream can't be followed past them
+            return false;
+    }
+
+    if (!frameEndsCleanly(decoder)) {
+        return false;
+    }
+
+    if (event->event == FLIGHT_LOG_EVENT_LOGGING_RESUME) {
+        // The iterations and time skipped up to the I-frame behind this event are on purpose
+        decoder->lastMainIteration = event->data.loggingResume.logIteration;
+        decoder->lastMainTime = event->data.loggingResume.currentTime;
+        decoder->lastMainValid = true;
+        decoder->stats.resumes++;
+    }
+
+    decoder->stats.eventCount++;
+    *decoded = BLACKBOX_DECODED_EVENT;
+    return true;
+}
+
+// Decodes until there is something to return
+static blackboxDecoded_e decodeData(blackboxDecoder_t *decoder)
+{
+    while (true) {
+        fillBuffer(decoder);
+
+        if (decoder->pos == decoder->end) {
+            decoder->state = BLACKBOX_DECODER_SEARCHING;
+            return BLACKBOX_DECODED_LOG_END;
+        }
+
+        const uint8_t *frameStart = decoder->pos;
+        uint8_t marker = *decoder->pos++;
+        blackboxDecoded_e decoded = BLACKBOX_DECODED_END;
+        bool ok;
+
+        decoder->corrupt = false;
+        decoder->frame.offset = inputOffset(decoder, frameStart);
+
+        if (marker == 'H' && isLogStart(decoder, frameStart)) {
+            // The log was cut short and another one follows
+            decoder->pos = frameStart;
+            decoder->state = BLACKBOX_DECODER_SEARCHING;
+            return BLACKBOX_DECODED_LOG_END;
+        }
+
+        if (!isFrameMarker(decoder, marker)) {
+            if (!decoder->resyncing) {
+                decoder->resyncing = true;
+                decoder->stats.resyncs++;
+            }
+            decoder->stats.skippedBytes++;
+            continue;
+        }
+
+        switch (marker) {
+            case 'I':
+                ok = decodeIntraframe(decoder, &decoded);
+            break;
+            case 'P':
+                ok = decodeInterframe(decoder, &decoded);
+            break;
+            case 'G':
+                ok = decodeSimpleFrame(decoder, BLACKBOX_FRAME_GPS, &decoded);
+            break;
+            case 'H':
+                ok = decodeSimpleFrame(decoder, BLACKBOX_FRAME_GPS_HOME, &decoded);
+            break;
+            case 'S':
+                ok = decodeSimpleFrame(decoder, BLACKBOX_FRAME_SLOW, &decoded);
+            break;
+            default:
+                ok = decodeEvent(decoder, &decoded);
+            break;
+        }
+
+        if (!ok) {
+            // Look for the next frame from just after this marker, the interframes can't be trusted until an I-frame
+            decoder->stats.corruptFrames++;
+            if (!decoder->resyncing) {
+                decoder->resyncing = true;
+                decoder->stats.resyncs++;
+            }
+            decoder->mainHistoryValid = false;
+            decoder->pos = frameStart + 1;
+            continue;
+        }
+
+        decoder->resyncing = false;
+
+        if (decoded == BLACKBOX_DECODED_LOG_END) {
+            decoder->state = BLACKBOX_DECODER_SEARCHING;
+            return decoded;
+        }
+        if (decoded != BLACKBOX_DECODED_END) {
+            if (decoded == BLACKBOX_DECODED_EVENT) {
+                decoder->frame.fieldCount = 0;
+            } else {
+                decoder->stats.frameCount[decoder->frame.type]++;
+            }
+            return decoded;
+        }
+    }
+}
+
+static blackboxDecoded_e decodeHeader(blackboxDecoder_t *decoder)
+{
+    for (bool firstLine = true; ; firstLine = false) {
+        fillBuffer(decoder);
+
+        if (decoder->end - decoder->pos < 2 || decoder->pos[0] != 'H' || decoder->pos[1] != ' ') {
+            break;
+        }
+        if (!firstLine && isLogStart(decoder, decoder->pos)) {
+            // A log with nothing but headers
+            break;
+        }
+
+        const char *line = (const char *)decoder->pos + 2;
+        const char *lineEnd = memchr(line, '\n', (const char *)decoder->end - line);
+
+        if (!lineEnd) {
+            // Cut short by the end of the input, or longer than anything the firmware writes
+            lineEnd = (const char *)decoder->end;
+            decoder->pos = decoder->end;
+        } else {
+            decoder->pos = (const uint8_t *)lineEnd + 1;
+        }
+
+        parseHeaderLine(decoder, line, lineEnd > line && lineEnd[-1] == '\r' ? lineEnd - 1 : lineEnd);
+    }
+
+    decoder->error = checkHeaders(decoder);
+    if (decoder->error) {
+        decoder->state = BLACKBOX_DECODER_SEARCHING;
+        return BLACKBOX_DECODED_LOG_UNSUPPORTED;
+    }
+
+    decoder->state = BLACKBOX_DECODER_DATA;
+    return BLACKBOX_DECODED_LOG_START;
+}
+
+static bool findLogStart(blackboxDecoder_t *decoder)
+{
+    while (true) {
+        fillBuffer(decoder);
+
+        const uint8_t *found = memchr(decoder->pos, 'H', decoder->end - decoder->pos);
+
+        if (!found) {
+            decoder->pos = decoder->end;
+            if (decoder->inputEnded) {
+                return false;
+            }
+            continue;
+        }
+
+        decoder->pos = found;
+        if (decoder->end - found < (int)strlen(logStartMarker) && !decoder->inputEnded) {
+            // Get the rest of the marker into the buffer
+            fillBuffer(decoder);
+            continue;
+        }
+        if (isLogStart(decoder, found)) {
+            return true;
+        }
+        decoder->pos++;
+    }
+}
+
+void blackboxDecoderInit(blackboxDecoder_t *decoder, blackboxDecoderReadPtr read, void *readContext)
+{
+    memset(decoder, 0, sizeof(*decoder));
+
+    decoder->read = read;
+    decoder->readContext = readContext;
+    decoder->pos = decoder->buffer;
+    decoder->end = decoder->buffer;
+    decoder->logIndex = -1;
+
+    for (int i = 0; i < 3; i++) {
+        decoder->mainHistory[i] = decoder->mainHistoryRing[i];
+    }
+}
+
+/*
+ * Decodes the input up to the next log start, frame, event or log end and returns which it was. Corrupt frames are
+ * counted and skipped over rather than returned.
+ */
+blackboxDecoded_e blackboxDecoderNext(blackboxDecoder_t *decoder)
+{
+    switch (decoder->state) {
+        case BLACKBOX_DECODER_SEARCHING:
+            if (!findLogStart(decoder)) {
+                return BLACKBOX_DECODED_END;
+            }
+            decoder->logIndex++;
+            startLog(decoder);
+            decoder->state = BLACKBOX_DECODER_HEADER;
+            return decodeHeader(decoder);
+        case BLACKBOX_DECODER_HEADER:
+            return decodeHeader(decoder);
+        case BLACKBOX_DECODER_DATA:
+        default:
+            return decodeData(decoder);
+    }
+}
+
+// Returns the index of the named field in frames of the given type, or -1
+int blackboxDecoderFindField(const blackboxDecoder_t *decoder, blackboxFrameType_e frameType, const char *name)
+{
+    const blackboxFrameDefinition_t *def = &decoder->frameDefs[frameType];
+
+    for (int i = 0; i < def->fieldCount; i++) {
+        if (strcmp(def->names[i], name) == 0) {
+            return i;
+        }
+    }
+
+    return -1;
+}
@@ -0,0 +1,149 @@
+/*
+ * This file is part of Cleanflight.
+ *
+ * Cleanflight is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cleanflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cleanflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+/*
+ * Streaming decoder for the logs written by blackbox.c, built on the host only (support/blackbox_decode and the tests).
+ * The frame layouts come from the "H Field" headers of each log and the predictors and encodings are those of
+ * blackbox_fielddefs.h, so the decoder follows the firmware as fields are added. Memory use does not depend on the
+ * size of the log.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "blackbox/blackbox_fielddefs.h"
+#include "blackbox/blackbox_adaptive.h"
+
+#define BLACKBOX_DECODER_MAX_FIELDS 64
+#define BLACKBOX_DECODER_MAX_FIELD_NAME 32
+
+// Bytes the decoder reads from the input at once, and how many of them a frame or header line may take
+#define BLACKBOX_DECODER_BUFFER_SIZE (64 * 1024)
+#define BLACKBOX_DECODER_MAX_FRAME_SIZE 4096
+
+typedef enum {
+    BLACKBOX_FRAME_INTRA = 0,   // 'I'
+    BLACKBOX_FRAME_INTER,       // 'P', with the names and signedness of the I-frame
+    BLACKBOX_FRAME_GPS,         // 'G'
+    BLACKBOX_FRAME_GPS_HOME,    // 'H'
+    BLACKBOX_FRAME_SLOW,        // 'S'
+    BLACKBOX_FRAME_TYPE_COUNT
+} blackboxFrameType_e;
+
+typedef enum {
+    BLACKBOX_DECODED_END = 0,       // the input is used up
+    BLACKBOX_DECODED_LOG_START,     // the headers of a log were read, the field definitions are valid until LOG_END
+    BLACKBOX_DECODED_LOG_UNSUPPORTED, // the headers ask for something this decoder can't do, error says what, the log is skipped
+    BLACKBOX_DECODED_MAIN,          // an I or P frame, in frame.values with the fields of the I-frame definition
+    BLACKBOX_DECODED_GPS,
+    BLACKBOX_DECODED_GPS_HOME,
+    BLACKBOX_DECODED_SLOW,
+    BLACKBOX_DECODED_EVENT,         // in event
+    BLACKBOX_DECODED_LOG_END        // an end of log event, the start of the next log or the end of the input
+} blackboxDecoded_e;
+
+typedef struct blackboxFrameDefinition_s {
+    int fieldCount;
+    char names[BLACKBOX_DECODER_MAX_FIELDS][BLACKBOX_DECODER_MAX_FIELD_NAME];
+    uint8_t isSigned[BLACKBOX_DECODER_MAX_FIELDS];
+    uint8_t predictor[BLACKBOX_DECODER_MAX_FIELDS];
+    uint8_t encoding[BLACKBOX_DECODER_MAX_FIELDS];
+} blackboxFrameDefinition_t;
+
+typedef struct blackboxDecoderStats_s {
+    uint32_t frameCount[BLACKBOX_FRAME_TYPE_COUNT];  // frames decoded and passed on
+    uint32_t eventCount;
+    uint32_t corruptFrames;         // did not decode, did not end where another frame starts, or jumped in time
+    uint32_t unusableFrames;        // decoded, but the I or H frame they are predicted from was lost
+    uint32_t resyncs;               // times the decoder had to search for the start of the next frame
+    uint64_t skippedBytes;          // bytes passed over in those searches
+    uint32_t missingIterations;     // loop iterations neither logged nor left out on purpose by the P interval
+    uint32_t resumes;               // logging resume events, the log was paused or the logger fell behind
+} blackboxDecoderStats_t;
+
+// Fills buffer with up to length bytes of the log, returns how many, 0 at the end of the input
+typedef int (*blackboxDecoderReadPtr)(void *context, uint8_t *buffer, int length);
+
+typedef enum {
+    BLACKBOX_DECODER_SEARCHING = 0, // looking for the next log start marker
+    BLACKBOX_DECODER_HEADER,
+    BLACKBOX_DECODER_DATA
+} blackboxDecoderState_e;
+
+typedef struct blackboxDecoder_s {
+    blackboxDecoderReadPtr read;
+    void *readContext;
+
+    uint8_t buffer[BLACKBOX_DECODER_BUFFER_SIZE + BLACKBOX_DECODER_MAX_FRAME_SIZE];
+    const uint8_t *pos;
+    const uint8_t *end;
+    uint64_t bufferOffset;          // offset in the input of buffer[0]
+    bool inputEnded;
+    bool corrupt;                   // the frame being read can't be right
+    bool resyncing;                 // searching for the next frame after a corrupt one
+
+    blackboxDecoderState_e state;
+    int logIndex;                   // of the current log in the input, from 0
+    const char *error;              // why the current log is unsupported
+
+    // From the headers of the current log
+    blackboxFrameDefinition_t frameDefs[BLACKBOX_FRAME_TYPE_COUNT];
+    int dataVersion;
+    int frameIntervalI;
+    int frameIntervalPNum;
+    int frameIntervalPDenom;
+    int minthrottle;
+    int vbatref;
+    float gyroScale;                // degrees per second per gyroADC unit, 0 when the log doesn't say
+    char firmwareRevision[BLACKBOX_DECODER_MAX_FIELD_NAME];
+    int iterationField;
+    int timeField;
+    int motor0Field;
+    int gpsTimeField;
+
+    // Predictor history, the main frame and the two before it
+    int32_t mainHistoryRing[3][BLACKBOX_DECODER_MAX_FIELDS];
+    int32_t *mainHistory[3];
+    bool mainHistoryValid;
+    uint32_t lastMainIteration;
+    uint32_t lastMainTime;
+    bool lastMainValid;
+    int32_t gpsHome[2];
+    bool gpsHomeValid;
+    blackboxAdaptiveField_t adaptiveFields[BLACKBOX_DECODER_MAX_FIELDS]; // state of the packed fields since the last I-frame
+
+    // The item the last blackboxDecoderNext() returned
+    struct {
+        blackboxFrameType_e type;
+        const int32_t *values;
+        int fieldCount;
+        uint64_t offset;            // in the input, of the frame marker
+        uint32_t time;              // of the frame, for GPS frames without their own the time of the last main frame
+    } frame;
+    int32_t frameValues[BLACKBOX_DECODER_MAX_FIELDS];
+    flightLogEvent_t event;
+    bool logEnded;                  // the log ended with an end of log event rather than being cut short
+
+    blackboxDecoderStats_t stats;   // of the current log, reset at LOG_START
+} blackboxDecoder_t;
+
+void blackboxDecoderInit(blackboxDecoder_t *decoder, blackboxDecoderReadPtr read, void *readContext);
+blackboxDecoded_e blackboxDecoderNext(blackboxDecoder_t *decoder);
+
+int blackboxDecoderFindField(const blackboxDecoder_t *decoder, blackboxFrameType_e frameType, const char *name);
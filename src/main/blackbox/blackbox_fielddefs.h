@@ -82,7 +82,10 @@ typedef enum FlightLogFieldPredictor {
     FLIGHT_LOG_FIELD_PREDICTOR_VBATREF        = 9,
 
     //Predict the last time value written in the main stream
-    FLIGHT_LOG_FIELD_PREDICTOR_LAST_MAIN_FRAME_TIME = 10
+    FLIGHT_LOG_FIELD_PREDICTOR_LAST_MAIN_FRAME_TIME = 10,
+
+    //Data version 3: whichever of AVERAGE_2, PREVIOUS and STRAIGHT_LINE did best on the recent frames, see blackbox_adaptive.h
+    FLIGHT_LOG_FIELD_PREDICTOR_ADAPTIVE       = 11
 
 } FlightLogFieldPredictor;
 
@@ -93,7 +96,8 @@ typedef enum FlightLogFieldEncoding {
     FLIGHT_LOG_FIELD_ENCODING_TAG8_8SVB       = 6,
     FLIGHT_LOG_FIELD_ENCODING_TAG2_3S32       = 7,
     FLIGHT_LOG_FIELD_ENCODING_TAG8_4S16       = 8,
-    FLIGHT_LOG_FIELD_ENCODING_NULL            = 9 // Nothing is written to the file, take value to be zero
+    FLIGHT_LOG_FIELD_ENCODING_NULL            = 9, // Nothing is written to the file, take value to be zero
+    FLIGHT_LOG_FIELD_ENCODING_RICE            = 10 // Data version 3: adaptive Rice code, neighbouring fields share a bitstream padded to a whole byte
 } FlightLogFieldEncoding;
 
 typedef enum FlightLogFieldSign {
@@ -74,19 +74,64 @@ int32_t blackboxHeaderBudget;
 static serialPort_t *blackboxPort = NULL;
 static portSharing_e blackboxPortSharing;
 
-void blackboxWrite(uint8_t value)
+/*
+ * The encoders write into this buffer instead of to the device byte by byte, blackboxFlushFrame() hands a whole frame to
+ * the device in one write. Anything longer than the buffer, like a header line, goes out in several writes.
+ */
+#define BLACKBOX_FRAME_BUFFER_SIZE 256
+
+// Longest item written in one go, a tag and three 32 bit fields
+#define BLACKBOX_FRAME_BUFFER_MAX_ITEM 13
+
+static uint8_t blackboxFrameBuffer[BLACKBOX_FRAME_BUFFER_SIZE];
+static int blackboxFrameBufferPos;
+
+/**
+ * Hand the bytes written since the last call to the device in one write.
+ */
+void blackboxFlushFrame(void)
 {
+    if (blackboxFrameBufferPos == 0) {
+        return;
+    }
+
     switch (masterConfig.blackbox_device) {
 #ifdef USE_FLASHFS
         case BLACKBOX_DEVICE_FLASH:
-            flashfsWriteByte(value); // Write byte asynchronously
+            flashfsWrite(blackboxFrameBuffer, blackboxFrameBufferPos, false); // Write asynchronously
         break;
 #endif
         case BLACKBOX_DEVICE_SERIAL:
         default:
-            serialWrite(blackboxPort, value);
+            serialWriteBuf(blackboxPort, blackboxFrameBuffer, blackboxFrameBufferPos);
         break;
     }
+
+    blackboxFrameBufferPos = 0;
+}
+
+// Returns where to write an item of up to the given number of bytes, blackboxFrameCommit() with the end of it after
+static uint8_t *blackboxFrameReserve(int bytes)
+{
+    if (blackboxFrameBufferPos + bytes > BLACKBOX_FRAME_BUFFER_SIZE) {
+        blackboxFlushFrame();
+    }
+
+    return &blackboxFrameBuffer[blackboxFrameBufferPos];
+}
+
+static void blackboxFrameCommit(const uint8_t *end)
+{
+    blackboxFrameBufferPos = end - blackboxFrameBuffer;
+}
+
+void blackboxWrite(uint8_t value)
+{
+    if (blackboxFrameBufferPos == BLACKBOX_FRAME_BUFFER_SIZE) {
+        blackboxFlushFrame();
+    }
+
+    blackboxFrameBuffer[blackboxFrameBufferPos++] = value;
 }
 
 static void _putc(void *p, char c)
@@ -140,31 +185,14 @@ void blackboxPrintfHeaderLine(const char *fmt, ...)
 // Print the null-terminated string 's' to the blackbox device and return the number of bytes written
 int blackboxPrint(const char *s)
 {
-    int length;
-    const uint8_t *pos;
-
-    switch (masterConfig.blackbox_device) {
-
-#ifdef USE_FLASHFS
-        case BLACKBOX_DEVICE_FLASH:
-            length = strlen(s);
-            flashfsWrite((const uint8_t*) s, length, false); // Write asynchronously
-        break;
-#endif
-
-        case BLACKBOX_DEVICE_SERIAL:
-        default:
-            pos = (uint8_t*) s;
-            while (*pos) {
-                serialWrite(blackboxPort, *pos);
-                pos++;
-            }
+    const uint8_t *pos = (const uint8_t*) s;
 
-            length = pos - (uint8_t*) s;
-        break;
+    while (*pos) {
+        blackboxWrite(*pos);
+        pos++;
     }
 
-    return length;
+    return pos - (const uint8_t*) s;
 }
 
 /**
@@ -172,12 +200,16 @@ int blackboxPrint(const char *s)
  */
 void blackboxWriteUnsignedVB(uint32_t value)
 {
+    uint8_t *buffer = blackboxFrameReserve(5);
+
     //While this isn't the final byte (we can only write 7 bits at a time)
     while (value > 127) {
-        blackboxWrite((uint8_t) (value | 0x80)); // Set the high bit to mean "more bytes follow"
+        *buffer++ = (uint8_t) (value | 0x80); // Set the high bit to mean "more bytes follow"
         value >>= 7;
     }
-    blackboxWrite(value);
+    *buffer++ = value;
+
+    blackboxFrameCommit(buffer);
 }
 
 /**
@@ -205,8 +237,12 @@ void blackboxWriteSigned16VBArray(int16_t *array, int count)
 
 void blackboxWriteS16(int16_t value)
 {
-    blackboxWrite(value & 0xFF);
-    blackboxWrite((value >> 8) & 0xFF);
+    uint8_t *buffer = blackboxFrameReserve(2);
+
+    *buffer++ = value & 0xFF;
+    *buffer++ = (value >> 8) & 0xFF;
+
+    blackboxFrameCommit(buffer);
 }
 
 /**
@@ -232,6 +268,7 @@ void blackboxWriteTag2_3S32(int32_t *values) {
 
     int x;
     int selector = BITS_2, selector2;
+    uint8_t *out = blackboxFrameReserve(BLACKBOX_FRAME_BUFFER_MAX_ITEM);
 
     /*
      * Find out how many bits the largest value requires to encode, and use it to choose one of the packing schemes
@@ -265,16 +302,16 @@ void blackboxWriteTag2_3S32(int32_t *values) {
 
     switch (selector) {
         case BITS_2:
-            blackboxWrite((selector << 6) | ((values[0] & 0x03) << 4) | ((values[1] & 0x03) << 2) | (values[2] & 0x03));
+            *out++ = (selector << 6) | ((values[0] & 0x03) << 4) | ((values[1] & 0x03) << 2) | (values[2] & 0x03);
         break;
         case BITS_4:
-            blackboxWrite((selector << 6) | (values[0] & 0x0F));
-            blackboxWrite((values[1] << 4) | (values[2] & 0x0F));
+            *out++ = (selector << 6) | (values[0] & 0x0F);
+            *out++ = (values[1] << 4) | (values[2] & 0x0F);
         break;
         case BITS_6:
-            blackboxWrite((selector << 6) | (values[0] & 0x3F));
-            blackboxWrite((uint8_t)values[1]);
-            blackboxWrite((uint8_t)values[2]);
+            *out++ = (selector << 6) | (values[0] & 0x3F);
+            *out++ = (uint8_t)values[1];
+            *out++ = (uint8_t)values[2];
         break;
         case BITS_32:
             /*
@@ -304,33 +341,35 @@ void blackboxWriteTag2_3S32(int32_t *values) {
             }
 
             //Write the selectors
-            blackboxWrite((selector << 6) | selector2);
+            *out++ = (selector << 6) | selector2;
 
             //And now the values according to the selectors we picked for them
             for (x = 0; x < NUM_FIELDS; x++, selector2 >>= 2) {
                 switch (selector2 & 0x03) {
                     case BYTES_1:
-                        blackboxWrite(values[x]);
+                        *out++ = values[x];
                     break;
                     case BYTES_2:
-                        blackboxWrite(values[x]);
-                        blackboxWrite(values[x] >> 8);
+                        *out++ = values[x];
+                        *out++ = values[x] >> 8;
                     break;
                     case BYTES_3:
-                        blackboxWrite(values[x]);
-                        blackboxWrite(values[x] >> 8);
-                        blackboxWrite(values[x] >> 16);
+                        *out++ = values[x];
+                        *out++ = values[x] >> 8;
+                        *out++ = values[x] >> 16;
                     break;
                     case BYTES_4:
-                        blackboxWrite(values[x]);
-                        blackboxWrite(values[x] >> 8);
-                        blackboxWrite(values[x] >> 16);
-                        blackboxWrite(values[x] >> 24);
+                        *out++ = values[x];
+                        *out++ = values[x] >> 8;
+                        *out++ = values[x] >> 16;
+                        *out++ = values[x] >> 24;
                     break;
                 }
             }
         break;
     }
+
+    blackboxFrameCommit(out);
 }
 
 /**
@@ -349,6 +388,7 @@ void blackboxWriteTag8_4S16(int32_t *values) {
     uint8_t selector, buffer;
     int nibbleIndex;
     int x;
+    uint8_t *out = blackboxFrameReserve(9);
 
     selector = 0;
     //Encode in reverse order so the first field is in the low bits:
@@ -366,7 +406,7 @@ void blackboxWriteTag8_4S16(int32_t *values) {
         }
     }
 
-    blackboxWrite(selector);
+    *out++ = selector;
 
     nibbleIndex = 0;
     buffer = 0;
@@ -381,16 +421,16 @@ void blackboxWriteTag8_4S16(int32_t *values) {
                     buffer = values[x] << 4;
                     nibbleIndex = 1;
                 } else {
-                    blackboxWrite(buffer | (values[x] & 0x0F));
+                    *out++ = buffer | (values[x] & 0x0F);
                     nibbleIndex = 0;
                 }
             break;
             case FIELD_8BIT:
                 if (nibbleIndex == 0) {
-                    blackboxWrite(values[x]);
+                    *out++ = values[x];
                 } else {
                     //Write the high bits of the value first (mask to avoid sign extension)
-                    blackboxWrite(buffer | ((values[x] >> 4) & 0x0F));
+                    *out++ = buffer | ((values[x] >> 4) & 0x0F);
                     //Now put the leftover low bits into the top of the next buffer entry
                     buffer = values[x] << 4;
                 }
@@ -398,13 +438,13 @@ void blackboxWriteTag8_4S16(int32_t *values) {
             case FIELD_16BIT:
                 if (nibbleIndex == 0) {
                     //Write high byte first
-                    blackboxWrite(values[x] >> 8);
-                    blackboxWrite(values[x]);
+                    *out++ = values[x] >> 8;
+                    *out++ = values[x];
                 } else {
                     //First write the highest 4 bits
-                    blackboxWrite(buffer | ((values[x] >> 12) & 0x0F));
+                    *out++ = buffer | ((values[x] >> 12) & 0x0F);
                     // Then the middle 8
-                    blackboxWrite(values[x] >> 4);
+                    *out++ = values[x] >> 4;
                     //Only the smallest 4 bits are still left to write
                     buffer = values[x] << 4;
                 }
@@ -413,8 +453,10 @@ void blackboxWriteTag8_4S16(int32_t *values) {
     }
     //Anything left over to write?
     if (nibbleIndex == 1) {
-        blackboxWrite(buffer);
+        *out++ = buffer;
     }
+
+    blackboxFrameCommit(out);
 }
 
 /**
@@ -456,13 +498,93 @@ void blackboxWriteTag8_8SVB(int32_t *values, int valueCount)
     }
 }
 
+// Bits of the packed fields not yet written out, the oldest ones highest
+static uint32_t blackboxBitBuffer;
+static int blackboxBitCount;
+
+// Append the low count bits of value, count at most 24
+static void blackboxWriteBits(uint32_t value, int count)
+{
+    blackboxBitBuffer = (blackboxBitBuffer << count) | value;
+    blackboxBitCount += count;
+
+    while (blackboxBitCount >= 8) {
+        blackboxBitCount -= 8;
+        blackboxWrite((uint8_t) (blackboxBitBuffer >> blackboxBitCount));
+    }
+}
+
+/**
+ * Write value as a Rice code with parameter k: the quotient value >> k in unary (that many 1 bits and a 0) followed by
+ * the low k bits. Values with a quotient of BLACKBOX_RICE_ESCAPE_LENGTH or more are written as that many 1 bits and
+ * then the value in 32 bits.
+ */
+static void blackboxWriteRice(uint32_t value, int k)
+{
+    uint32_t quotient = value >> k;
+
+    if (quotient < BLACKBOX_RICE_ESCAPE_LENGTH) {
+        uint32_t unary = ((uint32_t) 1 << (quotient + 1)) - 2;
+        uint32_t remainder = value & (((uint32_t) 1 << k) - 1);
+
+        if (quotient + 1 + k <= 24) {
+            blackboxWriteBits((unary << k) | remainder, quotient + 1 + k);
+        } else {
+            blackboxWriteBits(unary, quotient + 1);
+            blackboxWriteBits(remainder, k);
+        }
+    } else {
+        blackboxWriteBits(((uint32_t) 1 << BLACKBOX_RICE_ESCAPE_LENGTH) - 1, BLACKBOX_RICE_ESCAPE_LENGTH);
+        blackboxWriteBits(value >> 16, 16);
+        blackboxWriteBits(value & 0xFFFF, 16);
+    }
+}
+
+/**
+ * Write the fields of an array with FLIGHT_LOG_FIELD_PREDICTOR_ADAPTIVE and FLIGHT_LOG_FIELD_ENCODING_RICE, given the
+ * values of the last two frames and the adaptive state of each field. Neighbouring arrays continue the same bitstream,
+ * call blackboxFlushBits() after the last one.
+ */
+void blackboxWriteAdaptiveS16Array(const int16_t *values, const int16_t *previous, const int16_t *previous2,
+        blackboxAdaptiveField_t *fields, int count)
+{
+    for (int i = 0; i < count; i++) {
+        blackboxAdaptiveField_t *field = &fields[i];
+        int32_t predictions[BLACKBOX_ADAPTIVE_PREDICTOR_COUNT];
+
+        blackboxAdaptivePredictions(predictions, previous[i], previous2[i]);
+
+        uint32_t residual = zigzagEncode(values[i] - predictions[field->predictor]);
+
+        blackboxWriteRice(residual, blackboxAdaptiveRiceParameter(field));
+
+        blackboxAdaptiveLearnResidual(field, residual);
+        blackboxAdaptiveLearnValue(field, values[i], predictions);
+    }
+}
+
+/**
+ * Pad the packed fields written so far with 0 bits to a whole byte and write it out.
+ */
+void blackboxFlushBits(void)
+{
+    if (blackboxBitCount > 0) {
+        blackboxWrite((uint8_t) (blackboxBitBuffer << (8 - blackboxBitCount)));
+        blackboxBitCount = 0;
+    }
+}
+
 /** Write unsigned integer **/
 void blackboxWriteU32(int32_t value)
 {
-    blackboxWrite(value & 0xFF);
-    blackboxWrite((value >> 8) & 0xFF);
-    blackboxWrite((value >> 16) & 0xFF);
-    blackboxWrite((value >> 24) & 0xFF);
+    uint8_t *buffer = blackboxFrameReserve(4);
+
+    *buffer++ = value & 0xFF;
+    *buffer++ = (value >> 8) & 0xFF;
+    *buffer++ = (value >> 16) & 0xFF;
+    *buffer++ = (value >> 24) & 0xFF;
+
+    blackboxFrameCommit(buffer);
 }
 
 /** Write float value in the integer form **/
@@ -478,6 +600,8 @@ void blackboxWriteFloat(float value)
  */
 bool blackboxDeviceFlush(void)
 {
+    blackboxFlushFrame();
+
     switch (masterConfig.blackbox_device) {
         case BLACKBOX_DEVICE_SERIAL:
             //Nothing to speed up flushing on serial, as serial is continuously being drained out of its buffer
@@ -493,11 +617,29 @@ bool blackboxDeviceFlush(void)
     }
 }
 
+/**
+ * Hand the frames written so far to the device and let it write out what it can without waiting. Unlike
+ * blackboxDeviceFlush() this leaves a partly filled flash page in the buffer for the frames that follow, so call it every
+ * iteration while logging.
+ */
+void blackboxDeviceFlushBackground(void)
+{
+    blackboxFlushFrame();
+
+#ifdef USE_FLASHFS
+    if (masterConfig.blackbox_device == BLACKBOX_DEVICE_FLASH) {
+        flashfsFlushPagesAsync();
+    }
+#endif
+}
+
 /**
  * Attempt to open the logging device. Returns true if successful.
  */
 bool blackboxDeviceOpen(void)
 {
+    blackboxFrameBufferPos = 0;
+
     switch (masterConfig.blackbox_device) {
         case BLACKBOX_DEVICE_SERIAL:
             {
@@ -542,10 +684,14 @@ bool blackboxDeviceOpen(void)
             break;
 #ifdef USE_FLASHFS
         case BLACKBOX_DEVICE_FLASH:
+            flashfsSetRingMode(masterConfig.blackbox_flash_ring);
+
             if (flashfsGetSize() == 0 || isBlackboxDeviceFull()) {
                 return false;
             }
 
+            flashfsStartLog();
+
             blackboxMaxHeaderBytesPerIteration = BLACKBOX_TARGET_HEADER_BUDGET_PER_ITERATION;
 
             return true;
@@ -561,6 +707,8 @@ bool blackboxDeviceOpen(void)
  */
 void blackboxDeviceClose(void)
 {
+    blackboxFrameBufferPos = 0;
+
     switch (masterConfig.blackbox_device) {
         case BLACKBOX_DEVICE_SERIAL:
             closeSerialPort(blackboxPort);
@@ -576,7 +724,8 @@ void blackboxDeviceClose(void)
             break;
 #ifdef USE_FLASHFS
         case BLACKBOX_DEVICE_FLASH:
-            // No-op since the flash doesn't have a "close" and there's nobody else to hand control of it to.
+            // The flash doesn't have a "close" and there's nobody else to hand control of it to, just record the end of the log
+            flashfsFinishLog();
             break;
 #endif
     }
@@ -619,6 +768,9 @@ void blackboxReplenishHeaderBudget()
             freeSpace = 0;
     }
 
+    // Less what is still waiting in the frame buffer
+    freeSpace -= blackboxFrameBufferPos;
+
     blackboxHeaderBudget = MIN(MIN(freeSpace, blackboxHeaderBudget + blackboxMaxHeaderBytesPerIteration), BLACKBOX_MAX_ACCUMULATED_HEADER_BUDGET);
 }
 
@@ -22,6 +22,8 @@
 
 #include "platform.h"
 
+#include "blackbox/blackbox_adaptive.h"
+
 typedef enum BlackboxDevice {
     BLACKBOX_DEVICE_SERIAL = 0,
 
@@ -53,6 +55,7 @@ typedef enum {
 extern int32_t blackboxHeaderBudget;
 
 void blackboxWrite(uint8_t value);
+void blackboxFlushFrame(void);
 
 int blackboxPrintf(const char *fmt, ...);
 void blackboxPrintfHeaderLine(const char *fmt, ...);
@@ -66,10 +69,14 @@ void blackboxWriteS16(int16_t value);
 void blackboxWriteTag2_3S32(int32_t *values);
 void blackboxWriteTag8_4S16(int32_t *values);
 void blackboxWriteTag8_8SVB(int32_t *values, int valueCount);
+void blackboxWriteAdaptiveS16Array(const int16_t *values, const int16_t *previous, const int16_t *previous2,
+        blackboxAdaptiveField_t *fields, int count);
+void blackboxFlushBits(void);
 void blackboxWriteU32(int32_t value);
 void blackboxWriteFloat(float value);
 
 bool blackboxDeviceFlush(void);
+void blackboxDeviceFlushBackground(void);
 bool blackboxDeviceOpen(void);
 void blackboxDeviceClose(void);
 
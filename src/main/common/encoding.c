@@ -29,3 +29,8 @@ uint32_t zigzagEncode(int32_t value)
 {
     return (uint32_t)((value << 1) ^ (value >> 31));
 }
+
+int32_t zigzagDecode(uint32_t value)
+{
+    return (int32_t)((value >> 1) ^ -(int32_t)(value & 1));
+}
@@ -8,8 +8,11 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
+#include "platform.h"
+
 #include "common/axis.h"
 #include "common/filter.h"
 #include "common/axis.h"
@@ -45,6 +48,7 @@ int8_t * filterGetFIRCoefficientsTable(uint8_t filter_level)
 
 // 9 Tap FIR filter as described here:
 // Thanks to Qcopter & BorisB & DigitalEntity
+// The gyro runs these coefficients through firFilterInt16Apply() now, this is kept as its reference
 void filterApply9TapFIR(int16_t data[3], int16_t state[3][9], int8_t coeff[9])
 {
     int32_t FIRsum;
@@ -61,3 +65,154 @@ void filterApply9TapFIR(int16_t data[3], int16_t state[3][9], int8_t coeff[9])
         data[axis] = FIRsum / 256;
     }
 }
+
+/*
+ * Same result as filterApply9TapFIR(), bit for bit, without moving the state along on every sample. The ring holds
+ * each sample twice, taps apart, so the window from the oldest to the newest sample never wraps. With the DSP
+ * extension (F3/F4) the window and coefficients are read as packed int16 pairs and multiplied two at a time by SMLAD.
+ */
+void firFilterInt16Init(firFilterInt16_t *filter, const int8_t *coeff, uint8_t taps)
+{
+    int i;
+
+    taps = MIN(taps, FIR_FILTER_INT16_MAX_TAPS);
+    memset(filter, 0, sizeof(*filter));
+    filter->taps = (taps + 1) & ~1;
+
+    // an odd count gets a zero tap in front, on the oldest sample
+    for (i = 0; i < taps; i++) {
+        filter->coeff[filter->taps - taps + i] = coeff[i];
+    }
+}
+
+int16_t firFilterInt16Apply(firFilterInt16_t *filter, int16_t input)
+{
+    const uint8_t taps = filter->taps;
+    int32_t sum = 0;
+    int i;
+
+    filter->buf[filter->index] = input;
+    filter->buf[filter->index + taps] = input;
+    filter->index = filter->index + 1 < taps ? filter->index + 1 : 0;
+
+    const int16_t *window = &filter->buf[filter->index];
+
+#ifdef __ARM_FEATURE_DSP
+    // the window is only halfword aligned, the M4 loads unaligned words fine
+    for (i = 0; i < taps; i += 2) {
+        uint32_t samples, coeffs;
+
+        memcpy(&samples, &window[i], sizeof(samples));
+        memcpy(&coeffs, &filter->coeff[i], sizeof(coeffs));
+        sum = (int32_t)__SMLAD(samples, coeffs, (uint32_t)sum);
+    }
+#else
+    for (i = 0; i < taps; i++) {
+        sum += window[i] * filter->coeff[i];
+    }
+#endif
+
+    return sum / 256;
+}
+
+// Q of a notch at centerFreq whose -3dB edges are at cutoffFreq and the mirror of it above centerFreq
+float filterGetNotchQ(uint16_t centerFreq, uint16_t cutoffFreq)
+{
+    float octaves = log2f((float)centerFreq / (float)cutoffFreq) * 2;
+
+    return sqrtf(powf(2, octaves)) / (powf(2, octaves) - 1);
+}
+
+// Coefficients as in the Audio EQ Cookbook by Robert Bristow-Johnson, the state is kept
+void biquadFilterUpdate(biquadFilter_t *filter, biquadFilterType_e filterType, float filterFreq, float Q, uint32_t samplePeriodUs)
+{
+    const float sampleRate = 1000000.0f / samplePeriodUs;
+
+    // stay clear of Nyquist, the design falls apart there
+    filterFreq = constrainf(filterFreq, 1.0f, sampleRate * 0.45f);
+
+    const float omega = 2.0f * M_PIf * filterFreq / sampleRate;
+    const float sn = sin_approx(omega);
+    const float cs = cos_approx(omega);
+    const float alpha = sn / (2.0f * Q);
+
+    float b0, b1, b2;
+
+    switch (filterType) {
+    case FILTER_NOTCH:
+        b0 = 1;
+        b1 = -2 * cs;
+        b2 = 1;
+        break;
+    case FILTER_LPF:
+    default:
+        b0 = (1 - cs) / 2;
+        b1 = 1 - cs;
+        b2 = (1 - cs) / 2;
+        break;
+    }
+    const float a0 = 1 + alpha;
+
+    filter->b0 = b0 / a0;
+    filter->b1 = b1 / a0;
+    filter->b2 = b2 / a0;
+    filter->a1 = -2 * cs / a0;
+    filter->a2 = (1 - alpha) / a0;
+}
+
+void biquadFilterInit(biquadFilter_t *filter, biquadFilterType_e filterType, float filterFreq, float Q, uint32_t samplePeriodUs)
+{
+    biquadFilterUpdate(filter, filterType, filterFreq, Q, samplePeriodUs);
+    filter->d1 = 0;
+    filter->d2 = 0;
+}
+
+float biquadFilterApply(biquadFilter_t *filter, float input)
+{
+    const float result = filter->b0 * input + filter->d1;
+
+    filter->d1 = filter->b1 * input - filter->a1 * result + filter->d2;
+    filter->d2 = filter->b2 * input - filter->a2 * result;
+    return result;
+}
+
+static int16_t biquadCoeffToQ15(float coeff)
+{
+    return constrain(lrintf(coeff * (1 << BIQUAD_Q15_COEFF_SHIFT)), INT16_MIN, INT16_MAX);
+}
+
+// Fixed point copy of a designed filter, for MCUs without an FPU
+void biquadFilterQ15Init(biquadFilterQ15_t *filter, const biquadFilter_t *design)
+{
+    const float dcGain = (design->b0 + design->b1 + design->b2) / (1 + design->a1 + design->a2);
+
+    filter->b0 = biquadCoeffToQ15(design->b0);
+    filter->b2 = biquadCoeffToQ15(design->b2);
+    filter->a1 = biquadCoeffToQ15(design->a1);
+    filter->a2 = biquadCoeffToQ15(design->a2);
+    // rounding the coefficients of a low cutoff filter changes its gain at DC noticeably, b1 takes up the difference
+    filter->b1 = constrain(lrintf(dcGain * ((1 << BIQUAD_Q15_COEFF_SHIFT) + filter->a1 + filter->a2)) - filter->b0 - filter->b2, INT16_MIN, INT16_MAX);
+    filter->d1 = 0;
+    filter->d2 = 0;
+}
+
+/*
+ * The state is kept in Q8 of the sample. The output is fed back before it is rounded, the rounding error would otherwise
+ * be amplified by the gain of the poles, about 50 for a lowpass at 1/40 of the sample rate. A high Q close to Nyquist
+ * rings at several times full scale on a pegged gyro, the output before rounding is held within 32 times full scale so
+ * the state and the sums always fit in 32 bit. Only the products of the feedback are 64 bit, a single SMULL on the M3.
+ */
+int16_t biquadFilterQ15Apply(biquadFilterQ15_t *filter, int16_t input)
+{
+    const int shift = BIQUAD_Q15_COEFF_SHIFT - BIQUAD_Q15_STATE_SHIFT;
+    int32_t accumulator = (((int32_t)filter->b0 * input) >> shift) + filter->d1;
+
+    accumulator = accumulator > BIQUAD_Q15_STATE_MAX ? BIQUAD_Q15_STATE_MAX : (accumulator < -BIQUAD_Q15_STATE_MAX ? -BIQUAD_Q15_STATE_MAX : accumulator);
+
+    filter->d1 = (((int32_t)filter->b1 * input) >> shift) - (int32_t)(((int64_t)filter->a1 * accumulator) >> BIQUAD_Q15_COEFF_SHIFT) + filter->d2;
+    filter->d2 = (((int32_t)filter->b2 * input) >> shift) - (int32_t)(((int64_t)filter->a2 * accumulator) >> BIQUAD_Q15_COEFF_SHIFT);
+
+    const int32_t output = (accumulator + (1 << (BIQUAD_Q15_STATE_SHIFT - 1))) >> BIQUAD_Q15_STATE_SHIFT;
+
+    return output > INT16_MAX ? INT16_MAX : (output < INT16_MIN ? INT16_MIN : output);
+}
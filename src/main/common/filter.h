@@ -5,6 +5,7 @@
  *      Author: borisb
  */
 
+#pragma once
 
 
 typedef struct filterStatePt1_s {
@@ -12,6 +13,47 @@ typedef struct filterStatePt1_s {
 	float RC;
 } filterStatePt1_t;
 
+typedef enum {
+    FILTER_LPF,         // second order Butterworth lowpass
+    FILTER_NOTCH
+} biquadFilterType_e;
+
+// Biquad in direct form II transposed
+typedef struct biquadFilter_s {
+    float b0, b1, b2, a1, a2;
+    float d1, d2;
+} biquadFilter_t;
+
+// FIR for int16 samples with int8 coefficients in 1/256, taps are multiplied in pairs so the count is rounded up to even
+#define FIR_FILTER_INT16_MAX_TAPS 10
+
+typedef struct firFilterInt16_s {
+    int16_t buf[2 * FIR_FILTER_INT16_MAX_TAPS];     // every sample is stored twice, the last taps are always contiguous
+    int16_t coeff[FIR_FILTER_INT16_MAX_TAPS];       // oldest sample first
+    uint8_t taps;
+    uint8_t index;                                  // where the next sample goes, the oldest one
+} firFilterInt16_t;
+
+// Fixed point biquad for int16 samples, coefficients are Q14 so the ones up to 2 fit
+#define BIQUAD_Q15_COEFF_SHIFT 14
+// The state has 8 fractional bits and stays within 32 times full scale, so it and the sums fit in 32 bit
+#define BIQUAD_Q15_STATE_SHIFT 8
+#define BIQUAD_Q15_STATE_MAX (1 << 28)
+
+typedef struct biquadFilterQ15_s {
+    int16_t b0, b1, b2, a1, a2;
+    int32_t d1, d2;
+} biquadFilterQ15_t;
+
 float filterApplyPt1(float input, filterStatePt1_t *filter, uint8_t f_cut, float dt);
 int8_t * filterGetFIRCoefficientsTable(uint8_t filter_level);
 void filterApply9TapFIR(int16_t data[3], int16_t state[3][9], int8_t coeff[9]);
+void firFilterInt16Init(firFilterInt16_t *filter, const int8_t *coeff, uint8_t taps);
+int16_t firFilterInt16Apply(firFilterInt16_t *filter, int16_t input);
+
+float filterGetNotchQ(uint16_t centerFreq, uint16_t cutoffFreq);
+void biquadFilterInit(biquadFilter_t *filter, biquadFilterType_e filterType, float filterFreq, float Q, uint32_t samplePeriodUs);
+void biquadFilterUpdate(biquadFilter_t *filter, biquadFilterType_e filterType, float filterFreq, float Q, uint32_t samplePeriodUs);
+float biquadFilterApply(biquadFilter_t *filter, float input);
+void biquadFilterQ15Init(biquadFilterQ15_t *filter, const biquadFilter_t *design);
+int16_t biquadFilterQ15Apply(biquadFilterQ15_t *filter, int16_t input);
@@ -22,6 +22,7 @@
 #include "platform.h"
 
 #include "build_config.h"
+#include "scheduler.h"
 
 #include "common/color.h"
 #include "common/axis.h"
@@ -65,6 +66,8 @@
 #include "flight/altitudehold.h"
 #include "flight/navigation.h"
 
+#include "blackbox/blackbox.h"
+
 #include "config/runtime_config.h"
 #include "config/config.h"
 
@@ -132,14 +135,18 @@ void useRcControlsConfig(modeActivationCondition_t *modeActivationConditions, es
 #error "Flash page count not defined for target."
 #endif
 
+#if !defined(FLASH_TO_RESERVE_FOR_CONFIG)
 #if FLASH_SIZE <= 128
 #define FLASH_TO_RESERVE_FOR_CONFIG 0x800
 #else
 #define FLASH_TO_RESERVE_FOR_CONFIG 0x1000
 #endif
+#endif
 
 
-#if defined(REVO) || defined(SPARKY2) || defined(ALIENFLIGHTF4) || defined(BLUEJAYF4) || defined(VRCORE)
+#if defined(SITL)
+// CONFIG_START_FLASH_ADDRESS points at the emulated flash area provided by the target
+#elif defined(REVO) || defined(SPARKY2) || defined(ALIENFLIGHTF4) || defined(BLUEJAYF4) || defined(VRCORE)
 //dedicated flash storage since we have so much storage space
 //#define CONFIG_START_FLASH_ADDRESS (0x080E0000) //0x080E0000 to 0x080FFFFF (FLASH_Sector_11
 #define CONFIG_START_FLASH_ADDRESS (0x08080000) //0x08080000 to 0x080A0000 (FLASH_Sector_8)
@@ -159,7 +166,7 @@ static uint32_t activeFeaturesLatch = 0;
 static uint8_t currentControlRateProfileIndex = 0;
 controlRateConfig_t *currentControlRateProfile;
 
-static const uint8_t EEPROM_CONF_VERSION = 115;
+static const uint8_t EEPROM_CONF_VERSION = 124;
 
 static void resetAccelerometerTrims(flightDynamicsTrims_t *accelerometerTrims)
 {
@@ -201,7 +208,16 @@ static void resetPidProfile(pidProfile_t *pidProfile)
     pidProfile->I8[PIDVEL] = 45;
     pidProfile->D8[PIDVEL] = 1;
 
-    pidProfile->gyro_soft_lpf = 0;   // LOW filtering by default
+    pidProfile->gyro_fir_level = 0;
+    pidProfile->gyro_lpf_hz = 90;
+    pidProfile->gyro_notch_hz = 0;
+    pidProfile->gyro_notch_cutoff_hz = 160;
+#ifdef GYRO_DYNAMIC_NOTCH
+    pidProfile->gyro_dyn_notch_min_hz = 0;
+    pidProfile->gyro_dyn_notch_max_hz = 500;
+    pidProfile->gyro_dyn_notch_q = 20;
+#endif
+    pidProfile->setpoint_ff = 0;
     pidProfile->dterm_cut_hz = 8;
     pidProfile->yaw_pterm_cut_hz = 30;
 
@@ -512,6 +528,7 @@ static void resetConf(void)
     resetSerialConfig(&masterConfig.serialConfig);
 
     masterConfig.emf_avoidance = 0;
+    masterConfig.scheduler_mode = SCHEDULER_MODE_DYNAMIC;
 
     resetPidProfile(&currentProfile->pidProfile);
 
@@ -587,6 +604,8 @@ static void resetConf(void)
 #endif
     masterConfig.blackbox_rate_num = 1;
     masterConfig.blackbox_rate_denom = 1;
+    masterConfig.blackbox_encoding = BLACKBOX_ENCODING_VB;
+    masterConfig.blackbox_flash_ring = 0;
 #endif
 
 #if defined(REVO) || defined(SPARKY2) || defined (REVONANO) || defined(ALIENFLIGHTF4) || defined(BLUEJAYF4) || defined(VRCORE)
@@ -614,6 +633,11 @@ static void resetConf(void)
     masterConfig.serialConfig.portConfigs[2].msp_baudrateIndex = BAUD_9600;
 #endif
 
+#ifdef SITL
+    // the scripted pilot of the simulator flies through the MSP receiver
+    featureSet(FEATURE_RX_MSP);
+#endif
+
     // alternative defaults settings for ALIENWIIF1 and ALIENWIIF3 targets
 #ifdef ALIENWII32
     featureSet(FEATURE_RX_SERIAL);
@@ -757,7 +781,7 @@ void activateConfig(void)
         &currentProfile->pidProfile
     );
 
-    useGyroConfig(&masterConfig.gyroConfig, filterGetFIRCoefficientsTable(currentProfile->pidProfile.gyro_soft_lpf));
+    useGyroConfig(&masterConfig.gyroConfig, &currentProfile->pidProfile);
 
 #ifdef TELEMETRY
     telemetryUseConfig(&masterConfig.telemetryConfig);
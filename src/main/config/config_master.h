@@ -26,6 +26,7 @@ typedef struct master_t {
     uint8_t mixerMode;
     uint32_t enabledFeatures;
     uint8_t emf_avoidance;                   // change pll settings to avoid noise in the uhf band
+    uint8_t scheduler_mode;                  // see schedulerMode_e
 
     motorMixer_t customMotorMixer[MAX_SUPPORTED_MOTORS];
 #ifdef USE_SERVOS
@@ -98,6 +99,8 @@ typedef struct master_t {
     uint8_t blackbox_rate_num;
     uint8_t blackbox_rate_denom;
     uint8_t blackbox_device;
+    uint8_t blackbox_encoding;               // see blackboxEncoding_e
+    uint8_t blackbox_flash_ring;             // erase the oldest logs on the dataflash when it fills up
 #endif
 
     beeperOffConditions_t beeper_off;
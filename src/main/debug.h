@@ -39,3 +39,31 @@ extern uint32_t sectionTimes[2][4];
 #define TIME_SECTION_END(index) {}
 
 #endif
+
+/*
+ * Per stage timing of the main PID loop, used by the loop benchmark of the SITL target.
+ * The target provides a free running nanosecond clock and the sink for the durations.
+ */
+typedef enum {
+    LOOP_STAGE_GYRO = 0,
+    LOOP_STAGE_ATTITUDE,
+    LOOP_STAGE_RC_COMMAND,
+    LOOP_STAGE_PID,
+    LOOP_STAGE_MIXER,
+    LOOP_STAGE_MOTORS,
+    LOOP_STAGE_BLACKBOX,
+    LOOP_STAGE_TOTAL,
+    LOOP_STAGE_GYRO_ANALYSE,        // a step of the DYNNOTCH task, which runs between the loops
+    LOOP_STAGE_COUNT
+} loopStage_e;
+
+#ifdef LOOP_STAGE_TIMING
+uint32_t loopStageClockNs(void);
+void loopStageRecord(loopStage_e stage, uint32_t durationNs);
+
+#define LOOP_STAGE_BEGIN(stage) uint32_t stage##_startedAt = loopStageClockNs()
+#define LOOP_STAGE_END(stage) loopStageRecord(stage, loopStageClockNs() - stage##_startedAt)
+#else
+#define LOOP_STAGE_BEGIN(stage)
+#define LOOP_STAGE_END(stage)
+#endif
@@ -19,9 +19,12 @@
 
 extern uint16_t acc_1G; // FIXME move into acc_t
 
+#define GYRO_BATCH_MAX_SAMPLES 8                            // samples read at once by readBatch
+
 typedef struct gyro_s {
     sensorGyroInitFuncPtr init;                             // initialize function
     sensorReadFuncPtr read;                                 // read 3 axis data function
+    sensorReadBatchFuncPtr readBatch;                       // read every sample since the last read, NULL if only the latest is kept
     sensorReadFuncPtr temperature;                          // read temperature if available
     sensorInterruptFuncPtr intStatus;
     float scale;                                            // scalefactor
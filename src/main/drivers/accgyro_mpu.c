@@ -42,6 +42,7 @@
 #include "accgyro_spi_mpu6000.h"
 #include "accgyro_spi_mpu6500.h"
 #include "accgyro_mpu.h"
+#include "accgyro_mpu_fifo.h"
 
 #define DEBUG_MPU_DATA_READY_INTERRUPT
 
@@ -263,7 +264,14 @@ void MPU_DATA_READY_EXTI_Handler(void)
 
 
 		gyro_i_count++;
+#ifdef USE_MPU_FIFO
+		// the samples wait in the FIFO until the PID loop reads them all
+		if (!mpuGyroFifoIsEnabled()) {
+			mpuGyroReadCollect();
+		}
+#else
 		mpuGyroReadCollect();
+#endif
 
 		if (gyro_i_count >= gyroFilterLevel) {
 
@@ -276,6 +284,11 @@ void MPU_DATA_READY_EXTI_Handler(void)
     		lastCalledAt1 = now;
 #endif
 			gyro_i_count = 0;
+#if defined(USE_MPU_FIFO) && defined(USE_SPI_DMA)
+			// the samples come in while the scheduler gets to the PID loop
+			mpuGyroFifoStartRead();
+#endif
+    		gyroDataReadyAt = micros();
     		mpuDataReady = true;
 		}
 
@@ -0,0 +1,228 @@
+/*
+ * This file is part of Cleanflight.
+ *
+ * Cleanflight is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cleanflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cleanflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * The MPU queues every gyro sample in its FIFO, the PID loop drains all of them in one burst read instead of the data
+ * ready interrupt reading the gyro registers for every sample. gyroUpdate() then runs each sample through the filters.
+ * With SPI DMA the data ready interrupt that wakes the PID loop starts the burst read, which is normally done by the time
+ * gyroUpdate() asks for the samples. When it is not, gyroUpdate() gets them with the next loop rather than waiting.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "platform.h"
+#include "build_config.h"
+
+#ifdef USE_MPU_FIFO
+
+#include "common/maths.h"
+
+#include "exti.h"
+#include "bus_spi.h"
+#include "sensor.h"
+#include "accgyro.h"
+#include "accgyro_mpu.h"
+#include "accgyro_mpu_fifo.h"
+
+static bool fifoEnabled = false;
+static uint8_t fifoUserControl;
+static uint16_t fifoSize;
+
+static void mpuGyroFifoReset(void)
+{
+    mpuConfiguration.write(MPU_RA_USER_CTRL, fifoUserControl | MPU_RF_USER_FIFO_RESET);
+    mpuConfiguration.write(MPU_RA_USER_CTRL, fifoUserControl | MPU_RF_USER_FIFO_EN);
+}
+
+// userControl holds the USER_CTRL bits the driver needs besides the FIFO ones, e.g. I2C_IF_DIS on SPI, size is the
+// FIFO of the detected sensor in bytes
+void mpuGyroFifoInit(uint8_t userControl, uint16_t size)
+{
+    fifoUserControl = userControl;
+    fifoSize = size;
+
+    mpuConfiguration.write(MPU_RA_FIFO_EN, MPU_RF_FIFO_GYRO_XYZ);
+    mpuGyroFifoReset();
+    fifoEnabled = true;
+}
+
+bool mpuGyroFifoIsEnabled(void)
+{
+    return fifoEnabled;
+}
+
+static void mpuGyroFifoParse(int16_t (*samples)[3], const uint8_t *data, uint8_t sampleCount)
+{
+    uint8_t sample;
+
+    for (sample = 0; sample < sampleCount; sample++) {
+        const uint8_t *bytes = &data[sample * MPU_FIFO_GYRO_SAMPLE_SIZE];
+
+        samples[sample][0] = (int16_t)((bytes[0] << 8) | bytes[1]);
+        samples[sample][1] = (int16_t)((bytes[2] << 8) | bytes[3]);
+        samples[sample][2] = (int16_t)((bytes[4] << 8) | bytes[5]);
+    }
+}
+
+#ifdef USE_SPI_DMA
+
+typedef enum {
+    ASYNC_READ_IDLE = 0,
+    ASYNC_READ_BUSY,
+    ASYNC_READ_DONE,
+    ASYNC_READ_RESET            // the FIFO needs a reset, which is left to the PID loop
+} asyncReadState_e;
+
+static volatile asyncReadState_e asyncReadState = ASYNC_READ_IDLE;
+static volatile uint8_t asyncSampleCount;
+
+static const uint8_t countRegister = MPU_RA_FIFO_COUNTH | 0x80;
+static const uint8_t dataRegister = MPU_RA_FIFO_R_W | 0x80;
+static uint8_t asyncByteCount[2];
+static uint8_t asyncData[GYRO_BATCH_MAX_SAMPLES * MPU_FIFO_GYRO_SAMPLE_SIZE];
+
+static spiSegment_t countSegments[2] = {
+    { &countRegister, NULL, 1 },
+    { NULL, asyncByteCount, sizeof(asyncByteCount) }
+};
+static spiSegment_t dataSegments[2] = {
+    { &dataRegister, NULL, 1 },
+    { NULL, asyncData, 0 }
+};
+
+static void mpuGyroFifoDataRead(spiJob_t *job);
+static void mpuGyroFifoCountRead(spiJob_t *job);
+
+static spiJob_t countJob = { .segments = countSegments, .segmentCount = 2, .callback = mpuGyroFifoCountRead };
+static spiJob_t dataJob = { .segments = dataSegments, .segmentCount = 2, .callback = mpuGyroFifoDataRead };
+
+static void mpuGyroFifoCountRead(spiJob_t *job)
+{
+    UNUSED(job);
+
+    const uint16_t byteCount = (asyncByteCount[0] << 8) | asyncByteCount[1];
+
+    if (byteCount >= fifoSize || byteCount % MPU_FIFO_GYRO_SAMPLE_SIZE) {
+        asyncReadState = ASYNC_READ_RESET;
+        return;
+    }
+
+    asyncSampleCount = MIN(byteCount / MPU_FIFO_GYRO_SAMPLE_SIZE, GYRO_BATCH_MAX_SAMPLES);
+    if (asyncSampleCount == 0) {
+        asyncReadState = ASYNC_READ_DONE;
+        return;
+    }
+
+    dataSegments[1].length = asyncSampleCount * MPU_FIFO_GYRO_SAMPLE_SIZE;
+    spiTransferAsync(&dataJob);
+}
+
+static void mpuGyroFifoDataRead(spiJob_t *job)
+{
+    UNUSED(job);
+
+    asyncReadState = ASYNC_READ_DONE;
+}
+
+// The register read and write functions of the driver must go through the job queue of the bus as well
+void mpuGyroFifoInitAsync(const spiDevice_t *device)
+{
+    countJob.device = device;
+    dataJob.device = device;
+}
+
+// Called from the data ready interrupt, starts reading the FIFO count and then the samples
+void mpuGyroFifoStartRead(void)
+{
+    if (!fifoEnabled || !countJob.device || asyncReadState != ASYNC_READ_IDLE) {
+        return;
+    }
+
+    asyncReadState = ASYNC_READ_BUSY;
+    if (!spiTransferAsync(&countJob)) {
+        asyncReadState = ASYNC_READ_IDLE;
+    }
+}
+
+// Returns -1 if no read was started, else the samples the started read got, none while it is still on the bus
+static int mpuGyroFifoReadAsync(int16_t (*samples)[3], uint8_t maxSamples)
+{
+    uint8_t sampleCount = 0;
+
+    switch (asyncReadState) {
+    case ASYNC_READ_BUSY:
+        // the completion callback moves it on, the samples are taken by the next loop
+        return 0;
+    case ASYNC_READ_DONE:
+        // the read was for up to GYRO_BATCH_MAX_SAMPLES, anything beyond maxSamples is dropped
+        sampleCount = MIN(asyncSampleCount, maxSamples);
+        mpuGyroFifoParse(samples, asyncData, sampleCount);
+        break;
+    case ASYNC_READ_RESET:
+        mpuGyroFifoReset();
+        break;
+    default:
+        return -1;
+    }
+
+    asyncReadState = ASYNC_READ_IDLE;
+    return sampleCount;
+}
+
+#endif
+
+// Reads up to maxSamples of the oldest samples in the FIFO, the rest are left for the next read
+uint8_t mpuGyroFifoRead(int16_t (*samples)[3], uint8_t maxSamples)
+{
+    uint8_t data[GYRO_BATCH_MAX_SAMPLES * MPU_FIFO_GYRO_SAMPLE_SIZE];
+    uint8_t sampleCount;
+
+#ifdef USE_SPI_DMA
+    const int asyncCount = mpuGyroFifoReadAsync(samples, maxSamples);
+    if (asyncCount >= 0) {
+        return asyncCount;
+    }
+#endif
+
+    if (!mpuConfiguration.read(MPU_RA_FIFO_COUNTH, 2, data)) {
+        return 0;
+    }
+    const uint16_t byteCount = (data[0] << 8) | data[1];
+
+    // a full FIFO drops bytes, after that they no longer line up with the axes
+    if (byteCount >= fifoSize || byteCount % MPU_FIFO_GYRO_SAMPLE_SIZE) {
+        mpuGyroFifoReset();
+        return 0;
+    }
+
+    sampleCount = MIN(byteCount / MPU_FIFO_GYRO_SAMPLE_SIZE, MIN(maxSamples, GYRO_BATCH_MAX_SAMPLES));
+    if (sampleCount == 0) {
+        return 0;
+    }
+
+    if (!mpuConfiguration.read(MPU_RA_FIFO_R_W, sampleCount * MPU_FIFO_GYRO_SAMPLE_SIZE, data)) {
+        return 0;
+    }
+
+    mpuGyroFifoParse(samples, data, sampleCount);
+
+    return sampleCount;
+}
+
+#endif
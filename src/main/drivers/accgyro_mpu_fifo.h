@@ -0,0 +1,37 @@
+/*
+ * This file is part of Cleanflight.
+ *
+ * Cleanflight is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cleanflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cleanflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#define MPU6000_FIFO_SIZE           1024
+#define MPU6500_FIFO_SIZE           512     // the MPU9250 too
+#define MPU_FIFO_GYRO_SAMPLE_SIZE   6       // X, Y and Z, high byte first
+
+// RF = Register Flag
+#define MPU_RF_USER_FIFO_EN         (1 << 6)
+#define MPU_RF_USER_FIFO_RESET      (1 << 2)
+#define MPU_RF_FIFO_GYRO_XYZ        (1 << 6 | 1 << 5 | 1 << 4)
+
+void mpuGyroFifoInit(uint8_t userControl, uint16_t fifoSize);
+bool mpuGyroFifoIsEnabled(void);
+uint8_t mpuGyroFifoRead(int16_t (*samples)[3], uint8_t maxSamples);
+
+#ifdef USE_SPI_DMA
+struct spiDevice_s;
+void mpuGyroFifoInitAsync(const struct spiDevice_s *device);
+void mpuGyroFifoStartRead(void);
+#endif
@@ -43,6 +43,7 @@
 #include "accgyro.h"
 #include "accgyro_mpu.h"
 #include "accgyro_spi_mpu6000.h"
+#include "accgyro_mpu_fifo.h"
 
 static void mpu6000AccAndGyroInit(void);
 
@@ -107,24 +108,46 @@ void resetGyro (void) {
     delay(150);
 }
 
+#ifdef USE_SPI_DMA
+static const spiDevice_t mpu6000SpiDevice = { MPU6000_SPI_INSTANCE, MPU6000_CS_GPIO, MPU6000_CS_PIN };
+#endif
+
 bool mpu6000WriteRegister(uint8_t reg, uint8_t data)
 {
+#ifdef USE_SPI_DMA
+    // through the job queue, the FIFO read started by the data ready interrupt may be on the bus
+    const uint8_t out[2] = { reg, data };
+    const spiSegment_t segment = { out, NULL, sizeof(out) };
+    spiJob_t job = { .device = &mpu6000SpiDevice, .segments = &segment, .segmentCount = 1 };
+
+    spiTransferJob(&job);
+    delayMicroseconds(1);
+#else
     ENABLE_MPU6000;
     delayMicroseconds(1);
     spiTransferByte(MPU6000_SPI_INSTANCE, reg);
     spiTransferByte(MPU6000_SPI_INSTANCE, data);
     DISABLE_MPU6000;
     delayMicroseconds(1);
+#endif
 
     return true;
 }
 
 bool mpu6000ReadRegister(uint8_t reg, uint8_t length, uint8_t *data)
 {
+#ifdef USE_SPI_DMA
+    const uint8_t out = reg | 0x80; // read transaction
+    const spiSegment_t segments[2] = { { &out, NULL, 1 }, { NULL, data, length } };
+    spiJob_t job = { .device = &mpu6000SpiDevice, .segments = segments, .segmentCount = 2 };
+
+    spiTransferJob(&job);
+#else
     ENABLE_MPU6000;
     spiTransferByte(MPU6000_SPI_INSTANCE, reg | 0x80); // read transaction
     spiTransfer(MPU6000_SPI_INSTANCE, data, NULL, length);
     DISABLE_MPU6000;
+#endif
 
     return true;
 }
@@ -152,6 +175,11 @@ void mpu6000SpiGyroInit(uint8_t lpf)
 
     spiSetDivisor(MPU6000_SPI_INSTANCE, SPI_FAST_CLOCK); //high speed now that we don't need to write to the slow registers
 
+#if defined(USE_MPU_FIFO) && defined(USE_SPI_DMA)
+    // only now, the divisor must not change under a running transfer
+    mpuGyroFifoInitAsync(&mpu6000SpiDevice);
+#endif
+
     int16_t data[3];
     mpuGyroRead(data);
 
@@ -234,6 +262,10 @@ static void mpu6000AccAndGyroInit(void) {
     // Clock Source PPL with Z axis gyro reference
     verifympu6000WriteRegister(MPU_RA_PWR_MGMT_1, 0x09);
 
+#ifdef USE_MPU_FIFO
+    mpuGyroFifoInit(BIT_I2C_IF_DIS, MPU6000_FIFO_SIZE);
+#endif
+
     mpuSpi6000InitDone = true; //init done
 }
 
@@ -303,6 +335,9 @@ bool mpu6000SpiGyroDetect(gyro_t *gyro)
 
     gyro->init = mpu6000SpiGyroInit;
     gyro->read = mpuGyroRead;
+#ifdef USE_MPU_FIFO
+    gyro->readBatch = mpuGyroFifoRead;
+#endif
     gyro->intStatus = checkMPUDataReady;
 
     // 16.4 dps/lsb scalefactor
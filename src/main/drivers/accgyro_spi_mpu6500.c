@@ -35,20 +35,37 @@
 #include "accgyro_mpu.h"
 #include "accgyro_mpu6500.h"
 #include "accgyro_spi_mpu6500.h"
+#include "accgyro_mpu_fifo.h"
 
 #define DISABLE_MPU6500       GPIO_SetBits(MPU6500_CS_GPIO,   MPU6500_CS_PIN)
 #define ENABLE_MPU6500        GPIO_ResetBits(MPU6500_CS_GPIO, MPU6500_CS_PIN)
 
+#define BIT_I2C_IF_DIS              0x10
+
 extern uint16_t acc_1G;
 
+#ifdef USE_SPI_DMA
+static const spiDevice_t mpu6500SpiDevice = { MPU6500_SPI_INSTANCE, MPU6500_CS_GPIO, MPU6500_CS_PIN };
+#endif
+
 bool mpu6500WriteRegister(uint8_t reg, uint8_t data)
 {
+#ifdef USE_SPI_DMA
+    // through the job queue, the FIFO read started by the data ready interrupt may be on the bus
+    const uint8_t out[2] = { reg, data };
+    const spiSegment_t segment = { out, NULL, sizeof(out) };
+    spiJob_t job = { .device = &mpu6500SpiDevice, .segments = &segment, .segmentCount = 1 };
+
+    spiTransferJob(&job);
+    delayMicroseconds(1);
+#else
     ENABLE_MPU6500;
     delayMicroseconds(1);
     spiTransferByte(MPU6500_SPI_INSTANCE, reg);
     spiTransferByte(MPU6500_SPI_INSTANCE, data);
     DISABLE_MPU6500;
     delayMicroseconds(1);
+#endif
 
     return true;
 }
@@ -75,10 +92,18 @@ bool verifympu6500WriteRegister(uint8_t reg, uint8_t data) {
 
 bool mpu6500ReadRegister(uint8_t reg, uint8_t length, uint8_t *data)
 {
+#ifdef USE_SPI_DMA
+    const uint8_t out = reg | 0x80; // read transaction
+    const spiSegment_t segments[2] = { { &out, NULL, 1 }, { NULL, data, length } };
+    spiJob_t job = { .device = &mpu6500SpiDevice, .segments = segments, .segmentCount = 2 };
+
+    spiTransferJob(&job);
+#else
     ENABLE_MPU6500;
     spiTransferByte(MPU6500_SPI_INSTANCE, reg | 0x80); // read transaction
     spiTransfer(MPU6500_SPI_INSTANCE, data, NULL, length);
     DISABLE_MPU6500;
+#endif
 
     return true;
 }
@@ -138,6 +163,17 @@ static void mpu6500SpiInit(void)
     hardwareInitialised = true;
 }
 
+#ifdef USE_MPU_FIFO
+static void mpu6500SpiGyroInit(uint8_t lpf)
+{
+    mpu6500GyroInit(lpf);
+    mpuGyroFifoInit(BIT_I2C_IF_DIS, MPU6500_FIFO_SIZE);
+#ifdef USE_SPI_DMA
+    mpuGyroFifoInitAsync(&mpu6500SpiDevice);
+#endif
+}
+#endif
+
 bool mpu6500SpiDetect(void)
 {
     uint8_t tmp;
@@ -171,7 +207,12 @@ bool mpu6500SpiGyroDetect(gyro_t *gyro)
         return false;
     }
 
+#ifdef USE_MPU_FIFO
+    gyro->init = mpu6500SpiGyroInit;
+    gyro->readBatch = mpuGyroFifoRead;
+#else
     gyro->init = mpu6500GyroInit;
+#endif
     gyro->read = mpuGyroRead;
     gyro->intStatus = checkMPUDataReady;
 
@@ -23,7 +23,10 @@
 #include "build_config.h"
 #include "debug.h"
 
+#include "common/utils.h"
+
 #include "gpio.h"
+#include "nvic.h"
 
 #include "bus_spi.h"
 
@@ -516,6 +519,201 @@ void initSpi3(void)
 
 
 
+#if defined(USE_SPI_DMA) && (defined(STM32F40_41xxx) || defined (STM32F411xE))
+
+typedef struct spiDma_s {
+    SPI_TypeDef *instance;
+    uint32_t rccPeriph;
+    uint32_t channel;
+    DMA_Stream_TypeDef *rxStream;
+    DMA_Stream_TypeDef *txStream;
+    uint32_t rxFlags;
+    uint32_t txFlags;
+    uint32_t rxTransferCompleteIt;
+    IRQn_Type rxIrq;
+} spiDma_t;
+
+// SPI2 shares its streams with the UART3 and UART4 TX DMA, its jobs run on spiTransfer()
+static const spiDma_t spiDmaHardware[] = {
+#ifdef USE_SPI_DEVICE_1
+    { SPI1, RCC_AHB1Periph_DMA2, DMA_Channel_3, DMA2_Stream0, DMA2_Stream3,
+        DMA_FLAG_TCIF0 | DMA_FLAG_HTIF0 | DMA_FLAG_TEIF0 | DMA_FLAG_DMEIF0 | DMA_FLAG_FEIF0,
+        DMA_FLAG_TCIF3 | DMA_FLAG_HTIF3 | DMA_FLAG_TEIF3 | DMA_FLAG_DMEIF3 | DMA_FLAG_FEIF3,
+        DMA_IT_TCIF0, DMA2_Stream0_IRQn },
+#endif
+#ifdef USE_SPI_DEVICE_3
+    // the streams of the UART5 and UART2 RX DMA, serial_uart_stm32f4xx.c leaves those off with SPI3 DMA
+    { SPI3, RCC_AHB1Periph_DMA1, DMA_Channel_0, DMA1_Stream0, DMA1_Stream5,
+        DMA_FLAG_TCIF0 | DMA_FLAG_HTIF0 | DMA_FLAG_TEIF0 | DMA_FLAG_DMEIF0 | DMA_FLAG_FEIF0,
+        DMA_FLAG_TCIF5 | DMA_FLAG_HTIF5 | DMA_FLAG_TEIF5 | DMA_FLAG_DMEIF5 | DMA_FLAG_FEIF5,
+        DMA_IT_TCIF0, DMA1_Stream0_IRQn },
+#endif
+};
+
+// clocked out for segments without data and the target of received bytes nobody wants
+static uint8_t spiDmaFill = 0xFF;
+static uint8_t spiDmaSink;
+
+static const spiDma_t *spiDmaFind(SPI_TypeDef *instance)
+{
+    uint8_t i;
+
+    for (i = 0; i < ARRAYLEN(spiDmaHardware); i++) {
+        if (spiDmaHardware[i].instance == instance) {
+            return &spiDmaHardware[i];
+        }
+    }
+    return NULL;
+}
+
+static void spiDmaInit(SPI_TypeDef *instance)
+{
+    const spiDma_t *dma = spiDmaFind(instance);
+    DMA_InitTypeDef DMA_InitStructure;
+    NVIC_InitTypeDef NVIC_InitStructure;
+
+    if (!dma) {
+        return;
+    }
+
+    RCC_AHB1PeriphClockCmd(dma->rccPeriph, ENABLE);
+
+    DMA_StructInit(&DMA_InitStructure);
+    DMA_InitStructure.DMA_Channel = dma->channel;
+    DMA_InitStructure.DMA_PeripheralBaseAddr = (uint32_t)&instance->DR;
+    DMA_InitStructure.DMA_Memory0BaseAddr = (uint32_t)&spiDmaSink;
+    DMA_InitStructure.DMA_BufferSize = 1;
+    DMA_InitStructure.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+    DMA_InitStructure.DMA_MemoryInc = DMA_MemoryInc_Enable;
+    DMA_InitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Byte;
+    DMA_InitStructure.DMA_MemoryDataSize = DMA_MemoryDataSize_Byte;
+    DMA_InitStructure.DMA_Mode = DMA_Mode_Normal;
+    DMA_InitStructure.DMA_Priority = DMA_Priority_High;
+    DMA_InitStructure.DMA_FIFOMode = DMA_FIFOMode_Disable;
+    DMA_InitStructure.DMA_FIFOThreshold = DMA_FIFOThreshold_1QuarterFull;
+    DMA_InitStructure.DMA_MemoryBurst = DMA_MemoryBurst_Single;
+    DMA_InitStructure.DMA_PeripheralBurst = DMA_PeripheralBurst_Single;
+
+    DMA_InitStructure.DMA_DIR = DMA_DIR_PeripheralToMemory;
+    DMA_DeInit(dma->rxStream);
+    DMA_Init(dma->rxStream, &DMA_InitStructure);
+
+    DMA_InitStructure.DMA_DIR = DMA_DIR_MemoryToPeripheral;
+    DMA_DeInit(dma->txStream);
+    DMA_Init(dma->txStream, &DMA_InitStructure);
+
+    // the last byte is in once the receive stream is done, so its interrupt ends the segment
+    DMA_ITConfig(dma->rxStream, DMA_IT_TC, ENABLE);
+
+    NVIC_InitStructure.NVIC_IRQChannel = dma->rxIrq;
+    NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = NVIC_PRIORITY_BASE(NVIC_PRIO_SPI_DMA);
+    NVIC_InitStructure.NVIC_IRQChannelSubPriority = NVIC_PRIORITY_SUB(NVIC_PRIO_SPI_DMA);
+    NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+    NVIC_Init(&NVIC_InitStructure);
+}
+
+static void spiDmaSetMemory(DMA_Stream_TypeDef *stream, uint8_t *memory, uint8_t *fallback)
+{
+    // without a buffer the stream stays on the one byte
+    if (memory) {
+        stream->M0AR = (uint32_t)memory;
+        stream->CR |= DMA_SxCR_MINC;
+    } else {
+        stream->M0AR = (uint32_t)fallback;
+        stream->CR &= ~DMA_SxCR_MINC;
+    }
+}
+
+// Returns false if the bus has no DMA, the caller then does the transfer itself
+bool spiDmaStart(SPI_TypeDef *instance, const uint8_t *out, uint8_t *in, uint16_t length)
+{
+    const spiDma_t *dma = spiDmaFind(instance);
+
+    if (!dma || length == 0) {
+        return false;
+    }
+
+    DMA_ClearFlag(dma->rxStream, dma->rxFlags);
+    DMA_ClearFlag(dma->txStream, dma->txFlags);
+
+    spiDmaSetMemory(dma->rxStream, in, &spiDmaSink);
+    spiDmaSetMemory(dma->txStream, (uint8_t *)out, &spiDmaFill);
+    DMA_SetCurrDataCounter(dma->rxStream, length);
+    DMA_SetCurrDataCounter(dma->txStream, length);
+
+    // a byte left over from spiTransferByte() would be the first one received
+    instance->DR;
+
+    DMA_Cmd(dma->rxStream, ENABLE);
+    DMA_Cmd(dma->txStream, ENABLE);
+    SPI_I2S_DMACmd(instance, SPI_I2S_DMAReq_Rx | SPI_I2S_DMAReq_Tx, ENABLE);
+
+    return true;
+}
+
+static void spiDmaIrqHandler(SPI_TypeDef *instance)
+{
+    const spiDma_t *dma = spiDmaFind(instance);
+
+    if (DMA_GetITStatus(dma->rxStream, dma->rxTransferCompleteIt) == RESET) {
+        return;
+    }
+    DMA_ClearITPendingBit(dma->rxStream, dma->rxTransferCompleteIt);
+
+    SPI_I2S_DMACmd(instance, SPI_I2S_DMAReq_Rx | SPI_I2S_DMAReq_Tx, DISABLE);
+    DMA_Cmd(dma->txStream, DISABLE);
+    DMA_Cmd(dma->rxStream, DISABLE);
+
+    spiDmaTransferComplete(instance);
+}
+
+#ifdef USE_SPI_DEVICE_1
+void DMA2_Stream0_IRQHandler(void)
+{
+    spiDmaIrqHandler(SPI1);
+}
+#endif
+
+#ifdef USE_SPI_DEVICE_3
+void DMA1_Stream0_IRQHandler(void)
+{
+    spiDmaIrqHandler(SPI3);
+}
+#endif
+
+#elif defined(USE_SPI_DMA)
+
+#define spiDmaInit(instance) UNUSED(instance)
+
+// no DMA engine on this MCU yet, the queue runs every segment on spiTransfer()
+bool spiDmaStart(SPI_TypeDef *instance, const uint8_t *out, uint8_t *in, uint16_t length)
+{
+    UNUSED(instance);
+    UNUSED(out);
+    UNUSED(in);
+    UNUSED(length);
+
+    return false;
+}
+
+#else
+
+#define spiDmaInit(instance) UNUSED(instance)
+
+#endif
+
+#ifdef USE_SPI_DMA
+void spiDeviceSelect(const spiDevice_t *device)
+{
+    GPIO_ResetBits(device->csGpio, device->csPin);
+}
+
+void spiDeviceDeselect(const spiDevice_t *device)
+{
+    GPIO_SetBits(device->csGpio, device->csPin);
+}
+#endif
+
 bool spiInit(SPI_TypeDef *instance)
 {
 #if ( !( defined(USE_SPI_DEVICE_1) && defined(USE_SPI_DEVICE_2) && defined(USE_SPI_DEVICE_3)) )
@@ -525,18 +723,21 @@ bool spiInit(SPI_TypeDef *instance)
 #ifdef USE_SPI_DEVICE_1
     if (instance == SPI1) {
         initSpi1();
+        spiDmaInit(SPI1);
         return true;
     }
 #endif
 #ifdef USE_SPI_DEVICE_2
     if (instance == SPI2) {
         initSpi2();
+        spiDmaInit(SPI2);
         return true;
     }
 #endif
 #ifdef USE_SPI_DEVICE_3
     if (instance == SPI3) {
         initSpi3();
+        spiDmaInit(SPI3);
         return true;
     }
 #endif
@@ -41,3 +41,56 @@ bool spiTransfer(SPI_TypeDef *instance, uint8_t *out, const uint8_t *in, int len
 
 uint16_t spiGetErrorCounter(SPI_TypeDef *instance);
 void spiResetErrorCounter(SPI_TypeDef *instance);
+
+#ifdef USE_SPI_DMA
+
+typedef struct spiDevice_s {
+    SPI_TypeDef *instance;
+    GPIO_TypeDef *csGpio;
+    uint16_t csPin;
+} spiDevice_t;
+
+typedef struct spiSegment_s {
+    const uint8_t *out;             // NULL clocks out 0xFF
+    uint8_t *in;                    // NULL drops what the device sends back
+    uint16_t length;
+} spiSegment_t;
+
+typedef enum {
+    SPI_JOB_IDLE = 0,
+    SPI_JOB_QUEUED,
+    SPI_JOB_BUSY,
+    SPI_JOB_DONE
+} spiJobState_e;
+
+struct spiJob_s;
+typedef void (*spiJobCallbackPtr)(struct spiJob_s *job);
+
+/*
+ * One chip select cycle of a device, the segments are clocked back to back while the device is selected. The job, its
+ * segments and their buffers belong to the caller and must stay put until the job is done.
+ */
+typedef struct spiJob_s {
+    const spiDevice_t *device;
+    const spiSegment_t *segments;
+    uint8_t segmentCount;
+    spiJobCallbackPtr callback;     // optional, called once the device is deselected, may queue more jobs
+    volatile spiJobState_e state;
+
+    // owned by the queue
+    uint8_t segment;
+    struct spiJob_s *next;
+} spiJob_t;
+
+bool spiTransferAsync(spiJob_t *job);
+void spiTransferJob(spiJob_t *job);
+bool spiJobIsDone(const spiJob_t *job);
+bool spiBusIsBusy(SPI_TypeDef *instance);
+
+// The DMA engine under the queue, per MCU
+void spiDeviceSelect(const spiDevice_t *device);
+void spiDeviceDeselect(const spiDevice_t *device);
+bool spiDmaStart(SPI_TypeDef *instance, const uint8_t *out, uint8_t *in, uint16_t length);
+void spiDmaTransferComplete(SPI_TypeDef *instance);
+
+#endif
@@ -0,0 +1,210 @@
+/*
+ * This file is part of Cleanflight.
+ *
+ * Cleanflight is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cleanflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cleanflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Queue of SPI jobs per bus. A job selects its device, clocks each of its segments through the DMA engine and
+ * deselects the device again, then the next job of the bus starts from the DMA interrupt. The CPU only sets up each
+ * segment instead of waiting on every byte. A bus without DMA streams runs its segments with spiTransfer() as they
+ * come up, so callers do not need to care which bus a device is on.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <platform.h>
+
+#ifdef USE_SPI_DMA
+
+#include "common/atomic.h"
+
+#include "nvic.h"
+#include "bus_spi.h"
+
+#define SPI_BUS_COUNT 3
+
+typedef struct spiBusQueue_s {
+    SPI_TypeDef *instance;
+    spiJob_t *head;                 // the job on the bus
+    spiJob_t *tail;
+    bool active;                    // the head job is running, or jobs are being started
+} spiBusQueue_t;
+
+static spiBusQueue_t busQueues[SPI_BUS_COUNT];
+
+static spiBusQueue_t *spiBusQueue(SPI_TypeDef *instance)
+{
+    int i;
+
+    for (i = 0; i < SPI_BUS_COUNT; i++) {
+        if (busQueues[i].instance == instance) {
+            return &busQueues[i];
+        }
+    }
+    for (i = 0; i < SPI_BUS_COUNT; i++) {
+        if (!busQueues[i].instance) {
+            busQueues[i].instance = instance;
+            return &busQueues[i];
+        }
+    }
+    return NULL;
+}
+
+static void spiBusFinishJob(spiBusQueue_t *bus)
+{
+    spiJob_t *job = bus->head;
+
+    spiDeviceDeselect(job->device);
+
+    // jobs are linked in behind it from interrupts and callbacks
+    ATOMIC_BLOCK(NVIC_PRIO_SPI_DMA) {
+        bus->head = job->next;
+        if (!bus->head) {
+            bus->tail = NULL;
+        }
+        job->next = NULL;
+        job->state = SPI_JOB_DONE;
+    }
+
+    // jobs queued from here wait for the loop in spiBusRun(), the bus is still active
+    if (job->callback) {
+        job->callback(job);
+    }
+}
+
+/*
+ * Runs the jobs of the bus until a segment is left to the DMA or the queue is empty. Only the code that set the bus
+ * active, or the DMA interrupt after it, runs the bus, so only the queue itself needs the lock.
+ */
+static void spiBusRun(spiBusQueue_t *bus)
+{
+    while (true) {
+        spiJob_t *job;
+
+        ATOMIC_BLOCK(NVIC_PRIO_SPI_DMA) {
+            job = bus->head;
+            if (!job) {
+                bus->active = false;
+            }
+        }
+        if (!job) {
+            return;
+        }
+
+        if (job->state == SPI_JOB_QUEUED) {
+            job->state = SPI_JOB_BUSY;
+            job->segment = 0;
+            spiDeviceSelect(job->device);
+        }
+
+        while (job->segment < job->segmentCount) {
+            const spiSegment_t *segment = &job->segments[job->segment];
+
+            if (spiDmaStart(bus->instance, segment->out, segment->in, segment->length)) {
+                return;
+            }
+            spiTransfer(bus->instance, segment->in, segment->out, segment->length);
+            job->segment++;
+        }
+
+        spiBusFinishJob(bus);
+    }
+}
+
+/*
+ * Queues the job behind the others of its bus, it starts right away when the bus is free. Returns false if the job is
+ * still queued or running from before. Safe from interrupts below NVIC_PRIO_SPI_DMA and from job callbacks. Only
+ * linking the job in masks the interrupts, the segments of a bus without DMA and the callbacks run with them enabled.
+ */
+bool spiTransferAsync(spiJob_t *job)
+{
+    spiBusQueue_t *bus = spiBusQueue(job->device->instance);
+    bool queued = false;
+    bool run = false;
+
+    if (!bus) {
+        return false;
+    }
+
+    ATOMIC_BLOCK(NVIC_PRIO_SPI_DMA) {
+        if (job->state != SPI_JOB_QUEUED && job->state != SPI_JOB_BUSY) {
+            job->state = SPI_JOB_QUEUED;
+            job->next = NULL;
+            if (bus->tail) {
+                bus->tail->next = job;
+            } else {
+                bus->head = job;
+            }
+            bus->tail = job;
+
+            if (!bus->active) {
+                bus->active = true;
+                run = true;
+            }
+            queued = true;
+        }
+    }
+
+    if (run) {
+        spiBusRun(bus);
+    }
+
+    return queued;
+}
+
+/*
+ * Runs the job and waits for it, for code that needs the result before it can go on but shares the bus with jobs
+ * started elsewhere. A job still queued or running from an earlier call is waited for before it goes again. Not
+ * from an interrupt at or above NVIC_PRIO_SPI_DMA, the job could never finish.
+ */
+void spiTransferJob(spiJob_t *job)
+{
+    if (!spiBusQueue(job->device->instance)) {
+        return;
+    }
+    while (!spiTransferAsync(job)) {
+    }
+    while (!spiJobIsDone(job)) {
+    }
+}
+
+bool spiJobIsDone(const spiJob_t *job)
+{
+    return job->state == SPI_JOB_DONE;
+}
+
+bool spiBusIsBusy(SPI_TypeDef *instance)
+{
+    spiBusQueue_t *bus = spiBusQueue(instance);
+
+    return bus && bus->active;
+}
+
+// Called from the DMA interrupt once a segment is through
+void spiDmaTransferComplete(SPI_TypeDef *instance)
+{
+    spiBusQueue_t *bus = spiBusQueue(instance);
+
+    if (!bus || !bus->head) {
+        return;
+    }
+
+    bus->head->segment++;
+    spiBusRun(bus);
+}
+
+#endif
@@ -18,11 +18,14 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <string.h>
 
 #include "platform.h"
 
 #ifdef USE_FLASH_M25P16
 
+#include "common/maths.h"
+
 #include "drivers/flash_m25p16.h"
 #include "drivers/bus_spi.h"
 #include "drivers/system.h"
@@ -66,16 +69,43 @@ static flashGeometry_t geometry = {.pageSize = M25P16_PAGESIZE};
  */
 static bool couldBeBusy = false;
 
+#ifdef USE_SPI_DMA
+static const spiDevice_t m25p16Device = { M25P16_SPI_INSTANCE, M25P16_CS_GPIO, M25P16_CS_PIN };
+
+/*
+ * A page program is copied here and sent by DMA while the caller gets on with its work. The copy takes a fraction of
+ * the time the SPI takes to clock the page out.
+ */
+static uint8_t programBuffer[4 + M25P16_PAGESIZE];
+static spiSegment_t programSegment = { programBuffer, NULL, 0 };
+static spiJob_t programJob = { .device = &m25p16Device, .segments = &programSegment, .segmentCount = 1 };
+#endif
+
 /**
- * Send the given command byte to the device.
+ * Send and receive length bytes in one chip select cycle. Either buffer may be NULL.
  */
-static void m25p16_performOneByteCommand(uint8_t command)
+static void m25p16_transfer(uint8_t *in, const uint8_t *out, int length)
 {
+#ifdef USE_SPI_DMA
+    const spiSegment_t segment = { out, in, length };
+    spiJob_t job = { .device = &m25p16Device, .segments = &segment, .segmentCount = 1 };
+
+    spiTransferJob(&job);
+#else
     ENABLE_M25P16;
 
-    spiTransferByte(M25P16_SPI_INSTANCE, command);
+    spiTransfer(M25P16_SPI_INSTANCE, in, out, length);
 
     DISABLE_M25P16;
+#endif
+}
+
+/**
+ * Send the given command byte to the device.
+ */
+static void m25p16_performOneByteCommand(uint8_t command)
+{
+    m25p16_transfer(NULL, &command, 1);
 }
 
 /**
@@ -95,17 +125,27 @@ static uint8_t m25p16_readStatus()
     uint8_t command[2] = {M25P16_INSTRUCTION_READ_STATUS_REG, 0};
     uint8_t in[2];
 
-    ENABLE_M25P16;
-
-    spiTransfer(M25P16_SPI_INSTANCE, in, command, sizeof(command));
-
-    DISABLE_M25P16;
+    m25p16_transfer(in, command, sizeof(command));
 
     return in[1];
 }
 
+#ifdef USE_SPI_DMA
+// The last page program is still going out of programBuffer
+static bool m25p16_programJobPending()
+{
+    return programJob.state == SPI_JOB_QUEUED || programJob.state == SPI_JOB_BUSY;
+}
+#endif
+
 bool m25p16_isReady()
 {
+#ifdef USE_SPI_DMA
+    if (m25p16_programJobPending()) {
+        return false;
+    }
+#endif
+
     // If couldBeBusy is false, don't bother to poll the flash chip for its status
     couldBeBusy = couldBeBusy && ((m25p16_readStatus() & M25P16_STATUS_FLAG_WRITE_IN_PROGRESS) != 0);
 
@@ -142,12 +182,8 @@ static bool m25p16_readIdentification()
      */
     in[1] = 0;
 
-    ENABLE_M25P16;
-
-    spiTransfer(M25P16_SPI_INSTANCE, in, out, sizeof(out));
-
     // Clearing the CS bit terminates the command early so we don't have to read the chip UID:
-    DISABLE_M25P16;
+    m25p16_transfer(in, out, sizeof(out));
 
     // Manufacturer, memory type, and capacity
     chipID = (in[1] << 16) | (in[2] << 8) | (in[3]);
@@ -212,11 +248,7 @@ void m25p16_eraseSector(uint32_t address)
 
     m25p16_writeEnable();
 
-    ENABLE_M25P16;
-
-    spiTransfer(M25P16_SPI_INSTANCE, NULL, out, sizeof(out));
-
-    DISABLE_M25P16;
+    m25p16_transfer(NULL, out, sizeof(out));
 }
 
 void m25p16_eraseCompletely()
@@ -228,6 +260,44 @@ void m25p16_eraseCompletely()
     m25p16_performOneByteCommand(M25P16_INSTRUCTION_BULK_ERASE);
 }
 
+#ifdef USE_SPI_DMA
+
+void m25p16_pageProgramBegin(uint32_t address)
+{
+    m25p16_waitForReady(DEFAULT_TIMEOUT_MILLIS);
+
+    // Even past the timeout, the buffer can't be written while the DMA is still sending the last page from it
+    while (m25p16_programJobPending()) {
+    }
+
+    m25p16_writeEnable();
+
+    programBuffer[0] = M25P16_INSTRUCTION_PAGE_PROGRAM;
+    programBuffer[1] = (address >> 16) & 0xFF;
+    programBuffer[2] = (address >> 8) & 0xFF;
+    programBuffer[3] = address & 0xFF;
+    programSegment.length = 4;
+}
+
+void m25p16_pageProgramContinue(const uint8_t *data, int length)
+{
+    length = MIN(length, (int)sizeof(programBuffer) - programSegment.length);
+
+    memcpy(&programBuffer[programSegment.length], data, length);
+    programSegment.length += length;
+}
+
+// The page goes out after this returns, m25p16_isReady() stays false until the flash has written it
+void m25p16_pageProgramFinish()
+{
+    if (!spiTransferAsync(&programJob)) {
+        // Not queued, wait for the bus rather than lose the page
+        spiTransferJob(&programJob);
+    }
+}
+
+#else
+
 void m25p16_pageProgramBegin(uint32_t address)
 {
     uint8_t command[] = { M25P16_INSTRUCTION_PAGE_PROGRAM, (address >> 16) & 0xFF, (address >> 8) & 0xFF, address & 0xFF};
@@ -251,6 +321,8 @@ void m25p16_pageProgramFinish()
     DISABLE_M25P16;
 }
 
+#endif
+
 /**
  * Write bytes to a flash page. Address must not cross a page boundary.
  *
@@ -291,12 +363,19 @@ int m25p16_readBytes(uint32_t address, uint8_t *buffer, int length)
         return 0;
     }
 
+#ifdef USE_SPI_DMA
+    const spiSegment_t segments[2] = { { command, NULL, sizeof(command) }, { NULL, buffer, length } };
+    spiJob_t job = { .device = &m25p16Device, .segments = segments, .segmentCount = 2 };
+
+    spiTransferJob(&job);
+#else
     ENABLE_M25P16;
 
     spiTransfer(M25P16_SPI_INSTANCE, NULL, command, sizeof(command));
     spiTransfer(M25P16_SPI_INSTANCE, buffer, NULL, length);
 
     DISABLE_M25P16;
+#endif
 
     return length;
 }
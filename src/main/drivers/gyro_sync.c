@@ -27,6 +27,8 @@
 extern gyro_t gyro;
 
 uint32_t targetLooptime;
+uint32_t gyroSamplePeriod;      // us between the samples the gyro puts out, targetLooptime is a multiple of it
+volatile uint32_t gyroDataReadyAt;  // time of the latest data ready signal, set by the interrupt of the gyro driver
 static uint8_t mpuDividerDrops;
 static uint8_t gyroFilterRate;
 
@@ -63,6 +65,7 @@ void gyroUpdateSampleRate(void) {
 //    targetLooptime = 1000;  // Wanted looptime
 
     // calculate gyro divider and targetLooptime (expected cycleTime)
+    gyroSamplePeriod = gyroSampleRate;
     mpuDividerDrops = ( gyroSampleRate / gyroFrequency ) - 1;
     gyroFilterRate  = ( targetLooptime / gyroSampleRate );
 }
@@ -8,6 +8,8 @@
 #define INTERRUPT_WAIT_TIME 3
 
 extern uint32_t targetLooptime;
+extern uint32_t gyroSamplePeriod;
+extern volatile uint32_t gyroDataReadyAt;
 
 bool gyroSyncCheckUpdate(void);
 uint8_t gyroMPU6xxxGetDividerDrops(void);
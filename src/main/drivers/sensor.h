@@ -19,5 +19,6 @@
 
 typedef void (*sensorInitFuncPtr)(void);                    // sensor init prototype
 typedef bool (*sensorReadFuncPtr)(int16_t *data);           // sensor read and align prototype
+typedef uint8_t (*sensorReadBatchFuncPtr)(int16_t (*data)[3], uint8_t maxSamples); // read up to maxSamples 3 axis samples, returns the count
 typedef void (*sensorGyroInitFuncPtr)(uint8_t lpf);        // gyro sensor init prototype
 typedef void (*sensorInterruptFuncPtr)(bool *data);         // sensor Interrupt Data Ready
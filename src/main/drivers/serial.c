@@ -17,17 +17,17 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <string.h>
 
 #include "platform.h"
 
+#include "common/maths.h"
+
 #include "serial.h"
 
 void serialPrint(serialPort_t *instance, const char *str)
 {
-    uint8_t ch;
-    while ((ch = *(str++)) != 0) {
-        serialWrite(instance, ch);
-    }
+    serialWriteBuf(instance, (const uint8_t *)str, strlen(str));
 }
 
 uint32_t serialGetBaudRate(serialPort_t *instance)
@@ -35,17 +35,36 @@ uint32_t serialGetBaudRate(serialPort_t *instance)
     return instance->baudRate;
 }
 
+void serialSetReceiveSpanCallback(serialPort_t *instance, serialReceiveSpanCallbackPtr callback)
+{
+    instance->rxSpanCallback = callback;
+}
+
 void serialWrite(serialPort_t *instance, uint8_t ch)
 {
     instance->vTable->serialWrite(instance, ch);
 }
 
-uint8_t serialRxBytesWaiting(serialPort_t *instance)
+// Writes the whole buffer as one write, ports that buffer large writes send it in one go
+void serialWriteBuf(serialPort_t *instance, const uint8_t *data, uint32_t count)
+{
+    serialBeginWrite(instance);
+    if (instance->vTable->writeBuf) {
+        instance->vTable->writeBuf(instance, data, count);
+    } else {
+        while (count--) {
+            instance->vTable->serialWrite(instance, *data++);
+        }
+    }
+    serialEndWrite(instance);
+}
+
+uint32_t serialRxBytesWaiting(serialPort_t *instance)
 {
     return instance->vTable->serialTotalRxWaiting(instance);
 }
 
-uint8_t serialTxBytesFree(serialPort_t *instance)
+uint32_t serialTxBytesFree(serialPort_t *instance)
 {
     return instance->vTable->serialTotalTxFree(instance);
 }
@@ -55,6 +74,20 @@ uint8_t serialRead(serialPort_t *instance)
     return instance->vTable->serialRead(instance);
 }
 
+// Reads what is waiting, up to count bytes, and returns how many that was
+uint32_t serialReadBuf(serialPort_t *instance, uint8_t *data, uint32_t count)
+{
+    if (instance->vTable->readBuf) {
+        return instance->vTable->readBuf(instance, data, count);
+    }
+
+    count = MIN(count, serialRxBytesWaiting(instance));
+    for (uint32_t i = 0; i < count; i++) {
+        data[i] = instance->vTable->serialRead(instance);
+    }
+    return count;
+}
+
 void serialSetBaudRate(serialPort_t *instance, uint32_t baudRate)
 {
     instance->vTable->serialSetBaudRate(instance, baudRate);
@@ -81,3 +114,46 @@ void serialEndWrite(serialPort_t *instance)
     if (instance->vTable->endWrite)
         instance->vTable->endWrite(instance);
 }
+
+// Copies into the transmit ring in at most two parts, moving the head once the bytes are in for the interrupt to see
+void serialBufferWrite(serialPort_t *instance, const uint8_t *data, uint32_t count)
+{
+    uint32_t head = instance->txBufferHead;
+
+    while (count) {
+        const uint32_t span = MIN(count, instance->txBufferSize - head);
+
+        memcpy((uint8_t *)&instance->txBuffer[head], data, span);
+        data += span;
+        count -= span;
+        head += span;
+        if (head >= instance->txBufferSize) {
+            head = 0;
+        }
+    }
+
+    instance->txBufferHead = head;
+}
+
+uint32_t serialBufferRead(serialPort_t *instance, uint8_t *data, uint32_t count)
+{
+    const uint32_t head = instance->rxBufferHead;
+    uint32_t tail = instance->rxBufferTail;
+    const uint32_t waiting = head >= tail ? head - tail : instance->rxBufferSize + head - tail;
+
+    count = MIN(count, waiting);
+    for (uint32_t remaining = count; remaining; ) {
+        const uint32_t span = MIN(remaining, instance->rxBufferSize - tail);
+
+        memcpy(data, (const uint8_t *)&instance->rxBuffer[tail], span);
+        data += span;
+        remaining -= span;
+        tail += span;
+        if (tail >= instance->rxBufferSize) {
+            tail = 0;
+        }
+    }
+
+    instance->rxBufferTail = tail;
+    return count;
+}
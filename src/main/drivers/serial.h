@@ -35,6 +35,7 @@ typedef enum portOptions_t {
 } portOptions_t;
 
 typedef void (*serialReceiveCallbackPtr)(uint16_t data);   // used by serial drivers to return frames to app
+typedef void (*serialReceiveSpanCallbackPtr)(const uint8_t *data, uint16_t length);   // as above, for ports that receive by DMA
 
 typedef struct serialPort_s {
 
@@ -57,13 +58,15 @@ typedef struct serialPort_s {
 
     // FIXME rename member to rxCallback
     serialReceiveCallbackPtr callback;
+    // Optional, ports that receive by DMA hand over what arrived in one call instead of calling back per byte
+    serialReceiveSpanCallbackPtr rxSpanCallback;
 } serialPort_t;
 
 struct serialPortVTable {
     void (*serialWrite)(serialPort_t *instance, uint8_t ch);
 
-    uint8_t (*serialTotalRxWaiting)(serialPort_t *instance);
-    uint8_t (*serialTotalTxFree)(serialPort_t *instance);
+    uint32_t (*serialTotalRxWaiting)(serialPort_t *instance);
+    uint32_t (*serialTotalTxFree)(serialPort_t *instance);
 
     uint8_t (*serialRead)(serialPort_t *instance);
 
@@ -77,17 +80,28 @@ struct serialPortVTable {
     // Optional functions used to buffer large writes.
     void (*beginWrite)(serialPort_t *instance);
     void (*endWrite)(serialPort_t *instance);
+
+    // Optional, copy many bytes at a time, reads return how many were waiting up to count
+    void (*writeBuf)(serialPort_t *instance, const uint8_t *data, uint32_t count);
+    uint32_t (*readBuf)(serialPort_t *instance, uint8_t *data, uint32_t count);
 };
 
 void serialWrite(serialPort_t *instance, uint8_t ch);
-uint8_t serialRxBytesWaiting(serialPort_t *instance);
-uint8_t serialTxBytesFree(serialPort_t *instance);
+void serialWriteBuf(serialPort_t *instance, const uint8_t *data, uint32_t count);
+uint32_t serialRxBytesWaiting(serialPort_t *instance);
+uint32_t serialTxBytesFree(serialPort_t *instance);
 uint8_t serialRead(serialPort_t *instance);
+uint32_t serialReadBuf(serialPort_t *instance, uint8_t *data, uint32_t count);
 void serialSetBaudRate(serialPort_t *instance, uint32_t baudRate);
 void serialSetMode(serialPort_t *instance, portMode_t mode);
 bool isSerialTransmitBufferEmpty(serialPort_t *instance);
 void serialPrint(serialPort_t *instance, const char *str);
 uint32_t serialGetBaudRate(serialPort_t *instance);
+void serialSetReceiveSpanCallback(serialPort_t *instance, serialReceiveSpanCallbackPtr callback);
 
 void serialBeginWrite(serialPort_t *instance);
 void serialEndWrite(serialPort_t *instance);
+
+// For the drivers, copy in and out of the rxBuffer and txBuffer rings of the port
+void serialBufferWrite(serialPort_t *instance, const uint8_t *data, uint32_t count);
+uint32_t serialBufferRead(serialPort_t *instance, uint8_t *data, uint32_t count);
@@ -658,7 +658,7 @@ void onSerialRxPinChange(timerCCHandlerRec_t *cbRec, captureCompare_t capture)
 
 }
 
-uint8_t escSerialTotalBytesWaiting(serialPort_t *instance)
+uint32_t escSerialTotalBytesWaiting(serialPort_t *instance)
 {
     if ((instance->mode & MODE_RX) == 0) {
         return 0;
@@ -696,6 +696,24 @@ void escSerialWriteByte(serialPort_t *s, uint8_t ch)
     s->txBufferHead = (s->txBufferHead + 1) % s->txBufferSize;
 }
 
+uint32_t escSerialReadBuf(serialPort_t *instance, uint8_t *data, uint32_t count)
+{
+    if ((instance->mode & MODE_RX) == 0) {
+        return 0;
+    }
+
+    return serialBufferRead(instance, data, count);
+}
+
+void escSerialWriteBuf(serialPort_t *instance, const uint8_t *data, uint32_t count)
+{
+    if ((instance->mode & MODE_TX) == 0) {
+        return;
+    }
+
+    serialBufferWrite(instance, data, count);
+}
+
 void escSerialSetBaudRate(serialPort_t *s, uint32_t baudRate)
 {
     UNUSED(s);
@@ -713,7 +731,7 @@ bool isEscSerialTransmitBufferEmpty(serialPort_t *instance)
     return instance->txBufferHead == instance->txBufferTail;
 }
 
-uint8_t escSerialTxBytesFree(serialPort_t *instance)
+uint32_t escSerialTxBytesFree(serialPort_t *instance)
 {
     if ((instance->mode & MODE_TX) == 0) {
         return 0;
@@ -721,7 +739,7 @@ uint8_t escSerialTxBytesFree(serialPort_t *instance)
 
     escSerial_t *s = (escSerial_t *)instance;
 
-    uint8_t bytesUsed = (s->port.txBufferHead - s->port.txBufferTail) & (s->port.txBufferSize - 1);
+    uint32_t bytesUsed = (s->port.txBufferHead - s->port.txBufferTail) & (s->port.txBufferSize - 1);
 
     return (s->port.txBufferSize - 1) - bytesUsed;
 }
@@ -735,6 +753,10 @@ const struct serialPortVTable escSerialVTable[] = {
         escSerialSetBaudRate,
         isEscSerialTransmitBufferEmpty,
         escSerialSetMode,
+        .beginWrite = NULL,
+        .endWrite = NULL,
+        .writeBuf = escSerialWriteBuf,
+        .readBuf = escSerialReadBuf,
     }
 };
 
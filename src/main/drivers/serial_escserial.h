@@ -28,8 +28,10 @@ serialPort_t *openEscSerial(escSerialPortIndex_e portIndex, serialReceiveCallbac
 
 // serialPort API
 void escSerialWriteByte(serialPort_t *instance, uint8_t ch);
-uint8_t escSerialTotalBytesWaiting(serialPort_t *instance);
+void escSerialWriteBuf(serialPort_t *instance, const uint8_t *data, uint32_t count);
+uint32_t escSerialTotalBytesWaiting(serialPort_t *instance);
 uint8_t escSerialReadByte(serialPort_t *instance);
+uint32_t escSerialReadBuf(serialPort_t *instance, uint8_t *data, uint32_t count);
 void escSerialSetBaudRate(serialPort_t *s, uint32_t baudRate);
 bool isEscSerialTransmitBufferEmpty(serialPort_t *s);
 void escSerialInitialize();
@@ -0,0 +1,91 @@
+/*
+ * This file is part of Cleanflight.
+ *
+ * Cleanflight is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cleanflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cleanflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Receive by circular DMA for ports with a receive callback. The DMA fills the buffer without an interrupt per
+ * byte, and the half transfer, transfer complete and idle line interrupts call serialRxDmaService() with the count
+ * the DMA has left to go in its pass. Whatever arrived since the last call is handed over in at most two spans,
+ * the second one when it runs over the end of the buffer, so a frame followed by a silence is handed over whole.
+ *
+ * All of these interrupts must be of the same preemption priority, none of them may run in the middle of another.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "platform.h"
+
+#include "serial.h"
+#include "serial_rx_dma.h"
+
+void serialRxDmaInit(serialRxDma_t *rxDma, const volatile uint8_t *buffer, uint16_t size)
+{
+    rxDma->buffer = buffer;
+    rxDma->size = size;
+    rxDma->wraps = 0;
+    rxDma->consumed = 0;
+    rxDma->overruns = 0;
+    rxDma->lostBytes = 0;
+}
+
+// Transfer complete interrupt, the DMA is back at the start of the buffer
+void serialRxDmaWrapped(serialRxDma_t *rxDma)
+{
+    rxDma->wraps++;
+}
+
+static void serialRxDmaHandOver(serialPort_t *port, const uint8_t *data, uint16_t length)
+{
+    if (port->rxSpanCallback) {
+        port->rxSpanCallback(data, length);
+    } else if (port->callback) {
+        while (length--) {
+            port->callback(*data++);
+        }
+    }
+}
+
+// remaining is the data counter of the DMA, it counts down from the size of the buffer
+void serialRxDmaService(serialRxDma_t *rxDma, serialPort_t *port, uint16_t remaining)
+{
+    const uint32_t size = rxDma->size;
+    const uint32_t received = rxDma->wraps * size + size - remaining;
+    uint32_t pending = received - rxDma->consumed;
+
+    if ((int32_t)pending < 0) {
+        // The DMA has wrapped but the transfer complete interrupt has not been taken yet
+        pending += size;
+    }
+
+    if (pending > size) {
+        // Bytes that were not handed over have been written over, start again from the latest byte
+        rxDma->overruns++;
+        rxDma->lostBytes += pending;
+        rxDma->consumed += pending;
+        return;
+    }
+
+    while (pending) {
+        const uint32_t index = rxDma->consumed & (size - 1);
+        const uint16_t span = pending < size - index ? pending : size - index;
+
+        // the DMA is done with these bytes, they are not volatile any more
+        serialRxDmaHandOver(port, (const uint8_t *)&rxDma->buffer[index], span);
+        rxDma->consumed += span;
+        pending -= span;
+    }
+}
@@ -0,0 +1,32 @@
+/*
+ * This file is part of Cleanflight.
+ *
+ * Cleanflight is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cleanflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cleanflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+// A port receiving into a circular DMA buffer, handing what arrived over to the receive callback(s) of the port
+typedef struct serialRxDma_s {
+    const volatile uint8_t *buffer;
+    uint16_t size;              // a power of two, so the byte counts below wrap round with the buffer
+    uint32_t wraps;             // passes of the DMA over the buffer, counted by its transfer complete interrupt
+    uint32_t consumed;          // bytes handed over or lost since the start
+    uint32_t overruns;          // times the DMA went round over bytes that were not handed over yet
+    uint32_t lostBytes;
+} serialRxDma_t;
+
+void serialRxDmaInit(serialRxDma_t *rxDma, const volatile uint8_t *buffer, uint16_t size);
+void serialRxDmaWrapped(serialRxDma_t *rxDma);
+void serialRxDmaService(serialRxDma_t *rxDma, serialPort_t *port, uint16_t remaining);
@@ -403,7 +403,7 @@ void onSerialRxPinChange(timerCCHandlerRec_t *cbRec, captureCompare_t capture)
     }
 }
 
-uint8_t softSerialRxBytesWaiting(serialPort_t *instance)
+uint32_t softSerialRxBytesWaiting(serialPort_t *instance)
 {
     if ((instance->mode & MODE_RX) == 0) {
         return 0;
@@ -414,7 +414,7 @@ uint8_t softSerialRxBytesWaiting(serialPort_t *instance)
     return (s->port.rxBufferHead - s->port.rxBufferTail) & (s->port.rxBufferSize - 1);
 }
 
-uint8_t softSerialTxBytesFree(serialPort_t *instance)
+uint32_t softSerialTxBytesFree(serialPort_t *instance)
 {
     if ((instance->mode & MODE_TX) == 0) {
         return 0;
@@ -422,7 +422,7 @@ uint8_t softSerialTxBytesFree(serialPort_t *instance)
 
     softSerial_t *s = (softSerial_t *)instance;
 
-    uint8_t bytesUsed = (s->port.txBufferHead - s->port.txBufferTail) & (s->port.txBufferSize - 1);
+    uint32_t bytesUsed = (s->port.txBufferHead - s->port.txBufferTail) & (s->port.txBufferSize - 1);
 
     return (s->port.txBufferSize - 1) - bytesUsed;
 }
@@ -454,6 +454,24 @@ void softSerialWriteByte(serialPort_t *s, uint8_t ch)
     s->txBufferHead = (s->txBufferHead + 1) % s->txBufferSize;
 }
 
+uint32_t softSerialReadBuf(serialPort_t *instance, uint8_t *data, uint32_t count)
+{
+    if ((instance->mode & MODE_RX) == 0) {
+        return 0;
+    }
+
+    return serialBufferRead(instance, data, count);
+}
+
+void softSerialWriteBuf(serialPort_t *instance, const uint8_t *data, uint32_t count)
+{
+    if ((instance->mode & MODE_TX) == 0) {
+        return;
+    }
+
+    serialBufferWrite(instance, data, count);
+}
+
 void softSerialSetBaudRate(serialPort_t *s, uint32_t baudRate)
 {
     softSerial_t *softSerial = (softSerial_t *)s;
@@ -481,6 +499,8 @@ const struct serialPortVTable softSerialVTable[] = {
         softSerialSetMode,
         .beginWrite = NULL,
         .endWrite = NULL,
+        .writeBuf = softSerialWriteBuf,
+        .readBuf = softSerialReadBuf,
   }
 };
 
@@ -23,11 +23,13 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "platform.h"
 
 #include "build_config.h"
 
+#include "common/maths.h"
 #include "common/utils.h"
 #include "gpio.h"
 #include "inverter.h"
@@ -120,8 +122,9 @@ serialPort_t *uartOpen(USART_TypeDef *USARTx, serialReceiveCallbackPtr callback,
     // common serial initialisation code should move to serialPort::init()
     s->port.rxBufferHead = s->port.rxBufferTail = 0;
     s->port.txBufferHead = s->port.txBufferTail = 0;
-    // callback works for IRQ-based RX ONLY
+    // callback works for IRQ-based RX and, on the F4, for RX DMA
     s->port.callback = callback;
+    s->port.rxSpanCallback = NULL;
     s->port.mode = mode;
     s->port.baudRate = baudRate;
     s->port.options = options;
@@ -164,6 +167,14 @@ serialPort_t *uartOpen(USART_TypeDef *USARTx, serialReceiveCallbackPtr callback,
             DMA_InitStructure.DMA_Memory0BaseAddr = (uint32_t)s->port.rxBuffer;
             DMA_DeInit(s->rxDMAStream);
             DMA_Init(s->rxDMAStream, &DMA_InitStructure);
+            if (callback) {
+                // What arrived goes to the callback when the line goes idle after a frame, or the buffer is half full
+                // or full, instead of an interrupt per byte
+                serialRxDmaInit(&s->rxDma, s->port.rxBuffer, s->port.rxBufferSize);
+                DMA_ClearITPendingBit(s->rxDMAStream, s->rxDMAHalfTransferIt | s->rxDMATransferCompleteIt);
+                DMA_ITConfig(s->rxDMAStream, DMA_IT_HT | DMA_IT_TC, ENABLE);
+                USART_ITConfig(s->USARTx, USART_IT_IDLE, ENABLE);
+            }
             DMA_Cmd(s->rxDMAStream, ENABLE);
             USART_DMACmd(s->USARTx, USART_DMAReq_Rx, ENABLE);
             s->rxDMAPos = DMA_GetCurrDataCounter(s->rxDMAStream);
@@ -281,7 +292,7 @@ void uartStartTxDMA(uartPort_t *s)
 #endif
 }
 
-uint8_t uartTotalRxBytesWaiting(serialPort_t *instance)
+uint32_t uartTotalRxBytesWaiting(serialPort_t *instance)
 {
     uartPort_t *s = (uartPort_t*)instance;
 #if defined(STM32F40_41xxx) || defined (STM32F411xE)
@@ -291,10 +302,11 @@ uint8_t uartTotalRxBytesWaiting(serialPort_t *instance)
     if (s->rxDMAChannel) {
         uint32_t rxDMAHead = s->rxDMAChannel->CNDTR;
 #endif
-        if (rxDMAHead >= s->rxDMAPos) {
-            return rxDMAHead - s->rxDMAPos;
+        // Both count down from the end of the buffer as the DMA and the reads go along
+        if (s->rxDMAPos >= rxDMAHead) {
+            return s->rxDMAPos - rxDMAHead;
         } else {
-            return s->port.rxBufferSize + rxDMAHead - s->rxDMAPos;
+            return s->port.rxBufferSize + s->rxDMAPos - rxDMAHead;
         }
     }
 
@@ -305,7 +317,7 @@ uint8_t uartTotalRxBytesWaiting(serialPort_t *instance)
     }
 }
 
-uint8_t uartTotalTxBytesFree(serialPort_t *instance)
+uint32_t uartTotalTxBytesFree(serialPort_t *instance)
 {
     uartPort_t *s = (uartPort_t*)instance;
 
@@ -387,16 +399,37 @@ uint8_t uartRead(serialPort_t *instance)
     return ch;
 }
 
-void uartWrite(serialPort_t *instance, uint8_t ch)
+// Reads as many bytes as are waiting, up to count, with a copy per part of the buffer
+uint32_t uartReadBuf(serialPort_t *instance, uint8_t *data, uint32_t count)
 {
     uartPort_t *s = (uartPort_t *)instance;
-    s->port.txBuffer[s->port.txBufferHead] = ch;
-    if (s->port.txBufferHead + 1 >= s->port.txBufferSize) {
-        s->port.txBufferHead = 0;
-    } else {
-        s->port.txBufferHead++;
+
+#if defined(STM32F40_41xxx) || defined (STM32F411xE)
+    if (s->rxDMAStream) {
+#else
+    if (s->rxDMAChannel) {
+#endif
+        count = MIN(count, uartTotalRxBytesWaiting(instance));
+        for (uint32_t remaining = count; remaining; ) {
+            const uint32_t tail = s->port.rxBufferSize - s->rxDMAPos;
+            const uint32_t span = MIN(remaining, s->rxDMAPos);
+
+            memcpy(data, (const uint8_t *)&s->port.rxBuffer[tail], span);
+            data += span;
+            remaining -= span;
+            s->rxDMAPos -= span;
+            if (s->rxDMAPos == 0) {
+                s->rxDMAPos = s->port.rxBufferSize;
+            }
+        }
+        return count;
     }
 
+    return serialBufferRead(instance, data, count);
+}
+
+static void uartStartTx(uartPort_t *s)
+{
 #if defined(STM32F40_41xxx) || defined (STM32F411xE)
     if (s->txDMAStream) {
         if (!(s->txDMAStream->CR & 1))
@@ -410,6 +443,28 @@ void uartWrite(serialPort_t *instance, uint8_t ch)
     }
 }
 
+void uartWrite(serialPort_t *instance, uint8_t ch)
+{
+    uartPort_t *s = (uartPort_t *)instance;
+    s->port.txBuffer[s->port.txBufferHead] = ch;
+    if (s->port.txBufferHead + 1 >= s->port.txBufferSize) {
+        s->port.txBufferHead = 0;
+    } else {
+        s->port.txBufferHead++;
+    }
+
+    uartStartTx(s);
+}
+
+// One copy per part of the buffer and one start of the transmission, instead of both for every byte
+void uartWriteBuf(serialPort_t *instance, const uint8_t *data, uint32_t count)
+{
+    uartPort_t *s = (uartPort_t *)instance;
+
+    serialBufferWrite(instance, data, count);
+    uartStartTx(s);
+}
+
 const struct serialPortVTable uartVTable[] = {
     {
         uartWrite,
@@ -421,5 +476,7 @@ const struct serialPortVTable uartVTable[] = {
         uartSetMode,
         .beginWrite = NULL,
         .endWrite = NULL,
+        .writeBuf = uartWriteBuf,
+        .readBuf = uartReadBuf,
     }
 };
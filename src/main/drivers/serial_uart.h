@@ -17,12 +17,12 @@
 
 #pragma once
 
+#include "serial_rx_dma.h"
+
 // Since serial ports can be used for any function these buffer sizes should be equal
 // The two largest things that need to be sent are: 1, MSP responses, 2, UBLOX SVINFO packet.
 
 // Size must be a power of two due to various optimizations which use 'and' instead of 'mod'
-// Various serial routines return the buffer occupied size as uint8_t which would need to be extended in order to
-// increase size further.
 #define UART1_RX_BUFFER_SIZE    256
 #define UART1_TX_BUFFER_SIZE    256
 #define UART2_RX_BUFFER_SIZE    256
@@ -44,6 +44,9 @@ typedef struct {
     DMA_Stream_TypeDef *txDMAStream;
     uint32_t rxDMAChannel;
     uint32_t txDMAChannel;
+    uint32_t rxDMAHalfTransferIt;
+    uint32_t rxDMATransferCompleteIt;
+    serialRxDma_t rxDma;        // for a port with a receive callback
 #else
     DMA_Channel_TypeDef *rxDMAChannel;
     DMA_Channel_TypeDef *txDMAChannel;
@@ -65,8 +68,10 @@ serialPort_t *uartOpen(USART_TypeDef *USARTx, serialReceiveCallbackPtr callback,
 
 // serialPort API
 void uartWrite(serialPort_t *instance, uint8_t ch);
-uint8_t uartTotalRxBytesWaiting(serialPort_t *instance);
-uint8_t uartTotalTxBytesFree(serialPort_t *instance);
+void uartWriteBuf(serialPort_t *instance, const uint8_t *data, uint32_t count);
+uint32_t uartTotalRxBytesWaiting(serialPort_t *instance);
+uint32_t uartTotalTxBytesFree(serialPort_t *instance);
 uint8_t uartRead(serialPort_t *instance);
+uint32_t uartReadBuf(serialPort_t *instance, uint8_t *data, uint32_t count);
 void uartSetBaudRate(serialPort_t *s, uint32_t baudRate);
 bool isUartTransmitBufferEmpty(serialPort_t *s);
@@ -36,11 +36,16 @@
 #include "serial_uart.h"
 #include "serial_uart_impl.h"
 
-// Using RX DMA disables the use of receive callbacks
-//#define USE_USART1_RX_DMA
-//#define USE_USART2_RX_DMA
-//#define USE_USART3_RX_DMA
-//#define USE_USART6_RX_DMA
+// Polled ports read the RX DMA buffer, ports with a receive callback get what arrived from the idle line and half/full
+// buffer interrupts, no port takes an interrupt per received byte.
+#define USE_USART1_RX_DMA
+#if !defined(USE_SPI_DMA) || !defined(USE_SPI_DEVICE_3)
+#define USE_USART2_RX_DMA       // DMA1 stream 5 is the SPI3 TX DMA
+#endif
+#define USE_USART3_RX_DMA
+//#define USE_USART4_RX_DMA     // DMA1 stream 2 is the ws2811 LED strip DMA
+//#define USE_USART5_RX_DMA     // DMA1 stream 0 is the SPI3 RX DMA
+#define USE_USART6_RX_DMA
 
 
 #ifdef USE_USART1
@@ -88,6 +93,12 @@ void usartIrqHandler(uartPort_t *s)
         }
     }
 
+    if (s->rxDMAStream && (USART_GetITStatus(s->USARTx, USART_IT_IDLE) == SET)) {
+        // The flag clears by reading the status and then the data register, the DMA has taken the data already
+        (void)s->USARTx->DR;
+        serialRxDmaService(&s->rxDma, &s->port, s->rxDMAStream->NDTR);
+    }
+
     if (USART_GetITStatus(s->USARTx, USART_FLAG_ORE) == SET)
     {
         USART_ClearITPendingBit (s->USARTx, USART_IT_ORE);
@@ -95,6 +106,19 @@ void usartIrqHandler(uartPort_t *s)
 }
 
 
+static void handleUsartRxDma(uartPort_t *s)
+{
+    if (DMA_GetITStatus(s->rxDMAStream, s->rxDMATransferCompleteIt)) {
+        DMA_ClearITPendingBit(s->rxDMAStream, s->rxDMATransferCompleteIt);
+        serialRxDmaWrapped(&s->rxDma);
+    }
+    if (DMA_GetITStatus(s->rxDMAStream, s->rxDMAHalfTransferIt)) {
+        DMA_ClearITPendingBit(s->rxDMAStream, s->rxDMAHalfTransferIt);
+    }
+
+    serialRxDmaService(&s->rxDma, &s->port, s->rxDMAStream->NDTR);
+}
+
 static void handleUsartTxDma(uartPort_t *s)
 {
     DMA_Cmd(s->txDMAStream, DISABLE);
@@ -134,6 +158,8 @@ uartPort_t *serialUSART1(uint32_t baudRate, portMode_t mode, portOptions_t optio
 #ifdef USE_USART1_RX_DMA
     s->rxDMAChannel = DMA_Channel_4;
     s->rxDMAStream = DMA2_Stream5;
+    s->rxDMAHalfTransferIt = DMA_IT_HTIF5;
+    s->rxDMATransferCompleteIt = DMA_IT_TCIF5;
 #endif
     s->txDMAChannel = DMA_Channel_4;
     s->txDMAStream = DMA2_Stream7;
@@ -185,13 +211,21 @@ uartPort_t *serialUSART1(uint32_t baudRate, portMode_t mode, portOptions_t optio
     NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
     NVIC_Init(&NVIC_InitStructure);
 
-#ifndef USE_USART1_RX_DMA
+#ifdef USE_USART1_RX_DMA
+    // DMA RX Interrupt
+    NVIC_InitStructure.NVIC_IRQChannel = DMA2_Stream5_IRQn;
+    NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = NVIC_PRIORITY_BASE(NVIC_PRIO_SERIALUART1_RXDMA);
+    NVIC_InitStructure.NVIC_IRQChannelSubPriority = NVIC_PRIORITY_SUB(NVIC_PRIO_SERIALUART1_RXDMA);
+    NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+    NVIC_Init(&NVIC_InitStructure);
+#endif
+
+    // RX/TX Interrupt, the idle line with RX DMA
     NVIC_InitStructure.NVIC_IRQChannel = USART1_IRQn;
     NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = NVIC_PRIORITY_BASE(NVIC_PRIO_SERIALUART1);
     NVIC_InitStructure.NVIC_IRQChannelSubPriority = NVIC_PRIORITY_SUB(NVIC_PRIO_SERIALUART1);
     NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
     NVIC_Init(&NVIC_InitStructure);
-#endif
 
     return s;
 }
@@ -221,6 +255,16 @@ void DMA2_Stream7_IRQHandler(void)
 	}
 }
 
+#ifdef USE_USART1_RX_DMA
+// USART1 Rx DMA Handler
+void DMA2_Stream5_IRQHandler(void)
+{
+    uartPort_t *s = &uartPort1;
+
+    handleUsartRxDma(s);
+}
+#endif
+
 // USART1 Rx/Tx IRQ Handler
 void USART1_IRQHandler(void)
 {
@@ -260,6 +304,8 @@ uartPort_t *serialUSART2(uint32_t baudRate, portMode_t mode, portOptions_t optio
 #ifdef USE_USART2_RX_DMA
     s->rxDMAChannel = DMA_Channel_4;
     s->rxDMAStream = DMA1_Stream5;
+    s->rxDMAHalfTransferIt = DMA_IT_HTIF5;
+    s->rxDMATransferCompleteIt = DMA_IT_TCIF5;
 #endif
     s->txDMAChannel = DMA_Channel_4;
     s->txDMAStream = DMA1_Stream6;
@@ -305,14 +351,21 @@ uartPort_t *serialUSART2(uint32_t baudRate, portMode_t mode, portOptions_t optio
 	NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
 	NVIC_Init(&NVIC_InitStructure);
 
-	#ifndef USE_USART2_RX_DMA
-	// RX/TX Interrupt
+#ifdef USE_USART2_RX_DMA
+	// DMA RX Interrupt
+	NVIC_InitStructure.NVIC_IRQChannel = DMA1_Stream5_IRQn;
+	NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = NVIC_PRIORITY_BASE(NVIC_PRIO_SERIALUART2_RXDMA);
+	NVIC_InitStructure.NVIC_IRQChannelSubPriority = NVIC_PRIORITY_SUB(NVIC_PRIO_SERIALUART2_RXDMA);
+	NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+	NVIC_Init(&NVIC_InitStructure);
+#endif
+
+	// RX/TX Interrupt, the idle line with RX DMA
 	NVIC_InitStructure.NVIC_IRQChannel = USART2_IRQn;
 	NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = NVIC_PRIORITY_BASE(NVIC_PRIO_SERIALUART2);
 	NVIC_InitStructure.NVIC_IRQChannelSubPriority = NVIC_PRIORITY_SUB(NVIC_PRIO_SERIALUART2);
 	NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
 	NVIC_Init(&NVIC_InitStructure);
-	#endif
 
 	return s;
 }
@@ -340,6 +393,16 @@ void DMA1_Stream6_IRQHandler(void)
 	}
 }
 
+#ifdef USE_USART2_RX_DMA
+// USART2 Rx DMA Handler
+void DMA1_Stream5_IRQHandler(void)
+{
+    uartPort_t *s = &uartPort2;
+
+    handleUsartRxDma(s);
+}
+#endif
+
 void USART2_IRQHandler(void)
 {
 	uartPort_t *s = &uartPort2;
@@ -377,6 +440,8 @@ uartPort_t *serialUSART3(uint32_t baudRate, portMode_t mode, portOptions_t optio
 #ifdef USE_USART3_RX_DMA
     s->rxDMAChannel = DMA_Channel_4;
     s->rxDMAStream = DMA1_Stream1;
+    s->rxDMAHalfTransferIt = DMA_IT_HTIF1;
+    s->rxDMATransferCompleteIt = DMA_IT_TCIF1;
 #endif
     s->txDMAChannel = DMA_Channel_4;
     s->txDMAStream = DMA1_Stream3;
@@ -421,14 +486,21 @@ uartPort_t *serialUSART3(uint32_t baudRate, portMode_t mode, portOptions_t optio
     NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
     NVIC_Init(&NVIC_InitStructure);
 
-#ifndef USE_USART3_RX_DMA
-    // RX/TX Interrupt
+#ifdef USE_USART3_RX_DMA
+    // DMA RX Interrupt
+    NVIC_InitStructure.NVIC_IRQChannel = DMA1_Stream1_IRQn;
+    NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = NVIC_PRIORITY_BASE(NVIC_PRIO_SERIALUART3_RXDMA);
+    NVIC_InitStructure.NVIC_IRQChannelSubPriority = NVIC_PRIORITY_SUB(NVIC_PRIO_SERIALUART3_RXDMA);
+    NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+    NVIC_Init(&NVIC_InitStructure);
+#endif
+
+    // RX/TX Interrupt, the idle line with RX DMA
     NVIC_InitStructure.NVIC_IRQChannel = USART3_IRQn;
     NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = NVIC_PRIORITY_BASE(NVIC_PRIO_SERIALUART3);
     NVIC_InitStructure.NVIC_IRQChannelSubPriority = NVIC_PRIORITY_SUB(NVIC_PRIO_SERIALUART3);
     NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
     NVIC_Init(&NVIC_InitStructure);
-#endif
 
     return s;
 }
@@ -456,6 +528,16 @@ void DMA1_Stream3_IRQHandler(void)
 	}
 }
 
+#ifdef USE_USART3_RX_DMA
+// USART3 Rx DMA Handler
+void DMA1_Stream1_IRQHandler(void)
+{
+    uartPort_t *s = &uartPort3;
+
+    handleUsartRxDma(s);
+}
+#endif
+
 void USART3_IRQHandler(void)
 {
     uartPort_t *s = &uartPort3;
@@ -493,6 +575,8 @@ uartPort_t *serialUSART4(uint32_t baudRate, portMode_t mode, portOptions_t optio
 #ifdef USE_USART4_RX_DMA
     s->rxDMAChannel = DMA_Channel_4;
     s->rxDMAStream = DMA1_Stream2;
+    s->rxDMAHalfTransferIt = DMA_IT_HTIF2;
+    s->rxDMATransferCompleteIt = DMA_IT_TCIF2;
 #endif
     s->txDMAChannel = DMA_Channel_4;
     s->txDMAStream = DMA1_Stream4;
@@ -537,14 +621,21 @@ uartPort_t *serialUSART4(uint32_t baudRate, portMode_t mode, portOptions_t optio
     NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
     NVIC_Init(&NVIC_InitStructure);
 
-#ifndef USE_USART4_RX_DMA
-    // RX/TX Interrupt
+#ifdef USE_USART4_RX_DMA
+    // DMA RX Interrupt
+    NVIC_InitStructure.NVIC_IRQChannel = DMA1_Stream2_IRQn;
+    NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = NVIC_PRIORITY_BASE(NVIC_PRIO_SERIALUART4_RXDMA);
+    NVIC_InitStructure.NVIC_IRQChannelSubPriority = NVIC_PRIORITY_SUB(NVIC_PRIO_SERIALUART4_RXDMA);
+    NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+    NVIC_Init(&NVIC_InitStructure);
+#endif
+
+    // RX/TX Interrupt, the idle line with RX DMA
     NVIC_InitStructure.NVIC_IRQChannel = UART4_IRQn;
     NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = NVIC_PRIORITY_BASE(NVIC_PRIO_SERIALUART4);
     NVIC_InitStructure.NVIC_IRQChannelSubPriority = NVIC_PRIORITY_SUB(NVIC_PRIO_SERIALUART4);
     NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
     NVIC_Init(&NVIC_InitStructure);
-#endif
 
     return s;
 }
@@ -572,6 +663,16 @@ void DMA1_Stream4_IRQHandler(void)
 	}
 }
 
+#ifdef USE_USART4_RX_DMA
+// UART4 Rx DMA Handler
+void DMA1_Stream2_IRQHandler(void)
+{
+    uartPort_t *s = &uartPort4;
+
+    handleUsartRxDma(s);
+}
+#endif
+
 void UART4_IRQHandler(void)
 {
     uartPort_t *s = &uartPort4;
@@ -609,6 +710,8 @@ uartPort_t *serialUSART5(uint32_t baudRate, portMode_t mode, portOptions_t optio
 #ifdef USE_USART5_RX_DMA
     s->rxDMAChannel = DMA_Channel_4;
     s->rxDMAStream = DMA1_Stream0;
+    s->rxDMAHalfTransferIt = DMA_IT_HTIF0;
+    s->rxDMATransferCompleteIt = DMA_IT_TCIF0;
 #endif
     s->txDMAChannel = DMA_Channel_4;
     s->txDMAStream = DMA1_Stream7;
@@ -653,14 +756,21 @@ uartPort_t *serialUSART5(uint32_t baudRate, portMode_t mode, portOptions_t optio
     NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
     NVIC_Init(&NVIC_InitStructure);
 
-#ifndef USE_USART5_RX_DMA
-    // RX/TX Interrupt
+#ifdef USE_USART5_RX_DMA
+    // DMA RX Interrupt
+    NVIC_InitStructure.NVIC_IRQChannel = DMA1_Stream0_IRQn;
+    NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = NVIC_PRIORITY_BASE(NVIC_PRIO_SERIALUART5_RXDMA);
+    NVIC_InitStructure.NVIC_IRQChannelSubPriority = NVIC_PRIORITY_SUB(NVIC_PRIO_SERIALUART5_RXDMA);
+    NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+    NVIC_Init(&NVIC_InitStructure);
+#endif
+
+    // RX/TX Interrupt, the idle line with RX DMA
     NVIC_InitStructure.NVIC_IRQChannel = UART5_IRQn;
     NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = NVIC_PRIORITY_BASE(NVIC_PRIO_SERIALUART5);
     NVIC_InitStructure.NVIC_IRQChannelSubPriority = NVIC_PRIORITY_SUB(NVIC_PRIO_SERIALUART5);
     NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
     NVIC_Init(&NVIC_InitStructure);
-#endif
 
     return s;
 }
@@ -688,6 +798,16 @@ void DMA1_Stream7_IRQHandler(void)
 	}
 }
 
+#ifdef USE_USART5_RX_DMA
+// UART5 Rx DMA Handler
+void DMA1_Stream0_IRQHandler(void)
+{
+    uartPort_t *s = &uartPort5;
+
+    handleUsartRxDma(s);
+}
+#endif
+
 void UART5_IRQHandler(void)
 {
     uartPort_t *s = &uartPort5;
@@ -726,6 +846,8 @@ uartPort_t *serialUSART6(uint32_t baudRate, portMode_t mode, portOptions_t optio
 #ifdef USE_USART6_RX_DMA
     s->rxDMAChannel = DMA_Channel_5;
     s->rxDMAStream = DMA2_Stream1;
+    s->rxDMAHalfTransferIt = DMA_IT_HTIF1;
+    s->rxDMATransferCompleteIt = DMA_IT_TCIF1;
 #endif
     s->txDMAChannel = DMA_Channel_5;
     s->txDMAStream = DMA2_Stream6;
@@ -771,14 +893,21 @@ uartPort_t *serialUSART6(uint32_t baudRate, portMode_t mode, portOptions_t optio
     NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
     NVIC_Init(&NVIC_InitStructure);
 
-#ifndef USE_USART6_RX_DMA
-    // RX/TX Interrupt
+#ifdef USE_USART6_RX_DMA
+    // DMA RX Interrupt
+    NVIC_InitStructure.NVIC_IRQChannel = DMA2_Stream1_IRQn;
+    NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = NVIC_PRIORITY_BASE(NVIC_PRIO_SERIALUART6_RXDMA);
+    NVIC_InitStructure.NVIC_IRQChannelSubPriority = NVIC_PRIORITY_SUB(NVIC_PRIO_SERIALUART6_RXDMA);
+    NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+    NVIC_Init(&NVIC_InitStructure);
+#endif
+
+    // RX/TX Interrupt, the idle line with RX DMA
     NVIC_InitStructure.NVIC_IRQChannel = USART6_IRQn;
     NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = NVIC_PRIORITY_BASE(NVIC_PRIO_SERIALUART6);
     NVIC_InitStructure.NVIC_IRQChannelSubPriority = NVIC_PRIORITY_SUB(NVIC_PRIO_SERIALUART6);
     NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
     NVIC_Init(&NVIC_InitStructure);
-#endif
 
     return s;
 }
@@ -806,6 +935,16 @@ void DMA2_Stream6_IRQHandler(void)
 	}
 }
 
+#ifdef USE_USART6_RX_DMA
+// USART6 Rx DMA Handler
+void DMA2_Stream1_IRQHandler(void)
+{
+    uartPort_t *s = &uartPort6;
+
+    handleUsartRxDma(s);
+}
+#endif
+
 void USART6_IRQHandler(void)
 {
     uartPort_t *s = &uartPort6;
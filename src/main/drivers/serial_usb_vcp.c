@@ -31,6 +31,7 @@
 #include "usb_init.h"
 #include "hw_config.h"
 #endif
+#include "common/maths.h"
 #include "common/utils.h"
 
 #include "drivers/system.h"
@@ -65,11 +66,11 @@ static bool isUsbVcpTransmitBufferEmpty(serialPort_t *instance)
     return true;
 }
 
-static uint8_t usbVcpAvailable(serialPort_t *instance)
+static uint32_t usbVcpAvailable(serialPort_t *instance)
 {
     UNUSED(instance);
 
-    return receiveLength & 0xFF; // FIXME use uint32_t return type everywhere
+    return receiveLength;
 }
 
 static uint8_t usbVcpRead(serialPort_t *instance)
@@ -87,6 +88,24 @@ static uint8_t usbVcpRead(serialPort_t *instance)
     return buf[0];
 }
 
+// Takes what the CDC driver has, it hands over up to a packet (F1) or a byte (F4) at a time
+static uint32_t usbVcpReadBuf(serialPort_t *instance, uint8_t *data, uint32_t count)
+{
+    UNUSED(instance);
+
+    uint32_t rxed = 0;
+
+    while (rxed < count) {
+        const uint32_t received = CDC_Receive_DATA(data + rxed, count - rxed);
+        if (received == 0) {
+            break;
+        }
+        rxed += received;
+    }
+
+    return rxed;
+}
+
 static bool usbVcpFlush(vcpPort_t *port)
 {
     uint8_t count = port->txAt;
@@ -119,9 +138,28 @@ static void usbVcpWrite(serialPort_t *instance, uint8_t c)
     }
 }
 
-/*
- * unused functions
- *
+// Fills the packet buffer a part at a time, the same as writing the bytes one by one
+static void usbVcpWriteBuf(serialPort_t *instance, const uint8_t *data, uint32_t count)
+{
+    vcpPort_t *port = container_of(instance, vcpPort_t, port);
+
+    while (count) {
+        const uint32_t span = MIN(count, ARRAYLEN(port->txBuf) - port->txAt);
+
+        memcpy(&port->txBuf[port->txAt], data, span);
+        port->txAt += span;
+        data += span;
+        count -= span;
+        if (port->txAt >= ARRAYLEN(port->txBuf)) {
+            usbVcpFlush(port);
+        }
+    }
+
+    if (!port->buffering) {
+        usbVcpFlush(port);
+    }
+}
+
 static void usbVcpBeginWrite(serialPort_t *instance)
 {
     vcpPort_t *port = container_of(instance, vcpPort_t, port);
@@ -134,13 +172,13 @@ static void usbVcpEndWrite(serialPort_t *instance)
     port->buffering = false;
     usbVcpFlush(port);
 }
-*/
-uint8_t usbTxBytesFree() {
+
+uint32_t usbTxBytesFree() {
     // Because we block upon transmit and don't buffer bytes, our "buffer" capacity is effectively unlimited.
     return 255;
 }
 
-const struct serialPortVTable usbVTable[] = { { usbVcpWrite, usbVcpAvailable, usbTxBytesFree, usbVcpRead, usbVcpSetBaudRate, isUsbVcpTransmitBufferEmpty, usbVcpSetMode, 0, 0 } };
+const struct serialPortVTable usbVTable[] = { { usbVcpWrite, usbVcpAvailable, usbTxBytesFree, usbVcpRead, usbVcpSetBaudRate, isUsbVcpTransmitBufferEmpty, usbVcpSetMode, usbVcpBeginWrite, usbVcpEndWrite, usbVcpWriteBuf, usbVcpReadBuf } };
 
 serialPort_t *usbVcpOpen(void)
 {
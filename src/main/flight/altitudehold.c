@@ -189,6 +189,7 @@ int32_t calculateAltHoldThrottleAdjustment(int32_t vel_tmp, float accZ_tmp, floa
     int32_t error;
     int32_t setVel;
 
+    imuUpdateEulerAngles();
     if (!isThrustFacingDownwards(&attitude)) {
         return result;
     }
@@ -260,6 +261,7 @@ void calculateEstimatedAltitude(uint32_t currentTime)
 #endif
 
 #ifdef SONAR
+    imuUpdateEulerAngles();
     tiltAngle = calculateTiltAngle(&attitude);
     sonarAlt = sonarRead();
     sonarAlt = sonarCalculateAltitude(sonarAlt, tiltAngle);
@@ -29,6 +29,7 @@
 
 #include "common/axis.h"
 #include "common/filter.h"
+#include "common/utils.h"
 
 #include "drivers/system.h"
 #include "drivers/sensor.h"
@@ -77,7 +78,15 @@ static accDeadband_t *accDeadband;
 STATIC_UNIT_TESTED float q0 = 1.0f, q1 = 0.0f, q2 = 0.0f, q3 = 0.0f;    // quaternion of sensor frame relative to earth frame
 static float rMat[3][3];
 
+// rad/s added to the gyro rates by every integration step, the proportional and integral feedback of the last correction
+static float correctionRate[XYZ_AXIS_COUNT];
+
+// Sample times of the acc and mag readings fused so far
+static uint32_t fusedAccSampleTime;
+static uint32_t fusedMagSampleTime;
+
 attitudeEulerAngles_t attitude = { { 0, 0, 0 } };     // absolute angle inclination in multiple of 0.1 degree    180 deg = 1800
+STATIC_UNIT_TESTED bool attitudeIsStale = false;      // rMat has moved on since attitude was worked out
 
 static float gyroScale;
 
@@ -225,16 +234,20 @@ static float imuGetPGainScaleFactor(void)
     }
 }
 
-static void imuMahonyAHRSupdate(float dt, float gx, float gy, float gz,
-                                bool useAcc, float ax, float ay, float az,
-                                bool useMag, float mx, float my, float mz,
-                                bool useYaw, float yawError)
+/*
+ * The feedback half of the Mahony filter, the error between the attitude and the acc, mag or GPS heading measurements
+ * turned into a rate correction that imuIntegrateGyro() adds to the gyro until the next call. dt is the time since the
+ * last call, which is the loop time unless the corrections run in their own task.
+ */
+static void imuMahonyAHRSCorrection(float dt, float gx, float gy, float gz,
+                                    bool useAcc, float ax, float ay, float az,
+                                    bool useMag, float mx, float my, float mz,
+                                    bool useYaw, float yawError)
 {
     static float integralFBx = 0.0f,  integralFBy = 0.0f, integralFBz = 0.0f;    // integral error terms scaled by Ki
     float recipNorm;
     float hx, hy, bx;
     float ex = 0, ey = 0, ez = 0;
-    float qa, qb, qc;
 
     // Calculate general spin rate (rad/s)
     float spin_rate = sqrtf(sq(gx) + sq(gy) + sq(gz));
@@ -308,10 +321,22 @@ static void imuMahonyAHRSupdate(float dt, float gx, float gy, float gz,
     // Calculate kP gain. If we are acquiring initial attitude (not armed and within 20 sec from powerup) scale the kP to converge faster
     float dcmKpGain = imuRuntimeConfig->dcm_kp * imuGetPGainScaleFactor();
 
+    // Proportional and integral feedback
+    correctionRate[X] = dcmKpGain * ex + integralFBx;
+    correctionRate[Y] = dcmKpGain * ey + integralFBy;
+    correctionRate[Z] = dcmKpGain * ez + integralFBz;
+}
+
+// The half of the Mahony filter that runs every PID loop, the gyro and the last correction integrated into the quaternion
+static void imuIntegrateGyro(float dt, float gx, float gy, float gz)
+{
+    float recipNorm;
+    float qa, qb, qc;
+
     // Apply proportional and integral feedback
-    gx += dcmKpGain * ex + integralFBx;
-    gy += dcmKpGain * ey + integralFBy;
-    gz += dcmKpGain * ez + integralFBz;
+    gx += correctionRate[X];
+    gy += correctionRate[Y];
+    gz += correctionRate[Z];
 
     // Integrate rate of change of quaternion
     gx *= (0.5f * dt);
@@ -335,17 +360,7 @@ static void imuMahonyAHRSupdate(float dt, float gx, float gy, float gz,
 
     // Pre-compute rotation matrix from quaternion
     imuComputeRotationMatrix();
-}
-
-STATIC_UNIT_TESTED void imuUpdateEulerAngles(void)
-{
-    /* Compute pitch/roll angles */
-    attitude.values.roll = lrintf(atan2f(rMat[2][1], rMat[2][2]) * (1800.0f / M_PIf));
-    attitude.values.pitch = lrintf(((0.5f * M_PIf) - acosf(-rMat[2][0])) * (1800.0f / M_PIf));
-    attitude.values.yaw = lrintf((-atan2f(rMat[1][0], rMat[0][0]) * (1800.0f / M_PIf) + magneticDeclination));
-
-    if (attitude.values.yaw < 0)
-        attitude.values.yaw += 3600;
+    attitudeIsStale = true;
 
     /* Update small angle state */
     if (rMat[2][2] > smallAngleCosZ) {
@@ -355,6 +370,26 @@ STATIC_UNIT_TESTED void imuUpdateEulerAngles(void)
     }
 }
 
+/*
+ * Brings attitude up to date with the rotation matrix. The loop only integrates the quaternion, the angles are worked
+ * out here once something wants to read them, and at most once per update of the matrix.
+ */
+void imuUpdateEulerAngles(void)
+{
+    if (!attitudeIsStale) {
+        return;
+    }
+    attitudeIsStale = false;
+
+    /* Compute pitch/roll angles */
+    attitude.values.roll = lrintf(atan2_approx(rMat[2][1], rMat[2][2]) * (1800.0f / M_PIf));
+    attitude.values.pitch = lrintf(((0.5f * M_PIf) - acos_approx(-rMat[2][0])) * (1800.0f / M_PIf));
+    attitude.values.yaw = lrintf((-atan2_approx(rMat[1][0], rMat[0][0]) * (1800.0f / M_PIf) + magneticDeclination));
+
+    if (attitude.values.yaw < 0)
+        attitude.values.yaw += 3600;
+}
+
 static bool imuIsAccelerometerHealthy(void)
 {
     int32_t axis;
@@ -376,29 +411,13 @@ static bool isMagnetometerHealthy(void)
     return (magADC[X] != 0) && (magADC[Y] != 0) && (magADC[Z] != 0);
 }
 
-static void imuCalculateEstimatedAttitude(void)
+static void imuCalculateCorrection(uint32_t deltaT)
 {
-    static filterStatePt1_t accLPFState[3];
-    static uint32_t previousIMUUpdateTime;
     float rawYawError = 0;
-    int32_t axis;
     bool useAcc = false;
     bool useMag = false;
     bool useYaw = false;
 
-    uint32_t currentTime = micros();
-    uint32_t deltaT = currentTime - previousIMUUpdateTime;
-    previousIMUUpdateTime = currentTime;
-
-    // Smooth and use only valid accelerometer readings
-    for (axis = 0; axis < 3; axis++) {
-        if (imuRuntimeConfig->acc_cut_hz > 0) {
-            accSmooth[axis] = filterApplyPt1(accADC[axis], &accLPFState[axis], imuRuntimeConfig->acc_cut_hz, deltaT * 1e-6f);
-        } else {
-            accSmooth[axis] = accADC[axis];
-        }
-    }
-
     if (imuIsAccelerometerHealthy()) {
         useAcc = true;
     }
@@ -409,22 +428,97 @@ static void imuCalculateEstimatedAttitude(void)
 #if defined(GPS)
     else if (STATE(FIXED_WING) && sensors(SENSOR_GPS) && STATE(GPS_FIX) && GPS_numSat >= 5 && GPS_speed >= 300) {
         // In case of a fixed-wing aircraft we can use GPS course over ground to correct heading
+        imuUpdateEulerAngles();
         rawYawError = DECIDEGREES_TO_RADIANS(attitude.values.yaw - GPS_ground_course);
         useYaw = true;
     }
 #endif
 
-    imuMahonyAHRSupdate(deltaT * 1e-6f,
-                        gyroADC[X] * gyroScale, gyroADC[Y] * gyroScale, gyroADC[Z] * gyroScale,
-                        useAcc, accSmooth[X], accSmooth[Y], accSmooth[Z],
-                        useMag, magADC[X], magADC[Y], magADC[Z],
-                        useYaw, rawYawError);
+    imuMahonyAHRSCorrection(deltaT * 1e-6f,
+                            gyroADC[X] * gyroScale, gyroADC[Y] * gyroScale, gyroADC[Z] * gyroScale,
+                            useAcc, accSmooth[X], accSmooth[Y], accSmooth[Z],
+                            useMag, magADC[X], magADC[Y], magADC[Z],
+                            useYaw, rawYawError);
+}
+
+static void imuCalculateEstimatedAttitude(void)
+{
+    static uint32_t previousIMUUpdateTime;
+
+    uint32_t currentTime = micros();
+    uint32_t deltaT = currentTime - previousIMUUpdateTime;
+    previousIMUUpdateTime = currentTime;
+
+    imuIntegrateGyro(deltaT * 1e-6f, gyroADC[X] * gyroScale, gyroADC[Y] * gyroScale, gyroADC[Z] * gyroScale);
+}
 
-    imuUpdateEulerAngles();
+// Smooths a new acc sample and adds it, rotated into the earth frame, to accSum. deltaT is the time since the last one.
+static void imuFuseAccelerometer(uint32_t deltaT)
+{
+    static filterStatePt1_t accLPFState[3];
+    int32_t axis;
+
+    for (axis = 0; axis < 3; axis++) {
+        if (imuRuntimeConfig->acc_cut_hz > 0) {
+            accSmooth[axis] = filterApplyPt1(accADC[axis], &accLPFState[axis], imuRuntimeConfig->acc_cut_hz, deltaT * 1e-6f);
+        } else {
+            accSmooth[axis] = accADC[axis];
+        }
+    }
 
     imuCalculateAcceleration(deltaT); // rotate acc vector into earth frame
 }
 
+bool imuHasNewSamples(void)
+{
+    if (!isAccelUpdatedAtLeastOnce) {
+        return false;
+    }
+    return accSampleTime != fusedAccSampleTime || (sensors(SENSOR_MAG) && magSampleTime != fusedMagSampleTime);
+}
+
+/*
+ * Fuses the acc and mag samples read since the last call into the attitude, TASK_ATTITUDE runs it once one of them
+ * has a new sample. The time steps are those between the samples as they were read, so the filter, the integral
+ * feedback and accSum are not thrown by how late the task gets to run, and a sample is only fused once.
+ */
+void imuUpdateAttitudeCorrection(void)
+{
+    static bool accSampleFused = false;
+    static uint32_t correctedAt;
+    int32_t axis;
+
+    if (!imuHasNewSamples()) {
+        return;
+    }
+
+    // The first sample has no interval to go with it, it is only where the filter starts from
+    if (!accSampleFused) {
+        for (axis = 0; axis < 3; axis++) {
+            accSmooth[axis] = accADC[axis];
+        }
+        fusedAccSampleTime = accSampleTime;
+        fusedMagSampleTime = magSampleTime;
+        correctedAt = accSampleTime;
+        accSampleFused = true;
+        return;
+    }
+
+    if (accSampleTime != fusedAccSampleTime) {
+        imuFuseAccelerometer(accSampleTime - fusedAccSampleTime);
+        fusedAccSampleTime = accSampleTime;
+    }
+    fusedMagSampleTime = magSampleTime;
+
+    // The correction holds until the next sample, the integral feedback accumulates over the time since the last
+    uint32_t sampleTime = accSampleTime;
+    if (sensors(SENSOR_MAG) && cmp32(magSampleTime, sampleTime) > 0) {
+        sampleTime = magSampleTime;
+    }
+    imuCalculateCorrection(sampleTime - correctedAt);
+    correctedAt = sampleTime;
+}
+
 void imuUpdateAccelerometer(rollAndPitchTrims_t *accelerometerTrims)
 {
     if (sensors(SENSOR_ACC)) {
@@ -435,10 +529,14 @@ void imuUpdateAccelerometer(rollAndPitchTrims_t *accelerometerTrims)
 
 void imuUpdateGyroAndAttitude(void)
 {
+    LOOP_STAGE_BEGIN(LOOP_STAGE_GYRO);
     gyroUpdate();
+    LOOP_STAGE_END(LOOP_STAGE_GYRO);
 
     if (sensors(SENSOR_ACC) && isAccelUpdatedAtLeastOnce) {
+        LOOP_STAGE_BEGIN(LOOP_STAGE_ATTITUDE);
         imuCalculateEstimatedAttitude();
+        LOOP_STAGE_END(LOOP_STAGE_ATTITUDE);
     } else {
         accADC[X] = 0;
         accADC[Y] = 0;
@@ -461,7 +559,7 @@ int16_t calculateThrottleAngleCorrection(uint8_t throttle_correction_value)
     if (rMat[2][2] <= 0.015f) {
         return 0;
     }
-    int angle = lrintf(acosf(rMat[2][2]) * throttleAngleScale);
+    int angle = lrintf(acos_approx(rMat[2][2]) * throttleAngleScale);
     if (angle > 900)
         angle = 900;
     return lrintf(throttle_correction_value * sin_approx(angle / (900.0f * M_PIf / 2.0f)));
@@ -81,6 +81,9 @@ void imuConfigure(
 void calculateEstimatedAltitude(uint32_t currentTime);
 void imuUpdateAccelerometer(rollAndPitchTrims_t *accelerometerTrims);
 void imuUpdateGyroAndAttitude(void);
+bool imuHasNewSamples(void);
+void imuUpdateAttitudeCorrection(void);
+void imuUpdateEulerAngles(void);
 float calculateThrottleAngleScale(uint16_t throttle_correction_angle);
 int16_t calculateThrottleAngleCorrection(uint8_t throttle_correction_value);
 float calculateAccZLowPassFilterRCTimeConstant(float accz_lpf_cutoff);
@@ -95,7 +95,7 @@ typedef struct airplaneConfig_s {
 #ifdef USE_SERVOS
 
 // These must be consecutive, see 'reversedSources'
-enum {
+typedef enum {
     INPUT_STABILIZED_ROLL = 0,
     INPUT_STABILIZED_PITCH,
     INPUT_STABILIZED_YAW,
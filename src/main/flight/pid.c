@@ -102,7 +102,7 @@ static filterStatePt1_t yawPTermState;
 static void pidLuxFloat(pidProfile_t *pidProfile, controlRateConfig_t *controlRateConfig,
         uint16_t max_angle_inclination, rollAndPitchTrims_t *angleTrim, rxConfig_t *rxConfig)
 {
-    float RateError, errorAngle, AngleRate, gyroRate;
+    float RateError, errorAngle, AngleRate, AngleRateDerivative, gyroRate;
     float ITerm,PTerm,DTerm;
     int32_t stickPosAil, stickPosEle, mostDeflectedPos;
     static float lastError[3];
@@ -134,14 +134,20 @@ static void pidLuxFloat(pidProfile_t *pidProfile, controlRateConfig_t *controlRa
         }
     }
 
+    if (FLIGHT_MODE(ANGLE_MODE) || FLIGHT_MODE(HORIZON_MODE)) {
+        imuUpdateEulerAngles();
+    }
+
     // ----------PID controller----------
     for (axis = 0; axis < 3; axis++) {
         // -----Get the desired angle rate depending on flight mode
         uint8_t rate = controlRateConfig->rates[axis];
+        AngleRateDerivative = 0;    // of the part of AngleRate the sticks set, per second
 
         if (axis == FD_YAW) {
             // YAW is always gyro-controlled (MAG correction is applied to rcCommand) 100dps to 1100dps max yaw rate
             AngleRate = (float)((rate + 10) * rcCommand[YAW]) / 50.0f;
+            AngleRateDerivative = (rate + 10) * rcCommandDerivative[YAW] / 50.0f;
          } else {
             // calculate error and limit the angle to the max inclination
 #ifdef GPS
@@ -158,6 +164,7 @@ static void pidLuxFloat(pidProfile_t *pidProfile, controlRateConfig_t *controlRa
             } else {
                 //control is GYRO based (ACRO and HORIZON - direct sticks control is applied to rate PID
                 AngleRate = (float)((rate + 20) * rcCommand[axis]) / 50.0f; // 200dps to 1200dps max roll/pitch rate
+                AngleRateDerivative = (rate + 20) * rcCommandDerivative[axis] / 50.0f;
                 if (FLIGHT_MODE(HORIZON_MODE)) {
                     // mix up angle error to desired AngleRate to add a little auto-level feel
                     AngleRate += errorAngle * pidProfile->H_level * horizonLevelStrength;
@@ -298,6 +305,11 @@ static void pidLuxFloat(pidProfile_t *pidProfile, controlRateConfig_t *controlRa
             deltaSum = filterApplyPt1(delta, &DTermState[axis], pidProfile->dterm_cut_hz, dT);
         }
 
+        // Feed forward of the sticks, the setpoint in the error above only moves when a frame comes in
+        if (pidProfile->setpoint_ff) {
+            deltaSum += AngleRateDerivative * pidProfile->setpoint_ff / 100.0f;
+        }
+
         DTerm = constrainf(deltaSum * (pidProfile->D_f[axis]/4) * PIDweight[axis] / 100, -300.0f, 300.0f);
 
         // -----calculate total PID output
@@ -330,6 +342,7 @@ static void pidRewrite(pidProfile_t *pidProfile, controlRateConfig_t *controlRat
     static int32_t lastError[3] = { 0, 0, 0 };
     static int32_t previousErrorGyroI[3] = { 0, 0, 0 };
     int32_t AngleRateTmp, RateError;
+    float AngleRateDerivative;
 
     int8_t horizonLevelStrength = 100;
     int32_t stickPosAil, stickPosEle, mostDeflectedPos;
@@ -355,13 +368,19 @@ static void pidRewrite(pidProfile_t *pidProfile, controlRateConfig_t *controlRat
        	horizonLevelStrength = constrain((10 * (horizonLevelStrength - 100) * (10 * pidProfile->D8[PIDLEVEL] / 80) / 100) + 100, 0, 100);
     }
 
+    if (FLIGHT_MODE(ANGLE_MODE) || FLIGHT_MODE(HORIZON_MODE)) {
+        imuUpdateEulerAngles();
+    }
+
     // ----------PID controller----------
     for (axis = 0; axis < 3; axis++) {
         uint8_t rate = controlRateConfig->rates[axis];
+        AngleRateDerivative = 0;    // of the part of AngleRateTmp the sticks set, per second
 
         // -----Get the desired angle rate depending on flight mode
         if (axis == FD_YAW) { // YAW is always gyro-controlled (MAG correction is applied to rcCommand)
             AngleRateTmp = (((int32_t)(rate + 27) * rcCommand[YAW]) >> 5);
+            AngleRateDerivative = (rate + 27) * rcCommandDerivative[YAW] / 32.0f;
         } else {
             // calculate error and limit the angle to max configured inclination
 #ifdef GPS
@@ -374,6 +393,7 @@ static void pidRewrite(pidProfile_t *pidProfile, controlRateConfig_t *controlRat
 
             if (!FLIGHT_MODE(ANGLE_MODE)) { //control is GYRO based (ACRO and HORIZON - direct sticks control is applied to rate PID
                 AngleRateTmp = ((int32_t)(rate + 27) * rcCommand[axis]) >> 4;
+                AngleRateDerivative = (rate + 27) * rcCommandDerivative[axis] / 16.0f;
                 if (FLIGHT_MODE(HORIZON_MODE)) {
                     // mix up angle error to desired AngleRateTmp to add a little auto-level feel. horizonLevelStrength is scaled to the stick input
                 	AngleRateTmp += (errorAngle * pidProfile->I8[PIDLEVEL] * horizonLevelStrength / 100) >> 4;
@@ -438,6 +458,11 @@ static void pidRewrite(pidProfile_t *pidProfile, controlRateConfig_t *controlRat
             deltaSum = quickMedianFilter7(deltaOld[axis]);
         }
 
+        // Feed forward of the sticks, deltaSum is the change of the error over 16384us
+        if (pidProfile->setpoint_ff) {
+            deltaSum += lrintf(AngleRateDerivative * 0.016384f * pidProfile->setpoint_ff / 100);
+        }
+
         DTerm = (deltaSum * pidProfile->D8[axis] * PIDweight[axis] / 100) >> 8;
 
         // -----calculate total PID output
@@ -56,11 +56,20 @@ typedef struct pidProfile_s {
     float A_level;
     float H_level;
     uint8_t H_sensitivity;
+    uint8_t setpoint_ff;                    // % of the D gain the derivative of the smoothed stick rate is fed forward with, 0 disables it
 
     uint16_t yaw_p_limit;                   // set P term limit (fixed value was 300)
     uint8_t dterm_cut_hz;                   // (default 17Hz, Range 1-50Hz) Used for PT1 element in PID1, PID2 and PID5
     uint8_t yaw_pterm_cut_hz;               // Used for filering Pterm noise on noisy frames
-    uint8_t gyro_soft_lpf;                  // Gyro FIR filter
+    uint16_t gyro_lpf_hz;                   // Cutoff of the gyro biquad lowpass, 0 disables it
+    uint16_t gyro_notch_hz;                 // Center of the gyro notch, 0 disables it
+    uint16_t gyro_notch_cutoff_hz;          // Lower -3dB edge of the gyro notch
+    uint8_t  gyro_fir_level;                // 9 tap gyro FIR in front of the biquads, 1 to 3 picks the coefficients, 0 disables it
+#ifdef GYRO_DYNAMIC_NOTCH
+    uint16_t gyro_dyn_notch_min_hz;         // Lowest frequency the dynamic gyro notch follows noise to, 0 disables it
+    uint16_t gyro_dyn_notch_max_hz;         // Highest frequency the dynamic gyro notch follows noise to
+    uint8_t  gyro_dyn_notch_q;              // Q of the dynamic gyro notch, in tenths
+#endif
 
 #ifdef GTUNE
     uint8_t  gtune_lolimP[3];               // [0..200] Lower limit of P during G tune
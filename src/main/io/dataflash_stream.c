@@ -0,0 +1,278 @@
+/*
+ * This file is part of Cleanflight.
+ *
+ * Cleanflight is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cleanflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cleanflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "common/maths.h"
+
+#include "io/flashfs.h"
+#include "io/dataflash_stream.h"
+
+#define DATAFLASH_STREAM_CRC_POLY 0x1021
+
+// Entries in the table of where each hash of three bytes was last seen, positions plus one so that 0 is empty
+#define DATAFLASH_STREAM_LZ_HASH_BITS 8
+#define DATAFLASH_STREAM_LZ_HASH_SIZE (1 << DATAFLASH_STREAM_LZ_HASH_BITS)
+
+static dataflashStreamConfig_t stream;
+static uint16_t nextSequence;
+static uint16_t ackedSequence;     // first chunk the host has not acknowledged
+static uint32_t ackedAddress;      // and where it starts
+
+#ifdef DATAFLASH_STREAM_COMPRESSION
+static uint8_t chunkBuffer[DATAFLASH_STREAM_MAX_CHUNK_SIZE];
+static uint16_t hashTable[DATAFLASH_STREAM_LZ_HASH_SIZE];
+#endif
+
+// CRC-16-CCITT, start with 0xFFFF
+uint16_t dataflashStreamCrc16(uint16_t crc, const uint8_t *data, int length)
+{
+    while (length-- > 0) {
+        crc ^= (uint16_t)*data++ << 8;
+
+        for (int i = 0; i < 8; i++) {
+            if (crc & 0x8000) {
+                crc = (crc << 1) ^ DATAFLASH_STREAM_CRC_POLY;
+            } else {
+                crc <<= 1;
+            }
+        }
+    }
+
+    return crc;
+}
+
+#ifdef DATAFLASH_STREAM_COMPRESSION
+static uint32_t dataflashStreamHash(const uint8_t *data)
+{
+    uint32_t bytes = ((uint32_t)data[0] << 16) | ((uint32_t)data[1] << 8) | data[2];
+
+    return (bytes * 2654435761u) >> (32 - DATAFLASH_STREAM_LZ_HASH_BITS);
+}
+
+static int dataflashStreamWriteLiterals(const uint8_t *literals, int count, uint8_t *output, int outputSize)
+{
+    int written = 0;
+
+    while (count > 0) {
+        int run = MIN(count, DATAFLASH_STREAM_LZ_MAX_LITERALS);
+
+        if (written + 1 + run > outputSize) {
+            return -1;
+        }
+        output[written++] = run - 1;
+        memcpy(output + written, literals, run);
+        written += run;
+        literals += run;
+        count -= run;
+    }
+
+    return written;
+}
+
+/*
+ * A byte oriented LZ77 that is cheap enough to run as the chunks go out. The output is a series of tokens:
+ *
+ * 0x00 - 0x7F: token + 1 literal bytes follow
+ * 0x80 - 0xFF: copy (token & 0x7F) + 3 bytes from the u16 distance back in the output that follows, which may be less
+ *              than the length so that a run of one byte is a literal and a match at distance 1
+ *
+ * The matches are found greedily through a small hash table of the last place each three bytes were seen. Returns the
+ * length of the output, or -1 if it would not fit in outputSize bytes.
+ */
+int dataflashStreamCompress(const uint8_t *input, int length, uint8_t *output, int outputSize)
+{
+    int position = 0;
+    int literalStart = 0;
+    int written = 0;
+
+    memset(hashTable, 0, sizeof(hashTable));
+
+    while (position + DATAFLASH_STREAM_LZ_MIN_MATCH <= length) {
+        uint32_t hash = dataflashStreamHash(input + position);
+        int candidate = hashTable[hash] - 1;
+        int matchLength = 0;
+
+        hashTable[hash] = position + 1;
+
+        if (candidate >= 0 && memcmp(input + candidate, input + position, DATAFLASH_STREAM_LZ_MIN_MATCH) == 0) {
+            int maxLength = MIN(length - position, DATAFLASH_STREAM_LZ_MAX_MATCH);
+
+            matchLength = DATAFLASH_STREAM_LZ_MIN_MATCH;
+            while (matchLength < maxLength && input[candidate + matchLength] == input[position + matchLength]) {
+                matchLength++;
+            }
+        }
+
+        if (matchLength == 0) {
+            position++;
+            continue;
+        }
+
+        int literalsWritten = dataflashStreamWriteLiterals(input + literalStart, position - literalStart, output + written, outputSize - written);
+        int distance = position - candidate;
+
+        if (literalsWritten < 0 || written + literalsWritten + 3 > outputSize) {
+            return -1;
+        }
+        written += literalsWritten;
+        output[written++] = 0x80 | (matchLength - DATAFLASH_STREAM_LZ_MIN_MATCH);
+        output[written++] = distance & 0xFF;
+        output[written++] = distance >> 8;
+
+        position += matchLength;
+        literalStart = position;
+    }
+
+    int literalsWritten = dataflashStreamWriteLiterals(input + literalStart, length - literalStart, output + written, outputSize - written);
+
+    return literalsWritten < 0 ? -1 : written + literalsWritten;
+}
+#endif
+
+/*
+ * Starts sending the given range of the volume, or stops when its length is 0. The config is updated to what will
+ * actually be sent, the range cut at the end of the volume and the chunk size and window brought within the limits.
+ * A chunk part way out on the serial port when the stream restarts is not affected, the host can tell it from the new
+ * ones by the address.
+ */
+void dataflashStreamStart(dataflashStreamConfig_t *config)
+{
+    uint32_t volumeSize = flashfsGetSize();
+
+    if (config->address >= volumeSize) {
+        config->length = 0;
+    } else if (config->length > volumeSize - config->address) {
+        config->length = volumeSize - config->address;
+    }
+    if (config->chunkSize == 0 || config->chunkSize > DATAFLASH_STREAM_MAX_CHUNK_SIZE) {
+        config->chunkSize = DATAFLASH_STREAM_MAX_CHUNK_SIZE;
+    }
+    config->window = constrain(config->window, 1, DATAFLASH_STREAM_MAX_WINDOW);
+#ifdef DATAFLASH_STREAM_COMPRESSION
+    config->flags &= DATAFLASH_STREAM_FLAG_COMPRESS;
+#else
+    config->flags = 0;
+#endif
+
+    stream = *config;
+    nextSequence = 0;
+    ackedSequence = 0;
+    ackedAddress = config->address;
+}
+
+void dataflashStreamStop(void)
+{
+    stream.length = 0;
+    nextSequence = ackedSequence;
+}
+
+// Until the host has acknowledged the last chunk, which it might yet ask for again
+bool dataflashStreamIsActive(void)
+{
+    return stream.length > 0 || nextSequence != ackedSequence;
+}
+
+/*
+ * The host has every chunk before the given sequence number. Acknowledgements of chunks that were never sent are
+ * ignored. One that repeats the last while chunks are outstanding means the next chunk was lost or failed its CRC, so
+ * the stream goes back and sends everything from there again.
+ */
+void dataflashStreamAck(uint16_t sequence)
+{
+    uint16_t acked = sequence - ackedSequence;
+
+    if (acked > (uint16_t)(nextSequence - ackedSequence)) {
+        return;
+    }
+
+    if (acked > 0) {
+        // Only the last chunk of the stream is short, and nothing has been sent after it
+        ackedAddress = MIN(ackedAddress + (uint32_t)acked * stream.chunkSize, stream.address);
+        ackedSequence = sequence;
+    } else if (nextSequence != ackedSequence) {
+        stream.length += stream.address - ackedAddress;
+        stream.address = ackedAddress;
+        nextSequence = ackedSequence;
+    }
+}
+
+/*
+ * Writes the next chunk into payload, which has room for DATAFLASH_STREAM_MAX_PAYLOAD_SIZE bytes, and returns its
+ * length. Returns 0 when the stream is over or the window is full.
+ */
+int dataflashStreamNextChunk(uint8_t *payload)
+{
+    uint8_t *data = payload + DATAFLASH_STREAM_CHUNK_HEADER_SIZE;
+    uint8_t encoding = DATAFLASH_STREAM_ENCODING_RAW;
+    int encodedLength;
+    int bytesRead;
+    uint16_t crc;
+
+    if (stream.length == 0 || (uint16_t)(nextSequence - ackedSequence) >= stream.window) {
+        return 0;
+    }
+
+#ifdef DATAFLASH_STREAM_COMPRESSION
+    if (stream.flags & DATAFLASH_STREAM_FLAG_COMPRESS) {
+        bytesRead = flashfsReadAbs(stream.address, chunkBuffer, MIN(stream.chunkSize, stream.length));
+        if (bytesRead <= 0) {
+            stream.length = 0;
+            return 0;
+        }
+
+        // Compressed chunks that are no smaller go raw
+        encodedLength = dataflashStreamCompress(chunkBuffer, bytesRead, data, bytesRead - 1);
+        if (encodedLength < 0) {
+            memcpy(data, chunkBuffer, bytesRead);
+            encodedLength = bytesRead;
+        } else {
+            encoding = DATAFLASH_STREAM_ENCODING_LZ;
+        }
+        crc = dataflashStreamCrc16(0xFFFF, chunkBuffer, bytesRead);
+    } else
+#endif
+    {
+        bytesRead = flashfsReadAbs(stream.address, data, MIN(stream.chunkSize, stream.length));
+        if (bytesRead <= 0) {
+            stream.length = 0;
+            return 0;
+        }
+        encodedLength = bytesRead;
+        crc = dataflashStreamCrc16(0xFFFF, data, bytesRead);
+    }
+
+    payload[0] = nextSequence & 0xFF;
+    payload[1] = nextSequence >> 8;
+    payload[2] = stream.address & 0xFF;
+    payload[3] = (stream.address >> 8) & 0xFF;
+    payload[4] = (stream.address >> 16) & 0xFF;
+    payload[5] = stream.address >> 24;
+    payload[6] = bytesRead & 0xFF;
+    payload[7] = bytesRead >> 8;
+    payload[8] = encoding;
+    payload[9] = crc & 0xFF;
+    payload[10] = crc >> 8;
+
+    nextSequence++;
+    stream.address += bytesRead;
+    stream.length -= bytesRead;
+
+    return DATAFLASH_STREAM_CHUNK_HEADER_SIZE + encodedLength;
+}
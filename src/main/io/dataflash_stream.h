@@ -0,0 +1,71 @@
+/*
+ * This file is part of Cleanflight.
+ *
+ * Cleanflight is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cleanflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cleanflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+/*
+ * Streaming download of the dataflash. A range of the volume goes out in numbered chunks, each with the CRC of its
+ * contents and optionally compressed, and up to a window of them can be sent before the host acknowledges any. The
+ * framing and the serial port are the business of serial_msp.c.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// F1 boards have the RAM for neither a large chunk nor the compressor's buffers, they send smaller chunks raw
+#ifdef STM32F10X
+#define DATAFLASH_STREAM_MAX_CHUNK_SIZE 256
+#else
+#define DATAFLASH_STREAM_MAX_CHUNK_SIZE 1024
+#define DATAFLASH_STREAM_COMPRESSION
+#endif
+#define DATAFLASH_STREAM_MAX_WINDOW 8
+
+// u16 sequence, u32 address, u16 length of the data once decoded, u8 encoding, u16 CRC of the decoded data
+#define DATAFLASH_STREAM_CHUNK_HEADER_SIZE 11
+#define DATAFLASH_STREAM_MAX_PAYLOAD_SIZE (DATAFLASH_STREAM_CHUNK_HEADER_SIZE + DATAFLASH_STREAM_MAX_CHUNK_SIZE)
+
+#define DATAFLASH_STREAM_FLAG_COMPRESS (1 << 0)
+
+typedef enum {
+    DATAFLASH_STREAM_ENCODING_RAW = 0,
+    DATAFLASH_STREAM_ENCODING_LZ        // see dataflashStreamCompress()
+} dataflashStreamEncoding_e;
+
+// Matches are 3 to 130 bytes long and start up to a chunk back, within the chunk
+#define DATAFLASH_STREAM_LZ_MIN_MATCH 3
+#define DATAFLASH_STREAM_LZ_MAX_MATCH (0x7F + DATAFLASH_STREAM_LZ_MIN_MATCH)
+#define DATAFLASH_STREAM_LZ_MAX_LITERALS 0x80
+
+typedef struct dataflashStreamConfig_s {
+    uint32_t address;
+    uint32_t length;            // 0 stops the stream
+    uint16_t chunkSize;
+    uint8_t window;             // chunks that may be sent before the host acknowledges the first of them
+    uint8_t flags;              // DATAFLASH_STREAM_FLAG_COMPRESS is dropped on builds without the compressor
+} dataflashStreamConfig_t;
+
+void dataflashStreamStart(dataflashStreamConfig_t *config);
+void dataflashStreamStop(void);
+bool dataflashStreamIsActive(void);
+void dataflashStreamAck(uint16_t sequence);
+int dataflashStreamNextChunk(uint8_t *payload);
+
+uint16_t dataflashStreamCrc16(uint16_t crc, const uint8_t *data, int length);
+#ifdef DATAFLASH_STREAM_COMPRESSION
+int dataflashStreamCompress(const uint8_t *input, int length, uint8_t *output, int outputSize);
+#endif
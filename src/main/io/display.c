@@ -481,6 +481,7 @@ void showSensorsPage(void)
     }
 #endif
 
+    imuUpdateEulerAngles();
     tfp_sprintf(lineBuffer, format, "I&H", attitude.values.roll, attitude.values.pitch, DECIDEGREES_TO_DEGREES(attitude.values.yaw));
     padLineBuffer();
     i2c_OLED_set_line(rowIndex++);
@@ -27,15 +27,79 @@
  *
  * In future, we can add support for multiple different flash chips by adding a flash device driver vtable
  * and make calls through that, at the moment flashfs just calls m25p16_* routines explicitly.
+ *
+ * One of the first two sectors of the volume holds a directory of the logs written to it, a header followed by one
+ * record per log in the order they were started. A record gets the start address of its log when the log starts, the
+ * end address when it finishes and is marked deleted when the log is erased. Each of those only programs a field that
+ * was still erased, so the directory sector is never erased while logging. Logs are deleted oldest first, so the live
+ * records are the ones between the first that isn't deleted and the first that was never written, which two binary
+ * searches find at startup, and the end of the newest log is where writing carries on.
+ *
+ * Once the records run low the live ones are copied to the start of the other directory sector, which is erased ahead
+ * of time, and the old copy is erased after the new one's header is in. The header with the higher generation wins,
+ * so a power cut part way leaves one whole copy or the other. That happens when a log finishes or at startup, never
+ * when one starts.
+ *
+ * The sectors after the directory are used as a ring. The free space runs from the tail to the first sector of the
+ * oldest log. Once it runs out the volume is full, unless ring mode is on, in which case the sector after the free
+ * space is erased and the logs that had data in it are deleted.
+ *
+ * Volumes written before the directory existed carry on without one, as one stream from address 0, until they are
+ * erased completely.
+ *
+ * Writes go into a buffer of several pages and reach the flash one page program at a time, each ending on a page
+ * boundary. While logging, flashfsFlushPagesAsync() only programs whole pages, the partial page at the end waits for the
+ * writes that fill it. None of the asynchronous calls wait for the flash, they come back later if it is busy. In ring
+ * mode the next sector is erased before the free space runs out, when the buffer has just been emptied, so that the
+ * buffer has as much room as it can for what is logged during the erase.
  */
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <string.h>
 
+#include "platform.h"
+
 #include "drivers/flash_m25p16.h"
 #include "flashfs.h"
 
+#define FLASHFS_DIRECTORY_MAGIC 0x32534646 // "FFS2"
+#define FLASHFS_ERASED_WORD 0xFFFFFFFF
+
+// What the header of the directory in use knows of the other directory sector. Each state only clears bits of the last
+#define FLASHFS_SPARE_UNKNOWN FLASHFS_ERASED_WORD  // the copy it replaced may not have been erased yet
+#define FLASHFS_SPARE_ERASED 0x0000FFFF
+#define FLASHFS_SPARE_IN_USE 0x00000000             // a new copy is being written to it
+
+// The longest we wait for a sector erase we started ourselves
+#define FLASHFS_SECTOR_ERASE_TIMEOUT_MILLIS 5000
+
+enum {
+    /* We can choose whatever power of 2 size we like, which determines how much wastage of free space we'll have
+     * at the end of the last written data. But smaller blocksizes will require more searching.
+     */
+    FREE_BLOCK_SIZE = 2048,
+
+    /* We don't expect valid data to ever contain this many consecutive uint32_t's of all 1 bits: */
+    FREE_BLOCK_TEST_SIZE_INTS = 4, // i.e. 16 bytes
+    FREE_BLOCK_TEST_SIZE_BYTES = FREE_BLOCK_TEST_SIZE_INTS * sizeof(uint32_t),
+};
+
+typedef struct flashfsDirectoryHeader_s {
+    uint32_t magic;
+    uint32_t generation;    // one more than the copy it replaced
+    uint32_t check;         // ~generation, which a header part way through being erased doesn't have
+    uint32_t spareState;    // FLASHFS_SPARE_*
+} flashfsDirectoryHeader_t;
+
+typedef struct flashfsDirectoryRecord_s {
+    uint32_t start;
+    uint32_t end;       // FLASHFS_ERASED_WORD until the log finishes
+    uint32_t deleted;   // FLASHFS_ERASED_WORD while the log is live
+    uint32_t reserved;
+} flashfsDirectoryRecord_t;
+
 static uint8_t flashWriteBuffer[FLASHFS_WRITE_BUFFER_SIZE];
 
 /* The position of our head and tail in the circular flash write buffer.
@@ -43,16 +107,36 @@ static uint8_t flashWriteBuffer[FLASHFS_WRITE_BUFFER_SIZE];
  * The head is the index that a byte would be inserted into on writing, while the tail is the index of the
  * oldest byte that has yet to be written to flash.
  *
- * When the circular buffer is empty, head == tail
+ * When the circular buffer is empty, head == tail. The tail is at the same offset in a page as the tail address, so
+ * that the data for a page program never wraps around the end of the buffer.
  */
-static uint8_t bufferHead = 0, bufferTail = 0;
+static uint32_t bufferHead = 0, bufferTail = 0;
 
 // The position of the buffer's tail in the overall flash address space:
 static uint32_t tailAddress = 0;
 
+// How many bytes from the tail onward, around the end of the volume if need be, are known to be erased
+static uint32_t freeSpace = 0;
+
+static bool hasDirectory = false;
+static bool directoryHeaderPending = false; // the volume was erased and the chip may still be busy with it
+static bool ringMode = false;
+static uint32_t dataStart = 0;              // the first address after the directory
+static uint32_t directoryAddress = 0;       // of the sector with the copy of the directory in use
+static uint32_t directoryGeneration = 0;
+static uint32_t spareDirectoryState = FLASHFS_SPARE_ERASED;
+static bool spareDirectoryErasing = false;  // we started erasing the other directory sector
+
+// The live logs, oldest first. The end of an open log is FLASHFS_ERASED_WORD
+static flashfsLog_t logs[FLASHFS_MAX_LOGS];
+static int logCount = 0;
+static int firstLogRecord = 0;              // the directory record of logs[0]
+static bool logOpen = false;                // the newest log hasn't finished
+static uint32_t openLogLength = 0;          // bytes of it written to the flash
+
 static void flashfsClearBuffer()
 {
-    bufferTail = bufferHead = 0;
+    bufferTail = bufferHead = tailAddress % M25P16_PAGESIZE;
 }
 
 static bool flashfsBufferIsEmpty()
@@ -63,6 +147,193 @@ static bool flashfsBufferIsEmpty()
 static void flashfsSetTailAddress(uint32_t address)
 {
     tailAddress = address;
+
+    if (flashfsBufferIsEmpty()) {
+        flashfsClearBuffer();
+    }
+}
+
+static uint32_t flashfsGetDataSize()
+{
+    return flashfsGetSize() - dataStart;
+}
+
+// Brings an address that went past the end of the volume back around to the start of the data area
+static uint32_t flashfsWrapAddress(uint32_t address)
+{
+    return address >= flashfsGetSize() ? address - flashfsGetDataSize() : address;
+}
+
+// The number of bytes from one address forward to another, around the end of the volume if need be
+static uint32_t flashfsDistance(uint32_t from, uint32_t to)
+{
+    return to >= from ? to - from : to + flashfsGetDataSize() - from;
+}
+
+static uint32_t flashfsSectorStart(uint32_t address)
+{
+    return address - address % flashfsGetGeometry()->sectorSize;
+}
+
+static bool flashfsBlockIsErased(uint32_t address)
+{
+    union {
+        uint8_t bytes[FREE_BLOCK_TEST_SIZE_BYTES];
+        uint32_t ints[FREE_BLOCK_TEST_SIZE_INTS];
+    } testBuffer;
+
+    if (m25p16_readBytes(address, testBuffer.bytes, FREE_BLOCK_TEST_SIZE_BYTES) < FREE_BLOCK_TEST_SIZE_BYTES) {
+        // Unexpected timeout from flash, so report the block as used (the device fuller than it really is)
+        return false;
+    }
+
+    // Checking the buffer 4 bytes at a time like this is probably faster than byte-by-byte, but I didn't benchmark it :)
+    for (int i = 0; i < FREE_BLOCK_TEST_SIZE_INTS; i++) {
+        if (testBuffer.ints[i] != 0xFFFFFFFF) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static uint32_t flashfsDirectoryRecordAddress(int record)
+{
+    return directoryAddress + sizeof(flashfsDirectoryHeader_t) + record * sizeof(flashfsDirectoryRecord_t);
+}
+
+static int flashfsDirectoryRecordLimit()
+{
+    return (flashfsGetGeometry()->sectorSize - sizeof(flashfsDirectoryHeader_t)) / sizeof(flashfsDirectoryRecord_t);
+}
+
+static void flashfsProgramDirectoryWord(int record, unsigned fieldOffset, uint32_t value)
+{
+    m25p16_pageProgram(flashfsDirectoryRecordAddress(record) + fieldOffset, (const uint8_t *) &value, sizeof(value));
+}
+
+static uint32_t flashfsSpareDirectoryAddress()
+{
+    return directoryAddress == 0 ? flashfsGetGeometry()->sectorSize : 0;
+}
+
+static void flashfsWriteDirectoryHeader()
+{
+    const flashfsDirectoryHeader_t header = {
+        .magic = FLASHFS_DIRECTORY_MAGIC,
+        .generation = directoryGeneration,
+        .check = ~directoryGeneration,
+        .spareState = spareDirectoryState
+    };
+
+    m25p16_pageProgram(directoryAddress, (const uint8_t *) &header, sizeof(header));
+
+    directoryHeaderPending = false;
+}
+
+static void flashfsSetSpareDirectoryState(uint32_t state)
+{
+    spareDirectoryState = state;
+
+    m25p16_pageProgram(directoryAddress + offsetof(flashfsDirectoryHeader_t, spareState), (const uint8_t *) &state, sizeof(state));
+}
+
+/**
+ * Read the header of the directory copy in the sector at the given address, returning false if there isn't a whole one.
+ */
+static bool flashfsReadDirectoryHeader(uint32_t address, flashfsDirectoryHeader_t *header)
+{
+    return m25p16_readBytes(address, (uint8_t *) header, sizeof(*header)) == (int) sizeof(*header)
+        && header->magic == FLASHFS_DIRECTORY_MAGIC && header->check == ~header->generation;
+}
+
+/**
+ * Records are written in order and deleted oldest first, so for each field the records where it is still erased
+ * follow all the ones where it isn't. Find the first of them in [left...right).
+ */
+static int flashfsFindFirstErasedRecordField(int left, int right, unsigned fieldOffset)
+{
+    while (left < right) {
+        int mid = (left + right) / 2;
+        uint32_t value;
+
+        if (m25p16_readBytes(flashfsDirectoryRecordAddress(mid) + fieldOffset, (uint8_t *) &value, sizeof(value)) < (int) sizeof(value)
+                || value != FLASHFS_ERASED_WORD) {
+            left = mid + 1;
+        } else {
+            right = mid;
+        }
+    }
+
+    return left;
+}
+
+static void flashfsDeleteOldestLog()
+{
+    flashfsProgramDirectoryWord(firstLogRecord, offsetof(flashfsDirectoryRecord_t, deleted), 0);
+
+    firstLogRecord++;
+    logCount--;
+    memmove(&logs[0], &logs[1], logCount * sizeof(logs[0]));
+}
+
+/**
+ * Write the live records to the start of the other directory sector, which must be erased, and switch to it with its
+ * header. The erase of the old copy is started but not waited for.
+ */
+static void flashfsCompactDirectory()
+{
+    const uint32_t oldDirectoryAddress = directoryAddress;
+
+    // Until the header of the new copy is in, the old one says not to trust what is in the sector it goes to
+    flashfsSetSpareDirectoryState(FLASHFS_SPARE_IN_USE);
+
+    directoryAddress = flashfsSpareDirectoryAddress();
+
+    for (int i = 0; i < logCount; i++) {
+        const flashfsDirectoryRecord_t record = {
+            .start = logs[i].start,
+            .end = logs[i].end,
+            .deleted = FLASHFS_ERASED_WORD,
+            .reserved = FLASHFS_ERASED_WORD
+        };
+
+        m25p16_pageProgram(flashfsDirectoryRecordAddress(i), (const uint8_t *) &record, sizeof(record));
+    }
+
+    directoryGeneration++;
+    spareDirectoryState = FLASHFS_SPARE_UNKNOWN;
+    flashfsWriteDirectoryHeader();
+
+    firstLogRecord = 0;
+
+    m25p16_eraseSector(oldDirectoryAddress);
+    spareDirectoryErasing = true;
+}
+
+/**
+ * Record that the other directory sector is erased once the erase we started has finished, waiting for it if need be.
+ */
+static void flashfsFinishSpareDirectoryErase()
+{
+    if (spareDirectoryErasing && m25p16_waitForReady(FLASHFS_SECTOR_ERASE_TIMEOUT_MILLIS)) {
+        flashfsSetSpareDirectoryState(FLASHFS_SPARE_ERASED);
+        spareDirectoryErasing = false;
+    }
+}
+
+// An empty directory in the first sector of an erased volume
+static void flashfsResetDirectory()
+{
+    hasDirectory = true;
+    dataStart = 2 * flashfsGetGeometry()->sectorSize;
+    directoryAddress = 0;
+    directoryGeneration = 0;
+    spareDirectoryState = FLASHFS_SPARE_ERASED;
+    spareDirectoryErasing = false;
+    logCount = 0;
+    firstLogRecord = 0;
+    logOpen = false;
 }
 
 void flashfsEraseCompletely()
@@ -71,7 +342,12 @@ void flashfsEraseCompletely()
 
     flashfsClearBuffer();
 
-    flashfsSetTailAddress(0);
+    // The directory header can only go in once the chip has finished, see flashfsStartLog()
+    flashfsResetDirectory();
+    directoryHeaderPending = true;
+
+    flashfsSetTailAddress(dataStart);
+    freeSpace = flashfsGetDataSize();
 }
 
 /**
@@ -144,125 +420,155 @@ const flashGeometry_t* flashfsGetGeometry()
 }
 
 /**
- * Write the given buffers to flash sequentially at the current tail address, advancing the tail address after
- * each write.
- *
- * In synchronous mode, waits for the flash to become ready before writing so that every byte requested can be written.
- *
- * In asynchronous mode, if the flash is busy, then the write is aborted and the routine returns immediately.
- * In this case the returned number of bytes written will be less than the total amount requested.
- *
- * Modifies the supplied buffer pointers and sizes to reflect how many bytes remain in each of them.
- *
- * bufferCount: the number of buffers provided
- * buffers: an array of pointers to the beginning of buffers
- * bufferSizes: an array of the sizes of those buffers
- * sync: true if we should wait for the device to be idle before writes, otherwise if the device is busy the
- *       write will be aborted and this routine will return immediately.
- *
- * Returns the number of bytes written
+ * In ring mode, whether the sector after the free space can be erased to make more. Never the sector the tail is in,
+ * nor one with data of the log being written.
  */
-static uint32_t flashfsWriteBuffers(uint8_t const **buffers, uint32_t *bufferSizes, int bufferCount, bool sync)
+static bool flashfsCanEraseAhead()
 {
-    uint32_t bytesTotal = 0;
+    if (!ringMode || !hasDirectory) {
+        return false;
+    }
 
-    int i;
+    const uint32_t sectorSize = flashfsGetGeometry()->sectorSize;
+    uint32_t inUse;
 
-    for (i = 0; i < bufferCount; i++) {
-        bytesTotal += bufferSizes[i];
+    // Counted back from the tail to the start of the sector
+    if (logOpen) {
+        inUse = openLogLength + logs[logCount - 1].start % sectorSize;
+    } else {
+        inUse = flashfsWrapAddress(tailAddress) % sectorSize;
     }
 
-    if (!sync && !m25p16_isReady()) {
-        return 0;
+    return freeSpace + inUse + sectorSize <= flashfsGetDataSize();
+}
+
+/**
+ * Whether the oldest log starts in the sector at the given address, other than the one being written. The logs that
+ * started before it were deleted with the sector they started in.
+ */
+static bool flashfsOldestLogStartsIn(uint32_t sectorAddress)
+{
+    return logCount > 0 && !(logOpen && logCount == 1)
+        && flashfsDistance(sectorAddress, logs[0].start) < flashfsGetGeometry()->sectorSize;
+}
+
+/**
+ * Start erasing the sector after the free space, deleting the logs that had data in it. Returns false if the volume
+ * is full instead.
+ */
+static bool flashfsEraseAhead()
+{
+    if (!flashfsCanEraseAhead()) {
+        return false;
     }
 
-    uint32_t bytesTotalRemaining = bytesTotal;
+    const uint32_t address = flashfsWrapAddress(tailAddress + freeSpace);
+
+    while (flashfsOldestLogStartsIn(address)) {
+        flashfsDeleteOldestLog();
+    }
 
-    while (bytesTotalRemaining > 0) {
-        uint32_t bytesTotalThisIteration;
-        uint32_t bytesRemainThisIteration;
+    m25p16_eraseSector(address);
 
-        /*
-         * Each page needs to be saved in a separate program operation, so
-         * if we would cross a page boundary, only write up to the boundary in this iteration:
-         */
-        if (tailAddress % M25P16_PAGESIZE + bytesTotalRemaining > M25P16_PAGESIZE) {
-            bytesTotalThisIteration = M25P16_PAGESIZE - tailAddress % M25P16_PAGESIZE;
-        } else {
-            bytesTotalThisIteration = bytesTotalRemaining;
-        }
+    freeSpace += flashfsGetGeometry()->sectorSize;
 
-        // Are we at EOF already? Abort.
-        if (flashfsIsEOF()) {
-            // May as well throw away any buffered data
-            flashfsClearBuffer();
+    return true;
+}
 
-            break;
-        }
+/**
+ * In ring mode, erase the next sector once the free space is down to less than a sector and the buffer has just been
+ * written out. Each step, deleting a log from the directory or starting the erase, waits for the flash to be idle, so
+ * this never waits for the flash.
+ */
+static void flashfsEraseAheadAsync()
+{
+    if (!ringMode || freeSpace >= flashfsGetGeometry()->sectorSize || flashfsTransmitBufferUsed() >= M25P16_PAGESIZE
+            || !flashfsCanEraseAhead() || !m25p16_isReady()) {
+        return;
+    }
 
-        m25p16_pageProgramBegin(tailAddress);
+    const uint32_t address = flashfsWrapAddress(tailAddress + freeSpace);
 
-        bytesRemainThisIteration = bytesTotalThisIteration;
+    if (flashfsOldestLogStartsIn(address)) {
+        flashfsDeleteOldestLog();
+    } else {
+        flashfsEraseAhead();
+    }
+}
 
-        for (i = 0; i < bufferCount; i++) {
-            if (bufferSizes[i] > 0) {
-                // Is buffer larger than our write limit? Write our limit out of it
-                if (bufferSizes[i] >= bytesRemainThisIteration) {
-                    m25p16_pageProgramContinue(buffers[i], bytesRemainThisIteration);
+/**
+ * Called after bytes have been written from the buffer to advance the position of the tail by the given amount.
+ */
+static void flashfsAdvanceTailInBuffer(uint32_t delta)
+{
+    bufferTail += delta;
 
-                    buffers[i] += bytesRemainThisIteration;
-                    bufferSizes[i] -= bytesRemainThisIteration;
+    // Wrap tail around the end of the buffer
+    if (bufferTail >= FLASHFS_WRITE_BUFFER_SIZE) {
+        bufferTail -= FLASHFS_WRITE_BUFFER_SIZE;
+    }
+}
 
-                    bytesRemainThisIteration = 0;
-                    break;
-                } else {
-                    // We'll still have more to write after finishing this buffer off
-                    m25p16_pageProgramContinue(buffers[i], bufferSizes[i]);
+/**
+ * Program the buffered data from the tail address up to the end of its page, or as much of it as there is when
+ * `partial` is set. Otherwise nothing is written until the page can be completed.
+ *
+ * In synchronous mode, waits for the flash to become ready first, and for a sector erase if the free space has run
+ * out. In asynchronous mode returns false straight away if the flash is busy.
+ *
+ * Returns false if nothing was written. At the end of the volume the buffered data is thrown away.
+ */
+static bool flashfsProgramPage(bool partial, bool sync)
+{
+    uint32_t buffered = flashfsTransmitBufferUsed();
+    uint32_t length;
 
-                    bytesRemainThisIteration -= bufferSizes[i];
+    if (buffered == 0 || (!sync && !m25p16_isReady())) {
+        return false;
+    }
 
-                    buffers[i] += bufferSizes[i];
-                    bufferSizes[i] = 0;
-                }
-            }
+    // The end of the volume and the start of the data area are both on page boundaries
+    length = M25P16_PAGESIZE - tailAddress % M25P16_PAGESIZE;
+    if (buffered < length) {
+        if (!partial) {
+            return false;
         }
+        length = buffered;
+    }
 
-        m25p16_pageProgramFinish();
+    if (freeSpace == 0) {
+        // Are we at EOF already? Abort.
+        if (!flashfsEraseAhead()) {
+            // May as well throw away any buffered data
+            flashfsClearBuffer();
 
-        bytesTotalRemaining -= bytesTotalThisIteration;
+            return false;
+        }
+
+        // The erase takes a while, only wait for it if the caller wants every byte written
+        if (!sync || !m25p16_waitForReady(FLASHFS_SECTOR_ERASE_TIMEOUT_MILLIS)) {
+            return false;
+        }
+    }
 
-        // Advance the cursor in the file system to match the bytes we wrote
-        flashfsSetTailAddress(tailAddress + bytesTotalThisIteration);
+    if (length > freeSpace) {
+        length = freeSpace;
+    }
 
-        /*
-         * We'll have to wait for that write to complete before we can issue the next one, so if
-         * the user requested asynchronous writes, break now.
-         */
-        if (!sync)
-            break;
+    // Carry on around the ring from the start of the data area
+    if (tailAddress >= flashfsGetSize()) {
+        flashfsSetTailAddress(dataStart);
     }
 
-    return bytesTotal - bytesTotalRemaining;
-}
+    m25p16_pageProgram(tailAddress, flashWriteBuffer + bufferTail, length);
 
-/*
- * Since the buffered data might wrap around the end of the circular buffer, we can have two segments of data to write,
- * an initial portion and a possible wrapped portion.
- *
- * This routine will fill the details of those buffers into the provided arrays, which must be at least 2 elements long.
- */
-static void flashfsGetDirtyDataBuffers(uint8_t const *buffers[], uint32_t bufferSizes[])
-{
-    buffers[0] = flashWriteBuffer + bufferTail;
-    buffers[1] = flashWriteBuffer + 0;
+    // Advance the cursor in the file system to match the bytes we wrote
+    flashfsAdvanceTailInBuffer(length);
+    flashfsSetTailAddress(tailAddress + length);
+    freeSpace -= length;
+    openLogLength += length;
 
-    if (bufferHead >= bufferTail) {
-        bufferSizes[0] = bufferHead - bufferTail;
-        bufferSizes[1] = 0;
-    } else {
-        bufferSizes[0] = FLASHFS_WRITE_BUFFER_SIZE - bufferTail;
-        bufferSizes[1] = bufferHead;
-    }
+    return true;
 }
 
 /**
@@ -270,35 +576,27 @@ static void flashfsGetDirtyDataBuffers(uint8_t const *buffers[], uint32_t buffer
  */
 uint32_t flashfsGetOffset()
 {
-    uint8_t const * buffers[2];
-    uint32_t bufferSizes[2];
-
-    // Dirty data in the buffers contributes to the offset
+    // Dirty data in the buffer contributes to the offset
+    uint32_t offset = tailAddress + flashfsTransmitBufferUsed();
 
-    flashfsGetDirtyDataBuffers(buffers, bufferSizes);
-
-    return tailAddress + bufferSizes[0] + bufferSizes[1];
+    // A full volume ends at its size rather than back at the start of the data area
+    return offset > flashfsGetSize() ? offset - flashfsGetDataSize() : offset;
 }
 
 /**
- * Called after bytes have been written from the buffer to advance the position of the tail by the given amount.
+ * If the flash is ready, start programming the next whole page of buffered data, and in ring mode erase ahead when it
+ * is time to. The partial page at the end of the buffer stays there for later writes to fill. Never waits for the
+ * flash, call it regularly while writing.
  */
-static void flashfsAdvanceTailInBuffer(uint32_t delta)
+void flashfsFlushPagesAsync()
 {
-    bufferTail += delta;
+    flashfsEraseAheadAsync();
 
-    // Wrap tail around the end of the buffer
-    if (bufferTail >= FLASHFS_WRITE_BUFFER_SIZE) {
-        bufferTail -= FLASHFS_WRITE_BUFFER_SIZE;
-    }
-
-    if (flashfsBufferIsEmpty()) {
-        flashfsClearBuffer(); // Bring buffer pointers back to the start to be tidier
-    }
+    flashfsProgramPage(false, false);
 }
 
 /**
- * If the flash is ready to accept writes, flush the buffer to it.
+ * If the flash is ready to accept writes, flush the buffer to it, including a partial page at the end.
  *
  * Returns true if all data in the buffer has been flushed to the device, or false if
  * there is still data to be written (call flush again later).
@@ -309,51 +607,63 @@ bool flashfsFlushAsync()
         return true; // Nothing to flush
     }
 
-    uint8_t const * buffers[2];
-    uint32_t bufferSizes[2];
-    uint32_t bytesWritten;
-
-    flashfsGetDirtyDataBuffers(buffers, bufferSizes);
-    bytesWritten = flashfsWriteBuffers(buffers, bufferSizes, 2, false);
-    flashfsAdvanceTailInBuffer(bytesWritten);
+    flashfsProgramPage(true, false);
 
     return flashfsBufferIsEmpty();
 }
 
 /**
- * Wait for the flash to become ready and begin flushing any buffered data to flash.
+ * Wait for the flash to become ready and write out all of the buffered data.
  *
  * The flash will still be busy some time after this sync completes, but space will
  * be freed up to accept more writes in the write buffer.
  */
 void flashfsFlushSync()
 {
-    if (flashfsBufferIsEmpty()) {
-        return; // Nothing to flush
+    while (flashfsProgramPage(true, true)) {
     }
 
-    uint8_t const * buffers[2];
-    uint32_t bufferSizes[2];
-
-    flashfsGetDirtyDataBuffers(buffers, bufferSizes);
-    flashfsWriteBuffers(buffers, bufferSizes, 2, true);
-
-    // We've written our entire buffer now:
+    // We've written our entire buffer now, or reached the end of the volume:
     flashfsClearBuffer();
 }
 
+/**
+ * Move the file pointer to the given address, which is taken to have nothing but free space after it up to the end
+ * of the volume.
+ */
 void flashfsSeekAbs(uint32_t offset)
 {
     flashfsFlushSync();
 
     flashfsSetTailAddress(offset);
+    freeSpace = offset < flashfsGetSize() ? flashfsGetSize() - offset : 0;
 }
 
 void flashfsSeekRel(int32_t offset)
 {
-    flashfsFlushSync();
+    flashfsSeekAbs(tailAddress + offset);
+}
+
+static void flashfsBufferData(const uint8_t *data, unsigned int len)
+{
+    // First write the portion before we wrap around the end of the circular buffer
+    unsigned int bufferBytesBeforeWrap = FLASHFS_WRITE_BUFFER_SIZE - bufferHead;
+
+    unsigned int firstPortion = len < bufferBytesBeforeWrap ? len : bufferBytesBeforeWrap;
+
+    memcpy(flashWriteBuffer + bufferHead, data, firstPortion);
+
+    bufferHead += firstPortion;
+
+    data += firstPortion;
+    len -= firstPortion;
 
-    flashfsSetTailAddress(tailAddress + offset);
+    // If we wrap the head around, write the remainder to the start of the buffer (if any)
+    if (bufferHead == FLASHFS_WRITE_BUFFER_SIZE) {
+        memcpy(flashWriteBuffer + 0, data, len);
+
+        bufferHead = len;
+    }
 }
 
 /**
@@ -361,98 +671,45 @@ void flashfsSeekRel(int32_t offset)
  */
 void flashfsWriteByte(uint8_t byte)
 {
-    flashWriteBuffer[bufferHead++] = byte;
-
-    if (bufferHead >= FLASHFS_WRITE_BUFFER_SIZE) {
-        bufferHead = 0;
-    }
-
-    if (flashfsTransmitBufferUsed() >= FLASHFS_WRITE_BUFFER_AUTO_FLUSH_LEN) {
-        flashfsFlushAsync();
-    }
+    flashfsWrite(&byte, 1, false);
 }
 
 /**
  * Write the given buffer to the flash either synchronously or asynchronously depending on the 'sync' parameter.
  *
- * If writing asynchronously, data will be silently discarded if the buffer overflows.
+ * If writing asynchronously, the data is silently discarded if it doesn't fit in the buffer.
  * If writing synchronously, the routine will block waiting for the flash to become ready so will never drop data.
  */
 void flashfsWrite(const uint8_t *data, unsigned int len, bool sync)
 {
-    uint8_t const * buffers[3];
-    uint32_t bufferSizes[3];
+    if (!sync) {
+        if (len > flashfsGetWriteBufferFreeSpace()) {
+            // Try to make room for it
+            flashfsFlushPagesAsync();
 
-    // There could be two dirty buffers to write out already:
-    flashfsGetDirtyDataBuffers(buffers, bufferSizes);
-
-    // Plus the buffer the user supplied:
-    buffers[2] = data;
-    bufferSizes[2] = len;
-
-    /*
-     * Would writing this data to our buffer cause our buffer to reach the flush threshold? If so try to write through
-     * to the flash now
-     */
-    if (bufferSizes[0] + bufferSizes[1] + bufferSizes[2] >= FLASHFS_WRITE_BUFFER_AUTO_FLUSH_LEN) {
-        uint32_t bytesWritten;
-
-        // Attempt to write all three buffers through to the flash asynchronously
-        bytesWritten = flashfsWriteBuffers(buffers, bufferSizes, 3, false);
-
-        if (bufferSizes[0] == 0 && bufferSizes[1] == 0) {
-            // We wrote all the data that was previously buffered
-            flashfsClearBuffer();
-
-            if (bufferSizes[2] == 0) {
-                // And we wrote all the data the user supplied! Job done!
+            if (len > flashfsGetWriteBufferFreeSpace()) {
                 return;
             }
-        } else {
-            // We only wrote a portion of the old data, so advance the tail to remove the bytes we did write from the buffer
-            flashfsAdvanceTailInBuffer(bytesWritten);
         }
 
-        // Is the remainder of the data to be written too big to fit in the buffers?
-        if (bufferSizes[0] + bufferSizes[1] + bufferSizes[2] > FLASHFS_WRITE_BUFFER_USABLE) {
-            if (sync) {
-                // Write it through synchronously
-                flashfsWriteBuffers(buffers, bufferSizes, 3, true);
-                flashfsClearBuffer();
-            } else {
-                /*
-                 * Silently drop the data the user asked to write (i.e. no-op) since we can't buffer it and they
-                 * requested async.
-                 */
-            }
-
-            return;
-        }
+        flashfsBufferData(data, len);
+        flashfsFlushPagesAsync();
 
-        // Fall through and add the remainder of the incoming data to our buffer
-        data = buffers[2];
-        len = bufferSizes[2];
+        return;
     }
 
-    // Buffer up the data the user supplied instead of writing it right away
-
-    // First write the portion before we wrap around the end of the circular buffer
-    unsigned int bufferBytesBeforeWrap = FLASHFS_WRITE_BUFFER_SIZE - bufferHead;
-
-    unsigned int firstPortion = len < bufferBytesBeforeWrap ? len : bufferBytesBeforeWrap;
-
-    memcpy(flashWriteBuffer + bufferHead, data, firstPortion);
-
-    bufferHead += firstPortion;
-
-    data += firstPortion;
-    len -= firstPortion;
+    while (len > 0) {
+        unsigned int bufferFree = flashfsGetWriteBufferFreeSpace();
+        unsigned int portion = len < bufferFree ? len : bufferFree;
 
-    // If we wrap the head around, write the remainder to the start of the buffer (if any)
-    if (bufferHead == FLASHFS_WRITE_BUFFER_SIZE) {
-        memcpy(flashWriteBuffer + 0, data, len);
+        flashfsBufferData(data, portion);
+        data += portion;
+        len -= portion;
 
-        bufferHead = len;
+        // Write out a page to make room for the rest, unless the volume is full
+        if (len > 0 && !flashfsProgramPage(true, true)) {
+            break;
+        }
     }
 }
 
@@ -480,61 +737,25 @@ int flashfsReadAbs(uint32_t address, uint8_t *buffer, unsigned int len)
 }
 
 /**
- * Find the offset of the start of the free space on the device (or the size of the device if it is full).
+ * Find the first block of `blockSize` bytes of the `length` bytes from `start`, around the end of the volume if need
+ * be, that appears to be erased. Returns its offset from `start`, or `length` if there isn't one.
  */
-int flashfsIdentifyStartOfFreeSpace()
+static uint32_t flashfsFindFreeBlock(uint32_t start, uint32_t length, uint32_t blockSize)
 {
-    /* Find the start of the free space on the device by examining the beginning of blocks with a binary search,
-     * looking for ones that appear to be erased. We can achieve this with good accuracy because an erased block
-     * is all bits set to 1, which pretty much never appears in reasonable size substrings of blackbox logs.
-     *
-     * To do better we might write a volume header instead, which would mark how much free space remains. But keeping
-     * a header up to date while logging would incur more writes to the flash, which would consume precious write
-     * bandwidth and block more often.
+    /* Examine the beginning of blocks with a binary search, looking for ones that appear to be erased. We can achieve
+     * this with good accuracy because an erased block is all bits set to 1, which pretty much never appears in
+     * reasonable size substrings of blackbox logs.
      */
-
-    enum {
-        /* We can choose whatever power of 2 size we like, which determines how much wastage of free space we'll have
-         * at the end of the last written data. But smaller blocksizes will require more searching.
-         */
-        FREE_BLOCK_SIZE = 2048,
-
-        /* We don't expect valid data to ever contain this many consecutive uint32_t's of all 1 bits: */
-        FREE_BLOCK_TEST_SIZE_INTS = 4, // i.e. 16 bytes
-        FREE_BLOCK_TEST_SIZE_BYTES = FREE_BLOCK_TEST_SIZE_INTS * sizeof(uint32_t),
-    };
-
-    union {
-        uint8_t bytes[FREE_BLOCK_TEST_SIZE_BYTES];
-        uint32_t ints[FREE_BLOCK_TEST_SIZE_INTS];
-    } testBuffer;
-
     int left = 0; // Smallest block index in the search region
-    int right = flashfsGetSize() / FREE_BLOCK_SIZE; // One past the largest block index in the search region
+    int right = length / blockSize; // One past the largest block index in the search region
     int mid;
-    int result = right;
-    int i;
-    bool blockErased;
+    int result = -1;
 
     while (left < right) {
         mid = (left + right) / 2;
 
-        if (m25p16_readBytes(mid * FREE_BLOCK_SIZE, testBuffer.bytes, FREE_BLOCK_TEST_SIZE_BYTES) < FREE_BLOCK_TEST_SIZE_BYTES) {
-            // Unexpected timeout from flash, so bail early (reporting the device fuller than it really is)
-            break;
-        }
-
-        // Checking the buffer 4 bytes at a time like this is probably faster than byte-by-byte, but I didn't benchmark it :)
-        blockErased = true;
-        for (i = 0; i < FREE_BLOCK_TEST_SIZE_INTS; i++) {
-            if (testBuffer.ints[i] != 0xFFFFFFFF) {
-                blockErased = false;
-                break;
-            }
-        }
-
-        if (blockErased) {
-            /* This erased block might be the leftmost erased block in the volume, but we'll need to continue the
+        if (flashfsBlockIsErased(flashfsWrapAddress(start + mid * blockSize))) {
+            /* This erased block might be the leftmost erased block in the region, but we'll need to continue the
              * search leftwards to find out:
              */
             result = mid;
@@ -545,14 +766,363 @@ int flashfsIdentifyStartOfFreeSpace()
         }
     }
 
-    return result * FREE_BLOCK_SIZE;
+    return result < 0 ? length : (uint32_t) result * blockSize;
+}
+
+/**
+ * Find where the data written from `start` stops, no more than `length` bytes on, for a log that never finished. Each
+ * sector was erased before the log got to it, so the data ends in the first sector whose last bytes are still erased.
+ * The sectors after that one can hold data of deleted logs in ring mode, so only that sector is searched.
+ */
+static uint32_t flashfsFindEndOfData(uint32_t start, uint32_t length)
+{
+    const uint32_t sectorSize = flashfsGetGeometry()->sectorSize;
+    uint32_t offset = 0;
+
+    while (offset < length) {
+        uint32_t address = flashfsWrapAddress(start + offset);
+        uint32_t span = sectorSize - address % sectorSize;
+
+        if (span > length - offset) {
+            span = length - offset;
+        }
+
+        if (span >= FREE_BLOCK_TEST_SIZE_BYTES && flashfsBlockIsErased(address + span - FREE_BLOCK_TEST_SIZE_BYTES)) {
+            // Blocks are counted from the start of the span, the last whole one can take in the end of the data
+            uint32_t end = flashfsFindFreeBlock(address, span, FREE_BLOCK_TEST_SIZE_BYTES);
+
+            return offset + (end < span - FREE_BLOCK_TEST_SIZE_BYTES ? end : span - FREE_BLOCK_TEST_SIZE_BYTES);
+        }
+        offset += span;
+    }
+
+    return length;
+}
+
+/**
+ * Find the offset of the start of the free space on the device (or the size of the device if it is full), for volumes
+ * written as one stream from address 0.
+ */
+int flashfsIdentifyStartOfFreeSpace()
+{
+    /* Volumes with a directory only need this when the directory doesn't know where the last log ended. Keeping an
+     * end address up to date while logging would incur more writes to the flash, which would consume precious write
+     * bandwidth and block more often, so it is only written when the log finishes.
+     */
+    return flashfsFindFreeBlock(0, flashfsGetSize(), FREE_BLOCK_SIZE);
 }
 
 /**
- * Returns true if the file pointer is at the end of the device.
+ * Returns true if the file pointer is at the end of the device, with no free space left and none to be made.
  */
 bool flashfsIsEOF() {
-    return tailAddress >= flashfsGetSize();
+    return freeSpace == 0 && !flashfsCanEraseAhead();
+}
+
+/**
+ * The number of bytes that can be written before the volume is full, or in ring mode before the oldest logs are erased.
+ */
+uint32_t flashfsGetFreeSpace()
+{
+    uint32_t buffered = flashfsTransmitBufferUsed();
+
+    return freeSpace > buffered ? freeSpace - buffered : 0;
+}
+
+/**
+ * In ring mode the sectors of the oldest logs are erased when the volume fills up, rather than logging stopping.
+ */
+void flashfsSetRingMode(bool enabled)
+{
+    ringMode = enabled;
+}
+
+bool flashfsHasDirectory()
+{
+    return hasDirectory;
+}
+
+int flashfsGetLogCount()
+{
+    return logCount;
+}
+
+/**
+ * Fill `log` with the start and end of the log at the given index, 0 being the oldest. The end of a log still being
+ * written is the current offset.
+ */
+bool flashfsGetLog(int index, flashfsLog_t *log)
+{
+    if (index < 0 || index >= logCount) {
+        return false;
+    }
+
+    log->start = logs[index].start;
+    log->end = logOpen && index == logCount - 1 ? flashfsGetOffset() : logs[index].end;
+
+    return true;
+}
+
+uint32_t flashfsGetLogSize(const flashfsLog_t *log)
+{
+    return flashfsDistance(log->start, log->end);
+}
+
+/**
+ * Read `len` bytes from `offset` in the log at the given index. Logs can wrap around the end of the volume, so this
+ * reads no further than the end of the volume at once.
+ *
+ * Returns the number of bytes actually read, 0 at the end of the log.
+ */
+int flashfsReadLog(int index, uint32_t offset, uint8_t *buffer, unsigned int len)
+{
+    flashfsLog_t log;
+
+    if (!flashfsGetLog(index, &log)) {
+        return 0;
+    }
+
+    uint32_t size = flashfsGetLogSize(&log);
+
+    if (offset >= size) {
+        return 0;
+    }
+    if (len > size - offset) {
+        len = size - offset;
+    }
+
+    uint32_t address = flashfsWrapAddress(log.start + offset);
+
+    if (len > flashfsGetSize() - address) {
+        len = flashfsGetSize() - address;
+    }
+
+    return flashfsReadAbs(address, buffer, len);
+}
+
+/**
+ * Record the start of a new log at the current offset. Called before writing a log, the end is recorded by
+ * flashfsFinishLog().
+ */
+void flashfsStartLog()
+{
+    if (!hasDirectory || logOpen) {
+        return;
+    }
+
+    flashfsFlushSync();
+
+    if (directoryHeaderPending) {
+        if (!flashfsIsReady()) {
+            // Still erasing, this log is found by the search for free space at the next startup instead
+            return;
+        }
+        flashfsWriteDirectoryHeader();
+    }
+
+    // The directory is compacted when a log finishes, long before it fills up. Doing that here would hold up arming
+    if (firstLogRecord + logCount == flashfsDirectoryRecordLimit()) {
+        return;
+    }
+
+    // The directory keeps the newest logs, the data of one dropped here is erased when its space is needed
+    if (logCount == FLASHFS_MAX_LOGS) {
+        flashfsDeleteOldestLog();
+    }
+
+    flashfsSetTailAddress(flashfsWrapAddress(tailAddress));
+
+    logs[logCount].start = tailAddress;
+    logs[logCount].end = FLASHFS_ERASED_WORD;
+
+    flashfsProgramDirectoryWord(firstLogRecord + logCount, offsetof(flashfsDirectoryRecord_t, start), logs[logCount].start);
+
+    logCount++;
+    logOpen = true;
+    openLogLength = 0;
+}
+
+/**
+ * Flush the log being written and record its end, then compact the directory if half its records are used.
+ */
+void flashfsFinishLog()
+{
+    if (!logOpen) {
+        return;
+    }
+
+    flashfsFlushSync();
+
+    logs[logCount - 1].end = tailAddress;
+    logOpen = false;
+
+    flashfsProgramDirectoryWord(firstLogRecord + logCount - 1, offsetof(flashfsDirectoryRecord_t, end), tailAddress);
+
+    // Started when the directory was last compacted, a flight ago
+    flashfsFinishSpareDirectoryErase();
+
+    if (spareDirectoryState == FLASHFS_SPARE_ERASED && firstLogRecord + logCount > flashfsDirectoryRecordLimit() / 2) {
+        flashfsCompactDirectory();
+    }
+}
+
+/**
+ * Erase the `count` oldest logs, the whole sectors from the end of the free space up to the one the next log starts in
+ * (or the rest of the volume if none are left). Blocks until all but the last sector erase have finished.
+ *
+ * Returns the number of logs erased, 0 while a log is being written or when the volume has no directory.
+ */
+int flashfsEraseOldestLogs(int count)
+{
+    if (!hasDirectory || logOpen || count <= 0) {
+        return 0;
+    }
+
+    if (count > logCount) {
+        count = logCount;
+    }
+
+    flashfsFlushSync();
+
+    const uint32_t sectorSize = flashfsGetGeometry()->sectorSize;
+    const bool eraseAll = count == logCount;
+    uint32_t address = flashfsWrapAddress(tailAddress + freeSpace);
+    uint32_t sectorCount;
+
+    if (eraseAll) {
+        // Everything but the free space, including the sector the tail is in
+        sectorCount = (flashfsGetDataSize() - freeSpace + sectorSize - 1) / sectorSize;
+    } else {
+        sectorCount = flashfsDistance(address, flashfsSectorStart(logs[count].start)) / sectorSize;
+    }
+
+    for (int i = 0; i < count; i++) {
+        flashfsDeleteOldestLog();
+    }
+
+    for (uint32_t i = 0; i < sectorCount; i++) {
+        m25p16_eraseSector(address);
+        address = flashfsWrapAddress(address + sectorSize);
+        freeSpace += sectorSize;
+    }
+
+    if (eraseAll) {
+        flashfsSetTailAddress(flashfsSectorStart(flashfsWrapAddress(tailAddress)));
+        freeSpace = flashfsGetDataSize();
+    }
+
+    return count;
+}
+
+/**
+ * Count the bytes from the tail onward that are erased. The rest of the sector the tail is in was erased with it,
+ * after that whole sectors are checked up to the first sector of the oldest log. Ring mode can leave data of deleted
+ * logs before that.
+ */
+static uint32_t flashfsMeasureFreeSpace()
+{
+    const uint32_t sectorSize = flashfsGetGeometry()->sectorSize;
+    const uint32_t tail = flashfsWrapAddress(tailAddress);
+    uint32_t limit;
+    uint32_t erased = (sectorSize - tail % sectorSize) % sectorSize;
+
+    if (logCount > 0) {
+        limit = flashfsDistance(tail, flashfsSectorStart(logs[0].start));
+    } else {
+        limit = flashfsGetDataSize() - tail % sectorSize;
+    }
+
+    if (erased > limit) {
+        return limit;
+    }
+
+    while (erased + sectorSize <= limit && flashfsBlockIsErased(flashfsWrapAddress(tail + erased))) {
+        erased += sectorSize;
+    }
+
+    return erased;
+}
+
+/**
+ * Read the directory, or start one if the volume is blank. Returns false for volumes written without one.
+ */
+static bool flashfsLoadDirectory()
+{
+    flashfsDirectoryHeader_t first, second;
+    const flashfsDirectoryHeader_t *header = &first;
+    flashfsDirectoryRecord_t record;
+    bool firstIsValid = flashfsReadDirectoryHeader(0, &first);
+    bool secondIsValid = flashfsReadDirectoryHeader(flashfsGetGeometry()->sectorSize, &second);
+
+    if (!firstIsValid && !secondIsValid) {
+        if (!flashfsBlockIsErased(0)) {
+            return false;
+        }
+        // Blank, or it lost power before the header went in after an erase
+        flashfsResetDirectory();
+        flashfsWriteDirectoryHeader();
+    } else {
+        flashfsResetDirectory();
+
+        // There are two when the power went before the old copy was erased
+        if (secondIsValid && (!firstIsValid || (int32_t) (second.generation - first.generation) > 0)) {
+            directoryAddress = flashfsGetGeometry()->sectorSize;
+            header = &second;
+        }
+        directoryGeneration = header->generation;
+        spareDirectoryState = header->spareState;
+    }
+
+    int recordCount = flashfsFindFirstErasedRecordField(0, flashfsDirectoryRecordLimit(), offsetof(flashfsDirectoryRecord_t, start));
+
+    firstLogRecord = flashfsFindFirstErasedRecordField(0, recordCount, offsetof(flashfsDirectoryRecord_t, deleted));
+
+    while (recordCount - firstLogRecord > FLASHFS_MAX_LOGS) {
+        flashfsProgramDirectoryWord(firstLogRecord, offsetof(flashfsDirectoryRecord_t, deleted), 0);
+        firstLogRecord++;
+    }
+
+    for (int i = firstLogRecord; i < recordCount; i++) {
+        if (m25p16_readBytes(flashfsDirectoryRecordAddress(i), (uint8_t *) &record, sizeof(record)) < (int) sizeof(record)) {
+            break;
+        }
+        logs[logCount].start = record.start;
+        logs[logCount].end = record.end;
+        logCount++;
+    }
+
+    logOpen = logCount > 0 && logs[logCount - 1].end == FLASHFS_ERASED_WORD;
+
+    return true;
+}
+
+/**
+ * Point the tail at the end of the newest log, finding and recording where it stopped if it never finished.
+ */
+static void flashfsFindAppendPoint()
+{
+    uint32_t start;
+    uint32_t length;
+
+    if (logCount == 0) {
+        // The volume might have been written while the directory header was pending
+        start = dataStart;
+        length = flashfsGetDataSize();
+    } else if (!logOpen) {
+        flashfsSetTailAddress(logs[logCount - 1].end);
+        return;
+    } else {
+        start = logs[logCount - 1].start;
+        length = logCount > 1 ? flashfsDistance(start, flashfsSectorStart(logs[0].start)) : flashfsGetDataSize();
+    }
+
+    uint32_t end = start + flashfsFindEndOfData(start, length);
+
+    flashfsSetTailAddress(end > flashfsGetSize() ? end - flashfsGetDataSize() : end);
+
+    if (logOpen) {
+        flashfsFinishLog();
+    }
 }
 
 /**
@@ -560,9 +1130,34 @@ bool flashfsIsEOF() {
  */
 void flashfsInit()
 {
+    flashfsClearBuffer();
+    hasDirectory = false;
+    directoryHeaderPending = false;
+    dataStart = 0;
+    logCount = 0;
+    firstLogRecord = 0;
+    logOpen = false;
+
     // If we have a flash chip present at all
     if (flashfsGetSize() > 0) {
-        // Start the file pointer off at the beginning of free space so caller can start writing immediately
-        flashfsSeekAbs(flashfsIdentifyStartOfFreeSpace());
+        if (flashfsLoadDirectory()) {
+            flashfsFindAppendPoint();
+
+            // Unless it is known to be erased, the other directory sector could hold part of a copy or of an erase
+            if (spareDirectoryState != FLASHFS_SPARE_ERASED) {
+                m25p16_eraseSector(flashfsSpareDirectoryAddress());
+                spareDirectoryErasing = true;
+            }
+            // A copy that didn't finish is made again, and compacting now is cheaper than after the next flight
+            if (spareDirectoryState == FLASHFS_SPARE_IN_USE || firstLogRecord + logCount > flashfsDirectoryRecordLimit() / 2) {
+                flashfsCompactDirectory();
+            }
+            flashfsFinishSpareDirectoryErase();
+
+            freeSpace = flashfsMeasureFreeSpace();
+        } else {
+            // Start the file pointer off at the beginning of free space so caller can start writing immediately
+            flashfsSeekAbs(flashfsIdentifyStartOfFreeSpace());
+        }
     }
 }
@@ -21,11 +21,27 @@
 
 #include "drivers/flash.h"
 
-#define FLASHFS_WRITE_BUFFER_SIZE 128
+/*
+ * The write buffer holds several flash pages, the ones after it fill while a page goes to the chip. It also has to
+ * take what is written while a sector is erased ahead in ring mode. Targets with RAM to spare can make it bigger in
+ * target.h, it must be a multiple of the page size.
+ */
+#ifndef FLASHFS_WRITE_BUFFER_SIZE
+#ifdef STM32F10X
+#define FLASHFS_WRITE_BUFFER_SIZE 512
+#else
+#define FLASHFS_WRITE_BUFFER_SIZE 2048
+#endif
+#endif
 #define FLASHFS_WRITE_BUFFER_USABLE (FLASHFS_WRITE_BUFFER_SIZE - 1)
 
-// Automatically trigger a flush when this much data is in the buffer
-#define FLASHFS_WRITE_BUFFER_AUTO_FLUSH_LEN 64
+// The directory in one of the first two sectors of the volume lists up to this many logs, the newest ones
+#define FLASHFS_MAX_LOGS 32
+
+typedef struct flashfsLog_s {
+    uint32_t start;
+    uint32_t end;       // one past the last byte, before start if the log wraps around the end of the volume
+} flashfsLog_t;
 
 void flashfsEraseCompletely();
 void flashfsEraseRange(uint32_t start, uint32_t end);
@@ -45,6 +61,7 @@ void flashfsWrite(const uint8_t *data, unsigned int len, bool sync);
 
 int flashfsReadAbs(uint32_t offset, uint8_t *data, unsigned int len);
 
+void flashfsFlushPagesAsync();
 bool flashfsFlushAsync();
 void flashfsFlushSync();
 
@@ -52,3 +69,16 @@ void flashfsInit();
 
 bool flashfsIsReady();
 bool flashfsIsEOF();
+
+uint32_t flashfsGetFreeSpace();
+void flashfsSetRingMode(bool enabled);
+
+bool flashfsHasDirectory();
+int flashfsGetLogCount();
+bool flashfsGetLog(int index, flashfsLog_t *log);
+uint32_t flashfsGetLogSize(const flashfsLog_t *log);
+int flashfsReadLog(int index, uint32_t offset, uint8_t *buffer, unsigned int len);
+
+void flashfsStartLog();
+void flashfsFinishLog();
+int flashfsEraseOldestLogs(int count);
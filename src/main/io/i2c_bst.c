@@ -649,6 +649,7 @@ static bool bstSlaveProcessFeedbackCommand(uint8_t bstRequest)
 				bstWrite16(rcData[i]);
 			break;
 	    case BST_ATTITUDE:
+			imuUpdateEulerAngles();
 			for (i = 0; i < 2; i++)
 				bstWrite16(attitude.raw[i]);
 			//bstWrite16(heading); //FIXME
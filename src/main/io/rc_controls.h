@@ -150,6 +150,7 @@ typedef struct controlRateConfig_s {
 } controlRateConfig_t;
 
 extern int16_t rcCommand[4];
+extern float rcCommandDerivative[4];
 
 typedef struct rcControlsConfig_s {
     uint8_t deadband;                       // introduce a deadband around the stick center for pitch and roll axis. Must be greater than zero.
@@ -0,0 +1,186 @@
+/*
+ * This file is part of Cleanflight.
+ *
+ * Cleanflight is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cleanflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cleanflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Smoothing of rcCommand between RX frames. The targets come in once per frame and the PID loop
+ * moves towards them a little every loop. The time between frames is measured from the frame
+ * timestamps of the receiver, the rate of the protocol is only where the estimate starts from.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "common/maths.h"
+#include "common/filter.h"
+
+#include "io/rc_smoothing.h"
+
+#define BUTTERWORTH_Q 0.70710678f
+#define RC_SMOOTHING_INTERVAL_GAIN 0.125f       // of every measured interval in the estimate
+
+static void rcSmoothingDesignFilters(rcSmoothing_t *smoothing)
+{
+    // Half the frame rate, the steps between frames are above it
+    const float cutoffHz = 500000.0f / smoothing->frameInterval;
+
+    smoothing->pt1RC = 1.0f / (2.0f * M_PIf * cutoffHz);
+
+    if (smoothing->type == RC_SMOOTHING_BIQUAD && smoothing->loopTime) {
+        for (int channel = 0; channel < RC_SMOOTHING_CHANNEL_COUNT; channel++) {
+            biquadFilterUpdate(&smoothing->biquad[channel], FILTER_LPF, cutoffHz, BUTTERWORTH_Q, smoothing->loopTime);
+        }
+    }
+    smoothing->designedInterval = smoothing->frameInterval;
+}
+
+void rcSmoothingInit(rcSmoothing_t *smoothing, rcSmoothingType_e type, uint16_t frameInterval, uint32_t loopTime)
+{
+    memset(smoothing, 0, sizeof(*smoothing));
+    smoothing->type = type;
+    smoothing->frameInterval = constrain(frameInterval, RC_SMOOTHING_INTERVAL_MIN_US, RC_SMOOTHING_INTERVAL_MAX_US);
+    smoothing->loopTime = loopTime;
+    rcSmoothingDesignFilters(smoothing);
+}
+
+// One interval between frames into the estimate. Late frames after a dropped one and the frames that bunch up
+// behind them are left out, unless the receiver keeps coming at a rate so far from the estimate.
+static void rcSmoothingMeasureInterval(rcSmoothing_t *smoothing, uint32_t interval)
+{
+    if (interval < RC_SMOOTHING_INTERVAL_MIN_US || interval > RC_SMOOTHING_INTERVAL_MAX_US) {
+        return;
+    }
+
+    if (interval < smoothing->frameInterval * 0.5f || interval > smoothing->frameInterval * 1.5f) {
+        if (++smoothing->rejectedIntervals < RC_SMOOTHING_REJECTED_INTERVALS_MAX) {
+            return;
+        }
+        smoothing->frameInterval = interval;
+    } else {
+        smoothing->frameInterval += (interval - smoothing->frameInterval) * RC_SMOOTHING_INTERVAL_GAIN;
+    }
+
+    smoothing->rejectedIntervals = 0;
+}
+
+// Start the biquad as if it had been on the value all along
+static void rcSmoothingSettleBiquad(biquadFilter_t *filter, float value)
+{
+    filter->d1 = value * (1.0f - filter->b0);
+    filter->d2 = value * (filter->b2 - filter->a2);
+}
+
+// frameAt is the time of the frame the targets come from, it stays the same when the targets are worked out again without a new frame
+void rcSmoothingSetTargets(rcSmoothing_t *smoothing, const int16_t *targets, uint32_t frameAt)
+{
+    if (frameAt != smoothing->frameAt) {
+        if (smoothing->frameAt) {
+            rcSmoothingMeasureInterval(smoothing, frameAt - smoothing->frameAt);
+        }
+        smoothing->frameAt = frameAt;
+    }
+
+    // Only once the estimate has moved, the interval changes a little with every frame
+    if (ABS(smoothing->frameInterval - smoothing->designedInterval) > smoothing->designedInterval * RC_SMOOTHING_REDESIGN_CHANGE) {
+        rcSmoothingDesignFilters(smoothing);
+    }
+
+    const float segment = smoothing->frameInterval * 1e-6f;
+
+    for (int channel = 0; channel < RC_SMOOTHING_CHANNEL_COUNT; channel++) {
+        const float target = targets[channel];
+
+        if (!smoothing->started) {
+            smoothing->value[channel] = target;
+            smoothing->target[channel] = target;
+            rcSmoothingSettleBiquad(&smoothing->biquad[channel], target);
+        }
+
+        const float delta = target - smoothing->value[channel];
+        float slopeFrom = smoothing->derivative[channel] * segment;
+        float slopeTo = target - smoothing->target[channel];
+
+        // Monotone, the cubic does not swing past the target before it gets there
+        if (delta == 0.0f) {
+            slopeFrom = 0;
+            slopeTo = 0;
+        } else {
+            slopeFrom = (slopeFrom * delta < 0) ? 0 : constrainf(slopeFrom, -3 * ABS(delta), 3 * ABS(delta));
+            slopeTo = (slopeTo * delta < 0) ? 0 : constrainf(slopeTo, -3 * ABS(delta), 3 * ABS(delta));
+        }
+
+        smoothing->from[channel] = smoothing->value[channel];
+        smoothing->slopeFrom[channel] = slopeFrom;
+        smoothing->slopeTo[channel] = slopeTo;
+        smoothing->target[channel] = target;
+    }
+    smoothing->elapsed = 0;
+    smoothing->started = true;
+}
+
+// Called every PID loop with the time since the previous call, the biquad stays designed for the nominal loop time
+void rcSmoothingApply(rcSmoothing_t *smoothing, uint32_t deltaT)
+{
+    if (!deltaT) {
+        return;
+    }
+
+    const float dT = deltaT * 1e-6f;
+    const float rate = smoothing->type == RC_SMOOTHING_OFF ? 0 : 1e6f / deltaT;
+    float u = 0;
+
+    if (smoothing->type == RC_SMOOTHING_LINEAR || smoothing->type == RC_SMOOTHING_CUBIC) {
+        smoothing->elapsed += deltaT;
+        u = smoothing->elapsed / smoothing->frameInterval;
+    }
+
+    for (int channel = 0; channel < RC_SMOOTHING_CHANNEL_COUNT; channel++) {
+        const float previous = smoothing->value[channel];
+        const float target = smoothing->target[channel];
+        float value;
+
+        switch (smoothing->type) {
+        case RC_SMOOTHING_LINEAR:
+            value = u < 1.0f ? smoothing->from[channel] + (target - smoothing->from[channel]) * u : target;
+            break;
+        case RC_SMOOTHING_PT1:
+            value = previous + dT / (smoothing->pt1RC + dT) * (target - previous);
+            break;
+        case RC_SMOOTHING_BIQUAD:
+            value = biquadFilterApply(&smoothing->biquad[channel], target);
+            break;
+        case RC_SMOOTHING_CUBIC:
+            // Hermite basis, a late frame finds it waiting on the target rather than going past it
+            if (u < 1.0f) {
+                const float u2 = u * u;
+                const float u3 = u2 * u;
+                value = (2 * u3 - 3 * u2 + 1) * smoothing->from[channel] + (u3 - 2 * u2 + u) * smoothing->slopeFrom[channel]
+                    + (3 * u2 - 2 * u3) * target + (u3 - u2) * smoothing->slopeTo[channel];
+            } else {
+                value = target;
+            }
+            break;
+        case RC_SMOOTHING_OFF:
+        default:
+            value = target;
+            break;
+        }
+
+        smoothing->value[channel] = value;
+        smoothing->derivative[channel] = (value - previous) * rate;
+    }
+}
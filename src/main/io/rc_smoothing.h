@@ -0,0 +1,69 @@
+/*
+ * This file is part of Cleanflight.
+ *
+ * Cleanflight is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cleanflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cleanflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "common/filter.h"
+
+// ROLL, PITCH, YAW and THROTTLE, the channels behind rcCommand
+#define RC_SMOOTHING_CHANNEL_COUNT 4
+
+#define RC_SMOOTHING_INTERVAL_MIN_US 1000
+#define RC_SMOOTHING_INTERVAL_MAX_US 60000
+#define RC_SMOOTHING_REJECTED_INTERVALS_MAX 8     // the receiver really runs at another rate, start again from the intervals it has
+#define RC_SMOOTHING_REDESIGN_CHANGE 0.05f        // of the interval the filters are designed for, less leaves them as they are
+
+typedef enum {
+    RC_SMOOTHING_OFF = 0,
+    RC_SMOOTHING_LINEAR,        // straight line to the target over a frame interval
+    RC_SMOOTHING_PT1,           // first order lowpass of the frame steps at half the frame rate
+    RC_SMOOTHING_BIQUAD,        // second order Butterworth lowpass of the frame steps at half the frame rate
+    RC_SMOOTHING_CUBIC          // monotone cubic from where it is, with the slope it has, to the target with the slope of the last two frames
+} rcSmoothingType_e;
+
+typedef struct rcSmoothing_s {
+    rcSmoothingType_e type;
+    bool started;                       // has had targets
+
+    uint32_t frameAt;                   // time of the latest frame, 0 until there was one
+    float frameInterval;                // estimated time between frames in us
+    uint8_t rejectedIntervals;
+    uint32_t loopTime;                  // nominal time between rcSmoothingApply() calls in us, for the biquad design
+    float designedInterval;             // frame interval the filters are designed for
+
+    float target[RC_SMOOTHING_CHANNEL_COUNT];
+    float value[RC_SMOOTHING_CHANNEL_COUNT];
+    float derivative[RC_SMOOTHING_CHANNEL_COUNT];   // of value, per second, 0 without smoothing
+
+    // segment of LINEAR and CUBIC since the latest targets
+    float elapsed;
+    float from[RC_SMOOTHING_CHANNEL_COUNT];
+    float slopeFrom[RC_SMOOTHING_CHANNEL_COUNT];    // per segment
+    float slopeTo[RC_SMOOTHING_CHANNEL_COUNT];
+
+    float pt1RC;
+    biquadFilter_t biquad[RC_SMOOTHING_CHANNEL_COUNT];
+} rcSmoothing_t;
+
+void rcSmoothingInit(rcSmoothing_t *smoothing, rcSmoothingType_e type, uint16_t frameInterval, uint32_t loopTime);
+void rcSmoothingSetTargets(rcSmoothing_t *smoothing, const int16_t *targets, uint32_t frameAt);
+void rcSmoothingApply(rcSmoothing_t *smoothing, uint32_t deltaT);
+
+static inline float rcSmoothingGetDerivative(const rcSmoothing_t *smoothing, int channel)
+{
+    return smoothing->derivative[channel];
+}
@@ -33,6 +33,7 @@
 #include "common/maths.h"
 #include "common/color.h"
 #include "common/typeconversion.h"
+#include "common/utils.h"
 
 #include "drivers/system.h"
 
@@ -58,6 +59,7 @@
 
 #include "rx/rx.h"
 #include "rx/spektrum.h"
+#include "rx/serial_rx_frame.h"
 
 #include "sensors/battery.h"
 #include "sensors/boardalignment.h"
@@ -76,6 +78,8 @@
 #include "telemetry/telemetry.h"
 #include "telemetry/frsky.h"
 
+#include "blackbox/blackbox.h"
+
 #include "config/runtime_config.h"
 #include "config/config.h"
 #include "config/config_profile.h"
@@ -241,7 +245,7 @@ const clicmd_t cmdTable[] = {
         "list\r\n"
         "\t<+|->[name]", cliFeature),
 #ifdef USE_FLASHFS
-    CLI_COMMAND_DEF("flash_erase", "erase flash chip", NULL, cliFlashErase),
+    CLI_COMMAND_DEF("flash_erase", "erase flash chip", "[number of oldest logs]", cliFlashErase),
     CLI_COMMAND_DEF("flash_info", "show flash chip info", NULL, cliFlashInfo),
 #ifdef USE_FLASH_TOOLS
     CLI_COMMAND_DEF("flash_read", NULL, "<length> <address>", cliFlashRead),
@@ -291,7 +295,9 @@ const clicmd_t cmdTable[] = {
 #endif
     CLI_COMMAND_DEF("status", "show status", NULL, cliStatus),
 #ifndef SKIP_TASK_STATISTICS
-    CLI_COMMAND_DEF("tasks", "show task stats", NULL, cliTasks),
+    CLI_COMMAND_DEF("tasks", "show task stats",
+        "[hist]\r\n"
+        "\ttrace [on|off|spike]", cliTasks),
 #endif
     CLI_COMMAND_DEF("version", "show version", NULL, cliVersion),
 };
@@ -339,6 +345,10 @@ static const char * const lookupTableBlackboxDevice[] = {
     "SERIAL", "SPIFLASH"
 };
 
+static const char * const lookupTableBlackboxEncoding[] = {
+    "VB", "PACKED"
+};
+
 
 static const char * const lookupTablePidController[] = {
     "UNUSED", "MWREWRITE", "LUX"
@@ -354,15 +364,19 @@ static const char * const lookupTableSerialRX[] = {
     "XB-B-RJ01"
 };
 
-static const char * const lookupTableGyroFilter[] = {
-    "LOW", "MEDIUM", "HIGH"
-};
-
 static const char * const lookupTableGyroSampling[] = {
     "8KHZ",
     "1KHZ"
 };
 
+static const char * const lookupTableSchedulerMode[] = {
+    "DYNAMIC", "EDF"
+};
+
+static const char * const lookupTableRcSmoothing[] = {
+    "OFF", "LINEAR", "PT1", "BIQUAD", "CUBIC"
+};
+
 typedef struct lookupTableEntry_s {
     const char * const *values;
     const uint8_t valueCount;
@@ -378,13 +392,15 @@ typedef enum {
 #endif
 #ifdef BLACKBOX
     TABLE_BLACKBOX_DEVICE,
+    TABLE_BLACKBOX_ENCODING,
 #endif
     TABLE_CURRENT_SENSOR,
     TABLE_GIMBAL_MODE,
     TABLE_PID_CONTROLLER,
     TABLE_SERIAL_RX,
-    TABLE_GYRO_FILTER,
     TABLE_GYRO_SAMPLING,
+    TABLE_SCHEDULER_MODE,
+    TABLE_RC_SMOOTHING,
 } lookupTableIndex_e;
 
 static const lookupTableEntry_t lookupTables[] = {
@@ -396,12 +412,16 @@ static const lookupTableEntry_t lookupTables[] = {
     { lookupTableGPSSBASMode, sizeof(lookupTableGPSSBASMode) / sizeof(char *) },
 #endif
     { lookupTableBlackboxDevice, sizeof(lookupTableBlackboxDevice) / sizeof(char *) },
+#ifdef BLACKBOX
+    { lookupTableBlackboxEncoding, sizeof(lookupTableBlackboxEncoding) / sizeof(char *) },
+#endif
     { lookupTableCurrentSensor, sizeof(lookupTableCurrentSensor) / sizeof(char *) },
     { lookupTableGimbalMode, sizeof(lookupTableGimbalMode) / sizeof(char *) },
     { lookupTablePidController, sizeof(lookupTablePidController) / sizeof(char *) },
     { lookupTableSerialRX, sizeof(lookupTableSerialRX) / sizeof(char *) },
-    { lookupTableGyroFilter, sizeof(lookupTableGyroFilter) / sizeof(char *) },
-    { lookupTableGyroSampling, sizeof(lookupTableGyroSampling) / sizeof(char *) }
+    { lookupTableGyroSampling, sizeof(lookupTableGyroSampling) / sizeof(char *) },
+    { lookupTableSchedulerMode, sizeof(lookupTableSchedulerMode) / sizeof(char *) },
+    { lookupTableRcSmoothing, sizeof(lookupTableRcSmoothing) / sizeof(char *) }
 };
 
 #define VALUE_TYPE_OFFSET 0
@@ -455,6 +475,7 @@ typedef struct {
 
 const clivalue_t valueTable[] = {
     { "emf_avoidance",              VAR_UINT8  | MASTER_VALUE | MODE_LOOKUP,  &masterConfig.emf_avoidance, .config.lookup = { TABLE_OFF_ON } },
+    { "scheduler_mode",             VAR_UINT8  | MASTER_VALUE | MODE_LOOKUP,  &masterConfig.scheduler_mode, .config.lookup = { TABLE_SCHEDULER_MODE } },
 
 	{ "mid_rc",                     VAR_UINT16 | MASTER_VALUE,  &masterConfig.rxConfig.midrc, .config.minmax = { 1200,  1700 } },
     { "min_check",                  VAR_UINT16 | MASTER_VALUE,  &masterConfig.rxConfig.mincheck, .config.minmax = { PWM_RANGE_ZERO,  PWM_RANGE_MAX } },
@@ -463,7 +484,7 @@ const clivalue_t valueTable[] = {
     { "rssi_scale",                 VAR_UINT8  | MASTER_VALUE,  &masterConfig.rxConfig.rssi_scale, .config.minmax = { RSSI_SCALE_MIN,  RSSI_SCALE_MAX } },
     { "rssi_ppm_invert",            VAR_INT8   | MASTER_VALUE | MODE_LOOKUP,  &masterConfig.rxConfig.rssi_ppm_invert, .config.lookup = { TABLE_OFF_ON } },
     { "input_filtering_mode",       VAR_INT8   | MASTER_VALUE | MODE_LOOKUP,  &masterConfig.inputFilteringMode, .config.lookup = { TABLE_OFF_ON } },
-    { "rc_smoothing",               VAR_INT8   | MASTER_VALUE | MODE_LOOKUP,  &masterConfig.rxConfig.rcSmoothing, .config.lookup = { TABLE_OFF_ON } },
+    { "rc_smoothing",               VAR_INT8   | MASTER_VALUE | MODE_LOOKUP,  &masterConfig.rxConfig.rcSmoothing, .config.lookup = { TABLE_RC_SMOOTHING } },
 
     { "min_throttle",               VAR_UINT16 | MASTER_VALUE,  &masterConfig.escAndServoConfig.minthrottle, .config.minmax = { PWM_RANGE_ZERO,  PWM_RANGE_MAX } },
     { "max_throttle",               VAR_UINT16 | MASTER_VALUE,  &masterConfig.escAndServoConfig.maxthrottle, .config.minmax = { PWM_RANGE_ZERO,  PWM_RANGE_MAX } },
@@ -656,7 +677,16 @@ const clivalue_t valueTable[] = {
     { "i_vel",                      VAR_UINT8  | PROFILE_VALUE, &masterConfig.profile[0].pidProfile.I8[PIDVEL], .config.minmax = { 0,  200 } },
     { "d_vel",                      VAR_UINT8  | PROFILE_VALUE, &masterConfig.profile[0].pidProfile.D8[PIDVEL], .config.minmax = { 0,  200 } },
 
-    { "gyro_soft_lpf",              VAR_UINT8  | PROFILE_VALUE | MODE_LOOKUP, &masterConfig.profile[0].pidProfile.gyro_soft_lpf, .config.lookup = { TABLE_GYRO_FILTER } },
+    { "gyro_fir_level",             VAR_UINT8  | PROFILE_VALUE, &masterConfig.profile[0].pidProfile.gyro_fir_level, .config.minmax = {0, 3 } },
+    { "gyro_lpf_hz",                VAR_UINT16 | PROFILE_VALUE, &masterConfig.profile[0].pidProfile.gyro_lpf_hz, .config.minmax = {0, 1000 } },
+    { "gyro_notch_hz",              VAR_UINT16 | PROFILE_VALUE, &masterConfig.profile[0].pidProfile.gyro_notch_hz, .config.minmax = {0, 1000 } },
+    { "gyro_notch_cutoff_hz",       VAR_UINT16 | PROFILE_VALUE, &masterConfig.profile[0].pidProfile.gyro_notch_cutoff_hz, .config.minmax = {1, 1000 } },
+#ifdef GYRO_DYNAMIC_NOTCH
+    { "gyro_dyn_notch_min_hz",      VAR_UINT16 | PROFILE_VALUE, &masterConfig.profile[0].pidProfile.gyro_dyn_notch_min_hz, .config.minmax = {0, 1000 } },
+    { "gyro_dyn_notch_max_hz",      VAR_UINT16 | PROFILE_VALUE, &masterConfig.profile[0].pidProfile.gyro_dyn_notch_max_hz, .config.minmax = {1, 1000 } },
+    { "gyro_dyn_notch_q",           VAR_UINT8  | PROFILE_VALUE, &masterConfig.profile[0].pidProfile.gyro_dyn_notch_q, .config.minmax = {5, 100 } },
+#endif
+    { "setpoint_ff",                VAR_UINT8  | PROFILE_VALUE, &masterConfig.profile[0].pidProfile.setpoint_ff, .config.minmax = {0, 200 } },
     { "dterm_cut_hz",               VAR_UINT8  | PROFILE_VALUE, &masterConfig.profile[0].pidProfile.dterm_cut_hz, .config.minmax = {0, 200 } },
     { "yaw_pterm_cut_hz",           VAR_UINT8  | PROFILE_VALUE, &masterConfig.profile[0].pidProfile.yaw_pterm_cut_hz, .config.minmax = {0, 200 } },
 
@@ -664,6 +694,8 @@ const clivalue_t valueTable[] = {
     { "blackbox_rate_num",          VAR_UINT8  | MASTER_VALUE,  &masterConfig.blackbox_rate_num, .config.minmax = { 1,  32 } },
     { "blackbox_rate_denom",        VAR_UINT8  | MASTER_VALUE,  &masterConfig.blackbox_rate_denom, .config.minmax = { 1,  32 } },
     { "blackbox_device",            VAR_UINT8  | MASTER_VALUE | MODE_LOOKUP,  &masterConfig.blackbox_device, .config.lookup = { TABLE_BLACKBOX_DEVICE } },
+    { "blackbox_encoding",          VAR_UINT8  | MASTER_VALUE | MODE_LOOKUP,  &masterConfig.blackbox_encoding, .config.lookup = { TABLE_BLACKBOX_ENCODING } },
+    { "blackbox_flash_ring",        VAR_UINT8  | MASTER_VALUE | MODE_LOOKUP,  &masterConfig.blackbox_flash_ring, .config.lookup = { TABLE_OFF_ON } },
 #endif
 
     { "beeper_off_flags",           VAR_UINT32 | MASTER_VALUE, &masterConfig.beeper_off.flags, .config.minmax = {BEEPER_OFF_FLAGS_MIN, BEEPER_OFF_FLAGS_MAX }},
@@ -1451,14 +1483,35 @@ static void cliFlashInfo(char *cmdline)
 
     printf("Flash sectors=%u, sectorSize=%u, pagesPerSector=%u, pageSize=%u, totalSize=%u, usedSize=%u\r\n",
             layout->sectors, layout->sectorSize, layout->pagesPerSector, layout->pageSize, layout->totalSize, flashfsGetOffset());
+
+    if (!flashfsHasDirectory()) {
+        return;
+    }
+
+    printf("Logs=%d, freeSize=%u\r\n", flashfsGetLogCount(), flashfsGetFreeSpace());
+    for (int i = 0; i < flashfsGetLogCount(); i++) {
+        flashfsLog_t log;
+
+        flashfsGetLog(i, &log);
+        printf("Log %d: start=%u, size=%u\r\n", i, log.start, flashfsGetLogSize(&log));
+    }
 }
 
 static void cliFlashErase(char *cmdline)
 {
-    UNUSED(cmdline);
+    int oldestLogCount = isEmpty(cmdline) ? 0 : atoi(cmdline);
+
+    if (!isEmpty(cmdline) && oldestLogCount <= 0) {
+        cliShowArgumentRangeError("number of oldest logs", 1, FLASHFS_MAX_LOGS);
+        return;
+    }
 
     printf("Erasing...\r\n");
-    flashfsEraseCompletely();
+    if (oldestLogCount > 0) {
+        printf("Erased %d logs.\r\n", flashfsEraseOldestLogs(oldestLogCount));
+    } else {
+        flashfsEraseCompletely();
+    }
 
     while (!flashfsIsReady()) {
         delay(100);
@@ -2155,6 +2208,57 @@ static void cliSetVar(const clivalue_t *var, const int_float_value_t value)
     }
 }
 
+static bool cliParseValue(const clivalue_t *var, const char *text, int_float_value_t *value)
+{
+    switch (var->type & VALUE_MODE_MASK) {
+        case MODE_DIRECT: {
+                int32_t valuei = atoi(text);
+                float valuef = fastA2F(text);
+
+                if (valuef >= var->config.minmax.min && valuef <= var->config.minmax.max) { // note: compare float value
+                    if ((var->type & VALUE_TYPE_MASK) == VAR_FLOAT)
+                        value->float_value = valuef;
+                    else
+                        value->int_value = valuei;
+
+                    return true;
+                }
+            }
+            break;
+        case MODE_LOOKUP: {
+                const lookupTableEntry_t *tableEntry = &lookupTables[var->config.lookup.tableIndex];
+                for (uint8_t tableValueIndex = 0; tableValueIndex < tableEntry->valueCount; tableValueIndex++) {
+                    if (strcasecmp(tableEntry->values[tableValueIndex], text) == 0) {
+                        value->int_value = tableValueIndex;
+                        return true;
+                    }
+                }
+            }
+            break;
+    }
+    return false;
+}
+
+#ifdef LOG_REPLAY
+// Like "set name = value" without any output, for code driving the flight code without a CLI port (SITL log replay)
+bool cliSetValue(const char *name, const char *text)
+{
+    uint32_t i;
+    int_float_value_t value;
+
+    for (i = 0; i < VALUE_COUNT; i++) {
+        if (strcasecmp(name, valueTable[i].name) == 0) {
+            if (!cliParseValue(&valueTable[i], text, &value)) {
+                return false;
+            }
+            cliSetVar(&valueTable[i], value);
+            return true;
+        }
+    }
+    return false;
+}
+#endif
+
 static void cliSet(char *cmdline)
 {
     uint32_t i;
@@ -2192,43 +2296,8 @@ static void cliSet(char *cmdline)
             // ensure exact match when setting to prevent setting variables with shorter names
             if (strncasecmp(cmdline, valueTable[i].name, strlen(valueTable[i].name)) == 0 && variableNameLength == strlen(valueTable[i].name)) {
 
-                bool changeValue = false;
                 int_float_value_t tmp;
-                switch (valueTable[i].type & VALUE_MODE_MASK) {
-                    case MODE_DIRECT: {
-                            int32_t value = 0;
-                            float valuef = 0;
-
-                            value = atoi(eqptr);
-                            valuef = fastA2F(eqptr);
-
-                            if (valuef >= valueTable[i].config.minmax.min && valuef <= valueTable[i].config.minmax.max) { // note: compare float value
-
-                                if ((valueTable[i].type & VALUE_TYPE_MASK) == VAR_FLOAT)
-                                    tmp.float_value = valuef;
-                                else
-                                    tmp.int_value = value;
-
-                                changeValue = true;
-                            }
-                        }
-                        break;
-                    case MODE_LOOKUP: {
-                            const lookupTableEntry_t *tableEntry = &lookupTables[valueTable[i].config.lookup.tableIndex];
-                            bool matched = false;
-                            for (uint8_t tableValueIndex = 0; tableValueIndex < tableEntry->valueCount && !matched; tableValueIndex++) {
-                                matched = strcasecmp(tableEntry->values[tableValueIndex], eqptr) == 0;
-
-                                if (matched) {
-                                    tmp.int_value = tableValueIndex;
-                                    changeValue = true;
-                                }
-                            }
-                        }
-                        break;
-                }
-
-                if (changeValue) {
+                if (cliParseValue(val, eqptr, &tmp)) {
                     cliSetVar(val, tmp);
 
                     printf("%s set to ", valueTable[i].name);
@@ -2314,21 +2383,102 @@ static void cliStatus(char *cmdline)
 #endif
 
     printf("Cycle Time: %d, I2C Errors: %d, config size: %d\r\n", cycleTime, i2cErrorCounter, sizeof(master_t));
+
+#ifdef SERIAL_RX
+    if (feature(FEATURE_RX_SERIAL)) {
+        printf("RX dropped frames: %d\r\n", serialRxFrameDroppedCount());
+    }
+#endif
+
+#ifdef BLACKBOX
+    const blackboxQueueStats_t *blackboxStats = blackboxGetQueueStats();
+
+    printf("Blackbox dropped frames: %d, dropped events: %d, max queued: %d\r\n",
+            blackboxStats->droppedFrames, blackboxStats->droppedEvents, blackboxStats->maxQueued);
+#endif
 }
 
 #ifndef SKIP_TASK_STATISTICS
-static void cliTasks(char *cmdline)
+static const char * const schedulerTraceModeNames[] = {
+    "off", "on", "spike"
+};
+
+static void cliTasksHistogram(void)
 {
-    UNUSED(cmdline);
+    cfTaskId_e taskId;
+    cfTaskInfo_t taskInfo;
+    int i;
 
+    printf("Execution time histogram, runs of at least (us):\r\n");
+    for (i = 0; i < TASK_EXECUTION_TIME_BUCKET_COUNT; i++) {
+        printf("%6d", i ? 1 << (i - 1) : 0);
+    }
+    cliPrint("\r\n");
+
+    for (taskId = 0; taskId < TASK_COUNT; taskId++) {
+        getTaskInfo(taskId, &taskInfo);
+        if (taskInfo.isEnabled) {
+            for (i = 0; i < TASK_EXECUTION_TIME_BUCKET_COUNT; i++) {
+                printf("%6d", taskInfo.executionTimeHistogram[i]);
+            }
+            printf(" %d - %s\r\n", taskId, taskInfo.taskName);
+        }
+    }
+}
+
+static void cliTasksTrace(char *cmdline)
+{
+    schedulerTraceEvent_t events[SCHEDULER_TRACE_SIZE];
+    cfTaskInfo_t taskInfo;
+    uint8_t eventCount;
+    int i;
+
+    if (*cmdline) {
+        for (i = 0; i < (int)ARRAYLEN(schedulerTraceModeNames); i++) {
+            if (strcasecmp(cmdline, schedulerTraceModeNames[i]) == 0) {
+                schedulerSetTraceMode(i);
+                break;
+            }
+        }
+        if (i == (int)ARRAYLEN(schedulerTraceModeNames)) {
+            cliShowParseError();
+            return;
+        }
+    }
+
+    eventCount = getSchedulerTrace(events, SCHEDULER_TRACE_SIZE);
+
+    printf("Scheduler trace (%s), started at, duration:\r\n", schedulerTraceModeNames[getSchedulerTraceMode()]);
+    for (i = 0; i < eventCount; i++) {
+        getTaskInfo(events[i].taskId, &taskInfo);
+        printf("%u us, %d us - %s\r\n", events[i].startedAt, events[i].duration, taskInfo.taskName);
+    }
+}
+
+static void cliTasks(char *cmdline)
+{
     cfTaskId_e taskId;
     cfTaskInfo_t taskInfo;
 
-    printf("Task list:\r\n");
+    if (strncasecmp(cmdline, "hist", 4) == 0) {
+        cliTasksHistogram();
+        return;
+    }
+    if (strncasecmp(cmdline, "trace", 5) == 0) {
+        cmdline += 5;
+        while (*cmdline == ' ') {
+            cmdline++;
+        }
+        cliTasksTrace(cmdline);
+        return;
+    }
+
+    printf("Task list (%s scheduler):\r\n", lookupTableSchedulerMode[getSchedulerMode()]);
     for (taskId = 0; taskId < TASK_COUNT; taskId++) {
         getTaskInfo(taskId, &taskInfo);
         if (taskInfo.isEnabled) {
-            printf("%d - %s, max = %d us, avg = %d us, total = %d ms\r\n", taskId, taskInfo.taskName, taskInfo.maxExecutionTime, taskInfo.averageExecutionTime, taskInfo.totalExecutionTime / 1000);
+            printf("%d - %s, max = %d us, avg = %d us, total = %d ms, late max = %d us, avg = %d us, missed = %d\r\n", taskId, taskInfo.taskName, taskInfo.maxExecutionTime, taskInfo.averageExecutionTime, taskInfo.totalExecutionTime / 1000,
+                taskInfo.maxLateness, taskInfo.averageLateness, taskInfo.deadlineMisses);
         }
     }
 }
@@ -22,5 +22,8 @@ extern uint8_t cliMode;
 
 void cliProcess(void);
 bool cliIsActiveOnPort(serialPort_t *serialPort);
+#ifdef LOG_REPLAY
+bool cliSetValue(const char *name, const char *value);
+#endif
 
 #endif /* CLI_H_ */
@@ -23,6 +23,7 @@
 
 #include "build_config.h"
 #include "debug.h"
+#include "scheduler.h"
 
 #include "platform.h"
 
@@ -54,6 +55,7 @@
 #include "io/serial.h"
 #include "io/ledstrip.h"
 #include "io/flashfs.h"
+#include "io/dataflash_stream.h"
 
 #include "telemetry/telemetry.h"
 
@@ -136,7 +138,7 @@ void useRcControlsConfig(modeActivationCondition_t *modeActivationConditions, es
 #define MSP_PROTOCOL_VERSION                0
 
 #define API_VERSION_MAJOR                   1 // increment when major changes are made
-#define API_VERSION_MINOR                   13 // increment when any change is made, reset to zero when major changes are released after changing API_VERSION_MAJOR
+#define API_VERSION_MINOR                   17 // increment when any change is made, reset to zero when major changes are released after changing API_VERSION_MAJOR
 
 #define API_VERSION_LENGTH                  2
 
@@ -238,6 +240,17 @@ static const char * const boardIdentifier = TARGET_BOARD_IDENTIFIER;
 #define MSP_RXFAIL_CONFIG               77 //out message         Returns RXFAIL settings
 #define MSP_SET_RXFAIL_CONFIG           78 //in message          Sets RXFAIL settings
 
+#define MSP_TASK_STATS                  79 //out message         Returns the scheduler mode and per task execution and deadline statistics
+#define MSP_TASK_HISTOGRAM              80 //out message         Returns the execution time histogram of the task given in the request
+#define MSP_TASK_TRACE                  81 //out message         Returns the scheduler trace, the last tasks run
+
+#define MSP_DATAFLASH_LOGS              82 //out message         Returns the logs in the dataflash directory, from the index given in the request
+#define MSP_DATAFLASH_READ_LOG          83 //out message         Returns content of the log given in the request, from the offset given
+#define MSP_DATAFLASH_ERASE_LOGS        84 //in message          Erases the given number of the oldest logs on the dataflash
+#define MSP_DATAFLASH_STREAM            85 //out message         Starts streaming the range of the dataflash given in the request, returns the range and settings used
+#define MSP_DATAFLASH_STREAM_CHUNK      86 //out message         Sent unrequested while a stream is running, a chunk of the dataflash
+#define MSP_DATAFLASH_STREAM_ACK        87 //in message          Acknowledges the stream chunks before the sequence number given
+
 //
 // Baseflight MSP commands (if enabled they exist in Cleanflight)
 //
@@ -321,6 +334,15 @@ static const char * const boardIdentifier = TARGET_BOARD_IDENTIFIER;
 
 #define INBUF_SIZE 64
 
+#define MSP_TASK_TRACE_MAX_EVENTS 32     // 7 bytes each, keeps the reply under 256 bytes
+#define MSP_DATAFLASH_LOGS_PER_REPLY 16  // 8 bytes each
+
+// Stream chunks go out in jumbo frames, a size byte of 255 followed by the command and a u16 size
+#define MSP_JUMBO_FRAME_SIZE_LIMIT 255
+#define MSP_JUMBO_FRAME_HEADER_SIZE 7
+// Room left in the transmit buffer while streaming, for the replies to the acknowledgements and any other requests
+#define MSP_DATAFLASH_STREAM_TX_RESERVE 64
+
 typedef struct box_e {
     const uint8_t boxId;         // see boxId_e
     const char *boxName;            // GUI-readable box name
@@ -419,9 +441,24 @@ static mspPort_t mspPorts[MAX_MSP_PORT_COUNT];
 
 static mspPort_t *currentPort;
 
+// Replies are put together here and written to the port in one go, only the few longer ones go out in more than one
+#define MSP_REPLY_BUFFER_SIZE 128
+
+static uint8_t mspReplyBuffer[MSP_REPLY_BUFFER_SIZE];
+static uint8_t mspReplyBufferPosition;
+
+static void mspFlushReply(void)
+{
+    serialWriteBuf(mspSerialPort, mspReplyBuffer, mspReplyBufferPosition);
+    mspReplyBufferPosition = 0;
+}
+
 static void serialize8(uint8_t a)
 {
-    serialWrite(mspSerialPort, a);
+    if (mspReplyBufferPosition == MSP_REPLY_BUFFER_SIZE) {
+        mspFlushReply();
+    }
+    mspReplyBuffer[mspReplyBufferPosition++] = a;
     currentPort->checksum ^= a;
 }
 
@@ -479,6 +516,7 @@ static void headSerialError(uint8_t responseBodySize)
 static void tailSerialReply(void)
 {
     serialize8(currentPort->checksum);
+    mspFlushReply();
 }
 
 static void s_struct(uint8_t *cb, uint8_t siz)
@@ -591,6 +629,135 @@ static void serializeDataflashReadReply(uint32_t address, uint8_t size)
         serialize8(buffer[i]);
     }
 }
+
+static void serializeDataflashLogsReply(uint8_t firstLog)
+{
+    int logCount = flashfsGetLogCount();
+    int replyCount = firstLog < logCount ? MIN(logCount - firstLog, MSP_DATAFLASH_LOGS_PER_REPLY) : 0;
+
+    headSerialReply(1 + 4 + 2 + replyCount * 8);
+
+    serialize8(flashfsHasDirectory() ? 1 : 0);
+    serialize32(flashfsGetFreeSpace());
+    serialize8(logCount);
+    serialize8(firstLog);
+
+    for (int i = firstLog; i < firstLog + replyCount; i++) {
+        flashfsLog_t log;
+
+        flashfsGetLog(i, &log);
+        serialize32(log.start);
+        serialize32(flashfsGetLogSize(&log));
+    }
+}
+
+static void serializeDataflashReadLogReply(uint8_t logIndex, uint32_t offset, uint8_t size)
+{
+    uint8_t buffer[128];
+    int bytesRead;
+
+    if (size > sizeof(buffer)) {
+        size = sizeof(buffer);
+    }
+
+    // Reads stop at the end of the log, and at the end of the volume for logs that wrap around it
+    bytesRead = flashfsReadLog(logIndex, offset, buffer, size);
+
+    headSerialReply(1 + 4 + bytesRead);
+
+    serialize8(logIndex);
+    serialize32(offset);
+
+    for (int i = 0; i < bytesRead; i++) {
+        serialize8(buffer[i]);
+    }
+}
+
+static mspPort_t *dataflashStreamPort;
+static uint8_t dataflashStreamFrame[MSP_JUMBO_FRAME_HEADER_SIZE + DATAFLASH_STREAM_MAX_PAYLOAD_SIZE + 1];
+static uint16_t dataflashStreamFrameLength;
+static uint16_t dataflashStreamFramePosition;
+
+static void serializeDataflashStreamReply(void)
+{
+    dataflashStreamConfig_t config;
+
+    config.address = read32();
+    config.length = read32();
+    config.chunkSize = read16();
+    config.window = read8();
+    config.flags = read8();
+
+    dataflashStreamStart(&config);
+    dataflashStreamPort = currentPort;
+
+    headSerialReply(4 + 4 + 2 + 1 + 1);
+    serialize32(config.address);
+    serialize32(config.length);
+    serialize16(config.chunkSize);
+    serialize8(config.window);
+    serialize8(config.flags);
+}
+
+static void mspBuildDataflashStreamFrame(int payloadLength)
+{
+    uint8_t *frame = dataflashStreamFrame;
+    uint8_t checksum = 0;
+
+    frame[0] = '$';
+    frame[1] = 'M';
+    frame[2] = '>';
+    frame[3] = MSP_JUMBO_FRAME_SIZE_LIMIT;
+    frame[4] = MSP_DATAFLASH_STREAM_CHUNK;
+    frame[5] = payloadLength & 0xFF;
+    frame[6] = payloadLength >> 8;
+
+    for (int i = 3; i < MSP_JUMBO_FRAME_HEADER_SIZE + payloadLength; i++) {
+        checksum ^= frame[i];
+    }
+    frame[MSP_JUMBO_FRAME_HEADER_SIZE + payloadLength] = checksum;
+
+    dataflashStreamFrameLength = MSP_JUMBO_FRAME_HEADER_SIZE + payloadLength + 1;
+    dataflashStreamFramePosition = 0;
+}
+
+/*
+ * Sends the chunks of the stream on the port that started it without blocking, as much as the transmit buffer will
+ * take each time round and at most a frame's worth so that ports that never fill up (USB VCP) don't hold up the other
+ * tasks. Returns true while a frame is only part way out, when nothing else may be written to the port.
+ */
+static bool mspProcessDataflashStream(mspPort_t *mspPort)
+{
+    int budget = sizeof(dataflashStreamFrame);
+
+    if (mspPort != dataflashStreamPort) {
+        return false;
+    }
+
+    while (budget > 0) {
+        if (dataflashStreamFramePosition == dataflashStreamFrameLength) {
+            int payloadLength = dataflashStreamNextChunk(dataflashStreamFrame + MSP_JUMBO_FRAME_HEADER_SIZE);
+
+            if (payloadLength == 0) {
+                return false;
+            }
+            mspBuildDataflashStreamFrame(payloadLength);
+        }
+
+        int txFree = serialTxBytesFree(mspPort->port) - MSP_DATAFLASH_STREAM_TX_RESERVE;
+        int count = MIN(MIN(txFree, budget), dataflashStreamFrameLength - dataflashStreamFramePosition);
+
+        if (count <= 0) {
+            break;
+        }
+
+        serialWriteBuf(mspPort->port, dataflashStreamFrame + dataflashStreamFramePosition, count);
+        dataflashStreamFramePosition += count;
+        budget -= count;
+    }
+
+    return dataflashStreamFramePosition < dataflashStreamFrameLength;
+}
 #endif
 
 static void resetMspPort(mspPort_t *mspPortToReset, serialPort_t *serialPort, mspPortUsage_e usage)
@@ -634,6 +801,13 @@ void mspReleasePortIfAllocated(serialPort_t *serialPort)
     for (portIndex = 0; portIndex < MAX_MSP_PORT_COUNT; portIndex++) {
         mspPort_t *candidateMspPort = &mspPorts[portIndex];
         if (candidateMspPort->port == serialPort) {
+#ifdef USE_FLASHFS
+            if (candidateMspPort == dataflashStreamPort) {
+                dataflashStreamStop();
+                dataflashStreamPort = NULL;
+                dataflashStreamFrameLength = dataflashStreamFramePosition = 0;
+            }
+#endif
             closeSerialPort(serialPort);
             memset(candidateMspPort, 0, sizeof(mspPort_t));
         }
@@ -915,6 +1089,7 @@ static bool processOutCommand(uint8_t cmdMSP)
         break;
     case MSP_ATTITUDE:
         headSerialReply(6);
+        imuUpdateEulerAngles();
         serialize16(attitude.values.roll);
         serialize16(attitude.values.pitch);
         serialize16(DECIDEGREES_TO_DEGREES(attitude.values.yaw));
@@ -955,6 +1130,55 @@ static bool processOutCommand(uint8_t cmdMSP)
         headSerialReply(2);
         serialize16((uint16_t)targetLooptime);
         break;
+#ifndef SKIP_TASK_STATISTICS
+    case MSP_TASK_STATS:
+        headSerialReply(2 + TASK_COUNT * 13);
+        serialize8(getSchedulerMode());
+        serialize8(TASK_COUNT);
+        for (i = 0; i < TASK_COUNT; i++) {
+            cfTaskInfo_t taskInfo;
+            getTaskInfo(i, &taskInfo);
+            serialize8(taskInfo.isEnabled);
+            serialize16(MIN(taskInfo.averageExecutionTime, UINT16_MAX));
+            serialize16(MIN(taskInfo.maxExecutionTime, UINT16_MAX));
+            serialize32(taskInfo.deadlineMisses);
+            serialize16(MIN(taskInfo.averageLateness, UINT16_MAX));
+            serialize16(MIN(taskInfo.maxLateness, UINT16_MAX));
+        }
+        break;
+    case MSP_TASK_HISTOGRAM:
+        {
+            cfTaskInfo_t taskInfo;
+            uint8_t taskId = read8();
+
+            if (taskId >= TASK_COUNT) {
+                return false;
+            }
+            getTaskInfo(taskId, &taskInfo);
+            headSerialReply(2 + TASK_EXECUTION_TIME_BUCKET_COUNT * 2);
+            serialize8(taskId);
+            serialize8(TASK_EXECUTION_TIME_BUCKET_COUNT);
+            for (i = 0; i < TASK_EXECUTION_TIME_BUCKET_COUNT; i++) {
+                serialize16(taskInfo.executionTimeHistogram[i]);
+            }
+        }
+        break;
+    case MSP_TASK_TRACE:
+        {
+            schedulerTraceEvent_t events[MSP_TASK_TRACE_MAX_EVENTS];
+            uint8_t eventCount = getSchedulerTrace(events, MSP_TASK_TRACE_MAX_EVENTS);
+
+            headSerialReply(2 + eventCount * 7);
+            serialize8(getSchedulerTraceMode());
+            serialize8(eventCount);
+            for (i = 0; i < eventCount; i++) {
+                serialize8(events[i].taskId);
+                serialize32(events[i].startedAt);
+                serialize16(events[i].duration);
+            }
+        }
+        break;
+#endif
     case MSP_RC_TUNING:
         headSerialReply(11);
         serialize8(currentControlRateProfile->rcRate8);
@@ -1312,6 +1536,27 @@ static bool processOutCommand(uint8_t cmdMSP)
             serializeDataflashReadReply(readAddress, 128);
         }
         break;
+
+    case MSP_DATAFLASH_LOGS:
+        serializeDataflashLogsReply(read8());
+        break;
+
+    case MSP_DATAFLASH_READ_LOG:
+        {
+            uint8_t logIndex = read8();
+            uint32_t offset = read32();
+
+            serializeDataflashReadLogReply(logIndex, offset, 128);
+        }
+        break;
+
+    case MSP_DATAFLASH_STREAM:
+        if (ARMING_FLAG(ARMED)) {
+            headSerialError(0);
+        } else {
+            serializeDataflashStreamReply();
+        }
+        break;
 #endif
 
     case MSP_BF_BUILD_INFO:
@@ -1589,6 +1834,18 @@ static bool processInCommand(void)
     case MSP_DATAFLASH_ERASE:
         flashfsEraseCompletely();
         break;
+
+    case MSP_DATAFLASH_ERASE_LOGS:
+        if (ARMING_FLAG(ARMED)) {
+            headSerialError(0);
+            return true;
+        }
+        flashfsEraseOldestLogs(read8());
+        break;
+
+    case MSP_DATAFLASH_STREAM_ACK:
+        dataflashStreamAck(read16());
+        break;
 #endif
 
 #ifdef GPS
@@ -1937,6 +2194,16 @@ void mspProcess(void)
 
         setCurrentPort(candidatePort);
 
+#ifdef USE_FLASHFS
+        if (ARMING_FLAG(ARMED)) {
+            dataflashStreamStop();
+        }
+        // Requests wait until the chunk part way out is finished, their replies would break it up
+        if (mspProcessDataflashStream(candidatePort)) {
+            continue;
+        }
+#endif
+
         while (serialRxBytesWaiting(mspSerialPort)) {
 
             uint8_t c = serialRead(mspSerialPort);
@@ -552,7 +552,7 @@ void init(void)
 #ifdef SOFTSERIAL_LOOPBACK
 void processLoopback(void) {
     if (loopbackPort) {
-        uint8_t bytesWaiting;
+        uint32_t bytesWaiting;
         while ((bytesWaiting = serialRxBytesWaiting(loopbackPort))) {
             uint8_t b = serialRead(loopbackPort);
             serialWrite(loopbackPort, b);
@@ -567,11 +567,19 @@ int main(void) {
   
     init();
 
+#ifdef LOG_REPLAY
+    if (logReplayEnabled()) {
+        logReplayRun();
+    }
+#endif
+
     /* Setup scheduler */
+    schedulerSetMode(masterConfig.scheduler_mode);
     rescheduleTask(TASK_GYROPID, targetLooptime - INTERRUPT_WAIT_TIME);
 
     setTaskEnabled(TASK_GYROPID, true);
     setTaskEnabled(TASK_ACCEL, sensors(SENSOR_ACC));
+    setTaskEnabled(TASK_ATTITUDE, sensors(SENSOR_ACC));
     setTaskEnabled(TASK_SERIAL, true);
     setTaskEnabled(TASK_BEEPER, true);
     setTaskEnabled(TASK_BATTERY, feature(FEATURE_VBAT) || feature(FEATURE_CURRENT_METER));
@@ -600,6 +608,12 @@ int main(void) {
 #ifdef LED_STRIP
     setTaskEnabled(TASK_LEDSTRIP, feature(FEATURE_LED_STRIP));
 #endif
+#ifdef GYRO_DYNAMIC_NOTCH
+    setTaskEnabled(TASK_GYRO_ANALYSE, true);     // idles when the profile disables the dynamic notch
+#endif
+#ifdef BLACKBOX
+    setTaskEnabled(TASK_BLACKBOX, feature(FEATURE_BLACKBOX));
+#endif
 
     while (1) {
         scheduler();
@@ -50,6 +50,7 @@
 #include "sensors/acceleration.h"
 #include "sensors/barometer.h"
 #include "sensors/gyro.h"
+#include "sensors/gyroanalyse.h"
 #include "sensors/battery.h"
 
 #include "io/beeper.h"
@@ -57,6 +58,7 @@
 #include "io/escservo.h"
 #include "io/rc_controls.h"
 #include "io/rc_curves.h"
+#include "io/rc_smoothing.h"
 #include "io/gimbal.h"
 #include "io/gps.h"
 #include "io/ledstrip.h"
@@ -120,7 +122,6 @@ static uint32_t disarmAt;     // Time of automatic disarm when "Don't spin the m
 extern uint32_t currentTime;
 extern uint8_t dynP8[3], dynI8[3], dynD8[3], PIDweight[3];
 
-static bool isRXDataNew;
 static filterStatePt1_t filteredCycleTimeState;
 uint16_t filteredCycleTime;
 
@@ -174,40 +175,36 @@ bool isCalibrating()
     return (!isAccelerationCalibrationComplete() && sensors(SENSOR_ACC)) || (!isGyroCalibrationComplete());
 }
 
-void filterRc(void){
-    static int16_t lastCommand[4] = { 0, 0, 0, 0 };
-    static int16_t deltaRC[4] = { 0, 0, 0, 0 };
-    static int16_t factor, rcInterpolationFactor;
-    uint16_t rxRefreshRate;
+// rcCommand of the latest RX frame, and where the PID loop is on its way to it with rc_smoothing
+static int16_t rcCommandTarget[RC_SMOOTHING_CHANNEL_COUNT];
+static rcSmoothing_t rcSmoothing;
 
-    // Set RC refresh rate for sampling and channels to filter
-    initRxRefreshRate(&rxRefreshRate);
+static void setRcCommandTargets(void)
+{
+    if (!rcSmoothing.frameInterval || rcSmoothing.type != masterConfig.rxConfig.rcSmoothing) {
+        uint16_t rxRefreshRate;
 
-    rcInterpolationFactor = rxRefreshRate / filteredCycleTime + 1;
+        initRxRefreshRate(&rxRefreshRate);
+        rcSmoothingInit(&rcSmoothing, masterConfig.rxConfig.rcSmoothing, rxRefreshRate, targetLooptime);
+    }
 
-    if (isRXDataNew) {
-        for (int channel=0; channel < 4; channel++) {
-            deltaRC[channel] = rcCommand[channel] -  (lastCommand[channel] - deltaRC[channel] * factor / rcInterpolationFactor);
-            lastCommand[channel] = rcCommand[channel];
-        }
+    rcSmoothingSetTargets(&rcSmoothing, rcCommandTarget, rxGetFrameTime());
+}
 
-        isRXDataNew = false;
-        factor = rcInterpolationFactor - 1;
-    } else {
-        factor--;
-    }
+// Called by the PID loop, which only moves rcCommand towards the targets of the latest frame
+static void interpolateRcCommands(void)
+{
+    rcSmoothingApply(&rcSmoothing, cycleTime);
 
-    // Interpolate steps of rcCommand
-    if (factor > 0) {
-        for (int channel=0; channel < 4; channel++) {
-            rcCommand[channel] = lastCommand[channel] - deltaRC[channel] * factor/rcInterpolationFactor;
-         }
-    } else {
-        factor = 0;
+    // The loop adjusts rcCommand further (alt hold, throttle angle correction), so it starts from the smoothed value every time
+    for (int channel = 0; channel < RC_SMOOTHING_CHANNEL_COUNT; channel++) {
+        rcCommand[channel] = lrintf(rcSmoothing.value[channel]);
+        rcCommandDerivative[channel] = rcSmoothingGetDerivative(&rcSmoothing, channel);
     }
 }
 
-void annexCode(void)
+// Works out rcCommand and the TPA from the sticks, only when processRx() has had a new frame or every 20ms without one
+static void updateRcCommands(void)
 {
     int32_t tmp, tmp2;
     int32_t axis, prop1 = 0, prop2;
@@ -235,7 +232,7 @@ void annexCode(void)
             }
 
             tmp2 = tmp / 100;
-            rcCommand[axis] = lookupPitchRollRC[tmp2] + (tmp - tmp2 * 100) * (lookupPitchRollRC[tmp2 + 1] - lookupPitchRollRC[tmp2]) / 100;
+            rcCommandTarget[axis] = lookupPitchRollRC[tmp2] + (tmp - tmp2 * 100) * (lookupPitchRollRC[tmp2 + 1] - lookupPitchRollRC[tmp2]) / 100;
             prop1 = 100 - (uint16_t)currentControlRateProfile->rates[axis] * tmp / 500;
             prop1 = (uint16_t)prop1 * prop2 / 100;
         } else if (axis == YAW) {
@@ -247,7 +244,7 @@ void annexCode(void)
                 }
             }
             tmp2 = tmp / 100;
-            rcCommand[axis] = (lookupYawRC[tmp2] + (tmp - tmp2 * 100) * (lookupYawRC[tmp2 + 1] - lookupYawRC[tmp2]) / 100) * -masterConfig.yaw_control_direction;
+            rcCommandTarget[axis] = (lookupYawRC[tmp2] + (tmp - tmp2 * 100) * (lookupYawRC[tmp2 + 1] - lookupYawRC[tmp2]) / 100) * -masterConfig.yaw_control_direction;
             prop1 = 100 - (uint16_t)currentControlRateProfile->rates[axis] * ABS(tmp) / 500;
         }
         // FIXME axis indexes into pids.  use something like lookupPidIndex(rc_alias_e alias) to reduce coupling.
@@ -264,27 +261,29 @@ void annexCode(void)
         }
 
         if (rcData[axis] < masterConfig.rxConfig.midrc)
-            rcCommand[axis] = -rcCommand[axis];
+            rcCommandTarget[axis] = -rcCommandTarget[axis];
     }
 
     tmp = constrain(rcData[THROTTLE], masterConfig.rxConfig.mincheck, PWM_RANGE_MAX);
     tmp = (uint32_t)(tmp - masterConfig.rxConfig.mincheck) * PWM_RANGE_MIN / (PWM_RANGE_MAX - masterConfig.rxConfig.mincheck);       // [MINCHECK;2000] -> [0;1000]
     tmp2 = tmp / 100;
-    rcCommand[THROTTLE] = lookupThrottleRC[tmp2] + (tmp - tmp2 * 100) * (lookupThrottleRC[tmp2 + 1] - lookupThrottleRC[tmp2]) / 100;    // [0;1000] -> expo -> [MINTHROTTLE;MAXTHROTTLE]
+    rcCommandTarget[THROTTLE] = lookupThrottleRC[tmp2] + (tmp - tmp2 * 100) * (lookupThrottleRC[tmp2 + 1] - lookupThrottleRC[tmp2]) / 100;    // [0;1000] -> expo -> [MINTHROTTLE;MAXTHROTTLE]
 
     if (FLIGHT_MODE(HEADFREE_MODE)) {
+        imuUpdateEulerAngles();
         float radDiff = degreesToRadians(DECIDEGREES_TO_DEGREES(attitude.values.yaw) - headFreeModeHold);
         float cosDiff = cos_approx(radDiff);
         float sinDiff = sin_approx(radDiff);
-        int16_t rcCommand_PITCH = rcCommand[PITCH] * cosDiff + rcCommand[ROLL] * sinDiff;
-        rcCommand[ROLL] = rcCommand[ROLL] * cosDiff - rcCommand[PITCH] * sinDiff;
-        rcCommand[PITCH] = rcCommand_PITCH;
+        int16_t rcCommand_PITCH = rcCommandTarget[PITCH] * cosDiff + rcCommandTarget[ROLL] * sinDiff;
+        rcCommandTarget[ROLL] = rcCommandTarget[ROLL] * cosDiff - rcCommandTarget[PITCH] * sinDiff;
+        rcCommandTarget[PITCH] = rcCommand_PITCH;
     }
 
-    if (masterConfig.rxConfig.rcSmoothing) {
-        filterRc();
-    }
+    setRcCommandTargets();
+}
 
+static void updateLEDs(void)
+{
     if (ARMING_FLAG(ARMED)) {
         LED0_ON;
     } else {
@@ -309,10 +308,6 @@ void annexCode(void)
 
         warningLedUpdate();
     }
-
-    // Read out gyro temperature. can use it for something somewhere. maybe get MCU temperature instead? lots of fun possibilities.
-    if (gyro.temperature)
-        gyro.temperature(&telemTemperature1);
 }
 
 void mwDisarm(void)
@@ -351,6 +346,7 @@ void mwArm(void)
         }
         if (!ARMING_FLAG(PREVENT_ARMING)) {
             ENABLE_ARMING_FLAG(ARMED);
+            imuUpdateEulerAngles();
             headFreeModeHold = DECIDEGREES_TO_DEGREES(attitude.values.yaw);
 
 #ifdef BLACKBOX
@@ -424,6 +420,8 @@ void updateInflightCalibrationState(void)
 
 void updateMagHold(void)
 {
+    imuUpdateEulerAngles();
+
     if (ABS(rcCommand[YAW]) < 15 && FLIGHT_MODE(MAG_MODE)) {
         int16_t dif = DECIDEGREES_TO_DEGREES(attitude.values.yaw) - magHold;
         if (dif <= -180)
@@ -584,6 +582,7 @@ void processRx(void)
 
 #ifdef  MAG
     if (sensors(SENSOR_ACC) || sensors(SENSOR_MAG)) {
+        imuUpdateEulerAngles();
         if (IS_RC_MODE_ACTIVE(BOXMAG)) {
             if (!FLIGHT_MODE(MAG_MODE)) {
                 ENABLE_FLIGHT_MODE(MAG_MODE);
@@ -638,11 +637,13 @@ void processRx(void)
 }
 
 #if defined(BARO) || defined(SONAR)
-static bool haveProcessedAnnexCodeOnce = false;
+static bool haveInterpolatedRcCommandsOnce = false;
 #endif
 
 void taskMainPidLoop(void)
 {
+    LOOP_STAGE_BEGIN(LOOP_STAGE_TOTAL);
+
     cycleTime = getTaskDeltaTime(TASK_SELF);
     dT = (float)cycleTime * 0.000001f;
 
@@ -655,10 +656,12 @@ void taskMainPidLoop(void)
 
     imuUpdateGyroAndAttitude();
 
-    annexCode();
+    LOOP_STAGE_BEGIN(LOOP_STAGE_RC_COMMAND);
+    interpolateRcCommands();
+    LOOP_STAGE_END(LOOP_STAGE_RC_COMMAND);
 
 #if defined(BARO) || defined(SONAR)
-    haveProcessedAnnexCodeOnce = true;
+    haveInterpolatedRcCommandsOnce = true;
 #endif
 
 #ifdef MAG
@@ -704,6 +707,7 @@ void taskMainPidLoop(void)
 #endif
 
     // PID - note this is function pointer set by setPIDController()
+    LOOP_STAGE_BEGIN(LOOP_STAGE_PID);
     pid_controller(
         &currentProfile->pidProfile,
         currentControlRateProfile,
@@ -711,8 +715,11 @@ void taskMainPidLoop(void)
         &currentProfile->accelerometerTrims,
         &masterConfig.rxConfig
     );
+    LOOP_STAGE_END(LOOP_STAGE_PID);
 
+    LOOP_STAGE_BEGIN(LOOP_STAGE_MIXER);
     mixTable();
+    LOOP_STAGE_END(LOOP_STAGE_MIXER);
 
 #ifdef USE_SERVOS
     filterServos();
@@ -720,29 +727,34 @@ void taskMainPidLoop(void)
 #endif
 
     if (motorControlEnable) {
+        LOOP_STAGE_BEGIN(LOOP_STAGE_MOTORS);
         writeMotors();
+        LOOP_STAGE_END(LOOP_STAGE_MOTORS);
     }
 
 #ifdef BLACKBOX
     if (!cliMode && feature(FEATURE_BLACKBOX)) {
+        LOOP_STAGE_BEGIN(LOOP_STAGE_BLACKBOX);
         handleBlackbox();
+        LOOP_STAGE_END(LOOP_STAGE_BLACKBOX);
     }
 #endif
+
+    LOOP_STAGE_END(LOOP_STAGE_TOTAL);
 }
 
 // Function for loop trigger
-void taskMainPidLoopCheck(void) {
-    // getTaskDeltaTime() returns delta time freezed at the moment of entering the scheduler. currentTime is freezed at the very same point.
-    // To make busy-waiting timeout work we need to account for time spent within busy-waiting loop
-    uint32_t currentDeltaTime = getTaskDeltaTime(TASK_SELF);
-
-    while (1) {
-        if (gyroSyncCheckUpdate() || ((currentDeltaTime + (micros() - currentTime)) >= (targetLooptime + GYRO_WATCHDOG_DELAY))) {
-            break;
-        }
-    }
+bool taskMainPidLoopCheck(uint32_t currentDeltaTime)
+{
+    // The MPU data ready interrupt signals a new gyro sample, the scheduler runs other tasks until it does.
+    // Should the signal stop coming the watchdog keeps the loop running.
+    return gyroSyncCheckUpdate() || (currentDeltaTime >= (targetLooptime + GYRO_WATCHDOG_DELAY));
+}
 
-    taskMainPidLoop();
+// The loop is released by the data ready interrupt, not when the scheduler gets round to polling the flag
+uint32_t taskMainPidLoopSignaledAt(void)
+{
+    return gyroDataReadyAt;
 }
 
 void taskUpdateAccelerometer(void)
@@ -750,6 +762,18 @@ void taskUpdateAccelerometer(void)
     imuUpdateAccelerometer(&currentProfile->accelerometerTrims);
 }
 
+bool taskUpdateAttitudeCheck(uint32_t currentDeltaTime)
+{
+    UNUSED(currentDeltaTime);
+
+    return imuHasNewSamples();
+}
+
+void taskUpdateAttitude(void)
+{
+    imuUpdateAttitudeCorrection();
+}
+
 void taskHandleSerial(void)
 {
     handleSerial();
@@ -790,12 +814,18 @@ bool taskUpdateRxCheck(void)
 
 void taskUpdateRxMain(void)
 {
+    // OK_TO_ARM has to be up to date for the arming in processRx()
+    updateLEDs();
     processRx();
-    isRXDataNew = true;
+    updateRcCommands();
+
+    // Read out gyro temperature. can use it for something somewhere. maybe get MCU temperature instead? lots of fun possibilities.
+    if (gyro.temperature)
+        gyro.temperature(&telemTemperature1);
 
 #ifdef BARO
-    // the 'annexCode' initialses rcCommand, updateAltHoldState depends on valid rcCommand data.
-    if (haveProcessedAnnexCodeOnce) {
+    // the PID loop sets rcCommand, updateAltHoldState depends on valid rcCommand data.
+    if (haveInterpolatedRcCommandsOnce) {
         if (sensors(SENSOR_BARO)) {
             updateAltHoldState();
         }
@@ -803,8 +833,8 @@ void taskUpdateRxMain(void)
 #endif
 
 #ifdef SONAR
-    // the 'annexCode' initialses rcCommand, updateAltHoldState depends on valid rcCommand data.
-    if (haveProcessedAnnexCodeOnce) {
+    // the PID loop sets rcCommand, updateAltHoldState depends on valid rcCommand data.
+    if (haveInterpolatedRcCommandsOnce) {
         if (sensors(SENSOR_SONAR)) {
             updateSonarAltHoldState();
         }
@@ -899,3 +929,21 @@ void taskLedStrip(void)
     }
 }
 #endif
+
+#ifdef GYRO_DYNAMIC_NOTCH
+void taskGyroAnalyse(void)
+{
+    LOOP_STAGE_BEGIN(LOOP_STAGE_GYRO_ANALYSE);
+    gyroDataAnalyseUpdate();
+    LOOP_STAGE_END(LOOP_STAGE_GYRO_ANALYSE);
+}
+#endif
+
+#ifdef BLACKBOX
+void taskBlackbox(void)
+{
+    if (!cliMode && feature(FEATURE_BLACKBOX)) {
+        updateBlackbox();
+    }
+}
+#endif
@@ -42,6 +42,7 @@
 #include "drivers/pwm_rx.h"
 #include "drivers/system.h"
 #include "rx/pwm.h"
+#include "rx/serial_rx_frame.h"
 #include "rx/sbus.h"
 #include "rx/spektrum.h"
 #include "rx/sumd.h"
@@ -75,6 +76,7 @@ static bool rxIsInFailsafeMode = true;
 static bool rxIsInFailsafeModeNotDataDriven = true;
 
 static uint32_t rxUpdateAt = 0;
+static uint32_t rxFrameAt = 0;          // time of the latest frame, for the frame rate
 static uint32_t needRxSignalBefore = 0;
 static uint32_t suspendRxSignalUntil = 0;
 static uint8_t  skipRxSamples = 0;
@@ -236,32 +238,12 @@ void serialRxInit(rxConfig_t *rxConfig)
     }
 }
 
+// Frames of whichever protocol xxxInit() set up, pending when the cli or msp changed serialrx_provider without an init
 uint8_t serialRxFrameStatus(rxConfig_t *rxConfig)
 {
-    /**
-     * FIXME: Each of the xxxxFrameStatus() methods MUST be able to survive being called without the
-     * corresponding xxxInit() method having been called first.
-     *
-     * This situation arises when the cli or the msp changes the value of rxConfig->serialrx_provider
-     *
-     * A solution is for the ___Init() to configure the serialRxFrameStatus function pointer which
-     * should be used instead of the switch statement below.
-     */
-    switch (rxConfig->serialrx_provider) {
-        case SERIALRX_SPEKTRUM1024:
-        case SERIALRX_SPEKTRUM2048:
-            return spektrumFrameStatus();
-        case SERIALRX_SBUS:
-            return sbusFrameStatus();
-        case SERIALRX_SUMD:
-            return sumdFrameStatus();
-        case SERIALRX_SUMH:
-            return sumhFrameStatus();
-        case SERIALRX_XBUS_MODE_B:
-        case SERIALRX_XBUS_MODE_B_RJ01:
-            return xBusFrameStatus();
-    }
-    return SERIAL_RX_FRAME_PENDING;
+    UNUSED(rxConfig);
+
+    return serialRxFramePoll();
 }
 #endif
 
@@ -327,6 +309,7 @@ void updateRx(uint32_t currentTime)
 
         if (frameStatus & SERIAL_RX_FRAME_COMPLETE) {
             rxDataReceived = true;
+            rxFrameAt = currentTime;
             rxIsInFailsafeMode = (frameStatus & SERIAL_RX_FRAME_FAILSAFE) != 0;
             rxSignalReceived = !rxIsInFailsafeMode;
             needRxSignalBefore = currentTime + DELAY_10_HZ;
@@ -338,6 +321,7 @@ void updateRx(uint32_t currentTime)
         rxDataReceived = rxMspFrameComplete();
 
         if (rxDataReceived) {
+            rxFrameAt = currentTime;
             rxSignalReceived = true;
             rxIsInFailsafeMode = false;
             needRxSignalBefore = currentTime + DELAY_5_HZ;
@@ -346,6 +330,7 @@ void updateRx(uint32_t currentTime)
 
     if (feature(FEATURE_RX_PPM)) {
         if (isPPMDataBeingReceived()) {
+            rxFrameAt = currentTime;
             rxSignalReceivedNotDataDriven = true;
             rxIsInFailsafeModeNotDataDriven = false;
             needRxSignalBefore = currentTime + DELAY_10_HZ;
@@ -617,6 +602,12 @@ void updateRSSI(uint32_t currentTime)
     }
 }
 
+// Time updateRx() saw the latest frame, parallel PWM has none and stays at 0
+uint32_t rxGetFrameTime(void)
+{
+    return rxFrameAt;
+}
+
 void initRxRefreshRate(uint16_t *rxRefreshRatePtr) {
     *rxRefreshRatePtr = rxRefreshRate;
 }
@@ -152,6 +152,7 @@ void updateRSSI(uint32_t currentTime);
 void resetAllRxChannelRangeConfigurations(rxChannelRangeConfiguration_t *rxChannelRangeConfiguration);
 
 void initRxRefreshRate(uint16_t *rxRefreshRatePtr);
+uint32_t rxGetFrameTime(void);
 void suspendRxSignal(void);
 void resumeRxSignal(void);
 
@@ -18,6 +18,7 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "platform.h"
 
@@ -33,6 +34,7 @@
 #include "io/serial.h"
 
 #include "rx/rx.h"
+#include "rx/serial_rx_frame.h"
 #include "rx/sbus.h"
 
 /*
@@ -77,154 +79,85 @@ static uint16_t sbusStateFlags = 0;
 #define SBUS_DIGITAL_CHANNEL_MIN 173
 #define SBUS_DIGITAL_CHANNEL_MAX 1812
 
-static bool sbusFrameDone = false;
-static void sbusDataReceive(uint16_t c);
-static uint16_t sbusReadRawRC(rxRuntimeConfig_t *rxRuntimeConfig, uint8_t chan);
+#define SBUS_CHANNEL_COUNT 16       // of 11 bits, the two digital channels are in the flags
+#define SBUS_CHANNEL_BITS 11
+#define SBUS_CHANNEL_MASK ((1 << SBUS_CHANNEL_BITS) - 1)
 
-static uint32_t sbusChannelData[SBUS_MAX_CHANNEL];
-
-bool sbusInit(rxConfig_t *rxConfig, rxRuntimeConfig_t *rxRuntimeConfig, rcReadRawDataPtr *callback)
-{
-    int b;
-    for (b = 0; b < SBUS_MAX_CHANNEL; b++)
-        sbusChannelData[b] = (16 * rxConfig->midrc) / 10 - 1408;
-    if (callback)
-        *callback = sbusReadRawRC;
-    rxRuntimeConfig->channelCount = SBUS_MAX_CHANNEL;
-
-    serialPortConfig_t *portConfig = findSerialPortConfig(FUNCTION_RX_SERIAL);
-    if (!portConfig) {
-        return false;
-    }
-
-    serialPort_t *sBusPort = openSerialPort(portConfig->identifier, FUNCTION_RX_SERIAL, sbusDataReceive, SBUS_BAUDRATE, MODE_RX, SBUS_PORT_OPTIONS);
-
-    return sBusPort != NULL;
-}
+#define SBUS_OFFSET_CHANNELS 1
+#define SBUS_OFFSET_FLAGS 23
 
 #define SBUS_FLAG_CHANNEL_17        (1 << 0)
 #define SBUS_FLAG_CHANNEL_18        (1 << 1)
 #define SBUS_FLAG_SIGNAL_LOSS       (1 << 2)
 #define SBUS_FLAG_FAILSAFE_ACTIVE   (1 << 3)
 
-struct sbusFrame_s {
-    uint8_t syncByte;
-    // 176 bits of data (11 bits per channel * 16 channels) = 22 bytes.
-    unsigned int chan0 : 11;
-    unsigned int chan1 : 11;
-    unsigned int chan2 : 11;
-    unsigned int chan3 : 11;
-    unsigned int chan4 : 11;
-    unsigned int chan5 : 11;
-    unsigned int chan6 : 11;
-    unsigned int chan7 : 11;
-    unsigned int chan8 : 11;
-    unsigned int chan9 : 11;
-    unsigned int chan10 : 11;
-    unsigned int chan11 : 11;
-    unsigned int chan12 : 11;
-    unsigned int chan13 : 11;
-    unsigned int chan14 : 11;
-    unsigned int chan15 : 11;
-    uint8_t flags;
-    /**
-     * The endByte is 0x00 on FrSky and some futaba RX's, on Some SBUS2 RX's the value indicates the telemetry byte that is sent after every 4th sbus frame.
-     *
-     * See https://github.com/cleanflight/cleanflight/issues/590#issuecomment-101027349
-     * and
-     * https://github.com/cleanflight/cleanflight/issues/590#issuecomment-101706023
-     */
-    uint8_t endByte;
-} __attribute__ ((__packed__));
-
-typedef union {
-    uint8_t bytes[SBUS_FRAME_SIZE];
-    struct sbusFrame_s frame;
-} sbusFrame_t;
-
-static sbusFrame_t sbusFrame;
-
-// Receive ISR callback
-static void sbusDataReceive(uint16_t c)
-{
-    static uint8_t sbusFramePosition = 0;
-    static uint32_t sbusFrameStartAt = 0;
-    uint32_t now = micros();
+/*
+ * The frame is the sync byte, 16 channels of 11 bits (22 bytes, least significant bit first), the flags and an end byte.
+ *
+ * The endByte is 0x00 on FrSky and some futaba RX's, on Some SBUS2 RX's the value indicates the telemetry byte that is sent after every 4th sbus frame.
+ *
+ * See https://github.com/cleanflight/cleanflight/issues/590#issuecomment-101027349
+ * and
+ * https://github.com/cleanflight/cleanflight/issues/590#issuecomment-101706023
+ */
 
-    int32_t sbusFrameTime = now - sbusFrameStartAt;
+// Linear fitting values read from OpenTX-ppmus and comparing with values received by X4R, 0.625 * value + 880
+// http://www.wolframalpha.com/input/?i=linear+fit+%7B173%2C+988%7D%2C+%7B1812%2C+2012%7D%2C+%7B993%2C+1500%7D
+static const serialRxScale_t sbusScale = { 5, 3, 880 };
 
-    if (sbusFrameTime > (long)(SBUS_TIME_NEEDED_PER_FRAME + 500)) {
-        sbusFramePosition = 0;
-    }
+const serialRxFrameSpec_t sbusFrameSpec = {
+    .syncByte = SBUS_FRAME_BEGIN_BYTE,
+    .frameSize = SBUS_FRAME_SIZE,
+    .maxFrameTimeUs = SBUS_TIME_NEEDED_PER_FRAME + 500,
+    .unpack = sbusUnpackFrame
+};
 
-    if (sbusFramePosition == 0) {
-        if (c != SBUS_FRAME_BEGIN_BYTE) {
-            return;
-        }
-        sbusFrameStartAt = now;
-    }
+bool sbusInit(rxConfig_t *rxConfig, rxRuntimeConfig_t *rxRuntimeConfig, rcReadRawDataPtr *callback)
+{
+    serialRxFrameInit(&sbusFrameSpec);
 
-    if (sbusFramePosition < SBUS_FRAME_SIZE) {
-        sbusFrame.bytes[sbusFramePosition++] = (uint8_t)c;
-        if (sbusFramePosition < SBUS_FRAME_SIZE) {
-            sbusFrameDone = false;
-        } else {
-            sbusFrameDone = true;
-#ifdef DEBUG_SBUS_PACKETS
-        debug[2] = sbusFrameTime;
-#endif
-        }
+    for (int b = 0; b < SBUS_MAX_CHANNEL; b++) {
+        serialRxChannelData[b] = serialRxScaleValue(&sbusScale, (16 * rxConfig->midrc) / 10 - 1408);
     }
+    if (callback)
+        *callback = serialRxReadRawRC;
+    rxRuntimeConfig->channelCount = SBUS_MAX_CHANNEL;
+
+    return serialRxFrameOpenPort(SBUS_BAUDRATE, SBUS_PORT_OPTIONS) != NULL;
 }
 
-uint8_t sbusFrameStatus(void)
+uint8_t sbusUnpackFrame(const uint8_t *frame, uint8_t length)
 {
-    if (!sbusFrameDone) {
-        return SERIAL_RX_FRAME_PENDING;
+    UNUSED(length);
+
+    // Every channel is within the 32 bits from the byte it starts in, the last one reads up to the flags.
+    // One unaligned little endian load per channel, the Cortex-M3 and M4 do them in hardware.
+    const uint8_t *channels = frame + SBUS_OFFSET_CHANNELS;
+    for (int i = 0; i < SBUS_CHANNEL_COUNT; i++) {
+        const unsigned bit = i * SBUS_CHANNEL_BITS;
+        uint32_t word;
+
+        memcpy(&word, channels + (bit >> 3), sizeof(word));
+        serialRxChannelData[i] = serialRxScaleValue(&sbusScale, (word >> (bit & 7)) & SBUS_CHANNEL_MASK);
     }
-    sbusFrameDone = false;
+
+    const uint8_t flags = frame[SBUS_OFFSET_FLAGS];
 
 #ifdef DEBUG_SBUS_PACKETS
     sbusStateFlags = 0;
-    debug[1] = sbusFrame.frame.flags;
+    debug[1] = flags;
 #endif
 
-    sbusChannelData[0] = sbusFrame.frame.chan0;
-    sbusChannelData[1] = sbusFrame.frame.chan1;
-    sbusChannelData[2] = sbusFrame.frame.chan2;
-    sbusChannelData[3] = sbusFrame.frame.chan3;
-    sbusChannelData[4] = sbusFrame.frame.chan4;
-    sbusChannelData[5] = sbusFrame.frame.chan5;
-    sbusChannelData[6] = sbusFrame.frame.chan6;
-    sbusChannelData[7] = sbusFrame.frame.chan7;
-    sbusChannelData[8] = sbusFrame.frame.chan8;
-    sbusChannelData[9] = sbusFrame.frame.chan9;
-    sbusChannelData[10] = sbusFrame.frame.chan10;
-    sbusChannelData[11] = sbusFrame.frame.chan11;
-    sbusChannelData[12] = sbusFrame.frame.chan12;
-    sbusChannelData[13] = sbusFrame.frame.chan13;
-    sbusChannelData[14] = sbusFrame.frame.chan14;
-    sbusChannelData[15] = sbusFrame.frame.chan15;
-
-    if (sbusFrame.frame.flags & SBUS_FLAG_CHANNEL_17) {
-        sbusChannelData[16] = SBUS_DIGITAL_CHANNEL_MAX;
-    } else {
-        sbusChannelData[16] = SBUS_DIGITAL_CHANNEL_MIN;
-    }
-
-    if (sbusFrame.frame.flags & SBUS_FLAG_CHANNEL_18) {
-        sbusChannelData[17] = SBUS_DIGITAL_CHANNEL_MAX;
-    } else {
-        sbusChannelData[17] = SBUS_DIGITAL_CHANNEL_MIN;
-    }
+    serialRxChannelData[16] = serialRxScaleValue(&sbusScale, (flags & SBUS_FLAG_CHANNEL_17) ? SBUS_DIGITAL_CHANNEL_MAX : SBUS_DIGITAL_CHANNEL_MIN);
+    serialRxChannelData[17] = serialRxScaleValue(&sbusScale, (flags & SBUS_FLAG_CHANNEL_18) ? SBUS_DIGITAL_CHANNEL_MAX : SBUS_DIGITAL_CHANNEL_MIN);
 
-    if (sbusFrame.frame.flags & SBUS_FLAG_SIGNAL_LOSS) {
+    if (flags & SBUS_FLAG_SIGNAL_LOSS) {
 #ifdef DEBUG_SBUS_PACKETS
         sbusStateFlags |= SBUS_STATE_SIGNALLOSS;
         debug[0] = sbusStateFlags;
 #endif
     }
-    if (sbusFrame.frame.flags & SBUS_FLAG_FAILSAFE_ACTIVE) {
+    if (flags & SBUS_FLAG_FAILSAFE_ACTIVE) {
         // internal failsafe enabled and rx failsafe flag set
 #ifdef DEBUG_SBUS_PACKETS
         sbusStateFlags |= SBUS_STATE_FAILSAFE;
@@ -239,11 +172,3 @@ uint8_t sbusFrameStatus(void)
 #endif
     return SERIAL_RX_FRAME_COMPLETE;
 }
-
-static uint16_t sbusReadRawRC(rxRuntimeConfig_t *rxRuntimeConfig, uint8_t chan)
-{
-    UNUSED(rxRuntimeConfig);
-    // Linear fitting values read from OpenTX-ppmus and comparing with values received by X4R
-    // http://www.wolframalpha.com/input/?i=linear+fit+%7B173%2C+988%7D%2C+%7B1812%2C+2012%7D%2C+%7B993%2C+1500%7D
-    return (0.625f * sbusChannelData[chan]) + 880;
-}
@@ -17,4 +17,8 @@
 
 #pragma once
 
-uint8_t sbusFrameStatus(void);
+#include "rx/serial_rx_frame.h"
+
+extern const serialRxFrameSpec_t sbusFrameSpec;
+
+uint8_t sbusUnpackFrame(const uint8_t *frame, uint8_t length);
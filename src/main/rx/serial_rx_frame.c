@@ -0,0 +1,204 @@
+/*
+ * This file is part of Cleanflight.
+ *
+ * Cleanflight is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cleanflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cleanflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Framing shared by the serial receivers. The port hands over what it received, a byte at a time from the
+ * interrupt or a span at a time when it receives by DMA, and the spec of the protocol says where frames start and how long they are.
+ * A whole frame is left in its buffer while the next one goes into the other buffer. The RX task copies it out with
+ * the port interrupts masked, as a frame received meanwhile would flip the buffers, and checks and unpacks the copy.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "platform.h"
+
+#include "build_config.h"
+
+#include "common/atomic.h"
+
+#include "drivers/nvic.h"
+#include "drivers/system.h"
+#include "drivers/serial.h"
+
+#include "io/serial.h"
+
+#include "rx/rx.h"
+#include "rx/serial_rx_frame.h"
+
+uint16_t serialRxChannelData[SERIAL_RX_MAX_CHANNEL_COUNT];
+
+static serialRxFramer_t serialRxFramer;
+
+void serialRxFramerInit(serialRxFramer_t *framer, const serialRxFrameSpec_t *spec)
+{
+    memset(framer, 0, sizeof(*framer));
+    framer->spec = spec;
+    // Without a sync byte a frame can only be told apart by the silence before it
+    framer->awaitingGap = spec->syncByte == SERIAL_RX_FRAME_NO_SYNC;
+}
+
+// data was received at now, the bytes of a span come back to back
+static inline void serialRxFramerReceiveSpan(serialRxFramer_t *framer, const uint8_t *data, uint16_t length, uint32_t now)
+{
+    const serialRxFrameSpec_t *spec = framer->spec;
+
+    if (!spec) {
+        return;
+    }
+
+    if (spec->maxByteGapUs && now - framer->lastByteAt > spec->maxByteGapUs) {
+        framer->position = 0;
+        framer->awaitingGap = false;
+    }
+    if (framer->position && spec->maxFrameTimeUs && now - framer->frameStartAt > spec->maxFrameTimeUs) {
+        framer->position = 0;
+    }
+    framer->lastByteAt = now;
+
+    // In locals, the stores to the frame would have them read back from the framer and the spec for every byte
+    const uint16_t syncByte = spec->syncByte;
+    const uint8_t lengthOffset = spec->lengthOffset;
+    uint8_t *frame = framer->buffer[framer->receiving];
+    uint8_t position = framer->position;
+    uint8_t frameLength = framer->length;
+
+    for (const uint8_t *end = data + length; data < end; data++) {
+        const uint8_t c = *data;
+
+        if (position == 0) {
+            if (syncByte == SERIAL_RX_FRAME_NO_SYNC ? framer->awaitingGap : c != syncByte) {
+                continue;
+            }
+            framer->frameStartAt = now;
+            frameLength = spec->frameSize;
+        }
+
+        frame[position++] = c;
+
+        if (lengthOffset && position == lengthOffset + 1) {
+            frameLength = c * spec->lengthUnit + spec->lengthOverhead;
+            if (frameLength > spec->frameSize || frameLength <= position) {
+                position = 0;
+                continue;
+            }
+        }
+
+        if (position == frameLength) {
+            if (framer->complete) {
+                framer->droppedFrames++;
+            }
+            framer->completeLength[framer->receiving] = frameLength;
+            framer->complete = framer->receiving + 1;
+            framer->receiving ^= 1;
+            frame = framer->buffer[framer->receiving];
+            position = 0;
+            framer->awaitingGap = syncByte == SERIAL_RX_FRAME_NO_SYNC;
+        }
+    }
+
+    framer->position = position;
+    framer->length = frameLength;
+}
+
+void serialRxFramerReceive(serialRxFramer_t *framer, const uint8_t *data, uint16_t length, uint32_t now)
+{
+    serialRxFramerReceiveSpan(framer, data, length, now);
+}
+
+// Unpacks the latest whole frame, if there is one that has not been
+uint8_t serialRxFramerStatus(serialRxFramer_t *framer)
+{
+    uint8_t frame[SERIAL_RX_FRAME_MAX_SIZE];
+    uint8_t length = 0;
+
+    if (!framer->complete || !framer->spec) {
+        return SERIAL_RX_FRAME_PENDING;
+    }
+
+    // The UART and their RX DMA interrupts all share this group priority
+    ATOMIC_BLOCK(NVIC_PRIO_SERIALUART1) {
+        const uint8_t complete = framer->complete;
+
+        if (complete) {
+            length = framer->completeLength[complete - 1];
+            memcpy(frame, framer->buffer[complete - 1], length);
+            framer->complete = 0;
+        }
+    }
+    if (!length) {
+        return SERIAL_RX_FRAME_PENDING;
+    }
+
+    return framer->spec->unpack(frame, length);
+}
+
+void serialRxFrameInit(const serialRxFrameSpec_t *spec)
+{
+    memset(serialRxChannelData, 0, sizeof(serialRxChannelData));
+    serialRxFramerInit(&serialRxFramer, spec);
+}
+
+// Receive ISR callback
+void serialRxFrameDataReceive(uint16_t c)
+{
+    const uint8_t data = c;
+
+    // Inlined for the one byte, the interrupt doesn't go round the loop of a span
+    serialRxFramerReceiveSpan(&serialRxFramer, &data, 1, micros());
+}
+
+// Receive callback of ports that receive by DMA, the span came in ahead of the idle line or half/full buffer interrupt
+void serialRxFrameSpanReceive(const uint8_t *data, uint16_t length)
+{
+    serialRxFramerReceiveSpan(&serialRxFramer, data, length, micros());
+}
+
+serialPort_t *serialRxFrameOpenPort(uint32_t baudRate, portOptions_t options)
+{
+    serialPortConfig_t *portConfig = findSerialPortConfig(FUNCTION_RX_SERIAL);
+    if (!portConfig) {
+        return NULL;
+    }
+
+    serialPort_t *port = openSerialPort(portConfig->identifier, FUNCTION_RX_SERIAL, serialRxFrameDataReceive, baudRate, MODE_RX, options);
+    if (port) {
+        serialSetReceiveSpanCallback(port, serialRxFrameSpanReceive);
+    }
+
+    return port;
+}
+
+uint8_t serialRxFramePoll(void)
+{
+    return serialRxFramerStatus(&serialRxFramer);
+}
+
+uint16_t serialRxFrameDroppedCount(void)
+{
+    return serialRxFramer.droppedFrames;
+}
+
+uint16_t serialRxReadRawRC(rxRuntimeConfig_t *rxRuntimeConfig, uint8_t chan)
+{
+    // The drivers set at most SERIAL_RX_MAX_CHANNEL_COUNT
+    if (chan >= rxRuntimeConfig->channelCount) {
+        return 0;
+    }
+    return serialRxChannelData[chan];
+}
@@ -0,0 +1,84 @@
+/*
+ * This file is part of Cleanflight.
+ *
+ * Cleanflight is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cleanflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cleanflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "drivers/serial.h"
+
+#include "rx/rx.h"
+
+#define SERIAL_RX_FRAME_MAX_SIZE 40      // the largest frame of all protocols, SUMD with 16 channels is 37
+#define SERIAL_RX_MAX_CHANNEL_COUNT 18
+
+#define SERIAL_RX_FRAME_NO_SYNC 0x100    // frames only start after a silence
+
+// Raw channel value to us, (raw * multiplier >> shift) + offset
+typedef struct serialRxScale_s {
+    uint16_t multiplier;
+    uint8_t shift;
+    int16_t offset;
+} serialRxScale_t;
+
+// Checks a whole frame and unpacks its channels, returns SERIAL_RX_FRAME_* of rx.h
+typedef uint8_t (*serialRxFrameUnpackFuncPtr)(const uint8_t *frame, uint8_t length);
+
+// How the bytes of a protocol make up frames
+typedef struct serialRxFrameSpec_s {
+    uint16_t syncByte;          // first byte of every frame, or SERIAL_RX_FRAME_NO_SYNC
+    uint8_t frameSize;          // bytes in a frame, the most there can be when lengthOffset is set
+    uint8_t lengthOffset;       // 0, or the byte with the count of payload units
+    uint8_t lengthUnit;         // bytes per payload unit
+    uint8_t lengthOverhead;     // bytes of the frame besides the payload
+    uint16_t maxByteGapUs;      // a longer silence between bytes starts a new frame
+    uint16_t maxFrameTimeUs;    // 0, or how long a frame may take from its first byte
+    serialRxFrameUnpackFuncPtr unpack;
+} serialRxFrameSpec_t;
+
+// Assembles frames from what the port receives, into one buffer while the other one holds the latest whole frame
+typedef struct serialRxFramer_s {
+    const serialRxFrameSpec_t *spec;
+    uint8_t buffer[2][SERIAL_RX_FRAME_MAX_SIZE];
+    uint8_t completeLength[2];
+    uint8_t receiving;                      // buffer the bytes go to
+    volatile uint8_t complete;              // 1 + the buffer with a whole frame that has not been unpacked, or 0
+    volatile uint16_t droppedFrames;        // whole frames the next one replaced before the RX task took them
+    uint8_t position;
+    uint8_t length;                         // of the frame being received
+    bool awaitingGap;                       // no frame starts before the next silence
+    uint32_t frameStartAt;
+    uint32_t lastByteAt;
+} serialRxFramer_t;
+
+extern uint16_t serialRxChannelData[SERIAL_RX_MAX_CHANNEL_COUNT];
+
+void serialRxFramerInit(serialRxFramer_t *framer, const serialRxFrameSpec_t *spec);
+void serialRxFramerReceive(serialRxFramer_t *framer, const uint8_t *data, uint16_t length, uint32_t now);
+uint8_t serialRxFramerStatus(serialRxFramer_t *framer);
+
+void serialRxFrameInit(const serialRxFrameSpec_t *spec);
+void serialRxFrameDataReceive(uint16_t c);
+void serialRxFrameSpanReceive(const uint8_t *data, uint16_t length);
+serialPort_t *serialRxFrameOpenPort(uint32_t baudRate, portOptions_t options);
+uint8_t serialRxFramePoll(void);
+uint16_t serialRxFrameDroppedCount(void);
+
+static inline uint16_t serialRxScaleValue(const serialRxScale_t *scale, uint32_t value)
+{
+    return ((value * scale->multiplier) >> scale->shift) + scale->offset;
+}
+
+uint16_t serialRxReadRawRC(rxRuntimeConfig_t *rxRuntimeConfig, uint8_t chan);
@@ -22,6 +22,8 @@
 #include "platform.h"
 #include "debug.h"
 
+#include "build_config.h"
+
 #include "drivers/gpio.h"
 #include "drivers/system.h"
 
@@ -34,6 +36,7 @@
 #include "config/config.h"
 
 #include "rx/rx.h"
+#include "rx/serial_rx_frame.h"
 #include "rx/spektrum.h"
 
 // driver for spektrum satellite receiver / sbus
@@ -48,112 +51,68 @@
 
 static uint8_t spek_chan_shift;
 static uint8_t spek_chan_mask;
-static bool rcFrameComplete = false;
-static bool spekHiRes = false;
-
-static volatile uint8_t spekFrame[SPEK_FRAME_SIZE];
 
-static void spektrumDataReceive(uint16_t c);
-static uint16_t spektrumReadRawRC(rxRuntimeConfig_t *rxRuntimeConfig, uint8_t chan);
+static const serialRxScale_t spektrum2048Scale = { 1, 1, 988 };
+static const serialRxScale_t spektrum1024Scale = { 1, 0, 988 };
+static const serialRxScale_t *spektrumScale = &spektrum1024Scale;
 
 static rxRuntimeConfig_t *rxRuntimeConfigPtr;
 
+// Frames only have a fades count and system byte up front, a new one starts after the silence between them
+const serialRxFrameSpec_t spektrumFrameSpec = {
+    .syncByte = SERIAL_RX_FRAME_NO_SYNC,
+    .frameSize = SPEK_FRAME_SIZE,
+    .maxByteGapUs = 5000,
+    .unpack = spektrumUnpackFrame
+};
+
 bool spektrumInit(rxConfig_t *rxConfig, rxRuntimeConfig_t *rxRuntimeConfig, rcReadRawDataPtr *callback)
 {
     rxRuntimeConfigPtr = rxRuntimeConfig;
 
+    serialRxFrameInit(&spektrumFrameSpec);
+
     switch (rxConfig->serialrx_provider) {
         case SERIALRX_SPEKTRUM2048:
             // 11 bit frames
             spek_chan_shift = 3;
             spek_chan_mask = 0x07;
-            spekHiRes = true;
+            spektrumScale = &spektrum2048Scale;
             rxRuntimeConfig->channelCount = SPEKTRUM_2048_CHANNEL_COUNT;
             break;
         case SERIALRX_SPEKTRUM1024:
             // 10 bit frames
             spek_chan_shift = 2;
             spek_chan_mask = 0x03;
-            spekHiRes = false;
+            spektrumScale = &spektrum1024Scale;
             rxRuntimeConfig->channelCount = SPEKTRUM_1024_CHANNEL_COUNT;
             break;
     }
 
-    if (callback)
-        *callback = spektrumReadRawRC;
-
-    serialPortConfig_t *portConfig = findSerialPortConfig(FUNCTION_RX_SERIAL);
-    if (!portConfig) {
-        return false;
+    for (int b = 0; b < SPEKTRUM_MAX_SUPPORTED_CHANNEL_COUNT; b++) {
+        serialRxChannelData[b] = serialRxScaleValue(spektrumScale, 0);
     }
 
-    serialPort_t *spektrumPort = openSerialPort(portConfig->identifier, FUNCTION_RX_SERIAL, spektrumDataReceive, SPEKTRUM_BAUDRATE, MODE_RX, SERIAL_NOT_INVERTED);
-
-    return spektrumPort != NULL;
-}
-
-// Receive ISR callback
-static void spektrumDataReceive(uint16_t c)
-{
-    uint32_t spekTime;
-    static uint32_t spekTimeLast, spekTimeInterval;
-    static uint8_t spekFramePosition;
-
-    spekTime = micros();
-    spekTimeInterval = spekTime - spekTimeLast;
-    spekTimeLast = spekTime;
-    if (spekTimeInterval > 5000) {
-        spekFramePosition = 0;
-    }
+    if (callback)
+        *callback = serialRxReadRawRC;
 
-    if (spekFramePosition < SPEK_FRAME_SIZE) {
-        spekFrame[spekFramePosition++] = (uint8_t)c;
-        if (spekFramePosition < SPEK_FRAME_SIZE) {
-            rcFrameComplete = false;
-        } else {
-            rcFrameComplete = true;
-        }
-    }
+    return serialRxFrameOpenPort(SPEKTRUM_BAUDRATE, SERIAL_NOT_INVERTED) != NULL;
 }
 
-static uint32_t spekChannelData[SPEKTRUM_MAX_SUPPORTED_CHANNEL_COUNT];
-
-uint8_t spektrumFrameStatus(void)
+uint8_t spektrumUnpackFrame(const uint8_t *frame, uint8_t length)
 {
-    uint8_t b;
+    UNUSED(length);
 
-    if (!rcFrameComplete) {
-        return SERIAL_RX_FRAME_PENDING;
-    }
-
-    rcFrameComplete = false;
-
-    for (b = 3; b < SPEK_FRAME_SIZE; b += 2) {
-        uint8_t spekChannel = 0x0F & (spekFrame[b - 1] >> spek_chan_shift);
+    for (int b = 3; b < SPEK_FRAME_SIZE; b += 2) {
+        uint8_t spekChannel = 0x0F & (frame[b - 1] >> spek_chan_shift);
         if (spekChannel < rxRuntimeConfigPtr->channelCount && spekChannel < SPEKTRUM_MAX_SUPPORTED_CHANNEL_COUNT) {
-            spekChannelData[spekChannel] = ((uint32_t)(spekFrame[b - 1] & spek_chan_mask) << 8) + spekFrame[b];
+            serialRxChannelData[spekChannel] = serialRxScaleValue(spektrumScale, ((uint32_t)(frame[b - 1] & spek_chan_mask) << 8) + frame[b]);
         }
     }
 
     return SERIAL_RX_FRAME_COMPLETE;
 }
 
-static uint16_t spektrumReadRawRC(rxRuntimeConfig_t *rxRuntimeConfig, uint8_t chan)
-{
-    uint16_t data;
-
-    if (chan >= rxRuntimeConfig->channelCount) {
-        return 0;
-    }
-
-    if (spekHiRes)
-        data = 988 + (spekChannelData[chan] >> 1);   // 2048 mode
-    else
-        data = 988 + spekChannelData[chan];          // 1024 mode
-
-    return data;
-}
-
 #ifdef SPEKTRUM_BIND
 
 bool spekShouldBind(uint8_t spektrum_sat_bind)
@@ -17,7 +17,11 @@
 
 #pragma once
 
+#include "rx/serial_rx_frame.h"
+
 #define SPEKTRUM_SAT_BIND_DISABLED 0
 #define SPEKTRUM_SAT_BIND_MAX 10
 
-uint8_t spektrumFrameStatus(void);
+extern const serialRxFrameSpec_t spektrumFrameSpec;
+
+uint8_t spektrumUnpackFrame(const uint8_t *frame, uint8_t length);
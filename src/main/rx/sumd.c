@@ -30,6 +30,7 @@
 #include "io/serial.h"
 
 #include "rx/rx.h"
+#include "rx/serial_rx_frame.h"
 #include "rx/sumd.h"
 
 // driver for SUMD receiver using UART2
@@ -42,36 +43,46 @@
 
 #define SUMD_BAUDRATE 115200
 
-static bool sumdFrameDone = false;
-static uint16_t sumdChannels[SUMD_MAX_CHANNEL];
-static uint16_t crc;
+#define SUMD_OFFSET_STATE 1
+#define SUMD_OFFSET_CHANNEL_COUNT 2
+#define SUMD_OFFSET_CHANNEL_1_HIGH 3
+#define SUMD_OFFSET_CHANNEL_1_LOW 4
+#define SUMD_BYTES_PER_CHANNEL 2
+#define SUMD_FRAME_OVERHEAD 5           // sync, state, channel count and the CRC
 
-static void sumdDataReceive(uint16_t c);
-static uint16_t sumdReadRawRC(rxRuntimeConfig_t *rxRuntimeConfig, uint8_t chan);
+#define SUMD_FRAME_STATE_OK 0x01
+#define SUMD_FRAME_STATE_FAILSAFE 0x81
+
+static const serialRxScale_t sumdScale = { 1, 3, 0 };      // 1/8 us
+
+const serialRxFrameSpec_t sumdFrameSpec = {
+    .syncByte = SUMD_SYNCBYTE,
+    .frameSize = SUMD_BUFFSIZE,
+    .lengthOffset = SUMD_OFFSET_CHANNEL_COUNT,
+    .lengthUnit = SUMD_BYTES_PER_CHANNEL,
+    .lengthOverhead = SUMD_FRAME_OVERHEAD,
+    .maxByteGapUs = 4000,
+    .unpack = sumdUnpackFrame
+};
 
 bool sumdInit(rxConfig_t *rxConfig, rxRuntimeConfig_t *rxRuntimeConfig, rcReadRawDataPtr *callback)
 {
     UNUSED(rxConfig);
 
+    serialRxFrameInit(&sumdFrameSpec);
+
     if (callback)
-        *callback = sumdReadRawRC;
+        *callback = serialRxReadRawRC;
 
     rxRuntimeConfig->channelCount = SUMD_MAX_CHANNEL;
 
-    serialPortConfig_t *portConfig = findSerialPortConfig(FUNCTION_RX_SERIAL);
-    if (!portConfig) {
-        return false;
-    }
-
-    serialPort_t *sumdPort = openSerialPort(portConfig->identifier, FUNCTION_RX_SERIAL, sumdDataReceive, SUMD_BAUDRATE, MODE_RX, SERIAL_NOT_INVERTED);
-
-    return sumdPort != NULL;
+    return serialRxFrameOpenPort(SUMD_BAUDRATE, SERIAL_NOT_INVERTED) != NULL;
 }
 
 #define CRC_POLYNOME 0x1021
 
 // CRC calculation, adds a 8 bit unsigned to 16 bit crc
-static void CRC16(uint8_t value)
+static uint16_t CRC16(uint16_t crc, uint8_t value)
 {
     uint8_t i;
 
@@ -82,72 +93,24 @@ static void CRC16(uint8_t value)
     else
         crc = (crc << 1);
     }
+    return crc;
 }
 
-static uint8_t sumd[SUMD_BUFFSIZE] = { 0, };
-static uint8_t sumdChannelCount;
-
-// Receive ISR callback
-static void sumdDataReceive(uint16_t c)
+// The framer has checked the length against the channel count, so there are at most SUMD_MAX_CHANNEL
+uint8_t sumdUnpackFrame(const uint8_t *frame, uint8_t length)
 {
-    uint32_t sumdTime;
-    static uint32_t sumdTimeLast;
-    static uint8_t sumdIndex;
-
-    sumdTime = micros();
-    if ((sumdTime - sumdTimeLast) > 4000)
-        sumdIndex = 0;
-    sumdTimeLast = sumdTime;
-
-    if (sumdIndex == 0) {
-        if (c != SUMD_SYNCBYTE)
-            return;
-        else
-        {
-            sumdFrameDone = false; // lazy main loop didnt fetch the stuff
-            crc = 0;
-        }
-    }
-    if (sumdIndex == 2)
-        sumdChannelCount = (uint8_t)c;
-    if (sumdIndex < SUMD_BUFFSIZE)
-        sumd[sumdIndex] = (uint8_t)c;
-    sumdIndex++;
-    if (sumdIndex < sumdChannelCount * 2 + 4)
-        CRC16((uint8_t)c);
-    else
-        if (sumdIndex == sumdChannelCount * 2 + 5) {
-            sumdIndex = 0;
-            sumdFrameDone = true;
-        }
-}
-
-#define SUMD_OFFSET_CHANNEL_1_HIGH 3
-#define SUMD_OFFSET_CHANNEL_1_LOW 4
-#define SUMD_BYTES_PER_CHANNEL 2
-
-
-#define SUMD_FRAME_STATE_OK 0x01
-#define SUMD_FRAME_STATE_FAILSAFE 0x81
-
-uint8_t sumdFrameStatus(void)
-{
-    uint8_t channelIndex;
-
     uint8_t frameStatus = SERIAL_RX_FRAME_PENDING;
+    const uint8_t channelCount = frame[SUMD_OFFSET_CHANNEL_COUNT];
+    uint16_t crc = 0;
 
-    if (!sumdFrameDone) {
-        return frameStatus;
+    // verify CRC, of everything but the CRC at the end
+    for (int i = 0; i < length - 2; i++) {
+        crc = CRC16(crc, frame[i]);
     }
-
-    sumdFrameDone = false;
-
-    // verify CRC
-    if (crc != ((sumd[SUMD_BYTES_PER_CHANNEL * sumdChannelCount + SUMD_OFFSET_CHANNEL_1_HIGH] << 8) |
-            (sumd[SUMD_BYTES_PER_CHANNEL * sumdChannelCount + SUMD_OFFSET_CHANNEL_1_LOW])))
+    if (crc != ((frame[length - 2] << 8) | frame[length - 1]))
         return frameStatus;
 
-    switch (sumd[1]) {
+    switch (frame[SUMD_OFFSET_STATE]) {
         case SUMD_FRAME_STATE_FAILSAFE:
             frameStatus = SERIAL_RX_FRAME_COMPLETE | SERIAL_RX_FRAME_FAILSAFE;
             break;
@@ -158,20 +121,11 @@ uint8_t sumdFrameStatus(void)
             return frameStatus;
     }
 
-    if (sumdChannelCount > SUMD_MAX_CHANNEL)
-        sumdChannelCount = SUMD_MAX_CHANNEL;
-
-    for (channelIndex = 0; channelIndex < sumdChannelCount; channelIndex++) {
-        sumdChannels[channelIndex] = (
-            (sumd[SUMD_BYTES_PER_CHANNEL * channelIndex + SUMD_OFFSET_CHANNEL_1_HIGH] << 8) |
-            sumd[SUMD_BYTES_PER_CHANNEL * channelIndex + SUMD_OFFSET_CHANNEL_1_LOW]
+    for (int channelIndex = 0; channelIndex < channelCount; channelIndex++) {
+        serialRxChannelData[channelIndex] = serialRxScaleValue(&sumdScale,
+            (frame[SUMD_BYTES_PER_CHANNEL * channelIndex + SUMD_OFFSET_CHANNEL_1_HIGH] << 8) |
+            frame[SUMD_BYTES_PER_CHANNEL * channelIndex + SUMD_OFFSET_CHANNEL_1_LOW]
         );
     }
     return frameStatus;
 }
-
-static uint16_t sumdReadRawRC(rxRuntimeConfig_t *rxRuntimeConfig, uint8_t chan)
-{
-    UNUSED(rxRuntimeConfig);
-    return sumdChannels[chan] / 8;
-}
@@ -17,4 +17,8 @@
 
 #pragma once
 
-uint8_t sumdFrameStatus(void);
+#include "rx/serial_rx_frame.h"
+
+extern const serialRxFrameSpec_t sumdFrameSpec;
+
+uint8_t sumdUnpackFrame(const uint8_t *frame, uint8_t length);
@@ -36,6 +36,7 @@
 #include "io/serial.h"
 
 #include "rx/rx.h"
+#include "rx/serial_rx_frame.h"
 #include "rx/sumh.h"
 
 // driver for SUMH receiver using UART2
@@ -44,93 +45,46 @@
 
 #define SUMH_MAX_CHANNEL_COUNT 8
 #define SUMH_FRAME_SIZE 21
+#define SUMH_SYNCBYTE 0xA8
 
-static bool sumhFrameDone = false;
-
-static uint8_t sumhFrame[SUMH_FRAME_SIZE];
-static uint32_t sumhChannels[SUMH_MAX_CHANNEL_COUNT];
-
-static void sumhDataReceive(uint16_t c);
-static uint16_t sumhReadRawRC(rxRuntimeConfig_t *rxRuntimeConfig, uint8_t chan);
-
-static serialPort_t *sumhPort;
-
-
-static void sumhDataReceive(uint16_t c);
-static uint16_t sumhReadRawRC(rxRuntimeConfig_t *rxRuntimeConfig, uint8_t chan);
+#define SUMH_OFFSET_CHANNEL_1_HIGH 3
+#define SUMH_OFFSET_CHANNEL_1_LOW 4
 
+static const serialRxScale_t sumhScale = { 5, 5, -375 };   // value / 6.4 - 375
 
+const serialRxFrameSpec_t sumhFrameSpec = {
+    .syncByte = SUMH_SYNCBYTE,
+    .frameSize = SUMH_FRAME_SIZE,
+    .maxByteGapUs = 5000,
+    .unpack = sumhUnpackFrame
+};
 
 bool sumhInit(rxConfig_t *rxConfig, rxRuntimeConfig_t *rxRuntimeConfig, rcReadRawDataPtr *callback)
 {
     UNUSED(rxConfig);
 
+    serialRxFrameInit(&sumhFrameSpec);
+
     if (callback)
-        *callback = sumhReadRawRC;
+        *callback = serialRxReadRawRC;
 
     rxRuntimeConfig->channelCount = SUMH_MAX_CHANNEL_COUNT;
 
-    serialPortConfig_t *portConfig = findSerialPortConfig(FUNCTION_RX_SERIAL);
-    if (!portConfig) {
-        return false;
-    }
-
-    sumhPort = openSerialPort(portConfig->identifier, FUNCTION_RX_SERIAL, sumhDataReceive, SUMH_BAUDRATE, MODE_RX, SERIAL_NOT_INVERTED);
-
-    return sumhPort != NULL;
+    return serialRxFrameOpenPort(SUMH_BAUDRATE, SERIAL_NOT_INVERTED) != NULL;
 }
 
-// Receive ISR callback
-static void sumhDataReceive(uint16_t c)
+uint8_t sumhUnpackFrame(const uint8_t *frame, uint8_t length)
 {
-    uint32_t sumhTime;
-    static uint32_t sumhTimeLast, sumhTimeInterval;
-    static uint8_t sumhFramePosition;
-
-    sumhTime = micros();
-    sumhTimeInterval = sumhTime - sumhTimeLast;
-    sumhTimeLast = sumhTime;
-    if (sumhTimeInterval > 5000) {
-        sumhFramePosition = 0;
-    }
-
-    sumhFrame[sumhFramePosition] = (uint8_t) c;
-    if (sumhFramePosition == SUMH_FRAME_SIZE - 1) {
-        // FIXME at this point the value of 'c' is unused and un tested, what should it be, is it important?
-        sumhFrameDone = true;
-    } else {
-        sumhFramePosition++;
-    }
-}
+    UNUSED(length);
 
-uint8_t sumhFrameStatus(void)
-{
-    uint8_t channelIndex;
-
-    if (!sumhFrameDone) {
-        return SERIAL_RX_FRAME_PENDING;
-    }
-
-    sumhFrameDone = false;
-
-    if (!((sumhFrame[0] == 0xA8) && (sumhFrame[SUMH_FRAME_SIZE - 2] == 0))) {
+    // FIXME the last byte is unused and un tested, what should it be, is it important?
+    if (!((frame[0] == SUMH_SYNCBYTE) && (frame[SUMH_FRAME_SIZE - 2] == 0))) {
         return SERIAL_RX_FRAME_PENDING;
     }
 
-    for (channelIndex = 0; channelIndex < SUMH_MAX_CHANNEL_COUNT; channelIndex++) {
-        sumhChannels[channelIndex] = (((uint32_t)(sumhFrame[(channelIndex << 1) + 3]) << 8)
-                + sumhFrame[(channelIndex << 1) + 4]) / 6.4f - 375;
+    for (int channelIndex = 0; channelIndex < SUMH_MAX_CHANNEL_COUNT; channelIndex++) {
+        serialRxChannelData[channelIndex] = serialRxScaleValue(&sumhScale,
+            ((uint32_t)frame[(channelIndex << 1) + SUMH_OFFSET_CHANNEL_1_HIGH] << 8) + frame[(channelIndex << 1) + SUMH_OFFSET_CHANNEL_1_LOW]);
     }
     return SERIAL_RX_FRAME_COMPLETE;
 }
-
-static uint16_t sumhReadRawRC(rxRuntimeConfig_t *rxRuntimeConfig, uint8_t chan)
-{
-    UNUSED(rxRuntimeConfig);
-
-    if (chan >= SUMH_MAX_CHANNEL_COUNT) {
-        return 0;
-    }
-
-    return sumhChannels[chan];
-}
@@ -17,4 +17,8 @@
 
 #pragma once
 
-uint8_t sumhFrameStatus(void);
+#include "rx/serial_rx_frame.h"
+
+extern const serialRxFrameSpec_t sumhFrameSpec;
+
+uint8_t sumhUnpackFrame(const uint8_t *frame, uint8_t length);
@@ -21,6 +21,8 @@
 
 #include "platform.h"
 
+#include "build_config.h"
+
 #include "drivers/system.h"
 
 #include "drivers/serial.h"
@@ -28,6 +30,7 @@
 #include "io/serial.h"
 
 #include "rx/rx.h"
+#include "rx/serial_rx_frame.h"
 #include "rx/xbus.h"
 
 //
@@ -67,22 +70,21 @@
 //      2200µs -> 0xFFF
 // Total range is: 2200 - 800 = 1400 <==> 4095
 // Use formula: 800 + value * 1400 / 4096 (i.e. a shift by 12)
-#define XBUS_CONVERT_TO_USEC(V)	(800 + ((V * 1400) >> 12))
-
-static bool xBusFrameReceived = false;
-static bool xBusDataIncoming = false;
-static uint8_t xBusFramePosition;
-static uint8_t xBusFrameLength;
-static uint8_t xBusChannelCount;
-static uint8_t xBusProvider;
-
-
-// Use max values for ram areas
-static volatile uint8_t xBusFrame[XBUS_RJ01_FRAME_SIZE];
-static uint16_t xBusChannelData[XBUS_RJ01_CHANNEL_COUNT];
-
-static void xBusDataReceive(uint16_t c);
-static uint16_t xBusReadRawRC(rxRuntimeConfig_t *rxRuntimeConfig, uint8_t chan);
+static const serialRxScale_t xBusScale = { 1400, 12, 800 };
+
+const serialRxFrameSpec_t xBusModeBFrameSpec = {
+    .syncByte = XBUS_START_OF_FRAME_BYTE,
+    .frameSize = XBUS_FRAME_SIZE,
+    .maxByteGapUs = XBUS_MAX_FRAME_TIME,
+    .unpack = xBusUnpackModeBFrame
+};
+
+const serialRxFrameSpec_t xBusRj01FrameSpec = {
+    .syncByte = XBUS_START_OF_FRAME_BYTE,
+    .frameSize = XBUS_RJ01_FRAME_SIZE,
+    .maxByteGapUs = XBUS_MAX_FRAME_TIME,
+    .unpack = xBusUnpackRJ01Frame
+};
 
 bool xBusInit(rxConfig_t *rxConfig, rxRuntimeConfig_t *rxRuntimeConfig, rcReadRawDataPtr *callback)
 {
@@ -91,23 +93,13 @@ bool xBusInit(rxConfig_t *rxConfig, rxRuntimeConfig_t *rxRuntimeConfig, rcReadRa
     switch (rxConfig->serialrx_provider) {
         case SERIALRX_XBUS_MODE_B:
             rxRuntimeConfig->channelCount = XBUS_CHANNEL_COUNT;
-            xBusFrameReceived = false;
-            xBusDataIncoming = false;
-            xBusFramePosition = 0;
             baudRate = XBUS_BAUDRATE;
-            xBusFrameLength = XBUS_FRAME_SIZE;
-            xBusChannelCount = XBUS_CHANNEL_COUNT;
-            xBusProvider = SERIALRX_XBUS_MODE_B;
+            serialRxFrameInit(&xBusModeBFrameSpec);
             break;
         case SERIALRX_XBUS_MODE_B_RJ01:
             rxRuntimeConfig->channelCount = XBUS_RJ01_CHANNEL_COUNT;
-            xBusFrameReceived = false;
-            xBusDataIncoming = false;
-            xBusFramePosition = 0;
             baudRate = XBUS_RJ01_BAUDRATE;
-            xBusFrameLength = XBUS_RJ01_FRAME_SIZE;
-            xBusChannelCount = XBUS_RJ01_CHANNEL_COUNT;
-            xBusProvider = SERIALRX_XBUS_MODE_B_RJ01;
+            serialRxFrameInit(&xBusRj01FrameSpec);
             break;
         default:
             return false;
@@ -115,17 +107,10 @@ bool xBusInit(rxConfig_t *rxConfig, rxRuntimeConfig_t *rxRuntimeConfig, rcReadRa
     }
 
     if (callback) {
-        *callback = xBusReadRawRC;
+        *callback = serialRxReadRawRC;
     }
 
-    serialPortConfig_t *portConfig = findSerialPortConfig(FUNCTION_RX_SERIAL);
-    if (!portConfig) {
-        return false;
-    }
-
-    serialPort_t *xBusPort = openSerialPort(portConfig->identifier, FUNCTION_RX_SERIAL, xBusDataReceive, baudRate, MODE_RX, SERIAL_NOT_INVERTED);
-
-    return xBusPort != NULL;
+    return serialRxFrameOpenPort(baudRate, SERIAL_NOT_INVERTED) != NULL;
 }
 
 // The xbus mode B CRC calculations
@@ -169,7 +154,7 @@ uint8_t xBusRj01CRC8(uint8_t inData, uint8_t seed)
 }
 
 
-static void xBusUnpackModeBFrame(uint8_t offsetBytes)
+static uint8_t xBusUnpackEmbeddedModeBFrame(const uint8_t *xBusFrame)
 {
     // Calculate the CRC of the incoming frame
     uint16_t crc = 0;
@@ -180,31 +165,39 @@ static void xBusUnpackModeBFrame(uint8_t offsetBytes)
 
     // Calculate on all bytes except the final two CRC bytes
     for (i = 0; i < XBUS_FRAME_SIZE - 2; i++) {
-        inCrc = xBusCRC16(inCrc, xBusFrame[i+offsetBytes]);
+        inCrc = xBusCRC16(inCrc, xBusFrame[i]);
     }
 
     // Get the received CRC
-    crc = ((uint16_t)xBusFrame[offsetBytes + XBUS_FRAME_SIZE - 2]) << 8;
-    crc = crc + ((uint16_t)xBusFrame[offsetBytes + XBUS_FRAME_SIZE - 1]);
+    crc = ((uint16_t)xBusFrame[XBUS_FRAME_SIZE - 2]) << 8;
+    crc = crc + ((uint16_t)xBusFrame[XBUS_FRAME_SIZE - 1]);
 
-    if (crc == inCrc) {
-        // Unpack the data, we have a valid frame
-        for (i = 0; i < xBusChannelCount; i++) {
+    if (crc != inCrc) {
+        return SERIAL_RX_FRAME_PENDING;
+    }
 
-            frameAddr = offsetBytes + 1 + i * 2;
-            value = ((uint16_t)xBusFrame[frameAddr]) << 8;
-            value = value + ((uint16_t)xBusFrame[frameAddr + 1]);
+    // Unpack the data, we have a valid frame
+    for (i = 0; i < XBUS_CHANNEL_COUNT; i++) {
 
-            // Convert to internal format
-            xBusChannelData[i] = XBUS_CONVERT_TO_USEC(value);
-        }
+        frameAddr = 1 + i * 2;
+        value = ((uint16_t)xBusFrame[frameAddr]) << 8;
+        value = value + ((uint16_t)xBusFrame[frameAddr + 1]);
 
-        xBusFrameReceived = true;
+        // Convert to internal format
+        serialRxChannelData[i] = serialRxScaleValue(&xBusScale, value);
     }
 
+    return SERIAL_RX_FRAME_COMPLETE;
+}
+
+uint8_t xBusUnpackModeBFrame(const uint8_t *frame, uint8_t length)
+{
+    UNUSED(length);
+
+    return xBusUnpackEmbeddedModeBFrame(frame);
 }
 
-static void xBusUnpackRJ01Frame(void)
+uint8_t xBusUnpackRJ01Frame(const uint8_t *xBusFrame, uint8_t length)
 {
     // Calculate the CRC of the incoming frame
     uint8_t outerCrc = 0;
@@ -231,88 +224,22 @@ static void xBusUnpackRJ01Frame(void)
     if (xBusFrame[1] != XBUS_RJ01_MESSAGE_LENGTH)
     {
         // Unknown package as length is not ok
-        return;
+        return SERIAL_RX_FRAME_PENDING;
     }
     
     //
     // CRC calculation & check for full message
     //
-    for (i = 0; i < xBusFrameLength - 1; i++) {
+    for (i = 0; i < length - 1; i++) {
         outerCrc = xBusRj01CRC8(outerCrc, xBusFrame[i]);
     }
     
-    if (outerCrc != xBusFrame[xBusFrameLength - 1])
+    if (outerCrc != xBusFrame[length - 1])
     {
         // CRC does not match, skip this frame
-        return;
-    }
-
-    // Now unpack the "embedded MODE B frame"
-    xBusUnpackModeBFrame(XBUS_RJ01_OFFSET_BYTES);
-}
-
-// Receive ISR callback
-static void xBusDataReceive(uint16_t c)
-{
-    uint32_t now;
-    static uint32_t xBusTimeLast, xBusTimeInterval;
-
-    // Check if we shall reset frame position due to time
-    now = micros();
-    xBusTimeInterval = now - xBusTimeLast;
-    xBusTimeLast = now;
-    if (xBusTimeInterval > XBUS_MAX_FRAME_TIME) {
-        xBusFramePosition = 0;
-        xBusDataIncoming = false;
-    }
-    
-    // Check if we shall start a frame?
-    if ((xBusFramePosition == 0) && (c == XBUS_START_OF_FRAME_BYTE)) {
-        xBusDataIncoming = true;
-    }
-
-    // Only do this if we are receiving to a frame
-    if (xBusDataIncoming == true) {
-        // Store in frame copy
-        xBusFrame[xBusFramePosition] = (uint8_t)c;
-        xBusFramePosition++;
-    }
-    
-    // Done?
-    if (xBusFramePosition == xBusFrameLength) {
-        switch (xBusProvider) {
-            case SERIALRX_XBUS_MODE_B:
-                xBusUnpackModeBFrame(0);
-            case SERIALRX_XBUS_MODE_B_RJ01:
-                xBusUnpackRJ01Frame();
-        }
-        xBusDataIncoming = false;
-        xBusFramePosition = 0;
-    }
-}
-
-// Indicate time to read a frame from the data...
-uint8_t xBusFrameStatus(void)
-{
-    if (!xBusFrameReceived) {
         return SERIAL_RX_FRAME_PENDING;
     }
 
-    xBusFrameReceived = false;
-
-    return SERIAL_RX_FRAME_COMPLETE;
-}
-
-static uint16_t xBusReadRawRC(rxRuntimeConfig_t *rxRuntimeConfig, uint8_t chan)
-{
-    uint16_t data;
-
-    // Deliver the data wanted
-    if (chan >= rxRuntimeConfig->channelCount) {
-        return 0;
-    }
-
-    data = xBusChannelData[chan];
-
-    return data;
+    // Now unpack the "embedded MODE B frame"
+    return xBusUnpackEmbeddedModeBFrame(xBusFrame + XBUS_RJ01_OFFSET_BYTES);
 }
@@ -18,6 +18,11 @@
 #pragma once
 
 #include "rx/rx.h"
+#include "rx/serial_rx_frame.h"
+
+extern const serialRxFrameSpec_t xBusModeBFrameSpec;
+extern const serialRxFrameSpec_t xBusRj01FrameSpec;
 
 bool xBusInit(rxConfig_t *rxConfig, rxRuntimeConfig_t *rxRuntimeConfig, rcReadRawDataPtr *callback);
-uint8_t xBusFrameStatus(void);
+uint8_t xBusUnpackModeBFrame(const uint8_t *frame, uint8_t length);
+uint8_t xBusUnpackRJ01Frame(const uint8_t *frame, uint8_t length);
@@ -18,6 +18,7 @@
 #include <stdbool.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 
 #include "platform.h"
 #include "scheduler.h"
@@ -35,6 +36,8 @@ static uint32_t totalWaitingTasks;
 static uint32_t totalWaitingTasksSamples;
 static uint32_t realtimeGuardInterval;
 
+static schedulerMode_e schedulerMode = SCHEDULER_MODE_DYNAMIC;
+
 uint32_t currentTime = 0;
 uint16_t averageWaitingTasks100 = 0;
 
@@ -42,6 +45,7 @@ typedef struct {
     /* Configuration */
     const char * taskName;
     bool (*checkFunc)(uint32_t currentDeltaTime);
+    uint32_t (*signaledAtFunc)(void);   // time the event happened, else it is the time checkFunc saw it
     void (*taskFunc)(void);
     bool isEnabled;
     uint32_t desiredPeriod;     // target period of execution
@@ -52,6 +56,7 @@ typedef struct {
     uint32_t lastExecutedAt;    // last time of invocation
     uint32_t lastSignaledAt;    // time of invocation event for event-driven tasks
     uint16_t taskAgeCycles;
+    uint32_t deadline;          // EDF: time the task should have been started by
 
     /* Statistics */
     uint32_t averageExecutionTime;  // Moving averate over 6 samples, used to calculate guard interval
@@ -59,11 +64,19 @@ typedef struct {
 #ifndef SKIP_TASK_STATISTICS
     uint32_t maxExecutionTime;
     uint32_t totalExecutionTime;    // total time consumed by task since boot
+    uint32_t deadlineMisses;        // times the task was started a whole period after its release
+    uint32_t maxLateness;           // time from release to start
+    uint32_t averageLateness;
+    uint16_t executionTimeHistogram[TASK_EXECUTION_TIME_BUCKET_COUNT];
 #endif
 } cfTask_t;
 
-void taskMainPidLoopCheck(void);
+bool taskMainPidLoopCheck(uint32_t currentDeltaTime);
+uint32_t taskMainPidLoopSignaledAt(void);
+void taskMainPidLoop(void);
 void taskUpdateAccelerometer(void);
+bool taskUpdateAttitudeCheck(uint32_t currentDeltaTime);
+void taskUpdateAttitude(void);
 void taskHandleSerial(void);
 void taskUpdateBeeper(void);
 void taskUpdateBattery(void);
@@ -77,6 +90,8 @@ void taskCalculateAltitude(void);
 void taskUpdateDisplay(void);
 void taskTelemetry(void);
 void taskLedStrip(void);
+void taskGyroAnalyse(void);
+void taskBlackbox(void);
 void taskSystem(void);
 
 static cfTask_t cfTasks[TASK_COUNT] = {
@@ -90,7 +105,9 @@ static cfTask_t cfTasks[TASK_COUNT] = {
 
     [TASK_GYROPID] = {
         .taskName = "GYRO/PID",
-        .taskFunc = taskMainPidLoopCheck,
+        .checkFunc = taskMainPidLoopCheck,
+        .signaledAtFunc = taskMainPidLoopSignaledAt,
+        .taskFunc = taskMainPidLoop,
         .desiredPeriod = 100,
         .staticPriority = TASK_PRIORITY_REALTIME,
     },
@@ -102,6 +119,14 @@ static cfTask_t cfTasks[TASK_COUNT] = {
         .staticPriority = TASK_PRIORITY_MEDIUM,
     },
 
+    [TASK_ATTITUDE] = {
+        .taskName = "ATTITUDE",
+        .checkFunc = taskUpdateAttitudeCheck,
+        .taskFunc = taskUpdateAttitude,
+        .desiredPeriod = 1000000 / 100,     // runs once ACCEL or COMPASS has read a new sample
+        .staticPriority = TASK_PRIORITY_MEDIUM,
+    },
+
     [TASK_SERIAL] = {
         .taskName = "SERIAL",
         .taskFunc = taskHandleSerial,
@@ -202,12 +227,41 @@ static cfTask_t cfTasks[TASK_COUNT] = {
         .staticPriority = TASK_PRIORITY_IDLE,
     },
 #endif
+
+#ifdef GYRO_DYNAMIC_NOTCH
+    [TASK_GYRO_ANALYSE] = {
+        .taskName = "DYNNOTCH",
+        .taskFunc = taskGyroAnalyse,
+        .desiredPeriod = 1000000 / 500,         // 500 Hz, each axis analysed every GYRO_ANALYSE_STEP_COUNT * 3 runs
+        .staticPriority = TASK_PRIORITY_LOW,
+    },
+#endif
+
+#ifdef BLACKBOX
+    [TASK_BLACKBOX] = {
+        .taskName = "BLACKBOX",
+        .taskFunc = taskBlackbox,
+        .desiredPeriod = 1000000 / 1000,        // 1000 Hz, encodes the frames the PID loop queued since the last run
+        .staticPriority = TASK_PRIORITY_LOW,
+    },
+#endif
 };
 
 #define REALTIME_GUARD_INTERVAL_MIN     10
 #define REALTIME_GUARD_INTERVAL_MAX     300
 #define REALTIME_GUARD_INTERVAL_MARGIN  5
 
+/* EDF ready queue, released tasks ordered by deadline. A task is in the queue while its dynamicPriority is not zero. */
+static uint8_t edfQueue[TASK_COUNT];
+static uint8_t edfQueueSize = 0;
+
+#ifndef SKIP_TASK_STATISTICS
+/* Ring of the last tasks run, written only by scheduler(), the readers are tasks themselves so never see it half written */
+static schedulerTraceEvent_t schedulerTrace[SCHEDULER_TRACE_SIZE];
+static uint32_t schedulerTraceHead = 0;     // events recorded since boot
+static schedulerTraceMode_e schedulerTraceMode = SCHEDULER_TRACE_OFF;
+#endif
+
 void taskSystem(void)
 {
     uint8_t taskId;
@@ -243,9 +297,72 @@ void getTaskInfo(cfTaskId_e taskId, cfTaskInfo_t * taskInfo)
     taskInfo->maxExecutionTime = cfTasks[taskId].maxExecutionTime;
     taskInfo->totalExecutionTime = cfTasks[taskId].totalExecutionTime;
     taskInfo->averageExecutionTime = cfTasks[taskId].averageExecutionTime;
+    taskInfo->deadlineMisses = cfTasks[taskId].deadlineMisses;
+    taskInfo->maxLateness = cfTasks[taskId].maxLateness;
+    taskInfo->averageLateness = cfTasks[taskId].averageLateness;
+    memcpy(taskInfo->executionTimeHistogram, cfTasks[taskId].executionTimeHistogram, sizeof(taskInfo->executionTimeHistogram));
+}
+
+void schedulerSetTraceMode(schedulerTraceMode_e newMode)
+{
+    if (newMode != SCHEDULER_TRACE_OFF && schedulerTraceMode == SCHEDULER_TRACE_OFF) {
+        schedulerTraceHead = 0;
+    }
+    schedulerTraceMode = newMode;
+}
+
+schedulerTraceMode_e getSchedulerTraceMode(void)
+{
+    return schedulerTraceMode;
+}
+
+/* Copies the recorded events, oldest first, returns the number copied */
+uint8_t getSchedulerTrace(schedulerTraceEvent_t *events, uint8_t maxEvents)
+{
+    uint32_t count = MIN(MIN(schedulerTraceHead, SCHEDULER_TRACE_SIZE), maxEvents);
+    uint32_t index;
+
+    for (index = 0; index < count; index++) {
+        events[index] = schedulerTrace[(schedulerTraceHead - count + index) & (SCHEDULER_TRACE_SIZE - 1)];
+    }
+    return count;
+}
+
+static void taskExecutionTimeRecord(cfTask_t *task, uint32_t taskExecutionTime)
+{
+    uint8_t bucket = taskExecutionTime ? 32 - __builtin_clz(taskExecutionTime) : 0;
+    uint8_t i;
+
+    bucket = MIN(bucket, TASK_EXECUTION_TIME_BUCKET_COUNT - 1);
+
+    /* Halve the whole histogram rather than saturate, the shape is what matters */
+    if (task->executionTimeHistogram[bucket] == UINT16_MAX) {
+        for (i = 0; i < TASK_EXECUTION_TIME_BUCKET_COUNT; i++) {
+            task->executionTimeHistogram[i] /= 2;
+        }
+    }
+    task->executionTimeHistogram[bucket]++;
 }
 #endif
 
+void schedulerSetMode(schedulerMode_e newMode)
+{
+    uint8_t taskId;
+
+    schedulerMode = newMode;
+
+    /* Both modes keep the waiting state in dynamicPriority, start over from idle */
+    edfQueueSize = 0;
+    for (taskId = 0; taskId < TASK_COUNT; taskId++) {
+        cfTasks[taskId].dynamicPriority = 0;
+    }
+}
+
+schedulerMode_e getSchedulerMode(void)
+{
+    return schedulerMode;
+}
+
 void rescheduleTask(cfTaskId_e taskId, uint32_t newPeriodMicros)
 {
     if (taskId == TASK_SELF)
@@ -279,34 +396,24 @@ uint32_t getTaskDeltaTime(cfTaskId_e taskId)
     }
 }
 
-void scheduler(void)
+/* Release time of a signalled event-driven task. An event from before the last run, e.g. when the task was
+   started by a watchdog instead, or a time from the future is not trusted and the task is released now. */
+static uint32_t taskSignaledAt(cfTask_t *task)
 {
-    uint8_t taskId;
-    uint8_t selectedTaskId;
-    uint8_t selectedTaskDynPrio;
-    uint16_t waitingTasks = 0;
-    uint32_t timeToNextRealtimeTask = UINT32_MAX;
-
-    /* Cache currentTime */
-    currentTime = micros();
-
-    /* The task to be invoked */
-    selectedTaskId = TASK_NONE;
-    selectedTaskDynPrio = 0;
-
-    /* Check for realtime tasks */
-    for (taskId = 0; taskId < TASK_COUNT; taskId++) {
-        if (cfTasks[taskId].staticPriority == TASK_PRIORITY_REALTIME) {
-            uint32_t nextExecuteAt = cfTasks[taskId].lastExecutedAt + cfTasks[taskId].desiredPeriod;
-            if ((int32_t)(currentTime - nextExecuteAt) >= 0) {
-                timeToNextRealtimeTask = 0;
-            }
-            else {
-                uint32_t newTimeInterval = nextExecuteAt - currentTime;
-                timeToNextRealtimeTask = MIN(timeToNextRealtimeTask, newTimeInterval);
-            }
+    if (task->signaledAtFunc != NULL) {
+        uint32_t signaledAt = task->signaledAtFunc();
+        if ((int32_t)(signaledAt - task->lastExecutedAt) > 0 && (int32_t)(currentTime - signaledAt) >= 0) {
+            return signaledAt;
         }
     }
+    return currentTime;
+}
+
+static uint8_t dynamicSelectTask(uint32_t timeToNextRealtimeTask, uint16_t *waitingTasks)
+{
+    uint8_t taskId;
+    uint8_t selectedTaskId = TASK_NONE;
+    uint8_t selectedTaskDynPrio = 0;
 
     bool outsideRealtimeGuardInterval = (timeToNextRealtimeTask > realtimeGuardInterval);
 
@@ -319,13 +426,13 @@ void scheduler(void)
                 if (cfTasks[taskId].dynamicPriority > 0) {
                     cfTasks[taskId].taskAgeCycles = 1 + ((currentTime - cfTasks[taskId].lastSignaledAt) / cfTasks[taskId].desiredPeriod);
                     cfTasks[taskId].dynamicPriority = 1 + cfTasks[taskId].staticPriority * cfTasks[taskId].taskAgeCycles;
-                    waitingTasks++;
+                    (*waitingTasks)++;
                 }
                 else if (cfTasks[taskId].checkFunc(currentTime - cfTasks[taskId].lastExecutedAt)) {
-                    cfTasks[taskId].lastSignaledAt = currentTime;
+                    cfTasks[taskId].lastSignaledAt = taskSignaledAt(&cfTasks[taskId]);
                     cfTasks[taskId].taskAgeCycles = 1;
                     cfTasks[taskId].dynamicPriority = 1 + cfTasks[taskId].staticPriority;
-                    waitingTasks++;
+                    (*waitingTasks)++;
                 }
                 else {
                     cfTasks[taskId].taskAgeCycles = 0;
@@ -337,13 +444,20 @@ void scheduler(void)
                 cfTasks[taskId].taskAgeCycles = ((currentTime - cfTasks[taskId].lastExecutedAt) / cfTasks[taskId].desiredPeriod);
                 if (cfTasks[taskId].taskAgeCycles > 0) {
                     cfTasks[taskId].dynamicPriority = 1 + cfTasks[taskId].staticPriority * cfTasks[taskId].taskAgeCycles;
-                    waitingTasks++;
+                    (*waitingTasks)++;
                 }
             }
 
             /* limit new priority to avoid overflow of uint8_t */
             cfTasks[taskId].dynamicPriority = MIN(cfTasks[taskId].dynamicPriority, TASK_PRIORITY_MAX);;
 
+            /* A signalled realtime task runs in this very pass. Its jitter is then bounded by the longest task that
+               may have been started before the event, non-realtime tasks are not started within the guard interval
+               unless they are overdue. */
+            if (cfTasks[taskId].checkFunc != NULL && cfTasks[taskId].staticPriority == TASK_PRIORITY_REALTIME && cfTasks[taskId].dynamicPriority > 0) {
+                cfTasks[taskId].dynamicPriority = TASK_PRIORITY_MAX;
+            }
+
             bool taskCanBeChosenForScheduling =
                 (outsideRealtimeGuardInterval) ||
                 (cfTasks[taskId].taskAgeCycles > 1) ||
@@ -356,11 +470,167 @@ void scheduler(void)
         }
     }
 
+    return selectedTaskId;
+}
+
+static void edfQueueInsert(uint8_t taskId)
+{
+    uint8_t position = edfQueueSize;
+
+    /* Realtime tasks go first, everything else by deadline, FIFO for equal deadlines */
+    if (cfTasks[taskId].staticPriority == TASK_PRIORITY_REALTIME) {
+        position = 0;
+    } else {
+        while (position > 0 && cfTasks[edfQueue[position - 1]].staticPriority != TASK_PRIORITY_REALTIME
+                && (int32_t)(cfTasks[edfQueue[position - 1]].deadline - cfTasks[taskId].deadline) > 0) {
+            position--;
+        }
+    }
+
+    memmove(&edfQueue[position + 1], &edfQueue[position], edfQueueSize - position);
+    edfQueue[position] = taskId;
+    edfQueueSize++;
+}
+
+static void edfQueueRemove(uint8_t position)
+{
+    edfQueueSize--;
+    memmove(&edfQueue[position], &edfQueue[position + 1], edfQueueSize - position);
+}
+
+/*
+ * Earliest deadline first. Released tasks are queued by deadline, a time-driven task is released when its period is up and
+ * due one period later, an event-driven task is released by its event. A realtime task runs as soon as it is released.
+ * Any other task is admitted only if its average execution time fits in the time left until the next realtime task is
+ * expected, else it is deferred to a later gap, and only a task that is a whole period past its deadline runs regardless.
+ */
+static uint8_t edfSelectTask(uint32_t timeToNextRealtimeTask, uint16_t *waitingTasks)
+{
+    uint8_t taskId;
+    uint8_t position;
+    uint8_t selectedPosition = TASK_NONE;
+    uint8_t idlePosition = TASK_NONE;
+
+    /* Release tasks into the queue */
+    for (taskId = 0; taskId < TASK_COUNT; taskId++) {
+        cfTask_t *task = &cfTasks[taskId];
+
+        if (!task->isEnabled || task->dynamicPriority > 0) {
+            continue;
+        }
+
+        if (task->checkFunc != NULL) {
+            if (!task->checkFunc(currentTime - task->lastExecutedAt)) {
+                continue;
+            }
+            task->lastSignaledAt = taskSignaledAt(task);
+            task->deadline = task->lastSignaledAt;
+        } else {
+            if ((int32_t)(currentTime - task->lastExecutedAt) < (int32_t)task->desiredPeriod) {
+                continue;
+            }
+            task->deadline = task->lastExecutedAt + task->desiredPeriod;
+        }
+
+        if (task->staticPriority != TASK_PRIORITY_REALTIME) {
+            task->deadline += task->desiredPeriod;
+        }
+        task->dynamicPriority = 1;
+        edfQueueInsert(taskId);
+    }
+
+    *waitingTasks = edfQueueSize;
+
+    for (position = 0; position < edfQueueSize && selectedPosition == TASK_NONE; position++) {
+        cfTask_t *task = &cfTasks[edfQueue[position]];
+
+        if (!task->isEnabled) {
+            task->dynamicPriority = 0;
+            edfQueueRemove(position--);
+            continue;
+        }
+
+        bool fitsBeforeRealtimeTask = (task->averageExecutionTime + REALTIME_GUARD_INTERVAL_MARGIN) < timeToNextRealtimeTask;
+        bool overdue = (int32_t)(currentTime - task->deadline) >= (int32_t)task->desiredPeriod;
+
+        if (task->staticPriority == TASK_PRIORITY_REALTIME || overdue) {
+            selectedPosition = position;
+        } else if (fitsBeforeRealtimeTask) {
+            /* Idle tasks only run when nothing else can */
+            if (task->staticPriority != TASK_PRIORITY_IDLE) {
+                selectedPosition = position;
+            } else if (idlePosition == TASK_NONE) {
+                idlePosition = position;
+            }
+        }
+    }
+
+    if (selectedPosition == TASK_NONE) {
+        selectedPosition = idlePosition;
+    }
+
+    if (selectedPosition == TASK_NONE) {
+        return TASK_NONE;
+    }
+
+    taskId = edfQueue[selectedPosition];
+    edfQueueRemove(selectedPosition);
+    return taskId;
+}
+
+void scheduler(void)
+{
+    uint8_t taskId;
+    uint8_t selectedTaskId;
+    uint16_t waitingTasks = 0;
+    uint32_t timeToNextRealtimeTask = UINT32_MAX;
+
+    /* Cache currentTime */
+    currentTime = micros();
+
+    /* Check for realtime tasks */
+    for (taskId = 0; taskId < TASK_COUNT; taskId++) {
+        if (cfTasks[taskId].staticPriority == TASK_PRIORITY_REALTIME) {
+            uint32_t nextExecuteAt = cfTasks[taskId].lastExecutedAt + cfTasks[taskId].desiredPeriod;
+            if ((int32_t)(currentTime - nextExecuteAt) >= 0) {
+                timeToNextRealtimeTask = 0;
+            }
+            else {
+                uint32_t newTimeInterval = nextExecuteAt - currentTime;
+                timeToNextRealtimeTask = MIN(timeToNextRealtimeTask, newTimeInterval);
+            }
+        }
+    }
+
+    if (schedulerMode == SCHEDULER_MODE_EDF) {
+        selectedTaskId = edfSelectTask(timeToNextRealtimeTask, &waitingTasks);
+    } else {
+        selectedTaskId = dynamicSelectTask(timeToNextRealtimeTask, &waitingTasks);
+    }
+
     totalWaitingTasksSamples += 1;
     totalWaitingTasks += waitingTasks;
 
     /* Found a task that should be run */
     if (selectedTaskId != TASK_NONE) {
+#ifndef SKIP_TASK_STATISTICS
+        /* A realtime task half a period late is a loop time spike, the trace stops once it is recorded */
+        bool loopTimeSpike = cfTasks[selectedTaskId].staticPriority == TASK_PRIORITY_REALTIME && cfTasks[selectedTaskId].lastExecutedAt != 0
+            && currentTime - cfTasks[selectedTaskId].lastExecutedAt > cfTasks[selectedTaskId].desiredPeriod + cfTasks[selectedTaskId].desiredPeriod / 2;
+
+        /* Lateness is the time from release to start, a task is released by its event or when its period is up.
+           The first run after boot is not counted, the tasks were due long before the scheduler started. */
+        if (cfTasks[selectedTaskId].lastExecutedAt != 0) {
+            uint32_t releasedAt = cfTasks[selectedTaskId].checkFunc ? cfTasks[selectedTaskId].lastSignaledAt : cfTasks[selectedTaskId].lastExecutedAt + cfTasks[selectedTaskId].desiredPeriod;
+            uint32_t lateness = ((int32_t)(currentTime - releasedAt) > 0) ? currentTime - releasedAt : 0;
+
+            if (lateness >= cfTasks[selectedTaskId].desiredPeriod) {
+                cfTasks[selectedTaskId].deadlineMisses++;
+            }
+            cfTasks[selectedTaskId].maxLateness = MAX(cfTasks[selectedTaskId].maxLateness, lateness);
+            cfTasks[selectedTaskId].averageLateness = (cfTasks[selectedTaskId].averageLateness * 31 + lateness) / 32;
+        }
+#endif
         cfTasks[selectedTaskId].taskLatestDeltaTime = currentTime - cfTasks[selectedTaskId].lastExecutedAt;
         cfTasks[selectedTaskId].lastExecutedAt = currentTime;
         cfTasks[selectedTaskId].dynamicPriority = 0;
@@ -380,6 +650,19 @@ void scheduler(void)
 #ifndef SKIP_TASK_STATISTICS
         cfTasks[selectedTaskId].totalExecutionTime += taskExecutionTime;   // time consumed by scheduler + task
         cfTasks[selectedTaskId].maxExecutionTime = MAX(cfTasks[selectedTaskId].maxExecutionTime, taskExecutionTime);
+        taskExecutionTimeRecord(&cfTasks[selectedTaskId], taskExecutionTime);
+
+        if (schedulerTraceMode != SCHEDULER_TRACE_OFF) {
+            schedulerTraceEvent_t *event = &schedulerTrace[schedulerTraceHead++ & (SCHEDULER_TRACE_SIZE - 1)];
+
+            event->taskId = selectedTaskId;
+            event->startedAt = currentTimeBeforeTaskCall;
+            event->duration = MIN(taskExecutionTime, UINT16_MAX);
+
+            if (loopTimeSpike && schedulerTraceMode == SCHEDULER_TRACE_UNTIL_SPIKE) {
+                schedulerTraceMode = SCHEDULER_TRACE_OFF;
+            }
+        }
 #endif
 #if defined SCHEDULER_DEBUG
         debug[3] = (micros() - currentTime) - taskExecutionTime;
@@ -26,6 +26,14 @@ typedef enum {
     TASK_PRIORITY_MAX = 255
 } cfTaskPriority_e;
 
+typedef enum {
+    SCHEDULER_MODE_DYNAMIC = 0,     // priority grows with the age of the task, realtime guard interval
+    SCHEDULER_MODE_EDF              // earliest deadline first, tasks admitted if they fit before the next realtime task
+} schedulerMode_e;
+
+// execution time histogram, bucket 0 counts runs under 1us, bucket n runs of 2^(n-1) to 2^n - 1 us, the last one anything longer
+#define TASK_EXECUTION_TIME_BUCKET_COUNT 12
+
 typedef struct {
     const char * taskName;
     bool         isEnabled;
@@ -35,13 +43,34 @@ typedef struct {
     uint32_t     totalExecutionTime;
     uint32_t     lastExecutionTime;
     uint32_t     averageExecutionTime;
+    uint32_t     deadlineMisses;
+    uint32_t     maxLateness;
+    uint32_t     averageLateness;
+    uint16_t     executionTimeHistogram[TASK_EXECUTION_TIME_BUCKET_COUNT];
 } cfTaskInfo_t;
 
+#ifndef SCHEDULER_TRACE_SIZE
+#define SCHEDULER_TRACE_SIZE 32     // power of 2
+#endif
+
+typedef enum {
+    SCHEDULER_TRACE_OFF = 0,
+    SCHEDULER_TRACE_ON,
+    SCHEDULER_TRACE_UNTIL_SPIKE     // record until a realtime task runs half a period late, then keep what led up to it
+} schedulerTraceMode_e;
+
+typedef struct {
+    uint32_t startedAt;
+    uint16_t duration;
+    uint8_t taskId;
+} schedulerTraceEvent_t;
+
 typedef enum {
     /* Actual tasks */
     TASK_SYSTEM = 0,
     TASK_GYROPID,
     TASK_ACCEL,
+    TASK_ATTITUDE,
     TASK_SERIAL,
     TASK_BEEPER,
     TASK_BATTERY,
@@ -70,6 +99,12 @@ typedef enum {
 #ifdef LED_STRIP
     TASK_LEDSTRIP,
 #endif
+#ifdef GYRO_DYNAMIC_NOTCH
+    TASK_GYRO_ANALYSE,
+#endif
+#ifdef BLACKBOX
+    TASK_BLACKBOX,
+#endif
 
     /* Count of real tasks */
     TASK_COUNT,
@@ -83,6 +118,11 @@ extern uint16_t cpuLoad;
 extern uint16_t averageWaitingTasks100;
 
 void getTaskInfo(cfTaskId_e taskId, cfTaskInfo_t * taskInfo);
+void schedulerSetMode(schedulerMode_e newMode);
+schedulerMode_e getSchedulerMode(void);
+void schedulerSetTraceMode(schedulerTraceMode_e newMode);
+schedulerTraceMode_e getSchedulerTraceMode(void);
+uint8_t getSchedulerTrace(schedulerTraceEvent_t *events, uint8_t maxEvents);
 void rescheduleTask(cfTaskId_e taskId, uint32_t newPeriodMicros);
 void setTaskEnabled(cfTaskId_e taskId, bool newEnabledState);
 uint32_t getTaskDeltaTime(cfTaskId_e taskId);
@@ -36,6 +36,7 @@
 #include "sensors/acceleration.h"
 
 int16_t accADC[XYZ_AXIS_COUNT];
+uint32_t accSampleTime;         // micros() when accADC was read
 
 acc_t acc;                       // acc access functions
 sensor_align_e accAlign = 0;
@@ -175,6 +176,7 @@ void updateAccelerationReadings(rollAndPitchTrims_t *rollAndPitchTrims)
     if (!acc.read(accADC)) {
         return;
     }
+    accSampleTime = micros();
 
     alignSensors(accADC, accADC, accAlign);
 
@@ -38,6 +38,7 @@ extern acc_t acc;
 extern uint16_t acc_1G;
 
 extern int16_t accADC[XYZ_AXIS_COUNT];
+extern uint32_t accSampleTime;
 
 typedef struct rollAndPitchTrims_s {
     int16_t roll;
@@ -44,6 +44,7 @@ mag_t mag;                   // mag access functions
 extern uint32_t currentTime; // FIXME dependency on global variable, pass it in instead.
 
 int16_t magADC[XYZ_AXIS_COUNT];
+uint32_t magSampleTime;      // currentTime when magADC was read
 sensor_align_e magAlign = 0;
 #ifdef MAG
 static uint8_t magInit = 0;
@@ -72,6 +73,7 @@ void updateCompass(flightDynamicsTrims_t *magZero)
     nextUpdateAt = currentTime + COMPASS_UPDATE_FREQUENCY_10HZ;
 
     mag.read(magADC);
+    magSampleTime = currentTime;
     alignSensors(magADC, magADC, magAlign);
 
     if (STATE(CALIBRATE_MAG)) {
@@ -34,6 +34,7 @@ void updateCompass(flightDynamicsTrims_t *magZero);
 #endif
 
 extern int16_t magADC[XYZ_AXIS_COUNT];
+extern uint32_t magSampleTime;
 
 extern sensor_align_e magAlign;
 extern mag_t mag;
@@ -17,6 +17,8 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <string.h>
+#include <math.h>
 
 #include "debug.h"
 #include "platform.h"
@@ -27,30 +29,151 @@
 
 #include "drivers/sensor.h"
 #include "drivers/accgyro.h"
+#include "drivers/gyro_sync.h"
 #include "sensors/sensors.h"
 #include "io/beeper.h"
 #include "io/statusindicator.h"
 #include "sensors/boardalignment.h"
 
 #include "sensors/gyro.h"
+#include "sensors/gyroanalyse.h"
+
+#include "flight/pid.h"
+
+// No FPU on the F1, the filters run in fixed point there
+#ifdef STM32F10X
+#define GYRO_FILTER_FIXED_POINT
+#endif
+
+#define GYRO_FILTER_STAGE_COUNT 2   // lowpass and notch
+#define GYRO_FIR_TAPS 9
 
 uint16_t calibratingG = 0;
 int16_t gyroADC[XYZ_AXIS_COUNT];
 int16_t gyroZero[FLIGHT_DYNAMICS_INDEX_COUNT] = { 0, 0, 0 };
 
 static gyroConfig_t *gyroConfig;
-static int8_t * gyroFIRTable = 0L;
-static int16_t gyroFIRState[3][9];
+static pidProfile_t *gyroFilterProfile;
+static bool gyroFilterDesignNeeded;
+static uint8_t gyroFilterStageCount;
+static uint32_t gyroFilterSamplePeriod;   // us
+
+#ifdef GYRO_FILTER_FIXED_POINT
+static biquadFilterQ15_t gyroFilterStage[XYZ_AXIS_COUNT][GYRO_FILTER_STAGE_COUNT];
+#else
+static biquadFilter_t gyroFilterStage[XYZ_AXIS_COUNT][GYRO_FILTER_STAGE_COUNT];
+#endif
+
+// optional FIR in front of the biquads, run on the int16 samples with SMLAD where the MCU has it
+static firFilterInt16_t gyroFir[XYZ_AXIS_COUNT];
+static bool gyroFirActive;
+
+#ifdef GYRO_DYNAMIC_NOTCH
+// follows the noise peak found by gyroanalyse.c, applied after the static stages once a peak was found
+static biquadFilter_t gyroDynamicNotch[XYZ_AXIS_COUNT];
+static bool gyroDynamicNotchActive[XYZ_AXIS_COUNT];
+#endif
 
 gyro_t gyro;                      // gyro access functions
 sensor_align_e gyroAlign = 0;
 
-void useGyroConfig(gyroConfig_t *gyroConfigToUse, int8_t * filterTableToUse)
+void useGyroConfig(gyroConfig_t *gyroConfigToUse, struct pidProfile_s *pidProfileToUse)
 {
     gyroConfig = gyroConfigToUse;
-    gyroFIRTable = filterTableToUse;
+    gyroFilterProfile = pidProfileToUse;
+    gyroFilterDesignNeeded = true;
 }
 
+static void gyroFilterAddStage(biquadFilterType_e filterType, float filterFreq, float Q)
+{
+    int axis;
+
+    for (axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+#ifdef GYRO_FILTER_FIXED_POINT
+        biquadFilter_t design;
+
+        biquadFilterInit(&design, filterType, filterFreq, Q, gyroFilterSamplePeriod);
+        biquadFilterQ15Init(&gyroFilterStage[axis][gyroFilterStageCount], &design);
+#else
+        biquadFilterInit(&gyroFilterStage[axis][gyroFilterStageCount], filterType, filterFreq, Q, gyroFilterSamplePeriod);
+#endif
+    }
+    gyroFilterStageCount++;
+}
+
+// A gyro read in batches has every sample filtered, else only the one read per loop
+static void gyroFilterDesign(void)
+{
+    gyroFilterStageCount = 0;
+    gyroFilterSamplePeriod = gyro.readBatch ? gyroSamplePeriod : targetLooptime;
+
+    gyroFirActive = gyroFilterProfile->gyro_fir_level > 0;
+    if (gyroFirActive) {
+        int axis;
+        for (axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+            firFilterInt16Init(&gyroFir[axis], filterGetFIRCoefficientsTable(gyroFilterProfile->gyro_fir_level - 1), GYRO_FIR_TAPS);
+        }
+    }
+
+    if (gyroFilterProfile->gyro_lpf_hz) {
+        gyroFilterAddStage(FILTER_LPF, gyroFilterProfile->gyro_lpf_hz, 1.0f / sqrtf(2.0f));
+    }
+    if (gyroFilterProfile->gyro_notch_hz && gyroFilterProfile->gyro_notch_cutoff_hz < gyroFilterProfile->gyro_notch_hz) {
+        gyroFilterAddStage(FILTER_NOTCH, gyroFilterProfile->gyro_notch_hz,
+            filterGetNotchQ(gyroFilterProfile->gyro_notch_hz, gyroFilterProfile->gyro_notch_cutoff_hz));
+    }
+
+#ifdef GYRO_DYNAMIC_NOTCH
+    memset(gyroDynamicNotchActive, 0, sizeof(gyroDynamicNotchActive));
+    gyroDataAnalyseInit(gyroFilterSamplePeriod, gyroFilterProfile->gyro_dyn_notch_min_hz, gyroFilterProfile->gyro_dyn_notch_max_hz);
+#endif
+
+    gyroFilterDesignNeeded = false;
+}
+
+static void gyroFilterApply(int16_t data[XYZ_AXIS_COUNT])
+{
+    int axis, stage;
+
+    for (axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        if (gyroFirActive) {
+            data[axis] = firFilterInt16Apply(&gyroFir[axis], data[axis]);
+        }
+#ifdef GYRO_FILTER_FIXED_POINT
+        int16_t sample = data[axis];
+        for (stage = 0; stage < gyroFilterStageCount; stage++) {
+            sample = biquadFilterQ15Apply(&gyroFilterStage[axis][stage], sample);
+        }
+        data[axis] = sample;
+#else
+        float sample = data[axis];
+        for (stage = 0; stage < gyroFilterStageCount; stage++) {
+            sample = biquadFilterApply(&gyroFilterStage[axis][stage], sample);
+        }
+#ifdef GYRO_DYNAMIC_NOTCH
+        if (gyroDynamicNotchActive[axis]) {
+            sample = biquadFilterApply(&gyroDynamicNotch[axis], sample);
+        }
+#endif
+        data[axis] = constrain(lrintf(sample), INT16_MIN, INT16_MAX);
+#endif
+    }
+}
+
+#ifdef GYRO_DYNAMIC_NOTCH
+void gyroSetDynamicNotchCenter(uint8_t axis, float centerHz)
+{
+    const float Q = gyroFilterProfile->gyro_dyn_notch_q / 10.0f;
+
+    if (gyroDynamicNotchActive[axis]) {
+        biquadFilterUpdate(&gyroDynamicNotch[axis], FILTER_NOTCH, centerHz, Q, gyroFilterSamplePeriod);
+    } else {
+        biquadFilterInit(&gyroDynamicNotch[axis], FILTER_NOTCH, centerHz, Q, gyroFilterSamplePeriod);
+        gyroDynamicNotchActive[axis] = true;
+    }
+}
+#endif
+
 void gyroSetCalibrationCycles(uint16_t calibrationCyclesRequired)
 {
     calibratingG = calibrationCyclesRequired;
@@ -122,12 +245,30 @@ static void applyGyroZero(void)
 
 void gyroUpdate(void)
 {
+    int16_t samples[GYRO_BATCH_MAX_SAMPLES][XYZ_AXIS_COUNT];
+    uint8_t sampleCount, sample;
+
     // range: +/- 8192; +/- 2000 deg/sec
-    if (!gyro.read(gyroADC)) {
+    if (gyro.readBatch) {
+        // every sample since the last loop is filtered, so noise above half the loop rate is gone before it can alias
+        sampleCount = gyro.readBatch(samples, GYRO_BATCH_MAX_SAMPLES);
+    } else {
+        sampleCount = gyro.read(samples[0]) ? 1 : 0;
+    }
+    if (sampleCount == 0) {
         return;
     }
 
-    filterApply9TapFIR(gyroADC, gyroFIRState, gyroFIRTable);
+    if (gyroFilterDesignNeeded) {
+        gyroFilterDesign();
+    }
+    for (sample = 0; sample < sampleCount; sample++) {
+#ifdef GYRO_DYNAMIC_NOTCH
+        gyroDataAnalysePush(samples[sample]);
+#endif
+        gyroFilterApply(samples[sample]);
+    }
+    memcpy(gyroADC, samples[sampleCount - 1], sizeof(gyroADC));
 
     alignSensors(gyroADC, gyroADC, gyroAlign);
 
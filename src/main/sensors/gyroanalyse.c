@@ -0,0 +1,292 @@
+/*
+ * This file is part of Cleanflight.
+ *
+ * Cleanflight is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cleanflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cleanflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Finds the frequency of the strongest noise on each gyro axis, so a notch can follow motor noise as it moves with the
+ * throttle. The gyro samples are averaged down to a rate a little over twice the highest frequency looked at and kept
+ * in a ring per axis. A low priority task takes a Hann windowed real FFT of the ring, one axis at a time and spread
+ * over GYRO_ANALYSE_STEP_COUNT runs so no run takes long, and moves the notch of the axis to the peak between the
+ * configured bounds.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "platform.h"
+
+#ifdef GYRO_DYNAMIC_NOTCH
+
+#include "common/axis.h"
+#include "common/maths.h"
+
+#include "sensors/gyroanalyse.h"
+
+#define FFT_HALF_SIZE (GYRO_ANALYSE_FFT_SIZE / 2)
+
+// the peak has to stand out of the band, else the notch stays where it is. White noise alone reaches about 3 times the
+// band mean now and then
+#define PEAK_TO_MEAN_MIN 4.0f
+// share of a new estimate that goes into the notch center, damps the notch moving between neighbouring bins
+#define CENTER_SMOOTHING 0.3f
+// the decimated Nyquist frequency is this much above the highest frequency looked at, the averaging rolls off before it
+#define NYQUIST_MARGIN 1.25f
+
+typedef struct complex_s {
+    float re;
+    float im;
+} complex_t;
+
+static bool analyseEnabled;
+static uint8_t decimation;
+static float binWidthHz;
+static uint8_t minBin;
+static uint8_t maxBin;
+static uint16_t minHz;
+static uint16_t maxHz;
+
+// decimated samples per axis, written by the gyro
+static int32_t decimationSum[XYZ_AXIS_COUNT];
+static uint8_t decimationCount;
+static float sampleRing[XYZ_AXIS_COUNT][GYRO_ANALYSE_FFT_SIZE];
+static uint8_t sampleRingHead;
+
+static float hannWindow[GYRO_ANALYSE_FFT_SIZE];
+static complex_t twiddle[FFT_HALF_SIZE];        // e^(-2 pi i k / GYRO_ANALYSE_FFT_SIZE)
+static complex_t fftData[FFT_HALF_SIZE];
+
+static uint8_t analyseAxis;
+static uint8_t analyseStep;
+static float centerHz[XYZ_AXIS_COUNT];
+
+static uint8_t bitReverse(uint8_t index)
+{
+    uint8_t reversed = 0;
+    uint8_t bit;
+
+    for (bit = 1; bit < FFT_HALF_SIZE; bit <<= 1) {
+        reversed = (reversed << 1) | ((index & bit) ? 1 : 0);
+    }
+    return reversed;
+}
+
+void gyroDataAnalyseInit(uint32_t samplePeriodUs, uint16_t minFrequencyHz, uint16_t maxFrequencyHz)
+{
+    int i;
+
+    memset(decimationSum, 0, sizeof(decimationSum));
+    memset(sampleRing, 0, sizeof(sampleRing));
+    memset(centerHz, 0, sizeof(centerHz));
+    decimationCount = 0;
+    sampleRingHead = 0;
+    analyseAxis = 0;
+    analyseStep = 0;
+
+    const float sampleRate = 1000000.0f / samplePeriodUs;
+
+    analyseEnabled = minFrequencyHz > 0 && maxFrequencyHz > minFrequencyHz && maxFrequencyHz * 2 < sampleRate;
+    if (!analyseEnabled) {
+        return;
+    }
+
+    decimation = MAX(1, (int)(sampleRate / (2 * NYQUIST_MARGIN * maxFrequencyHz)));
+    binWidthHz = sampleRate / decimation / GYRO_ANALYSE_FFT_SIZE;
+    minHz = minFrequencyHz;
+    maxHz = maxFrequencyHz;
+    // the parabola through the peak needs a bin either side
+    minBin = constrain(minFrequencyHz / binWidthHz, 1, FFT_HALF_SIZE - 2);
+    maxBin = constrain(maxFrequencyHz / binWidthHz + 1, minBin + 1, FFT_HALF_SIZE - 1);
+
+    for (i = 0; i < GYRO_ANALYSE_FFT_SIZE; i++) {
+        hannWindow[i] = 0.5f - 0.5f * cos_approx(2 * M_PIf * i / (GYRO_ANALYSE_FFT_SIZE - 1));
+    }
+    for (i = 0; i < FFT_HALF_SIZE; i++) {
+        twiddle[i].re = cos_approx(2 * M_PIf * i / GYRO_ANALYSE_FFT_SIZE);
+        twiddle[i].im = -sin_approx(2 * M_PIf * i / GYRO_ANALYSE_FFT_SIZE);
+    }
+}
+
+// Called with every gyro sample, before the filters
+void gyroDataAnalysePush(const int16_t data[XYZ_AXIS_COUNT])
+{
+    int axis;
+
+    if (!analyseEnabled) {
+        return;
+    }
+
+    for (axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        decimationSum[axis] += data[axis];
+    }
+
+    if (++decimationCount < decimation) {
+        return;
+    }
+
+    for (axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        sampleRing[axis][sampleRingHead] = (float)decimationSum[axis] / decimation;
+        decimationSum[axis] = 0;
+    }
+    decimationCount = 0;
+    sampleRingHead = (sampleRingHead + 1) % GYRO_ANALYSE_FFT_SIZE;
+}
+
+// Windows the ring of the axis, oldest sample first, and packs even and odd samples as one complex sequence in bit
+// reversed order, ready for the butterflies.
+static void fftLoad(uint8_t axis)
+{
+    uint8_t i;
+
+    for (i = 0; i < FFT_HALF_SIZE; i++) {
+        uint8_t even = (sampleRingHead + 2 * i) % GYRO_ANALYSE_FFT_SIZE;
+        uint8_t odd = (even + 1) % GYRO_ANALYSE_FFT_SIZE;
+        uint8_t reversed = bitReverse(i);
+
+        fftData[reversed].re = sampleRing[axis][even] * hannWindow[2 * i];
+        fftData[reversed].im = sampleRing[axis][odd] * hannWindow[2 * i + 1];
+    }
+}
+
+// Radix-2 decimation in time butterflies of the complex FFT, for butterfly spans from firstSpan up to lastSpan
+static void fftButterflies(uint8_t firstSpan, uint8_t lastSpan)
+{
+    uint8_t span, start, k;
+
+    for (span = firstSpan; span <= lastSpan && span < FFT_HALF_SIZE; span <<= 1) {
+        // the complex FFT is half the size, so it takes every other twiddle of the full size
+        uint8_t twiddleStep = FFT_HALF_SIZE / span;
+
+        for (start = 0; start < FFT_HALF_SIZE; start += 2 * span) {
+            for (k = 0; k < span; k++) {
+                const complex_t w = twiddle[k * twiddleStep];
+                complex_t *a = &fftData[start + k];
+                complex_t *b = &fftData[start + k + span];
+                const float re = b->re * w.re - b->im * w.im;
+                const float im = b->re * w.im + b->im * w.re;
+
+                b->re = a->re - re;
+                b->im = a->im - im;
+                a->re += re;
+                a->im += im;
+            }
+        }
+    }
+}
+
+// Magnitude of bin k of the real FFT, split out of the half size complex FFT
+static float fftRealMagnitude(uint8_t k)
+{
+    const complex_t zk = fftData[k];
+    const complex_t *mirror = &fftData[(FFT_HALF_SIZE - k) % FFT_HALF_SIZE];
+    const complex_t zc = { mirror->re, -mirror->im };                                    // conj(Z[N/2 - k])
+    const complex_t even = { (zk.re + zc.re) / 2, (zk.im + zc.im) / 2 };
+    const complex_t odd = { (zk.im - zc.im) / 2, -(zk.re - zc.re) / 2 };                 // (Z[k] - conj) / 2i
+    const complex_t w = twiddle[k];
+    const float re = even.re + odd.re * w.re - odd.im * w.im;
+    const float im = even.im + odd.re * w.im + odd.im * w.re;
+
+    return sqrtf(re * re + im * im);
+}
+
+static void fftFindPeak(uint8_t axis)
+{
+    float magnitude[FFT_HALF_SIZE];
+    float sum = 0;
+    uint8_t peakBin = 0;
+    uint8_t bin;
+
+    for (bin = minBin - 1; bin <= maxBin + 1 && bin < FFT_HALF_SIZE; bin++) {
+        magnitude[bin] = fftRealMagnitude(bin);
+    }
+
+    for (bin = minBin; bin <= maxBin; bin++) {
+        sum += magnitude[bin];
+        if (!peakBin || magnitude[bin] > magnitude[peakBin]) {
+            peakBin = bin;
+        }
+    }
+
+    if (magnitude[peakBin] < PEAK_TO_MEAN_MIN * sum / (maxBin - minBin + 1)) {
+        return;
+    }
+
+    // vertex of the parabola through the peak and its neighbours
+    float offset = 0;
+    if (peakBin + 1 < FFT_HALF_SIZE) {
+        const float left = magnitude[peakBin - 1];
+        const float right = magnitude[peakBin + 1];
+        const float denominator = left - 2 * magnitude[peakBin] + right;
+        if (denominator != 0) {
+            offset = constrainf(0.5f * (left - right) / denominator, -0.5f, 0.5f);
+        }
+    }
+
+    const float peakHz = constrainf((peakBin + offset) * binWidthHz, minHz, maxHz);
+
+    if (centerHz[axis] == 0) {
+        centerHz[axis] = peakHz;
+    } else {
+        centerHz[axis] += CENTER_SMOOTHING * (peakHz - centerHz[axis]);
+    }
+    gyroSetDynamicNotchCenter(axis, centerHz[axis]);
+}
+
+/*
+ * One step of the analysis of one axis, run from a low priority task:
+ *   0: window and load the samples, in bit reversed order
+ *   1: butterflies of span 1 to 4
+ *   2: butterflies of span 8 and up
+ *   3: split the real spectrum, find the peak and move the notch
+ */
+void gyroDataAnalyseUpdate(void)
+{
+    if (!analyseEnabled) {
+        return;
+    }
+
+    switch (analyseStep) {
+    case 0:
+        fftLoad(analyseAxis);
+        break;
+    case 1:
+        fftButterflies(1, 4);
+        break;
+    case 2:
+        fftButterflies(8, FFT_HALF_SIZE / 2);
+        break;
+    case 3:
+        fftFindPeak(analyseAxis);
+        analyseAxis = (analyseAxis + 1) % XYZ_AXIS_COUNT;
+        break;
+    }
+
+    analyseStep = (analyseStep + 1) % GYRO_ANALYSE_STEP_COUNT;
+}
+
+// 0 until a peak was found
+float gyroDataAnalyseGetCenterHz(uint8_t axis)
+{
+    return centerHz[axis];
+}
+
+float gyroDataAnalyseGetBinWidthHz(void)
+{
+    return binWidthHz;
+}
+
+#endif
@@ -0,0 +1,30 @@
+/*
+ * This file is part of Cleanflight.
+ *
+ * Cleanflight is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cleanflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cleanflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#define GYRO_ANALYSE_FFT_SIZE 64            // real samples per FFT, power of 2
+#define GYRO_ANALYSE_STEP_COUNT 4           // task runs per axis, see gyroDataAnalyseUpdate()
+
+void gyroDataAnalyseInit(uint32_t samplePeriodUs, uint16_t minHz, uint16_t maxHz);
+void gyroDataAnalysePush(const int16_t data[XYZ_AXIS_COUNT]);
+void gyroDataAnalyseUpdate(void);
+float gyroDataAnalyseGetCenterHz(uint8_t axis);
+float gyroDataAnalyseGetBinWidthHz(void);
+
+// implemented by the gyro, called with the noise peak of an axis once it is found
+void gyroSetDynamicNotchCenter(uint8_t axis, float centerHz);
@@ -252,7 +252,7 @@ const extiConfig_t *selectMPUIntExtiConfig(void)
     return NULL;
 }
 
-#ifdef USE_FAKE_GYRO
+#if defined(USE_FAKE_GYRO) && !defined(USE_SIMULATED_ACCGYRO)
 static void fakeGyroInit(uint16_t lpf)
 {
     UNUSED(lpf);
@@ -277,9 +277,12 @@ bool fakeGyroDetect(gyro_t *gyro)
     gyro->temperature = fakeGyroReadTemp;
     return true;
 }
+#elif defined(USE_FAKE_GYRO)
+// provided by the simulated quad of the SITL target
+bool fakeGyroDetect(gyro_t *gyro);
 #endif
 
-#ifdef USE_FAKE_ACC
+#if defined(USE_FAKE_ACC) && !defined(USE_SIMULATED_ACCGYRO)
 static void fakeAccInit(void) {}
 static bool fakeAccRead(int16_t *accData) {
     memset(accData, 0, sizeof(int16_t[XYZ_AXIS_COUNT]));
@@ -293,6 +296,8 @@ bool fakeAccDetect(acc_t *acc)
     acc->revisionCode = 0;
     return true;
 }
+#elif defined(USE_FAKE_ACC)
+bool fakeAccDetect(acc_t *acc);
 #endif
 
 bool detectGyro(void)
@@ -76,6 +76,7 @@
 // MPU6500 interrupt
 //#define DEBUG_MPU_DATA_READY_INTERRUPT
 #define USE_MPU_DATA_READY_SIGNAL
+#define USE_MPU_FIFO
 #define ENSURE_MPU_DATA_READY_IS_LOW
 #define EXTI_CALLBACK_HANDLER_COUNT 1 // MPU data ready
 
@@ -126,6 +127,7 @@
 #define USE_SPI_DEVICE_1
 #define USE_SPI_DEVICE_2
 #define USE_SPI_DEVICE_3
+#define USE_SPI_DMA
 
 //#define USE_I2C
 #define I2C_DEVICE (I2CDEV_1)
@@ -169,6 +171,7 @@
 //#define DISPLAY
 #define GPS
 #define GTUNE
+#define GYRO_DYNAMIC_NOTCH
 #define SERIAL_RX
 #define TELEMETRY
 #define USE_SERVOS
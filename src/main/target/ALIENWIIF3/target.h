@@ -114,6 +114,7 @@
 #define SERIAL_RX
 //#define GPS
 #define GTUNE
+#define GYRO_DYNAMIC_NOTCH
 //#define DISPLAY
 #define USE_SERVOS
 #define USE_CLI
@@ -78,6 +78,7 @@
 // MPU6500 interrupt
 //#define DEBUG_MPU_DATA_READY_INTERRUPT
 #define USE_MPU_DATA_READY_SIGNAL
+#define USE_MPU_FIFO
 #define ENSURE_MPU_DATA_READY_IS_LOW
 #define EXTI_CALLBACK_HANDLER_COUNT 1 // MPU data ready
 
@@ -112,6 +113,7 @@
 #define USE_SPI
 #define USE_SPI_DEVICE_1
 #define USE_SPI_DEVICE_3
+#define USE_SPI_DMA
 
 #define USE_I2C
 #define I2C_DEVICE (I2CDEV_1)
@@ -121,5 +123,6 @@
 #define TELEMETRY
 #define SERIAL_RX
 #define AUTOTUNE
+#define GYRO_DYNAMIC_NOTCH
 #define USE_SERVOS
 #define USE_CLI
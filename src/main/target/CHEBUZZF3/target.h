@@ -121,6 +121,7 @@
 
 #define BLACKBOX
 #define GTUNE
+#define GYRO_DYNAMIC_NOTCH
 #define TELEMETRY
 #define SERIAL_RX
 #define USE_SERVOS
@@ -160,6 +160,7 @@
 #define BLACKBOX
 #define GPS
 #define GTUNE
+#define GYRO_DYNAMIC_NOTCH
 #define LED_STRIP
 
 #define LED_STRIP_TIMER TIM16
@@ -161,6 +161,7 @@
 #define DISPLAY
 #define GPS
 #define GTUNE
+#define GYRO_DYNAMIC_NOTCH
 #define SERIAL_RX
 #define TELEMETRY
 #define USE_SERVOS
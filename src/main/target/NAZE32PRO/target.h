@@ -43,6 +43,7 @@
 #define BLACKBOX
 #define GPS
 #define GTUNE
+#define GYRO_DYNAMIC_NOTCH
 #define SERIAL_RX
 #define TELEMETRY
 #define USE_SERVOS
@@ -48,6 +48,7 @@
 
 // MPU6000 interrupts
 #define USE_MPU_DATA_READY_SIGNAL
+#define USE_MPU_FIFO
 #define EXTI_CALLBACK_HANDLER_COUNT 2 // MPU data ready (mag disabled)
 
 //#define MAG
@@ -112,6 +113,7 @@
 #define USE_SPI
 #define USE_SPI_DEVICE_1
 #define USE_SPI_DEVICE_3
+#define USE_SPI_DMA
 
 #define USE_I2C
 #define I2C_DEVICE (I2CDEV_1)
@@ -140,5 +142,6 @@
 #define TELEMETRY
 #define SERIAL_RX
 #define GTUNE
+#define GYRO_DYNAMIC_NOTCH
 #define USE_SERVOS
 #define USE_CLI
@@ -62,6 +62,7 @@
 
 // MPU9250 interrupts
 #define USE_MPU_DATA_READY_SIGNAL
+#define USE_MPU_FIFO
 //#define ENSURE_MPU_DATA_READY_IS_LOW
 #define EXTI_CALLBACK_HANDLER_COUNT 1 // MPU data ready (mag disabled)
 
@@ -122,6 +123,7 @@
 #define TELEMETRY
 #define SERIAL_RX
 #define GTUNE
+#define GYRO_DYNAMIC_NOTCH
 #define USE_SERVOS
 #define USE_CLI
 
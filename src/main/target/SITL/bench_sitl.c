@@ -0,0 +1,188 @@
+/*
+ * This file is part of Cleanflight.
+ *
+ * Cleanflight is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cleanflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cleanflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Loop benchmark. With SITL_BENCH=<iterations> the simulator runs in lockstep, so every run
+ * feeds the flight code the same sensor and stick input, and the host time spent in each stage
+ * of taskMainPidLoop() is collected once the pilot has armed. When the iterations are done a
+ * JSON report is written and the simulator exits.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "platform.h"
+
+#include "debug.h"
+
+#include "common/axis.h"
+
+#include "drivers/gyro_sync.h"
+
+#include "flight/mixer.h"
+
+#include "config/runtime_config.h"
+
+#include "sitl.h"
+#include "sim_quad.h"
+
+#define BENCH_BUCKET_NS 10
+#define BENCH_BUCKET_COUNT 10000    // 100us, slower iterations go into the last bucket
+
+typedef struct benchStage_s {
+    uint32_t count;
+    uint64_t totalNs;
+    uint32_t minNs;
+    uint32_t maxNs;
+    uint32_t histogram[BENCH_BUCKET_COUNT];
+} benchStage_t;
+
+static const char * const stageNames[LOOP_STAGE_COUNT] = {
+    "gyroUpdate",
+    "imuCalculateEstimatedAttitude",
+    "interpolateRcCommands",
+    "pid_controller",
+    "mixTable",
+    "writeMotors",
+    "handleBlackbox",
+    "taskMainPidLoop",
+    "gyroDataAnalyse"
+};
+
+static uint32_t benchIterations;
+static const char *reportFileName;
+static benchStage_t stages[LOOP_STAGE_COUNT];
+static uint32_t motorChecksum = 2166136261U;
+
+void benchInit(void)
+{
+    benchIterations = sitlEnvInt("SITL_BENCH", 0);
+    reportFileName = getenv("SITL_BENCH_REPORT");
+    if (!reportFileName) {
+        reportFileName = "sitl_bench.json";
+    }
+
+    for (int i = 0; i < LOOP_STAGE_COUNT; i++) {
+        stages[i].minNs = UINT32_MAX;
+    }
+}
+
+bool benchEnabled(void)
+{
+    return benchIterations > 0;
+}
+
+uint32_t loopStageClockNs(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t)now.tv_sec * 1000000000U + (uint32_t)now.tv_nsec;
+}
+
+static uint32_t percentileNs(const benchStage_t *stage, uint32_t perMille)
+{
+    uint64_t rank = ((uint64_t)stage->count * perMille + 999) / 1000;
+    uint64_t seen = 0;
+
+    for (int i = 0; i < BENCH_BUCKET_COUNT; i++) {
+        seen += stage->histogram[i];
+        if (seen >= rank && seen) {
+            // upper edge of the bucket, never better than what was measured
+            uint32_t ns = (i + 1) * BENCH_BUCKET_NS;
+            return ns < stage->maxNs ? ns : stage->maxNs;
+        }
+    }
+    return stage->maxNs;
+}
+
+static void benchWriteReport(void)
+{
+    FILE *file = strcmp(reportFileName, "-") ? fopen(reportFileName, "w") : stdout;
+
+    if (!file) {
+        fprintf(stderr, "[SITL] cannot write %s\n", reportFileName);
+        exit(1);
+    }
+
+    fprintf(file, "{\n  \"target\": \"%s\",\n  \"iterations\": %u,\n  \"looptime_us\": %u,\n  \"motor_checksum\": \"%08x\",\n  \"stages\": {\n",
+        TARGET_BOARD_IDENTIFIER, benchIterations, targetLooptime, motorChecksum);
+
+    for (int i = 0; i < LOOP_STAGE_COUNT; i++) {
+        const benchStage_t *stage = &stages[i];
+        bool first = true;
+
+        fprintf(file, "    \"%s\": {\"calls\": %u, \"mean_ns\": %u, \"min_ns\": %u, \"p50_ns\": %u, \"p99_ns\": %u, \"p999_ns\": %u, \"max_ns\": %u, \"histogram_bucket_ns\": %d, \"histogram\": {",
+            stageNames[i], stage->count, stage->count ? (uint32_t)(stage->totalNs / stage->count) : 0, stage->count ? stage->minNs : 0,
+            percentileNs(stage, 500), percentileNs(stage, 990), percentileNs(stage, 999), stage->maxNs, BENCH_BUCKET_NS);
+
+        // sparse, bucket lower edge in ns to count
+        for (int bucket = 0; bucket < BENCH_BUCKET_COUNT; bucket++) {
+            if (stage->histogram[bucket]) {
+                fprintf(file, "%s\"%d\": %u", first ? "" : ", ", bucket * BENCH_BUCKET_NS, stage->histogram[bucket]);
+                first = false;
+            }
+        }
+        fprintf(file, "}}%s\n", i < LOOP_STAGE_COUNT - 1 ? "," : "");
+    }
+
+    // What is left of a loop period after the slowest loops and the longest analysis step that may run before the next
+    const uint32_t loopNs = percentileNs(&stages[LOOP_STAGE_TOTAL], 999);
+    const uint32_t analyseNs = stages[LOOP_STAGE_GYRO_ANALYSE].maxNs;
+    fprintf(file, "  },\n  \"budget\": {\"looptime_ns\": %u, \"loop_p999_ns\": %u, \"gyro_analyse_max_ns\": %u, \"headroom_ns\": %d}\n}\n",
+        targetLooptime * 1000, loopNs, analyseNs, (int32_t)(targetLooptime * 1000 - loopNs - analyseNs));
+
+    if (file != stdout) {
+        fclose(file);
+    }
+}
+
+void loopStageRecord(loopStage_e stage, uint32_t durationNs)
+{
+    if (!benchIterations || !ARMING_FLAG(ARMED)) {
+        return;
+    }
+
+    benchStage_t *s = &stages[stage];
+    uint32_t bucket = durationNs / BENCH_BUCKET_NS;
+
+    s->count++;
+    s->totalNs += durationNs;
+    if (durationNs < s->minNs) {
+        s->minNs = durationNs;
+    }
+    if (durationNs > s->maxNs) {
+        s->maxNs = durationNs;
+    }
+    s->histogram[bucket < BENCH_BUCKET_COUNT ? bucket : BENCH_BUCKET_COUNT - 1]++;
+
+    if (stage == LOOP_STAGE_TOTAL) {
+        // FNV-1a over the motor outputs, equal between runs unless the flight behaviour changed
+        for (int i = 0; i < SIM_MOTOR_COUNT; i++) {
+            motorChecksum = (motorChecksum ^ (uint16_t)motor[i]) * 16777619U;
+        }
+
+        if (s->count >= benchIterations) {
+            benchWriteReport();
+            exit(0);
+        }
+    }
+}
@@ -0,0 +1,111 @@
+/*
+ * This file is part of Cleanflight.
+ *
+ * Cleanflight is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cleanflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cleanflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Peripherals the simulator does not model: timers, PWM/PPM input, ADC and LEDs.
+ * The motor outputs are in sim_quad.c.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "platform.h"
+
+#include "common/utils.h"
+
+#include "drivers/light_led.h"
+#include "drivers/adc.h"
+#include "drivers/timer.h"
+#include "drivers/pwm_mapping.h"
+#include "drivers/pwm_output.h"
+#include "drivers/pwm_rx.h"
+
+#include "sim_quad.h"
+
+static pwmOutputConfiguration_t pwmOutputConfiguration;
+
+void ledInit(void)
+{
+}
+
+void timerInit(void)
+{
+}
+
+void timerStart(void)
+{
+}
+
+uint16_t adcGetChannel(uint8_t channel)
+{
+    UNUSED(channel);
+    return 0;
+}
+
+pwmOutputConfiguration_t *pwmInit(drv_pwm_config_t *init)
+{
+    memset(&pwmOutputConfiguration, 0, sizeof(pwmOutputConfiguration));
+
+    for (int i = 0; i < SIM_MOTOR_COUNT; i++) {
+        pwmOutputConfiguration.portConfigurations[i].index = i;
+        pwmOutputConfiguration.portConfigurations[i].flags = PWM_PF_MOTOR | (init->useOneshot ? PWM_PF_OUTPUT_PROTOCOL_ONESHOT : PWM_PF_OUTPUT_PROTOCOL_PWM);
+        pwmWriteMotor(i, init->idlePulse);
+    }
+    pwmOutputConfiguration.motorCount = SIM_MOTOR_COUNT;
+    pwmOutputConfiguration.outputCount = SIM_MOTOR_COUNT;
+
+    return &pwmOutputConfiguration;
+}
+
+void pwmShutdownPulsesForAllMotors(uint8_t motorCount)
+{
+    for (int i = 0; i < motorCount; i++) {
+        pwmWriteMotor(i, 0);
+    }
+}
+
+void pwmRxInit(inputFilteringMode_e initialInputFilteringMode)
+{
+    UNUSED(initialInputFilteringMode);
+}
+
+uint16_t pwmRead(uint8_t channel)
+{
+    UNUSED(channel);
+    return 0;
+}
+
+uint16_t ppmRead(uint8_t channel)
+{
+    UNUSED(channel);
+    return 0;
+}
+
+bool isPPMDataBeingReceived(void)
+{
+    return false;
+}
+
+void resetPPMDataReceivedState(void)
+{
+}
+
+bool isPWMDataBeingReceived(void)
+{
+    return false;
+}
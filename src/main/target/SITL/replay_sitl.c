@@ -0,0 +1,667 @@
+/*
+ * This file is part of Cleanflight.
+ *
+ * Cleanflight is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cleanflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cleanflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Blackbox log replay. With SITL_LOG_REPLAY=<log> the simulator does not fly, it feeds the gyroADC, attitude
+ * and rcCommand of every main frame of a recorded log through gyroUpdate() (so the gyro filters of the settings
+ * being tried), pid_controller() and mixTable(), and compares axisPID_P/I/D and motor[] with what was logged.
+ *
+ * Each parameter set in SITL_REPLAY_SETS is replayed in a process of its own, forked once the config is loaded,
+ * so the static state of the PID controller and filters starts from scratch for every set, and up to
+ * SITL_REPLAY_JOBS sets run at once. The sets are then ranked, see docs/development/SITL.md.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "platform.h"
+
+#include "common/axis.h"
+#include "common/maths.h"
+#include "common/utils.h"
+
+#include "drivers/sensor.h"
+#include "drivers/accgyro.h"
+#include "drivers/serial.h"
+#include "drivers/timer.h"
+#include "drivers/pwm_rx.h"
+#include "drivers/gyro_sync.h"
+
+#include "sensors/sensors.h"
+#include "sensors/boardalignment.h"
+#include "sensors/acceleration.h"
+#include "sensors/barometer.h"
+#include "sensors/gyro.h"
+#include "sensors/gyroanalyse.h"
+#include "sensors/battery.h"
+
+#include "rx/rx.h"
+
+#include "io/beeper.h"
+#include "io/escservo.h"
+#include "io/rc_controls.h"
+#include "io/rc_curves.h"
+#include "io/gimbal.h"
+#include "io/serial.h"
+#include "io/serial_cli.h"
+
+#include "telemetry/telemetry.h"
+
+#include "blackbox/blackbox_decoder.h"
+
+#include "flight/mixer.h"
+#include "flight/pid.h"
+#include "flight/imu.h"
+#include "flight/failsafe.h"
+
+#include "config/runtime_config.h"
+#include "config/config.h"
+#include "config/config_profile.h"
+#include "config/config_master.h"
+
+#include "sitl.h"
+
+#define REPLAY_MAX_SETS 256
+#define REPLAY_MAX_SET_LENGTH 256
+#define REPLAY_MAX_MOTORS 8
+
+// Frames after the start of the log or a gap that are left out of the comparison, while the D term median and
+// the filters fill up
+#define REPLAY_WARMUP_FRAMES 16
+// A longer time between frames is a gap in the log, the PID is not run across it with a huge dT
+#define REPLAY_MAX_FRAME_GAP_US 20000
+
+#define REPLAY_GYRO_ANALYSE_PERIOD_US 2000     // how often the scheduler runs the dynamic notch analysis
+
+typedef void (*pidControllerFuncPtr)(pidProfile_t *pidProfile, controlRateConfig_t *controlRateConfig,
+        uint16_t max_angle_inclination, rollAndPitchTrims_t *angleTrim, rxConfig_t *rxConfig);
+
+extern pidControllerFuncPtr pid_controller;
+extern uint8_t PIDweight[3];
+extern uint8_t motorCount;
+extern float dT;
+
+typedef enum {
+    REPLAY_RANK_DIFF = 0,   // closest to the logged output first
+    REPLAY_RANK_NOISE       // quietest motor outputs first
+} replayRank_e;
+
+// Field indexes in the main frames of the log, -1 when not logged
+typedef struct replayFields_s {
+    int time;
+    int gyroADC[XYZ_AXIS_COUNT];
+    int attitude[XYZ_AXIS_COUNT];
+    int rcCommand[4];
+    int axisP[XYZ_AXIS_COUNT];
+    int axisI[XYZ_AXIS_COUNT];
+    int axisD[XYZ_AXIS_COUNT];
+    int motor[REPLAY_MAX_MOTORS];
+    int motorCount;
+    int flightModeFlags;    // in the slow frames
+} replayFields_t;
+
+typedef struct replayResult_s {
+    bool failed;
+    char error[96];
+    uint32_t frames;        // compared with the log
+    float pidRms[XYZ_AXIS_COUNT];   // of axisPID against the logged P + I + D, per axis
+    float termRms[3];       // of the P, I and D terms against the logged ones, over all axes
+    float motorRms;
+    float motorNoise;       // mean change of a motor output from one frame to the next
+} replayResult_t;
+
+typedef struct replayTotals_s {
+    uint32_t frames;
+    double pidSquares[XYZ_AXIS_COUNT];
+    double termSquares[3];
+    double motorSquares;
+    double motorSteps;
+    uint32_t motorStepCount;
+} replayTotals_t;
+
+static const char *logFileName;
+static int logIndex;
+static int jobs;
+static replayRank_e rankBy;
+
+static char sets[REPLAY_MAX_SETS][REPLAY_MAX_SET_LENGTH];
+static int setCount;
+static replayResult_t results[REPLAY_MAX_SETS];
+
+static blackboxDecoder_t decoder;
+static replayFields_t fields;
+static int16_t replayGyroSample[XYZ_AXIS_COUNT];
+
+bool logReplayEnabled(void)
+{
+    logFileName = getenv("SITL_LOG_REPLAY");
+    return logFileName && logFileName[0];
+}
+
+static int readLogFile(void *context, uint8_t *buffer, int length)
+{
+    return fread(buffer, 1, length, (FILE *)context);
+}
+
+// the gyro driver while replaying, every gyroUpdate() reads the gyroADC of the frame being replayed
+static bool replayGyroRead(int16_t *data)
+{
+    memcpy(data, replayGyroSample, sizeof(replayGyroSample));
+    return true;
+}
+
+static void replayFindFields(void)
+{
+    char name[BLACKBOX_DECODER_MAX_FIELD_NAME];
+    int i;
+
+    fields.time = blackboxDecoderFindField(&decoder, BLACKBOX_FRAME_INTRA, "time");
+    for (i = 0; i < XYZ_AXIS_COUNT; i++) {
+        snprintf(name, sizeof(name), "gyroADC[%d]", i);
+        fields.gyroADC[i] = blackboxDecoderFindField(&decoder, BLACKBOX_FRAME_INTRA, name);
+        snprintf(name, sizeof(name), "attitude[%d]", i);
+        fields.attitude[i] = blackboxDecoderFindField(&decoder, BLACKBOX_FRAME_INTRA, name);
+        snprintf(name, sizeof(name), "axisP[%d]", i);
+        fields.axisP[i] = blackboxDecoderFindField(&decoder, BLACKBOX_FRAME_INTRA, name);
+        snprintf(name, sizeof(name), "axisI[%d]", i);
+        fields.axisI[i] = blackboxDecoderFindField(&decoder, BLACKBOX_FRAME_INTRA, name);
+        snprintf(name, sizeof(name), "axisD[%d]", i);
+        fields.axisD[i] = blackboxDecoderFindField(&decoder, BLACKBOX_FRAME_INTRA, name);
+    }
+    for (i = 0; i < 4; i++) {
+        snprintf(name, sizeof(name), "rcCommand[%d]", i);
+        fields.rcCommand[i] = blackboxDecoderFindField(&decoder, BLACKBOX_FRAME_INTRA, name);
+    }
+    for (fields.motorCount = 0; fields.motorCount < REPLAY_MAX_MOTORS; fields.motorCount++) {
+        snprintf(name, sizeof(name), "motor[%d]", fields.motorCount);
+        fields.motor[fields.motorCount] = blackboxDecoderFindField(&decoder, BLACKBOX_FRAME_INTRA, name);
+        if (fields.motor[fields.motorCount] < 0) {
+            break;
+        }
+    }
+    fields.flightModeFlags = blackboxDecoderFindField(&decoder, BLACKBOX_FRAME_SLOW, "flightModeFlags");
+}
+
+// the fields replay can't do without, axisD is only logged while the D gain of the axis is set
+static const char *replayMissingField(void)
+{
+    int i;
+
+    if (fields.time < 0) {
+        return "time";
+    }
+    for (i = 0; i < XYZ_AXIS_COUNT; i++) {
+        if (fields.gyroADC[i] < 0 || fields.attitude[i] < 0 || fields.axisP[i] < 0 || fields.axisI[i] < 0) {
+            return "gyroADC, attitude, axisP or axisI";
+        }
+    }
+    for (i = 0; i < 4; i++) {
+        if (fields.rcCommand[i] < 0) {
+            return "rcCommand";
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Reads the log through to find the fields, the gyro scale and the time between frames, before any set is
+ * replayed. Exits when the log can't be replayed.
+ */
+static void replayScanLog(void)
+{
+    FILE *file = fopen(logFileName, "rb");
+    bool inLog = false;
+    uint32_t frames = 0, firstTime = 0, lastTime = 0;
+    blackboxDecoded_e decoded;
+
+    if (!file) {
+        fprintf(stderr, "[SITL] cannot open %s\n", logFileName);
+        exit(1);
+    }
+
+    blackboxDecoderInit(&decoder, readLogFile, file);
+    while ((decoded = blackboxDecoderNext(&decoder)) != BLACKBOX_DECODED_END) {
+        if (decoder.logIndex + 1 != logIndex) {
+            continue;
+        }
+        if (decoded == BLACKBOX_DECODED_LOG_UNSUPPORTED) {
+            fprintf(stderr, "[SITL] log %d of %s can't be decoded: %s\n", logIndex, logFileName, decoder.error);
+            exit(1);
+        }
+        if (decoded == BLACKBOX_DECODED_LOG_START) {
+            inLog = true;
+            replayFindFields();
+            if (replayMissingField()) {
+                fprintf(stderr, "[SITL] log %d of %s has no %s fields\n", logIndex, logFileName, replayMissingField());
+                exit(1);
+            }
+            if (decoder.gyroScale > 0.0f) {
+                gyro.scale = decoder.gyroScale;
+            }
+        } else if (decoded == BLACKBOX_DECODED_MAIN) {
+            lastTime = decoder.frame.values[fields.time];
+            if (!frames++) {
+                firstTime = lastTime;
+            }
+        } else if (decoded == BLACKBOX_DECODED_LOG_END) {
+            break;
+        }
+    }
+    fclose(file);
+
+    if (!inLog || frames < 2) {
+        fprintf(stderr, "[SITL] %s has no log %d with frames to replay\n", logFileName, logIndex);
+        exit(1);
+    }
+
+    // the loop runs once per logged frame, so the filters and PID see the frame interval as the looptime
+    targetLooptime = (lastTime - firstTime) / (frames - 1);
+
+    printf("[SITL] replaying log %d of %s: %u frames %uus apart, %d motors, %d parameter sets on %d jobs\n",
+        logIndex, logFileName, frames, targetLooptime, fields.motorCount, setCount, jobs);
+}
+
+static void replayReadSets(void)
+{
+    const char *setsFileName = getenv("SITL_REPLAY_SETS");
+    char line[REPLAY_MAX_SET_LENGTH];
+
+    // the first set is the config as it is
+    setCount = 1;
+    sets[0][0] = '\0';
+
+    if (!setsFileName || !setsFileName[0]) {
+        return;
+    }
+
+    FILE *file = fopen(setsFileName, "r");
+    if (!file) {
+        fprintf(stderr, "[SITL] cannot open %s\n", setsFileName);
+        exit(1);
+    }
+
+    while (setCount < REPLAY_MAX_SETS && fgets(line, sizeof(line), file)) {
+        char *comment = strchr(line, '#');
+        char *end;
+
+        if (comment) {
+            *comment = '\0';
+        }
+        for (end = line + strlen(line); end > line && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r' || end[-1] == '\n'); end--) {
+        }
+        *end = '\0';
+
+        if (line[0]) {
+            strcpy(sets[setCount++], line);
+        }
+    }
+    fclose(file);
+}
+
+// "name=value name=value ..." with the names of the CLI set command
+static bool replayApplySet(const char *set, replayResult_t *result)
+{
+    char copy[REPLAY_MAX_SET_LENGTH];
+    char *saveptr;
+    char *assignment;
+
+    strcpy(copy, set);
+    for (assignment = strtok_r(copy, " \t", &saveptr); assignment; assignment = strtok_r(NULL, " \t", &saveptr)) {
+        char *equals = strchr(assignment, '=');
+
+        if (equals) {
+            *equals = '\0';
+        }
+        if (!equals || !cliSetValue(assignment, equals + 1)) {
+            snprintf(result->error, sizeof(result->error), "invalid setting %s", assignment);
+            result->failed = true;
+            return false;
+        }
+    }
+
+    activateConfig();
+    return true;
+}
+
+// The stick position behind a logged rcCommand[THROTTLE], through the throttle curve of updateRcCommands() backwards
+static int16_t replayThrottleStick(int16_t throttleCommand)
+{
+    int tmp, segment;
+
+    if (throttleCommand <= lookupThrottleRC[0]) {
+        // anywhere up to mincheck gives the bottom of the curve, take it as the stick being down
+        return masterConfig.rxConfig.mincheck - 1;
+    }
+    for (segment = 0; segment < THROTTLE_LOOKUP_LENGTH - 2 && throttleCommand > lookupThrottleRC[segment + 1]; segment++) {
+    }
+    tmp = segment * 100;
+    if (lookupThrottleRC[segment + 1] > lookupThrottleRC[segment]) {
+        tmp += MIN(100 * (throttleCommand - lookupThrottleRC[segment]) / (lookupThrottleRC[segment + 1] - lookupThrottleRC[segment]), 100);
+    }
+    return masterConfig.rxConfig.mincheck + tmp * (PWM_RANGE_MAX - masterConfig.rxConfig.mincheck) / PWM_RANGE_MIN;
+}
+
+// PIDweight as updateRcCommands() sets it from the throttle, for the TPA
+static void replayUpdatePidWeight(void)
+{
+    int weight;
+
+    if (rcData[THROTTLE] < currentControlRateProfile->tpa_breakpoint) {
+        weight = 100;
+    } else if (rcData[THROTTLE] < 2000) {
+        weight = 100 - (uint16_t)currentControlRateProfile->dynThrPID * (rcData[THROTTLE] - currentControlRateProfile->tpa_breakpoint) / (2000 - currentControlRateProfile->tpa_breakpoint);
+    } else {
+        weight = 100 - currentControlRateProfile->dynThrPID;
+    }
+
+    PIDweight[ROLL] = weight;
+    PIDweight[PITCH] = weight;
+    PIDweight[YAW] = 100;
+}
+
+static void replayCompare(const int32_t *values, replayTotals_t *totals)
+{
+    static int16_t previousMotor[REPLAY_MAX_MOTORS];
+    int axis, i;
+    int motors = MIN(fields.motorCount, motorCount);
+
+    for (axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        int32_t loggedD = fields.axisD[axis] >= 0 ? values[fields.axisD[axis]] : 0;
+        int32_t loggedPid = values[fields.axisP[axis]] + values[fields.axisI[axis]] + loggedD;
+        double error;
+
+        error = axisPID_P[axis] + axisPID_I[axis] + axisPID_D[axis] - loggedPid;
+        totals->pidSquares[axis] += error * error;
+        error = axisPID_P[axis] - values[fields.axisP[axis]];
+        totals->termSquares[0] += error * error;
+        error = axisPID_I[axis] - values[fields.axisI[axis]];
+        totals->termSquares[1] += error * error;
+        error = axisPID_D[axis] - loggedD;
+        totals->termSquares[2] += error * error;
+    }
+
+    for (i = 0; i < motors; i++) {
+        double error = motor[i] - values[fields.motor[i]];
+
+        totals->motorSquares += error * error;
+        if (totals->frames) {
+            totals->motorSteps += ABS(motor[i] - previousMotor[i]);
+            totals->motorStepCount++;
+        }
+        previousMotor[i] = motor[i];
+    }
+
+    totals->frames++;
+}
+
+static void replayFrame(const int32_t *values, replayTotals_t *totals)
+{
+    static uint32_t previousTime, lastAnalysedAt;
+    static uint32_t warmup = REPLAY_WARMUP_FRAMES;
+    static bool started;
+    uint32_t time = values[fields.time];
+    uint32_t frameDelta = time - previousTime;
+    int axis;
+
+    if (!started || frameDelta == 0 || frameDelta > REPLAY_MAX_FRAME_GAP_US) {
+        frameDelta = targetLooptime;
+        warmup = REPLAY_WARMUP_FRAMES;
+        lastAnalysedAt = time;
+        started = true;
+    }
+    previousTime = time;
+    dT = frameDelta * 0.000001f;
+
+    for (axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        replayGyroSample[axis] = values[fields.gyroADC[axis]];
+        attitude.raw[axis] = values[fields.attitude[axis]];
+    }
+    gyroUpdate();
+
+#ifdef GYRO_DYNAMIC_NOTCH
+    while (time - lastAnalysedAt >= REPLAY_GYRO_ANALYSE_PERIOD_US) {
+        gyroDataAnalyseUpdate();
+        lastAnalysedAt += REPLAY_GYRO_ANALYSE_PERIOD_US;
+    }
+#endif
+
+    for (axis = 0; axis < 4; axis++) {
+        rcCommand[axis] = values[fields.rcCommand[axis]];
+    }
+    rcData[THROTTLE] = replayThrottleStick(rcCommand[THROTTLE]);
+    replayUpdatePidWeight();
+
+    // the I term is reset with the throttle down, as processRx() does without air mode
+    if (calculateThrottleStatus(&masterConfig.rxConfig, masterConfig.flight3DConfig.deadband3d_throttle) == THROTTLE_LOW) {
+        pidResetErrorGyro();
+    }
+
+    pid_controller(
+        &currentProfile->pidProfile,
+        currentControlRateProfile,
+        masterConfig.max_angle_inclination,
+        &currentProfile->accelerometerTrims,
+        &masterConfig.rxConfig
+    );
+    mixTable();
+
+    if (warmup) {
+        warmup--;
+    } else {
+        replayCompare(values, totals);
+    }
+}
+
+static void replaySet(const char *set, replayResult_t *result)
+{
+    replayTotals_t totals;
+    blackboxDecoded_e decoded;
+    FILE *file;
+    int axis, term;
+
+    memset(&totals, 0, sizeof(totals));
+
+    if (!replayApplySet(set, result)) {
+        return;
+    }
+
+    file = fopen(logFileName, "rb");
+    if (!file) {
+        snprintf(result->error, sizeof(result->error), "cannot open the log");
+        result->failed = true;
+        return;
+    }
+
+    blackboxDecoderInit(&decoder, readLogFile, file);
+    while ((decoded = blackboxDecoderNext(&decoder)) != BLACKBOX_DECODED_END) {
+        if (decoder.logIndex + 1 != logIndex) {
+            continue;
+        }
+        if (decoded == BLACKBOX_DECODED_MAIN) {
+            replayFrame(decoder.frame.values, &totals);
+        } else if (decoded == BLACKBOX_DECODED_SLOW && fields.flightModeFlags >= 0) {
+            flightModeFlags = decoder.frame.values[fields.flightModeFlags];
+        } else if (decoded == BLACKBOX_DECODED_LOG_END) {
+            break;
+        }
+    }
+    fclose(file);
+
+    result->frames = totals.frames;
+    if (!totals.frames) {
+        return;
+    }
+    for (axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        result->pidRms[axis] = sqrt(totals.pidSquares[axis] / totals.frames);
+    }
+    for (term = 0; term < 3; term++) {
+        result->termRms[term] = sqrt(totals.termSquares[term] / (totals.frames * XYZ_AXIS_COUNT));
+    }
+    if (fields.motorCount && motorCount) {
+        result->motorRms = sqrt(totals.motorSquares / (totals.frames * MIN(fields.motorCount, motorCount)));
+    }
+    if (totals.motorStepCount) {
+        result->motorNoise = totals.motorSteps / totals.motorStepCount;
+    }
+}
+
+static float replayRankKey(const replayResult_t *result)
+{
+    if (result->failed || !result->frames) {
+        return INFINITY;
+    }
+    if (rankBy == REPLAY_RANK_NOISE) {
+        return result->motorNoise;
+    }
+    return result->pidRms[ROLL] + result->pidRms[PITCH] + result->pidRms[YAW] + result->motorRms;
+}
+
+static int compareResults(const void *a, const void *b)
+{
+    float keyA = replayRankKey(&results[*(const int *)a]);
+    float keyB = replayRankKey(&results[*(const int *)b]);
+
+    if (keyA != keyB) {
+        return keyA < keyB ? -1 : 1;
+    }
+    return *(const int *)a - *(const int *)b;
+}
+
+static void replayPrintRanking(void)
+{
+    int order[REPLAY_MAX_SETS];
+    int i;
+
+    for (i = 0; i < setCount; i++) {
+        order[i] = i;
+    }
+    qsort(order, setCount, sizeof(order[0]), compareResults);
+
+    printf("rank  set   frames  pid_rms_roll  pid_rms_pitch  pid_rms_yaw   p_rms   i_rms   d_rms  motor_rms  motor_noise  settings\n");
+    for (i = 0; i < setCount; i++) {
+        const replayResult_t *result = &results[order[i]];
+        const char *settings = order[i] ? sets[order[i]] : "(as configured)";
+
+        if (result->failed) {
+            printf("%4d  %3d  %s: %s\n", i + 1, order[i], result->error, settings);
+            continue;
+        }
+        printf("%4d  %3d  %7u  %12.2f  %13.2f  %11.2f  %6.2f  %6.2f  %6.2f  %9.2f  %11.2f  %s\n",
+            i + 1, order[i], result->frames,
+            (double)result->pidRms[ROLL], (double)result->pidRms[PITCH], (double)result->pidRms[YAW],
+            (double)result->termRms[0], (double)result->termRms[1], (double)result->termRms[2],
+            (double)result->motorRms, (double)result->motorNoise, settings);
+    }
+}
+
+/*
+ * Called in place of the scheduler loop once init() has loaded the config, does not return.
+ */
+void logReplayRun(void)
+{
+    pid_t workers[REPLAY_MAX_SETS];
+    int resultPipes[REPLAY_MAX_SETS];
+    int started = 0, running = 0;
+    boardAlignment_t noBoardAlignment;
+
+    logIndex = sitlEnvInt("SITL_REPLAY_INDEX", 1);
+    jobs = sitlEnvInt("SITL_REPLAY_JOBS", sysconf(_SC_NPROCESSORS_ONLN));
+    jobs = MAX(jobs, 1);
+    rankBy = getenv("SITL_REPLAY_RANK") && strcmp(getenv("SITL_REPLAY_RANK"), "noise") == 0 ? REPLAY_RANK_NOISE : REPLAY_RANK_DIFF;
+
+    replayReadSets();
+    replayScanLog();
+
+    // the logged gyroADC is already aligned, calibrated and through the filters the log was flown with, so only
+    // the filters a set asks for are run on it
+    currentProfile->pidProfile.gyro_fir_level = 0;
+    currentProfile->pidProfile.gyro_lpf_hz = 0;
+    currentProfile->pidProfile.gyro_notch_hz = 0;
+#ifdef GYRO_DYNAMIC_NOTCH
+    currentProfile->pidProfile.gyro_dyn_notch_min_hz = 0;
+#endif
+    useGyroConfig(&masterConfig.gyroConfig, &currentProfile->pidProfile);
+
+    gyro.read = replayGyroRead;
+    gyro.readBatch = NULL;
+    gyroAlign = CW0_DEG;
+    memset(&noBoardAlignment, 0, sizeof(noBoardAlignment));
+    initBoardAlignment(&noBoardAlignment);
+    gyroSetCalibrationCycles(0);
+    memset(gyroZero, 0, sizeof(gyroZero));
+
+    // blackbox only logs while armed
+    ENABLE_ARMING_FLAG(ARMED);
+
+    fflush(NULL);
+
+    while (started < setCount || running) {
+        if (started < setCount && running < jobs) {
+            int fds[2];
+
+            if (pipe(fds) != 0) {
+                perror("[SITL] pipe");
+                exit(1);
+            }
+            workers[started] = fork();
+            if (workers[started] == 0) {
+                replayResult_t result;
+
+                close(fds[0]);
+                memset(&result, 0, sizeof(result));
+                replaySet(sets[started], &result);
+                if (write(fds[1], &result, sizeof(result)) != sizeof(result)) {
+                    _exit(1);
+                }
+                _exit(0);
+            }
+            if (workers[started] < 0) {
+                perror("[SITL] fork");
+                exit(1);
+            }
+            close(fds[1]);
+            resultPipes[started++] = fds[0];
+            running++;
+            continue;
+        }
+
+        pid_t done = wait(NULL);
+        for (int i = 0; i < started; i++) {
+            if (workers[i] == done) {
+                if (read(resultPipes[i], &results[i], sizeof(results[i])) != sizeof(results[i])) {
+                    results[i].failed = true;
+                    snprintf(results[i].error, sizeof(results[i].error), "replay process died");
+                }
+                close(resultPipes[i]);
+                running--;
+            }
+        }
+    }
+
+    replayPrintRanking();
+
+    // nothing was simulated, leave out the simulator summary
+    fflush(NULL);
+    _exit(0);
+}
@@ -0,0 +1,244 @@
+/*
+ * This file is part of Cleanflight.
+ *
+ * Cleanflight is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cleanflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cleanflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * The USB VCP of the simulator is a TCP server, so the configurator or a terminal
+ * can talk MSP and CLI to it, e.g. "socat - TCP:localhost:5761".
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include "platform.h"
+
+#include "common/maths.h"
+#include "common/utils.h"
+
+#include "drivers/serial.h"
+#include "drivers/serial_usb_vcp.h"
+
+#include "sitl.h"
+
+#define SITL_TCP_PORT_DEFAULT 5761
+#define TCP_RX_BUFFER_SIZE 256
+
+static vcpPort_t vcpPort;
+
+static int listenSocket = -1;
+static int clientSocket = -1;
+
+static uint8_t rxBuffer[TCP_RX_BUFFER_SIZE];
+
+static void tcpAccept(void)
+{
+    if (clientSocket >= 0 || listenSocket < 0) {
+        return;
+    }
+
+    clientSocket = accept(listenSocket, NULL, NULL);
+    if (clientSocket >= 0) {
+        int one = 1;
+        fcntl(clientSocket, F_SETFL, O_NONBLOCK);
+        fcntl(clientSocket, F_SETFD, FD_CLOEXEC);
+        setsockopt(clientSocket, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        printf("[SITL] serial client connected\n");
+    }
+}
+
+static void tcpDisconnect(void)
+{
+    close(clientSocket);
+    clientSocket = -1;
+    printf("[SITL] serial client disconnected\n");
+}
+
+static void tcpPoll(serialPort_t *instance)
+{
+    tcpAccept();
+    if (clientSocket < 0) {
+        return;
+    }
+
+    uint32_t used = (instance->rxBufferHead - instance->rxBufferTail) % instance->rxBufferSize;
+    uint32_t space = instance->rxBufferSize - 1 - used;
+
+    while (space) {
+        uint32_t chunk = instance->rxBufferSize - instance->rxBufferHead;
+        if (chunk > space) {
+            chunk = space;
+        }
+
+        ssize_t received = recv(clientSocket, (uint8_t *)&instance->rxBuffer[instance->rxBufferHead], chunk, 0);
+        if (received == 0 || (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+            tcpDisconnect();
+            return;
+        }
+        if (received < 0) {
+            return;
+        }
+
+        instance->rxBufferHead = (instance->rxBufferHead + received) % instance->rxBufferSize;
+        space -= received;
+    }
+}
+
+static void tcpFlush(vcpPort_t *port)
+{
+    uint8_t count = port->txAt;
+    port->txAt = 0;
+
+    if (count == 0 || clientSocket < 0) {
+        return;
+    }
+
+    if (send(clientSocket, port->txBuf, count, MSG_NOSIGNAL) < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+        tcpDisconnect();
+    }
+}
+
+static void tcpSetBaudRate(serialPort_t *instance, uint32_t baudRate)
+{
+    instance->baudRate = baudRate;
+}
+
+static void tcpSetMode(serialPort_t *instance, portMode_t mode)
+{
+    instance->mode = mode;
+}
+
+static bool isTcpTransmitBufferEmpty(serialPort_t *instance)
+{
+    UNUSED(instance);
+    return true;
+}
+
+static uint32_t tcpTotalRxWaiting(serialPort_t *instance)
+{
+    tcpPoll(instance);
+
+    return (instance->rxBufferHead - instance->rxBufferTail) % instance->rxBufferSize;
+}
+
+static uint32_t tcpTotalTxFree(serialPort_t *instance)
+{
+    UNUSED(instance);
+    // Like the VCP, writes go straight out and are never held back
+    return 255;
+}
+
+static uint8_t tcpRead(serialPort_t *instance)
+{
+    uint8_t ch = instance->rxBuffer[instance->rxBufferTail];
+    instance->rxBufferTail = (instance->rxBufferTail + 1) % instance->rxBufferSize;
+    return ch;
+}
+
+static void tcpWrite(serialPort_t *instance, uint8_t c)
+{
+    vcpPort_t *port = container_of(instance, vcpPort_t, port);
+
+    port->txBuf[port->txAt++] = c;
+    if (!port->buffering || port->txAt >= ARRAYLEN(port->txBuf)) {
+        tcpFlush(port);
+    }
+}
+
+static uint32_t tcpReadBuf(serialPort_t *instance, uint8_t *data, uint32_t count)
+{
+    tcpPoll(instance);
+
+    return serialBufferRead(instance, data, count);
+}
+
+// As the VCP, through the packet buffer a part at a time
+static void tcpWriteBuf(serialPort_t *instance, const uint8_t *data, uint32_t count)
+{
+    vcpPort_t *port = container_of(instance, vcpPort_t, port);
+
+    while (count) {
+        const uint32_t span = MIN(count, ARRAYLEN(port->txBuf) - port->txAt);
+
+        memcpy(&port->txBuf[port->txAt], data, span);
+        port->txAt += span;
+        data += span;
+        count -= span;
+        if (port->txAt >= ARRAYLEN(port->txBuf)) {
+            tcpFlush(port);
+        }
+    }
+
+    if (!port->buffering) {
+        tcpFlush(port);
+    }
+}
+
+static void tcpBeginWrite(serialPort_t *instance)
+{
+    vcpPort_t *port = container_of(instance, vcpPort_t, port);
+    port->buffering = true;
+}
+
+static void tcpEndWrite(serialPort_t *instance)
+{
+    vcpPort_t *port = container_of(instance, vcpPort_t, port);
+    port->buffering = false;
+    tcpFlush(port);
+}
+
+static const struct serialPortVTable tcpVTable[] = { { tcpWrite, tcpTotalRxWaiting, tcpTotalTxFree, tcpRead, tcpSetBaudRate, isTcpTransmitBufferEmpty, tcpSetMode, tcpBeginWrite, tcpEndWrite, tcpWriteBuf, tcpReadBuf } };
+
+serialPort_t *usbVcpOpen(void)
+{
+    vcpPort_t *s = &vcpPort;
+    int tcpPort = sitlEnvInt("SITL_TCP_PORT", SITL_TCP_PORT_DEFAULT);
+
+    if (tcpPort > 0 && listenSocket < 0) {
+        struct sockaddr_in address;
+        int one = 1;
+
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = htons(tcpPort);
+
+        listenSocket = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        setsockopt(listenSocket, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (bind(listenSocket, (struct sockaddr *)&address, sizeof(address)) < 0 || listen(listenSocket, 1) < 0) {
+            fprintf(stderr, "[SITL] cannot listen on port %d: %s\n", tcpPort, strerror(errno));
+            close(listenSocket);
+            listenSocket = -1;
+        } else {
+            printf("[SITL] serial port on tcp://127.0.0.1:%d\n", tcpPort);
+        }
+    }
+
+    s->port.vTable = tcpVTable;
+    s->port.rxBuffer = rxBuffer;
+    s->port.rxBufferSize = TCP_RX_BUFFER_SIZE;
+    s->port.rxBufferHead = s->port.rxBufferTail = 0;
+    s->port.mode = MODE_RXTX;
+
+    return (serialPort_t *)s;
+}
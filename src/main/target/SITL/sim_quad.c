@@ -0,0 +1,488 @@
+/*
+ * This file is part of Cleanflight.
+ *
+ * Cleanflight is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cleanflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cleanflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Rigid body model of a 250 class quad X, closing the loop around the flight code.
+ *
+ * The body frame is x forward, y left, z up, which is also the frame the flight controller
+ * sees on the gyro and accelerometer after alignment: a positive roll PID output raises the
+ * left motors and produces a positive roll rate, a positive pitch PID output raises the
+ * rear motors and produces a positive (nose down) pitch rate.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "platform.h"
+
+#include "common/axis.h"
+#include "common/maths.h"
+#include "common/utils.h"
+
+#include "drivers/sensor.h"
+#include "drivers/accgyro.h"
+#include "drivers/pwm_output.h"
+#include "drivers/gyro_sync.h"
+#include "drivers/system.h"
+
+#include "sensors/sensors.h"
+
+#include "rx/rx.h"
+#include "rx/msp.h"
+
+#include "config/runtime_config.h"
+
+#include "sitl.h"
+#include "sim_quad.h"
+
+#define GRAVITY_MSS 9.80665f
+
+#define SIM_MASS_KG 0.5f
+#define SIM_ARM_M 0.087f            // motor offset along x and y, 250mm diagonal
+#define SIM_INERTIA_XX 0.0022f      // kg m^2
+#define SIM_INERTIA_YY 0.0022f
+#define SIM_INERTIA_ZZ 0.0040f
+#define SIM_MOTOR_THRUST_MAX_N 4.0f
+#define SIM_MOTOR_TIME_CONSTANT_S 0.02f
+#define SIM_YAW_TORQUE_PER_N 0.016f // rotor drag torque per newton of thrust
+#define SIM_RATE_DAMPING 0.0005f    // N m s / rad, aerodynamic damping of the body rates
+#define SIM_LINEAR_DRAG 0.1f        // N s / m
+
+// Samples per data ready signal, averaged by the read as done by mpuGyroReadCollect(), or all read at once from the
+// FIFO with USE_MPU_FIFO
+#define SIM_GYRO_SAMPLES_PER_READ 2
+
+// MPU6xxx scaling so the rest of the flight code sees familiar raw values
+#define SIM_GYRO_LSB_PER_DPS 16.4f
+#define SIM_ACC_1G (512 * 8)
+
+#define SIM_RC_FRAME_PERIOD_US 20000
+
+typedef struct simMotor_s {
+    float x;            // m, position in the body frame
+    float y;
+    float yawTorque;    // reaction torque direction
+} simMotor_t;
+
+// Geometry matching mixerQuadX with the default yaw_motor_direction
+static const simMotor_t simMotors[SIM_MOTOR_COUNT] = {
+    { -SIM_ARM_M, -SIM_ARM_M,  1.0f },     // REAR_R
+    {  SIM_ARM_M, -SIM_ARM_M, -1.0f },     // FRONT_R
+    { -SIM_ARM_M,  SIM_ARM_M, -1.0f },     // REAR_L
+    {  SIM_ARM_M,  SIM_ARM_M,  1.0f },     // FRONT_L
+};
+
+simQuadState_t simQuad;
+
+static uint16_t motorCommand[SIM_MOTOR_COUNT];
+
+static uint32_t simTime;
+static float gyroNoiseDps;
+static uint32_t noiseSeed = 22695477;
+
+static int32_t gyroSampleSum[XYZ_AXIS_COUNT];
+static uint8_t gyroSampleCount;
+static int16_t gyroLatched[XYZ_AXIS_COUNT];
+#ifdef USE_MPU_FIFO
+static int16_t gyroFifo[GYRO_BATCH_MAX_SAMPLES][XYZ_AXIS_COUNT];
+static uint8_t gyroFifoCount;
+#endif
+static int16_t accLatched[XYZ_AXIS_COUNT];
+static volatile bool gyroDataReady;
+
+// Raw sensor samples, gyro then acc, one record per gyro sample period
+static FILE *recordFile;
+static FILE *replayFile;
+
+static bool pilotEnabled;
+static uint32_t pilotNextFrameAt;
+static float pilotAltitudeTarget;
+static float pilotRollTarget;
+static float pilotAltitudeIntegral;
+
+static uint32_t armedTime;
+static float maxAltitude;
+static float attitudeErrorSquareSum;
+static uint32_t attitudeErrorSamples;
+static uint32_t gyroReadCount;
+
+static float simNoise(void)
+{
+    // sum of uniforms, good enough and repeatable across hosts
+    float sum = 0;
+    for (int i = 0; i < 4; i++) {
+        noiseSeed = noiseSeed * 1664525 + 1013904223;
+        sum += (float)(noiseSeed >> 8) / (float)(1 << 24) - 0.5f;
+    }
+    return sum;
+}
+
+static void quaternionToRotation(const float q[4], float r[3][3])
+{
+    float q0 = q[0], q1 = q[1], q2 = q[2], q3 = q[3];
+
+    r[0][0] = 1 - 2 * (q2 * q2 + q3 * q3);
+    r[0][1] = 2 * (q1 * q2 - q0 * q3);
+    r[0][2] = 2 * (q1 * q3 + q0 * q2);
+    r[1][0] = 2 * (q1 * q2 + q0 * q3);
+    r[1][1] = 1 - 2 * (q1 * q1 + q3 * q3);
+    r[1][2] = 2 * (q2 * q3 - q0 * q1);
+    r[2][0] = 2 * (q1 * q3 - q0 * q2);
+    r[2][1] = 2 * (q2 * q3 + q0 * q1);
+    r[2][2] = 1 - 2 * (q1 * q1 + q2 * q2);
+}
+
+static void simQuadEulerAngles(float *roll, float *pitch)
+{
+    float r[3][3];
+
+    quaternionToRotation(simQuad.q, r);
+    *roll = atan2f(r[2][1], r[2][2]);
+    *pitch = -asinf(constrainf(r[2][0], -1.0f, 1.0f));
+}
+
+static void simQuadStep(float dt)
+{
+    float r[3][3];
+    float force[3];
+    float torque[3] = { 0, 0, 0 };
+    float totalThrust = 0;
+
+    for (int i = 0; i < SIM_MOTOR_COUNT; i++) {
+        float throttle = constrainf((motorCommand[i] - 1000) / 1000.0f, 0.0f, 1.0f);
+        float target = SIM_MOTOR_THRUST_MAX_N * throttle * throttle;
+
+        simQuad.thrust[i] += (target - simQuad.thrust[i]) * dt / SIM_MOTOR_TIME_CONSTANT_S;
+        totalThrust += simQuad.thrust[i];
+
+        // r x F with F along body z
+        torque[X] += simMotors[i].y * simQuad.thrust[i];
+        torque[Y] -= simMotors[i].x * simQuad.thrust[i];
+        torque[Z] += simMotors[i].yawTorque * SIM_YAW_TORQUE_PER_N * simQuad.thrust[i];
+    }
+
+    const float inertia[3] = { SIM_INERTIA_XX, SIM_INERTIA_YY, SIM_INERTIA_ZZ };
+    float *w = simQuad.rate;
+    float h[3] = { inertia[X] * w[X], inertia[Y] * w[Y], inertia[Z] * w[Z] };
+
+    // Euler's equations, including the gyroscopic coupling w x (I w)
+    torque[X] -= w[Y] * h[Z] - w[Z] * h[Y] + SIM_RATE_DAMPING * w[X];
+    torque[Y] -= w[Z] * h[X] - w[X] * h[Z] + SIM_RATE_DAMPING * w[Y];
+    torque[Z] -= w[X] * h[Y] - w[Y] * h[X] + SIM_RATE_DAMPING * w[Z];
+
+    for (int axis = 0; axis < 3; axis++) {
+        w[axis] += torque[axis] / inertia[axis] * dt;
+    }
+
+    // q' = 1/2 q x (0, w)
+    float *q = simQuad.q;
+    float dq[4] = {
+        0.5f * (-q[1] * w[X] - q[2] * w[Y] - q[3] * w[Z]),
+        0.5f * ( q[0] * w[X] + q[2] * w[Z] - q[3] * w[Y]),
+        0.5f * ( q[0] * w[Y] - q[1] * w[Z] + q[3] * w[X]),
+        0.5f * ( q[0] * w[Z] + q[1] * w[Y] - q[2] * w[X])
+    };
+    float norm = 0;
+    for (int i = 0; i < 4; i++) {
+        q[i] += dq[i] * dt;
+        norm += q[i] * q[i];
+    }
+    norm = 1.0f / sqrtf(norm);
+    for (int i = 0; i < 4; i++) {
+        q[i] *= norm;
+    }
+
+    quaternionToRotation(q, r);
+
+    for (int axis = 0; axis < 3; axis++) {
+        force[axis] = r[axis][Z] * totalThrust - SIM_LINEAR_DRAG * simQuad.velocity[axis];
+    }
+
+    float accel[3] = { force[X] / SIM_MASS_KG, force[Y] / SIM_MASS_KG, force[Z] / SIM_MASS_KG - GRAVITY_MSS };
+
+    if (simQuad.position[Z] <= 0.0f && accel[Z] <= 0.0f) {
+        // resting on the ground, keep the heading and drop everything else
+        float yaw = atan2f(r[1][0], r[0][0]);
+
+        simQuad.position[Z] = 0;
+        memset(simQuad.velocity, 0, sizeof(simQuad.velocity));
+        memset(simQuad.rate, 0, sizeof(simQuad.rate));
+        memset(accel, 0, sizeof(accel));
+        simQuad.q[0] = cosf(yaw / 2);
+        simQuad.q[1] = 0;
+        simQuad.q[2] = 0;
+        simQuad.q[3] = sinf(yaw / 2);
+        quaternionToRotation(simQuad.q, r);
+    } else {
+        for (int axis = 0; axis < 3; axis++) {
+            simQuad.velocity[axis] += accel[axis] * dt;
+            simQuad.position[axis] += simQuad.velocity[axis] * dt;
+        }
+    }
+
+    // the accelerometer measures the specific force, rotated into the body frame
+    float specificForce[3] = { accel[X], accel[Y], accel[Z] + GRAVITY_MSS };
+    for (int axis = 0; axis < 3; axis++) {
+        simQuad.specificForce[axis] = r[X][axis] * specificForce[X] + r[Y][axis] * specificForce[Y] + r[Z][axis] * specificForce[Z];
+    }
+}
+
+static void simGyroSample(void)
+{
+    int16_t sample[XYZ_AXIS_COUNT * 2];
+
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        float dps = simQuad.rate[axis] * (180.0f / M_PIf) + gyroNoiseDps * simNoise();
+        sample[axis] = constrain(lrintf(dps * SIM_GYRO_LSB_PER_DPS), INT16_MIN, INT16_MAX);
+        sample[XYZ_AXIS_COUNT + axis] = constrain(lrintf(simQuad.specificForce[axis] * (SIM_ACC_1G / GRAVITY_MSS)), INT16_MIN, INT16_MAX);
+    }
+
+    if (replayFile) {
+        // a recording shorter than the run is played in a loop
+        if (fread(sample, sizeof(sample), 1, replayFile) != 1) {
+            rewind(replayFile);
+            if (fread(sample, sizeof(sample), 1, replayFile) != 1) {
+                memset(sample, 0, sizeof(sample));
+            }
+        }
+    }
+    if (recordFile) {
+        fwrite(sample, sizeof(sample), 1, recordFile);
+    }
+
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        gyroSampleSum[axis] += sample[axis];
+        accLatched[axis] = sample[XYZ_AXIS_COUNT + axis];
+    }
+
+#ifdef USE_MPU_FIFO
+    // a full FIFO keeps the oldest samples, like the MPU
+    if (gyroFifoCount < GYRO_BATCH_MAX_SAMPLES) {
+        memcpy(gyroFifo[gyroFifoCount++], sample, sizeof(gyroFifo[0]));
+    }
+#endif
+
+    if (++gyroSampleCount >= SIM_GYRO_SAMPLES_PER_READ) {
+        for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+            gyroLatched[axis] = gyroSampleSum[axis] / gyroSampleCount;
+            gyroSampleSum[axis] = 0;
+        }
+        gyroSampleCount = 0;
+        gyroDataReadyAt = simTime;
+        gyroDataReady = true;
+    }
+}
+
+void simQuadInit(void)
+{
+    memset(&simQuad, 0, sizeof(simQuad));
+    simQuad.q[0] = 1.0f;
+
+    for (int i = 0; i < SIM_MOTOR_COUNT; i++) {
+        motorCommand[i] = 1000;
+    }
+
+    gyroNoiseDps = sitlEnvFloat("SITL_GYRO_NOISE", 2.0f);
+    pilotEnabled = sitlEnvInt("SITL_PILOT", 1) != 0;
+    pilotAltitudeTarget = sitlEnvFloat("SITL_PILOT_ALTITUDE", 1.5f);
+    simTime = 0;
+
+    const char *fileName = getenv("SITL_RECORD");
+    if (fileName && !(recordFile = fopen(fileName, "wb"))) {
+        fprintf(stderr, "[SITL] cannot record to %s\n", fileName);
+    }
+    fileName = getenv("SITL_REPLAY");
+    if (fileName && !(replayFile = fopen(fileName, "rb"))) {
+        fprintf(stderr, "[SITL] cannot replay %s\n", fileName);
+    }
+}
+
+void simQuadUpdate(uint32_t currentTime)
+{
+    while ((int32_t)(currentTime - simTime) >= SITL_GYRO_SAMPLE_PERIOD_US) {
+        simTime += SITL_GYRO_SAMPLE_PERIOD_US;
+        simQuadStep(SITL_GYRO_SAMPLE_PERIOD_US * 1e-6f);
+        simGyroSample();
+
+        if (pilotEnabled && (int32_t)(simTime - pilotNextFrameAt) >= 0) {
+            pilotNextFrameAt = simTime + SIM_RC_FRAME_PERIOD_US;
+            simPilotUpdate(simTime);
+        }
+    }
+}
+
+/*
+ * The pilot flies the quad in the default rate mode using the true state of the model:
+ * an angle loop on the roll and pitch sticks and an altitude loop on the throttle,
+ * with a square wave on the roll target to keep the rate controller busy.
+ */
+void simPilotUpdate(uint32_t currentTime)
+{
+    // AETR channel order, the default rcmap
+    uint16_t frame[8] = { 1500, 1500, 1000, 1500, 1000, 1000, 1000, 1000 };
+    float seconds = currentTime * 1e-6f;
+    float roll, pitch;
+
+    simQuadEulerAngles(&roll, &pitch);
+
+    if (!ARMING_FLAG(ARMED)) {
+        if (seconds > 3.0f) {
+            frame[3] = 2000;    // throttle low, yaw right
+        }
+        rxMspFrameReceive(frame, ARRAYLEN(frame));
+        return;
+    }
+
+    armedTime += SIM_RC_FRAME_PERIOD_US;
+    pilotRollTarget = ((armedTime / 2000000) & 1) ? 15.0f : -15.0f;
+    if (simQuad.position[Z] < 0.5f) {
+        pilotRollTarget = 0;   // level out for the take off
+    }
+
+    float rollError = pilotRollTarget - roll * (180.0f / M_PIf);
+    float pitchError = -pitch * (180.0f / M_PIf);
+    float altitudeError = pilotAltitudeTarget - simQuad.position[Z];
+
+    pilotAltitudeIntegral = constrainf(pilotAltitudeIntegral + altitudeError * (SIM_RC_FRAME_PERIOD_US * 1e-6f), -5.0f, 5.0f);
+
+    frame[0] = constrain(1500 + lrintf(rollError * 12.0f), 1000, 2000);
+    frame[1] = constrain(1500 + lrintf(pitchError * 12.0f), 1000, 2000);
+    frame[2] = constrain(1500 + lrintf(altitudeError * 150.0f + pilotAltitudeIntegral * 60.0f - simQuad.velocity[Z] * 100.0f), 1200, 1900);
+
+    if (simQuad.position[Z] >= 0.5f) {
+        attitudeErrorSquareSum += rollError * rollError + pitchError * pitchError;
+        attitudeErrorSamples++;
+    }
+    if (simQuad.position[Z] > maxAltitude) {
+        maxAltitude = simQuad.position[Z];
+    }
+
+    rxMspFrameReceive(frame, ARRAYLEN(frame));
+}
+
+void simQuadPrintSummary(void)
+{
+    float roll, pitch;
+
+    simQuadEulerAngles(&roll, &pitch);
+
+    printf("sim: t=%.3fs gyro_reads=%u armed=%.1fs alt=%.2fm max_alt=%.2fm roll=%.1f pitch=%.1f attitude_rms_error=%.2fdeg\n",
+        (double)(simTime * 1e-6f), gyroReadCount, (double)(armedTime * 1e-6f), (double)simQuad.position[Z], (double)maxAltitude,
+        (double)(roll * (180.0f / M_PIf)), (double)(pitch * (180.0f / M_PIf)),
+        attitudeErrorSamples ? (double)sqrtf(attitudeErrorSquareSum / attitudeErrorSamples) : 0.0);
+}
+
+/*
+ * Drivers
+ */
+
+void pwmWriteMotor(uint8_t index, uint16_t value)
+{
+    if (index < SIM_MOTOR_COUNT) {
+        motorCommand[index] = value;
+    }
+}
+
+void pwmCompleteOneshotMotorUpdate(uint8_t motorCount)
+{
+    UNUSED(motorCount);
+}
+
+void pwmWriteServo(uint8_t index, uint16_t value)
+{
+    UNUSED(index);
+    UNUSED(value);
+}
+
+static void simGyroInit(uint8_t lpf)
+{
+    UNUSED(lpf);
+}
+
+static bool simGyroRead(int16_t *gyroADC)
+{
+    gyroReadCount++;
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        gyroADC[axis] = gyroLatched[axis];
+    }
+    return true;
+}
+
+#ifdef USE_MPU_FIFO
+static uint8_t simGyroReadBatch(int16_t (*samples)[3], uint8_t maxSamples)
+{
+    uint8_t sampleCount = MIN(gyroFifoCount, maxSamples);
+
+    gyroReadCount++;
+    memcpy(samples, gyroFifo, sampleCount * sizeof(gyroFifo[0]));
+    memmove(gyroFifo, gyroFifo[sampleCount], (gyroFifoCount - sampleCount) * sizeof(gyroFifo[0]));
+    gyroFifoCount -= sampleCount;
+    return sampleCount;
+}
+#endif
+
+static bool simGyroReadTemp(int16_t *tempData)
+{
+    *tempData = 250;    // 25.0 degrees, like the MPU in deci-degrees
+    return true;
+}
+
+static void simGyroIntStatus(bool *dataReady)
+{
+    simQuadUpdate(micros());
+
+    *dataReady = gyroDataReady;
+    gyroDataReady = false;
+}
+
+bool fakeGyroDetect(gyro_t *gyro)
+{
+    gyro->init = simGyroInit;
+    gyro->read = simGyroRead;
+#ifdef USE_MPU_FIFO
+    gyro->readBatch = simGyroReadBatch;
+#endif
+    gyro->temperature = simGyroReadTemp;
+    gyro->intStatus = simGyroIntStatus;
+    gyro->scale = 1.0f / SIM_GYRO_LSB_PER_DPS;
+    return true;
+}
+
+static void simAccInit(void)
+{
+    acc_1G = SIM_ACC_1G;
+}
+
+static bool simAccRead(int16_t *accData)
+{
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        accData[axis] = accLatched[axis];
+    }
+    return true;
+}
+
+bool fakeAccDetect(acc_t *acc)
+{
+    acc->init = simAccInit;
+    acc->read = simAccRead;
+    acc->revisionCode = 0;
+    return true;
+}
@@ -0,0 +1,41 @@
+/*
+ * This file is part of Cleanflight.
+ *
+ * Cleanflight is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cleanflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cleanflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#define SIM_MOTOR_COUNT 4
+
+typedef struct simQuadState_s {
+    float position[3];          // m, earth frame, z up
+    float velocity[3];          // m/s, earth frame
+    float q[4];                 // attitude quaternion, body to earth
+    float rate[3];              // rad/s, body frame, same axes as the flight controller gyro
+    float thrust[SIM_MOTOR_COUNT];  // N, per motor after the motor lag
+    float specificForce[3];     // m/s^2, body frame, what the accelerometer measures
+} simQuadState_t;
+
+extern simQuadState_t simQuad;
+
+void simQuadInit(void);
+
+// Advance the physics up to currentTime, raising the gyro data ready signal for every sample period crossed
+void simQuadUpdate(uint32_t currentTime);
+
+// Scripted pilot, feeds the MSP receiver, see docs/development/SITL.md
+void simPilotUpdate(uint32_t currentTime);
+
+void simQuadPrintSummary(void);
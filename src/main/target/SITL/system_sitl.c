@@ -0,0 +1,314 @@
+/*
+ * This file is part of Cleanflight.
+ *
+ * Cleanflight is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cleanflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cleanflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host replacement for drivers/system.c and the MCU flash, the simulated quad is
+ * stepped whenever the flight code looks at the clock.
+ *
+ * The flight code only ever sees a virtual clock. In lockstep, the default, it moves
+ * when it is read or waited on, so every run is the same whatever the load of the host.
+ * Otherwise it follows the host clock, for flying along with the configurator.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include "platform.h"
+
+#include "common/utils.h"
+
+#include "drivers/system.h"
+
+#include "scheduler.h"
+
+#include "sitl.h"
+#include "sim_quad.h"
+
+#define SITL_CONFIG_FLASH_SIZE 0x2000
+
+// Time charged to every clock read in lockstep, so polling loops always make progress
+#define SITL_LOCKSTEP_TICK_US 1
+
+uint32_t SystemCoreClock = 72000000;
+uint32_t hse_value = 8000000;
+uint32_t cachedRccCsrValue;
+
+uint8_t sitlConfigFlash[SITL_CONFIG_FLASH_SIZE] __attribute__((aligned(4)));
+
+static struct timespec startedAt;
+static bool started = false;
+static uint64_t runDuration;        // us, 0 runs until interrupted
+static bool lockstep;
+static uint64_t virtualTime;        // us since the start, all the flight code sees of time
+static const char *eepromFileName;
+
+int sitlEnvInt(const char *name, int defaultValue)
+{
+    const char *value = getenv(name);
+    return value ? atoi(value) : defaultValue;
+}
+
+float sitlEnvFloat(const char *name, float defaultValue)
+{
+    const char *value = getenv(name);
+    return value ? strtof(value, NULL) : defaultValue;
+}
+
+static uint64_t hostMicros(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)(now.tv_sec - startedAt.tv_sec) * 1000000 + (now.tv_nsec - startedAt.tv_nsec) / 1000;
+}
+
+static void sitlStart(void)
+{
+    if (started) {
+        return;
+    }
+    started = true;
+
+    clock_gettime(CLOCK_MONOTONIC, &startedAt);
+    runDuration = (uint64_t)(sitlEnvFloat("SITL_DURATION", 0) * 1e6f);
+    benchInit();
+    lockstep = sitlEnvInt("SITL_LOCKSTEP", 1) || benchEnabled();
+    simQuadInit();
+}
+
+// lockstep moves the virtual clock on by us, otherwise it catches up with the host clock
+static void sitlTimeAdvance(uint32_t us)
+{
+    sitlStart();
+
+    if (lockstep) {
+        virtualTime += us;
+    } else {
+        const uint64_t hostTime = hostMicros();
+        if (hostTime > virtualTime) {
+            virtualTime = hostTime;
+        }
+    }
+
+    if (runDuration && virtualTime >= runDuration) {
+        exit(0);
+    }
+
+    simQuadUpdate((uint32_t)virtualTime);
+}
+
+uint32_t micros(void)
+{
+    sitlTimeAdvance(SITL_LOCKSTEP_TICK_US);
+    return (uint32_t)virtualTime;
+}
+
+uint32_t millis(void)
+{
+    sitlTimeAdvance(SITL_LOCKSTEP_TICK_US);
+    return (uint32_t)(virtualTime / 1000);
+}
+
+void delayMicroseconds(uint32_t us)
+{
+    if (lockstep) {
+        sitlTimeAdvance(us);
+        return;
+    }
+
+    sitlTimeAdvance(0);
+    const uint64_t until = virtualTime + us;
+
+    while (virtualTime < until) {
+        usleep(us > 100 ? 100 : us);
+        sitlTimeAdvance(0);
+    }
+}
+
+void delay(uint32_t ms)
+{
+    while (ms--) {
+        delayMicroseconds(1000);
+    }
+}
+
+// time the scheduler had nothing to run, i.e. what is left of the CPU for more work
+static void sitlPrintSchedulerSummary(void)
+{
+    uint64_t elapsed = virtualTime;
+    uint64_t busy = 0;
+    cfTaskInfo_t taskInfo;
+
+    if (!elapsed) {
+        return;
+    }
+
+    printf("scheduler:");
+    for (cfTaskId_e taskId = 0; taskId < TASK_COUNT; taskId++) {
+        getTaskInfo(taskId, &taskInfo);
+        if (taskInfo.isEnabled) {
+            busy += taskInfo.totalExecutionTime;
+            printf(" %s=%.1f%%", taskInfo.taskName, (double)(100.0f * taskInfo.totalExecutionTime / elapsed));
+        }
+    }
+    printf(" idle=%.1f%%\n", busy < elapsed ? (double)(100.0f * (elapsed - busy) / elapsed) : 0.0);
+}
+
+static void sitlShutdown(void)
+{
+    simQuadPrintSummary();
+    sitlPrintSchedulerSummary();
+}
+
+static void sitlInterrupted(int signal)
+{
+    UNUSED(signal);
+    exit(0);
+}
+
+void systemInit(void)
+{
+    sitlStart();
+
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    atexit(sitlShutdown);
+    signal(SIGINT, sitlInterrupted);
+    signal(SIGTERM, sitlInterrupted);
+    signal(SIGPIPE, SIG_IGN);
+
+    printf("[SITL] %s, gyro sample period %dus\n", TARGET_BOARD_IDENTIFIER, SITL_GYRO_SAMPLE_PERIOD_US);
+}
+
+void failureMode(uint8_t mode)
+{
+    fprintf(stderr, "[SITL] failure mode %d\n", mode);
+    exit(1);
+}
+
+void systemReset(void)
+{
+    // restart the executable, like the MCU would reboot into the firmware
+    printf("[SITL] reset\n");
+    fflush(NULL);
+    execl("/proc/self/exe", "/proc/self/exe", (char *)NULL);
+    exit(0);
+}
+
+void systemResetToBootloader(void)
+{
+    printf("[SITL] no bootloader, exiting\n");
+    exit(0);
+}
+
+bool isMPUSoftReset(void)
+{
+    return false;
+}
+
+void enableGPIOPowerUsageAndNoiseReductions(void)
+{
+}
+
+void registerExtiCallbackHandler(IRQn_Type irqn, extiCallbackHandlerFunc *fn)
+{
+    UNUSED(irqn);
+    UNUSED(fn);
+}
+
+void unregisterExtiCallbackHandler(IRQn_Type irqn, extiCallbackHandlerFunc *fn)
+{
+    UNUSED(irqn);
+    UNUSED(fn);
+}
+
+/*
+ * Config flash, kept in a file so the settings survive a restart like they would on the board.
+ */
+
+static void flashLoad(void)
+{
+    memset(sitlConfigFlash, 0xFF, sizeof(sitlConfigFlash));
+
+    eepromFileName = getenv("SITL_EEPROM");
+    if (!eepromFileName) {
+        eepromFileName = "eeprom.bin";
+    }
+
+    FILE *file = fopen(eepromFileName, "rb");
+    if (file) {
+        if (fread(sitlConfigFlash, 1, sizeof(sitlConfigFlash), file) != sizeof(sitlConfigFlash)) {
+            memset(sitlConfigFlash, 0xFF, sizeof(sitlConfigFlash));
+        }
+        fclose(file);
+    }
+}
+
+// load the saved settings before init() reads the config, SITL_EEPROM="" starts from defaults every time
+static void __attribute__((constructor)) flashInit(void)
+{
+    flashLoad();
+}
+
+void FLASH_Unlock(void)
+{
+}
+
+void FLASH_Lock(void)
+{
+    if (!eepromFileName[0]) {
+        return;
+    }
+
+    FILE *file = fopen(eepromFileName, "wb");
+    if (file) {
+        fwrite(sitlConfigFlash, 1, sizeof(sitlConfigFlash), file);
+        fclose(file);
+    }
+}
+
+void FLASH_ClearFlag(uint32_t FLASH_FLAG)
+{
+    UNUSED(FLASH_FLAG);
+}
+
+FLASH_Status FLASH_ErasePage(uintptr_t Page_Address)
+{
+    uintptr_t offset = Page_Address - (uintptr_t)sitlConfigFlash;
+
+    if (offset + FLASH_PAGE_SIZE > sizeof(sitlConfigFlash)) {
+        return FLASH_ERROR_PG;
+    }
+    memset(&sitlConfigFlash[offset - offset % FLASH_PAGE_SIZE], 0xFF, FLASH_PAGE_SIZE);
+    return FLASH_COMPLETE;
+}
+
+FLASH_Status FLASH_ProgramWord(uintptr_t Address, uint32_t Data)
+{
+    uintptr_t offset = Address - (uintptr_t)sitlConfigFlash;
+
+    if (offset + sizeof(Data) > sizeof(sitlConfigFlash)) {
+        return FLASH_ERROR_PG;
+    }
+    memcpy(&sitlConfigFlash[offset], &Data, sizeof(Data));
+    return FLASH_COMPLETE;
+}
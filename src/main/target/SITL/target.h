@@ -0,0 +1,142 @@
+/*
+ * This file is part of Cleanflight.
+ *
+ * Cleanflight is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cleanflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cleanflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+// Software-in-the-loop target, builds the flight code as a Linux executable.
+// The MCU peripherals are replaced by the simulator in target/SITL/*.c
+
+#define TARGET_BOARD_IDENTIFIER "SITL"
+
+#define GYRO
+#define USE_FAKE_GYRO
+#define ACC
+#define USE_FAKE_ACC
+
+// The fake gyro/acc drivers are provided by the quad model in sim_quad.c
+#define USE_SIMULATED_ACCGYRO
+
+#define USE_VCP
+#define SERIAL_PORT_COUNT 1
+
+#define BLACKBOX
+#define GYRO_DYNAMIC_NOTCH
+#define USE_CLI
+#define USE_SERVOS
+
+#define FLASH_PAGE_SIZE 0x400
+
+// Simulated 8 kHz MPU data ready signal, see sim_quad.c
+#define SITL_GYRO_SAMPLE_PERIOD_US 125
+// The gyro is read from a simulated FIFO like on the F4 targets
+#define USE_MPU_FIFO
+
+// Per stage timing of the PID loop for the loop benchmark, see bench_sitl.c
+#define LOOP_STAGE_TIMING
+
+// Replay of blackbox logs through the PID controller and mixer instead of flying, see replay_sitl.c
+#define LOG_REPLAY
+bool logReplayEnabled(void);
+void logReplayRun(void);
+
+/*
+ * Minimal stand-ins for the STM32 standard peripheral library types that leak into the driver headers.
+ */
+
+#define U_ID_0 0
+#define U_ID_1 1
+#define U_ID_2 2
+
+typedef enum {DISABLE = 0, ENABLE = !DISABLE} FunctionalState;
+
+typedef enum
+{
+    Mode_AIN = 0x0,
+    Mode_IN_FLOATING = 0x04,
+    Mode_IPD = 0x28,
+    Mode_IPU = 0x48,
+    Mode_Out_OD = 0x14,
+    Mode_Out_PP = 0x10,
+    Mode_AF_OD = 0x1C,
+    Mode_AF_PP = 0x18
+} GPIO_Mode;
+
+typedef struct
+{
+    uint32_t IDR;
+    uint32_t ODR;
+    uint32_t BSRR;
+    uint32_t BRR;
+} GPIO_TypeDef;
+
+typedef struct
+{
+    void *test;
+} TIM_TypeDef;
+
+typedef struct
+{
+    void *test;
+} USART_TypeDef;
+
+typedef struct
+{
+    void *test;
+} DMA_Channel_TypeDef;
+
+typedef struct
+{
+    void *test;
+} SPI_TypeDef;
+
+typedef enum { TEST_IRQ = 0 } IRQn_Type;
+
+#define NVIC_PriorityGroup_2 ((uint32_t)0x500)
+
+extern uint32_t SystemCoreClock;
+
+static inline uint32_t __get_BASEPRI(void) { return 0; }
+static inline void __set_BASEPRI(uint32_t basePri) { (void)basePri; }
+
+typedef enum
+{
+    FLASH_BUSY = 1,
+    FLASH_ERROR_PG,
+    FLASH_ERROR_WRP,
+    FLASH_COMPLETE,
+    FLASH_TIMEOUT
+} FLASH_Status;
+
+#define FLASH_FLAG_EOP      0x01
+#define FLASH_FLAG_PGERR    0x02
+#define FLASH_FLAG_WRPRTERR 0x04
+
+void FLASH_Unlock(void);
+void FLASH_Lock(void);
+void FLASH_ClearFlag(uint32_t FLASH_FLAG);
+FLASH_Status FLASH_ErasePage(uintptr_t Page_Address);
+FLASH_Status FLASH_ProgramWord(uintptr_t Address, uint32_t Data);
+
+// Emulated config flash area, host pointers do not fit the 32 bit flash addresses used on the MCUs
+extern uint8_t sitlConfigFlash[];
+#define CONFIG_START_FLASH_ADDRESS ((uintptr_t)sitlConfigFlash)
+// the config area of the high end targets, master_t no longer fits in the 2kB of the 128kB ones
+#define FLASH_TO_RESERVE_FOR_CONFIG 0x1000
@@ -121,6 +121,7 @@
 #define BLACKBOX
 #define GPS
 #define GTUNE
+#define GYRO_DYNAMIC_NOTCH
 #define DISPLAY
 #define SERIAL_RX
 #define TELEMETRY
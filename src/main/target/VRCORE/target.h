@@ -51,6 +51,7 @@
 
 // MPU6000 interrupts
 #define USE_MPU_DATA_READY_SIGNAL
+#define USE_MPU_FIFO
 #define EXTI_CALLBACK_HANDLER_COUNT 2 // MPU data ready (mag disabled)
 
 //#define MAG
@@ -148,5 +149,6 @@
 #define TELEMETRY
 #define SERIAL_RX
 #define GTUNE
+#define GYRO_DYNAMIC_NOTCH
 #define USE_SERVOS
 #define USE_CLI
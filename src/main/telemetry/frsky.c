@@ -431,6 +431,7 @@ static void sendFuelLevel(void)
 
 static void sendHeading(void)
 {
+    imuUpdateEulerAngles();
     sendDataHead(ID_COURSE_BP);
     serialize16(DECIDEGREES_TO_DEGREES(attitude.values.yaw));
     sendDataHead(ID_COURSE_AP);
@@ -0,0 +1,416 @@
+/*
+ * This file is part of Cleanflight.
+ *
+ * Cleanflight is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cleanflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cleanflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host benchmark of the blackbox writer, how many bytes per microsecond the encoders of blackbox_io.c get to the
+ * device when they write P-frames like writeInterframe() does. The serial port is a fake UART that puts the bytes in
+ * its transmit ring, the flash goes through flashfs to a fake M25P16 that takes every page at once. Host figures only
+ * compare builds of the writer with each other.
+ *
+ * The second table compares the encodings of the gyroADC, accSmooth, attitude and motor fields, the average predictor
+ * with signed VB of data version 2 and the packed encoding of version 3, on the P-frames of the blackbox log given as
+ * argument, or on a synthetic flight without one.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include <time.h>
+
+#include "platform.h"
+
+#include "common/axis.h"
+#include "common/maths.h"
+#include "common/color.h"
+
+#include "drivers/sensor.h"
+#include "drivers/serial.h"
+#include "drivers/flash.h"
+#include "drivers/timer.h"
+#include "drivers/pwm_rx.h"
+#include "drivers/accgyro.h"
+
+#include "sensors/sensors.h"
+#include "sensors/boardalignment.h"
+#include "sensors/acceleration.h"
+#include "sensors/barometer.h"
+#include "sensors/gyro.h"
+#include "sensors/battery.h"
+
+#include "io/beeper.h"
+#include "io/escservo.h"
+#include "rx/rx.h"
+#include "io/rc_controls.h"
+#include "io/gimbal.h"
+#include "io/gps.h"
+#include "io/ledstrip.h"
+#include "io/serial.h"
+#include "io/serial_msp.h"
+#include "io/flashfs.h"
+#include "telemetry/telemetry.h"
+
+#include "flight/pid.h"
+#include "flight/mixer.h"
+#include "flight/failsafe.h"
+#include "flight/imu.h"
+#include "flight/navigation.h"
+
+#include "config/runtime_config.h"
+#include "config/config.h"
+#include "config/config_profile.h"
+#include "config/config_master.h"
+
+#include "blackbox/blackbox.h"
+#include "blackbox/blackbox_io.h"
+#include "blackbox/blackbox_decoder.h"
+
+#define FRAME_COUNT 4096
+#define ROUNDS 200
+#define MOTOR_COUNT 4
+
+// A frame as writeInterframe() sees it, the deltas and predictions already worked out
+typedef struct benchFrame_s {
+    int32_t time;
+    int32_t pidP[XYZ_AXIS_COUNT];
+    int32_t pidI[XYZ_AXIS_COUNT];
+    int32_t pidD[2];
+    int32_t rcCommand[4];
+    int32_t optional[2];
+    int32_t gyro[XYZ_AXIS_COUNT];
+    int32_t acc[XYZ_AXIS_COUNT];
+    int32_t attitude[XYZ_AXIS_COUNT];
+    int32_t motor[MOTOR_COUNT];
+} benchFrame_t;
+
+static benchFrame_t frames[FRAME_COUNT];
+
+// gyroADC, accSmooth, attitude and motor of each main frame, as blackboxMainState_t has them
+#define PACKED_FIELD_COUNT (3 * XYZ_AXIS_COUNT + MOTOR_COUNT)
+#define MAX_LOG_FRAMES (1024 * 1024)
+#define SYNTHETIC_FRAME_COUNT (64 * 1024)
+
+static int16_t (*mainFrames)[PACKED_FIELD_COUNT];
+static int mainFrameCount;
+
+// The writer before frame buffering has no blackboxFlushFrame()
+void blackboxFlushFrame(void) __attribute__((weak));
+
+/* Fake UART, the transmit ring of uartWrite() without the interrupt */
+
+#define TX_BUFFER_SIZE 1024
+
+static uint8_t txBuffer[TX_BUFFER_SIZE];
+static uint32_t txHead;
+static uint64_t bytesOut;
+
+static void fakeUartWrite(serialPort_t *instance, uint8_t ch)
+{
+    (void)instance;
+    txBuffer[txHead] = ch;
+    txHead = (txHead + 1) % TX_BUFFER_SIZE;
+    bytesOut++;
+}
+
+static void fakeUartWriteBuf(serialPort_t *instance, const uint8_t *data, uint32_t count)
+{
+    (void)instance;
+    while (count) {
+        const uint32_t span = MIN(count, TX_BUFFER_SIZE - txHead);
+        memcpy(&txBuffer[txHead], data, span);
+        txHead = (txHead + span) % TX_BUFFER_SIZE;
+        data += span;
+        count -= span;
+        bytesOut += span;
+    }
+}
+
+static uint32_t fakeUartTotalRxWaiting(serialPort_t *instance) { (void)instance; return 0; }
+static uint32_t fakeUartTotalTxFree(serialPort_t *instance) { (void)instance; return 255; }
+static uint8_t fakeUartRead(serialPort_t *instance) { (void)instance; return 0; }
+static void fakeUartSetBaudRate(serialPort_t *instance, uint32_t baudRate) { (void)instance; (void)baudRate; }
+static bool fakeUartTransmitBufferEmpty(serialPort_t *instance) { (void)instance; return true; }
+static void fakeUartSetMode(serialPort_t *instance, portMode_t mode) { (void)instance; (void)mode; }
+
+static const struct serialPortVTable fakeUartVTable = {
+    fakeUartWrite, fakeUartTotalRxWaiting, fakeUartTotalTxFree, fakeUartRead, fakeUartSetBaudRate,
+    fakeUartTransmitBufferEmpty, fakeUartSetMode, NULL, NULL, fakeUartWriteBuf, NULL
+};
+
+static serialPort_t fakeUart = { .vTable = &fakeUartVTable };
+static serialPortConfig_t fakeUartConfig;
+
+/* Fake M25P16 */
+
+static flashGeometry_t flashGeometry = {
+    .sectors = 256, .pageSize = 256, .sectorSize = 65536, .totalSize = 256 * 65536, .pagesPerSector = 256
+};
+
+bool m25p16_isReady(void) { return true; }
+bool m25p16_waitForReady(uint32_t timeoutMillis) { (void)timeoutMillis; return true; }
+const flashGeometry_t *m25p16_getGeometry(void) { return &flashGeometry; }
+void m25p16_eraseCompletely(void) {}
+void m25p16_eraseSector(uint32_t address) { (void)address; }
+void m25p16_pageProgramBegin(uint32_t address) { (void)address; }
+void m25p16_pageProgramContinue(const uint8_t *data, int length) { (void)data; bytesOut += length; }
+void m25p16_pageProgramFinish(void) {}
+void m25p16_pageProgram(uint32_t address, const uint8_t *data, int length) { (void)address; (void)data; bytesOut += length; }
+
+int m25p16_readBytes(uint32_t address, uint8_t *buffer, int length)
+{
+    (void)address;
+    memset(buffer, 0xFF, length);   // erased, the whole chip is free
+    return length;
+}
+
+/* What blackbox_io.c needs from the rest of the firmware */
+
+master_t masterConfig;
+uint32_t targetLooptime = 125;
+const uint32_t baudRates[] = { 0, 9600, 19200, 38400, 57600, 115200, 230400, 250000 };
+
+serialPortConfig_t *findSerialPortConfig(serialPortFunction_e function) { (void)function; return &fakeUartConfig; }
+portSharing_e determinePortSharing(serialPortConfig_t *portConfig, serialPortFunction_e function)
+{
+    (void)portConfig;
+    (void)function;
+    return PORTSHARING_NOT_SHARED;
+}
+serialPort_t *openSerialPort(serialPortIdentifier_e identifier, serialPortFunction_e function,
+        serialReceiveCallbackPtr callback, uint32_t baudRate, portMode_t mode, portOptions_t options)
+{
+    (void)identifier; (void)function; (void)callback; (void)baudRate; (void)mode; (void)options;
+    return &fakeUart;
+}
+void closeSerialPort(serialPort_t *serialPort) { (void)serialPort; }
+void mspAllocateSerialPorts(serialConfig_t *serialConfig) { (void)serialConfig; }
+
+static void writeFrame(const benchFrame_t *frame)
+{
+    blackboxWrite('P');
+    blackboxWriteSignedVB(frame->time);
+    blackboxWriteSignedVBArray((int32_t *)frame->pidP, XYZ_AXIS_COUNT);
+    blackboxWriteTag2_3S32((int32_t *)frame->pidI);
+    blackboxWriteSignedVB(frame->pidD[0]);
+    blackboxWriteSignedVB(frame->pidD[1]);
+    blackboxWriteTag8_4S16((int32_t *)frame->rcCommand);
+    blackboxWriteTag8_8SVB((int32_t *)frame->optional, 2);
+    blackboxWriteSignedVBArray((int32_t *)frame->gyro, XYZ_AXIS_COUNT);
+    blackboxWriteSignedVBArray((int32_t *)frame->acc, XYZ_AXIS_COUNT);
+    blackboxWriteSignedVBArray((int32_t *)frame->attitude, XYZ_AXIS_COUNT);
+    blackboxWriteSignedVBArray((int32_t *)frame->motor, MOTOR_COUNT);
+
+    if (blackboxFlushFrame) {
+        blackboxFlushFrame();
+    }
+}
+
+static uint64_t nowNs(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static int32_t randomDelta(int range)
+{
+    return rand() % (2 * range + 1) - range;
+}
+
+static void benchDevice(const char *name, uint8_t device)
+{
+    uint64_t startedAt, elapsedNs;
+
+    masterConfig.blackbox_device = device;
+    if (device == BLACKBOX_DEVICE_FLASH) {
+        flashfsInit();
+    }
+    blackboxDeviceOpen();
+    bytesOut = 0;
+
+    startedAt = nowNs();
+    for (int round = 0; round < ROUNDS; round++) {
+        if (device == BLACKBOX_DEVICE_FLASH) {
+            flashfsSeekAbs(0);
+        }
+        for (int i = 0; i < FRAME_COUNT; i++) {
+            writeFrame(&frames[i]);
+        }
+        blackboxDeviceFlush();
+    }
+    elapsedNs = nowNs() - startedAt;
+
+    printf("%-8s %12.1f %12.1f %10.2f\n", name, (double)bytesOut / (ROUNDS * FRAME_COUNT),
+        (double)elapsedNs / (ROUNDS * FRAME_COUNT), (double)bytesOut * 1000 / elapsedNs);
+}
+
+static void writeAveragePredictorFields(int frame)
+{
+    for (int i = 0; i < PACKED_FIELD_COUNT; i++) {
+        blackboxWriteSignedVB(mainFrames[frame][i] - (mainFrames[frame - 1][i] + mainFrames[frame - 2][i]) / 2);
+    }
+}
+
+static void writeAdaptiveFields(int frame)
+{
+    static blackboxAdaptiveField_t fields[PACKED_FIELD_COUNT];
+
+    // Like writeIntraframe() the bench starts over every I interval
+    if (frame % 32 == 2) {
+        for (int i = 0; i < PACKED_FIELD_COUNT; i++) {
+            blackboxAdaptiveReset(&fields[i]);
+        }
+    }
+    blackboxWriteAdaptiveS16Array(mainFrames[frame], mainFrames[frame - 1], mainFrames[frame - 2], fields, PACKED_FIELD_COUNT);
+    blackboxFlushBits();
+}
+
+static void benchEncoding(const char *name, void (*writeFields)(int frame))
+{
+    int encodingRounds = 1 + 16 * 1024 * 1024 / mainFrameCount / PACKED_FIELD_COUNT;
+    uint64_t startedAt, elapsedNs;
+
+    masterConfig.blackbox_device = BLACKBOX_DEVICE_SERIAL;
+    blackboxDeviceOpen();
+    bytesOut = 0;
+
+    startedAt = nowNs();
+    for (int round = 0; round < encodingRounds; round++) {
+        for (int i = 2; i < mainFrameCount; i++) {
+            writeFields(i);
+            blackboxFlushFrame();
+        }
+    }
+    elapsedNs = nowNs() - startedAt;
+
+    printf("%-8s %12.2f %12.1f\n", name, (double)bytesOut / ((uint64_t)encodingRounds * (mainFrameCount - 2)),
+        (double)elapsedNs / ((uint64_t)encodingRounds * (mainFrameCount - 2)));
+}
+
+static int readLog(void *context, uint8_t *buffer, int length)
+{
+    return fread(buffer, 1, length, (FILE *)context);
+}
+
+static bool loadLog(const char *fileName)
+{
+    static blackboxDecoder_t decoder;
+    static const char * const fieldNames[PACKED_FIELD_COUNT] = {
+        "gyroADC[0]", "gyroADC[1]", "gyroADC[2]", "accSmooth[0]", "accSmooth[1]", "accSmooth[2]",
+        "attitude[0]", "attitude[1]", "attitude[2]", "motor[0]", "motor[1]", "motor[2]", "motor[3]"
+    };
+    int fields[PACKED_FIELD_COUNT];
+    FILE *file = fopen(fileName, "rb");
+    blackboxDecoded_e decoded;
+
+    if (!file) {
+        perror(fileName);
+        return false;
+    }
+
+    // The main frames of every log in the file one after the other, the odd jump between them makes no difference
+    blackboxDecoderInit(&decoder, readLog, file);
+    while ((decoded = blackboxDecoderNext(&decoder)) != BLACKBOX_DECODED_END && mainFrameCount < MAX_LOG_FRAMES) {
+        if (decoded == BLACKBOX_DECODED_LOG_START) {
+            for (int i = 0; i < PACKED_FIELD_COUNT; i++) {
+                fields[i] = blackboxDecoderFindField(&decoder, BLACKBOX_FRAME_INTRA, fieldNames[i]);
+            }
+        } else if (decoded == BLACKBOX_DECODED_MAIN) {
+            for (int i = 0; i < PACKED_FIELD_COUNT; i++) {
+                mainFrames[mainFrameCount][i] = fields[i] >= 0 ? decoder.frame.values[fields[i]] : 0;
+            }
+            mainFrameCount++;
+        }
+    }
+    fclose(file);
+
+    return mainFrameCount > 2;
+}
+
+// A flight of 4kHz frames, stick moves under motor and frame noise
+static void makeSyntheticFlight(void)
+{
+    for (int i = 0; i < SYNTHETIC_FRAME_COUNT; i++) {
+        float t = i / 4000.0f;
+        float roll = 300 * sinf(2 * M_PIf * 0.7f * t);
+        float pitch = 200 * sinf(2 * M_PIf * 0.3f * t + 1);
+
+        for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+            float rate = axis == 0 ? roll : axis == 1 ? pitch : 20 * sinf(t);
+
+            mainFrames[i][axis] = rate + 10 * sinf(2 * M_PIf * 230 * t + axis) + randomDelta(4);
+            mainFrames[i][XYZ_AXIS_COUNT + axis] = (axis == 2 ? 512 : 0) + 40 * sinf(2 * M_PIf * 230 * t) + randomDelta(20);
+            mainFrames[i][2 * XYZ_AXIS_COUNT + axis] = 10 * rate / 4 + randomDelta(1);
+        }
+        for (int motor = 0; motor < MOTOR_COUNT; motor++) {
+            mainFrames[i][3 * XYZ_AXIS_COUNT + motor] = 1400 + (motor & 1 ? roll : -roll) / 4 + randomDelta(15);
+        }
+        mainFrameCount++;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    // Deltas of a 4kHz log at 1/1, mostly small with the odd large one from the gyro and motors
+    srand(1);
+    for (int i = 0; i < FRAME_COUNT; i++) {
+        benchFrame_t *frame = &frames[i];
+
+        frame->time = randomDelta(2);
+        for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+            frame->pidP[axis] = randomDelta(40);
+            frame->pidI[axis] = randomDelta(3);
+            frame->gyro[axis] = randomDelta(i % 16 == 0 ? 600 : 60);
+            frame->acc[axis] = randomDelta(30);
+            frame->attitude[axis] = randomDelta(4);
+        }
+        frame->pidD[0] = randomDelta(100);
+        frame->pidD[1] = randomDelta(100);
+        for (int channel = 0; channel < 4; channel++) {
+            frame->rcCommand[channel] = i % 8 == 0 ? randomDelta(20) : 0;
+        }
+        frame->optional[0] = i % 64 == 0 ? randomDelta(2) : 0;
+        frame->optional[1] = 0;
+        for (int motor = 0; motor < MOTOR_COUNT; motor++) {
+            frame->motor[motor] = randomDelta(i % 16 == 0 ? 300 : 30);
+        }
+    }
+
+    printf("%-8s %12s %12s %10s\n", "device", "bytes/frame", "ns/frame", "bytes/us");
+    benchDevice("serial", BLACKBOX_DEVICE_SERIAL);
+    benchDevice("flash", BLACKBOX_DEVICE_FLASH);
+
+    mainFrames = calloc(MAX_LOG_FRAMES, sizeof(*mainFrames));
+    if (argc > 1) {
+        if (!loadLog(argv[1])) {
+            fprintf(stderr, "%s: no main frames to encode\n", argv[1]);
+            return 1;
+        }
+        printf("\n%d main frames of %s\n", mainFrameCount, argv[1]);
+    } else {
+        makeSyntheticFlight();
+        printf("\n%d main frames of a synthetic flight\n", mainFrameCount);
+    }
+
+    printf("%-8s %12s %12s\n", "encoding", "bytes/frame", "ns/frame");
+    benchEncoding("vb", writeAveragePredictorFields);
+    benchEncoding("packed", writeAdaptiveFields);
+    return 0;
+}
@@ -0,0 +1,173 @@
+/*
+ * This file is part of Cleanflight.
+ *
+ * Cleanflight is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cleanflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cleanflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host benchmark of the gyro filters, the time to filter one sample of the three axes with the old 9 tap FIR, its
+ * circular buffer version and the biquad stages gyroUpdate() chains, in float and fixed point. Host times only compare
+ * the filters with each other, they are not the time the filters take on the MCU. The host runs the portable loop of
+ * the circular FIR, the MCUs with the DSP extension the SMLAD one.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_HAS_TSC
+#endif
+
+#include "common/axis.h"
+#include "common/maths.h"
+#include "common/filter.h"
+
+#define LOOPTIME 250
+#define SAMPLE_COUNT 4096
+#define ROUNDS 500
+
+static int16_t samples[SAMPLE_COUNT][XYZ_AXIS_COUNT];
+static volatile int32_t sink;
+
+typedef struct benchResult_s {
+    double nsPerSample;
+    double ticksPerSample;
+} benchResult_t;
+
+typedef void benchFilterFunc(int16_t data[XYZ_AXIS_COUNT]);
+
+static int16_t firState[XYZ_AXIS_COUNT][9];
+static int8_t *firCoeff;
+static firFilterInt16_t fir[XYZ_AXIS_COUNT];
+static biquadFilter_t lowpass[XYZ_AXIS_COUNT], notch[XYZ_AXIS_COUNT];
+static biquadFilterQ15_t lowpassQ15[XYZ_AXIS_COUNT], notchQ15[XYZ_AXIS_COUNT];
+
+static void benchFir(int16_t data[XYZ_AXIS_COUNT])
+{
+    filterApply9TapFIR(data, firState, firCoeff);
+}
+
+static void benchFirCircular(int16_t data[XYZ_AXIS_COUNT])
+{
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        data[axis] = firFilterInt16Apply(&fir[axis], data[axis]);
+    }
+}
+
+static void benchLowpass(int16_t data[XYZ_AXIS_COUNT])
+{
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        data[axis] = lrintf(biquadFilterApply(&lowpass[axis], data[axis]));
+    }
+}
+
+static void benchLowpassNotch(int16_t data[XYZ_AXIS_COUNT])
+{
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        data[axis] = lrintf(biquadFilterApply(&notch[axis], biquadFilterApply(&lowpass[axis], data[axis])));
+    }
+}
+
+static void benchLowpassQ15(int16_t data[XYZ_AXIS_COUNT])
+{
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        data[axis] = biquadFilterQ15Apply(&lowpassQ15[axis], data[axis]);
+    }
+}
+
+static void benchLowpassNotchQ15(int16_t data[XYZ_AXIS_COUNT])
+{
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        data[axis] = biquadFilterQ15Apply(&notchQ15[axis], biquadFilterQ15Apply(&lowpassQ15[axis], data[axis]));
+    }
+}
+
+static uint64_t nowNs(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static benchResult_t benchRun(benchFilterFunc *filter)
+{
+    benchResult_t result = { 0, 0 };
+    int16_t data[XYZ_AXIS_COUNT];
+    uint64_t startedAt = nowNs();
+#ifdef BENCH_HAS_TSC
+    uint64_t startedAtTicks = __rdtsc();
+#endif
+
+    for (int round = 0; round < ROUNDS; round++) {
+        for (int i = 0; i < SAMPLE_COUNT; i++) {
+            data[X] = samples[i][X];
+            data[Y] = samples[i][Y];
+            data[Z] = samples[i][Z];
+            filter(data);
+            sink += data[X] + data[Y] + data[Z];
+        }
+    }
+
+#ifdef BENCH_HAS_TSC
+    result.ticksPerSample = (double)(__rdtsc() - startedAtTicks) / (ROUNDS * SAMPLE_COUNT);
+#endif
+    result.nsPerSample = (double)(nowNs() - startedAt) / (ROUNDS * SAMPLE_COUNT);
+    return result;
+}
+
+int main(void)
+{
+    static const struct {
+        const char *name;
+        benchFilterFunc *filter;
+    } benches[] = {
+        { "fir9_int8", benchFir },
+        { "fir9_int8_circular", benchFirCircular },
+        { "biquad_lpf_float", benchLowpass },
+        { "biquad_lpf_notch_float", benchLowpassNotch },
+        { "biquad_lpf_q15", benchLowpassQ15 },
+        { "biquad_lpf_notch_q15", benchLowpassNotchQ15 },
+    };
+
+    // gyro like input, stick movement with motor noise and some sensor noise
+    srand(1);
+    for (int i = 0; i < SAMPLE_COUNT; i++) {
+        float t = (float)i * LOOPTIME / 1000000;
+        for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+            samples[i][axis] = 4000 * sinf(2 * M_PIf * (2 + axis) * t) + 1500 * sinf(2 * M_PIf * 260 * t) + (rand() % 64 - 32);
+        }
+    }
+
+    firCoeff = filterGetFIRCoefficientsTable(0);
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        firFilterInt16Init(&fir[axis], firCoeff, 9);
+        biquadFilterInit(&lowpass[axis], FILTER_LPF, 90, 1.0f / sqrtf(2.0f), LOOPTIME);
+        biquadFilterInit(&notch[axis], FILTER_NOTCH, 260, filterGetNotchQ(260, 160), LOOPTIME);
+        biquadFilterQ15Init(&lowpassQ15[axis], &lowpass[axis]);
+        biquadFilterQ15Init(&notchQ15[axis], &notch[axis]);
+    }
+
+    printf("%-24s %10s %10s\n", "filter, 3 axes", "ns/sample", "ticks/sample");
+    for (unsigned i = 0; i < sizeof(benches) / sizeof(benches[0]); i++) {
+        benchResult_t result = benchRun(benches[i].filter);
+        printf("%-24s %10.2f %10.2f\n", benches[i].name, result.nsPerSample, result.ticksPerSample);
+    }
+    return 0;
+}
@@ -0,0 +1,134 @@
+/*
+ * This file is part of Cleanflight.
+ *
+ * Cleanflight is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cleanflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cleanflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host benchmark of the dynamic notch analysis, the time each run of the DYNNOTCH task takes per analysis step and the
+ * time gyroUpdate() spends handing a sample over. The worst step is what the task costs the loop it runs in, the
+ * scheduler has to find a gap that long. Host times only compare builds, the MCU times are in the CLI tasks list.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_HAS_TSC
+#endif
+
+#include "platform.h"
+
+#include "common/axis.h"
+#include "common/maths.h"
+
+#include "sensors/gyroanalyse.h"
+
+#define LOOPTIME 250
+#define LOOPS_PER_TASK_RUN 8
+#define ROUNDS 20000
+
+static volatile float sink;
+
+typedef struct benchResult_s {
+    uint64_t totalNs;
+    uint64_t maxNs;
+    uint64_t totalTicks;
+    uint32_t runs;
+} benchResult_t;
+
+static benchResult_t stepResult[GYRO_ANALYSE_STEP_COUNT];
+static benchResult_t pushResult;
+
+void gyroSetDynamicNotchCenter(uint8_t axis, float centerHz)
+{
+    sink += axis + centerHz;
+}
+
+static uint64_t nowNs(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static void benchAdd(benchResult_t *result, uint64_t ns, uint64_t ticks)
+{
+    result->totalNs += ns;
+    result->maxNs = MAX(result->maxNs, ns);
+    result->totalTicks += ticks;
+    result->runs++;
+}
+
+static uint64_t ticks(void)
+{
+#ifdef BENCH_HAS_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+static void benchPrint(const char *name, const benchResult_t *result)
+{
+    printf("%-24s %10.1f %10.1f %10llu\n", name, (double)result->totalNs / result->runs,
+        (double)result->totalTicks / result->runs, (unsigned long long)result->maxNs);
+}
+
+int main(void)
+{
+    uint32_t loop = 0;
+    uint8_t step = 0;
+
+    gyroDataAnalyseInit(LOOPTIME, 100, 500);
+    srand(1);
+
+    for (int round = 0; round < ROUNDS; round++) {
+        for (int i = 0; i < LOOPS_PER_TASK_RUN; i++, loop++) {
+            float t = (float)loop * LOOPTIME / 1000000;
+            int16_t data[XYZ_AXIS_COUNT];
+
+            for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+                data[axis] = 4000 * sinf(2 * M_PIf * (2 + axis) * t) + 1500 * sinf(2 * M_PIf * 260 * t) + (rand() % 64 - 32);
+            }
+
+            uint64_t startedAt = nowNs();
+            uint64_t startedAtTicks = ticks();
+            gyroDataAnalysePush(data);
+            benchAdd(&pushResult, nowNs() - startedAt, ticks() - startedAtTicks);
+        }
+
+        uint64_t startedAt = nowNs();
+        uint64_t startedAtTicks = ticks();
+        gyroDataAnalyseUpdate();
+        benchAdd(&stepResult[step], nowNs() - startedAt, ticks() - startedAtTicks);
+        step = (step + 1) % GYRO_ANALYSE_STEP_COUNT;
+    }
+
+    printf("%-24s %10s %10s %10s\n", "dynamic notch", "mean ns", "mean ticks", "max ns");
+    benchPrint("push, 3 axes", &pushResult);
+    for (int i = 0; i < GYRO_ANALYSE_STEP_COUNT; i++) {
+        char name[24];
+        snprintf(name, sizeof(name), "task step %d", i);
+        benchPrint(name, &stepResult[i]);
+    }
+    printf("notch center %.1f Hz, bin width %.1f Hz\n", (double)gyroDataAnalyseGetCenterHz(FD_ROLL), (double)gyroDataAnalyseGetBinWidthHz());
+    return 0;
+}
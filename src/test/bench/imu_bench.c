@@ -0,0 +1,234 @@
+/*
+ * This file is part of Cleanflight.
+ *
+ * Cleanflight is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cleanflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cleanflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host benchmark of the attitude estimation, the time per PID loop of imuUpdateGyroAndAttitude() and of fusing the
+ * 100Hz acc samples in TASK_ATTITUDE, with the Euler angles worked out every loop with libm as they used to be and
+ * with them only read by a 100Hz task. The second table is the Euler angles alone, with libm and with the
+ * approximations of common/maths.c. Host times only compare the paths with each other, they are not the time they
+ * take on the MCU.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_HAS_TSC
+#endif
+
+#include "platform.h"
+
+#include "common/axis.h"
+#include "common/maths.h"
+
+#include "drivers/sensor.h"
+#include "drivers/accgyro.h"
+
+#include "sensors/sensors.h"
+#include "sensors/gyro.h"
+#include "sensors/acceleration.h"
+
+#include "rx/rx.h"
+#include "io/rc_controls.h"
+
+#include "flight/pid.h"
+#include "flight/imu.h"
+
+#include "config/runtime_config.h"
+
+#define LOOPTIME 250
+#define LOOPS_PER_TASK_RUN (1000000 / 100 / LOOPTIME)
+#define SAMPLE_COUNT 4096
+#define ROUNDS 200
+
+void imuInit(void);
+void imuComputeRotationMatrix(void);
+extern float q0, q1, q2, q3;
+extern bool attitudeIsStale;
+
+// What imu.c needs of the rest of the firmware
+uint16_t acc_1G = 512;
+gyro_t gyro;
+int16_t magADC[XYZ_AXIS_COUNT];
+int16_t accADC[XYZ_AXIS_COUNT];
+uint32_t accSampleTime;
+uint32_t magSampleTime;
+int16_t gyroADC[XYZ_AXIS_COUNT];
+uint8_t stateFlags;
+uint16_t flightModeFlags;
+uint8_t armingFlags = ARMED;
+uint8_t GPS_numSat;
+uint16_t GPS_speed;
+uint16_t GPS_ground_course;
+
+static uint32_t currentTimeUs;
+
+uint32_t micros(void) { return currentTimeUs; }
+uint32_t millis(void) { return currentTimeUs / 1000; }
+bool sensors(uint32_t mask) { return mask == SENSOR_ACC; }
+void gyroUpdate(void) {}
+void updateAccelerationReadings(rollAndPitchTrims_t *rollAndPitchTrims) { (void)rollAndPitchTrims; accSampleTime = currentTimeUs; }
+
+static int16_t gyroSamples[SAMPLE_COUNT][XYZ_AXIS_COUNT];
+static int16_t accSamples[SAMPLE_COUNT][XYZ_AXIS_COUNT];
+static volatile int32_t sink;
+
+static imuRuntimeConfig_t imuRuntimeConfig;
+static pidProfile_t pidProfile;
+static accDeadband_t accDeadband;
+
+typedef struct benchResult_s {
+    double nsPerLoop;
+    double ticksPerLoop;
+} benchResult_t;
+
+static uint64_t nowNs(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static void eulerAnglesLibm(void)
+{
+    float r20 = 2.0f * (q1 * q3 - q0 * q2);
+    float r21 = 2.0f * (q2 * q3 + q0 * q1);
+    float r22 = 1.0f - 2.0f * q1 * q1 - 2.0f * q2 * q2;
+    float r10 = 2.0f * (q1 * q2 + q0 * q3);
+    float r00 = 1.0f - 2.0f * q2 * q2 - 2.0f * q3 * q3;
+
+    attitude.values.roll = lrintf(atan2f(r21, r22) * (1800.0f / M_PIf));
+    attitude.values.pitch = lrintf(((0.5f * M_PIf) - acosf(-r20)) * (1800.0f / M_PIf));
+    attitude.values.yaw = lrintf(-atan2f(r10, r00) * (1800.0f / M_PIf));
+}
+
+static benchResult_t benchLoop(bool eulerEveryLoop)
+{
+    benchResult_t result = { 0, 0 };
+
+    imuRuntimeConfig.dcm_kp = 0.25f;
+    imuRuntimeConfig.small_angle = 25;
+    imuConfigure(&imuRuntimeConfig, &pidProfile, &accDeadband, 5.0f, 800);
+    imuInit();
+    imuUpdateAccelerometer(NULL);
+
+    uint64_t startedAt = nowNs();
+#ifdef BENCH_HAS_TSC
+    uint64_t startedAtTicks = __rdtsc();
+#endif
+
+    for (int round = 0; round < ROUNDS; round++) {
+        for (int i = 0; i < SAMPLE_COUNT; i++) {
+            currentTimeUs += LOOPTIME;
+            gyroADC[X] = gyroSamples[i][X];
+            gyroADC[Y] = gyroSamples[i][Y];
+            gyroADC[Z] = gyroSamples[i][Z];
+
+            imuUpdateGyroAndAttitude();
+
+            if (i % LOOPS_PER_TASK_RUN == 0) {
+                accADC[X] = accSamples[i][X];
+                accADC[Y] = accSamples[i][Y];
+                accADC[Z] = accSamples[i][Z];
+                imuUpdateAccelerometer(NULL);
+                imuUpdateAttitudeCorrection();
+            }
+
+            if (eulerEveryLoop) {
+                eulerAnglesLibm();
+            } else if (i % LOOPS_PER_TASK_RUN == 0) {
+                imuUpdateEulerAngles();
+            }
+            sink += attitude.values.roll;
+        }
+    }
+
+#ifdef BENCH_HAS_TSC
+    result.ticksPerLoop = (double)(__rdtsc() - startedAtTicks) / (ROUNDS * SAMPLE_COUNT);
+#endif
+    result.nsPerLoop = (double)(nowNs() - startedAt) / (ROUNDS * SAMPLE_COUNT);
+    return result;
+}
+
+static benchResult_t benchEuler(bool approximations)
+{
+    benchResult_t result = { 0, 0 };
+
+    uint64_t startedAt = nowNs();
+#ifdef BENCH_HAS_TSC
+    uint64_t startedAtTicks = __rdtsc();
+#endif
+
+    for (int round = 0; round < ROUNDS; round++) {
+        for (int i = 0; i < SAMPLE_COUNT; i++) {
+            // Walk the quaternion a little so that the compiler can't keep the angles
+            q1 = gyroSamples[i][X] * 1e-5f;
+            q2 = gyroSamples[i][Y] * 1e-5f;
+            q0 = 1.0f - q1 * q1 - q2 * q2;
+            if (approximations) {
+                imuComputeRotationMatrix();
+                attitudeIsStale = true;
+                imuUpdateEulerAngles();
+            } else {
+                imuComputeRotationMatrix();
+                eulerAnglesLibm();
+            }
+            sink += attitude.values.roll + attitude.values.pitch + attitude.values.yaw;
+        }
+    }
+
+#ifdef BENCH_HAS_TSC
+    result.ticksPerLoop = (double)(__rdtsc() - startedAtTicks) / (ROUNDS * SAMPLE_COUNT);
+#endif
+    result.nsPerLoop = (double)(nowNs() - startedAt) / (ROUNDS * SAMPLE_COUNT);
+    return result;
+}
+
+int main(void)
+{
+    benchResult_t result;
+
+    // A flight like gyro and acc, stick movement with motor noise, gravity with some vibration
+    gyro.scale = 1.0f / 16.4f;
+    srand(1);
+    for (int i = 0; i < SAMPLE_COUNT; i++) {
+        float t = (float)i * LOOPTIME / 1000000;
+        for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+            gyroSamples[i][axis] = 4000 * sinf(2 * M_PIf * (2 + axis) * t) + 1500 * sinf(2 * M_PIf * 260 * t) + (rand() % 64 - 32);
+            accSamples[i][axis] = (axis == Z ? acc_1G : 0) + 60 * sinf(2 * M_PIf * 260 * t) + (rand() % 16 - 8);
+        }
+    }
+
+    printf("%-36s %10s %10s\n", "attitude, per PID loop", "ns/loop", "ticks/loop");
+    result = benchLoop(true);
+    printf("%-36s %10.2f %10.2f\n", "libm Euler every loop", result.nsPerLoop, result.ticksPerLoop);
+    result = benchLoop(false);
+    printf("%-36s %10.2f %10.2f\n", "Euler read at 100Hz", result.nsPerLoop, result.ticksPerLoop);
+
+    printf("\n%-36s %10s %10s\n", "Euler angles from the quaternion", "ns/update", "ticks/update");
+    result = benchEuler(false);
+    printf("%-36s %10.2f %10.2f\n", "libm", result.nsPerLoop, result.ticksPerLoop);
+    result = benchEuler(true);
+    printf("%-36s %10.2f %10.2f\n", "atan2_approx, acos_approx", result.nsPerLoop, result.ticksPerLoop);
+    return 0;
+}
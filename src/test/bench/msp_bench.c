@@ -0,0 +1,204 @@
+/*
+ * This file is part of Cleanflight.
+ *
+ * Cleanflight is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cleanflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cleanflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host benchmark of MSP replies, how many bytes per microsecond get to the transmit ring of a UART when the reply
+ * is serialized the way serial_msp.c does it. Every byte written to the port by serialWrite(), as before, against the
+ * reply put together in a buffer and written with serialWriteBuf(). The fake UART is uartWrite() and uartWriteBuf()
+ * with the start of the transmission a store to a volatile, and the interrupt empties the ring after every reply.
+ * Host figures only compare the two with each other.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "platform.h"
+
+#include "common/utils.h"
+
+#include "drivers/serial.h"
+
+#define ROUNDS 200000
+
+/* Fake UART */
+
+#define TX_BUFFER_SIZE 256
+
+static volatile uint8_t txBuffer[TX_BUFFER_SIZE];
+static volatile uint32_t txInterruptEnabled;
+static uint64_t bytesOut;
+
+// Not inlined, the firmware calls the driver through the vtable
+static void __attribute__ ((noinline)) fakeUartWrite(serialPort_t *instance, uint8_t ch)
+{
+    instance->txBuffer[instance->txBufferHead] = ch;
+    if (instance->txBufferHead + 1 >= instance->txBufferSize) {
+        instance->txBufferHead = 0;
+    } else {
+        instance->txBufferHead++;
+    }
+    txInterruptEnabled = 1;
+}
+
+static void __attribute__ ((noinline)) fakeUartWriteBuf(serialPort_t *instance, const uint8_t *data, uint32_t count)
+{
+    serialBufferWrite(instance, data, count);
+    txInterruptEnabled = 1;
+}
+
+static uint32_t fakeUartTotalRxWaiting(serialPort_t *instance) { (void)instance; return 0; }
+static uint32_t fakeUartTotalTxFree(serialPort_t *instance) { (void)instance; return TX_BUFFER_SIZE - 1; }
+static uint8_t fakeUartRead(serialPort_t *instance) { (void)instance; return 0; }
+static void fakeUartSetBaudRate(serialPort_t *instance, uint32_t baudRate) { (void)instance; (void)baudRate; }
+static bool fakeUartTransmitBufferEmpty(serialPort_t *instance) { (void)instance; return true; }
+static void fakeUartSetMode(serialPort_t *instance, portMode_t mode) { (void)instance; (void)mode; }
+
+static const struct serialPortVTable fakeUartVTable = {
+    fakeUartWrite, fakeUartTotalRxWaiting, fakeUartTotalTxFree, fakeUartRead, fakeUartSetBaudRate,
+    fakeUartTransmitBufferEmpty, fakeUartSetMode, NULL, NULL, fakeUartWriteBuf, NULL
+};
+
+static serialPort_t fakeUart = {
+    .vTable = &fakeUartVTable, .txBuffer = txBuffer, .txBufferSize = TX_BUFFER_SIZE
+};
+
+// What the transmit interrupt would have sent by the time of the next reply
+static void fakeUartDrain(void)
+{
+    bytesOut += (fakeUart.txBufferHead - fakeUart.txBufferTail) % TX_BUFFER_SIZE;
+    fakeUart.txBufferTail = fakeUart.txBufferHead;
+}
+
+/* The serializers of serial_msp.c */
+
+#define MSP_REPLY_BUFFER_SIZE 128
+
+static serialPort_t *mspSerialPort = &fakeUart;
+static uint8_t checksum;
+static bool buffered;
+
+static uint8_t mspReplyBuffer[MSP_REPLY_BUFFER_SIZE];
+static uint8_t mspReplyBufferPosition;
+
+static void mspFlushReply(void)
+{
+    serialWriteBuf(mspSerialPort, mspReplyBuffer, mspReplyBufferPosition);
+    mspReplyBufferPosition = 0;
+}
+
+static void serialize8(uint8_t a)
+{
+    if (buffered) {
+        if (mspReplyBufferPosition == MSP_REPLY_BUFFER_SIZE) {
+            mspFlushReply();
+        }
+        mspReplyBuffer[mspReplyBufferPosition++] = a;
+    } else {
+        serialWrite(mspSerialPort, a);
+    }
+    checksum ^= a;
+}
+
+static void serialize16(uint16_t a)
+{
+    serialize8((uint8_t)(a >> 0));
+    serialize8((uint8_t)(a >> 8));
+}
+
+static void headSerialReply(uint8_t cmd, uint8_t responseBodySize)
+{
+    serialize8('$');
+    serialize8('M');
+    serialize8('>');
+    checksum = 0;
+    serialize8(responseBodySize);
+    serialize8(cmd);
+}
+
+static void tailSerialReply(void)
+{
+    serialize8(checksum);
+    if (buffered) {
+        mspFlushReply();
+    }
+}
+
+typedef struct benchReply_s {
+    const char *name;
+    uint8_t cmd;
+    uint8_t size;               // of the payload, in 16 bit words when words is set
+    bool words;
+} benchReply_t;
+
+// The replies the configurator polls, and the long one it asks for on connecting
+static const benchReply_t benchReplies[] = {
+    { "MSP_STATUS", 101, 11, false },
+    { "MSP_RAW_IMU", 102, 9, true },
+    { "MSP_RC", 105, 18, true },
+    { "MSP_ATTITUDE", 108, 3, true },
+    { "MSP_ANALOG", 110, 7, false },
+    { "MSP_BOXNAMES", 116, 160, false },
+};
+
+static uint64_t nowNs(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static void benchReply(const benchReply_t *reply, bool bufferReply)
+{
+    const uint8_t payloadLength = reply->words ? reply->size * 2 : reply->size;
+    uint64_t startedAt;
+    uint64_t elapsedNs;
+
+    buffered = bufferReply;
+    bytesOut = 0;
+
+    startedAt = nowNs();
+    for (int round = 0; round < ROUNDS; round++) {
+        headSerialReply(reply->cmd, payloadLength);
+        for (int i = 0; i < reply->size; i++) {
+            if (reply->words) {
+                serialize16(round + i * 7);
+            } else {
+                serialize8(round + i);
+            }
+        }
+        tailSerialReply();
+        fakeUartDrain();
+    }
+    elapsedNs = nowNs() - startedAt;
+
+    printf("%-14s %-9s %8d %10.1f %10.2f\n", reply->name, bufferReply ? "buffered" : "bytes", 6 + payloadLength,
+        (double)elapsedNs / ROUNDS, bytesOut * 1000.0 / elapsedNs);
+}
+
+int main(void)
+{
+    printf("%-14s %-9s %8s %10s %10s\n", "reply", "written", "bytes", "ns/reply", "bytes/us");
+    for (unsigned r = 0; r < ARRAYLEN(benchReplies); r++) {
+        benchReply(&benchReplies[r], false);
+        benchReply(&benchReplies[r], true);
+    }
+    return 0;
+}
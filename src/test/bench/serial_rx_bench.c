@@ -0,0 +1,441 @@
+/*
+ * This file is part of Cleanflight.
+ *
+ * Cleanflight is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cleanflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cleanflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host benchmark of the serial receivers, the time per frame to take it in, unpack it and read all of its channels.
+ * Every protocol is timed with the bytes handed over one at a time as the UART interrupt does, and as one span as a
+ * DMA would. SBUS is also timed the way it used to be done, bitfields and a float conversion per channel read. Host
+ * times only compare the paths with each other, they are not the time they take on the MCU.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_HAS_TSC
+#endif
+
+#include "platform.h"
+
+#include "common/utils.h"
+
+#include "drivers/serial.h"
+#include "io/serial.h"
+
+#include "rx/rx.h"
+#include "rx/serial_rx_frame.h"
+#include "rx/sbus.h"
+#include "rx/sumd.h"
+#include "rx/sumh.h"
+#include "rx/spektrum.h"
+#include "rx/xbus.h"
+
+#define FRAME_COUNT 256
+#define ROUNDS 2000
+#define SILENCE 10000
+
+bool sbusInit(rxConfig_t *rxConfig, rxRuntimeConfig_t *rxRuntimeConfig, rcReadRawDataPtr *callback);
+bool spektrumInit(rxConfig_t *rxConfig, rxRuntimeConfig_t *rxRuntimeConfig, rcReadRawDataPtr *callback);
+bool sumdInit(rxConfig_t *rxConfig, rxRuntimeConfig_t *rxRuntimeConfig, rcReadRawDataPtr *callback);
+bool sumhInit(rxConfig_t *rxConfig, rxRuntimeConfig_t *rxRuntimeConfig, rcReadRawDataPtr *callback);
+uint8_t xBusRj01CRC8(uint8_t inData, uint8_t seed);
+
+// What the receivers need of the rest of the firmware
+static uint32_t currentTimeUs;
+static serialPortConfig_t portConfig;
+static serialPort_t port;
+static serialReceiveCallbackPtr portCallback;
+
+// Not inlined into the old receiver, micros() is in drivers/system.c
+uint32_t __attribute__ ((noinline)) micros(void) { return currentTimeUs; }
+serialPortConfig_t *findSerialPortConfig(serialPortFunction_e function) { (void)function; return &portConfig; }
+serialPort_t *openSerialPort(serialPortIdentifier_e identifier, serialPortFunction_e function, serialReceiveCallbackPtr callback,
+    uint32_t baudrate, portMode_t mode, portOptions_t options)
+{
+    (void)identifier; (void)function; (void)baudrate; (void)mode; (void)options;
+    portCallback = callback;
+    return &port;
+}
+
+typedef struct frame_s {
+    uint8_t data[SERIAL_RX_FRAME_MAX_SIZE];
+    uint8_t length;
+} frame_t;
+
+static frame_t frames[FRAME_COUNT];
+static volatile uint32_t sink;
+
+static rxConfig_t benchRxConfig;
+static rxRuntimeConfig_t benchRxRuntimeConfig;
+static rcReadRawDataPtr readRawRC;
+
+typedef struct benchResult_s {
+    double nsPerFrame;
+    double ticksPerFrame;
+} benchResult_t;
+
+static uint64_t nowNs(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static uint16_t crc16(uint16_t crc, uint8_t value)
+{
+    crc ^= (uint16_t)value << 8;
+    for (int i = 0; i < 8; i++) {
+        crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+    return crc;
+}
+
+static void encodeFrames(SerialRXType provider)
+{
+    for (int n = 0; n < FRAME_COUNT; n++) {
+        uint8_t *frame = frames[n].data;
+        int length = 0;
+
+        memset(frame, 0, SERIAL_RX_FRAME_MAX_SIZE);
+        switch (provider) {
+            case SERIALRX_SBUS:
+                frame[0] = 0x0F;
+                for (int bit = 0; bit < 16 * 11; bit++) {
+                    if (rand() & 1) {
+                        frame[1 + bit / 8] |= 1 << (bit % 8);
+                    }
+                }
+                length = 25;
+                break;
+            case SERIALRX_SUMD:
+            case SERIALRX_XBUS_MODE_B:
+            case SERIALRX_XBUS_MODE_B_RJ01: {
+                uint8_t *payload = frame;
+                int channelCount = 12;
+                if (provider == SERIALRX_SUMD) {
+                    frame[length++] = 0xA8;
+                    frame[length++] = 0x01;
+                    frame[length++] = channelCount = 16;
+                } else {
+                    if (provider == SERIALRX_XBUS_MODE_B_RJ01) {
+                        frame[length++] = 0xA1;
+                        frame[length++] = 30;
+                        frame[length++] = 0x00;
+                        payload = frame + length;
+                    }
+                    frame[length++] = 0xA1;
+                }
+                for (int i = 0; i < channelCount; i++) {
+                    const uint16_t value = provider == SERIALRX_SUMD ? 8800 + rand() % 6400 : rand() % 4096;
+                    frame[length++] = value >> 8;
+                    frame[length++] = value & 0xFF;
+                }
+                uint16_t crc = 0;
+                for (uint8_t *b = payload; b < frame + length; b++) {
+                    crc = crc16(crc, *b);
+                }
+                frame[length++] = crc >> 8;
+                frame[length++] = crc & 0xFF;
+                if (provider == SERIALRX_XBUS_MODE_B_RJ01) {
+                    length += 2;
+                    uint8_t outerCrc = 0;
+                    for (int i = 0; i < length; i++) {
+                        outerCrc = xBusRj01CRC8(outerCrc, frame[i]);
+                    }
+                    frame[length++] = outerCrc;
+                }
+                break;
+            }
+            case SERIALRX_SUMH:
+                frame[0] = 0xA8;
+                for (int i = 0; i < 8; i++) {
+                    const uint16_t value = 9440 + rand() % 5120;
+                    frame[3 + i * 2] = value >> 8;
+                    frame[4 + i * 2] = value & 0xFF;
+                }
+                length = 21;
+                break;
+            default:
+                frame[1] = 0x12;
+                for (int i = 0; i < 7; i++) {
+                    const uint16_t word = (i << 11) | (rand() % 2048);
+                    frame[2 + i * 2] = word >> 8;
+                    frame[3 + i * 2] = word & 0xFF;
+                }
+                length = 16;
+                break;
+        }
+        frames[n].length = length;
+    }
+}
+
+static void initProtocol(SerialRXType provider)
+{
+    benchRxConfig.serialrx_provider = provider;
+    benchRxConfig.midrc = 1500;
+
+    switch (provider) {
+        case SERIALRX_SBUS:
+            sbusInit(&benchRxConfig, &benchRxRuntimeConfig, &readRawRC);
+            break;
+        case SERIALRX_SUMD:
+            sumdInit(&benchRxConfig, &benchRxRuntimeConfig, &readRawRC);
+            break;
+        case SERIALRX_SUMH:
+            sumhInit(&benchRxConfig, &benchRxRuntimeConfig, &readRawRC);
+            break;
+        case SERIALRX_XBUS_MODE_B:
+        case SERIALRX_XBUS_MODE_B_RJ01:
+            xBusInit(&benchRxConfig, &benchRxRuntimeConfig, &readRawRC);
+            break;
+        default:
+            spektrumInit(&benchRxConfig, &benchRxRuntimeConfig, &readRawRC);
+            break;
+    }
+}
+
+static void readChannels(void)
+{
+    for (int chan = 0; chan < benchRxRuntimeConfig.channelCount; chan++) {
+        sink += readRawRC(&benchRxRuntimeConfig, chan);
+    }
+}
+
+// spec is NULL for the bytes to go through the port callback one at a time
+static benchResult_t benchProtocol(const serialRxFrameSpec_t *spec)
+{
+    benchResult_t result = { 0, 0 };
+    serialRxFramer_t framer;
+    uint32_t complete = 0;
+
+    if (spec) {
+        serialRxFramerInit(&framer, spec);
+    }
+
+    uint64_t startedAt = nowNs();
+#ifdef BENCH_HAS_TSC
+    uint64_t startedAtTicks = __rdtsc();
+#endif
+
+    for (int round = 0; round < ROUNDS; round++) {
+        for (int n = 0; n < FRAME_COUNT; n++) {
+            uint8_t status;
+
+            currentTimeUs += SILENCE;
+            if (spec) {
+                serialRxFramerReceive(&framer, frames[n].data, frames[n].length, currentTimeUs);
+                status = serialRxFramerStatus(&framer);
+            } else {
+                for (int i = 0; i < frames[n].length; i++) {
+                    currentTimeUs += 100;
+                    portCallback(frames[n].data[i]);
+                }
+                status = serialRxFramePoll();
+            }
+            if (status & SERIAL_RX_FRAME_COMPLETE) {
+                complete++;
+                readChannels();
+            }
+        }
+    }
+
+#ifdef BENCH_HAS_TSC
+    result.ticksPerFrame = (double)(__rdtsc() - startedAtTicks) / (ROUNDS * FRAME_COUNT);
+#endif
+    result.nsPerFrame = (double)(nowNs() - startedAt) / (ROUNDS * FRAME_COUNT);
+
+    if (complete != ROUNDS * FRAME_COUNT) {
+        fprintf(stderr, "only %u of %u frames were received\n", complete, ROUNDS * FRAME_COUNT);
+        exit(1);
+    }
+    return result;
+}
+
+// The SBUS receiver as it was, a bitfield struct over the frame and the float conversion on every channel read
+
+struct oldSbusFrame_s {
+    uint8_t syncByte;
+    unsigned int chan0 : 11;
+    unsigned int chan1 : 11;
+    unsigned int chan2 : 11;
+    unsigned int chan3 : 11;
+    unsigned int chan4 : 11;
+    unsigned int chan5 : 11;
+    unsigned int chan6 : 11;
+    unsigned int chan7 : 11;
+    unsigned int chan8 : 11;
+    unsigned int chan9 : 11;
+    unsigned int chan10 : 11;
+    unsigned int chan11 : 11;
+    unsigned int chan12 : 11;
+    unsigned int chan13 : 11;
+    unsigned int chan14 : 11;
+    unsigned int chan15 : 11;
+    uint8_t flags;
+    uint8_t endByte;
+} __attribute__ ((__packed__));
+
+typedef union {
+    uint8_t bytes[25];
+    struct oldSbusFrame_s frame;
+} oldSbusFrame_t;
+
+static oldSbusFrame_t oldSbusFrame;
+static bool oldSbusFrameDone;
+static uint32_t oldSbusChannelData[18];
+
+// Not inlined, the firmware calls them through the port callback and rcReadRawFunc
+static void __attribute__ ((noinline)) oldSbusDataReceive(uint16_t c)
+{
+    static uint8_t sbusFramePosition = 0;
+    static uint32_t sbusFrameStartAt = 0;
+    uint32_t now = micros();
+
+    int32_t sbusFrameTime = now - sbusFrameStartAt;
+
+    if (sbusFrameTime > (long)(3000 + 500)) {
+        sbusFramePosition = 0;
+    }
+
+    if (sbusFramePosition == 0) {
+        if (c != 0x0F) {
+            return;
+        }
+        sbusFrameStartAt = now;
+    }
+
+    if (sbusFramePosition < 25) {
+        oldSbusFrame.bytes[sbusFramePosition++] = (uint8_t)c;
+        if (sbusFramePosition < 25) {
+            oldSbusFrameDone = false;
+        } else {
+            oldSbusFrameDone = true;
+        }
+    }
+}
+
+static uint8_t __attribute__ ((noinline)) oldSbusFrameStatus(void)
+{
+    if (!oldSbusFrameDone) {
+        return SERIAL_RX_FRAME_PENDING;
+    }
+    oldSbusFrameDone = false;
+
+    oldSbusChannelData[0] = oldSbusFrame.frame.chan0;
+    oldSbusChannelData[1] = oldSbusFrame.frame.chan1;
+    oldSbusChannelData[2] = oldSbusFrame.frame.chan2;
+    oldSbusChannelData[3] = oldSbusFrame.frame.chan3;
+    oldSbusChannelData[4] = oldSbusFrame.frame.chan4;
+    oldSbusChannelData[5] = oldSbusFrame.frame.chan5;
+    oldSbusChannelData[6] = oldSbusFrame.frame.chan6;
+    oldSbusChannelData[7] = oldSbusFrame.frame.chan7;
+    oldSbusChannelData[8] = oldSbusFrame.frame.chan8;
+    oldSbusChannelData[9] = oldSbusFrame.frame.chan9;
+    oldSbusChannelData[10] = oldSbusFrame.frame.chan10;
+    oldSbusChannelData[11] = oldSbusFrame.frame.chan11;
+    oldSbusChannelData[12] = oldSbusFrame.frame.chan12;
+    oldSbusChannelData[13] = oldSbusFrame.frame.chan13;
+    oldSbusChannelData[14] = oldSbusFrame.frame.chan14;
+    oldSbusChannelData[15] = oldSbusFrame.frame.chan15;
+    oldSbusChannelData[16] = (oldSbusFrame.frame.flags & (1 << 0)) ? 1812 : 173;
+    oldSbusChannelData[17] = (oldSbusFrame.frame.flags & (1 << 1)) ? 1812 : 173;
+
+    return SERIAL_RX_FRAME_COMPLETE;
+}
+
+static uint16_t __attribute__ ((noinline)) oldSbusReadRawRC(rxRuntimeConfig_t *rxRuntimeConfig, uint8_t chan)
+{
+    (void)rxRuntimeConfig;
+    return (0.625f * oldSbusChannelData[chan]) + 880;
+}
+
+static benchResult_t benchOldSbus(void)
+{
+    benchResult_t result = { 0, 0 };
+
+    readRawRC = oldSbusReadRawRC;
+    portCallback = oldSbusDataReceive;
+
+    uint64_t startedAt = nowNs();
+#ifdef BENCH_HAS_TSC
+    uint64_t startedAtTicks = __rdtsc();
+#endif
+
+    for (int round = 0; round < ROUNDS; round++) {
+        for (int n = 0; n < FRAME_COUNT; n++) {
+            currentTimeUs += SILENCE;
+            for (int i = 0; i < frames[n].length; i++) {
+                currentTimeUs += 100;
+                portCallback(frames[n].data[i]);
+            }
+            if (oldSbusFrameStatus() & SERIAL_RX_FRAME_COMPLETE) {
+                readChannels();
+            }
+        }
+    }
+
+#ifdef BENCH_HAS_TSC
+    result.ticksPerFrame = (double)(__rdtsc() - startedAtTicks) / (ROUNDS * FRAME_COUNT);
+#endif
+    result.nsPerFrame = (double)(nowNs() - startedAt) / (ROUNDS * FRAME_COUNT);
+    return result;
+}
+
+typedef struct benchProtocol_s {
+    const char *name;
+    SerialRXType provider;
+    const serialRxFrameSpec_t *spec;
+} benchProtocol_t;
+
+static const benchProtocol_t benchProtocols[] = {
+    { "SBUS", SERIALRX_SBUS, &sbusFrameSpec },
+    { "SUMD, 16 channels", SERIALRX_SUMD, &sumdFrameSpec },
+    { "SUMH", SERIALRX_SUMH, &sumhFrameSpec },
+    { "SPEKTRUM2048", SERIALRX_SPEKTRUM2048, &spektrumFrameSpec },
+    { "XB-B", SERIALRX_XBUS_MODE_B, &xBusModeBFrameSpec },
+    { "XB-B-RJ01", SERIALRX_XBUS_MODE_B_RJ01, &xBusRj01FrameSpec },
+};
+
+int main(void)
+{
+    benchResult_t bytes;
+    benchResult_t span;
+
+    srand(1);
+
+    printf("%-24s %12s %12s %12s %12s\n", "frame in, all read", "ns, bytes", "ticks, bytes", "ns, span", "ticks, span");
+    for (unsigned p = 0; p < ARRAYLEN(benchProtocols); p++) {
+        encodeFrames(benchProtocols[p].provider);
+        initProtocol(benchProtocols[p].provider);
+        bytes = benchProtocol(NULL);
+        span = benchProtocol(benchProtocols[p].spec);
+        printf("%-24s %12.2f %12.2f %12.2f %12.2f\n", benchProtocols[p].name,
+            bytes.nsPerFrame, bytes.ticksPerFrame, span.nsPerFrame, span.ticksPerFrame);
+    }
+
+    encodeFrames(SERIALRX_SBUS);
+    initProtocol(SERIALRX_SBUS);
+    bytes = benchOldSbus();
+    printf("%-24s %12.2f %12.2f\n", "SBUS bitfields and float", bytes.nsPerFrame, bytes.ticksPerFrame);
+    return 0;
+}
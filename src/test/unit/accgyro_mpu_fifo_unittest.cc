@@ -0,0 +1,255 @@
+/*
+ * This file is part of Cleanflight.
+ *
+ * Cleanflight is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cleanflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cleanflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+extern "C" {
+    #include "platform.h"
+
+    #include "drivers/exti.h"
+    #include "drivers/bus_spi.h"
+    #include "drivers/sensor.h"
+    #include "drivers/accgyro.h"
+    #include "drivers/accgyro_mpu.h"
+    #include "drivers/accgyro_mpu_fifo.h"
+}
+
+#include "unittest_macros.h"
+#include "gtest/gtest.h"
+
+// MOCK MPU, a FIFO of gyro samples behind the register interface
+
+#define MOCK_FIFO_SIZE 1024
+
+static uint8_t mockFifo[MOCK_FIFO_SIZE];
+static uint16_t mockFifoCount;
+static uint8_t mockUserControl;
+static uint8_t mockFifoEnable;
+static int mockFifoReads;
+static int mockFifoResets;
+
+static void mockFifoPush(int16_t x, int16_t y, int16_t z)
+{
+    const int16_t sample[3] = { x, y, z };
+
+    for (int axis = 0; axis < 3 && mockFifoCount + 2 <= MOCK_FIFO_SIZE; axis++) {
+        mockFifo[mockFifoCount++] = (uint16_t)sample[axis] >> 8;
+        mockFifo[mockFifoCount++] = (uint16_t)sample[axis] & 0xFF;
+    }
+}
+
+static bool mockRead(uint8_t reg, uint8_t length, uint8_t *data)
+{
+    switch (reg) {
+    case MPU_RA_FIFO_COUNTH:
+        data[0] = mockFifoCount >> 8;
+        data[1] = mockFifoCount & 0xFF;
+        return length == 2;
+    case MPU_RA_FIFO_R_W:
+        mockFifoReads++;
+        if (length > mockFifoCount) {
+            return false;
+        }
+        memcpy(data, mockFifo, length);
+        memmove(mockFifo, &mockFifo[length], mockFifoCount - length);
+        mockFifoCount -= length;
+        return true;
+    default:
+        return false;
+    }
+}
+
+static bool mockWrite(uint8_t reg, uint8_t data)
+{
+    switch (reg) {
+    case MPU_RA_USER_CTRL:
+        mockUserControl = data;
+        if (data & MPU_RF_USER_FIFO_RESET) {
+            mockFifoCount = 0;
+            mockFifoResets++;
+        }
+        return true;
+    case MPU_RA_FIFO_EN:
+        mockFifoEnable = data;
+        return true;
+    default:
+        return false;
+    }
+}
+
+static void mockMpuInit(uint16_t fifoSize = MPU6500_FIFO_SIZE)
+{
+    mpuConfiguration.read = mockRead;
+    mpuConfiguration.write = mockWrite;
+    mockFifoReads = 0;
+    mockFifoResets = 0;
+
+    mpuGyroFifoInit(0x10, fifoSize);
+    mockFifoResets = 0;
+}
+
+TEST(AccgyroMpuFifoUnittest, TestInit)
+{
+    // when
+    mockMpuInit();
+
+    // then
+    EXPECT_TRUE(mpuGyroFifoIsEnabled());
+    EXPECT_EQ(MPU_RF_FIFO_GYRO_XYZ, mockFifoEnable);
+    EXPECT_EQ(0x10 | MPU_RF_USER_FIFO_EN, mockUserControl);
+    EXPECT_EQ(0, mockFifoCount);
+}
+
+TEST(AccgyroMpuFifoUnittest, TestReadsAllSamplesInOneBurst)
+{
+    // given
+    mockMpuInit();
+    mockFifoPush(1, -2, 3);
+    mockFifoPush(-32768, 32767, 0);
+    mockFifoPush(100, 200, -300);
+
+    // when
+    int16_t samples[GYRO_BATCH_MAX_SAMPLES][3];
+    uint8_t sampleCount = mpuGyroFifoRead(samples, GYRO_BATCH_MAX_SAMPLES);
+
+    // then
+    EXPECT_EQ(3, sampleCount);
+    EXPECT_EQ(1, mockFifoReads);
+    EXPECT_EQ(0, mockFifoCount);
+
+    EXPECT_EQ(1, samples[0][0]);
+    EXPECT_EQ(-2, samples[0][1]);
+    EXPECT_EQ(3, samples[0][2]);
+    EXPECT_EQ(-32768, samples[1][0]);
+    EXPECT_EQ(32767, samples[1][1]);
+    EXPECT_EQ(0, samples[1][2]);
+    EXPECT_EQ(100, samples[2][0]);
+    EXPECT_EQ(200, samples[2][1]);
+    EXPECT_EQ(-300, samples[2][2]);
+}
+
+TEST(AccgyroMpuFifoUnittest, TestLeavesSamplesAboveMax)
+{
+    // given
+    mockMpuInit();
+    for (int i = 0; i < 5; i++) {
+        mockFifoPush(i, i, i);
+    }
+
+    // when
+    int16_t samples[GYRO_BATCH_MAX_SAMPLES][3];
+    uint8_t sampleCount = mpuGyroFifoRead(samples, 2);
+
+    // then the oldest come first and the rest wait for the next read
+    EXPECT_EQ(2, sampleCount);
+    EXPECT_EQ(0, samples[0][0]);
+    EXPECT_EQ(1, samples[1][0]);
+
+    sampleCount = mpuGyroFifoRead(samples, GYRO_BATCH_MAX_SAMPLES);
+    EXPECT_EQ(3, sampleCount);
+    EXPECT_EQ(2, samples[0][0]);
+    EXPECT_EQ(4, samples[2][0]);
+}
+
+TEST(AccgyroMpuFifoUnittest, TestEmptyFifo)
+{
+    // given
+    mockMpuInit();
+
+    // when
+    int16_t samples[GYRO_BATCH_MAX_SAMPLES][3];
+    uint8_t sampleCount = mpuGyroFifoRead(samples, GYRO_BATCH_MAX_SAMPLES);
+
+    // then the FIFO data is not read at all
+    EXPECT_EQ(0, sampleCount);
+    EXPECT_EQ(0, mockFifoReads);
+}
+
+TEST(AccgyroMpuFifoUnittest, TestResetsAfterOverflow)
+{
+    // given
+    mockMpuInit();
+    while (mockFifoCount < MPU6500_FIFO_SIZE) {
+        mockFifoPush(1, 1, 1);
+    }
+
+    // when
+    int16_t samples[GYRO_BATCH_MAX_SAMPLES][3];
+    uint8_t sampleCount = mpuGyroFifoRead(samples, GYRO_BATCH_MAX_SAMPLES);
+
+    // then
+    EXPECT_EQ(0, sampleCount);
+    EXPECT_EQ(1, mockFifoResets);
+    EXPECT_EQ(0, mockFifoCount);
+    EXPECT_EQ(0x10 | MPU_RF_USER_FIFO_EN, mockUserControl);
+
+    // and the next samples line up again
+    mockFifoPush(7, 8, 9);
+    sampleCount = mpuGyroFifoRead(samples, GYRO_BATCH_MAX_SAMPLES);
+    EXPECT_EQ(1, sampleCount);
+    EXPECT_EQ(9, samples[0][2]);
+}
+
+TEST(AccgyroMpuFifoUnittest, TestLargerFifoIsNotReset)
+{
+    // given an MPU6000 holding more than an MPU6500 could
+    mockMpuInit(MPU6000_FIFO_SIZE);
+    while (mockFifoCount < MPU6500_FIFO_SIZE + MPU_FIFO_GYRO_SAMPLE_SIZE) {
+        mockFifoPush(1, 2, 3);
+    }
+
+    // when
+    int16_t samples[GYRO_BATCH_MAX_SAMPLES][3];
+    uint8_t sampleCount = mpuGyroFifoRead(samples, GYRO_BATCH_MAX_SAMPLES);
+
+    // then
+    EXPECT_EQ(GYRO_BATCH_MAX_SAMPLES, sampleCount);
+    EXPECT_EQ(0, mockFifoResets);
+    EXPECT_EQ(3, samples[0][2]);
+}
+
+TEST(AccgyroMpuFifoUnittest, TestResetsOnPartialSample)
+{
+    // given
+    mockMpuInit();
+    mockFifoPush(1, 2, 3);
+    mockFifo[mockFifoCount++] = 0;
+
+    // when
+    int16_t samples[GYRO_BATCH_MAX_SAMPLES][3];
+    uint8_t sampleCount = mpuGyroFifoRead(samples, GYRO_BATCH_MAX_SAMPLES);
+
+    // then
+    EXPECT_EQ(0, sampleCount);
+    EXPECT_EQ(1, mockFifoResets);
+}
+
+// STUBS
+
+extern "C" {
+
+mpuConfiguration_t mpuConfiguration;
+
+bool spiTransferAsync(spiJob_t *job)
+{
+    UNUSED(job);
+    return false;
+}
+
+}
@@ -0,0 +1,678 @@
+/*
+ * This file is part of Cleanflight.
+ *
+ * Cleanflight is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cleanflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cleanflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+extern "C" {
+    #include "common/encoding.h"
+
+    #include "blackbox/blackbox_fielddefs.h"
+    #include "blackbox/blackbox_adaptive.h"
+    #include "blackbox/blackbox_decoder.h"
+}
+
+#include "unittest_macros.h"
+#include "gtest/gtest.h"
+
+#define MINTHROTTLE 1150
+#define VBATREF 4095
+#define LOOPTIME 250
+
+// A cut down main frame with a field for each encoding the firmware uses
+typedef struct testFrame_s {
+    uint32_t iteration;
+    uint32_t time;
+    int32_t axisI[3];
+    int32_t rcCommand[4];
+    int32_t vbat;
+    int32_t gyro;
+    int32_t motor[2];
+} testFrame_t;
+
+#define TEST_FIELD_COUNT 13
+
+// The P-frame predictors and encodings of data version 2, and those of version 3 with gyroADC and the motors packed
+#define TEST_P_FIELDS \
+        "H Field P predictor:6,2,1,1,1,1,1,1,1,1,3,3,3\n" \
+        "H Field P encoding:9,0,7,7,7,8,8,8,8,6,0,0,0\n"
+#define TEST_PACKED_P_FIELDS \
+        "H Field P predictor:6,2,1,1,1,1,1,1,1,1,11,11,11\n" \
+        "H Field P encoding:9,0,7,7,7,8,8,8,8,6,10,10,10\n"
+
+static const char *testHeaderWithPFields(const char *dataVersion, const char *pInterval, const char *pFields)
+{
+    static char header[2048];
+
+    snprintf(header, sizeof(header),
+        "H Product:Blackbox flight data recorder by Nicholas Sherlock\n"
+        "H Data version:%s\n"
+        "H I interval:32\n"
+        "H Field I name:loopIteration,time,axisI[0],axisI[1],axisI[2],rcCommand[0],rcCommand[1],rcCommand[2],rcCommand[3],vbatLatest,gyroADC[0],motor[0],motor[1]\n"
+        "H Field I signed:0,0,1,1,1,1,1,1,0,0,1,0,0\n"
+        "H Field I predictor:0,0,0,0,0,0,0,0,4,9,0,4,5\n"
+        "H Field I encoding:1,1,0,0,0,0,0,0,1,3,0,1,0\n"
+        "%s"
+        "H Field S name:flightModeFlags,stateFlags\n"
+        "H Field S signed:0,0\n"
+        "H Field S predictor:0,0\n"
+        "H Field S encoding:1,1\n"
+        "H Firmware revision:abc1234\n"
+        "H P interval:%s\n"
+        "H minthrottle:%d\n"
+        "H vbatref:%d\n"
+        "H gyro.scale:0x3d79c190\n",
+        dataVersion, pFields, pInterval, MINTHROTTLE, VBATREF);
+
+    return header;
+}
+
+static const char *testHeader(const char *dataVersion, const char *pInterval)
+{
+    return testHeaderWithPFields(dataVersion, pInterval, TEST_P_FIELDS);
+}
+
+/* A log writer following blackbox.c and blackbox_io.c */
+
+static uint8_t logBuffer[16384];
+static int logLength;
+
+static void writeByte(uint8_t value)
+{
+    logBuffer[logLength++] = value;
+}
+
+static void writeString(const char *s)
+{
+    while (*s) {
+        writeByte(*s++);
+    }
+}
+
+static void writeUnsignedVB(uint32_t value)
+{
+    while (value > 127) {
+        writeByte((uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+    writeByte(value);
+}
+
+static void writeSignedVB(int32_t value)
+{
+    writeUnsignedVB(zigzagEncode(value));
+}
+
+static void writeTag2_3S32(const int32_t *values)
+{
+    int32_t largest = 0;
+
+    for (int i = 0; i < 3; i++) {
+        int32_t magnitude = values[i] < 0 ? -values[i] - 1 : values[i];
+        largest = magnitude > largest ? magnitude : largest;
+    }
+
+    if (largest < 2) {
+        writeByte(((values[0] & 0x03) << 4) | ((values[1] & 0x03) << 2) | (values[2] & 0x03));
+    } else if (largest < 8) {
+        writeByte(0x40 | (values[0] & 0x0F));
+        writeByte((values[1] << 4) | (values[2] & 0x0F));
+    } else if (largest < 32) {
+        writeByte(0x80 | (values[0] & 0x3F));
+        writeByte(values[1] & 0x3F);
+        writeByte(values[2] & 0x3F);
+    } else {
+        uint8_t selector = 0;
+        int byteCounts[3];
+
+        for (int i = 2; i >= 0; i--) {
+            int32_t magnitude = values[i] < 0 ? -values[i] - 1 : values[i];
+            byteCounts[i] = magnitude < 128 ? 1 : magnitude < 32768 ? 2 : magnitude < 8388608 ? 3 : 4;
+            selector = (selector << 2) | (byteCounts[i] - 1);
+        }
+        writeByte(0xC0 | selector);
+        for (int i = 0; i < 3; i++) {
+            for (int b = 0; b < byteCounts[i]; b++) {
+                writeByte(values[i] >> (8 * b));
+            }
+        }
+    }
+}
+
+static void writeTag8_4S16(const int32_t *values)
+{
+    uint8_t selector = 0;
+    uint8_t nibbles[16];
+    int nibbleCount = 0;
+
+    for (int i = 3; i >= 0; i--) {
+        selector <<= 2;
+        if (values[i] == 0) {
+        } else if (values[i] >= -8 && values[i] < 8) {
+            selector |= 1;
+        } else if (values[i] >= -128 && values[i] < 128) {
+            selector |= 2;
+        } else {
+            selector |= 3;
+        }
+    }
+    writeByte(selector);
+
+    for (int i = 0; i < 4; i++) {
+        int width = ((selector >> (2 * i)) & 0x03) == 3 ? 4 : ((selector >> (2 * i)) & 0x03);
+
+        for (int n = width - 1; n >= 0; n--) {
+            nibbles[nibbleCount++] = (values[i] >> (4 * n)) & 0x0F;
+        }
+    }
+    for (int n = 0; n < nibbleCount; n += 2) {
+        writeByte((nibbles[n] << 4) | (n + 1 < nibbleCount ? nibbles[n + 1] : 0));
+    }
+}
+
+static void writeIntraframe(const testFrame_t *frame)
+{
+    writeByte('I');
+    writeUnsignedVB(frame->iteration);
+    writeUnsignedVB(frame->time);
+    for (int i = 0; i < 3; i++) {
+        writeSignedVB(frame->axisI[i]);
+    }
+    for (int i = 0; i < 3; i++) {
+        writeSignedVB(frame->rcCommand[i]);
+    }
+    writeUnsignedVB(frame->rcCommand[3] - MINTHROTTLE);
+    writeUnsignedVB((VBATREF - frame->vbat) & 0x3FFF);
+    writeSignedVB(frame->gyro);
+    writeUnsignedVB(frame->motor[0] - MINTHROTTLE);
+    writeSignedVB(frame->motor[1] - frame->motor[0]);
+}
+
+static void writeInterframe(const testFrame_t *frame, const testFrame_t *previous, const testFrame_t *previous2)
+{
+    int32_t deltas[4];
+
+    writeByte('P');
+    writeSignedVB(frame->time - 2 * previous->time + previous2->time);
+    for (int i = 0; i < 3; i++) {
+        deltas[i] = frame->axisI[i] - previous->axisI[i];
+    }
+    writeTag2_3S32(deltas);
+    for (int i = 0; i < 4; i++) {
+        deltas[i] = frame->rcCommand[i] - previous->rcCommand[i];
+    }
+    writeTag8_4S16(deltas);
+    // A lone TAG8_8SVB field goes without the header
+    writeSignedVB(frame->vbat - previous->vbat);
+    writeSignedVB(frame->gyro - (previous->gyro + previous2->gyro) / 2);
+    for (int i = 0; i < 2; i++) {
+        writeSignedVB(frame->motor[i] - (previous->motor[i] + previous2->motor[i]) / 2);
+    }
+}
+
+static blackboxAdaptiveField_t packedFields[3];
+static uint32_t bitBuffer;
+static int bitCount;
+
+static void writeBits(uint32_t value, int count)
+{
+    for (int i = count - 1; i >= 0; i--) {
+        bitBuffer = (bitBuffer << 1) | ((value >> i) & 1);
+        if (++bitCount == 8) {
+            writeByte(bitBuffer);
+            bitCount = 0;
+        }
+    }
+}
+
+static void writePacked(blackboxAdaptiveField_t *field, int32_t value, int32_t previous, int32_t previous2)
+{
+    int32_t predictions[BLACKBOX_ADAPTIVE_PREDICTOR_COUNT];
+
+    blackboxAdaptivePredictions(predictions, previous, previous2);
+
+    uint32_t residual = zigzagEncode(value - predictions[field->predictor]);
+    int k = blackboxAdaptiveRiceParameter(field);
+
+    if ((residual >> k) < BLACKBOX_RICE_ESCAPE_LENGTH) {
+        for (uint32_t i = 0; i < residual >> k; i++) {
+            writeBits(1, 1);
+        }
+        writeBits(0, 1);
+        writeBits(residual, k);
+    } else {
+        writeBits(0xFFFF, BLACKBOX_RICE_ESCAPE_LENGTH);
+        writeBits(residual >> 16, 16);
+        writeBits(residual, 16);
+    }
+
+    blackboxAdaptiveLearnResidual(field, residual);
+    blackboxAdaptiveLearnValue(field, value, predictions);
+}
+
+// The P-frame of data version 3, gyroADC and the motors in one bitstream
+static void writePackedInterframe(const testFrame_t *frame, const testFrame_t *previous, const testFrame_t *previous2)
+{
+    int32_t deltas[4];
+
+    writeByte('P');
+    writeSignedVB(frame->time - 2 * previous->time + previous2->time);
+    for (int i = 0; i < 3; i++) {
+        deltas[i] = frame->axisI[i] - previous->axisI[i];
+    }
+    writeTag2_3S32(deltas);
+    for (int i = 0; i < 4; i++) {
+        deltas[i] = frame->rcCommand[i] - previous->rcCommand[i];
+    }
+    writeTag8_4S16(deltas);
+    writeSignedVB(frame->vbat - previous->vbat);
+    writePacked(&packedFields[0], frame->gyro, previous->gyro, previous2->gyro);
+    for (int i = 0; i < 2; i++) {
+        writePacked(&packedFields[1 + i], frame->motor[i], previous->motor[i], previous2->motor[i]);
+    }
+    if (bitCount > 0) {
+        writeBits(0, 8 - bitCount);
+    }
+}
+
+static void writeLogEnd(void)
+{
+    writeByte('E');
+    writeByte(FLIGHT_LOG_EVENT_LOG_END);
+    writeString("End of log");
+    writeByte(0);
+}
+
+static testFrame_t testFrames[64];
+
+// Frames whose P-frame deltas reach every size of TAG2_3S32 and TAG8_4S16, RC commands stay within 16 bits
+static void makeTestFrames(int count, uint32_t firstIteration, int iterationStep)
+{
+    for (int i = 0; i < count; i++) {
+        testFrame_t *frame = &testFrames[i];
+        int32_t step = (i % 5 == 0) ? 40000 : (i % 5 == 1) ? 300 : (i % 5 == 2) ? 20 : (i % 5 == 3) ? 5 : 1;
+
+        frame->iteration = firstIteration + i * iterationStep;
+        frame->time = 1000000 + frame->iteration * LOOPTIME + (i % 3);
+        frame->axisI[0] = (i & 1 ? 1 : -1) * step * i;
+        frame->axisI[1] = i % 2;
+        frame->axisI[2] = -step;
+        frame->rcCommand[0] = (i % 4 == 0) ? 0 : (i & 1 ? -1 : 1) * (step > 500 ? 500 : step);
+        frame->rcCommand[1] = (i % 3) * 7;
+        frame->rcCommand[2] = -(i % 6);
+        frame->rcCommand[3] = MINTHROTTLE + 20 * i;
+        frame->vbat = VBATREF - 30 - i / 8;
+        frame->gyro = (i & 1 ? -1 : 1) * step / 3;
+        frame->motor[0] = MINTHROTTLE + 10 * i;
+        frame->motor[1] = MINTHROTTLE + 12 * i - (i & 1);
+    }
+}
+
+static void writeTestFrames(int count)
+{
+    for (int i = 0; i < count; i++) {
+        if (i == 0) {
+            writeIntraframe(&testFrames[i]);
+        } else {
+            writeInterframe(&testFrames[i], &testFrames[i - 1], &testFrames[i > 1 ? i - 2 : i - 1]);
+        }
+    }
+}
+
+static void expectFrame(const testFrame_t *expected, const int32_t *values)
+{
+    const int32_t fields[TEST_FIELD_COUNT] = {
+        (int32_t)expected->iteration, (int32_t)expected->time,
+        expected->axisI[0], expected->axisI[1], expected->axisI[2],
+        expected->rcCommand[0], expected->rcCommand[1], expected->rcCommand[2], expected->rcCommand[3],
+        expected->vbat, expected->gyro, expected->motor[0], expected->motor[1]
+    };
+
+    for (int i = 0; i < TEST_FIELD_COUNT; i++) {
+        EXPECT_EQ(fields[i], values[i]) << "field " << i << " of iteration " << expected->iteration;
+    }
+}
+
+/* Reading the log back */
+
+static int readPosition;
+static int readChunkSize;
+
+static int readLogBuffer(void *context, uint8_t *buffer, int length)
+{
+    UNUSED(context);
+
+    int count = logLength - readPosition;
+
+    count = count < length ? count : length;
+    count = count < readChunkSize ? count : readChunkSize;
+    memcpy(buffer, logBuffer + readPosition, count);
+    readPosition += count;
+
+    return count;
+}
+
+static blackboxDecoder_t decoder;
+
+static void startDecoding(int chunkSize)
+{
+    readPosition = 0;
+    readChunkSize = chunkSize;
+    blackboxDecoderInit(&decoder, readLogBuffer, NULL);
+}
+
+static void resetLog(void)
+{
+    logLength = 0;
+}
+
+TEST(BlackboxDecoderTest, DecodesTheFieldsOfEveryEncoding)
+{
+    // given
+    resetLog();
+    writeString(testHeader("2", "1/1"));
+    makeTestFrames(32, 0, 1);
+    writeTestFrames(32);
+    writeLogEnd();
+
+    // when
+    startDecoding(logLength);
+
+    // then
+    EXPECT_EQ(BLACKBOX_DECODED_LOG_START, blackboxDecoderNext(&decoder));
+    EXPECT_EQ(TEST_FIELD_COUNT, decoder.frameDefs[BLACKBOX_FRAME_INTRA].fieldCount);
+    EXPECT_STREQ("motor[1]", decoder.frameDefs[BLACKBOX_FRAME_INTER].names[12]);
+    EXPECT_EQ(MINTHROTTLE, decoder.minthrottle);
+    EXPECT_STREQ("abc1234", decoder.firmwareRevision);
+    EXPECT_FLOAT_EQ(0.0609756f, decoder.gyroScale);
+
+    for (int i = 0; i < 32; i++) {
+        ASSERT_EQ(BLACKBOX_DECODED_MAIN, blackboxDecoderNext(&decoder));
+        EXPECT_EQ(i == 0 ? BLACKBOX_FRAME_INTRA : BLACKBOX_FRAME_INTER, decoder.frame.type);
+        expectFrame(&testFrames[i], decoder.frame.values);
+    }
+
+    EXPECT_EQ(BLACKBOX_DECODED_LOG_END, blackboxDecoderNext(&decoder));
+    EXPECT_TRUE(decoder.logEnded);
+    EXPECT_EQ(1, decoder.stats.frameCount[BLACKBOX_FRAME_INTRA]);
+    EXPECT_EQ(31, decoder.stats.frameCount[BLACKBOX_FRAME_INTER]);
+    EXPECT_EQ(0, decoder.stats.corruptFrames);
+    EXPECT_EQ(0, decoder.stats.missingIterations);
+    EXPECT_EQ(BLACKBOX_DECODED_END, blackboxDecoderNext(&decoder));
+}
+
+TEST(BlackboxDecoderTest, DecodesTheSameWhateverSizeTheReadsAre)
+{
+    // given
+    resetLog();
+    writeString(testHeader("2", "1/1"));
+    makeTestFrames(32, 0, 1);
+    writeTestFrames(32);
+
+    for (int chunkSize = 1; chunkSize < 100; chunkSize += 7) {
+        int frames = 0;
+
+        // when
+        startDecoding(chunkSize);
+
+        // then
+        EXPECT_EQ(BLACKBOX_DECODED_LOG_START, blackboxDecoderNext(&decoder));
+        while (blackboxDecoderNext(&decoder) == BLACKBOX_DECODED_MAIN) {
+            expectFrame(&testFrames[frames++], decoder.frame.values);
+        }
+        EXPECT_EQ(32, frames);
+        EXPECT_FALSE(decoder.logEnded);
+        EXPECT_EQ(0, decoder.stats.corruptFrames);
+    }
+}
+
+TEST(BlackboxDecoderTest, ResynchronisesAtTheNextIntraframeAfterDamage)
+{
+    // given
+    resetLog();
+    writeString(testHeader("2", "1/1"));
+    makeTestFrames(8, 0, 1);
+    writeTestFrames(8);
+    // bytes a logger dropped leave the frame before them running into garbage
+    writeByte(0x01);
+    writeByte(0x02);
+    for (int i = 8; i < 16; i++) {
+        writeInterframe(&testFrames[i % 8], &testFrames[(i - 1) % 8], &testFrames[(i - 2) % 8]);
+    }
+    makeTestFrames(4, 32, 1);
+    writeTestFrames(4);
+    writeLogEnd();
+
+    // when
+    startDecoding(logLength);
+    int frames = 0;
+    blackboxDecoded_e decoded;
+
+    EXPECT_EQ(BLACKBOX_DECODED_LOG_START, blackboxDecoderNext(&decoder));
+    while ((decoded = blackboxDecoderNext(&decoder)) == BLACKBOX_DECODED_MAIN) {
+        if (decoder.frame.values[0] >= 32) {
+            expectFrame(&testFrames[decoder.frame.values[0] - 32], decoder.frame.values);
+        }
+        frames++;
+    }
+
+    // then
+    EXPECT_EQ(BLACKBOX_DECODED_LOG_END, decoded);
+    EXPECT_EQ(7 + 4, frames);
+    EXPECT_EQ(1, decoder.stats.corruptFrames);
+    EXPECT_EQ(1, decoder.stats.resyncs);
+    EXPECT_LT(0u, decoder.stats.skippedBytes);
+    EXPECT_EQ(8, decoder.stats.unusableFrames);
+    EXPECT_EQ(32 - 7, decoder.stats.missingIterations);
+}
+
+TEST(BlackboxDecoderTest, CountsOnlyIterationsThePIntervalShouldHaveLogged)
+{
+    // given
+    resetLog();
+    writeString(testHeader("2", "1/2"));
+    makeTestFrames(3, 0, 2);
+    writeTestFrames(3);
+    makeTestFrames(2, 32, 2);
+    writeTestFrames(2);
+
+    // when
+    startDecoding(logLength);
+
+    // then
+    EXPECT_EQ(BLACKBOX_DECODED_LOG_START, blackboxDecoderNext(&decoder));
+    EXPECT_EQ(1, decoder.frameIntervalPNum);
+    EXPECT_EQ(2, decoder.frameIntervalPDenom);
+
+    const uint32_t expectedIterations[] = { 0, 2, 4, 32, 34 };
+    for (int i = 0; i < 5; i++) {
+        ASSERT_EQ(BLACKBOX_DECODED_MAIN, blackboxDecoderNext(&decoder));
+        EXPECT_EQ(expectedIterations[i], (uint32_t)decoder.frame.values[0]);
+    }
+    EXPECT_EQ(BLACKBOX_DECODED_LOG_END, blackboxDecoderNext(&decoder));
+
+    // 6, 8 ... 30
+    EXPECT_EQ(13, decoder.stats.missingIterations);
+}
+
+TEST(BlackboxDecoderTest, DecodesEventsAndSlowFrames)
+{
+    // given
+    resetLog();
+    writeString(testHeader("2", "1/1"));
+    makeTestFrames(2, 0, 1);
+    writeTestFrames(2);
+
+    writeByte('S');
+    writeUnsignedVB(5);
+    writeUnsignedVB(300);
+
+    writeByte('E');
+    writeByte(FLIGHT_LOG_EVENT_SYNC_BEEP);
+    writeUnsignedVB(123456);
+
+    // the firmware follows an inflight adjustment with the G-Tune fields
+    writeByte('E');
+    writeByte(FLIGHT_LOG_EVENT_INFLIGHT_ADJUSTMENT);
+    writeByte(7);
+    writeSignedVB(-25);
+    writeByte(0);
+    writeSignedVB(0);
+    writeByte(0);
+    writeByte(0);
+
+    writeByte('E');
+    writeByte(FLIGHT_LOG_EVENT_LOGGING_RESUME);
+    writeUnsignedVB(4096);
+    writeUnsignedVB(2000000);
+    makeTestFrames(1, 4096, 1);
+    testFrames[0].time = 2000000;
+    writeTestFrames(1);
+
+    // when
+    startDecoding(logLength);
+
+    // then
+    EXPECT_EQ(BLACKBOX_DECODED_LOG_START, blackboxDecoderNext(&decoder));
+    EXPECT_EQ(BLACKBOX_DECODED_MAIN, blackboxDecoderNext(&decoder));
+    EXPECT_EQ(BLACKBOX_DECODED_MAIN, blackboxDecoderNext(&decoder));
+
+    EXPECT_EQ(BLACKBOX_DECODED_SLOW, blackboxDecoderNext(&decoder));
+    EXPECT_EQ(5, decoder.frame.values[0]);
+    EXPECT_EQ(300, decoder.frame.values[1]);
+
+    EXPECT_EQ(BLACKBOX_DECODED_EVENT, blackboxDecoderNext(&decoder));
+    EXPECT_EQ(FLIGHT_LOG_EVENT_SYNC_BEEP, decoder.event.event);
+    EXPECT_EQ(123456, decoder.event.data.syncBeep.time);
+
+    EXPECT_EQ(BLACKBOX_DECODED_EVENT, blackboxDecoderNext(&decoder));
+    EXPECT_EQ(FLIGHT_LOG_EVENT_INFLIGHT_ADJUSTMENT, decoder.event.event);
+    EXPECT_EQ(7, decoder.event.data.inflightAdjustment.adjustmentFunction);
+    EXPECT_FALSE(decoder.event.data.inflightAdjustment.floatFlag);
+    EXPECT_EQ(-25, decoder.event.data.inflightAdjustment.newValue);
+
+    EXPECT_EQ(BLACKBOX_DECODED_EVENT, blackboxDecoderNext(&decoder));
+    EXPECT_EQ(FLIGHT_LOG_EVENT_LOGGING_RESUME, decoder.event.event);
+
+    // the jump to the resumed iteration is on purpose
+    EXPECT_EQ(BLACKBOX_DECODED_MAIN, blackboxDecoderNext(&decoder));
+    EXPECT_EQ(4096, decoder.frame.values[0]);
+    EXPECT_EQ(BLACKBOX_DECODED_LOG_END, blackboxDecoderNext(&decoder));
+    EXPECT_EQ(0, decoder.stats.corruptFrames);
+    EXPECT_EQ(0, decoder.stats.missingIterations);
+    EXPECT_EQ(1, decoder.stats.resumes);
+    EXPECT_EQ(3, decoder.stats.eventCount);
+}
+
+TEST(BlackboxDecoderTest, SplitsTheInputIntoLogs)
+{
+    // given
+    resetLog();
+    writeString("garbage before the first log");
+    writeString(testHeader("2", "1/1"));
+    makeTestFrames(4, 0, 1);
+    writeTestFrames(4);
+    writeLogEnd();
+    for (int i = 0; i < 100; i++) {
+        writeByte(0xFF);
+    }
+    writeString(testHeader("99", "1/1"));
+    writeTestFrames(4);
+    writeString(testHeader("2", "1/1"));
+    writeTestFrames(3);
+
+    // when
+    startDecoding(logLength);
+
+    // then
+    EXPECT_EQ(BLACKBOX_DECODED_LOG_START, blackboxDecoderNext(&decoder));
+    EXPECT_EQ(0, decoder.logIndex);
+    for (int i = 0; i < 4; i++) {
+        EXPECT_EQ(BLACKBOX_DECODED_MAIN, blackboxDecoderNext(&decoder));
+    }
+    EXPECT_EQ(BLACKBOX_DECODED_LOG_END, blackboxDecoderNext(&decoder));
+    EXPECT_TRUE(decoder.logEnded);
+
+    EXPECT_EQ(BLACKBOX_DECODED_LOG_UNSUPPORTED, blackboxDecoderNext(&decoder));
+    EXPECT_EQ(1, decoder.logIndex);
+    EXPECT_STREQ("unsupported data version", decoder.error);
+
+    EXPECT_EQ(BLACKBOX_DECODED_LOG_START, blackboxDecoderNext(&decoder));
+    EXPECT_EQ(2, decoder.logIndex);
+    for (int i = 0; i < 3; i++) {
+        EXPECT_EQ(BLACKBOX_DECODED_MAIN, blackboxDecoderNext(&decoder));
+        expectFrame(&testFrames[i], decoder.frame.values);
+    }
+    EXPECT_EQ(BLACKBOX_DECODED_LOG_END, blackboxDecoderNext(&decoder));
+    EXPECT_FALSE(decoder.logEnded);
+    EXPECT_EQ(BLACKBOX_DECODED_END, blackboxDecoderNext(&decoder));
+}
+
+TEST(BlackboxDecoderTest, DecodesPackedFieldsOfDataVersion3)
+{
+    // given
+    resetLog();
+    writeString(testHeaderWithPFields("3", "1/1", TEST_PACKED_P_FIELDS));
+    makeTestFrames(64, 0, 1);
+    // Two I intervals, the second starts the adaptive state over, and fields that follow a straight line for a while
+    for (int i = 0; i < 64; i++) {
+        if (i % 32 == 0) {
+            writeIntraframe(&testFrames[i]);
+            for (int f = 0; f < 3; f++) {
+                blackboxAdaptiveReset(&packedFields[f]);
+            }
+        } else {
+            if (i >= 40) {
+                testFrames[i].gyro = 500 + 37 * i;
+                testFrames[i].motor[0] = MINTHROTTLE + 300 + (i & 3);
+            }
+            writePackedInterframe(&testFrames[i], &testFrames[i - 1], &testFrames[i % 32 > 1 ? i - 2 : i - 1]);
+        }
+    }
+    writeLogEnd();
+
+    // when
+    startDecoding(logLength);
+
+    // then
+    EXPECT_EQ(BLACKBOX_DECODED_LOG_START, blackboxDecoderNext(&decoder));
+    EXPECT_EQ(3, decoder.dataVersion);
+    for (int i = 0; i < 64; i++) {
+        ASSERT_EQ(BLACKBOX_DECODED_MAIN, blackboxDecoderNext(&decoder));
+        expectFrame(&testFrames[i], decoder.frame.values);
+    }
+    EXPECT_EQ(BLACKBOX_DECODED_LOG_END, blackboxDecoderNext(&decoder));
+    EXPECT_TRUE(decoder.logEnded);
+    EXPECT_EQ(0, decoder.stats.corruptFrames);
+}
+
+TEST(BlackboxDecoderTest, RejectsPackedFieldsOutsideDataVersion3)
+{
+    // given
+    resetLog();
+    writeString(testHeaderWithPFields("2", "1/1", TEST_PACKED_P_FIELDS));
+    makeTestFrames(4, 0, 1);
+    writeTestFrames(4);
+
+    // when
+    startDecoding(logLength);
+
+    // then
+    EXPECT_EQ(BLACKBOX_DECODED_LOG_UNSUPPORTED, blackboxDecoderNext(&decoder));
+    EXPECT_STREQ("bad packed field", decoder.error);
+}
@@ -0,0 +1,431 @@
+/*
+ * This file is part of Cleanflight.
+ *
+ * Cleanflight is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cleanflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cleanflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+extern "C" {
+    #include "platform.h"
+
+    #include "drivers/bus_spi.h"
+}
+
+#include "unittest_macros.h"
+#include "gtest/gtest.h"
+
+#define FAKE_BUS_COUNT 3
+#define FAKE_DEVICE_COUNT 3
+#define FAKE_DEVICE_LOG_SIZE 64
+
+// FAKE BUSES, bus 1 and 3 have DMA, bus 2 does not
+
+static SPI_TypeDef fakeSpi[FAKE_BUS_COUNT];
+
+#define FAKE_SPI1 (&fakeSpi[0])
+#define FAKE_SPI2 (&fakeSpi[1])
+#define FAKE_SPI3 (&fakeSpi[2])
+
+// FAKE DEVICES, each logs the bytes it gets while selected and answers with a counter
+
+typedef struct fakeDevice_s {
+    spiDevice_t device;
+    bool selected;
+    int selectCount;
+    uint8_t log[FAKE_DEVICE_LOG_SIZE];
+    int logCount;
+    uint8_t reply;
+} fakeDevice_t;
+
+static GPIO_TypeDef fakeGpio;
+static fakeDevice_t fakeDevices[FAKE_DEVICE_COUNT];
+
+#define GYRO_DEVICE (&fakeDevices[0])      // on bus 1
+#define FLASH_DEVICE (&fakeDevices[1])     // on bus 1
+#define BARO_DEVICE (&fakeDevices[2])      // on bus 3
+
+static fakeDevice_t *fakeDeviceFind(const spiDevice_t *device)
+{
+    for (int i = 0; i < FAKE_DEVICE_COUNT; i++) {
+        if (fakeDevices[i].device.csPin == device->csPin) {
+            return &fakeDevices[i];
+        }
+    }
+    return NULL;
+}
+
+static uint8_t fakeClock(SPI_TypeDef *instance, uint8_t out)
+{
+    for (int i = 0; i < FAKE_DEVICE_COUNT; i++) {
+        fakeDevice_t *fake = &fakeDevices[i];
+
+        if (fake->device.instance == instance && fake->selected) {
+            if (fake->logCount < FAKE_DEVICE_LOG_SIZE) {
+                fake->log[fake->logCount++] = out;
+            }
+            return fake->reply++;
+        }
+    }
+    ADD_FAILURE() << "byte clocked with no device selected";
+    return 0;
+}
+
+static void fakeTransfer(SPI_TypeDef *instance, const uint8_t *out, uint8_t *in, uint16_t length)
+{
+    for (int i = 0; i < length; i++) {
+        uint8_t b = fakeClock(instance, out ? out[i] : 0xFF);
+        if (in) {
+            in[i] = b;
+        }
+    }
+}
+
+// FAKE DMA ENGINE, holds the transfer started on a bus until the test lets it run
+
+typedef struct fakeDmaTransfer_s {
+    bool pending;
+    const uint8_t *out;
+    uint8_t *in;
+    uint16_t length;
+} fakeDmaTransfer_t;
+
+static fakeDmaTransfer_t fakeDma[FAKE_BUS_COUNT];
+static int fakeDmaStarts;
+
+static bool fakeBusHasDma(SPI_TypeDef *instance)
+{
+    return instance != FAKE_SPI2;
+}
+
+// Moves the bytes of the pending transfer and raises the transfer complete interrupt, false if nothing was pending
+static bool fakeDmaRun(SPI_TypeDef *instance)
+{
+    fakeDmaTransfer_t *dma = &fakeDma[instance - fakeSpi];
+
+    if (!dma->pending) {
+        return false;
+    }
+    dma->pending = false;
+    fakeTransfer(instance, dma->out, dma->in, dma->length);
+    spiDmaTransferComplete(instance);
+    return true;
+}
+
+static void resetFakes(void)
+{
+    memset(fakeDevices, 0, sizeof(fakeDevices));
+    memset(fakeDma, 0, sizeof(fakeDma));
+    fakeDmaStarts = 0;
+
+    GYRO_DEVICE->device = (spiDevice_t) { FAKE_SPI1, &fakeGpio, 1 << 4 };
+    FLASH_DEVICE->device = (spiDevice_t) { FAKE_SPI1, &fakeGpio, 1 << 3 };
+    BARO_DEVICE->device = (spiDevice_t) { FAKE_SPI3, &fakeGpio, 1 << 12 };
+}
+
+// JOB CALLBACKS
+
+#define CALLBACK_LOG_SIZE 8
+
+static spiJob_t *callbackLog[CALLBACK_LOG_SIZE];
+static int callbackCount;
+static spiJob_t *followUpJob;
+
+static void logCallback(spiJob_t *job)
+{
+    EXPECT_EQ(SPI_JOB_DONE, job->state);
+    EXPECT_FALSE(fakeDeviceFind(job->device)->selected);
+    if (callbackCount < CALLBACK_LOG_SIZE) {
+        callbackLog[callbackCount] = job;
+    }
+    callbackCount++;
+}
+
+static void followUpCallback(spiJob_t *job)
+{
+    logCallback(job);
+    EXPECT_TRUE(spiTransferAsync(followUpJob));
+}
+
+static void resetCallbacks(void)
+{
+    callbackCount = 0;
+    followUpJob = NULL;
+}
+
+static void initJob(spiJob_t *job, fakeDevice_t *device, const spiSegment_t *segments, uint8_t segmentCount)
+{
+    memset(job, 0, sizeof(*job));
+    job->device = &device->device;
+    job->segments = segments;
+    job->segmentCount = segmentCount;
+    job->callback = logCallback;
+}
+
+TEST(BusSpiAsyncUnittest, TestJobKeepsDeviceSelectedOverSegments)
+{
+    // given
+    resetFakes();
+    resetCallbacks();
+    const uint8_t command = 0x3B | 0x80;
+    uint8_t data[6] = { 0 };
+    const spiSegment_t segments[2] = { { &command, NULL, 1 }, { NULL, data, sizeof(data) } };
+    spiJob_t job;
+    initJob(&job, GYRO_DEVICE, segments, 2);
+
+    // when
+    EXPECT_TRUE(spiTransferAsync(&job));
+
+    // then the first segment is left to the DMA
+    EXPECT_EQ(SPI_JOB_BUSY, job.state);
+    EXPECT_TRUE(GYRO_DEVICE->selected);
+    EXPECT_TRUE(spiBusIsBusy(FAKE_SPI1));
+    EXPECT_EQ(0, GYRO_DEVICE->logCount);
+
+    // and the device stays selected from one segment to the next
+    EXPECT_TRUE(fakeDmaRun(FAKE_SPI1));
+    EXPECT_EQ(SPI_JOB_BUSY, job.state);
+    EXPECT_TRUE(GYRO_DEVICE->selected);
+    EXPECT_EQ(0, callbackCount);
+
+    EXPECT_TRUE(fakeDmaRun(FAKE_SPI1));
+    EXPECT_TRUE(spiJobIsDone(&job));
+    EXPECT_FALSE(GYRO_DEVICE->selected);
+    EXPECT_EQ(1, GYRO_DEVICE->selectCount);
+    EXPECT_FALSE(spiBusIsBusy(FAKE_SPI1));
+    EXPECT_FALSE(fakeDmaRun(FAKE_SPI1));
+
+    EXPECT_EQ(1, callbackCount);
+    EXPECT_EQ(&job, callbackLog[0]);
+
+    // the command went out, then 0xFF while the data came in
+    EXPECT_EQ(7, GYRO_DEVICE->logCount);
+    EXPECT_EQ(0xBB, GYRO_DEVICE->log[0]);
+    for (int i = 0; i < 6; i++) {
+        EXPECT_EQ(0xFF, GYRO_DEVICE->log[1 + i]);
+        EXPECT_EQ(1 + i, data[i]);
+    }
+}
+
+TEST(BusSpiAsyncUnittest, TestJobsOfABusRunInOrder)
+{
+    // given
+    resetFakes();
+    resetCallbacks();
+    const uint8_t gyroCommand[2] = { 0x6A, 0x04 };
+    const uint8_t flashCommand[4] = { 0x02, 0x00, 0x01, 0x00 };
+    const spiSegment_t gyroSegment = { gyroCommand, NULL, sizeof(gyroCommand) };
+    const spiSegment_t flashSegment = { flashCommand, NULL, sizeof(flashCommand) };
+    spiJob_t flashJob, gyroJob;
+    initJob(&flashJob, FLASH_DEVICE, &flashSegment, 1);
+    initJob(&gyroJob, GYRO_DEVICE, &gyroSegment, 1);
+
+    // when
+    EXPECT_TRUE(spiTransferAsync(&flashJob));
+    EXPECT_TRUE(spiTransferAsync(&gyroJob));
+
+    // then the second job waits for the bus
+    EXPECT_EQ(SPI_JOB_BUSY, flashJob.state);
+    EXPECT_EQ(SPI_JOB_QUEUED, gyroJob.state);
+    EXPECT_TRUE(FLASH_DEVICE->selected);
+    EXPECT_FALSE(GYRO_DEVICE->selected);
+
+    // and starts from the interrupt that ends the first
+    EXPECT_TRUE(fakeDmaRun(FAKE_SPI1));
+    EXPECT_EQ(SPI_JOB_DONE, flashJob.state);
+    EXPECT_EQ(SPI_JOB_BUSY, gyroJob.state);
+    EXPECT_FALSE(FLASH_DEVICE->selected);
+    EXPECT_TRUE(GYRO_DEVICE->selected);
+
+    EXPECT_TRUE(fakeDmaRun(FAKE_SPI1));
+    EXPECT_EQ(SPI_JOB_DONE, gyroJob.state);
+    EXPECT_FALSE(spiBusIsBusy(FAKE_SPI1));
+
+    EXPECT_EQ(2, callbackCount);
+    EXPECT_EQ(&flashJob, callbackLog[0]);
+    EXPECT_EQ(&gyroJob, callbackLog[1]);
+    EXPECT_EQ(4, FLASH_DEVICE->logCount);
+    EXPECT_EQ(0, memcmp(flashCommand, FLASH_DEVICE->log, sizeof(flashCommand)));
+    EXPECT_EQ(2, GYRO_DEVICE->logCount);
+    EXPECT_EQ(0, memcmp(gyroCommand, GYRO_DEVICE->log, sizeof(gyroCommand)));
+}
+
+TEST(BusSpiAsyncUnittest, TestBusesRunSideBySide)
+{
+    // given
+    resetFakes();
+    resetCallbacks();
+    uint8_t gyroData[6], baroData[3];
+    const spiSegment_t gyroSegment = { NULL, gyroData, sizeof(gyroData) };
+    const spiSegment_t baroSegment = { NULL, baroData, sizeof(baroData) };
+    spiJob_t gyroJob, baroJob;
+    initJob(&gyroJob, GYRO_DEVICE, &gyroSegment, 1);
+    initJob(&baroJob, BARO_DEVICE, &baroSegment, 1);
+
+    // when
+    EXPECT_TRUE(spiTransferAsync(&gyroJob));
+    EXPECT_TRUE(spiTransferAsync(&baroJob));
+
+    // then both are on their buses at once
+    EXPECT_EQ(SPI_JOB_BUSY, gyroJob.state);
+    EXPECT_EQ(SPI_JOB_BUSY, baroJob.state);
+    EXPECT_EQ(2, fakeDmaStarts);
+
+    // and finish in any order
+    EXPECT_TRUE(fakeDmaRun(FAKE_SPI3));
+    EXPECT_EQ(SPI_JOB_DONE, baroJob.state);
+    EXPECT_EQ(SPI_JOB_BUSY, gyroJob.state);
+    EXPECT_TRUE(fakeDmaRun(FAKE_SPI1));
+    EXPECT_EQ(SPI_JOB_DONE, gyroJob.state);
+}
+
+TEST(BusSpiAsyncUnittest, TestCallbackStartsNextJob)
+{
+    // given
+    resetFakes();
+    resetCallbacks();
+    uint8_t count[2], data[12];
+    const spiSegment_t countSegment = { NULL, count, sizeof(count) };
+    const spiSegment_t dataSegment = { NULL, data, sizeof(data) };
+    spiJob_t countJob, dataJob;
+    initJob(&countJob, GYRO_DEVICE, &countSegment, 1);
+    initJob(&dataJob, GYRO_DEVICE, &dataSegment, 1);
+    countJob.callback = followUpCallback;
+    followUpJob = &dataJob;
+
+    // when
+    EXPECT_TRUE(spiTransferAsync(&countJob));
+    EXPECT_TRUE(fakeDmaRun(FAKE_SPI1));
+
+    // then the follow up job is on the bus right away, in its own chip select cycle
+    EXPECT_EQ(SPI_JOB_DONE, countJob.state);
+    EXPECT_EQ(SPI_JOB_BUSY, dataJob.state);
+    EXPECT_TRUE(GYRO_DEVICE->selected);
+    EXPECT_EQ(2, GYRO_DEVICE->selectCount);
+
+    EXPECT_TRUE(fakeDmaRun(FAKE_SPI1));
+    EXPECT_EQ(SPI_JOB_DONE, dataJob.state);
+    EXPECT_EQ(2, callbackCount);
+    EXPECT_EQ(2, data[0]);
+}
+
+TEST(BusSpiAsyncUnittest, TestJobInFlightIsNotQueuedTwice)
+{
+    // given
+    resetFakes();
+    resetCallbacks();
+    uint8_t data[2];
+    const spiSegment_t segment = { NULL, data, sizeof(data) };
+    spiJob_t job;
+    initJob(&job, GYRO_DEVICE, &segment, 1);
+    EXPECT_TRUE(spiTransferAsync(&job));
+
+    // when
+    EXPECT_FALSE(spiTransferAsync(&job));
+
+    // then it runs once
+    EXPECT_TRUE(fakeDmaRun(FAKE_SPI1));
+    EXPECT_FALSE(fakeDmaRun(FAKE_SPI1));
+    EXPECT_EQ(1, callbackCount);
+
+    // and can go again once done
+    EXPECT_TRUE(spiTransferAsync(&job));
+    EXPECT_TRUE(fakeDmaRun(FAKE_SPI1));
+    EXPECT_EQ(2, callbackCount);
+    EXPECT_EQ(2, GYRO_DEVICE->selectCount);
+}
+
+TEST(BusSpiAsyncUnittest, TestBusWithoutDma)
+{
+    // given
+    resetFakes();
+    resetCallbacks();
+    fakeDevice_t *device = &fakeDevices[0];
+    device->device = (spiDevice_t) { FAKE_SPI2, &fakeGpio, 1 << 12 };
+    const uint8_t command = 0x75 | 0x80;
+    uint8_t data[4];
+    const spiSegment_t segments[2] = { { &command, NULL, 1 }, { NULL, data, sizeof(data) } };
+    spiJob_t job;
+    initJob(&job, device, segments, 2);
+
+    // when
+    EXPECT_TRUE(spiTransferAsync(&job));
+
+    // then the job is done before the call returns
+    EXPECT_EQ(SPI_JOB_DONE, job.state);
+    EXPECT_FALSE(device->selected);
+    EXPECT_FALSE(spiBusIsBusy(FAKE_SPI2));
+    EXPECT_EQ(0, fakeDmaStarts);
+    EXPECT_EQ(1, callbackCount);
+    EXPECT_EQ(5, device->logCount);
+    EXPECT_EQ(4, data[3]);
+
+    // and waiting for a job works the same
+    job.callback = NULL;
+    spiTransferJob(&job);
+    EXPECT_EQ(SPI_JOB_DONE, job.state);
+    EXPECT_EQ(10, device->logCount);
+}
+
+// STUBS
+
+extern "C" {
+
+void spiDeviceSelect(const spiDevice_t *device)
+{
+    fakeDevice_t *fake = fakeDeviceFind(device);
+
+    for (int i = 0; i < FAKE_DEVICE_COUNT; i++) {
+        if (fakeDevices[i].device.instance == device->instance) {
+            EXPECT_FALSE(fakeDevices[i].selected) << "two devices selected on one bus";
+        }
+    }
+    fake->selected = true;
+    fake->selectCount++;
+}
+
+void spiDeviceDeselect(const spiDevice_t *device)
+{
+    fakeDevice_t *fake = fakeDeviceFind(device);
+
+    EXPECT_TRUE(fake->selected);
+    fake->selected = false;
+}
+
+bool spiDmaStart(SPI_TypeDef *instance, const uint8_t *out, uint8_t *in, uint16_t length)
+{
+    fakeDmaTransfer_t *dma = &fakeDma[instance - fakeSpi];
+
+    if (!fakeBusHasDma(instance)) {
+        return false;
+    }
+
+    EXPECT_FALSE(dma->pending) << "DMA started on a busy bus";
+    dma->pending = true;
+    dma->out = out;
+    dma->in = in;
+    dma->length = length;
+    fakeDmaStarts++;
+    return true;
+}
+
+bool spiTransfer(SPI_TypeDef *instance, uint8_t *out, const uint8_t *in, int len)
+{
+    fakeTransfer(instance, in, out, len);
+    return true;
+}
+
+}
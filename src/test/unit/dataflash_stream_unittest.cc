@@ -0,0 +1,591 @@
+/*
+ * This file is part of Cleanflight.
+ *
+ * Cleanflight is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cleanflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cleanflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <deque>
+
+extern "C" {
+    #include "io/flashfs.h"
+    #include "io/dataflash_stream.h"
+}
+
+#include "unittest_macros.h"
+#include "gtest/gtest.h"
+
+#define TEST_FLASH_SIZE (256 * 1024)
+// Flight data in the first part of the volume, the rest is erased
+#define TEST_LOGGED_SIZE (160 * 1024)
+
+#define SERIAL_TASK_PERIOD_US 5000
+#define TX_BUFFER_SIZE 256
+#define TX_RESERVE 64
+#define MSP_REPLY_OVERHEAD 6        // $M> size command ... checksum
+#define MSP_JUMBO_FRAME_OVERHEAD 8  // $M> 255 command u16 size ... checksum
+#define READ_REQUEST_SIZE 128       // what MSP_DATAFLASH_READ returns
+
+static uint8_t flash[TEST_FLASH_SIZE];
+
+// Frames of a slowly changing state with some noise in them, like a blackbox log
+static void fillFlash()
+{
+    uint32_t seed = 12345;
+
+    memset(flash, 0xFF, sizeof(flash));
+
+    for (int i = 0; i < TEST_LOGGED_SIZE; i++) {
+        seed = seed * 1103515245 + 12345;
+        flash[i] = (i % 24 < 12) ? (uint8_t) (i / 24 / 50 + i % 24) : (uint8_t) (seed >> 24);
+    }
+}
+
+// The reference decoder for DATAFLASH_STREAM_ENCODING_LZ, returns the decoded length or -1 if the input is malformed
+static int lzDecode(const uint8_t *input, int length, uint8_t *output, int outputSize)
+{
+    int in = 0, out = 0;
+
+    while (in < length) {
+        uint8_t token = input[in++];
+
+        if (token < 0x80) {
+            int count = token + 1;
+
+            if (in + count > length || out + count > outputSize) {
+                return -1;
+            }
+            memcpy(output + out, input + in, count);
+            in += count;
+            out += count;
+        } else {
+            int count = (token & 0x7F) + DATAFLASH_STREAM_LZ_MIN_MATCH;
+
+            if (in + 2 > length) {
+                return -1;
+            }
+            int distance = input[in] | (input[in + 1] << 8);
+            in += 2;
+
+            if (distance == 0 || distance > out || out + count > outputSize) {
+                return -1;
+            }
+            for (int i = 0; i < count; i++, out++) {
+                output[out] = output[out - distance];
+            }
+        }
+    }
+
+    return out;
+}
+
+typedef struct decodedChunk_s {
+    uint16_t sequence;
+    uint32_t address;
+    int length;
+    uint8_t encoding;
+    bool crcOk;
+    uint8_t data[DATAFLASH_STREAM_MAX_CHUNK_SIZE];
+} decodedChunk_t;
+
+static bool decodeChunk(const uint8_t *payload, int payloadLength, decodedChunk_t *chunk)
+{
+    const uint8_t *data = payload + DATAFLASH_STREAM_CHUNK_HEADER_SIZE;
+    int dataLength = payloadLength - DATAFLASH_STREAM_CHUNK_HEADER_SIZE;
+
+    chunk->sequence = payload[0] | (payload[1] << 8);
+    chunk->address = payload[2] | (payload[3] << 8) | (payload[4] << 16) | ((uint32_t)payload[5] << 24);
+    chunk->length = payload[6] | (payload[7] << 8);
+    chunk->encoding = payload[8];
+
+    if (chunk->length > DATAFLASH_STREAM_MAX_CHUNK_SIZE) {
+        return false;
+    }
+    if (chunk->encoding == DATAFLASH_STREAM_ENCODING_LZ) {
+        if (lzDecode(data, dataLength, chunk->data, chunk->length) != chunk->length) {
+            return false;
+        }
+    } else if (chunk->encoding == DATAFLASH_STREAM_ENCODING_RAW && dataLength == chunk->length) {
+        memcpy(chunk->data, data, dataLength);
+    } else {
+        return false;
+    }
+
+    chunk->crcOk = dataflashStreamCrc16(0xFFFF, chunk->data, chunk->length) == (payload[9] | (payload[10] << 8));
+
+    return true;
+}
+
+static void startStream(uint32_t address, uint32_t length, uint16_t chunkSize, uint8_t window, uint8_t flags)
+{
+    dataflashStreamConfig_t config = { address, length, chunkSize, window, flags };
+
+    dataflashStreamStart(&config);
+}
+
+TEST(DataflashStreamTest, CrcIsCcitt)
+{
+    EXPECT_EQ(0x29B1, dataflashStreamCrc16(0xFFFF, (const uint8_t *) "123456789", 9));
+}
+
+TEST(DataflashStreamTest, StartKeepsTheStreamWithinLimits)
+{
+    dataflashStreamConfig_t config = { TEST_FLASH_SIZE - 100, 1000, 0, 0, 0xFF };
+
+    dataflashStreamStart(&config);
+
+    EXPECT_TRUE(dataflashStreamIsActive());
+    EXPECT_EQ(TEST_FLASH_SIZE - 100, config.address);
+    EXPECT_EQ(100, config.length);
+    EXPECT_EQ(DATAFLASH_STREAM_MAX_CHUNK_SIZE, config.chunkSize);
+    EXPECT_EQ(1, config.window);
+    EXPECT_EQ(DATAFLASH_STREAM_FLAG_COMPRESS, config.flags);
+
+    config.address = TEST_FLASH_SIZE;
+    config.length = 1;
+    config.window = 200;
+    dataflashStreamStart(&config);
+
+    EXPECT_FALSE(dataflashStreamIsActive());
+    EXPECT_EQ(0, config.length);
+    EXPECT_EQ(DATAFLASH_STREAM_MAX_WINDOW, config.window);
+}
+
+TEST(DataflashStreamTest, ChunksCarryTheirAddressSequenceAndCrc)
+{
+    uint8_t payload[DATAFLASH_STREAM_MAX_PAYLOAD_SIZE];
+    decodedChunk_t chunk;
+    int payloadLength;
+
+    // given
+    fillFlash();
+    startStream(1000, 700, 256, 4, 0);
+
+    // then
+    for (int i = 0; i < 3; i++) {
+        payloadLength = dataflashStreamNextChunk(payload);
+        ASSERT_TRUE(decodeChunk(payload, payloadLength, &chunk));
+        EXPECT_EQ(i, chunk.sequence);
+        EXPECT_EQ(1000 + i * 256, (int) chunk.address);
+        EXPECT_EQ(i < 2 ? 256 : 700 - 512, chunk.length);
+        EXPECT_EQ(DATAFLASH_STREAM_ENCODING_RAW, chunk.encoding);
+        EXPECT_TRUE(chunk.crcOk);
+        EXPECT_EQ(0, memcmp(chunk.data, flash + chunk.address, chunk.length));
+    }
+    EXPECT_EQ(0, dataflashStreamNextChunk(payload));
+    EXPECT_TRUE(dataflashStreamIsActive());
+
+    // It is over once the host has the last chunk
+    dataflashStreamAck(3);
+    EXPECT_FALSE(dataflashStreamIsActive());
+
+    // A damaged chunk fails its CRC
+    startStream(1000, 256, 256, 1, 0);
+    payloadLength = dataflashStreamNextChunk(payload);
+    payload[DATAFLASH_STREAM_CHUNK_HEADER_SIZE + 17] ^= 0x04;
+    ASSERT_TRUE(decodeChunk(payload, payloadLength, &chunk));
+    EXPECT_FALSE(chunk.crcOk);
+}
+
+TEST(DataflashStreamTest, WindowHoldsChunksBackUntilAcknowledged)
+{
+    uint8_t payload[DATAFLASH_STREAM_MAX_PAYLOAD_SIZE];
+
+    // given
+    fillFlash();
+    startStream(0, 100 * 64, 64, 3, 0);
+
+    // when
+    for (int i = 0; i < 3; i++) {
+        EXPECT_GT(dataflashStreamNextChunk(payload), 0);
+    }
+
+    // then
+    EXPECT_EQ(0, dataflashStreamNextChunk(payload));
+
+    // Acknowledgements of chunks that weren't sent are ignored
+    dataflashStreamAck(5);
+    EXPECT_EQ(0, dataflashStreamNextChunk(payload));
+
+    dataflashStreamAck(2);
+    EXPECT_GT(dataflashStreamNextChunk(payload), 0);
+    EXPECT_GT(dataflashStreamNextChunk(payload), 0);
+    EXPECT_EQ(0, dataflashStreamNextChunk(payload));
+
+    dataflashStreamStop();
+    dataflashStreamAck(5);
+    EXPECT_EQ(0, dataflashStreamNextChunk(payload));
+}
+
+TEST(DataflashStreamTest, RepeatedAckResendsFromTheChunkAfterIt)
+{
+    uint8_t payload[DATAFLASH_STREAM_MAX_PAYLOAD_SIZE];
+    decodedChunk_t chunk;
+
+    // given
+    fillFlash();
+    startStream(1000, 5 * 64 + 10, 64, 4, 0);
+
+    for (int i = 0; i < 4; i++) {
+        EXPECT_GT(dataflashStreamNextChunk(payload), 0);
+    }
+
+    // when
+    // Chunk 1 went missing, the host has 0 and says so again once it sees 2
+    dataflashStreamAck(1);
+    dataflashStreamAck(1);
+
+    // then
+    for (int i = 1; i < 5; i++) {
+        int payloadLength = dataflashStreamNextChunk(payload);
+
+        ASSERT_TRUE(decodeChunk(payload, payloadLength, &chunk));
+        EXPECT_TRUE(chunk.crcOk);
+        EXPECT_EQ(i, chunk.sequence);
+        EXPECT_EQ(1000 + i * 64u, chunk.address);
+        EXPECT_EQ(64, chunk.length);
+    }
+    EXPECT_EQ(0, dataflashStreamNextChunk(payload));
+
+    // The short chunk at the end is sent again too
+    dataflashStreamAck(5);
+    ASSERT_TRUE(decodeChunk(payload, dataflashStreamNextChunk(payload), &chunk));
+    EXPECT_EQ(5, chunk.sequence);
+    EXPECT_EQ(10, chunk.length);
+    EXPECT_EQ(0, dataflashStreamNextChunk(payload));
+    EXPECT_TRUE(dataflashStreamIsActive());
+
+    dataflashStreamAck(5);
+    ASSERT_TRUE(decodeChunk(payload, dataflashStreamNextChunk(payload), &chunk));
+    EXPECT_EQ(5, chunk.sequence);
+    EXPECT_EQ(1000 + 5 * 64u, chunk.address);
+    EXPECT_EQ(10, chunk.length);
+    EXPECT_TRUE(dataflashStreamIsActive());
+
+    dataflashStreamAck(6);
+    EXPECT_FALSE(dataflashStreamIsActive());
+
+    // Nothing is outstanding, so there's nothing to send again
+    dataflashStreamAck(6);
+    EXPECT_EQ(0, dataflashStreamNextChunk(payload));
+}
+
+TEST(DataflashStreamTest, SequenceNumbersWrapAround)
+{
+    uint8_t payload[DATAFLASH_STREAM_MAX_PAYLOAD_SIZE];
+    decodedChunk_t chunk;
+
+    // given
+    fillFlash();
+    startStream(0, 70000 * 2, 2, 2, 0);
+
+    // then
+    for (uint32_t i = 0; i < 70000; i++) {
+        int payloadLength = dataflashStreamNextChunk(payload);
+
+        ASSERT_GT(payloadLength, 0);
+        ASSERT_TRUE(decodeChunk(payload, payloadLength, &chunk));
+        ASSERT_EQ((uint16_t) i, chunk.sequence);
+        ASSERT_EQ(i * 2, chunk.address);
+        dataflashStreamAck(chunk.sequence + 1);
+    }
+    EXPECT_FALSE(dataflashStreamIsActive());
+}
+
+TEST(DataflashStreamTest, CompressionShrinksErasedAndRepetitiveData)
+{
+    uint8_t payload[DATAFLASH_STREAM_MAX_PAYLOAD_SIZE];
+    decodedChunk_t chunk;
+    int payloadLength;
+
+    // given
+    fillFlash();
+    memset(flash + TEST_LOGGED_SIZE - 2048, 0, 32);
+
+    // when an erased chunk goes out
+    startStream(TEST_FLASH_SIZE - DATAFLASH_STREAM_MAX_CHUNK_SIZE, DATAFLASH_STREAM_MAX_CHUNK_SIZE, 0, 1,
+        DATAFLASH_STREAM_FLAG_COMPRESS);
+    payloadLength = dataflashStreamNextChunk(payload);
+
+    // then
+    ASSERT_TRUE(decodeChunk(payload, payloadLength, &chunk));
+    EXPECT_EQ(DATAFLASH_STREAM_ENCODING_LZ, chunk.encoding);
+    EXPECT_TRUE(chunk.crcOk);
+    EXPECT_EQ(DATAFLASH_STREAM_MAX_CHUNK_SIZE, chunk.length);
+    EXPECT_LT(payloadLength - DATAFLASH_STREAM_CHUNK_HEADER_SIZE, DATAFLASH_STREAM_MAX_CHUNK_SIZE / 20);
+    EXPECT_EQ(0, memcmp(chunk.data, flash + chunk.address, chunk.length));
+
+    // Every chunk of the logged data comes back as it was, and is smaller on the way
+    startStream(0, TEST_FLASH_SIZE, 0, 1, DATAFLASH_STREAM_FLAG_COMPRESS);
+    int wireBytes = 0;
+    for (uint16_t sequence = 0; dataflashStreamIsActive(); sequence++) {
+        payloadLength = dataflashStreamNextChunk(payload);
+        ASSERT_TRUE(decodeChunk(payload, payloadLength, &chunk));
+        ASSERT_TRUE(chunk.crcOk);
+        ASSERT_EQ(0, memcmp(chunk.data, flash + chunk.address, chunk.length));
+        wireBytes += payloadLength;
+        dataflashStreamAck(sequence + 1);
+    }
+    EXPECT_LT(wireBytes, TEST_LOGGED_SIZE * 4 / 5);
+}
+
+TEST(DataflashStreamTest, IncompressibleChunksGoRaw)
+{
+    uint8_t payload[DATAFLASH_STREAM_MAX_PAYLOAD_SIZE];
+    decodedChunk_t chunk;
+    uint32_t seed = 1;
+
+    // given
+    for (int i = 0; i < DATAFLASH_STREAM_MAX_CHUNK_SIZE; i++) {
+        seed = seed * 1103515245 + 12345;
+        flash[i] = seed >> 24;
+    }
+
+    // when
+    startStream(0, DATAFLASH_STREAM_MAX_CHUNK_SIZE, 0, 1, DATAFLASH_STREAM_FLAG_COMPRESS);
+    int payloadLength = dataflashStreamNextChunk(payload);
+
+    // then
+    ASSERT_TRUE(decodeChunk(payload, payloadLength, &chunk));
+    EXPECT_EQ(DATAFLASH_STREAM_ENCODING_RAW, chunk.encoding);
+    EXPECT_EQ(DATAFLASH_STREAM_CHUNK_HEADER_SIZE + DATAFLASH_STREAM_MAX_CHUNK_SIZE, payloadLength);
+    EXPECT_TRUE(chunk.crcOk);
+}
+
+TEST(DataflashStreamTest, CompressorHandlesLongRunsAndDistantMatches)
+{
+    uint8_t input[DATAFLASH_STREAM_MAX_CHUNK_SIZE];
+    uint8_t output[DATAFLASH_STREAM_MAX_CHUNK_SIZE];
+    uint8_t decoded[DATAFLASH_STREAM_MAX_CHUNK_SIZE];
+
+    for (int i = 0; i < DATAFLASH_STREAM_MAX_CHUNK_SIZE; i++) {
+        input[i] = (i < 300) ? 0xAA : (uint8_t) (i * 7 % 251);
+    }
+    // The start of the chunk again at the end
+    memcpy(input + DATAFLASH_STREAM_MAX_CHUNK_SIZE - 40, input + 290, 40);
+
+    int length = dataflashStreamCompress(input, sizeof(input), output, sizeof(output));
+
+    ASSERT_GT(length, 0);
+    EXPECT_EQ((int) sizeof(input), lzDecode(output, length, decoded, sizeof(decoded)));
+    EXPECT_EQ(0, memcmp(input, decoded, sizeof(input)));
+
+    // Output that would overflow is refused
+    EXPECT_EQ(-1, dataflashStreamCompress(input, sizeof(input), output, 10));
+}
+
+/*
+ * Throughput over simulated serial links. Bytes leave the transmit buffer at the rate of the link and reach the host
+ * its latency later. The flight controller side runs every serial task period and does what serial_msp.c does: the
+ * old way, one MSP_DATAFLASH_READ request answered per run, and streaming, a frame's worth of chunks per run written
+ * into the free transmit buffer and one acknowledgement read when no frame is part way out.
+ */
+typedef struct linkModel_s {
+    const char *name;
+    uint32_t bytesPerSecond;
+    uint32_t latencyUs;
+    bool reportsFixedTxFree;    // USB VCP says 255 bytes are free however much is queued
+} linkModel_t;
+
+static const linkModel_t usbVcpLink = { "USB VCP", 500000, 1000, true };
+static const linkModel_t uartLink = { "UART 115200", 11520, 100, false };
+
+typedef struct simulatedLink_s {
+    const linkModel_t *model;
+    double busyUntilUs;         // when the bytes written so far will have left the transmit buffer
+} simulatedLink_t;
+
+// Returns when the bytes reach the host
+static double linkWrite(simulatedLink_t *link, double nowUs, int count)
+{
+    double startUs = link->busyUntilUs > nowUs ? link->busyUntilUs : nowUs;
+
+    link->busyUntilUs = startUs + count * 1e6 / link->model->bytesPerSecond;
+
+    return link->busyUntilUs + link->model->latencyUs;
+}
+
+static int linkTxFree(const simulatedLink_t *link, double nowUs)
+{
+    if (link->model->reportsFixedTxFree || link->busyUntilUs <= nowUs) {
+        return TX_BUFFER_SIZE - 1;
+    }
+    return TX_BUFFER_SIZE - 1 - (int) ((link->busyUntilUs - nowUs) * link->model->bytesPerSecond / 1e6 + 1);
+}
+
+static double simulateReadRequests(const linkModel_t *model, uint32_t length)
+{
+    simulatedLink_t link = { model, 0 };
+    double requestArrivalUs = model->latencyUs;
+    double replyArrivalUs = 0;
+
+    for (uint32_t address = 0; address < length; address += READ_REQUEST_SIZE) {
+        double taskUs = ((uint64_t) (requestArrivalUs + SERIAL_TASK_PERIOD_US - 1) / SERIAL_TASK_PERIOD_US) * SERIAL_TASK_PERIOD_US;
+
+        replyArrivalUs = linkWrite(&link, taskUs, MSP_REPLY_OVERHEAD + 4 + READ_REQUEST_SIZE);
+        requestArrivalUs = replyArrivalUs + model->latencyUs;
+    }
+
+    return replyArrivalUs;
+}
+
+typedef struct simulatedFrame_s {
+    double arrivalUs;
+    int payloadLength;
+    uint8_t payload[DATAFLASH_STREAM_MAX_PAYLOAD_SIZE];
+} simulatedFrame_t;
+
+static double simulateStream(const linkModel_t *model, uint32_t length, uint8_t flags, uint32_t *wireBytes)
+{
+    simulatedLink_t link = { model, 0 };
+    std::deque<simulatedFrame_t> framesInFlight;
+    bool ackInFlight = false;           // sent, and the reply hasn't come back
+    double ackArrivalUs = 0;            // at the flight controller
+    double ackReplyArrivalUs = -1;      // at the host, -1 before the flight controller has read it
+    uint16_t ackSequence = 0;
+    simulatedFrame_t frame;
+    int frameRemaining = 0;
+    uint32_t received = 0;
+    uint16_t expectedSequence = 0;
+    double lastArrivalUs = 0;
+
+    *wireBytes = 0;
+    startStream(0, length, 0, DATAFLASH_STREAM_MAX_WINDOW, flags);
+
+    for (double nowUs = 0; received < length; nowUs += SERIAL_TASK_PERIOD_US) {
+        // Flight controller
+        int budget = MSP_JUMBO_FRAME_OVERHEAD + DATAFLASH_STREAM_MAX_PAYLOAD_SIZE;
+
+        while (budget > 0) {
+            if (frameRemaining == 0) {
+                frame.payloadLength = dataflashStreamNextChunk(frame.payload);
+                if (frame.payloadLength == 0) {
+                    break;
+                }
+                frameRemaining = frame.payloadLength + MSP_JUMBO_FRAME_OVERHEAD;
+                *wireBytes += frameRemaining;
+            }
+
+            int count = linkTxFree(&link, nowUs) - TX_RESERVE;
+            count = count < budget ? count : budget;
+            count = count < frameRemaining ? count : frameRemaining;
+            if (count <= 0) {
+                break;
+            }
+
+            frame.arrivalUs = linkWrite(&link, nowUs, count);
+            frameRemaining -= count;
+            budget -= count;
+            if (frameRemaining == 0) {
+                framesInFlight.push_back(frame);
+            }
+        }
+        if (frameRemaining == 0 && ackInFlight && ackReplyArrivalUs < 0 && ackArrivalUs <= nowUs) {
+            dataflashStreamAck(ackSequence);
+            *wireBytes += MSP_REPLY_OVERHEAD;
+            ackReplyArrivalUs = linkWrite(&link, nowUs, MSP_REPLY_OVERHEAD);
+        }
+
+        // Host, everything that arrives before the next run of the serial task
+        while (!framesInFlight.empty() && framesInFlight.front().arrivalUs < nowUs + SERIAL_TASK_PERIOD_US) {
+            const simulatedFrame_t *arrived = &framesInFlight.front();
+            decodedChunk_t chunk;
+
+            EXPECT_TRUE(decodeChunk(arrived->payload, arrived->payloadLength, &chunk));
+            EXPECT_TRUE(chunk.crcOk);
+            EXPECT_EQ(expectedSequence, chunk.sequence);
+            EXPECT_EQ(received, chunk.address);
+            EXPECT_EQ(0, memcmp(chunk.data, flash + chunk.address, chunk.length));
+
+            received += chunk.length;
+            expectedSequence++;
+            lastArrivalUs = arrived->arrivalUs;
+            framesInFlight.pop_front();
+        }
+
+        // Acknowledgements are cumulative, so one at a time is enough, the next goes when the reply to the last is back
+        if (ackInFlight && ackReplyArrivalUs >= 0 && ackReplyArrivalUs < nowUs + SERIAL_TASK_PERIOD_US) {
+            ackInFlight = false;
+        }
+        if (!ackInFlight && ackSequence != expectedSequence) {
+            double sendUs = ackReplyArrivalUs > lastArrivalUs ? ackReplyArrivalUs : lastArrivalUs;
+
+            ackInFlight = true;
+            ackArrivalUs = sendUs + model->latencyUs;
+            ackReplyArrivalUs = -1;
+            ackSequence = expectedSequence;
+        }
+    }
+
+    return lastArrivalUs;
+}
+
+static void compareThroughput(const linkModel_t *model, double minimumSpeedup)
+{
+    uint32_t rawWireBytes, compressedWireBytes;
+
+    // given
+    fillFlash();
+
+    // when
+    double requestsUs = simulateReadRequests(model, TEST_FLASH_SIZE);
+    double streamUs = simulateStream(model, TEST_FLASH_SIZE, 0, &rawWireBytes);
+    double compressedUs = simulateStream(model, TEST_FLASH_SIZE, DATAFLASH_STREAM_FLAG_COMPRESS, &compressedWireBytes);
+
+    printf("%s: read requests %.1f kB/s, stream %.1f kB/s, compressed stream %.1f kB/s (%u bytes sent for %u), "
+        "16MB in %.0fs, %.0fs, %.0fs\n", model->name,
+        TEST_FLASH_SIZE / requestsUs * 1e3, TEST_FLASH_SIZE / streamUs * 1e3, TEST_FLASH_SIZE / compressedUs * 1e3,
+        compressedWireBytes, TEST_FLASH_SIZE,
+        requestsUs * 64 / 1e6, streamUs * 64 / 1e6, compressedUs * 64 / 1e6);
+
+    // then
+    EXPECT_GT(requestsUs, streamUs * minimumSpeedup);
+    EXPECT_GT(streamUs, compressedUs * 1.3);
+    EXPECT_LT(compressedWireBytes, rawWireBytes * 4 / 5);
+}
+
+TEST(DataflashStreamTest, StreamingOutrunsReadRequestsOverUsb)
+{
+    compareThroughput(&usbVcpLink, 5);
+}
+
+TEST(DataflashStreamTest, StreamingOutrunsReadRequestsOverUart)
+{
+    compareThroughput(&uartLink, 1.2);
+}
+
+// STUBS
+
+extern "C" {
+
+uint32_t flashfsGetSize()
+{
+    return TEST_FLASH_SIZE;
+}
+
+int flashfsReadAbs(uint32_t address, uint8_t *buffer, unsigned int len)
+{
+    if (address + len > TEST_FLASH_SIZE) {
+        len = TEST_FLASH_SIZE - address;
+    }
+    memcpy(buffer, flash + address, len);
+
+    return len;
+}
+
+}
@@ -59,6 +59,19 @@ TEST(EncodingTest, ZigzagEncodingTest)
     }
 }
 
+TEST(EncodingTest, ZigzagDecodingTest)
+{
+    // given
+    int32_t values[] = { 0, -1, 1, -2, 2, 2147483646, -2147483647, 2147483647, -2147483648 };
+    int valueCount = sizeof(values) / sizeof(values[0]);
+
+    // expect
+
+    for (int i = 0; i < valueCount; i++) {
+        EXPECT_EQ(values[i], zigzagDecode(zigzagEncode(values[i])));
+    }
+}
+
 TEST(EncodingTest, FloatToIntEncodingTest)
 {
     // given
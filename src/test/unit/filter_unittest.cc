@@ -0,0 +1,230 @@
+/*
+ * This file is part of Cleanflight.
+ *
+ * Cleanflight is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cleanflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cleanflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+
+extern "C" {
+    #include "common/axis.h"
+    #include "common/maths.h"
+    #include "common/filter.h"
+}
+
+#include "unittest_macros.h"
+#include "gtest/gtest.h"
+
+#define LOOPTIME 250    // 4kHz
+#define SAMPLE_RATE (1000000 / LOOPTIME)
+#define BUTTERWORTH_Q 0.70710678f
+
+// amplitude of the filter output for a sine at frequency, once the filter has settled
+static float sineGain(biquadFilter_t *filter, float frequency)
+{
+    float peak = 0;
+
+    for (int i = 0; i < SAMPLE_RATE; i++) {
+        float output = biquadFilterApply(filter, 1000 * sinf(2 * M_PIf * frequency * i / SAMPLE_RATE));
+        if (i > SAMPLE_RATE / 2) {
+            peak = MAX(peak, fabsf(output));
+        }
+    }
+    return peak / 1000;
+}
+
+TEST(FilterUnittest, TestBiquadLowpass)
+{
+    biquadFilter_t filter;
+
+    // DC passes
+    biquadFilterInit(&filter, FILTER_LPF, 90, BUTTERWORTH_Q, LOOPTIME);
+    float output = 0;
+    for (int i = 0; i < SAMPLE_RATE; i++) {
+        output = biquadFilterApply(&filter, 1000);
+    }
+    EXPECT_NEAR(1000, output, 0.1);
+
+    // -3dB at the cutoff
+    biquadFilterInit(&filter, FILTER_LPF, 90, BUTTERWORTH_Q, LOOPTIME);
+    EXPECT_NEAR(M_SQRT1_2, sineGain(&filter, 90), 0.01);
+
+    // -12dB per octave beyond it
+    biquadFilterInit(&filter, FILTER_LPF, 90, BUTTERWORTH_Q, LOOPTIME);
+    EXPECT_LT(sineGain(&filter, 720), 0.02);
+}
+
+TEST(FilterUnittest, TestBiquadNotch)
+{
+    biquadFilter_t filter;
+    const float Q = filterGetNotchQ(260, 160);
+
+    // the center is removed
+    biquadFilterInit(&filter, FILTER_NOTCH, 260, Q, LOOPTIME);
+    EXPECT_LT(sineGain(&filter, 260), 0.01);
+
+    // -3dB at the cutoff
+    biquadFilterInit(&filter, FILTER_NOTCH, 260, Q, LOOPTIME);
+    EXPECT_NEAR(M_SQRT1_2, sineGain(&filter, 160), 0.02);
+
+    // well away from it nothing changes
+    biquadFilterInit(&filter, FILTER_NOTCH, 260, Q, LOOPTIME);
+    EXPECT_NEAR(1.0, sineGain(&filter, 20), 0.01);
+}
+
+TEST(FilterUnittest, TestBiquadUpdateKeepsState)
+{
+    biquadFilter_t filter;
+
+    biquadFilterInit(&filter, FILTER_LPF, 90, BUTTERWORTH_Q, LOOPTIME);
+    for (int i = 0; i < SAMPLE_RATE; i++) {
+        biquadFilterApply(&filter, 1000);
+    }
+
+    // moving the cutoff does not restart the filter from zero
+    biquadFilterUpdate(&filter, FILTER_LPF, 100, BUTTERWORTH_Q, LOOPTIME);
+    EXPECT_NEAR(1000, biquadFilterApply(&filter, 1000), 5);
+}
+
+TEST(FilterUnittest, TestBiquadQ15FollowsFloat)
+{
+    biquadFilter_t lowpass, lowpassDesign, notch, notchDesign;
+    biquadFilterQ15_t lowpassQ15, notchQ15;
+
+    biquadFilterInit(&lowpass, FILTER_LPF, 90, BUTTERWORTH_Q, LOOPTIME);
+    biquadFilterInit(&lowpassDesign, FILTER_LPF, 90, BUTTERWORTH_Q, LOOPTIME);
+    biquadFilterQ15Init(&lowpassQ15, &lowpassDesign);
+    biquadFilterInit(&notch, FILTER_NOTCH, 260, filterGetNotchQ(260, 160), LOOPTIME);
+    biquadFilterInit(&notchDesign, FILTER_NOTCH, 260, filterGetNotchQ(260, 160), LOOPTIME);
+    biquadFilterQ15Init(&notchQ15, &notchDesign);
+
+    // gyro like input, stick movement with motor noise on top, up to about 2/3 of full scale
+    float maxError = 0;
+    for (int i = 0; i < SAMPLE_RATE * 2; i++) {
+        float t = (float)i / SAMPLE_RATE;
+        int16_t input = 16000 * sinf(2 * M_PIf * 3 * t) + 4000 * sinf(2 * M_PIf * 260 * t) + 1000 * sinf(2 * M_PIf * 600 * t);
+
+        float expected = biquadFilterApply(&notch, biquadFilterApply(&lowpass, input));
+        int16_t actual = biquadFilterQ15Apply(&notchQ15, biquadFilterQ15Apply(&lowpassQ15, input));
+
+        maxError = MAX(maxError, fabsf(expected - actual));
+    }
+
+    // a couple of LSB, a fraction of a degree per second at 16.4 LSB per degree per second
+    EXPECT_LT(maxError, 3);
+}
+
+TEST(FilterUnittest, TestBiquadQ15FullScale)
+{
+    biquadFilter_t design;
+    biquadFilterQ15_t filter;
+
+    biquadFilterInit(&design, FILTER_LPF, 90, BUTTERWORTH_Q, LOOPTIME);
+    biquadFilterQ15Init(&filter, &design);
+
+    // a pegged gyro comes out pegged, not wrapped around
+    int16_t output = 0;
+    for (int i = 0; i < SAMPLE_RATE; i++) {
+        output = biquadFilterQ15Apply(&filter, INT16_MAX);
+    }
+    EXPECT_NEAR(INT16_MAX, output, 100);
+    for (int i = 0; i < SAMPLE_RATE; i++) {
+        output = biquadFilterQ15Apply(&filter, INT16_MIN);
+    }
+    EXPECT_NEAR(INT16_MIN, output, 100);
+}
+
+TEST(FilterUnittest, TestBiquadQ15PeggedAtResonance)
+{
+    biquadFilter_t reference, design;
+    biquadFilterQ15_t filter;
+
+    // a high Q close to Nyquist, driven at its peak it rings at more than ten times full scale
+    biquadFilterInit(&reference, FILTER_LPF, 1800, 10, LOOPTIME);
+    biquadFilterInit(&design, FILTER_LPF, 1800, 10, LOOPTIME);
+    biquadFilterQ15Init(&filter, &design);
+
+    int peggedCount = 0;
+    for (int i = 0; i < SAMPLE_RATE; i++) {
+        int16_t input = sinf(2 * M_PIf * 1800 * i / SAMPLE_RATE) >= 0 ? INT16_MAX : INT16_MIN;
+
+        float expected = biquadFilterApply(&reference, input);
+        int16_t actual = biquadFilterQ15Apply(&filter, input);
+
+        // where the float filter is well past full scale the output is pegged the same way, the state never wraps
+        if (fabsf(expected) > 2 * 32768) {
+            ASSERT_EQ(expected > 0 ? INT16_MAX : INT16_MIN, actual) << "sample " << i;
+            peggedCount++;
+        }
+    }
+    EXPECT_GT(peggedCount, SAMPLE_RATE / 2);
+
+    // and it settles once the input does
+    int16_t output = 0;
+    for (int i = 0; i < SAMPLE_RATE; i++) {
+        output = biquadFilterQ15Apply(&filter, 0);
+    }
+    EXPECT_EQ(0, output);
+}
+
+TEST(FilterUnittest, TestFirInt16MatchesShiftingFir)
+{
+    for (int level = 0; level < 3; level++) {
+        int8_t *coeff = filterGetFIRCoefficientsTable(level);
+        int16_t state[XYZ_AXIS_COUNT][9] = { { 0 } };
+        firFilterInt16_t filter[XYZ_AXIS_COUNT];
+
+        for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+            firFilterInt16Init(&filter[axis], coeff, 9);
+        }
+
+        // noise over the whole range, then a pegged gyro both ways
+        srand(level);
+        for (int i = 0; i < 3000; i++) {
+            int16_t expected[XYZ_AXIS_COUNT];
+            for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+                if (i < 1000) {
+                    expected[axis] = rand() % 65536 - 32768;
+                } else {
+                    expected[axis] = i < 2000 ? INT16_MAX : INT16_MIN;
+                }
+            }
+            int16_t input[XYZ_AXIS_COUNT] = { expected[X], expected[Y], expected[Z] };
+
+            filterApply9TapFIR(expected, state, coeff);
+
+            for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+                ASSERT_EQ(expected[axis], firFilterInt16Apply(&filter[axis], input[axis])) << "level " << level << " sample " << i;
+            }
+        }
+    }
+}
+
+TEST(FilterUnittest, TestFirInt16EvenTaps)
+{
+    const int8_t coeff[4] = { 64, 64, 64, 64 };
+    firFilterInt16_t filter;
+
+    firFilterInt16Init(&filter, coeff, 4);
+
+    // a moving average of the last four samples
+    EXPECT_EQ(100, firFilterInt16Apply(&filter, 400));
+    EXPECT_EQ(200, firFilterInt16Apply(&filter, 400));
+    EXPECT_EQ(200, firFilterInt16Apply(&filter, 0));
+    EXPECT_EQ(200, firFilterInt16Apply(&filter, 0));
+    EXPECT_EQ(100, firFilterInt16Apply(&filter, 0));
+    EXPECT_EQ(0, firFilterInt16Apply(&filter, 0));
+}
@@ -0,0 +1,696 @@
+/*
+ * This file is part of Cleanflight.
+ *
+ * Cleanflight is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cleanflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cleanflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+extern "C" {
+    #include "drivers/flash_m25p16.h"
+    #include "io/flashfs.h"
+}
+
+#include "unittest_macros.h"
+#include "gtest/gtest.h"
+
+// A chip of 16 sectors of 4KB, the first two take turns holding the directory
+#define TEST_PAGES_PER_SECTOR 16
+#define TEST_SECTOR_SIZE (TEST_PAGES_PER_SECTOR * M25P16_PAGESIZE)
+#define TEST_SECTORS 16
+#define TEST_FLASH_SIZE (TEST_SECTORS * TEST_SECTOR_SIZE)
+#define TEST_DATA_START (2 * TEST_SECTOR_SIZE)
+#define TEST_DATA_SIZE (TEST_FLASH_SIZE - TEST_DATA_START)
+
+// Times the mock reports busy after a program or erase
+#define TEST_PROGRAM_BUSY_POLLS 2
+#define TEST_ERASE_BUSY_POLLS 20
+
+static uint8_t flash[TEST_FLASH_SIZE];
+static int busyPolls;
+static uint32_t programAddress;
+static int programLength;
+static int pageCrossings;
+static int reads;
+static int sectorErases;
+static int stalls;              // waits for the flash while it was busy
+static int dataPrograms;
+static int partialDataPrograms; // that didn't fill a whole page
+static int powerCutAfter = -1;  // programs and erases the chip still carries out, -1 for all of them
+
+static flashGeometry_t geometry = {
+    .sectors = TEST_SECTORS,
+    .pagesPerSector = TEST_PAGES_PER_SECTOR,
+    .pageSize = M25P16_PAGESIZE,
+    .sectorSize = TEST_SECTOR_SIZE,
+    .totalSize = TEST_FLASH_SIZE
+};
+
+static void eraseFlash()
+{
+    memset(flash, 0xFF, sizeof(flash));
+    busyPolls = 0;
+    pageCrossings = 0;
+    reads = 0;
+    sectorErases = 0;
+    stalls = 0;
+    dataPrograms = 0;
+    partialDataPrograms = 0;
+    powerCutAfter = -1;
+    flashfsSetRingMode(false);
+}
+
+static uint8_t testByte(int log, uint32_t offset)
+{
+    return (uint8_t) (log * 31 + offset);
+}
+
+// Writes a log the way the blackbox does, asynchronously in small pieces
+static void writeLog(int log, uint32_t length)
+{
+    uint8_t data[32];
+
+    flashfsStartLog();
+
+    for (uint32_t offset = 0; offset < length; offset += sizeof(data)) {
+        uint32_t count = length - offset < sizeof(data) ? length - offset : sizeof(data);
+
+        for (uint32_t i = 0; i < count; i++) {
+            data[i] = testByte(log, offset + i);
+        }
+        flashfsWrite(data, count, false);
+
+        while (!flashfsFlushAsync()) {
+        }
+    }
+
+    flashfsFinishLog();
+}
+
+// Writes a log a frame per loop iteration, polling the flash as the rest of the loop lets time pass
+static void logFrames(int log, uint32_t length)
+{
+    uint8_t frame[40];
+
+    for (uint32_t offset = 0; offset < length; offset += sizeof(frame)) {
+        uint32_t count = length - offset < sizeof(frame) ? length - offset : sizeof(frame);
+
+        for (uint32_t i = 0; i < count; i++) {
+            frame[i] = testByte(log, offset + i);
+        }
+        flashfsWrite(frame, count, false);
+        flashfsFlushPagesAsync();
+
+        m25p16_isReady();
+    }
+}
+
+static bool logMatches(int index, int log, uint32_t length)
+{
+    flashfsLog_t entry;
+    uint8_t buffer[100];
+    uint32_t offset = 0;
+
+    if (!flashfsGetLog(index, &entry) || flashfsGetLogSize(&entry) != length) {
+        return false;
+    }
+
+    while (offset < length) {
+        int bytesRead = flashfsReadLog(index, offset, buffer, sizeof(buffer));
+
+        if (bytesRead <= 0) {
+            return false;
+        }
+        for (int i = 0; i < bytesRead; i++) {
+            if (buffer[i] != testByte(log, offset + i)) {
+                return false;
+            }
+        }
+        offset += bytesRead;
+    }
+
+    return flashfsReadLog(index, offset, buffer, sizeof(buffer)) == 0;
+}
+
+TEST(FlashfsTest, BlankVolumeGetsADirectory)
+{
+    // given
+    eraseFlash();
+
+    // when
+    flashfsInit();
+
+    // then
+    EXPECT_TRUE(flashfsHasDirectory());
+    EXPECT_EQ(0, memcmp(flash, "FFS2", 4));
+    EXPECT_EQ(0, flashfsGetLogCount());
+    EXPECT_EQ(TEST_DATA_START, flashfsGetOffset());
+    EXPECT_EQ(TEST_DATA_SIZE, flashfsGetFreeSpace());
+}
+
+TEST(FlashfsTest, RecordsTheStartAndEndOfEachLog)
+{
+    // given
+    eraseFlash();
+    flashfsInit();
+
+    // when
+    writeLog(0, 5000);
+    writeLog(1, 100);
+    writeLog(2, 3000);
+
+    // then
+    flashfsLog_t log;
+
+    EXPECT_EQ(3, flashfsGetLogCount());
+    EXPECT_TRUE(flashfsGetLog(0, &log));
+    EXPECT_EQ(TEST_DATA_START, log.start);
+    EXPECT_TRUE(flashfsGetLog(2, &log));
+    EXPECT_EQ(TEST_DATA_START + 5100, log.start);
+    EXPECT_EQ(TEST_DATA_START + 8100, log.end);
+    EXPECT_FALSE(flashfsGetLog(3, &log));
+
+    EXPECT_TRUE(logMatches(0, 0, 5000));
+    EXPECT_TRUE(logMatches(1, 1, 100));
+    EXPECT_TRUE(logMatches(2, 2, 3000));
+    EXPECT_EQ(0, pageCrossings);
+}
+
+TEST(FlashfsTest, FindsTheAppendPointFromTheDirectory)
+{
+    // given
+    eraseFlash();
+    flashfsInit();
+    writeLog(0, 5000);
+    writeLog(1, 3000);
+    reads = 0;
+
+    // when
+    flashfsInit();
+
+    // then, after a couple of binary searches of the directory and a look at the sectors ahead
+    EXPECT_LE(reads, 40);
+    EXPECT_EQ(2, flashfsGetLogCount());
+    EXPECT_EQ(TEST_DATA_START + 8000, flashfsGetOffset());
+    EXPECT_TRUE(logMatches(1, 1, 3000));
+}
+
+TEST(FlashfsTest, RecoversALogThatNeverFinished)
+{
+    // given
+    eraseFlash();
+    flashfsInit();
+    writeLog(0, 1000);
+    flashfsStartLog();
+    for (uint32_t offset = 0; offset < 5000; offset++) {
+        uint8_t byte = testByte(1, offset);
+
+        flashfsWrite(&byte, 1, true);
+    }
+    flashfsFlushSync();
+
+    // when the power goes off
+    flashfsInit();
+
+    // then the log ends at the first free block after its data, and stays that way
+    flashfsLog_t log;
+
+    EXPECT_EQ(2, flashfsGetLogCount());
+    EXPECT_TRUE(flashfsGetLog(1, &log));
+    EXPECT_EQ(TEST_DATA_START + 1000, log.start);
+    EXPECT_GE(flashfsGetLogSize(&log), 5000);
+    EXPECT_LT(flashfsGetLogSize(&log), 5000 + 2048);
+
+    flashfsInit();
+    flashfsLog_t reloaded;
+
+    EXPECT_TRUE(flashfsGetLog(1, &reloaded));
+    EXPECT_EQ(log.end, reloaded.end);
+    EXPECT_EQ(log.end, flashfsGetOffset());
+}
+
+TEST(FlashfsTest, RecoversALogThatNeverFinishedInRingMode)
+{
+    // given a volume that has gone around a few times, so the sectors ahead hold data of deleted logs
+    eraseFlash();
+    flashfsInit();
+    flashfsSetRingMode(true);
+    for (int log = 0; log < 8; log++) {
+        writeLog(log, 5 * TEST_SECTOR_SIZE - 300);
+    }
+    int count = flashfsGetLogCount();
+
+    flashfsStartLog();
+    for (uint32_t offset = 0; offset < 3000; offset++) {
+        uint8_t byte = testByte(8, offset);
+
+        flashfsWrite(&byte, 1, true);
+    }
+    flashfsFlushSync();
+    uint32_t freeSpace = flashfsGetFreeSpace();
+
+    // when the power goes off
+    flashfsInit();
+
+    // then the log ends where its data does, rather than at the end of the data that was left ahead of it
+    flashfsLog_t log;
+
+    EXPECT_EQ(count + 1, flashfsGetLogCount());
+    EXPECT_TRUE(flashfsGetLog(count, &log));
+    EXPECT_GE(flashfsGetLogSize(&log), 3000);
+    EXPECT_LT(flashfsGetLogSize(&log), 3000 + 16);
+    EXPECT_LE(freeSpace - 16, flashfsGetFreeSpace());
+    EXPECT_GE(freeSpace, flashfsGetFreeSpace());
+    EXPECT_TRUE(logMatches(count - 1, 7, 5 * TEST_SECTOR_SIZE - 300));
+}
+
+TEST(FlashfsTest, VolumeWithoutADirectoryIsLeftAlone)
+{
+    // given a volume written from address 0
+    eraseFlash();
+    memset(flash, 0x55, 10000);
+
+    // when
+    flashfsInit();
+    flashfsStartLog();
+
+    // then
+    EXPECT_FALSE(flashfsHasDirectory());
+    EXPECT_EQ(0, flashfsGetLogCount());
+    EXPECT_EQ(10240, flashfsGetOffset());
+    EXPECT_EQ(0x55, flash[0]);
+}
+
+TEST(FlashfsTest, ErasesTheOldestLogsBySector)
+{
+    // given
+    eraseFlash();
+    flashfsInit();
+    writeLog(0, 6000);
+    writeLog(1, 6000);
+    writeLog(2, 6000);
+    uint32_t freeSpace = flashfsGetFreeSpace();
+
+    // when
+    EXPECT_EQ(1, flashfsEraseOldestLogs(1));
+
+    // then only the sector that had nothing but the oldest log in it went
+    EXPECT_EQ(1, sectorErases);
+    EXPECT_EQ(freeSpace + TEST_SECTOR_SIZE, flashfsGetFreeSpace());
+    EXPECT_EQ(2, flashfsGetLogCount());
+    EXPECT_TRUE(logMatches(0, 1, 6000));
+    EXPECT_TRUE(logMatches(1, 2, 6000));
+
+    // and the directory agrees after a restart
+    flashfsInit();
+    EXPECT_EQ(2, flashfsGetLogCount());
+    EXPECT_EQ(freeSpace + TEST_SECTOR_SIZE, flashfsGetFreeSpace());
+}
+
+TEST(FlashfsTest, ErasingEveryLogLeavesTheWholeDataArea)
+{
+    // given
+    eraseFlash();
+    flashfsInit();
+    writeLog(0, 6000);
+    writeLog(1, 6000);
+
+    // when
+    EXPECT_EQ(2, flashfsEraseOldestLogs(10));
+
+    // then
+    EXPECT_EQ(0, flashfsGetLogCount());
+    EXPECT_EQ(TEST_DATA_SIZE, flashfsGetFreeSpace());
+
+    for (int i = TEST_DATA_START; i < TEST_FLASH_SIZE; i++) {
+        if (flash[i] != 0xFF) {
+            FAIL() << "not erased at " << i;
+        }
+    }
+}
+
+TEST(FlashfsTest, StopsWhenFullWithoutRingMode)
+{
+    // given
+    eraseFlash();
+    flashfsInit();
+
+    // when
+    writeLog(0, TEST_DATA_SIZE - 1000);
+    writeLog(1, 3000);
+
+    // then the second log is cut short at the end of the volume
+    EXPECT_TRUE(flashfsIsEOF());
+    EXPECT_TRUE(logMatches(0, 0, TEST_DATA_SIZE - 1000));
+    EXPECT_TRUE(logMatches(1, 1, 1000));
+    EXPECT_EQ(TEST_FLASH_SIZE, flashfsGetOffset());
+    EXPECT_EQ(0, sectorErases);
+}
+
+TEST(FlashfsTest, RingModeErasesTheOldestLogsToMakeRoom)
+{
+    // given
+    eraseFlash();
+    flashfsInit();
+    flashfsSetRingMode(true);
+
+    // when three times the data area is logged
+    for (int log = 0; log < 15; log++) {
+        writeLog(log, 9000);
+        EXPECT_FALSE(flashfsIsEOF());
+    }
+
+    // then the logs that are left are intact, including the one that wraps around the end of the volume
+    int count = flashfsGetLogCount();
+    bool wrapped = false;
+
+    EXPECT_GE(count, 5);
+    for (int i = 0; i < count; i++) {
+        flashfsLog_t log;
+
+        flashfsGetLog(i, &log);
+        wrapped |= log.end < log.start;
+        EXPECT_TRUE(logMatches(i, 15 - count + i, 9000));
+    }
+    EXPECT_TRUE(wrapped);
+    EXPECT_EQ(0, pageCrossings);
+
+    // and so are they after a restart, with the free space where it was
+    uint32_t freeSpace = flashfsGetFreeSpace();
+
+    flashfsInit();
+    EXPECT_EQ(count, flashfsGetLogCount());
+    EXPECT_EQ(freeSpace, flashfsGetFreeSpace());
+    EXPECT_TRUE(logMatches(count - 1, 14, 9000));
+}
+
+TEST(FlashfsTest, RingModeNeverErasesTheLogBeingWritten)
+{
+    // given
+    eraseFlash();
+    flashfsInit();
+    flashfsSetRingMode(true);
+
+    // when
+    writeLog(0, TEST_DATA_SIZE + 10000);
+
+    // then it stops where it would wrap into its own first sector
+    EXPECT_EQ(1, flashfsGetLogCount());
+    EXPECT_EQ(0, sectorErases);
+    EXPECT_TRUE(logMatches(0, 0, TEST_DATA_SIZE));
+}
+
+TEST(FlashfsTest, LoggingProgramsWholePagesWithoutWaiting)
+{
+    // given
+    eraseFlash();
+    flashfsInit();
+    flashfsStartLog();
+    stalls = 0;
+
+    // when
+    logFrames(0, 10000);
+
+    // then the partial page at the end is still in the buffer
+    EXPECT_EQ(0, stalls);
+    EXPECT_EQ(10000 / M25P16_PAGESIZE, dataPrograms);
+    EXPECT_EQ(0, partialDataPrograms);
+    EXPECT_EQ(TEST_DATA_START + 10000, flashfsGetOffset());
+
+    // until the log finishes
+    flashfsFinishLog();
+    EXPECT_EQ(1, partialDataPrograms);
+    EXPECT_TRUE(logMatches(0, 0, 10000));
+}
+
+TEST(FlashfsTest, RingModeErasesAheadWithoutLosingData)
+{
+    // given a nearly full volume
+    eraseFlash();
+    flashfsInit();
+    flashfsSetRingMode(true);
+    for (int log = 0; log < 6; log++) {
+        writeLog(log, 9000);
+    }
+    flashfsStartLog();
+    stalls = 0;
+    sectorErases = 0;
+
+    // when
+    logFrames(6, 20000);
+
+    // then the sectors ahead were erased while the buffer took the frames
+    EXPECT_EQ(0, stalls);
+    EXPECT_GE(sectorErases, 3);
+    EXPECT_FALSE(flashfsIsEOF());
+
+    flashfsFinishLog();
+    EXPECT_TRUE(logMatches(flashfsGetLogCount() - 1, 6, 20000));
+    EXPECT_TRUE(logMatches(0, 7 - flashfsGetLogCount(), 9000));
+}
+
+TEST(FlashfsTest, DirectoryKeepsTheNewestLogsAndCompacts)
+{
+    // given
+    eraseFlash();
+    flashfsInit();
+    flashfsSetRingMode(true);
+
+    // when more logs are written than the directory sector has records for
+    for (int log = 0; log < 300; log++) {
+        writeLog(log, 100);
+    }
+
+    // then
+    EXPECT_EQ(FLASHFS_MAX_LOGS, flashfsGetLogCount());
+    EXPECT_TRUE(logMatches(0, 300 - FLASHFS_MAX_LOGS, 100));
+    EXPECT_TRUE(logMatches(FLASHFS_MAX_LOGS - 1, 299, 100));
+
+    flashfsInit();
+    EXPECT_EQ(FLASHFS_MAX_LOGS, flashfsGetLogCount());
+    EXPECT_TRUE(logMatches(FLASHFS_MAX_LOGS - 1, 299, 100));
+}
+
+TEST(FlashfsTest, StartingALogNeverCompactsTheDirectory)
+{
+    // given
+    eraseFlash();
+    flashfsInit();
+    flashfsSetRingMode(true);
+
+    for (int log = 0; log < 300; log++) {
+        // The craft sits on the ground for a while between flights
+        while (!m25p16_isReady()) {
+        }
+        sectorErases = 0;
+
+        // when
+        flashfsStartLog();
+
+        // then
+        EXPECT_EQ(0, sectorErases);
+
+        logFrames(log, 100);
+        flashfsFinishLog();
+    }
+    EXPECT_TRUE(logMatches(FLASHFS_MAX_LOGS - 1, 299, 100));
+}
+
+TEST(FlashfsTest, DirectorySurvivesAPowerCutWhileCompacting)
+{
+    // The 128th log to finish takes more than half the records and compacts the directory, the power goes at each of
+    // the programs and erases that log makes in turn
+    for (int cut = 0; cut < FLASHFS_MAX_LOGS + 10; cut++) {
+        // given
+        eraseFlash();
+        flashfsInit();
+        for (int log = 0; log < 127; log++) {
+            writeLog(log, 100);
+        }
+        uint32_t lastStart = flashfsGetOffset();
+
+        // when
+        powerCutAfter = cut;
+        writeLog(127, 100);
+        powerCutAfter = -1;
+        flashfsInit();
+
+        // then the logs before it are all still there
+        flashfsLog_t log;
+        int newest = flashfsGetLogCount() - 1;
+
+        // Less the oldest when the power went between deleting it and recording the start of the new one
+        EXPECT_GE(flashfsGetLogCount(), FLASHFS_MAX_LOGS - 1) << "cut after " << cut;
+        EXPECT_TRUE(flashfsGetLog(newest, &log));
+        if (log.start == lastStart) {
+            newest--;
+        }
+        EXPECT_TRUE(logMatches(newest, 126, 100)) << "cut after " << cut;
+        EXPECT_TRUE(logMatches(newest - (FLASHFS_MAX_LOGS - 2), 126 - (FLASHFS_MAX_LOGS - 2), 100)) << "cut after " << cut;
+
+        // and logging carries on
+        writeLog(200, 100);
+        flashfsInit();
+        EXPECT_TRUE(logMatches(FLASHFS_MAX_LOGS - 1, 200, 100)) << "cut after " << cut;
+    }
+}
+
+TEST(FlashfsTest, DirectoryHeaderWaitsForTheEraseToFinish)
+{
+    // given
+    eraseFlash();
+    memset(flash, 0x55, 10000);
+    flashfsInit();
+
+    // when
+    flashfsEraseCompletely();
+    flashfsStartLog();
+
+    // then the chip is still busy so the log isn't recorded
+    EXPECT_EQ(0, flashfsGetLogCount());
+    EXPECT_EQ(0xFF, flash[0]);
+
+    // when
+    flashfsFinishLog();
+    m25p16_waitForReady(0);
+    writeLog(0, 1000);
+
+    // then
+    EXPECT_EQ(0, memcmp(flash, "FFS2", 4));
+    EXPECT_EQ(1, flashfsGetLogCount());
+    EXPECT_TRUE(logMatches(0, 0, 1000));
+}
+
+// STUBS
+
+extern "C" {
+
+static bool powerIsOn()
+{
+    if (powerCutAfter == 0) {
+        return false;
+    }
+    if (powerCutAfter > 0) {
+        powerCutAfter--;
+    }
+    return true;
+}
+
+bool m25p16_isReady()
+{
+    if (busyPolls > 0) {
+        busyPolls--;
+        return false;
+    }
+    return true;
+}
+
+bool m25p16_waitForReady(uint32_t timeoutMillis)
+{
+    UNUSED(timeoutMillis);
+
+    if (busyPolls > 0) {
+        stalls++;
+    }
+    busyPolls = 0;
+    return true;
+}
+
+void m25p16_eraseSector(uint32_t address)
+{
+    m25p16_waitForReady(0);
+
+    if (!powerIsOn()) {
+        return;
+    }
+
+    memset(flash + address - address % TEST_SECTOR_SIZE, 0xFF, TEST_SECTOR_SIZE);
+    sectorErases++;
+    busyPolls = TEST_ERASE_BUSY_POLLS;
+}
+
+void m25p16_eraseCompletely()
+{
+    m25p16_waitForReady(0);
+
+    memset(flash, 0xFF, sizeof(flash));
+    busyPolls = TEST_ERASE_BUSY_POLLS;
+}
+
+void m25p16_pageProgramBegin(uint32_t address)
+{
+    m25p16_waitForReady(0);
+
+    programAddress = address;
+    programLength = 0;
+}
+
+void m25p16_pageProgramContinue(const uint8_t *data, int length)
+{
+    for (int i = 0; i < length; i++) {
+        uint32_t address = programAddress + programLength;
+
+        if (address / M25P16_PAGESIZE != programAddress / M25P16_PAGESIZE || address >= TEST_FLASH_SIZE) {
+            pageCrossings++;
+        } else {
+            // Programming can only clear bits
+            flash[address] &= data[i];
+        }
+        programLength++;
+    }
+}
+
+void m25p16_pageProgramFinish()
+{
+    if (programAddress >= TEST_DATA_START) {
+        dataPrograms++;
+        if (programAddress % M25P16_PAGESIZE != 0 || programLength != M25P16_PAGESIZE) {
+            partialDataPrograms++;
+        }
+    }
+    busyPolls = TEST_PROGRAM_BUSY_POLLS;
+}
+
+void m25p16_pageProgram(uint32_t address, const uint8_t *data, int length)
+{
+    if (!powerIsOn()) {
+        return;
+    }
+    m25p16_pageProgramBegin(address);
+    m25p16_pageProgramContinue(data, length);
+    m25p16_pageProgramFinish();
+}
+
+int m25p16_readBytes(uint32_t address, uint8_t *buffer, int length)
+{
+    m25p16_waitForReady(0);
+
+    if (address + length > TEST_FLASH_SIZE) {
+        return 0;
+    }
+
+    memcpy(buffer, flash + address, length);
+    reads++;
+
+    return length;
+}
+
+const flashGeometry_t* m25p16_getGeometry()
+{
+    return &geometry;
+}
+
+}
@@ -19,6 +19,8 @@
 #include <stdbool.h>
 
 #include <limits.h>
+#include <math.h>
+#include <string.h>
 
 #define BARO
 
@@ -53,23 +55,312 @@ extern "C" {
 #define UPWARDS_THRUST false
 
 
-TEST(FlightImuTest, TestCalculateHeading)
+extern "C" {
+    void imuInit(void);
+    void imuComputeRotationMatrix(void);
+
+    extern float q0, q1, q2, q3;
+    extern bool attitudeIsStale;
+}
+
+#define LOOPTIME_US 1000
+#define ACC_1G 512
+
+static uint32_t currentTimeUs;     // never goes back, the IMU keeps the time of its last update
+static uint32_t currentSensors;
+
+static imuRuntimeConfig_t imuRuntimeConfig;
+static pidProfile_t pidProfile;
+static accDeadband_t accDeadband;
+
+static void imuSetUp(void)
+{
+    memset(&imuRuntimeConfig, 0, sizeof(imuRuntimeConfig));
+    imuRuntimeConfig.dcm_kp = 0.25f;
+    imuRuntimeConfig.small_angle = 25;
+    imuConfigure(&imuRuntimeConfig, &pidProfile, &accDeadband, 5.0f, 800);
+
+    acc_1G = ACC_1G;
+    gyro.scale = 1.0f / 16.4f;
+    currentSensors = SENSOR_ACC;
+    armingFlags = 0;
+    memset(gyroADC, 0, sizeof(gyroADC));
+    memset(accADC, 0, sizeof(accADC));
+    accADC[Z] = ACC_1G;
+
+    imuInit();
+    imuUpdateAccelerometer(NULL);
+}
+
+// ZYX Euler angles in radians to the quaternion the IMU keeps
+static void imuSetQuaternion(float roll, float pitch, float yaw)
+{
+    float cr = cosf(roll / 2), sr = sinf(roll / 2);
+    float cp = cosf(pitch / 2), sp = sinf(pitch / 2);
+    float cy = cosf(yaw / 2), sy = sinf(yaw / 2);
+
+    q0 = cr * cp * cy + sr * sp * sy;
+    q1 = sr * cp * cy - cr * sp * sy;
+    q2 = cr * sp * cy + sr * cp * sy;
+    q3 = cr * cp * sy - sr * sp * cy;
+    imuComputeRotationMatrix();
+    attitudeIsStale = true;
+}
+
+// The angles of the quaternion from the libm functions imuUpdateEulerAngles() used to call
+static void referenceEulerAngles(int16_t angles[XYZ_AXIS_COUNT])
 {
-    //TODO: Add test cases using the Z dimension.
-    t_fp_vector north = {.A={1.0f, 0.0f, 0.0f}};
-    EXPECT_EQ(imuCalculateHeading(&north), 0);
+    float r20 = 2.0f * (q1 * q3 - q0 * q2);
+    float r21 = 2.0f * (q2 * q3 + q0 * q1);
+    float r22 = 1.0f - 2.0f * q1 * q1 - 2.0f * q2 * q2;
+    float r10 = 2.0f * (q1 * q2 + q0 * q3);
+    float r00 = 1.0f - 2.0f * q2 * q2 - 2.0f * q3 * q3;
 
-    t_fp_vector east = {.A={0.0f, 1.0f, 0.0f}};
-    EXPECT_EQ(imuCalculateHeading(&east), 90);
+    angles[0] = lrintf(atan2f(r21, r22) * (1800.0f / M_PIf));
+    angles[1] = lrintf(((0.5f * M_PIf) - acosf(-r20)) * (1800.0f / M_PIf));
+    angles[2] = lrintf(-atan2f(r10, r00) * (1800.0f / M_PIf));
+    if (angles[2] < 0) {
+        angles[2] += 3600;
+    }
+}
 
-    t_fp_vector south = {.A={-1.0f, 0.0f, 0.0f}};
-    EXPECT_EQ(imuCalculateHeading(&south), 180);
+static int decidegreeDifference(int a, int b)
+{
+    int difference = ABS(a - b);
+
+    return MIN(difference, 3600 - difference);
+}
+
+// The PID loop at 1kHz, TASK_ACCEL reading the acc at 100Hz and TASK_ATTITUDE fusing what it read
+static void imuRunLoops(int count)
+{
+    for (int i = 0; i < count; i++) {
+        currentTimeUs += LOOPTIME_US;
+        imuUpdateGyroAndAttitude();
+        if (currentTimeUs % 10000 == 0) {
+            imuUpdateAccelerometer(NULL);
+        }
+        if (imuHasNewSamples()) {
+            imuUpdateAttitudeCorrection();
+        }
+    }
+}
+
+TEST(FlightImuTest, EulerAnglesMatchReferenceMath)
+{
+    int16_t expected[XYZ_AXIS_COUNT];
+    int worstError = 0;
+
+    imuSetUp();
+
+    for (int roll = -1790; roll <= 1790; roll += 65) {
+        for (int pitch = -890; pitch <= 890; pitch += 35) {
+            for (int yaw = 0; yaw < 3600; yaw += 95) {
+                imuSetQuaternion(DECIDEGREES_TO_RADIANS(roll), DECIDEGREES_TO_RADIANS(pitch), DECIDEGREES_TO_RADIANS(yaw));
+                referenceEulerAngles(expected);
+                imuUpdateEulerAngles();
+
+                for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+                    worstError = MAX(worstError, decidegreeDifference(attitude.raw[axis], expected[axis]));
+                }
+            }
+        }
+    }
+
+    // The approximations are good to a few thousandths of a degree, only the rounding may differ
+    EXPECT_LE(worstError, 1);
+}
+
+TEST(FlightImuTest, EulerAnglesAreWorkedOutWhenRead)
+{
+    imuSetUp();
+    imuSetQuaternion(0, 0, 0);
+    imuUpdateEulerAngles();
+
+    // Only the gyro, no acc for the feedback
+    accADC[Z] = 0;
+    gyroADC[X] = 164 * 10;     // 100 deg/s for 0.1s
+    imuRunLoops(100);
+
+    // The loop only integrated the quaternion
+    EXPECT_EQ(0, attitude.values.roll);
+    EXPECT_TRUE(attitudeIsStale);
+
+    imuUpdateEulerAngles();
+    EXPECT_FALSE(attitudeIsStale);
+    EXPECT_NEAR(100, attitude.values.roll, 5);
+
+    // Nothing to do until the next loop
+    attitude.values.roll = 0;
+    imuUpdateEulerAngles();
+    EXPECT_EQ(0, attitude.values.roll);
+}
+
+TEST(FlightImuTest, AccSamplesLevelTheAttitude)
+{
+    imuSetUp();
+    imuSetQuaternion(DEGREES_TO_RADIANS(20), 0, 0);
 
-    t_fp_vector west = {.A={0.0f, -1.0f, 0.0f}};
-    EXPECT_EQ(imuCalculateHeading(&west), 270);
+    // The acc says level, the feedback should take the 20 degrees out
+    imuRunLoops(500);
+    imuUpdateEulerAngles();
+    EXPECT_LT(attitude.values.roll, 200);
 
-    t_fp_vector north_east = {.A={1.0f, 1.0f, 0.0f}};
-    EXPECT_EQ(imuCalculateHeading(&north_east), 45);
+    imuRunLoops(5000);
+    imuUpdateEulerAngles();
+    EXPECT_NEAR(0, attitude.values.roll, 5);
+}
+
+TEST(FlightImuTest, AccSamplesAreFusedOnceOverTheirOwnInterval)
+{
+    imuSetUp();
+    imuRunLoops(100);
+    imuResetAccelerationSum();
+
+    // Read 12ms after the last one, then fused 3ms late
+    currentTimeUs += 12000;
+    imuUpdateAccelerometer(NULL);
+    EXPECT_TRUE(imuHasNewSamples());
+    currentTimeUs += 3000;
+    imuUpdateAttitudeCorrection();
+    EXPECT_FALSE(imuHasNewSamples());
+    EXPECT_EQ(1, accSumCount);
+    EXPECT_EQ(12000u, accTimeSum);
+
+    // The PID loops until the next read don't fuse the sample again
+    for (int i = 0; i < 7; i++) {
+        currentTimeUs += LOOPTIME_US;
+        imuUpdateGyroAndAttitude();
+        imuUpdateAttitudeCorrection();
+    }
+    EXPECT_EQ(1, accSumCount);
+    EXPECT_EQ(12000u, accTimeSum);
+
+    // Read on time, fused at once
+    imuUpdateAccelerometer(NULL);
+    imuUpdateAttitudeCorrection();
+    EXPECT_EQ(2, accSumCount);
+    EXPECT_EQ(12000u + 10000u, accTimeSum);
+}
+
+#define REPLAY_SECONDS 20
+#define REPLAY_ACC_PERIOD_US 10000
+#define REPLAY_ACC_MAX_LATENESS_US 4000
+// Degrees, what the IMU made of the flight when it filtered and fused accADC every PID loop
+#define REPLAY_LOOP_FUSION_RMS_ERROR 5.384
+
+typedef struct replayQuaternion_s {
+    double w, x, y, z;
+} replayQuaternion_t;
+
+// Rolling and pitching up to 40 degrees while turning, the attitude of the flight at time t
+static replayQuaternion_t replayAttitude(double t)
+{
+    double roll = DEGREES_TO_RADIANS(40) * sin(2 * M_PI * 0.35 * t) * sin(2 * M_PI * 0.05 * t);
+    double pitch = DEGREES_TO_RADIANS(30) * sin(2 * M_PI * 0.23 * t + 1);
+    double yaw = DEGREES_TO_RADIANS(90) * sin(2 * M_PI * 0.04 * t);
+    double cr = cos(roll / 2), sr = sin(roll / 2);
+    double cp = cos(pitch / 2), sp = sin(pitch / 2);
+    double cy = cos(yaw / 2), sy = sin(yaw / 2);
+    replayQuaternion_t q = {
+        cr * cp * cy + sr * sp * sy,
+        sr * cp * cy - cr * sp * sy,
+        cr * sp * cy + sr * cp * sy,
+        cr * cp * sy - sr * sp * cy
+    };
+
+    return q;
+}
+
+// Down in the body frame, the last row of the rotation matrix imuComputeRotationMatrix() works out
+static void replayDown(double w, double x, double y, double z, double down[XYZ_AXIS_COUNT])
+{
+    down[X] = 2 * (x * z - w * y);
+    down[Y] = 2 * (y * z + w * x);
+    down[Z] = 1 - 2 * x * x - 2 * y * y;
+}
+
+static double replayNoise(double amplitude)
+{
+    return amplitude * (2.0 * rand() / RAND_MAX - 1);
+}
+
+/*
+ * A flight replayed through the sensors as the scheduler would read them: the gyro every PID loop, the acc by
+ * TASK_ACCEL at 100Hz give or take the lateness of the task, both with noise and the gyro with a bias. Returns the
+ * RMS error of the tilt, the angle between the real and the estimated down, in degrees.
+ */
+static double replayFlight(void)
+{
+    const double gyroBias[XYZ_AXIS_COUNT] = { 0.6, -0.4, 0.3 };    // deg/s
+    uint32_t nextAccReadAt = currentTimeUs;
+    double errorSquareSum = 0;
+    int errorSamples = 0;
+
+    srand(1);
+
+    for (int loop = 0; loop < REPLAY_SECONDS * 1000000 / LOOPTIME_US; loop++) {
+        double t = loop * LOOPTIME_US * 1e-6;
+        double down[XYZ_AXIS_COUNT];
+
+        if ((int32_t)(currentTimeUs - nextAccReadAt) >= 0) {
+            replayQuaternion_t q = replayAttitude(t);
+
+            replayDown(q.w, q.x, q.y, q.z, down);
+            for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+                accADC[axis] = lrint(down[axis] * ACC_1G + replayNoise(0.3 * ACC_1G));
+            }
+            imuUpdateAccelerometer(NULL);
+            if (imuHasNewSamples()) {
+                imuUpdateAttitudeCorrection();
+            }
+            nextAccReadAt += REPLAY_ACC_PERIOD_US;
+            nextAccReadAt += rand() % REPLAY_ACC_MAX_LATENESS_US;
+        }
+
+        // The body rates from the attitude a loop apart, 2 * conj(q) * dq / dt
+        replayQuaternion_t a = replayAttitude(t);
+        replayQuaternion_t b = replayAttitude(t + LOOPTIME_US * 1e-6);
+        double rate[XYZ_AXIS_COUNT] = {
+            a.w * b.x - a.x * b.w - a.y * b.z + a.z * b.y,
+            a.w * b.y + a.x * b.z - a.y * b.w - a.z * b.x,
+            a.w * b.z - a.x * b.y + a.y * b.x - a.z * b.w
+        };
+        for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+            double degreesPerSecond = 2 * rate[axis] / (LOOPTIME_US * 1e-6) * (180 / M_PI);
+            gyroADC[axis] = lrint((degreesPerSecond + gyroBias[axis] + replayNoise(2)) / gyro.scale);
+        }
+
+        currentTimeUs += LOOPTIME_US;
+        imuUpdateGyroAndAttitude();
+
+        // Past the initial levelling
+        if (loop * LOOPTIME_US >= 2000000) {
+            replayQuaternion_t q = replayAttitude(t + LOOPTIME_US * 1e-6);
+            double estimated[XYZ_AXIS_COUNT];
+
+            replayDown(q.w, q.x, q.y, q.z, down);
+            replayDown(q0, q1, q2, q3, estimated);
+            double cosError = constrainf(down[X] * estimated[X] + down[Y] * estimated[Y] + down[Z] * estimated[Z], -1, 1);
+            errorSquareSum += sq(acos(cosError) * (180 / M_PI));
+            errorSamples++;
+        }
+    }
+
+    return sqrt(errorSquareSum / errorSamples);
+}
+
+TEST(FlightImuTest, ReplayedFlightAttitudeError)
+{
+    imuSetUp();
+    imuRuntimeConfig.acc_cut_hz = 15;
+    armingFlags = ARMED;
+    imuSetQuaternion(0, 0, 0);
+
+    double error = replayFlight();
+
+    // No worse than fusing the same sample over and over, give or take the noise of the replay
+    EXPECT_LT(error, REPLAY_LOOP_FUSION_RMS_ERROR * 1.05);
 }
 
 // STUBS
@@ -92,6 +383,8 @@ uint8_t armingFlags;
 
 int32_t sonarAlt;
 int16_t accADC[XYZ_AXIS_COUNT];
+uint32_t accSampleTime;
+uint32_t magSampleTime;
 int16_t gyroADC[XYZ_AXIS_COUNT];
 
 
@@ -108,15 +401,20 @@ uint16_t disableFlightMode(flightModeFlags_e mask)
 void gyroUpdate(void) {};
 bool sensors(uint32_t mask)
 {
-    UNUSED(mask);
-    return false;
+    return (currentSensors & mask) != 0;
 };
 void updateAccelerationReadings(rollAndPitchTrims_t *rollAndPitchTrims)
 {
     UNUSED(rollAndPitchTrims);
+    accSampleTime = currentTimeUs;
 }
 
-uint32_t micros(void) { return 0; }
+uint32_t micros(void) { return currentTimeUs; }
+uint32_t millis(void) { return currentTimeUs / 1000; }
+
+uint8_t GPS_numSat;
+uint16_t GPS_speed;
+uint16_t GPS_ground_course;
 bool isBaroCalibrationComplete(void) { return true; }
 void performBaroCalibrationCycle(void) {}
 int32_t baroCalculateAltitude(void) { return 0; }
@@ -0,0 +1,246 @@
+/*
+ * This file is part of Cleanflight.
+ *
+ * Cleanflight is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cleanflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cleanflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+
+extern "C" {
+    #include "debug.h"
+
+    #include "platform.h"
+
+    #include "common/axis.h"
+    #include "common/maths.h"
+    #include "common/filter.h"
+
+    #include "drivers/sensor.h"
+    #include "drivers/accgyro.h"
+
+    #include "sensors/sensors.h"
+    #include "sensors/gyro.h"
+
+    #include "io/beeper.h"
+
+    #include "flight/pid.h"
+}
+
+#include "unittest_macros.h"
+#include "gtest/gtest.h"
+
+#define GYRO_SAMPLE_PERIOD 125      // 8kHz gyro
+#define LOOPTIME 250                // 4kHz PID loop
+#define SAMPLES_PER_LOOP (LOOPTIME / GYRO_SAMPLE_PERIOD)
+
+// MOCK GYRO, a sample source the test fills and the driver functions read
+
+typedef int16_t mockSampleFunc(uint32_t sampleIndex, int axis);
+
+static mockSampleFunc *mockSample;
+static uint32_t mockSampleIndex;
+static uint8_t mockSamplesPerRead;
+
+static bool mockGyroRead(int16_t *data)
+{
+    // only the latest sample is kept, the ones in between are lost
+    mockSampleIndex += mockSamplesPerRead;
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        data[axis] = mockSample(mockSampleIndex - 1, axis);
+    }
+    return true;
+}
+
+static uint8_t mockGyroReadBatch(int16_t (*data)[3], uint8_t maxSamples)
+{
+    uint8_t sampleCount = MIN(mockSamplesPerRead, maxSamples);
+
+    for (int i = 0; i < sampleCount; i++, mockSampleIndex++) {
+        for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+            data[i][axis] = mockSample(mockSampleIndex, axis);
+        }
+    }
+    return sampleCount;
+}
+
+static int16_t nyquistSample(uint32_t sampleIndex, int axis)
+{
+    UNUSED(axis);
+    // noise right at half the gyro rate, read every other sample it looks like a constant offset
+    return (sampleIndex & 1) ? 1000 : -1000;
+}
+
+static int16_t constantSample(uint32_t sampleIndex, int axis)
+{
+    UNUSED(sampleIndex);
+    return 100 * (axis + 1);
+}
+
+static int16_t stepSample(uint32_t sampleIndex, int axis)
+{
+    // a step with a little noise on it, different on each axis
+    return (sampleIndex >= 20 ? 2000 * (axis + 1) : 0) + (int16_t)((sampleIndex * 37 + axis * 11) % 64) - 32;
+}
+
+static gyroConfig_t gyroConfig;
+static pidProfile_t pidProfile;
+
+static void setupGyro(bool batch, mockSampleFunc *sample)
+{
+    memset(&gyro, 0, sizeof(gyro));
+    gyro.read = mockGyroRead;
+    gyro.readBatch = batch ? mockGyroReadBatch : NULL;
+    mockSample = sample;
+    mockSampleIndex = 0;
+    mockSamplesPerRead = SAMPLES_PER_LOOP;
+
+    memset(&pidProfile, 0, sizeof(pidProfile));
+    pidProfile.gyro_lpf_hz = 90;
+    useGyroConfig(&gyroConfig, &pidProfile);
+    gyroSetCalibrationCycles(0);
+    memset(gyroZero, 0, sizeof(gyroZero));
+}
+
+static void runLoops(int loops)
+{
+    for (int i = 0; i < loops; i++) {
+        gyroUpdate();
+    }
+}
+
+TEST(GyroUnittest, TestSingleReadAliasesNoiseAboveLoopRate)
+{
+    // given
+    setupGyro(false, nyquistSample);
+
+    // when
+    runLoops(1000);
+
+    // then the noise passes the lowpass as if it was a real rotation
+    EXPECT_NEAR(1000, gyroADC[FD_ROLL], 5);
+}
+
+TEST(GyroUnittest, TestBatchFiltersEverySample)
+{
+    // given
+    setupGyro(true, nyquistSample);
+
+    // when
+    runLoops(1000);
+
+    // then every sample went through the lowpass, which removes the noise
+    EXPECT_EQ((uint32_t)1000 * SAMPLES_PER_LOOP, mockSampleIndex);
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        EXPECT_NEAR(0, gyroADC[axis], 2);
+    }
+}
+
+TEST(GyroUnittest, TestBatchPassesRotation)
+{
+    // given
+    setupGyro(true, constantSample);
+
+    // when
+    runLoops(1000);
+
+    // then
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        EXPECT_NEAR(100 * (axis + 1), gyroADC[axis], 1);
+    }
+}
+
+TEST(GyroUnittest, TestFirMatchesShiftingFir)
+{
+    // given the FIR alone on every sample
+    setupGyro(true, stepSample);
+    pidProfile.gyro_lpf_hz = 0;
+    pidProfile.gyro_fir_level = 1;
+    useGyroConfig(&gyroConfig, &pidProfile);
+
+    int16_t state[XYZ_AXIS_COUNT][9];
+    memset(state, 0, sizeof(state));
+    int8_t *coeff = filterGetFIRCoefficientsTable(0);
+
+    for (int loop = 0; loop < 50; loop++) {
+        // when
+        runLoops(1);
+
+        // then the gyro gets what the old FIR gives for the same samples
+        int16_t expected[XYZ_AXIS_COUNT];
+        for (uint32_t i = mockSampleIndex - SAMPLES_PER_LOOP; i < mockSampleIndex; i++) {
+            for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+                expected[axis] = stepSample(i, axis);
+            }
+            filterApply9TapFIR(expected, state, coeff);
+        }
+        for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+            EXPECT_EQ(expected[axis], gyroADC[axis]);
+        }
+    }
+}
+
+TEST(GyroUnittest, TestBatchTakesWhatIsThere)
+{
+    // given
+    setupGyro(true, constantSample);
+    runLoops(1000);
+
+    // when the loop is late and the FIFO holds more than a batch
+    mockSamplesPerRead = GYRO_BATCH_MAX_SAMPLES + 4;
+    runLoops(1);
+
+    // then one batch is taken, the rest comes with the next loop
+    EXPECT_EQ((uint32_t)1000 * SAMPLES_PER_LOOP + GYRO_BATCH_MAX_SAMPLES, mockSampleIndex);
+}
+
+TEST(GyroUnittest, TestEmptyBatchKeepsLastSample)
+{
+    // given
+    setupGyro(true, constantSample);
+    runLoops(1000);
+    int16_t before[XYZ_AXIS_COUNT];
+    memcpy(before, gyroADC, sizeof(before));
+
+    // when
+    mockSamplesPerRead = 0;
+    runLoops(1);
+
+    // then
+    EXPECT_EQ(0, memcmp(before, gyroADC, sizeof(before)));
+}
+
+// STUBS
+
+extern "C" {
+
+int16_t debug[DEBUG16_VALUE_COUNT];
+
+uint32_t targetLooptime = LOOPTIME;
+uint32_t gyroSamplePeriod = GYRO_SAMPLE_PERIOD;
+
+void alignSensors(int16_t *src, int16_t *dest, uint8_t rotation)
+{
+    UNUSED(rotation);
+    memmove(dest, src, sizeof(int16_t) * XYZ_AXIS_COUNT);
+}
+
+void beeper(beeperMode_e mode)
+{
+    UNUSED(mode);
+}
+
+}
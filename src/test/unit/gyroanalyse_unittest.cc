@@ -0,0 +1,215 @@
+/*
+ * This file is part of Cleanflight.
+ *
+ * Cleanflight is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cleanflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cleanflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <math.h>
+
+extern "C" {
+    #include "platform.h"
+
+    #include "common/axis.h"
+    #include "common/maths.h"
+
+    #include "sensors/gyroanalyse.h"
+}
+
+#include "unittest_macros.h"
+#include "gtest/gtest.h"
+
+#define LOOPTIME 250                // 4kHz
+#define SAMPLE_RATE (1000000 / LOOPTIME)
+#define LOOPS_PER_TASK_RUN 8        // the analysis task runs at 500Hz
+#define MIN_HZ 100
+#define MAX_HZ 500
+
+static float notchCenterHz[XYZ_AXIS_COUNT];
+static int notchUpdates;
+static uint32_t loopCount;
+static uint32_t noiseSeed;
+
+// uniform noise of +/- amplitude
+static float noise(float amplitude)
+{
+    noiseSeed = noiseSeed * 1664525 + 1013904223;
+    return amplitude * ((float)(noiseSeed >> 8) / (1 << 23) - 1.0f);
+}
+
+static void resetAnalyser(void)
+{
+    gyroDataAnalyseInit(LOOPTIME, MIN_HZ, MAX_HZ);
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        notchCenterHz[axis] = 0;
+    }
+    notchUpdates = 0;
+    loopCount = 0;
+    noiseSeed = 22695477;
+}
+
+// one loop of the flight code, the gyro sample goes to the analyser and every few loops the task runs
+static void runLoop(const float sample[XYZ_AXIS_COUNT])
+{
+    int16_t data[XYZ_AXIS_COUNT];
+
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        data[axis] = lrintf(sample[axis]);
+    }
+    gyroDataAnalysePush(data);
+    if (++loopCount % LOOPS_PER_TASK_RUN == 0) {
+        gyroDataAnalyseUpdate();
+    }
+}
+
+// a sine per axis with noise on top, for duration seconds
+static void runSines(const float frequency[XYZ_AXIS_COUNT], float amplitude, float noiseAmplitude, float duration)
+{
+    for (int i = 0; i < duration * SAMPLE_RATE; i++) {
+        float t = (float)loopCount / SAMPLE_RATE;
+        float sample[XYZ_AXIS_COUNT];
+
+        for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+            sample[axis] = amplitude * sinf(2 * M_PIf * frequency[axis] * t) + noise(noiseAmplitude);
+        }
+        runLoop(sample);
+    }
+}
+
+TEST(GyroAnalyseUnittest, TestFindsNoisePeak)
+{
+    // given
+    resetAnalyser();
+    const float frequency[XYZ_AXIS_COUNT] = { 237, 237, 237 };
+
+    // when
+    runSines(frequency, 200, 100, 0.5f);
+
+    // then
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        EXPECT_NEAR(237, notchCenterHz[axis], 10);
+        EXPECT_FLOAT_EQ(notchCenterHz[axis], gyroDataAnalyseGetCenterHz(axis));
+    }
+}
+
+TEST(GyroAnalyseUnittest, TestAxesAreAnalysedApart)
+{
+    // given
+    resetAnalyser();
+    const float frequency[XYZ_AXIS_COUNT] = { 150, 310, 440 };
+
+    // when
+    runSines(frequency, 200, 100, 0.5f);
+
+    // then
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        EXPECT_NEAR(frequency[axis], notchCenterHz[axis], 10);
+    }
+}
+
+TEST(GyroAnalyseUnittest, TestFollowsSweep)
+{
+    // given
+    resetAnalyser();
+    const float start[XYZ_AXIS_COUNT] = { 150, 150, 150 };
+    runSines(start, 200, 100, 0.5f);
+
+    // when
+    // the motors spin up from 150Hz to 400Hz in a second, like a punch out
+    float phase = 0;
+    float maxError = 0;
+    for (int i = 0; i < SAMPLE_RATE; i++) {
+        float frequency = 150 + 250.0f * i / SAMPLE_RATE;
+        phase += 2 * M_PIf * frequency / SAMPLE_RATE;
+        float value = 200 * sinf(phase) + noise(100);
+        float sample[XYZ_AXIS_COUNT] = { value, value, value };
+
+        runLoop(sample);
+
+        // the FFT looks at the last 48ms and the smoothing adds a few more updates of lag
+        if (i > SAMPLE_RATE / 4) {
+            maxError = MAX(maxError, fabsf(frequency - notchCenterHz[FD_ROLL]));
+        }
+    }
+
+    // then
+    EXPECT_LT(maxError, 40);
+    EXPECT_NEAR(400, notchCenterHz[FD_ROLL], 25);
+}
+
+TEST(GyroAnalyseUnittest, TestIgnoresPeakOutsideBounds)
+{
+    // given
+    resetAnalyser();
+
+    // when
+    // a strong peak below the bounds, like frame flex, and the motor noise inside them
+    for (int i = 0; i < SAMPLE_RATE / 2; i++) {
+        float t = (float)i / SAMPLE_RATE;
+        float value = 400 * sinf(2 * M_PIf * 30 * t) + 100 * sinf(2 * M_PIf * 300 * t) + noise(50);
+        float sample[XYZ_AXIS_COUNT] = { value, value, value };
+
+        runLoop(sample);
+    }
+
+    // then
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        EXPECT_NEAR(300, notchCenterHz[axis], 10);
+    }
+}
+
+TEST(GyroAnalyseUnittest, TestNoiseAloneDoesNotMoveNotch)
+{
+    // given
+    resetAnalyser();
+    const float frequency[XYZ_AXIS_COUNT] = { 0, 0, 0 };
+
+    // when
+    runSines(frequency, 0, 200, 1.0f);
+
+    // then
+    EXPECT_EQ(0, notchUpdates);
+}
+
+TEST(GyroAnalyseUnittest, TestDisabled)
+{
+    // given
+    gyroDataAnalyseInit(LOOPTIME, 0, MAX_HZ);
+    notchUpdates = 0;
+    const float frequency[XYZ_AXIS_COUNT] = { 237, 237, 237 };
+
+    // when
+    runSines(frequency, 200, 100, 0.5f);
+
+    // then
+    EXPECT_EQ(0, notchUpdates);
+
+    // and an upper bound above the Nyquist frequency of the loop disables it too
+    gyroDataAnalyseInit(LOOPTIME, MIN_HZ, SAMPLE_RATE / 2);
+    runSines(frequency, 200, 100, 0.5f);
+    EXPECT_EQ(0, notchUpdates);
+}
+
+// STUBS
+
+extern "C" {
+
+void gyroSetDynamicNotchCenter(uint8_t axis, float centerHz)
+{
+    notchCenterHz[axis] = centerHz;
+    notchUpdates++;
+}
+
+}
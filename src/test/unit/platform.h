@@ -24,6 +24,9 @@
 #define TELEMETRY
 #define LED_STRIP
 #define USE_SERVOS
+#define GYRO_DYNAMIC_NOTCH
+#define USE_MPU_FIFO
+#define USE_SPI_DMA
 
 #define SERIAL_PORT_COUNT 4
 
@@ -45,6 +48,26 @@ typedef struct
     void* test;
 } TIM_TypeDef;
 
+typedef struct
+{
+    void* test;
+} SPI_TypeDef;
+
+typedef struct
+{
+    void* test;
+} USART_TypeDef;
+
+typedef struct
+{
+    void* test;
+} DMA_Channel_TypeDef;
+
 typedef enum {DISABLE = 0, ENABLE = !DISABLE} FunctionalState;
 
 typedef enum {TEST_IRQ = 0 } IRQn_Type;
+
+#define NVIC_PriorityGroup_2 ((uint32_t)0x500)
+
+static inline uint32_t __get_BASEPRI(void) { return 0; }
+static inline void __set_BASEPRI(uint32_t basePri) { (void)basePri; }
@@ -0,0 +1,375 @@
+/*
+ * This file is part of Cleanflight.
+ *
+ * Cleanflight is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cleanflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cleanflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+
+extern "C" {
+    #include "common/maths.h"
+    #include "common/utils.h"
+    #include "common/filter.h"
+
+    #include "io/rc_smoothing.h"
+}
+
+#include "unittest_macros.h"
+#include "gtest/gtest.h"
+
+#define LOOPTIME 250
+
+// What a receiver sends, every interval with up to jitter either way, leaving out every dropEvery-th frame
+typedef struct frameStream_s {
+    uint32_t interval;
+    uint32_t jitter;
+    uint32_t dropEvery;
+
+    uint32_t frame;
+    uint32_t nextFrameAt;
+} frameStream_t;
+
+typedef float (*stickFuncPtr)(float seconds);
+
+typedef struct runResult_s {
+    float minValue;
+    float maxValue;
+    float minDerivative;
+    float maxDerivative;
+    float meanDerivative;
+} runResult_t;
+
+static void frameStreamInit(frameStream_t *stream, uint32_t interval, uint32_t jitter, uint32_t dropEvery)
+{
+    srand(1);
+    stream->interval = interval;
+    stream->jitter = jitter;
+    stream->dropEvery = dropEvery;
+    stream->frame = 0;
+    stream->nextFrameAt = interval;
+}
+
+// The frame due by now, if there is one
+static bool frameStreamPoll(frameStream_t *stream, uint32_t now, uint32_t *frameAt)
+{
+    bool received = false;
+
+    while ((int32_t)(now - stream->nextFrameAt) >= 0) {
+        stream->frame++;
+        if (!stream->dropEvery || stream->frame % stream->dropEvery) {
+            *frameAt = now;
+            received = true;
+        }
+        int32_t jitter = stream->jitter ? (int32_t)(rand() % (2 * stream->jitter + 1)) - (int32_t)stream->jitter : 0;
+        stream->nextFrameAt = stream->frame * stream->interval + stream->interval + jitter;
+    }
+    return received;
+}
+
+// Every PID loop for the given time, with the stick sampled on every frame for all channels
+static runResult_t runStream(rcSmoothing_t *smoothing, frameStream_t *stream, stickFuncPtr stick, uint32_t duration, uint32_t measureFrom)
+{
+    runResult_t result = { 1e9f, -1e9f, 1e9f, 0, 0 };
+    int16_t targets[RC_SMOOTHING_CHANNEL_COUNT];
+    uint32_t frameAt = 0;
+    float measuredFrom = 0;
+    float previous = smoothing->value[0];
+
+    for (uint32_t now = LOOPTIME; now <= duration; now += LOOPTIME) {
+        if (frameStreamPoll(stream, now, &frameAt)) {
+            for (int channel = 0; channel < RC_SMOOTHING_CHANNEL_COUNT; channel++) {
+                targets[channel] = lrintf(stick(now * 1e-6f));
+            }
+            rcSmoothingSetTargets(smoothing, targets, frameAt);
+        }
+        rcSmoothingApply(smoothing, LOOPTIME);
+
+        const float derivative = (smoothing->value[0] - previous) * (1e6f / LOOPTIME);
+        previous = smoothing->value[0];
+
+        if (now == measureFrom) {
+            measuredFrom = smoothing->value[0];
+        }
+        if (now >= measureFrom) {
+            result.minValue = MIN(result.minValue, smoothing->value[0]);
+            result.maxValue = MAX(result.maxValue, smoothing->value[0]);
+            result.minDerivative = MIN(result.minDerivative, derivative);
+            result.maxDerivative = MAX(result.maxDerivative, ABS(derivative));
+        }
+    }
+    result.meanDerivative = (smoothing->value[0] - measuredFrom) / ((duration - measureFrom) * 1e-6f);
+    return result;
+}
+
+static float stickHold(float seconds)
+{
+    UNUSED(seconds);
+    return 100;
+}
+
+static float stickRamp(float seconds)
+{
+    return 1000 * seconds;      // 1000 per second
+}
+
+static float stickStep(float seconds)
+{
+    return seconds < 0.5f ? 0 : 500;
+}
+
+static float stickSine(float seconds)
+{
+    return 500 * sinf(2 * M_PIf * 2 * seconds);     // 2Hz, up to 6283 per second
+}
+
+static const rcSmoothingType_e smoothedTypes[] = { RC_SMOOTHING_LINEAR, RC_SMOOTHING_PT1, RC_SMOOTHING_BIQUAD, RC_SMOOTHING_CUBIC };
+
+TEST(RcSmoothingTest, FrameIntervalFollowsTheReceiver)
+{
+    rcSmoothing_t smoothing;
+    frameStream_t stream;
+
+    // SBUS said to be 11ms that comes every 14ms, give or take 1ms
+    rcSmoothingInit(&smoothing, RC_SMOOTHING_LINEAR, 11000, LOOPTIME);
+    frameStreamInit(&stream, 14000, 1000, 0);
+    runStream(&smoothing, &stream, stickHold, 2000000, 0);
+
+    EXPECT_NEAR(14000, smoothing.frameInterval, 400);
+}
+
+TEST(RcSmoothingTest, DroppedFramesDoNotStretchTheInterval)
+{
+    rcSmoothing_t smoothing;
+    frameStream_t stream;
+
+    rcSmoothingInit(&smoothing, RC_SMOOTHING_LINEAR, 9000, LOOPTIME);
+    frameStreamInit(&stream, 9000, 500, 5);
+    runStream(&smoothing, &stream, stickHold, 2000000, 0);
+
+    EXPECT_NEAR(9000, smoothing.frameInterval, 300);
+}
+
+TEST(RcSmoothingTest, FrameIntervalStartsAgainForAReceiverAtAnotherRate)
+{
+    rcSmoothing_t smoothing;
+    frameStream_t stream;
+
+    // A 22ms protocol constant for a receiver that sends every 7ms, every interval is out of range at first
+    rcSmoothingInit(&smoothing, RC_SMOOTHING_LINEAR, 22000, LOOPTIME);
+    frameStreamInit(&stream, 7000, 250, 0);
+    runStream(&smoothing, &stream, stickHold, 1000000, 0);
+
+    EXPECT_NEAR(7000, smoothing.frameInterval, 300);
+}
+
+TEST(RcSmoothingTest, OffFollowsTheFramesAtOnce)
+{
+    rcSmoothing_t smoothing;
+    const int16_t targets[RC_SMOOTHING_CHANNEL_COUNT] = { 100, -200, 300, 1400 };
+
+    rcSmoothingInit(&smoothing, RC_SMOOTHING_OFF, 9000, LOOPTIME);
+    rcSmoothingSetTargets(&smoothing, targets, 1000);
+    rcSmoothingApply(&smoothing, LOOPTIME);
+
+    for (int channel = 0; channel < RC_SMOOTHING_CHANNEL_COUNT; channel++) {
+        EXPECT_EQ(targets[channel], smoothing.value[channel]);
+    }
+}
+
+TEST(RcSmoothingTest, SmoothedValuesStartOnTheFirstTargets)
+{
+    const int16_t targets[RC_SMOOTHING_CHANNEL_COUNT] = { 100, -200, 300, 1400 };
+
+    for (unsigned i = 0; i < ARRAYLEN(smoothedTypes); i++) {
+        rcSmoothing_t smoothing;
+
+        rcSmoothingInit(&smoothing, smoothedTypes[i], 9000, LOOPTIME);
+        rcSmoothingSetTargets(&smoothing, targets, 1000);
+        rcSmoothingApply(&smoothing, LOOPTIME);
+
+        for (int channel = 0; channel < RC_SMOOTHING_CHANNEL_COUNT; channel++) {
+            // and does not move off them, less than 1 per second
+            EXPECT_NEAR(targets[channel], smoothing.value[channel], LOOPTIME * 1e-6f) << "type " << smoothedTypes[i];
+        }
+    }
+}
+
+TEST(RcSmoothingTest, StepsAreSpreadOverTheFrames)
+{
+    rcSmoothing_t smoothing;
+    frameStream_t stream;
+
+    // Without smoothing a step of 500 in one 250us loop is 2000000 per second, over a 9ms frame it is 55556
+    for (unsigned i = 0; i < ARRAYLEN(smoothedTypes); i++) {
+        rcSmoothingInit(&smoothing, smoothedTypes[i], 9000, LOOPTIME);
+        frameStreamInit(&stream, 9000, 1000, 0);
+        runResult_t result = runStream(&smoothing, &stream, stickStep, 1000000, LOOPTIME);
+
+        EXPECT_LT(result.maxDerivative, 500 / 0.009f * 3) << "type " << smoothedTypes[i];
+        EXPECT_NEAR(500, smoothing.value[0], 1) << "type " << smoothedTypes[i];
+        EXPECT_GE(result.minValue, -1) << "type " << smoothedTypes[i];
+
+        // The Butterworth rings a little, the others do not go past the step
+        EXPECT_LE(result.maxValue, smoothedTypes[i] == RC_SMOOTHING_BIQUAD ? 500 * 1.06f : 500.5f) << "type " << smoothedTypes[i];
+    }
+}
+
+TEST(RcSmoothingTest, DerivativeFollowsTheStick)
+{
+    rcSmoothing_t smoothing;
+    frameStream_t stream;
+
+    for (unsigned i = 0; i < ARRAYLEN(smoothedTypes); i++) {
+        rcSmoothingInit(&smoothing, smoothedTypes[i], 9000, LOOPTIME);
+        frameStreamInit(&stream, 9000, 0, 0);
+        runResult_t result = runStream(&smoothing, &stream, stickRamp, 500000, 100000);
+
+        EXPECT_NEAR(1000, result.meanDerivative, 10) << "type " << smoothedTypes[i];
+        if (smoothedTypes[i] == RC_SMOOTHING_LINEAR || smoothedTypes[i] == RC_SMOOTHING_CUBIC) {
+            // Steady frames of a steady ramp come out as the ramp itself
+            EXPECT_GT(result.minDerivative, 1000 * 0.95f) << "type " << smoothedTypes[i];
+            EXPECT_LT(result.maxDerivative, 1000 * 1.05f) << "type " << smoothedTypes[i];
+        } else {
+            // The lowpasses still ripple with the frames, less the higher their order
+            EXPECT_GT(result.minDerivative, 0) << "type " << smoothedTypes[i];
+            EXPECT_LT(result.maxDerivative, 1000 * 4) << "type " << smoothedTypes[i];
+        }
+    }
+}
+
+TEST(RcSmoothingTest, DerivativeIsTheSlopeOfTheValue)
+{
+    rcSmoothing_t smoothing;
+    frameStream_t stream;
+    int16_t targets[RC_SMOOTHING_CHANNEL_COUNT];
+    uint32_t frameAt = 0;
+
+    for (unsigned i = 0; i < ARRAYLEN(smoothedTypes); i++) {
+        rcSmoothingInit(&smoothing, smoothedTypes[i], 11000, LOOPTIME);
+        frameStreamInit(&stream, 11000, 1000, 0);
+
+        // with loops that come early and late
+        uint32_t now = 0;
+        for (int loop = 0; loop < 2000; loop++) {
+            const uint32_t deltaT = loop % 2 ? LOOPTIME - 50 : LOOPTIME + 50;
+            now += deltaT;
+            if (frameStreamPoll(&stream, now, &frameAt)) {
+                for (int channel = 0; channel < RC_SMOOTHING_CHANNEL_COUNT; channel++) {
+                    targets[channel] = lrintf(stickSine(now * 1e-6f));
+                }
+                rcSmoothingSetTargets(&smoothing, targets, frameAt);
+            }
+            const float previous = smoothing.value[0];
+            rcSmoothingApply(&smoothing, deltaT);
+
+            EXPECT_NEAR((smoothing.value[0] - previous) * 1e6f / deltaT, rcSmoothingGetDerivative(&smoothing, 0), 0.5f) << "type " << smoothedTypes[i];
+        }
+    }
+}
+
+TEST(RcSmoothingTest, NoDerivativeWithoutSmoothing)
+{
+    rcSmoothing_t smoothing;
+    const int16_t targets[RC_SMOOTHING_CHANNEL_COUNT] = { 100, -200, 300, 1400 };
+
+    rcSmoothingInit(&smoothing, RC_SMOOTHING_OFF, 9000, LOOPTIME);
+    rcSmoothingSetTargets(&smoothing, targets, 1000);
+    rcSmoothingApply(&smoothing, LOOPTIME);
+    rcSmoothingSetTargets(&smoothing, targets + 1, 10000);
+    rcSmoothingApply(&smoothing, LOOPTIME);
+
+    for (int channel = 0; channel < RC_SMOOTHING_CHANNEL_COUNT; channel++) {
+        EXPECT_EQ(0, rcSmoothingGetDerivative(&smoothing, channel));
+    }
+}
+
+TEST(RcSmoothingTest, BiquadIsDesignedForTheNominalLoop)
+{
+    rcSmoothing_t smoothing;
+    frameStream_t stream;
+    int16_t targets[RC_SMOOTHING_CHANNEL_COUNT] = { 0, 0, 0, 1000 };
+    uint32_t frameAt = 0;
+
+    rcSmoothingInit(&smoothing, RC_SMOOTHING_BIQUAD, 9000, LOOPTIME);
+    const biquadFilter_t designed = smoothing.biquad[0];
+
+    // when the loops jitter and the frames wander within a few percent of the estimate
+    frameStreamInit(&stream, 9000, 300, 0);
+    uint32_t now = 0;
+    for (int loop = 0; loop < 4000; loop++) {
+        const uint32_t deltaT = loop % 3 ? LOOPTIME - 20 : LOOPTIME + 40;
+        now += deltaT;
+        if (frameStreamPoll(&stream, now, &frameAt)) {
+            rcSmoothingSetTargets(&smoothing, targets, frameAt);
+        }
+        rcSmoothingApply(&smoothing, deltaT);
+    }
+
+    // then the coefficients stay as they were
+    EXPECT_EQ(LOOPTIME, smoothing.loopTime);
+    EXPECT_EQ(designed.b0, smoothing.biquad[0].b0);
+    EXPECT_EQ(designed.a1, smoothing.biquad[0].a1);
+    EXPECT_EQ(designed.a2, smoothing.biquad[0].a2);
+
+    // and are designed again once the receiver turns out to be slower, its frame times carry on after the first ones
+    frameStreamInit(&stream, 11000, 300, 0);
+    for (now = 0; now < 1000000; now += LOOPTIME) {
+        if (frameStreamPoll(&stream, now, &frameAt)) {
+            rcSmoothingSetTargets(&smoothing, targets, frameAt + 2000000);
+        }
+        rcSmoothingApply(&smoothing, LOOPTIME);
+    }
+    EXPECT_NEAR(11000, smoothing.designedInterval, 11000 * RC_SMOOTHING_REDESIGN_CHANGE);
+    EXPECT_LT(smoothing.biquad[0].b0, designed.b0);
+}
+
+TEST(RcSmoothingTest, JitteredFramesAreSmootherThanTheSteps)
+{
+    rcSmoothing_t smoothing;
+    frameStream_t stream;
+
+    // SBUS every 14ms give or take 2ms, a frame in seven lost, a 2Hz stick with a peak rate of 6283 per second
+    rcSmoothingInit(&smoothing, RC_SMOOTHING_OFF, 11000, LOOPTIME);
+    frameStreamInit(&stream, 14000, 2000, 7);
+    const runResult_t steps = runStream(&smoothing, &stream, stickSine, 3000000, 500000);
+
+    for (unsigned i = 0; i < ARRAYLEN(smoothedTypes); i++) {
+        rcSmoothingInit(&smoothing, smoothedTypes[i], 11000, LOOPTIME);
+        frameStreamInit(&stream, 14000, 2000, 7);
+        runResult_t result = runStream(&smoothing, &stream, stickSine, 3000000, 500000);
+
+        EXPECT_GT(result.maxValue, 500 * 0.9f) << "type " << smoothedTypes[i];
+        EXPECT_LT(result.maxValue, 500 * 1.05f) << "type " << smoothedTypes[i];
+        EXPECT_GT(result.minValue, -500 * 1.05f) << "type " << smoothedTypes[i];
+        EXPECT_LT(result.maxDerivative, steps.maxDerivative / 8) << "type " << smoothedTypes[i];
+    }
+}
+
+TEST(RcSmoothingTest, TargetsWithoutANewFrameKeepTheInterval)
+{
+    rcSmoothing_t smoothing;
+    const int16_t targets[RC_SMOOTHING_CHANNEL_COUNT] = { 0, 0, 0, 1000 };
+
+    // processRx() at 50Hz without frames, parallel PWM or a lost link, hands the same frame time over again
+    rcSmoothingInit(&smoothing, RC_SMOOTHING_CUBIC, 20000, LOOPTIME);
+    for (int i = 0; i < 10; i++) {
+        rcSmoothingSetTargets(&smoothing, targets, 0);
+        rcSmoothingApply(&smoothing, LOOPTIME);
+    }
+
+    EXPECT_EQ(20000, smoothing.frameInterval);
+    EXPECT_EQ(0, smoothing.rejectedIntervals);
+}
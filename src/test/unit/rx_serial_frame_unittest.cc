@@ -0,0 +1,853 @@
+/*
+ * This file is part of Cleanflight.
+ *
+ * Cleanflight is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cleanflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cleanflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+extern "C" {
+    #include "platform.h"
+
+    #include "common/utils.h"
+
+    #include "drivers/serial.h"
+    #include "io/serial.h"
+
+    #include "rx/rx.h"
+    #include "rx/serial_rx_frame.h"
+    #include "rx/sbus.h"
+    #include "rx/sumd.h"
+    #include "rx/sumh.h"
+    #include "rx/spektrum.h"
+    #include "rx/xbus.h"
+
+    bool sbusInit(rxConfig_t *rxConfig, rxRuntimeConfig_t *rxRuntimeConfig, rcReadRawDataPtr *callback);
+    bool spektrumInit(rxConfig_t *rxConfig, rxRuntimeConfig_t *rxRuntimeConfig, rcReadRawDataPtr *callback);
+    bool sumdInit(rxConfig_t *rxConfig, rxRuntimeConfig_t *rxRuntimeConfig, rcReadRawDataPtr *callback);
+    bool sumhInit(rxConfig_t *rxConfig, rxRuntimeConfig_t *rxRuntimeConfig, rcReadRawDataPtr *callback);
+    uint8_t xBusRj01CRC8(uint8_t inData, uint8_t seed);
+}
+
+#include "unittest_macros.h"
+#include "gtest/gtest.h"
+
+#define SBUS_BYTE_TIME 120      // 100000 baud 8E2
+#define UART_BYTE_TIME 87       // 115200 baud 8N1
+#define SILENCE 10000           // between frames, longer than any byte gap
+
+static uint32_t fakeMicros = 100000;
+static serialReceiveCallbackPtr portCallback;
+static serialPortConfig_t portConfig;
+static serialPort_t port;
+
+static rxConfig_t testRxConfig;
+static rxRuntimeConfig_t testRxRuntimeConfig;
+static rcReadRawDataPtr readRawRC;
+
+static uint16_t readChannel(uint8_t chan)
+{
+    return readRawRC(&testRxRuntimeConfig, chan);
+}
+
+// The port hands the bytes over one at a time as the interrupt would, byteTime apart
+static void feedBytes(const uint8_t *data, int length, uint32_t byteTime)
+{
+    for (int i = 0; i < length; i++) {
+        fakeMicros += byteTime;
+        portCallback(data[i]);
+    }
+}
+
+static uint8_t receiveBytes(const uint8_t *data, int length, uint32_t byteTime)
+{
+    feedBytes(data, length, byteTime);
+    return serialRxFramePoll();
+}
+
+static uint8_t receiveFrame(const uint8_t *data, int length, uint32_t byteTime)
+{
+    fakeMicros += SILENCE;
+    return receiveBytes(data, length, byteTime);
+}
+
+// Protocol encoders, the way the receivers send them
+
+static uint16_t crc16(uint16_t crc, uint8_t value)
+{
+    crc ^= (uint16_t)value << 8;
+    for (int i = 0; i < 8; i++) {
+        crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+    return crc;
+}
+
+// 16 channels of 11 bits packed bit by bit, least significant first
+static int sbusEncode(uint8_t *frame, const uint16_t *raw, uint8_t flags)
+{
+    memset(frame, 0, 25);
+    frame[0] = 0x0F;
+    for (int bit = 0; bit < 16 * 11; bit++) {
+        if (raw[bit / 11] & (1 << (bit % 11))) {
+            frame[1 + bit / 8] |= 1 << (bit % 8);
+        }
+    }
+    frame[23] = flags;
+    frame[24] = 0x00;
+    return 25;
+}
+
+static int sumdEncode(uint8_t *frame, const uint16_t *raw, uint8_t channelCount, uint8_t state)
+{
+    int length = 0;
+    frame[length++] = 0xA8;
+    frame[length++] = state;
+    frame[length++] = channelCount;
+    for (int i = 0; i < channelCount; i++) {
+        frame[length++] = raw[i] >> 8;
+        frame[length++] = raw[i] & 0xFF;
+    }
+    uint16_t crc = 0;
+    for (int i = 0; i < length; i++) {
+        crc = crc16(crc, frame[i]);
+    }
+    frame[length++] = crc >> 8;
+    frame[length++] = crc & 0xFF;
+    return length;
+}
+
+static int sumhEncode(uint8_t *frame, const uint16_t *raw)
+{
+    memset(frame, 0, 21);
+    frame[0] = 0xA8;
+    for (int i = 0; i < 8; i++) {
+        frame[3 + i * 2] = raw[i] >> 8;
+        frame[4 + i * 2] = raw[i] & 0xFF;
+    }
+    frame[20] = 0x5A;
+    return 21;
+}
+
+// 7 channel words of id and value, 11 bits of value in 2048 mode, 10 in 1024 mode
+static int spektrumEncode(uint8_t *frame, const uint8_t *ids, const uint16_t *raw, bool hiRes)
+{
+    const int shift = hiRes ? 11 : 10;
+
+    frame[0] = 0x00;
+    frame[1] = hiRes ? 0x12 : 0x01;
+    for (int i = 0; i < 7; i++) {
+        const uint16_t word = (ids[i] << shift) | raw[i];
+        frame[2 + i * 2] = word >> 8;
+        frame[3 + i * 2] = word & 0xFF;
+    }
+    return 16;
+}
+
+static int xBusModeBEncode(uint8_t *frame, const uint16_t *raw)
+{
+    frame[0] = 0xA1;
+    for (int i = 0; i < 12; i++) {
+        frame[1 + i * 2] = raw[i] >> 8;
+        frame[2 + i * 2] = raw[i] & 0xFF;
+    }
+    uint16_t crc = 0;
+    for (int i = 0; i < 25; i++) {
+        crc = crc16(crc, frame[i]);
+    }
+    frame[25] = crc >> 8;
+    frame[26] = crc & 0xFF;
+    return 27;
+}
+
+static int xBusRj01Encode(uint8_t *frame, const uint16_t *raw)
+{
+    frame[0] = 0xA1;
+    frame[1] = 30;
+    frame[2] = 0x00;
+    xBusModeBEncode(frame + 3, raw);
+    frame[30] = 0x00;
+    frame[31] = 0x00;
+    uint8_t crc = 0;
+    for (int i = 0; i < 32; i++) {
+        crc = xBusRj01CRC8(crc, frame[i]);
+    }
+    frame[32] = crc;
+    return 33;
+}
+
+static void randomValues(uint16_t *raw, int count, uint16_t min, uint16_t max)
+{
+    for (int i = 0; i < count; i++) {
+        raw[i] = min + rand() % (max - min + 1);
+    }
+}
+
+static void initProtocol(SerialRXType provider)
+{
+    memset(&testRxConfig, 0, sizeof(testRxConfig));
+    memset(&testRxRuntimeConfig, 0, sizeof(testRxRuntimeConfig));
+    testRxConfig.serialrx_provider = provider;
+    testRxConfig.midrc = 1500;
+    memset(&port, 0, sizeof(port));
+    portCallback = NULL;
+    readRawRC = NULL;
+
+    bool enabled = false;
+    switch (provider) {
+        case SERIALRX_SBUS:
+            enabled = sbusInit(&testRxConfig, &testRxRuntimeConfig, &readRawRC);
+            break;
+        case SERIALRX_SUMD:
+            enabled = sumdInit(&testRxConfig, &testRxRuntimeConfig, &readRawRC);
+            break;
+        case SERIALRX_SUMH:
+            enabled = sumhInit(&testRxConfig, &testRxRuntimeConfig, &readRawRC);
+            break;
+        case SERIALRX_SPEKTRUM1024:
+        case SERIALRX_SPEKTRUM2048:
+            enabled = spektrumInit(&testRxConfig, &testRxRuntimeConfig, &readRawRC);
+            break;
+        case SERIALRX_XBUS_MODE_B:
+        case SERIALRX_XBUS_MODE_B_RJ01:
+            enabled = xBusInit(&testRxConfig, &testRxRuntimeConfig, &readRawRC);
+            break;
+    }
+    ASSERT_TRUE(enabled);
+    ASSERT_TRUE(portCallback != NULL);
+    ASSERT_TRUE(port.rxSpanCallback == serialRxFrameSpanReceive);
+    ASSERT_TRUE(readRawRC == serialRxReadRawRC);
+}
+
+TEST(SerialRxFrameTest, PollBeforeAnyInit)
+{
+    // serialrx_provider can change in the cli or msp without the matching init
+    EXPECT_EQ(SERIAL_RX_FRAME_PENDING, serialRxFramePoll());
+}
+
+TEST(SerialRxFrameTest, ScalesMatchTheFloatConversions)
+{
+    // given
+    static const serialRxScale_t sbusScale = { 5, 3, 880 };
+    static const serialRxScale_t xBusScale = { 1400, 12, 800 };
+    static const serialRxScale_t sumhScale = { 5, 5, -375 };
+
+    // then, every value the protocols can send
+    for (uint32_t raw = 0; raw < 2048; raw++) {
+        EXPECT_EQ((uint16_t)(0.625f * raw + 880), serialRxScaleValue(&sbusScale, raw));
+    }
+    for (uint32_t raw = 0; raw < 4096; raw++) {
+        EXPECT_EQ(800 + ((raw * 1400) >> 12), serialRxScaleValue(&xBusScale, raw));
+    }
+
+    // and SUMH is value / 6.4 - 375 exactly, the float division came out one short on 1500
+    EXPECT_EQ(1500, serialRxScaleValue(&sumhScale, 12000));
+    EXPECT_EQ(1100, serialRxScaleValue(&sumhScale, 9440));
+    EXPECT_EQ(1900, serialRxScaleValue(&sumhScale, 14560));
+    EXPECT_EQ(1500, serialRxScaleValue(&sumhScale, 12006));
+}
+
+TEST(SbusTest, UnpackMatchesBitwiseReference)
+{
+    // given
+    initProtocol(SERIALRX_SBUS);
+    EXPECT_EQ(18, testRxRuntimeConfig.channelCount);
+    EXPECT_EQ(1500, readChannel(0));
+
+    srand(1);
+    for (int n = 0; n < 1000; n++) {
+        uint16_t raw[16];
+        uint8_t frame[SERIAL_RX_FRAME_MAX_SIZE];
+        randomValues(raw, 16, 0, 2047);
+        const int length = sbusEncode(frame, raw, 0);
+
+        // when
+        EXPECT_EQ(SERIAL_RX_FRAME_COMPLETE, receiveFrame(frame, length, SBUS_BYTE_TIME));
+
+        // then
+        for (int i = 0; i < 16; i++) {
+            EXPECT_EQ((uint16_t)(0.625f * raw[i] + 880), readChannel(i));
+        }
+    }
+}
+
+TEST(SbusTest, DigitalChannelsAndFailsafe)
+{
+    // given
+    initProtocol(SERIALRX_SBUS);
+    uint16_t raw[16];
+    uint8_t frame[SERIAL_RX_FRAME_MAX_SIZE];
+    randomValues(raw, 16, 173, 1812);
+
+    // when
+    int length = sbusEncode(frame, raw, (1 << 0));
+
+    // then
+    EXPECT_EQ(SERIAL_RX_FRAME_COMPLETE, receiveFrame(frame, length, SBUS_BYTE_TIME));
+    EXPECT_EQ(2012, readChannel(16));
+    EXPECT_EQ(988, readChannel(17));
+
+    // when
+    length = sbusEncode(frame, raw, (1 << 1) | (1 << 3));
+
+    // then
+    EXPECT_EQ(SERIAL_RX_FRAME_COMPLETE | SERIAL_RX_FRAME_FAILSAFE, receiveFrame(frame, length, SBUS_BYTE_TIME));
+    EXPECT_EQ(988, readChannel(16));
+    EXPECT_EQ(2012, readChannel(17));
+}
+
+TEST(SbusTest, FrameThatTakesTooLongIsDropped)
+{
+    // given
+    initProtocol(SERIALRX_SBUS);
+    uint16_t raw[16];
+    uint8_t frame[SERIAL_RX_FRAME_MAX_SIZE];
+    randomValues(raw, 16, 0, 2047);
+    const int length = sbusEncode(frame, raw, 0);
+
+    // when, half a frame and the rest of it long after
+    fakeMicros += SILENCE;
+    receiveBytes(frame, 12, SBUS_BYTE_TIME);
+    fakeMicros += 3000;
+
+    // then
+    EXPECT_EQ(SERIAL_RX_FRAME_PENDING, receiveBytes(frame + 12, length - 12, SBUS_BYTE_TIME));
+    EXPECT_EQ(SERIAL_RX_FRAME_COMPLETE, receiveFrame(frame, length, SBUS_BYTE_TIME));
+}
+
+TEST(SbusTest, FramesHandedOverByDma)
+{
+    // given
+    initProtocol(SERIALRX_SBUS);
+    uint16_t raw[16];
+    uint8_t frame[SERIAL_RX_FRAME_MAX_SIZE];
+    randomValues(raw, 16, 0, 2047);
+    const int length = sbusEncode(frame, raw, 0);
+
+    // when, the whole frame on the idle line after it
+    fakeMicros += SILENCE + length * SBUS_BYTE_TIME;
+    port.rxSpanCallback(frame, length);
+
+    // then
+    EXPECT_EQ(SERIAL_RX_FRAME_COMPLETE, serialRxFramePoll());
+    EXPECT_EQ((uint16_t)(0.625f * raw[5] + 880), readChannel(5));
+
+    // when, the next one split by the half buffer interrupt
+    randomValues(raw, 16, 0, 2047);
+    sbusEncode(frame, raw, 0);
+    fakeMicros += SILENCE + 10 * SBUS_BYTE_TIME;
+    port.rxSpanCallback(frame, 10);
+    fakeMicros += (length - 10) * SBUS_BYTE_TIME;
+    port.rxSpanCallback(frame + 10, length - 10);
+
+    // then
+    EXPECT_EQ(SERIAL_RX_FRAME_COMPLETE, serialRxFramePoll());
+    EXPECT_EQ((uint16_t)(0.625f * raw[15] + 880), readChannel(15));
+}
+
+TEST(SumdTest, Frames)
+{
+    // given
+    initProtocol(SERIALRX_SUMD);
+    uint16_t raw[16];
+    uint8_t frame[SERIAL_RX_FRAME_MAX_SIZE];
+
+    srand(2);
+    for (int channelCount = 1; channelCount <= 16; channelCount++) {
+        randomValues(raw, channelCount, 1100 * 8, 1900 * 8);
+        const int length = sumdEncode(frame, raw, channelCount, 0x01);
+
+        // when
+        EXPECT_EQ(SERIAL_RX_FRAME_COMPLETE, receiveFrame(frame, length, UART_BYTE_TIME));
+
+        // then
+        for (int i = 0; i < channelCount; i++) {
+            EXPECT_EQ(raw[i] / 8, readChannel(i));
+        }
+    }
+
+    // failsafe
+    int length = sumdEncode(frame, raw, 8, 0x81);
+    EXPECT_EQ(SERIAL_RX_FRAME_COMPLETE | SERIAL_RX_FRAME_FAILSAFE, receiveFrame(frame, length, UART_BYTE_TIME));
+
+    // unknown state
+    length = sumdEncode(frame, raw, 8, 0x02);
+    EXPECT_EQ(SERIAL_RX_FRAME_PENDING, receiveFrame(frame, length, UART_BYTE_TIME));
+
+    // bad CRC
+    length = sumdEncode(frame, raw, 8, 0x01);
+    frame[5] ^= 0x10;
+    EXPECT_EQ(SERIAL_RX_FRAME_PENDING, receiveFrame(frame, length, UART_BYTE_TIME));
+
+    // more channels than there is room for
+    length = sumdEncode(frame, raw, 8, 0x01);
+    frame[2] = 17;
+    EXPECT_EQ(SERIAL_RX_FRAME_PENDING, receiveFrame(frame, length, UART_BYTE_TIME));
+}
+
+TEST(SumhTest, Frames)
+{
+    // given
+    initProtocol(SERIALRX_SUMH);
+    EXPECT_EQ(8, testRxRuntimeConfig.channelCount);
+    uint16_t raw[8] = { 12000, 9440, 14560, 12006, 12800, 11200, 9600, 14400 };
+    uint8_t frame[SERIAL_RX_FRAME_MAX_SIZE];
+    int length = sumhEncode(frame, raw);
+
+    // when
+    EXPECT_EQ(SERIAL_RX_FRAME_COMPLETE, receiveFrame(frame, length, UART_BYTE_TIME));
+
+    // then
+    EXPECT_EQ(1500, readChannel(0));
+    EXPECT_EQ(1100, readChannel(1));
+    EXPECT_EQ(1900, readChannel(2));
+    EXPECT_EQ(1500, readChannel(3));
+    EXPECT_EQ(1625, readChannel(4));
+    EXPECT_EQ(1375, readChannel(5));
+    EXPECT_EQ(1125, readChannel(6));
+    EXPECT_EQ(1875, readChannel(7));
+    EXPECT_EQ(0, readChannel(8));
+
+    // when, the byte before the last one is not 0
+    frame[19] = 1;
+
+    // then
+    EXPECT_EQ(SERIAL_RX_FRAME_PENDING, receiveFrame(frame, length, UART_BYTE_TIME));
+}
+
+TEST(SpektrumTest, Frames2048)
+{
+    // given
+    initProtocol(SERIALRX_SPEKTRUM2048);
+    EXPECT_EQ(12, testRxRuntimeConfig.channelCount);
+    EXPECT_EQ(988, readChannel(0));
+
+    const uint8_t ids[2][7] = { { 0, 1, 2, 3, 4, 5, 6 }, { 7, 8, 9, 10, 11, 12, 15 } };
+    uint16_t raw[7];
+    uint8_t frame[SERIAL_RX_FRAME_MAX_SIZE];
+
+    srand(3);
+    for (int n = 0; n < 2; n++) {
+        randomValues(raw, 7, 0, 2047);
+        const int length = spektrumEncode(frame, ids[n], raw, true);
+
+        // when
+        EXPECT_EQ(SERIAL_RX_FRAME_COMPLETE, receiveFrame(frame, length, UART_BYTE_TIME));
+
+        // then, the channels past the count are left out
+        for (int i = 0; i < 7; i++) {
+            if (ids[n][i] < 12) {
+                EXPECT_EQ(988 + (raw[i] >> 1), readChannel(ids[n][i]));
+            }
+        }
+    }
+    EXPECT_EQ(0, readChannel(12));
+}
+
+TEST(SpektrumTest, Frames1024)
+{
+    // given
+    initProtocol(SERIALRX_SPEKTRUM1024);
+    EXPECT_EQ(7, testRxRuntimeConfig.channelCount);
+
+    const uint8_t ids[7] = { 0, 1, 2, 3, 4, 5, 6 };
+    uint16_t raw[7];
+    uint8_t frame[SERIAL_RX_FRAME_MAX_SIZE];
+    randomValues(raw, 7, 0, 1023);
+    const int length = spektrumEncode(frame, ids, raw, false);
+
+    // when
+    EXPECT_EQ(SERIAL_RX_FRAME_COMPLETE, receiveFrame(frame, length, UART_BYTE_TIME));
+
+    // then
+    for (int i = 0; i < 7; i++) {
+        EXPECT_EQ(988 + raw[i], readChannel(i));
+    }
+}
+
+TEST(SpektrumTest, FramesOnlyStartAfterSilence)
+{
+    // given
+    initProtocol(SERIALRX_SPEKTRUM2048);
+    const uint8_t ids[7] = { 0, 1, 2, 3, 4, 5, 6 };
+    uint16_t raw[7] = { 0, 100, 200, 300, 400, 500, 600 };
+    uint8_t frame[SERIAL_RX_FRAME_MAX_SIZE];
+    const int length = spektrumEncode(frame, ids, raw, true);
+
+    // when, joined in the middle of a frame
+    fakeMicros += SILENCE;
+
+    // then
+    EXPECT_EQ(SERIAL_RX_FRAME_PENDING, receiveBytes(frame + 5, length - 5, UART_BYTE_TIME));
+    EXPECT_EQ(SERIAL_RX_FRAME_COMPLETE, receiveFrame(frame, length, UART_BYTE_TIME));
+    EXPECT_EQ(988 + 300, readChannel(6));
+
+    // and the bytes straight after a frame are not the start of another one
+    EXPECT_EQ(SERIAL_RX_FRAME_PENDING, receiveBytes(frame, length, UART_BYTE_TIME));
+}
+
+TEST(XBusTest, ModeB)
+{
+    // given
+    initProtocol(SERIALRX_XBUS_MODE_B);
+    uint16_t raw[12];
+    uint8_t frame[SERIAL_RX_FRAME_MAX_SIZE];
+
+    srand(4);
+    randomValues(raw, 12, 0, 4095);
+    // the high byte of the first channel is the RJ01 length, it must not matter in MODE B
+    raw[0] = (30 << 8) | 0x12;
+    int length = xBusModeBEncode(frame, raw);
+
+    // when
+    EXPECT_EQ(SERIAL_RX_FRAME_COMPLETE, receiveFrame(frame, length, UART_BYTE_TIME));
+
+    // then
+    for (int i = 0; i < 12; i++) {
+        EXPECT_EQ(800 + ((raw[i] * 1400) >> 12), readChannel(i));
+    }
+
+    // bad CRC
+    frame[7] ^= 0x01;
+    EXPECT_EQ(SERIAL_RX_FRAME_PENDING, receiveFrame(frame, length, UART_BYTE_TIME));
+}
+
+TEST(XBusTest, Rj01)
+{
+    // given
+    initProtocol(SERIALRX_XBUS_MODE_B_RJ01);
+    uint16_t raw[12];
+    uint8_t frame[SERIAL_RX_FRAME_MAX_SIZE];
+
+    srand(5);
+    randomValues(raw, 12, 0, 4095);
+    int length = xBusRj01Encode(frame, raw);
+
+    // when
+    EXPECT_EQ(SERIAL_RX_FRAME_COMPLETE, receiveFrame(frame, length, UART_BYTE_TIME));
+
+    // then
+    for (int i = 0; i < 12; i++) {
+        EXPECT_EQ(800 + ((raw[i] * 1400) >> 12), readChannel(i));
+    }
+
+    // bad outer CRC
+    frame[32] ^= 0x01;
+    EXPECT_EQ(SERIAL_RX_FRAME_PENDING, receiveFrame(frame, length, UART_BYTE_TIME));
+
+    // bad length
+    length = xBusRj01Encode(frame, raw);
+    frame[1] = 29;
+    EXPECT_EQ(SERIAL_RX_FRAME_PENDING, receiveFrame(frame, length, UART_BYTE_TIME));
+}
+
+// A stream of frames of every protocol, to hand to the framer a byte or a span at a time
+
+#define STREAM_FRAME_COUNT 50
+
+typedef struct streamFrame_s {
+    uint8_t data[SERIAL_RX_FRAME_MAX_SIZE];
+    uint8_t length;
+} streamFrame_t;
+
+typedef struct testProtocol_s {
+    SerialRXType provider;
+    const serialRxFrameSpec_t *spec;
+    uint32_t byteTime;
+} testProtocol_t;
+
+static const testProtocol_t testProtocols[] = {
+    { SERIALRX_SBUS, &sbusFrameSpec, SBUS_BYTE_TIME },
+    { SERIALRX_SUMD, &sumdFrameSpec, UART_BYTE_TIME },
+    { SERIALRX_SUMH, &sumhFrameSpec, UART_BYTE_TIME },
+    { SERIALRX_SPEKTRUM2048, &spektrumFrameSpec, UART_BYTE_TIME },
+    { SERIALRX_XBUS_MODE_B, &xBusModeBFrameSpec, UART_BYTE_TIME },
+    { SERIALRX_XBUS_MODE_B_RJ01, &xBusRj01FrameSpec, UART_BYTE_TIME },
+};
+
+static void encodeStream(SerialRXType provider, streamFrame_t *frames)
+{
+    const uint8_t ids[7] = { 0, 1, 2, 3, 4, 5, 6 };
+    uint16_t raw[16];
+
+    for (int n = 0; n < STREAM_FRAME_COUNT; n++) {
+        switch (provider) {
+            case SERIALRX_SBUS:
+                randomValues(raw, 16, 0, 2047);
+                frames[n].length = sbusEncode(frames[n].data, raw, 0);
+                break;
+            case SERIALRX_SUMD:
+                randomValues(raw, 16, 1100 * 8, 1900 * 8);
+                frames[n].length = sumdEncode(frames[n].data, raw, 1 + n % 16, 0x01);
+                break;
+            case SERIALRX_SUMH:
+                randomValues(raw, 8, 9440, 14560);
+                frames[n].length = sumhEncode(frames[n].data, raw);
+                break;
+            case SERIALRX_SPEKTRUM2048:
+                randomValues(raw, 7, 0, 2047);
+                frames[n].length = spektrumEncode(frames[n].data, ids, raw, true);
+                break;
+            case SERIALRX_XBUS_MODE_B:
+                randomValues(raw, 12, 0, 4095);
+                frames[n].length = xBusModeBEncode(frames[n].data, raw);
+                break;
+            default:
+                randomValues(raw, 12, 0, 4095);
+                frames[n].length = xBusRj01Encode(frames[n].data, raw);
+                break;
+        }
+    }
+}
+
+// Every frame is one burst after a silence, the spans break up at random within it as a DMA would
+static int receiveStream(serialRxFramer_t *framer, const streamFrame_t *frames, uint32_t byteTime, int maxSpan, uint16_t (*channels)[SERIAL_RX_MAX_CHANNEL_COUNT])
+{
+    int complete = 0;
+    uint32_t now = 100000;
+
+    memset(serialRxChannelData, 0, sizeof(serialRxChannelData));
+
+    for (int n = 0; n < STREAM_FRAME_COUNT; n++) {
+        now += SILENCE;
+        for (int position = 0; position < frames[n].length; ) {
+            int span = 1 + rand() % maxSpan;
+            if (span > frames[n].length - position) {
+                span = frames[n].length - position;
+            }
+            now += span * byteTime;
+            serialRxFramerReceive(framer, frames[n].data + position, span, now);
+            position += span;
+
+            if (serialRxFramerStatus(framer) & SERIAL_RX_FRAME_COMPLETE) {
+                memcpy(channels[complete++], serialRxChannelData, sizeof(serialRxChannelData));
+            }
+        }
+    }
+    return complete;
+}
+
+TEST(SerialRxFrameTest, SpansGiveTheSameFramesAsBytes)
+{
+    static streamFrame_t frames[STREAM_FRAME_COUNT];
+    static uint16_t byteChannels[STREAM_FRAME_COUNT][SERIAL_RX_MAX_CHANNEL_COUNT];
+    static uint16_t spanChannels[STREAM_FRAME_COUNT][SERIAL_RX_MAX_CHANNEL_COUNT];
+    serialRxFramer_t framer;
+
+    srand(6);
+    for (unsigned p = 0; p < ARRAYLEN(testProtocols); p++) {
+        // given
+        initProtocol(testProtocols[p].provider);
+        encodeStream(testProtocols[p].provider, frames);
+
+        // when
+        serialRxFramerInit(&framer, testProtocols[p].spec);
+        const int byteFrames = receiveStream(&framer, frames, testProtocols[p].byteTime, 1, byteChannels);
+        serialRxFramerInit(&framer, testProtocols[p].spec);
+        const int spanFrames = receiveStream(&framer, frames, testProtocols[p].byteTime, SERIAL_RX_FRAME_MAX_SIZE, spanChannels);
+
+        // then
+        EXPECT_EQ(STREAM_FRAME_COUNT, byteFrames) << "provider " << testProtocols[p].provider;
+        EXPECT_EQ(STREAM_FRAME_COUNT, spanFrames) << "provider " << testProtocols[p].provider;
+        EXPECT_EQ(0, memcmp(byteChannels, spanChannels, sizeof(byteChannels))) << "provider " << testProtocols[p].provider;
+    }
+}
+
+TEST(SerialRxFrameTest, GarbageIsNotTakenForFrames)
+{
+    uint8_t garbage[4096];
+
+    srand(7);
+    for (unsigned p = 0; p < ARRAYLEN(testProtocols); p++) {
+        // given
+        initProtocol(testProtocols[p].provider);
+        for (unsigned i = 0; i < sizeof(garbage); i++) {
+            garbage[i] = rand();
+            // plenty of sync bytes so that frames start
+            if (rand() % 8 == 0) {
+                garbage[i] = testProtocols[p].spec->syncByte;
+            }
+        }
+
+        // when
+        int complete = 0;
+        fakeMicros += SILENCE;
+        for (unsigned i = 0; i < sizeof(garbage); i++) {
+            fakeMicros += testProtocols[p].byteTime;
+            if (rand() % 64 == 0) {
+                fakeMicros += SILENCE;
+            }
+            portCallback(garbage[i]);
+
+            if (serialRxFramePoll() & SERIAL_RX_FRAME_COMPLETE) {
+                complete++;
+
+                // then, whatever was unpacked is in the range of the protocol
+                for (int chan = 0; chan < testRxRuntimeConfig.channelCount; chan++) {
+                    switch (testProtocols[p].provider) {
+                        case SERIALRX_SBUS:
+                            EXPECT_GE(readChannel(chan), 880);
+                            EXPECT_LE(readChannel(chan), 2159);
+                            break;
+                        case SERIALRX_SPEKTRUM2048:
+                            EXPECT_GE(readChannel(chan), 988);
+                            EXPECT_LE(readChannel(chan), 2011);
+                            break;
+                        default:
+                            break;
+                    }
+                }
+            }
+        }
+
+        // and the protocols with a CRC turn it all down, the ones without take what comes
+        switch (testProtocols[p].provider) {
+            case SERIALRX_SUMD:
+            case SERIALRX_XBUS_MODE_B:
+            case SERIALRX_XBUS_MODE_B_RJ01:
+                EXPECT_EQ(0, complete) << "provider " << testProtocols[p].provider;
+                break;
+            case SERIALRX_SBUS:
+            case SERIALRX_SPEKTRUM2048:
+                EXPECT_GT(complete, 0) << "provider " << testProtocols[p].provider;
+                break;
+            default:
+                break;
+        }
+
+        // and a frame after the silence that follows is received
+        uint16_t raw[16];
+        uint8_t frame[SERIAL_RX_FRAME_MAX_SIZE];
+        int length;
+        const uint8_t ids[7] = { 0, 1, 2, 3, 4, 5, 6 };
+        randomValues(raw, 16, 0, 2047);
+        switch (testProtocols[p].provider) {
+            case SERIALRX_SBUS:
+                length = sbusEncode(frame, raw, 0);
+                break;
+            case SERIALRX_SUMD:
+                length = sumdEncode(frame, raw, 8, 0x01);
+                break;
+            case SERIALRX_SUMH:
+                length = sumhEncode(frame, raw);
+                break;
+            case SERIALRX_SPEKTRUM2048:
+                length = spektrumEncode(frame, ids, raw, true);
+                break;
+            case SERIALRX_XBUS_MODE_B:
+                length = xBusModeBEncode(frame, raw);
+                break;
+            default:
+                length = xBusRj01Encode(frame, raw);
+                break;
+        }
+        EXPECT_EQ(SERIAL_RX_FRAME_COMPLETE, receiveFrame(frame, length, testProtocols[p].byteTime)) << "provider " << testProtocols[p].provider;
+    }
+}
+
+TEST(SerialRxFrameTest, ResyncsAfterSilence)
+{
+    // given
+    initProtocol(SERIALRX_SUMD);
+    uint16_t raw[16];
+    uint8_t frame[SERIAL_RX_FRAME_MAX_SIZE];
+    randomValues(raw, 12, 1100 * 8, 1900 * 8);
+    const int length = sumdEncode(frame, raw, 12, 0x01);
+
+    // when, the start of a frame, silence and a whole frame
+    fakeMicros += SILENCE;
+    receiveBytes(frame, 10, UART_BYTE_TIME);
+
+    // then
+    EXPECT_EQ(SERIAL_RX_FRAME_COMPLETE, receiveFrame(frame, length, UART_BYTE_TIME));
+    for (int i = 0; i < 12; i++) {
+        EXPECT_EQ(raw[i] / 8, readChannel(i));
+    }
+}
+
+TEST(SerialRxFrameTest, LatestFrameWins)
+{
+    // given
+    initProtocol(SERIALRX_SBUS);
+    uint16_t raw[16];
+    uint8_t frame[SERIAL_RX_FRAME_MAX_SIZE];
+
+    // when, two frames before the RX task gets to them
+    randomValues(raw, 16, 0, 2047);
+    fakeMicros += SILENCE;
+    feedBytes(frame, sbusEncode(frame, raw, 0), SBUS_BYTE_TIME);
+    randomValues(raw, 16, 0, 2047);
+    fakeMicros += SILENCE;
+    feedBytes(frame, sbusEncode(frame, raw, 0), SBUS_BYTE_TIME);
+
+    // then the first one counts as dropped
+    EXPECT_EQ(SERIAL_RX_FRAME_COMPLETE, serialRxFramePoll());
+    EXPECT_EQ((uint16_t)(0.625f * raw[15] + 880), readChannel(15));
+    EXPECT_EQ(SERIAL_RX_FRAME_PENDING, serialRxFramePoll());
+    EXPECT_EQ(1, serialRxFrameDroppedCount());
+}
+
+TEST(SerialRxFrameTest, FramesTakenInTimeAreNotDropped)
+{
+    // given
+    initProtocol(SERIALRX_SBUS);
+    uint16_t raw[16];
+    uint8_t frame[SERIAL_RX_FRAME_MAX_SIZE];
+
+    // when, the RX task takes every frame
+    for (int i = 0; i < 10; i++) {
+        randomValues(raw, 16, 0, 2047);
+        EXPECT_EQ(SERIAL_RX_FRAME_COMPLETE, receiveFrame(frame, sbusEncode(frame, raw, 0), SBUS_BYTE_TIME));
+    }
+
+    // then
+    EXPECT_EQ(0, serialRxFrameDroppedCount());
+}
+
+// STUBS
+
+extern "C" {
+
+uint32_t micros(void)
+{
+    return fakeMicros;
+}
+
+serialPortConfig_t *findSerialPortConfig(serialPortFunction_e function)
+{
+    UNUSED(function);
+    return &portConfig;
+}
+
+serialPort_t *openSerialPort(
+    serialPortIdentifier_e identifier,
+    serialPortFunction_e function,
+    serialReceiveCallbackPtr callback,
+    uint32_t baudrate,
+    portMode_t mode,
+    portOptions_t options)
+{
+    UNUSED(identifier);
+    UNUSED(function);
+    UNUSED(baudrate);
+    UNUSED(mode);
+    UNUSED(options);
+
+    portCallback = callback;
+    return &port;
+}
+
+}
@@ -0,0 +1,330 @@
+/*
+ * This file is part of Cleanflight.
+ *
+ * Cleanflight is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cleanflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cleanflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <limits.h>
+
+extern "C" {
+    #include "debug.h"
+
+    #include "platform.h"
+
+    #include "common/maths.h"
+
+    #include "scheduler.h"
+}
+
+#include "unittest_macros.h"
+#include "gtest/gtest.h"
+
+// 8 kHz gyro, the PID loop takes 80us and leaves a 40us gap to the next sample
+#define GYRO_PERIOD 125
+#define GYROPID_EXECUTION_TIME 80
+
+// a task too long for the gap and a short one that fits, the execution time averages settle about 30us low
+#define LONG_TASK TASK_SERIAL
+#define LONG_TASK_EXECUTION_TIME 90
+#define LONG_TASK_PERIOD 5000
+#define LONG_TASK_SPIKE_EXECUTION_TIME 150
+#define SHORT_TASK TASK_BEEPER
+#define SHORT_TASK_EXECUTION_TIME 10
+#define SHORT_TASK_PERIOD 1000
+
+static uint32_t simulatedTime = 1000;
+static uint32_t nextGyroSampleAt;
+static uint32_t gyroSampledAt;
+static uint32_t maxGyroPidLatency;
+static uint32_t longTaskExecutionTime = LONG_TASK_EXECUTION_TIME;
+static uint32_t longTaskRuns;
+
+#define TASK_LOG_SIZE 16
+static cfTaskId_e taskLog[TASK_LOG_SIZE];
+static int taskLogCount;
+
+static void taskExecuted(cfTaskId_e taskId, uint32_t executionTime)
+{
+    if (taskLogCount < TASK_LOG_SIZE) {
+        taskLog[taskLogCount++] = taskId;
+    }
+    simulatedTime += executionTime;
+}
+
+static void runScheduler(uint32_t duration)
+{
+    uint32_t endAt = simulatedTime + duration;
+
+    while ((int32_t)(simulatedTime - endAt) < 0) {
+        simulatedTime++;    // a pass of the scheduler
+        scheduler();
+    }
+}
+
+static void setupGyroAndTwoTasks(schedulerMode_e mode)
+{
+    for (int taskId = 0; taskId < TASK_COUNT; taskId++) {
+        setTaskEnabled((cfTaskId_e)taskId, false);
+    }
+    schedulerSetMode(mode);
+
+    nextGyroSampleAt = simulatedTime + GYRO_PERIOD;
+    rescheduleTask(TASK_GYROPID, GYRO_PERIOD - 3);
+    rescheduleTask(LONG_TASK, LONG_TASK_PERIOD);
+    rescheduleTask(SHORT_TASK, SHORT_TASK_PERIOD);
+    setTaskEnabled(TASK_SYSTEM, true);
+    setTaskEnabled(TASK_GYROPID, true);
+    setTaskEnabled(LONG_TASK, true);
+    setTaskEnabled(SHORT_TASK, true);
+
+    // settle the execution time averages and the guard interval
+    runScheduler(1000000);
+    maxGyroPidLatency = 0;
+}
+
+TEST(SchedulerUnittest, TestEdfRunsEarliestDeadlineFirst)
+{
+    // given
+    for (int taskId = 0; taskId < TASK_COUNT; taskId++) {
+        setTaskEnabled((cfTaskId_e)taskId, false);
+    }
+    schedulerSetMode(SCHEDULER_MODE_EDF);
+    rescheduleTask(TASK_GYROPID, 1000000);
+
+    // and two tasks released at the same time, the one with the higher id is due first
+    rescheduleTask(TASK_ACCEL, 1000);
+    rescheduleTask(TASK_BATTERY, 500);
+    setTaskEnabled(TASK_ACCEL, true);
+    setTaskEnabled(TASK_BATTERY, true);
+    taskLogCount = 0;
+
+    // when
+    runScheduler(10);
+
+    // then
+    EXPECT_EQ(2, taskLogCount);
+    EXPECT_EQ(TASK_BATTERY, taskLog[0]);
+    EXPECT_EQ(TASK_ACCEL, taskLog[1]);
+}
+
+TEST(SchedulerUnittest, TestEdfRunsShortTaskWhenLongTaskDoesNotFit)
+{
+    // given
+    setupGyroAndTwoTasks(SCHEDULER_MODE_EDF);
+
+    cfTaskInfo_t shortTaskBefore, shortTaskAfter, longTaskBefore, longTaskAfter;
+    getTaskInfo(SHORT_TASK, &shortTaskBefore);
+    getTaskInfo(LONG_TASK, &longTaskBefore);
+
+    // when
+    runScheduler(1000000);
+
+    // then
+    getTaskInfo(SHORT_TASK, &shortTaskAfter);
+    getTaskInfo(LONG_TASK, &longTaskAfter);
+
+    // the short task is started in the gap after the PID loop, long before its deadline
+    EXPECT_EQ(shortTaskBefore.deadlineMisses, shortTaskAfter.deadlineMisses);
+    EXPECT_LT(shortTaskAfter.averageLateness, (uint32_t)GYRO_PERIOD);
+
+    // the long task never fits, it is deferred until it is a period past its deadline and then run anyway
+    EXPECT_GT(longTaskAfter.deadlineMisses, longTaskBefore.deadlineMisses);
+    EXPECT_GT(longTaskAfter.totalExecutionTime, longTaskBefore.totalExecutionTime);
+
+    // so the PID loop is never held up by more than the long task
+    EXPECT_LE(maxGyroPidLatency, (uint32_t)LONG_TASK_EXECUTION_TIME + 2);
+}
+
+TEST(SchedulerUnittest, TestDynamicDelaysShortTaskBehindGuardInterval)
+{
+    // given
+    setupGyroAndTwoTasks(SCHEDULER_MODE_DYNAMIC);
+
+    cfTaskInfo_t shortTaskBefore, shortTaskAfter;
+    getTaskInfo(SHORT_TASK, &shortTaskBefore);
+
+    // when
+    runScheduler(1000000);
+
+    // then
+    getTaskInfo(SHORT_TASK, &shortTaskAfter);
+
+    // the guard interval is sized for the long task, so the short task only gets in once it is overdue
+    EXPECT_GT(shortTaskAfter.deadlineMisses, shortTaskBefore.deadlineMisses);
+}
+
+TEST(SchedulerUnittest, TestSignalledGyroPidRunsFirst)
+{
+    for (int mode = SCHEDULER_MODE_DYNAMIC; mode <= SCHEDULER_MODE_EDF; mode++) {
+        // given
+        setupGyroAndTwoTasks((schedulerMode_e)mode);
+
+        // and the gyro sample lands while both other tasks are waiting
+        rescheduleTask(LONG_TASK, 10);
+        rescheduleTask(SHORT_TASK, 10);
+        runScheduler(GYRO_PERIOD * 4);
+        simulatedTime = nextGyroSampleAt;
+        taskLogCount = 0;
+
+        // when
+        simulatedTime++;
+        scheduler();
+
+        // then
+        EXPECT_EQ(1, taskLogCount);
+        EXPECT_EQ(TASK_GYROPID, taskLog[0]);
+
+        rescheduleTask(LONG_TASK, LONG_TASK_PERIOD);
+        rescheduleTask(SHORT_TASK, SHORT_TASK_PERIOD);
+    }
+}
+
+TEST(SchedulerUnittest, TestGyroPidLatenessIsFromTheSignal)
+{
+    for (int mode = SCHEDULER_MODE_DYNAMIC; mode <= SCHEDULER_MODE_EDF; mode++) {
+        // given
+        setupGyroAndTwoTasks((schedulerMode_e)mode);
+
+        cfTaskInfo_t before, after;
+        getTaskInfo(TASK_GYROPID, &before);
+
+        // the long task holds the loop up behind samples that land while it runs
+        EXPECT_GT(before.maxLateness, 0u);
+
+        // when the scheduler only polls the signal well after the sample, longer than any task holds it up
+        const uint32_t polledAfter = mode == SCHEDULER_MODE_DYNAMIC ? 100 : 110;
+        runScheduler(GYRO_PERIOD * 4);
+        simulatedTime = nextGyroSampleAt + polledAfter;
+        scheduler();
+
+        // then the loop is that late
+        getTaskInfo(TASK_GYROPID, &after);
+        EXPECT_EQ(polledAfter, after.maxLateness);
+        EXPECT_EQ(before.deadlineMisses, after.deadlineMisses);
+    }
+}
+
+TEST(SchedulerUnittest, TestExecutionTimeHistogram)
+{
+    // given
+    setupGyroAndTwoTasks(SCHEDULER_MODE_DYNAMIC);
+
+    // when
+    cfTaskInfo_t longTask, shortTask;
+    getTaskInfo(LONG_TASK, &longTask);
+    getTaskInfo(SHORT_TASK, &shortTask);
+
+    // then
+    for (int i = 0; i < TASK_EXECUTION_TIME_BUCKET_COUNT; i++) {
+        // 90us is in the 64..127us bucket, 10us in the 8..15us one
+        EXPECT_EQ(i == 7, longTask.executionTimeHistogram[i] > 0);
+        EXPECT_EQ(i == 4, shortTask.executionTimeHistogram[i] > 0);
+    }
+}
+
+TEST(SchedulerUnittest, TestTraceStopsAfterLoopTimeSpike)
+{
+    // given
+    setupGyroAndTwoTasks(SCHEDULER_MODE_DYNAMIC);
+
+    // and a long task that has just run and from now on takes more than a gyro period, the PID loop is on time
+    // until it runs again
+    const uint32_t longTaskRunsBefore = longTaskRuns;
+    while (longTaskRuns == longTaskRunsBefore) {
+        runScheduler(1);
+    }
+    longTaskExecutionTime = LONG_TASK_SPIKE_EXECUTION_TIME;
+
+    // when
+    schedulerSetTraceMode(SCHEDULER_TRACE_UNTIL_SPIKE);
+    runScheduler(LONG_TASK_PERIOD * 3);
+    longTaskExecutionTime = LONG_TASK_EXECUTION_TIME;
+
+    // then
+    schedulerTraceEvent_t events[SCHEDULER_TRACE_SIZE];
+    uint8_t eventCount = getSchedulerTrace(events, SCHEDULER_TRACE_SIZE);
+
+    EXPECT_EQ(SCHEDULER_TRACE_OFF, getSchedulerTraceMode());
+    EXPECT_EQ(SCHEDULER_TRACE_SIZE, eventCount);
+
+    // the trace ends with the late PID loop, held up by the long task started just before the gyro sample
+    EXPECT_EQ(TASK_GYROPID, events[eventCount - 1].taskId);
+    EXPECT_EQ(GYROPID_EXECUTION_TIME, events[eventCount - 1].duration);
+    EXPECT_EQ(LONG_TASK, events[eventCount - 2].taskId);
+    EXPECT_EQ(LONG_TASK_SPIKE_EXECUTION_TIME, events[eventCount - 2].duration);
+
+    int previousGyroPid = eventCount - 3;
+    while (previousGyroPid > 0 && events[previousGyroPid].taskId != TASK_GYROPID) {
+        previousGyroPid--;
+    }
+    EXPECT_EQ(TASK_GYROPID, events[previousGyroPid].taskId);
+    EXPECT_GT(events[eventCount - 1].startedAt - events[previousGyroPid].startedAt, (uint32_t)(GYRO_PERIOD - 3) * 3 / 2);
+}
+
+// STUBS
+
+extern "C" {
+
+int16_t debug[DEBUG16_VALUE_COUNT];
+
+uint32_t micros(void)
+{
+    return simulatedTime;
+}
+
+bool taskMainPidLoopCheck(uint32_t currentDeltaTime)
+{
+    UNUSED(currentDeltaTime);
+
+    if ((int32_t)(simulatedTime - nextGyroSampleAt) < 0) {
+        return false;
+    }
+    while ((int32_t)(simulatedTime - nextGyroSampleAt) >= 0) {
+        gyroSampledAt = nextGyroSampleAt;
+        nextGyroSampleAt += GYRO_PERIOD;
+    }
+    return true;
+}
+
+uint32_t taskMainPidLoopSignaledAt(void)
+{
+    return gyroSampledAt;
+}
+
+void taskMainPidLoop(void)
+{
+    maxGyroPidLatency = MAX(maxGyroPidLatency, simulatedTime - gyroSampledAt);
+    taskExecuted(TASK_GYROPID, GYROPID_EXECUTION_TIME);
+}
+void taskUpdateAccelerometer(void) { taskExecuted(TASK_ACCEL, 1); }
+bool taskUpdateAttitudeCheck(uint32_t currentDeltaTime) { UNUSED(currentDeltaTime); return false; }
+void taskUpdateAttitude(void) {}
+void taskHandleSerial(void) { longTaskRuns++; taskExecuted(TASK_SERIAL, longTaskExecutionTime); }
+void taskUpdateBeeper(void) { taskExecuted(TASK_BEEPER, SHORT_TASK_EXECUTION_TIME); }
+void taskUpdateBattery(void) { taskExecuted(TASK_BATTERY, 1); }
+bool taskUpdateRxCheck(uint32_t currentDeltaTime) { UNUSED(currentDeltaTime); return false; }
+void taskUpdateRxMain(void) {}
+void taskProcessGPS(void) {}
+void taskUpdateCompass(void) {}
+void taskUpdateBaro(void) {}
+void taskCalculateAltitude(void) {}
+void taskUpdateDisplay(void) {}
+void taskTelemetry(void) {}
+void taskLedStrip(void) {}
+void taskGyroAnalyse(void) {}
+
+}
@@ -0,0 +1,272 @@
+/*
+ * This file is part of Cleanflight.
+ *
+ * Cleanflight is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cleanflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cleanflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+extern "C" {
+    #include "platform.h"
+
+    #include "drivers/serial.h"
+    #include "drivers/serial_rx_dma.h"
+}
+
+#include "unittest_macros.h"
+#include "gtest/gtest.h"
+
+#define RX_BUFFER_SIZE 64
+
+// A UART receiving by circular DMA, the flags and the data counter work as on the F4
+static volatile uint8_t rxBuffer[RX_BUFFER_SIZE];
+static uint16_t dmaRemaining;
+static bool halfTransferFlag;
+static bool transferCompleteFlag;
+
+static serialRxDma_t rxDma;
+static serialPort_t port;
+
+static std::vector<uint8_t> handedOver;
+static std::vector<uint16_t> spans;
+static uint8_t nextByte;
+
+static void spanReceive(const uint8_t *data, uint16_t length)
+{
+    handedOver.insert(handedOver.end(), data, data + length);
+    spans.push_back(length);
+}
+
+static void byteReceive(uint16_t c)
+{
+    handedOver.push_back(c);
+}
+
+// The line receives length bytes, counting up from the last ones, which the DMA writes with the interrupts held off
+static void lineReceive(int length)
+{
+    while (length--) {
+        rxBuffer[RX_BUFFER_SIZE - dmaRemaining] = nextByte++;
+        if (--dmaRemaining == RX_BUFFER_SIZE / 2) {
+            halfTransferFlag = true;
+        }
+        if (dmaRemaining == 0) {
+            dmaRemaining = RX_BUFFER_SIZE;
+            transferCompleteFlag = true;
+        }
+    }
+}
+
+static void dmaInterrupt(void)
+{
+    if (!halfTransferFlag && !transferCompleteFlag) {
+        return;
+    }
+    if (transferCompleteFlag) {
+        transferCompleteFlag = false;
+        serialRxDmaWrapped(&rxDma);
+    }
+    halfTransferFlag = false;
+    serialRxDmaService(&rxDma, &port, dmaRemaining);
+}
+
+static void idleLineInterrupt(void)
+{
+    serialRxDmaService(&rxDma, &port, dmaRemaining);
+}
+
+// As the hardware runs, the DMA interrupt is taken as soon as one of its flags is set
+static void lineReceiveWithInterrupts(int length)
+{
+    while (length--) {
+        lineReceive(1);
+        dmaInterrupt();
+    }
+}
+
+static void expectHandedOver(uint8_t first, int length)
+{
+    ASSERT_EQ((size_t)length, handedOver.size());
+    for (int i = 0; i < length; i++) {
+        EXPECT_EQ((uint8_t)(first + i), handedOver[i]);
+    }
+}
+
+static void resetUart(void)
+{
+    memset((void *)rxBuffer, 0, sizeof(rxBuffer));
+    dmaRemaining = RX_BUFFER_SIZE;
+    halfTransferFlag = false;
+    transferCompleteFlag = false;
+    nextByte = 0;
+
+    memset(&port, 0, sizeof(port));
+    port.rxSpanCallback = spanReceive;
+    serialRxDmaInit(&rxDma, rxBuffer, RX_BUFFER_SIZE);
+
+    handedOver.clear();
+    spans.clear();
+}
+
+TEST(SerialRxDmaTest, HandsOverAFrameWhenTheLineGoesIdle)
+{
+    // given
+    resetUart();
+
+    // when
+    lineReceiveWithInterrupts(25);
+
+    // then
+    EXPECT_EQ(0u, handedOver.size());
+
+    // when
+    idleLineInterrupt();
+
+    // then
+    expectHandedOver(0, 25);
+    ASSERT_EQ(1u, spans.size());
+    EXPECT_EQ(25, spans[0]);
+
+    // when
+    idleLineInterrupt();
+
+    // then
+    EXPECT_EQ(1u, spans.size());
+}
+
+TEST(SerialRxDmaTest, HandsOverAtHalfAndFullBuffer)
+{
+    // given
+    resetUart();
+
+    // when
+    lineReceiveWithInterrupts(80);
+    idleLineInterrupt();
+
+    // then
+    expectHandedOver(0, 80);
+    ASSERT_EQ(3u, spans.size());
+    EXPECT_EQ(RX_BUFFER_SIZE / 2, spans[0]);
+    EXPECT_EQ(RX_BUFFER_SIZE / 2, spans[1]);
+    EXPECT_EQ(80 - RX_BUFFER_SIZE, spans[2]);
+}
+
+TEST(SerialRxDmaTest, SplitsWhatRunsOverTheEndOfTheBuffer)
+{
+    // given
+    resetUart();
+    lineReceive(50);
+    dmaInterrupt();
+    idleLineInterrupt();
+    handedOver.clear();
+    spans.clear();
+
+    // when
+    lineReceive(30);
+    idleLineInterrupt();
+
+    // then
+    // the transfer complete interrupt is still pending behind the idle line one
+    expectHandedOver(50, 30);
+    ASSERT_EQ(2u, spans.size());
+    EXPECT_EQ(RX_BUFFER_SIZE - 50, spans[0]);
+    EXPECT_EQ(30 - (RX_BUFFER_SIZE - 50), spans[1]);
+
+    // when
+    dmaInterrupt();
+
+    // then
+    EXPECT_EQ(30u, handedOver.size());
+
+    // when
+    lineReceiveWithInterrupts(10);
+    idleLineInterrupt();
+
+    // then
+    expectHandedOver(50, 40);
+    EXPECT_EQ(0u, rxDma.overruns);
+}
+
+TEST(SerialRxDmaTest, CountsAnOverrunAndStartsAgainFromTheLatestByte)
+{
+    // given
+    resetUart();
+    lineReceiveWithInterrupts(40);
+    idleLineInterrupt();
+    handedOver.clear();
+
+    // when
+    // the interrupts are held off for longer than the buffer takes to fill
+    lineReceive(70);
+    dmaInterrupt();
+
+    // then
+    EXPECT_EQ(1u, rxDma.overruns);
+    EXPECT_EQ(70u, rxDma.lostBytes);
+    EXPECT_EQ(0u, handedOver.size());
+
+    // when
+    lineReceiveWithInterrupts(20);
+    idleLineInterrupt();
+
+    // then
+    expectHandedOver(110, 20);
+    EXPECT_EQ(1u, rxDma.overruns);
+}
+
+TEST(SerialRxDmaTest, CallsBackPerByteWithoutASpanCallback)
+{
+    // given
+    resetUart();
+    port.rxSpanCallback = NULL;
+    port.callback = byteReceive;
+
+    // when
+    lineReceiveWithInterrupts(100);
+    idleLineInterrupt();
+
+    // then
+    expectHandedOver(0, 100);
+    EXPECT_EQ(0u, spans.size());
+}
+
+TEST(SerialRxDmaTest, HandsOverEveryByteInOrderOverManyPasses)
+{
+    // given
+    resetUart();
+    srand(24);
+    int received = 0;
+
+    // when
+    while (received < 100000) {
+        // frames of up to most of the buffer, with a silence after them
+        const int length = 1 + rand() % (RX_BUFFER_SIZE - 8);
+        lineReceiveWithInterrupts(length);
+        received += length;
+        if (rand() % 2) {
+            idleLineInterrupt();
+        }
+    }
+    idleLineInterrupt();
+
+    // then
+    expectHandedOver(0, received);
+    EXPECT_EQ(0u, rxDma.overruns);
+    EXPECT_EQ((uint32_t)received, rxDma.consumed);
+}
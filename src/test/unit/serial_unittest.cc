@@ -0,0 +1,148 @@
+/*
+ * This file is part of Cleanflight.
+ *
+ * Cleanflight is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cleanflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cleanflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+extern "C" {
+    #include "platform.h"
+
+    #include "drivers/serial.h"
+}
+
+#include "unittest_macros.h"
+#include "gtest/gtest.h"
+
+#define BUFFER_SIZE 16
+
+static volatile uint8_t rxBuffer[BUFFER_SIZE];
+static volatile uint8_t txBuffer[BUFFER_SIZE];
+static serialPort_t port;
+
+static uint8_t written[BUFFER_SIZE * 2];
+static uint32_t writtenCount;
+
+// A port without writeBuf and readBuf, serialWriteBuf() and serialReadBuf() go a byte at a time
+static void byteWrite(serialPort_t *instance, uint8_t ch)
+{
+    UNUSED(instance);
+    written[writtenCount++] = ch;
+}
+
+static uint32_t byteRxWaiting(serialPort_t *instance)
+{
+    return (instance->rxBufferHead - instance->rxBufferTail) % instance->rxBufferSize;
+}
+
+static uint8_t byteRead(serialPort_t *instance)
+{
+    const uint8_t ch = instance->rxBuffer[instance->rxBufferTail];
+    instance->rxBufferTail = (instance->rxBufferTail + 1) % instance->rxBufferSize;
+    return ch;
+}
+
+static const struct serialPortVTable byteVTable = {
+    byteWrite, byteRxWaiting, NULL, byteRead, NULL, NULL, NULL, NULL, NULL, NULL, NULL
+};
+
+static void resetPort(uint32_t head, uint32_t tail)
+{
+    memset(&port, 0, sizeof(port));
+    memset((void *)rxBuffer, 0, sizeof(rxBuffer));
+    memset((void *)txBuffer, 0, sizeof(txBuffer));
+    port.vTable = &byteVTable;
+    port.rxBuffer = rxBuffer;
+    port.rxBufferSize = BUFFER_SIZE;
+    port.rxBufferHead = head;
+    port.rxBufferTail = tail;
+    port.txBuffer = txBuffer;
+    port.txBufferSize = BUFFER_SIZE;
+    port.txBufferHead = head;
+    port.txBufferTail = tail;
+    writtenCount = 0;
+}
+
+TEST(SerialTest, BufferWriteSplitsAtTheEndOfTheRing)
+{
+    const uint8_t data[] = { 1, 2, 3, 4, 5, 6 };
+
+    resetPort(12, 12);
+    serialBufferWrite(&port, data, sizeof(data));
+
+    EXPECT_EQ(2, port.txBufferHead);
+    EXPECT_EQ(0, memcmp(data, (const uint8_t *)&txBuffer[12], 4));
+    EXPECT_EQ(0, memcmp(data + 4, (const uint8_t *)&txBuffer[0], 2));
+}
+
+TEST(SerialTest, BufferWriteUpToTheEndOfTheRingWrapsTheHead)
+{
+    const uint8_t data[] = { 1, 2, 3, 4 };
+
+    resetPort(12, 12);
+    serialBufferWrite(&port, data, sizeof(data));
+
+    EXPECT_EQ(0, port.txBufferHead);
+    EXPECT_EQ(0, memcmp(data, (const uint8_t *)&txBuffer[12], 4));
+}
+
+TEST(SerialTest, BufferReadSplitsAtTheEndOfTheRing)
+{
+    uint8_t data[BUFFER_SIZE];
+
+    resetPort(3, 13);
+    for (int i = 0; i < BUFFER_SIZE; i++) {
+        rxBuffer[i] = i;
+    }
+
+    EXPECT_EQ(6, serialBufferRead(&port, data, 6));
+    EXPECT_EQ(3, port.rxBufferTail);
+    const uint8_t expected[] = { 13, 14, 15, 0, 1, 2 };
+    EXPECT_EQ(0, memcmp(expected, data, sizeof(expected)));
+}
+
+TEST(SerialTest, BufferReadOnlyReadsWhatIsWaiting)
+{
+    uint8_t data[BUFFER_SIZE];
+
+    resetPort(7, 4);
+    EXPECT_EQ(3, serialBufferRead(&port, data, sizeof(data)));
+    EXPECT_EQ(7, port.rxBufferTail);
+    EXPECT_EQ(0, serialBufferRead(&port, data, sizeof(data)));
+}
+
+TEST(SerialTest, PortsWithoutBulkCopiesGoByteByByte)
+{
+    const uint8_t data[] = { 'M', 'S', 'P' };
+    uint8_t read[BUFFER_SIZE];
+
+    resetPort(0, 0);
+    serialWriteBuf(&port, data, sizeof(data));
+    serialPrint(&port, "$M>");
+    EXPECT_EQ(6, writtenCount);
+    EXPECT_EQ(0, memcmp("MSP$M>", written, 6));
+
+    resetPort(5, 1);
+    rxBuffer[1] = 'a';
+    rxBuffer[2] = 'b';
+    EXPECT_EQ(2, serialReadBuf(&port, read, 2));
+    EXPECT_EQ('a', read[0]);
+    EXPECT_EQ('b', read[1]);
+    EXPECT_EQ(3, port.rxBufferTail);
+    EXPECT_EQ(2, serialReadBuf(&port, read, sizeof(read)));
+}
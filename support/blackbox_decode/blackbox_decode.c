@@ -0,0 +1,456 @@
+/*
+ * This file is part of Cleanflight.
+ *
+ * Cleanflight is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cleanflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cleanflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Decodes blackbox logs into CSV or columnar binary files, one set of files per log in the input, see
+ * docs/development/Blackbox Internals.md.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include "blackbox/blackbox_decoder.h"
+
+#define OUTPUT_BUFFER_SIZE (64 * 1024)
+#define BINARY_BLOCK_ROWS 4096
+#define MAX_COLUMNS (2 * BLACKBOX_DECODER_MAX_FIELDS)
+
+static const char binaryMagic[8] = { 'B', 'B', 'X', 'C', 'O', 'L', '1', '\n' };
+
+typedef struct columnOutput_s {
+    FILE *file;
+    bool binary;
+    int columnCount;
+    uint8_t isSigned[MAX_COLUMNS];
+
+    // CSV rows are formatted into buffer, binary rows are gathered into blocks of columns
+    char buffer[OUTPUT_BUFFER_SIZE];
+    int bufferLength;
+    int32_t *block;
+    int blockRows;
+} columnOutput_t;
+
+static bool binaryOutput;
+static int selectedLog = -1;
+static const char *outputPrefix;
+static bool writeToStdout;
+
+/* Output */
+
+static void flushText(columnOutput_t *output)
+{
+    fwrite(output->buffer, 1, output->bufferLength, output->file);
+    output->bufferLength = 0;
+}
+
+static void flushBlock(columnOutput_t *output)
+{
+    uint32_t rows = output->blockRows;
+
+    if (rows == 0) {
+        return;
+    }
+
+    fwrite(&rows, sizeof(rows), 1, output->file);
+    for (int column = 0; column < output->columnCount; column++) {
+        fwrite(output->block + column * BINARY_BLOCK_ROWS, sizeof(int32_t), rows, output->file);
+    }
+    output->blockRows = 0;
+}
+
+static char *formatUnsigned(char *out, uint32_t value)
+{
+    char digits[10];
+    int count = 0;
+
+    do {
+        digits[count++] = '0' + value % 10;
+        value /= 10;
+    } while (value);
+
+    while (count) {
+        *out++ = digits[--count];
+    }
+
+    return out;
+}
+
+static FILE *openOutputFile(const char *prefix, int logNumber, const char *suffix)
+{
+    char filename[1024];
+    FILE *file;
+
+    if (writeToStdout) {
+        return stdout;
+    }
+
+    snprintf(filename, sizeof(filename), "%s.%02d%s", prefix, logNumber, suffix);
+    file = fopen(filename, "wb");
+    if (!file) {
+        fprintf(stderr, "Failed to create %s\n", filename);
+        exit(1);
+    }
+    fprintf(stderr, "Writing %s\n", filename);
+
+    return file;
+}
+
+static void openColumnOutput(columnOutput_t *output, FILE *file, const char * const *names, const uint8_t *isSigned,
+        int columnCount)
+{
+    output->file = file;
+    output->binary = binaryOutput;
+    output->columnCount = columnCount;
+    output->bufferLength = 0;
+    output->blockRows = 0;
+    memcpy(output->isSigned, isSigned, columnCount);
+
+    if (output->binary) {
+        uint32_t count = columnCount;
+
+        output->block = malloc(sizeof(int32_t) * BINARY_BLOCK_ROWS * columnCount);
+        fwrite(binaryMagic, sizeof(binaryMagic), 1, file);
+        fwrite(&count, sizeof(count), 1, file);
+        for (int i = 0; i < columnCount; i++) {
+            uint8_t nameLength = strlen(names[i]);
+
+            fwrite(&output->isSigned[i], 1, 1, file);
+            fwrite(&nameLength, 1, 1, file);
+            fwrite(names[i], 1, nameLength, file);
+        }
+    } else {
+        output->block = NULL;
+        for (int i = 0; i < columnCount; i++) {
+            fprintf(file, "%s%s", i ? "," : "", names[i]);
+        }
+        fprintf(file, "\n");
+    }
+}
+
+static void writeRow(columnOutput_t *output, const int32_t *values)
+{
+    if (output->binary) {
+        for (int column = 0; column < output->columnCount; column++) {
+            output->block[column * BINARY_BLOCK_ROWS + output->blockRows] = values[column];
+        }
+        if (++output->blockRows == BINARY_BLOCK_ROWS) {
+            flushBlock(output);
+        }
+        return;
+    }
+
+    // Each column takes at most 12 characters
+    if (output->bufferLength + output->columnCount * 12 + 1 > OUTPUT_BUFFER_SIZE) {
+        flushText(output);
+    }
+
+    char *out = output->buffer + output->bufferLength;
+
+    for (int column = 0; column < output->columnCount; column++) {
+        if (column) {
+            *out++ = ',';
+        }
+        if (output->isSigned[column] && values[column] < 0) {
+            *out++ = '-';
+            out = formatUnsigned(out, -(uint32_t)values[column]);
+        } else {
+            out = formatUnsigned(out, values[column]);
+        }
+    }
+    *out++ = '\n';
+
+    output->bufferLength = out - output->buffer;
+}
+
+static void closeColumnOutput(columnOutput_t *output)
+{
+    if (!output->file) {
+        return;
+    }
+
+    if (output->binary) {
+        flushBlock(output);
+        free(output->block);
+    } else {
+        flushText(output);
+    }
+    if (output->file != stdout) {
+        fclose(output->file);
+    }
+    output->file = NULL;
+}
+
+/* Decoding */
+
+static int readFile(void *context, uint8_t *buffer, int length)
+{
+    return fread(buffer, 1, length, (FILE *)context);
+}
+
+static void writeEvent(FILE *file, const blackboxDecoder_t *decoder)
+{
+    const flightLogEvent_t *event = &decoder->event;
+
+    if (!file) {
+        return;
+    }
+
+    switch (event->event) {
+        case FLIGHT_LOG_EVENT_SYNC_BEEP:
+            fprintf(file, "%u,Sync beep,time %u\n", decoder->lastMainTime, event->data.syncBeep.time);
+        break;
+        case FLIGHT_LOG_EVENT_INFLIGHT_ADJUSTMENT:
+            if (event->data.inflightAdjustment.floatFlag) {
+                fprintf(file, "%u,Inflight adjustment,function %d value %g\n", decoder->lastMainTime,
+                    event->data.inflightAdjustment.adjustmentFunction, (double)event->data.inflightAdjustment.newFloatValue);
+            } else {
+                fprintf(file, "%u,Inflight adjustment,function %d value %d\n", decoder->lastMainTime,
+                    event->data.inflightAdjustment.adjustmentFunction, event->data.inflightAdjustment.newValue);
+            }
+        break;
+        case FLIGHT_LOG_EVENT_GTUNE_RESULT:
+            fprintf(file, "%u,G-Tune result,axis %d gyro average %d new P %d\n", decoder->lastMainTime,
+                event->data.gtuneCycleResult.gtuneAxis, event->data.gtuneCycleResult.gtuneGyroAVG,
+                event->data.gtuneCycleResult.gtuneNewP);
+        break;
+        case FLIGHT_LOG_EVENT_LOGGING_RESUME:
+            fprintf(file, "%u,Logging resume,iteration %u\n", event->data.loggingResume.currentTime,
+                event->data.loggingResume.logIteration);
+        break;
+        default:
+        break;
+    }
+}
+
+static void printStats(const blackboxDecoder_t *decoder, uint32_t firstTime, uint32_t lastTime)
+{
+    const blackboxDecoderStats_t *stats = &decoder->stats;
+
+    fprintf(stderr, "Log %d, %s: %u I, %u P, %u S, %u G, %u H frames, %u events, %.3fs\n", decoder->logIndex + 1,
+        decoder->logEnded ? "ended cleanly" : "cut short",
+        stats->frameCount[BLACKBOX_FRAME_INTRA], stats->frameCount[BLACKBOX_FRAME_INTER],
+        stats->frameCount[BLACKBOX_FRAME_SLOW], stats->frameCount[BLACKBOX_FRAME_GPS],
+        stats->frameCount[BLACKBOX_FRAME_GPS_HOME], stats->eventCount, (lastTime - firstTime) / 1e6);
+    fprintf(stderr, "    %u corrupt frames, %u resyncs, %llu bytes skipped, %u unusable frames, %u missing iterations, "
+        "%u resumes\n", stats->corruptFrames, stats->resyncs, (unsigned long long)stats->skippedBytes,
+        stats->unusableFrames, stats->missingIterations, stats->resumes);
+}
+
+static void decodeFile(const char *filename)
+{
+    static blackboxDecoder_t decoder;
+    static columnOutput_t mainOutput, gpsOutput;
+    FILE *input = fopen(filename, "rb");
+    FILE *eventFile = NULL;
+    char prefix[1024];
+    int32_t row[MAX_COLUMNS];
+    int mainFieldCount = 0, slowFieldCount = 0, gpsFieldCount = 0;
+    uint32_t firstTime = 0, lastTime = 0;
+    bool haveFrames = false;
+    bool logSelected = false;
+
+    if (!input) {
+        fprintf(stderr, "Failed to open %s\n", filename);
+        exit(1);
+    }
+
+    if (outputPrefix) {
+        snprintf(prefix, sizeof(prefix), "%s", outputPrefix);
+    } else {
+        const char *extension = strrchr(filename, '.');
+        int length = extension && extension > filename ? extension - filename : (int)strlen(filename);
+
+        snprintf(prefix, sizeof(prefix), "%.*s", length, filename);
+    }
+
+    blackboxDecoderInit(&decoder, readFile, input);
+    memset(row, 0, sizeof(row));
+
+    while (true) {
+        blackboxDecoded_e decoded = blackboxDecoderNext(&decoder);
+
+        if (decoded == BLACKBOX_DECODED_END) {
+            break;
+        }
+
+        if (decoded == BLACKBOX_DECODED_LOG_UNSUPPORTED) {
+            fprintf(stderr, "Log %d can't be decoded: %s\n", decoder.logIndex + 1, decoder.error);
+            continue;
+        }
+
+        if (decoded == BLACKBOX_DECODED_LOG_START) {
+            logSelected = selectedLog < 0 || decoder.logIndex + 1 == selectedLog;
+            if (!logSelected) {
+                continue;
+            }
+
+            const blackboxFrameDefinition_t *mainDef = &decoder.frameDefs[BLACKBOX_FRAME_INTRA];
+            const blackboxFrameDefinition_t *slowDef = &decoder.frameDefs[BLACKBOX_FRAME_SLOW];
+            const blackboxFrameDefinition_t *gpsDef = &decoder.frameDefs[BLACKBOX_FRAME_GPS];
+            const char *names[MAX_COLUMNS];
+            uint8_t isSigned[MAX_COLUMNS];
+            int count = 0;
+
+            // Main frames carry the slow fields last logged along with them
+            mainFieldCount = mainDef->fieldCount;
+            slowFieldCount = slowDef->fieldCount;
+            for (int i = 0; i < mainFieldCount; i++, count++) {
+                names[count] = mainDef->names[i];
+                isSigned[count] = mainDef->isSigned[i];
+            }
+            for (int i = 0; i < slowFieldCount; i++, count++) {
+                names[count] = slowDef->names[i];
+                isSigned[count] = slowDef->isSigned[i];
+            }
+            openColumnOutput(&mainOutput, openOutputFile(prefix, decoder.logIndex + 1, binaryOutput ? ".bin" : ".csv"),
+                names, isSigned, count);
+
+            // GPS frames get the time whether or not they logged it
+            gpsFieldCount = gpsDef->fieldCount;
+            if (gpsFieldCount > 0 && !writeToStdout) {
+                count = 0;
+                names[count] = "time";
+                isSigned[count++] = 0;
+                for (int i = 0; i < gpsFieldCount; i++) {
+                    if (i != decoder.gpsTimeField) {
+                        names[count] = gpsDef->names[i];
+                        isSigned[count++] = gpsDef->isSigned[i];
+                    }
+                }
+                openColumnOutput(&gpsOutput, openOutputFile(prefix, decoder.logIndex + 1, binaryOutput ? ".gps.bin" : ".gps.csv"),
+                    names, isSigned, count);
+            }
+
+            if (!writeToStdout) {
+                eventFile = openOutputFile(prefix, decoder.logIndex + 1, ".event");
+            }
+
+            memset(row, 0, sizeof(row));
+            haveFrames = false;
+            continue;
+        }
+
+        if (!logSelected) {
+            continue;
+        }
+
+        switch (decoded) {
+            case BLACKBOX_DECODED_MAIN:
+                memcpy(row, decoder.frame.values, mainFieldCount * sizeof(int32_t));
+                writeRow(&mainOutput, row);
+                if (!haveFrames) {
+                    firstTime = decoder.frame.time;
+                    haveFrames = true;
+                }
+                lastTime = decoder.frame.time;
+            break;
+            case BLACKBOX_DECODED_SLOW:
+                memcpy(row + mainFieldCount, decoder.frame.values, slowFieldCount * sizeof(int32_t));
+            break;
+            case BLACKBOX_DECODED_GPS:
+                if (gpsOutput.file) {
+                    int32_t gpsRow[BLACKBOX_DECODER_MAX_FIELDS + 1];
+                    int count = 0;
+
+                    gpsRow[count++] = decoder.frame.time;
+                    for (int i = 0; i < gpsFieldCount; i++) {
+                        if (i != decoder.gpsTimeField) {
+                            gpsRow[count++] = decoder.frame.values[i];
+                        }
+                    }
+                    writeRow(&gpsOutput, gpsRow);
+                }
+            break;
+            case BLACKBOX_DECODED_EVENT:
+                writeEvent(eventFile, &decoder);
+            break;
+            case BLACKBOX_DECODED_LOG_END:
+                closeColumnOutput(&mainOutput);
+                closeColumnOutput(&gpsOutput);
+                if (eventFile) {
+                    fclose(eventFile);
+                    eventFile = NULL;
+                }
+                printStats(&decoder, firstTime, lastTime);
+                logSelected = false;
+            break;
+            default:
+            break;
+        }
+    }
+
+    fclose(input);
+}
+
+static void usage(void)
+{
+    fprintf(stderr,
+        "usage: blackbox_decode [options] <logfile>...\n"
+        "    --binary       write columnar binary files (.bin) instead of CSV\n"
+        "    --index <n>    only decode the n-th log in each file, from 1\n"
+        "    --prefix <p>   start the output file names with p rather than the log file name\n"
+        "    --stdout       write the main frames to stdout, leave out GPS and events\n"
+        "    --help         show this text\n");
+}
+
+int main(int argc, char **argv)
+{
+    static const struct option longOptions[] = {
+        { "binary", no_argument,       NULL, 'b' },
+        { "index",  required_argument, NULL, 'i' },
+        { "prefix", required_argument, NULL, 'p' },
+        { "stdout", no_argument,       NULL, 's' },
+        { "help",   no_argument,       NULL, 'h' },
+        { NULL,     0,                 NULL, 0 }
+    };
+    int option;
+
+    while ((option = getopt_long(argc, argv, "bi:p:sh", longOptions, NULL)) != -1) {
+        switch (option) {
+            case 'b':
+                binaryOutput = true;
+            break;
+            case 'i':
+                selectedLog = atoi(optarg);
+            break;
+            case 'p':
+                outputPrefix = optarg;
+            break;
+            case 's':
+                writeToStdout = true;
+            break;
+            default:
+                usage();
+                return option == 'h' ? 0 : 1;
+        }
+    }
+
+    if (optind == argc) {
+        usage();
+        return 1;
+    }
+
+    for (int i = optind; i < argc; i++) {
+        decodeFile(argv[i]);
+    }
+
+    return 0;
+}